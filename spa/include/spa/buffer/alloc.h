@@ -250,10 +250,65 @@ spa_buffer_alloc_layout(struct spa_buffer_alloc_info *info,
 	return b;
 }
 
+/**
+ * Copy a buffer skeleton made with \ref spa_buffer_alloc_layout()
+ *
+ * The skeleton of \a src is copied to \a skel_mem and the pointers are
+ * moved to \a skel_mem and \a data_mem. This gives the same result as
+ * a layout with the same info, without computing the layout again.
+ *
+ * \param info the allocation info used for \a src
+ * \param src a buffer skeleton
+ * \param src_data the data memory used for \a src
+ * \param skel_mem memory to hold the copy
+ * \param data_mem memory to hold the meta, chunk and memory of the copy,
+ *	the offset from \a src_data should be a multiple of info->max_align
+ * \return a \ref struct spa_buffer in \a skel_mem
+ */
+static inline struct spa_buffer *
+spa_buffer_alloc_copy(struct spa_buffer_alloc_info *info, const struct spa_buffer *src,
+		const void *src_data, void *skel_mem, void *data_mem)
+{
+	struct spa_buffer *b = (struct spa_buffer*)skel_mem;
+	ptrdiff_t skel_diff, data_diff, *diff;
+	uint32_t i;
+
+	skel_diff = (const uint8_t*)skel_mem - (const uint8_t*)src;
+	data_diff = (const uint8_t*)data_mem - (const uint8_t*)src_data;
+
+	memcpy(b, src, sizeof(struct spa_buffer) +
+			info->n_metas * sizeof(struct spa_meta) +
+			info->n_datas * sizeof(struct spa_data));
+
+	/* the offsets can be larger than what SPA_MEMBER handles */
+	b->metas = (struct spa_meta*)((uint8_t*)b->metas + skel_diff);
+	b->datas = (struct spa_data*)((uint8_t*)b->datas + skel_diff);
+
+	diff = SPA_FLAG_IS_SET(info->flags, SPA_BUFFER_ALLOC_FLAG_INLINE_META) ?
+		&skel_diff : &data_diff;
+	for (i = 0; i < info->n_metas; i++)
+		b->metas[i].data = (uint8_t*)b->metas[i].data + *diff;
+
+	diff = SPA_FLAG_IS_SET(info->flags, SPA_BUFFER_ALLOC_FLAG_INLINE_CHUNK) ?
+		&skel_diff : &data_diff;
+	for (i = 0; i < info->n_datas; i++)
+		b->datas[i].chunk = (struct spa_chunk*)((uint8_t*)b->datas[i].chunk + *diff);
+
+	if (!SPA_FLAG_IS_SET(info->flags, SPA_BUFFER_ALLOC_FLAG_NO_DATA)) {
+		diff = SPA_FLAG_IS_SET(info->flags, SPA_BUFFER_ALLOC_FLAG_INLINE_DATA) ?
+			&skel_diff : &data_diff;
+		for (i = 0; i < info->n_datas; i++)
+			b->datas[i].data = (uint8_t*)b->datas[i].data + *diff;
+	}
+	return b;
+}
+
 /**
  * Layout an array of buffers
  *
  * Use the allocation info to layout the memory of an array of buffers.
+ * The first buffer is laid out, the others are copied from it with
+ * \ref spa_buffer_alloc_copy().
  *
  * \a skel_mem should point to at least info->skel_size * \a n_buffers bytes
  * of memory.
@@ -274,11 +329,17 @@ spa_buffer_alloc_layout_array(struct spa_buffer_alloc_info *info,
 			      uint32_t n_buffers, struct spa_buffer *buffers[],
 			      void *skel_mem, void *data_mem)
 {
+	void *data = data_mem;
 	uint32_t i;
-	for (i = 0; i < n_buffers; i++) {
-		buffers[i] = spa_buffer_alloc_layout(info, skel_mem, data_mem);
+
+	if (n_buffers == 0)
+		return 0;
+
+	buffers[0] = spa_buffer_alloc_layout(info, skel_mem, data_mem);
+	for (i = 1; i < n_buffers; i++) {
 		skel_mem = SPA_MEMBER(skel_mem, info->skel_size, void);
 		data_mem = SPA_MEMBER(data_mem, info->mem_size, void);
+		buffers[i] = spa_buffer_alloc_copy(info, buffers[0], data, skel_mem, data_mem);
         }
 	return 0;
 }
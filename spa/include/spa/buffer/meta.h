@@ -45,6 +45,7 @@ enum spa_meta_type {
 	SPA_META_Cursor,	/**< struct spa_meta_cursor */
 	SPA_META_Control,	/**< metadata contains a spa_meta_control
 				  *  associated with the data */
+	SPA_META_SyncFence,	/**< struct spa_meta_sync_fence */
 
 	SPA_META_LAST,		/**< not part of ABI/API */
 };
@@ -144,6 +145,25 @@ struct spa_meta_control {
 	struct spa_pod_sequence sequence;
 };
 
+/**
+ * Explicit synchronization
+ *
+ * sync_file fds that signal when the GPU is done with the buffer, -1 when
+ * there is no fence. The fds are only valid in the process that placed
+ * them so this metadata must only be negotiated between nodes that share
+ * an address space.
+ *
+ * The producer sets acquire_fd when it queues a buffer that is still
+ * being rendered, the consumer waits for it before reading the data,
+ * closes it and sets it to -1. The consumer sets release_fd when it
+ * recycles a buffer that is still being read, the producer waits for it
+ * before writing, closes it and sets it to -1.
+ */
+struct spa_meta_sync_fence {
+	int32_t acquire_fd;		/**< signals when the data can be read */
+	int32_t release_fd;		/**< signals when the buffer can be written */
+};
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -73,6 +73,7 @@ static const struct spa_type_info spa_type_meta_type[] = {
 	{ SPA_META_Bitmap, SPA_TYPE_Pointer, SPA_TYPE_INFO_META_BASE "Bitmap", NULL },
 	{ SPA_META_Cursor, SPA_TYPE_Pointer, SPA_TYPE_INFO_META_BASE "Cursor", NULL },
 	{ SPA_META_Control, SPA_TYPE_Pointer, SPA_TYPE_INFO_META_BASE "Control", NULL },
+	{ SPA_META_SyncFence, SPA_TYPE_Pointer, SPA_TYPE_INFO_META_BASE "SyncFence", NULL },
 	{ 0, 0, NULL, NULL },
 };
 
@@ -89,6 +89,14 @@ static inline int spa_debug_buffer(int indent, const struct spa_buffer *buffer)
 			break;
 		case SPA_META_Cursor:
 			break;
+		case SPA_META_SyncFence:
+		{
+			struct spa_meta_sync_fence *h = (struct spa_meta_sync_fence*)m->data;
+			spa_debug("%*s" "    struct spa_meta_sync_fence:", indent, "");
+			spa_debug("%*s" "      acquire_fd: %d", indent, "", h->acquire_fd);
+			spa_debug("%*s" "      release_fd: %d", indent, "", h->release_fd);
+			break;
+		}
 		default:
 			spa_debug("%*s" "    Unknown:", indent, "");
 			spa_debug_mem(5, m->data, m->size);
@@ -121,6 +121,8 @@ struct spa_io_range {
  * since the provider was last started.
  */
 struct spa_io_clock {
+#define SPA_IO_CLOCK_FLAG_FREEWHEEL	(1<<0)	/**< the graph runs as fast as it can,
+						  *  clock times do not follow real time */
 	uint32_t flags;			/**< clock flags */
 	uint32_t id;			/**< unique clock id, set by application */
 	char name[64];			/**< clock name prefixed with API, set by node. The clock name
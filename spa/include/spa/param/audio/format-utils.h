@@ -75,6 +75,26 @@ spa_format_audio_raw_build(struct spa_pod_builder *builder, uint32_t id, struct
 	return (struct spa_pod*)spa_pod_builder_pop(builder, &f);
 }
 
+static inline int
+spa_format_audio_iec958_parse(const struct spa_pod *format, struct spa_audio_info_iec958 *info)
+{
+	info->flags = 0;
+	return spa_pod_parse_object(format,
+			SPA_TYPE_OBJECT_Format, NULL,
+			SPA_FORMAT_AUDIO_iec958Codec,	SPA_POD_Id(&info->codec),
+			SPA_FORMAT_AUDIO_rate,		SPA_POD_Int(&info->rate));
+}
+
+static inline struct spa_pod *
+spa_format_audio_iec958_build(struct spa_pod_builder *builder, uint32_t id, struct spa_audio_info_iec958 *info)
+{
+	return (struct spa_pod *)spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, id,
+			SPA_FORMAT_mediaType,		SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,	SPA_POD_Id(SPA_MEDIA_SUBTYPE_iec958),
+			SPA_FORMAT_AUDIO_iec958Codec,	SPA_POD_Id(info->codec),
+			SPA_FORMAT_AUDIO_rate,		SPA_POD_Int(info->rate));
+}
 
 #ifdef __cplusplus
 }  /* extern "C" */
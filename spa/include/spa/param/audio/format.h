@@ -31,12 +31,14 @@ extern "C" {
 
 #include <spa/param/format.h>
 #include <spa/param/audio/raw.h>
+#include <spa/param/audio/iec958.h>
 
 struct spa_audio_info {
 	uint32_t media_type;
 	uint32_t media_subtype;
 	union {
 		struct spa_audio_info_raw raw;
+		struct spa_audio_info_iec958 iec958;
 	} info;
 };
 
@@ -61,6 +61,7 @@ enum spa_media_subtype {
 	SPA_MEDIA_SUBTYPE_g729,
 	SPA_MEDIA_SUBTYPE_amr,
 	SPA_MEDIA_SUBTYPE_gsm,
+	SPA_MEDIA_SUBTYPE_iec958,	/**< compressed audio in IEC958 frames */
 
 	SPA_MEDIA_SUBTYPE_START_Video	= 0x20000,
 	SPA_MEDIA_SUBTYPE_h264,
@@ -104,6 +105,7 @@ enum spa_format {
 	SPA_FORMAT_AUDIO_rate,		/**< sample rate (Int) */
 	SPA_FORMAT_AUDIO_channels,	/**< number of audio channels (Int) */
 	SPA_FORMAT_AUDIO_position,	/**< channel positions (Id enum spa_audio_position) */
+	SPA_FORMAT_AUDIO_iec958Codec,	/**< codec used (IEC958) (Id enum spa_audio_iec958_codec) */
 
 	/* Video Format keys */
 	SPA_FORMAT_START_Video = 0x20000,
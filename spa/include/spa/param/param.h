@@ -69,6 +69,8 @@ enum spa_param_buffers {
 	SPA_PARAM_BUFFERS_size,		/**< size of a data block memory (Int)*/
 	SPA_PARAM_BUFFERS_stride,	/**< stride of data block memory (Int) */
 	SPA_PARAM_BUFFERS_align,	/**< alignment of data block memory (Int) */
+	SPA_PARAM_BUFFERS_dataType,	/**< possible memory types (flags choice Int, mask
+					  *  of enum spa_data_type) */
 };
 
 /** properties for SPA_TYPE_OBJECT_ParamMeta */
@@ -74,6 +74,9 @@ enum spa_prop {
 	SPA_PROP_ditherType,
 	SPA_PROP_truncate,
 	SPA_PROP_channelVolumes,
+	SPA_PROP_volumeRampSamples,	/**< ramp volume changes over this many samples (Int) */
+	SPA_PROP_volumeRampScale,	/**< scale of the volume ramp (Int), 0 is linear,
+					  *  1 is logarithmic */
 
 	SPA_PROP_START_Video	= 0x20000,	/**< video related properties */
 	SPA_PROP_brightness,
@@ -643,6 +643,44 @@ static inline int spa_pod_builder_add(struct spa_pod_builder *builder, ...)
 	spa_pod_builder_pop(b, &f);						\
 })
 
+/** Get the offset of the value of property \a key in the object \a tmpl.
+ * For a choice this is the offset of the default value. The offset can be
+ * used with SPA_POD_TEMPLATE_VALUE() on copies made with
+ * spa_pod_builder_template(). Returns 0 when the property is not found. */
+static inline uint32_t
+spa_pod_template_offset(const struct spa_pod *tmpl, uint32_t key)
+{
+	const struct spa_pod_prop *prop;
+	const void *value;
+
+	if ((prop = spa_pod_find_prop(tmpl, NULL, key)) == NULL)
+		return 0;
+
+	if (prop->value.type == SPA_TYPE_Choice)
+		value = SPA_POD_CHOICE_VALUES(&prop->value);
+	else
+		value = SPA_POD_BODY_CONST(&prop->value);
+
+	return SPA_PTRDIFF(value, tmpl);
+}
+
+#define SPA_POD_TEMPLATE_VALUE(pod,offset,type)	SPA_MEMBER(pod,offset,type)
+
+/** Add a copy of a prebuilt object \a tmpl with one write. The size of an
+ * object is always padded so no extra padding is added. Values in the copy
+ * can then be filled in at the offsets from spa_pod_template_offset().
+ * Returns the copy or NULL when it does not fit. */
+static inline struct spa_pod *
+spa_pod_builder_template(struct spa_pod_builder *builder, const struct spa_pod *tmpl)
+{
+	uint32_t offset = builder->state.offset;
+
+	if (spa_pod_builder_raw(builder, tmpl, SPA_POD_SIZE(tmpl)) < 0)
+		return NULL;
+
+	return spa_pod_builder_deref(builder, offset);
+}
+
 /** Copy a pod structure */
 static inline struct spa_pod *
 spa_pod_copy(const struct spa_pod *pod)
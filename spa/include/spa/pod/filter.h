@@ -86,6 +86,67 @@ static inline int spa_pod_choice_fix_default(struct spa_pod_choice *choice)
 	return 0;
 }
 
+/* enums with at least this many values are intersected with a sorted copy
+ * of the second enum, the stack space for the copy limits the maximum */
+#define SPA_POD_FILTER_SORT_MIN	8
+#define SPA_POD_FILTER_SORT_MAX	256
+
+static inline int spa_pod_filter_compare_key(const void *k1, const void *k2)
+{
+	uint64_t v1 = *(const uint64_t*)k1, v2 = *(const uint64_t*)k2;
+	return v1 < v2 ? -1 : v1 > v2 ? 1 : 0;
+}
+
+/* types where equal values have equal bits so that they can be compared
+ * as integers */
+static inline bool spa_pod_filter_can_sort(uint32_t type, uint32_t size)
+{
+	switch (type) {
+	case SPA_TYPE_Bool:
+	case SPA_TYPE_Id:
+	case SPA_TYPE_Int:
+		return size == sizeof(uint32_t);
+	case SPA_TYPE_Long:
+	case SPA_TYPE_Rectangle:
+		return size == sizeof(uint64_t);
+	default:
+		return false;
+	}
+}
+
+static inline uint64_t spa_pod_filter_key(const void *val, uint32_t size)
+{
+	uint64_t key = 0;
+	memcpy(&key, val, size);
+	return key;
+}
+
+/* copy the values of alt1 that are also in alt2, in the order of alt1.
+ * Returns the number of copied values. */
+static inline int
+spa_pod_filter_enum_sorted(struct spa_pod_builder *b, uint32_t size,
+		const void *alt1, uint32_t nalt1, const void *alt2, uint32_t nalt2)
+{
+	uint64_t keys[SPA_POD_FILTER_SORT_MAX], key;
+	const void *a1;
+	uint32_t j;
+	int n_copied = 0;
+
+	for (j = 0; j < nalt2; j++)
+		keys[j] = spa_pod_filter_key(SPA_MEMBER(alt2, j * size, void), size);
+	qsort(keys, nalt2, sizeof(uint64_t), spa_pod_filter_compare_key);
+
+	for (j = 0, a1 = alt1; j < nalt1; j++, a1 = SPA_MEMBER(a1, size, void)) {
+		key = spa_pod_filter_key(a1, size);
+		if (bsearch(&key, keys, nalt2, sizeof(uint64_t),
+					spa_pod_filter_compare_key) == NULL)
+			continue;
+		spa_pod_builder_raw(b, a1, size);
+		n_copied++;
+	}
+	return n_copied;
+}
+
 static inline int
 spa_pod_filter_prop(struct spa_pod_builder *b,
 	    const struct spa_pod_prop *p1,
@@ -137,6 +198,14 @@ spa_pod_filter_prop(struct spa_pod_builder *b,
 	    (p1c == SPA_CHOICE_Enum && p2c == SPA_CHOICE_None) ||
 	    (p1c == SPA_CHOICE_Enum && p2c == SPA_CHOICE_Enum)) {
 		int n_copied = 0;
+		if (nalt1 >= SPA_POD_FILTER_SORT_MIN &&
+		    nalt2 >= SPA_POD_FILTER_SORT_MIN &&
+		    nalt2 <= SPA_POD_FILTER_SORT_MAX &&
+		    spa_pod_filter_can_sort(type, size)) {
+			n_copied = spa_pod_filter_enum_sorted(b, size,
+					alt1, nalt1, alt2, nalt2);
+			nalt1 = 0;
+		}
 		/* copy all equal values but don't copy the default value again */
 		for (j = 0, a1 = alt1; j < nalt1; j++, a1 = SPA_MEMBER(a1, size, void)) {
 			for (k = 0, a2 = alt2; k < nalt2; k++, a2 = SPA_MEMBER(a2,size,void)) {
@@ -191,6 +260,28 @@ spa_pod_filter_prop(struct spa_pod_builder *b,
 		nc->body.type = SPA_CHOICE_Enum;
 	}
 
+	if ((p1c == SPA_CHOICE_None || p1c == SPA_CHOICE_Flags) &&
+	    (p2c == SPA_CHOICE_None || p2c == SPA_CHOICE_Flags) &&
+	    (p1c == SPA_CHOICE_Flags || p2c == SPA_CHOICE_Flags)) {
+		int32_t *val = (int32_t *)SPA_POD_CHOICE_VALUES(nc);
+		int32_t f1, f2;
+
+		if (type != SPA_TYPE_Int)
+			return -ENOTSUP;
+
+		/* keep the common flags, a plain value must be one of the flags */
+		f1 = *(int32_t *)SPA_POD_BODY(v1);
+		f2 = *(int32_t *)SPA_POD_BODY(v2);
+		*val = f1 & f2;
+		if (*val == 0 ||
+		    (p1c == SPA_CHOICE_None && *val != f1) ||
+		    (p2c == SPA_CHOICE_None && *val != f2))
+			return -EINVAL;
+
+		nc->body.type = p1c == SPA_CHOICE_None || p2c == SPA_CHOICE_None ?
+			SPA_CHOICE_None : SPA_CHOICE_Flags;
+	}
+
 	if (p1c == SPA_CHOICE_Range && p2c == SPA_CHOICE_Range) {
 		if (spa_pod_compare_value(type, alt1, alt2, size) < 0)
 			spa_pod_builder_raw(b, alt2, size);
@@ -208,9 +299,6 @@ spa_pod_filter_prop(struct spa_pod_builder *b,
 		nc->body.type = SPA_CHOICE_Range;
 	}
 
-	if (p1c == SPA_CHOICE_None && p2c == SPA_CHOICE_Flags)
-		return -ENOTSUP;
-
 	if (p1c == SPA_CHOICE_Range && p2c == SPA_CHOICE_Step)
 		return -ENOTSUP;
 
@@ -232,16 +320,12 @@ spa_pod_filter_prop(struct spa_pod_builder *b,
 	if (p1c == SPA_CHOICE_Step && p2c == SPA_CHOICE_Flags)
 		return -ENOTSUP;
 
-	if (p1c == SPA_CHOICE_Flags && p2c == SPA_CHOICE_None)
-		return -ENOTSUP;
 	if (p1c == SPA_CHOICE_Flags && p2c == SPA_CHOICE_Range)
 		return -ENOTSUP;
 	if (p1c == SPA_CHOICE_Flags && p2c == SPA_CHOICE_Step)
 		return -ENOTSUP;
 	if (p1c == SPA_CHOICE_Flags && p2c == SPA_CHOICE_Enum)
 		return -ENOTSUP;
-	if (p1c == SPA_CHOICE_Flags && p2c == SPA_CHOICE_Flags)
-		return -ENOTSUP;
 
 	spa_pod_builder_pop(b, &f);
 	spa_pod_choice_fix_default(nc);
@@ -245,6 +245,27 @@ static inline int spa_pod_parser_get_pod(struct spa_pod_parser *parser, struct s
 	spa_pod_parser_advance(parser, pod);
 	return 0;
 }
+static inline int spa_pod_parser_get_array(struct spa_pod_parser *parser,
+		uint32_t *child_type, uint32_t *n_values, const void **values)
+{
+	const struct spa_pod *pod = spa_pod_parser_current(parser);
+	if (pod == NULL)
+		return -EPIPE;
+	if (!spa_pod_is_array(pod))
+		return -EINVAL;
+	*child_type = SPA_POD_ARRAY_VALUE_TYPE(pod);
+	*n_values = SPA_POD_ARRAY_VALUE_SIZE(pod) ? SPA_POD_ARRAY_N_VALUES(pod) : 0;
+	*values = SPA_POD_ARRAY_VALUES(pod);
+	spa_pod_parser_advance(parser, pod);
+	return 0;
+}
+
+/** Skip the next pod without looking at its type or contents */
+static inline int spa_pod_parser_skip(struct spa_pod_parser *parser)
+{
+	return spa_pod_parser_next(parser) ? 0 : -EPIPE;
+}
+
 static inline int spa_pod_parser_push_struct(struct spa_pod_parser *parser,
 		struct spa_pod_frame *frame)
 {
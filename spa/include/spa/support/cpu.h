@@ -78,6 +78,12 @@ struct spa_cpu { struct spa_interface iface; };
 #define SPA_CPU_FLAG_ARMV8		(1 << 6)
 
 #define SPA_CPU_FORCE_AUTODETECT	((uint32_t)-1)
+
+/** check if all the cpu flags \a req, required by an implementation,
+ * are present in \a flags. An implementation without requirements
+ * always matches. */
+#define SPA_CPU_FLAGS_MATCH(req,flags)	((req) == 0 || ((req) & (flags)) == (req))
+
 /**
  * methods
  */
@@ -115,7 +121,8 @@ struct spa_cpu_methods {
 #define spa_cpu_get_max_align(c)	spa_cpu_method(c, get_max_align, 0)
 
 /** keys can be given when initializing the cpu handle */
-#define SPA_KEY_CPU_FORCE		"cpu.force"		/**< force cpu flags */
+#define SPA_KEY_CPU_FORCE		"cpu.force"		/**< force cpu flags, as a decimal
+								  *  or 0x prefixed hex mask */
 
 #ifdef __cplusplus
 }  /* extern "C" */
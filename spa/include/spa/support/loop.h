@@ -41,6 +41,10 @@ struct spa_loop_control { struct spa_interface iface; };
 struct spa_loop_utils { struct spa_interface iface; };
 struct spa_source;
 
+/** the time in microseconds to poll the fds of the loop without
+ * blocking before waiting for them, 0 (the default) to not poll */
+#define SPA_KEY_LOOP_BUSY_POLL		"loop.busy-poll"
+
 typedef void (*spa_source_func_t) (struct spa_source *source);
 
 struct spa_source {
@@ -65,7 +69,7 @@ typedef int (*spa_invoke_func_t) (struct spa_loop *loop,
 struct spa_loop_methods {
 	/* the version of this structure. This can be used to expand this
 	 * structure in the future */
-#define SPA_VERSION_LOOP_METHODS	0
+#define SPA_VERSION_LOOP_METHODS	1
 	uint32_t version;
 
 	/** add a source to the loop */
@@ -88,6 +92,15 @@ struct spa_loop_methods {
 		       size_t size,
 		       bool block,
 		       void *user_data);
+
+	/** start a batch of invokes from this thread. The loop is not
+	 * woken up for the non-blocking invokes until the batch is
+	 * committed. Since version 1. */
+	int (*begin_batch) (void *object);
+
+	/** commit a batch of invokes, the loop is woken up once for all
+	 * of them. Since version 1. */
+	int (*commit_batch) (void *object);
 };
 
 #define spa_loop_method(o,method,version,...)				\
@@ -104,6 +117,8 @@ struct spa_loop_methods {
 #define spa_loop_update_source(l,...)	spa_loop_method(l,update_source,0,##__VA_ARGS__)
 #define spa_loop_remove_source(l,...)	spa_loop_method(l,remove_source,0,##__VA_ARGS__)
 #define spa_loop_invoke(l,...)		spa_loop_method(l,invoke,0,##__VA_ARGS__)
+#define spa_loop_begin_batch(l)		spa_loop_method(l,begin_batch,1)
+#define spa_loop_commit_batch(l)	spa_loop_method(l,commit_batch,1)
 
 
 /** Control hooks */
@@ -50,6 +50,26 @@ extern "C" {
 									  *  used in snd_pcm_open() and
 									  *  snd_ctl_open(). */
 #define SPA_KEY_API_ALSA_CARD		"api.alsa.card"			/**< alsa card number */
+#define SPA_KEY_API_ALSA_PERIOD_WAKEUP	"api.alsa.period-wakeup"	/**< wake up on period interrupts
+									  *  of the device instead of a
+									  *  timer, boolean */
+#define SPA_KEY_API_ALSA_REWIND		"api.alsa.rewind"		/**< rewind already queued samples
+									  *  when the quantum shrinks,
+									  *  boolean */
+#define SPA_KEY_API_ALSA_HEADROOM	"api.alsa.headroom"		/**< minimum extra samples to keep
+									  *  queued in the device, more
+									  *  is added after xruns */
+#define SPA_KEY_API_ALSA_DSP		"api.alsa.dsp"			/**< convert to and from planar
+									  *  32 bit float in the node,
+									  *  boolean */
+#define SPA_KEY_API_ALSA_AGGREGATE	"api.alsa.aggregate"		/**< space separated list of alsa
+									  *  device paths that are opened
+									  *  as one node with the channels
+									  *  of all devices. */
+#define SPA_KEY_API_ALSA_IEC958_CODECS	"api.alsa.iec958-codecs"	/**< space separated list of
+									  *  codecs the device can pass
+									  *  through in IEC958 frames,
+									  *  Ex. "AC3 DTS" */
 
 /** info from alsa card_info */
 #define SPA_KEY_API_ALSA_CARD_ID	"api.alsa.card.id"		/**< id from card_info */
@@ -95,11 +115,35 @@ extern "C" {
 #define SPA_KEY_API_BLUEZ5_TRANSPORT	"api.bluez5.transport"		/**< an internal bluez5 transport */
 #define SPA_KEY_API_BLUEZ5_PROFILE	"api.bluez5.profile"		/**< a bluetooth profile */
 #define SPA_KEY_API_BLUEZ5_ADDRESS	"api.bluez5.address"		/**< a bluetooth address */
+#define SPA_KEY_API_BLUEZ5_LOW_LATENCY	"api.bluez5.low-latency"	/**< send small a2dp packets, trading
+									  *  bandwidth efficiency for latency */
 
 /** keys for jack api */
 #define SPA_KEY_API_JACK		"api.jack"			/**< key for the JACK api */
 #define SPA_KEY_API_JACK_SERVER		"api.jack.server"		/**< a jack server name */
 #define SPA_KEY_API_JACK_CLIENT		"api.jack.client"		/**< an internal jack client */
+#define SPA_KEY_API_JACK_ZERO_COPY	"api.jack.zero-copy"		/**< let buffers point to the jack
+									  *  port memory, boolean */
+
+/** keys for rtp api */
+#define SPA_KEY_API_RTP			"api.rtp"			/**< key for the rtp api */
+#define SPA_KEY_API_RTP_DESTINATION_IP	"api.rtp.destination.ip"	/**< address to send to, can be
+									  *  multicast */
+#define SPA_KEY_API_RTP_DESTINATION_PORT	\
+					"api.rtp.destination.port"	/**< port to send to */
+#define SPA_KEY_API_RTP_SOURCE_IP	"api.rtp.source.ip"		/**< address to receive on, a
+									  *  multicast group is joined */
+#define SPA_KEY_API_RTP_SOURCE_PORT	"api.rtp.source.port"		/**< port to receive on */
+#define SPA_KEY_API_RTP_INTERFACE	"api.rtp.interface"		/**< network interface for
+									  *  multicast */
+#define SPA_KEY_API_RTP_ENCODING	"api.rtp.encoding"		/**< payload encoding, L16 or L24 */
+#define SPA_KEY_API_RTP_RATE		"api.rtp.rate"			/**< sample rate */
+#define SPA_KEY_API_RTP_CHANNELS	"api.rtp.channels"		/**< number of channels */
+#define SPA_KEY_API_RTP_PTIME		"api.rtp.ptime"			/**< packet time in microseconds */
+#define SPA_KEY_API_RTP_LATENCY		"api.rtp.latency"		/**< receive latency in frames */
+#define SPA_KEY_API_RTP_PTP_DEVICE	"api.rtp.ptp-device"		/**< PTP clock device to follow,
+									  *  like /dev/ptp0. CLOCK_TAI is
+									  *  used when not set */
 
 #ifdef __cplusplus
 }  /* extern "C" */
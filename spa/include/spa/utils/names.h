@@ -36,6 +36,9 @@ extern "C" {
 #define SPA_NAME_SUPPORT_LOOP		"support.loop"			/**< A Loop/LoopControl/LoopUtils
 									  *  interface */
 #define SPA_NAME_SUPPORT_SYSTEM		"support.system"		/**< A System interface */
+#define SPA_NAME_SUPPORT_NODE_DRIVER	"support.node.driver"		/**< A dummy driver node, driven by a
+									  *  timer or, with driver.freewheel,
+									  *  as fast as the graph can run */
 
 
 /* control mixer */
@@ -117,9 +120,18 @@ extern "C" {
 #define SPA_NAME_API_JACK_SOURCE	"api.jack.source"		/**< a jack source */
 #define SPA_NAME_API_JACK_SINK		"api.jack.sink"			/**< a jack sink */
 
+/** keys for rtp factory names */
+#define SPA_NAME_API_RTP_SINK		"api.rtp.sink"			/**< send audio as RTP/AES67 */
+#define SPA_NAME_API_RTP_SOURCE		"api.rtp.source"		/**< receive RTP/AES67 audio */
+
 /** keys for vulkan factory names */
 #define SPA_NAME_API_VULKAN_COMPUTE_SOURCE	\
 					"api.vulkan.compute.source"	/**< a vulkan compute source. */
+#define SPA_NAME_API_VULKAN_COMPUTE_FILTER	\
+					"api.vulkan.compute.filter"	/**< a vulkan compute filter. */
+#define SPA_NAME_API_VULKAN_AUDIO_CONVOLVER	\
+					"api.vulkan.audio.convolver"	/**< an audio convolver running
+									  *  on a vulkan device. */
 
 #ifdef __cplusplus
 }  /* extern "C" */
@@ -167,6 +167,106 @@ static inline void spa_ringbuffer_write_update(struct spa_ringbuffer *rbuf, int3
 }
 
 
+/**
+ * A ringbuffer index pair for one reader and one writer in the same
+ * process.
+ *
+ * The read and write index are 64 bytes apart so that the reader and
+ * writer don't update the same cache line. Each side also keeps a copy of
+ * the index of the other side and only loads the shared index when its
+ * copy says the ring is empty or full. Updating the index with more than
+ * one element commits a batch of elements at once.
+ *
+ * Unlike spa_ringbuffer this layout is not meant for shared memory.
+ */
+struct spa_ringbuffer_spsc {
+	uint32_t readindex;		/*< the read index, written by the reader */
+	uint32_t cached_writeindex;	/*< last write index seen by the reader */
+	uint8_t padding1[56];
+	uint32_t writeindex;		/*< the write index, written by the writer */
+	uint32_t cached_readindex;	/*< last read index seen by the writer */
+	uint8_t padding2[56];
+};
+
+static inline void spa_ringbuffer_spsc_init(struct spa_ringbuffer_spsc *rbuf)
+{
+	memset(rbuf, 0, sizeof(*rbuf));
+}
+
+/**
+ * Get the read index and the number of elements to read. Only for the
+ * reader. The result can be lower than the current fill level.
+ *
+ * \param rbuf a spa_ringbuffer_spsc
+ * \param index the value of readindex
+ * \return number of available elements to read
+ */
+static inline int32_t spa_ringbuffer_spsc_get_read_index(struct spa_ringbuffer_spsc *rbuf,
+		uint32_t *index)
+{
+	int32_t avail;
+
+	*index = rbuf->readindex;
+	avail = (int32_t) (rbuf->cached_writeindex - *index);
+	if (avail <= 0) {
+		rbuf->cached_writeindex = __atomic_load_n(&rbuf->writeindex, __ATOMIC_ACQUIRE);
+		avail = (int32_t) (rbuf->cached_writeindex - *index);
+	}
+	return avail;
+}
+
+/**
+ * Commit the elements read up to \a index. Only for the reader.
+ */
+static inline void spa_ringbuffer_spsc_read_update(struct spa_ringbuffer_spsc *rbuf,
+		uint32_t index)
+{
+	__atomic_store_n(&rbuf->readindex, index, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the write index and the fill level. Only for the writer. The read
+ * index is only loaded again when the ring looks full, so the result can
+ * be higher than the current fill level.
+ *
+ * \param rbuf a spa_ringbuffer_spsc
+ * \param index the value of writeindex
+ * \param size the number of elements in the ring
+ * \return the fill level of \a rbuf
+ */
+static inline int32_t spa_ringbuffer_spsc_get_write_index(struct spa_ringbuffer_spsc *rbuf,
+		uint32_t *index, uint32_t size)
+{
+	int32_t filled;
+
+	*index = rbuf->writeindex;
+	filled = (int32_t) (*index - rbuf->cached_readindex);
+	if (filled >= (int32_t) size) {
+		rbuf->cached_readindex = __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE);
+		filled = (int32_t) (*index - rbuf->cached_readindex);
+	}
+	return filled;
+}
+
+/**
+ * Commit the elements written up to \a index. Only for the writer.
+ */
+static inline void spa_ringbuffer_spsc_write_update(struct spa_ringbuffer_spsc *rbuf,
+		uint32_t index)
+{
+	__atomic_store_n(&rbuf->writeindex, index, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the current fill level from either side or from another thread.
+ * This always loads both shared indexes.
+ */
+static inline int32_t spa_ringbuffer_spsc_get_fill(struct spa_ringbuffer_spsc *rbuf)
+{
+	uint32_t read = __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE);
+	return (int32_t) (__atomic_load_n(&rbuf->writeindex, __ATOMIC_ACQUIRE) - read);
+}
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
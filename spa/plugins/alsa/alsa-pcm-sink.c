@@ -370,7 +370,10 @@ impl_node_port_enum_params(void *object, int seq,
 		if (result.index > 0)
 			return 0;
 
-		param = spa_format_audio_raw_build(&b, id, &this->current_format.info.raw);
+		if (this->current_format.media_subtype == SPA_MEDIA_SUBTYPE_iec958)
+			param = spa_format_audio_iec958_build(&b, id, &this->current_format.info.iec958);
+		else
+			param = spa_format_audio_raw_build(&b, id, &this->current_format.info.raw);
 		break;
 
 	case SPA_PARAM_Buffers:
@@ -382,12 +385,12 @@ impl_node_port_enum_params(void *object, int seq,
 		param = spa_pod_builder_add_object(&b,
 			SPA_TYPE_OBJECT_ParamBuffers, id,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(3, 1, MAX_BUFFERS),
-			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(this->blocks),
 			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
-							this->props.max_latency * this->frame_size,
-							this->props.min_latency * this->frame_size,
+							this->props.max_latency * this->stride,
+							this->props.min_latency * this->stride,
 							INT32_MAX),
-			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->frame_size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->stride),
 			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
 		break;
 
@@ -444,6 +447,9 @@ static int clear_buffers(struct state *this)
 		spa_list_init(&this->ready);
 		this->n_buffers = 0;
 	}
+	free(this->buffer_mem);
+	this->buffer_mem = NULL;
+	this->direct = false;
 	return 0;
 }
 
@@ -470,12 +476,23 @@ static int port_set_format(void *object,
 		if ((err = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
 			return err;
 
-		if (info.media_type != SPA_MEDIA_TYPE_audio ||
-		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		if (info.media_type != SPA_MEDIA_TYPE_audio)
 			return -EINVAL;
 
-		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+		switch (info.media_subtype) {
+		case SPA_MEDIA_SUBTYPE_raw:
+			if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+				return -EINVAL;
+			break;
+		case SPA_MEDIA_SUBTYPE_iec958:
+			if (spa_format_audio_iec958_parse(format, &info.info.iec958) < 0)
+				return -EINVAL;
+			if (!(this->props.iec958_codecs & (1u << info.info.iec958.codec)))
+				return -ENOTSUP;
+			break;
+		default:
 			return -EINVAL;
+		}
 
 		if ((err = spa_alsa_set_format(this, &info, flags)) < 0)
 			return err;
@@ -525,7 +542,7 @@ impl_node_port_use_buffers(void *object,
 			   struct spa_buffer **buffers, uint32_t n_buffers)
 {
 	struct state *this = object;
-	uint32_t i;
+	uint32_t i, j;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -541,6 +558,23 @@ impl_node_port_use_buffers(void *object,
 		clear_buffers(this);
 		return 0;
 	}
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	clear_buffers(this);
+
+	if (flags & SPA_NODE_BUFFERS_FLAG_ALLOC) {
+		/* we fill in the memory. Free buffers are pointed at the mmap
+		 * area when possible so that the upstream node renders into
+		 * the device directly, the allocated memory is used when
+		 * there is not enough contiguous space. */
+		this->buffer_maxsize = buffers[0]->datas[0].maxsize;
+		this->buffer_mem = malloc(n_buffers * this->blocks * (this->buffer_maxsize + 64));
+		if (this->buffer_mem == NULL)
+			return -errno;
+		this->direct = snd_pcm_type(this->hndl) == SND_PCM_TYPE_HW &&
+			!this->dsp;
+	}
 
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b = &this->buffers[i];
@@ -549,9 +583,26 @@ impl_node_port_use_buffers(void *object,
 		b->buf = buffers[i];
 		b->id = i;
 		b->flags = BUFFER_FLAG_OUT;
+		b->mem = NULL;
 
 		b->h = spa_buffer_find_meta_data(b->buf, SPA_META_Header, sizeof(*b->h));
 
+		if (buffers[i]->n_datas < this->blocks) {
+			spa_log_error(this->log, NAME " %p: need %d data blocks", this,
+					this->blocks);
+			return -EINVAL;
+		}
+		for (j = 0; this->buffer_mem && j < this->blocks; j++) {
+			void *mem = SPA_PTR_ALIGN(SPA_MEMBER(this->buffer_mem,
+					(i * this->blocks + j) * (this->buffer_maxsize + 64),
+					void), 64, void);
+			if (j == 0)
+				b->mem = mem;
+			d[j].type = SPA_DATA_MemPtr;
+			d[j].flags |= SPA_DATA_FLAG_DYNAMIC;
+			d[j].data = mem;
+			d[j].maxsize = this->buffer_maxsize;
+		}
 		if (d[0].data == NULL) {
 			spa_log_error(this->log, NAME " %p: need mapped memory", this);
 			return -EINVAL;
@@ -670,6 +721,13 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct state *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct state *) handle;
+	free(this->buffer_mem);
+	this->buffer_mem = NULL;
 	return 0;
 }
 
@@ -705,6 +763,9 @@ impl_init(const struct spa_handle_factory *factory,
 		case SPA_TYPE_INTERFACE_DataLoop:
 			this->data_loop = support[i].data;
 			break;
+		case SPA_TYPE_INTERFACE_CPU:
+			this->cpu_flags = spa_cpu_get_flags((struct spa_cpu*)support[i].data);
+			break;
 		}
 	}
 	if (this->data_loop == NULL) {
@@ -744,7 +805,8 @@ impl_init(const struct spa_handle_factory *factory,
 	this->port_info = SPA_PORT_INFO_INIT();
 	this->port_info.flags = SPA_PORT_FLAG_LIVE |
 			   SPA_PORT_FLAG_PHYSICAL |
-			   SPA_PORT_FLAG_TERMINAL;
+			   SPA_PORT_FLAG_TERMINAL |
+			   SPA_PORT_FLAG_CAN_ALLOC_BUFFERS;
 	this->port_params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
 	this->port_params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
 	this->port_params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
@@ -758,6 +820,22 @@ impl_init(const struct spa_handle_factory *factory,
 	for (i = 0; info && i < info->n_items; i++) {
 		if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PATH)) {
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PERIOD_WAKEUP)) {
+			const char *str = info->items[i].value;
+			this->period_wakeup = strcmp(str, "true") == 0 || atoi(str) == 1;
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_DSP)) {
+			const char *str = info->items[i].value;
+			this->dsp = strcmp(str, "true") == 0 || atoi(str) == 1;
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_HEADROOM)) {
+			this->props.headroom = atoi(info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_REWIND)) {
+			const char *str = info->items[i].value;
+			this->rewind = strcmp(str, "true") == 0 || atoi(str) == 1;
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_AGGREGATE)) {
+			snprintf(this->props.aggregate, sizeof(this->props.aggregate),
+					"%s", info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_IEC958_CODECS)) {
+			this->props.iec958_codecs = spa_alsa_parse_iec958_codecs(info->items[i].value);
 		}
 	}
 
@@ -790,7 +868,13 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Play audio with the alsa API" },
-	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<path>]" },
+	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<path>] "
+				"["SPA_KEY_API_ALSA_AGGREGATE"=<path ...>] "
+				"["SPA_KEY_API_ALSA_PERIOD_WAKEUP"=<bool>] "
+				"["SPA_KEY_API_ALSA_HEADROOM"=<samples>] "
+				"["SPA_KEY_API_ALSA_DSP"=<bool>] "
+				"["SPA_KEY_API_ALSA_REWIND"=<bool>] "
+				"["SPA_KEY_API_ALSA_IEC958_CODECS"=<codecs>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
@@ -23,6 +23,8 @@
  */
 
 #include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <alsa/asoundlib.h>
 
@@ -343,7 +345,7 @@ static void recycle_buffer(struct state *this, uint32_t buffer_id)
 	if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT)) {
 		spa_log_trace_fp(this->log, NAME " %p: recycle buffer %u", this, buffer_id);
 		spa_list_append(&this->free, &b->link);
-		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUT);
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUT | BUFFER_FLAG_MMAP);
 	}
 }
 
@@ -394,12 +396,12 @@ impl_node_port_enum_params(void *object, int seq,
 		param = spa_pod_builder_add_object(&b,
 			SPA_TYPE_OBJECT_ParamBuffers, id,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
-			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(this->blocks),
 			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
-							this->props.max_latency * this->frame_size,
-							this->props.min_latency * this->frame_size,
+							this->props.max_latency * this->stride,
+							this->props.min_latency * this->stride,
 							INT32_MAX),
-			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->frame_size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->stride),
 			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
 		break;
 
@@ -450,6 +452,47 @@ impl_node_port_enum_params(void *object, int seq,
 	return 0;
 }
 
+static void free_buffer_mem(struct state *this)
+{
+	if (this->buffer_fd != -1) {
+		munmap(this->buffer_mem, this->buffer_mem_size);
+		close(this->buffer_fd);
+		this->buffer_fd = -1;
+	} else {
+		free(this->buffer_mem);
+	}
+	this->buffer_mem = NULL;
+	this->buffer_mem_size = 0;
+}
+
+/* buffers that are shared with other processes get memory from a memfd,
+ * the peers can't see our own allocations */
+static int alloc_buffer_mem(struct state *this, size_t size, bool shared)
+{
+	void *mem;
+	int fd;
+
+	if (!shared) {
+		if ((errno = posix_memalign(&mem, 64, size)) != 0)
+			return -errno;
+		this->buffer_mem = mem;
+		this->buffer_mem_size = size;
+		return 0;
+	}
+	if ((fd = memfd_create("pipewire-alsa", MFD_CLOEXEC)) < 0)
+		return -errno;
+	if (ftruncate(fd, size) < 0 ||
+	    (mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		int res = -errno;
+		close(fd);
+		return res;
+	}
+	this->buffer_fd = fd;
+	this->buffer_mem = mem;
+	this->buffer_mem_size = size;
+	return 0;
+}
+
 static int clear_buffers(struct state *this)
 {
 	if (this->n_buffers > 0) {
@@ -457,6 +500,8 @@ static int clear_buffers(struct state *this)
 		spa_list_init(&this->ready);
 		this->n_buffers = 0;
 	}
+	free_buffer_mem(this);
+	this->direct = false;
 	return 0;
 }
 
@@ -543,7 +588,8 @@ impl_node_port_use_buffers(void *object,
 {
 	struct state *this = object;
 	int res;
-	uint32_t i;
+	uint32_t i, j, block_size = 0;
+	bool shared = false;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -559,6 +605,31 @@ impl_node_port_use_buffers(void *object,
 		if ((res = clear_buffers(this)) < 0)
 			return res;
 	}
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	if (n_buffers > 0 && (flags & SPA_NODE_BUFFERS_FLAG_ALLOC)) {
+		/* we fill in the memory. Only buffers with memory in this
+		 * process, like the ones of the adapter, can point into the
+		 * mmap area when the captured data is contiguous. The other
+		 * buffers get shared memory that we copy into. */
+		shared = buffers[0]->datas[0].type != SPA_DATA_MemPtr;
+		this->buffer_maxsize = buffers[0]->datas[0].maxsize;
+		if (this->buffer_maxsize == 0)
+			this->buffer_maxsize = this->props.max_latency * this->stride;
+		/* shared blocks start on a page so that they can be mapped */
+		block_size = SPA_ROUND_UP_N(this->buffer_maxsize, shared ? 4096u : 64u);
+
+		if ((res = alloc_buffer_mem(this,
+				(size_t)n_buffers * this->blocks * block_size, shared)) < 0) {
+			spa_log_error(this->log, NAME " %p: can't allocate buffer memory: %s",
+					this, spa_strerror(res));
+			return res;
+		}
+		this->direct = !shared && snd_pcm_type(this->hndl) == SND_PCM_TYPE_HW &&
+			this->interleaved && !this->dsp;
+	}
+
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b = &this->buffers[i];
 		struct spa_data *d = buffers[i]->datas;
@@ -566,9 +637,33 @@ impl_node_port_use_buffers(void *object,
 		b->buf = buffers[i];
 		b->id = i;
 		b->flags = 0;
+		b->mem = NULL;
 
 		b->h = spa_buffer_find_meta_data(b->buf, SPA_META_Header, sizeof(*b->h));
 
+		if (buffers[i]->n_datas < this->blocks) {
+			spa_log_error(this->log, NAME " %p: need %d data blocks", this,
+					this->blocks);
+			return -EINVAL;
+		}
+		for (j = 0; this->buffer_mem && j < this->blocks; j++) {
+			uint32_t offset = (i * this->blocks + j) * block_size;
+			void *mem = SPA_MEMBER(this->buffer_mem, offset, void);
+
+			if (j == 0)
+				b->mem = mem;
+			if (shared) {
+				d[j].type = SPA_DATA_MemFd;
+				d[j].flags = SPA_DATA_FLAG_READWRITE;
+				d[j].fd = this->buffer_fd;
+				d[j].mapoffset = offset;
+			} else {
+				d[j].type = SPA_DATA_MemPtr;
+				d[j].flags |= SPA_DATA_FLAG_DYNAMIC;
+			}
+			d[j].data = mem;
+			d[j].maxsize = this->buffer_maxsize;
+		}
 		if (d[0].data == NULL) {
 			spa_log_error(this->log, NAME " %p: need mapped memory", this);
 			return -EINVAL;
@@ -701,6 +796,12 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct state *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct state *) handle;
+	free_buffer_mem(this);
 	return 0;
 }
 
@@ -728,6 +829,7 @@ impl_init(const struct spa_handle_factory *factory,
 	handle->clear = impl_clear;
 
 	this = (struct state *) handle;
+	this->buffer_fd = -1;
 
 	for (i = 0; i < n_support; i++) {
 		switch (support[i].type) {
@@ -740,6 +842,9 @@ impl_init(const struct spa_handle_factory *factory,
 		case SPA_TYPE_INTERFACE_DataLoop:
 			this->data_loop = support[i].data;
 			break;
+		case SPA_TYPE_INTERFACE_CPU:
+			this->cpu_flags = spa_cpu_get_flags((struct spa_cpu*)support[i].data);
+			break;
 		}
 	}
 	if (this->data_loop == NULL) {
@@ -773,7 +878,8 @@ impl_init(const struct spa_handle_factory *factory,
 	this->port_info = SPA_PORT_INFO_INIT();
 	this->port_info.flags = SPA_PORT_FLAG_LIVE |
 			   SPA_PORT_FLAG_PHYSICAL |
-			   SPA_PORT_FLAG_TERMINAL;
+			   SPA_PORT_FLAG_TERMINAL |
+			   SPA_PORT_FLAG_CAN_ALLOC_BUFFERS;
 	this->port_params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
 	this->port_params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
 	this->port_params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
@@ -788,6 +894,17 @@ impl_init(const struct spa_handle_factory *factory,
 	for (i = 0; info && i < info->n_items; i++) {
 		if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PATH)) {
 			snprintf(this->props.device, 63, "%s", info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_PERIOD_WAKEUP)) {
+			const char *str = info->items[i].value;
+			this->period_wakeup = strcmp(str, "true") == 0 || atoi(str) == 1;
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_DSP)) {
+			const char *str = info->items[i].value;
+			this->dsp = strcmp(str, "true") == 0 || atoi(str) == 1;
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_HEADROOM)) {
+			this->props.headroom = atoi(info->items[i].value);
+		} else if (!strcmp(info->items[i].key, SPA_KEY_API_ALSA_AGGREGATE)) {
+			snprintf(this->props.aggregate, sizeof(this->props.aggregate),
+					"%s", info->items[i].value);
 		}
 	}
 	return 0;
@@ -817,7 +934,11 @@ impl_enum_interface_info(const struct spa_handle_factory *factory,
 static const struct spa_dict_item info_items[] = {
 	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
 	{ SPA_KEY_FACTORY_DESCRIPTION, "Record audio with the alsa API" },
-	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<device>]" },
+	{ SPA_KEY_FACTORY_USAGE, "["SPA_KEY_API_ALSA_PATH"=<device>] "
+				"["SPA_KEY_API_ALSA_AGGREGATE"=<device ...>] "
+				"["SPA_KEY_API_ALSA_PERIOD_WAKEUP"=<bool>] "
+				"["SPA_KEY_API_ALSA_HEADROOM"=<samples>] "
+				"["SPA_KEY_API_ALSA_DSP"=<bool>]" },
 };
 
 static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
@@ -10,13 +10,136 @@
 
 #include <spa/pod/filter.h>
 #include <spa/support/system.h>
+#include <spa/param/audio/type-info.h>
 
 #define NAME "alsa-pcm"
 
 #include "alsa-pcm.h"
 
+/* samples in front of the hardware pointer that are never rewound */
+#define REWIND_SAFEGUARD	64
+
 #define CHECK(s,msg) if ((err = (s)) < 0) { spa_log_error(state->log, msg ": %s", snd_strerror(err)); return err; }
 
+/* Open the devices of props->aggregate as one PCM with the multi plugin.
+ * The plugin links the devices so that they start and stop together and
+ * presents the channels of all devices in order. The node then runs one
+ * timer and one DLL for all of them. The devices must share a clock. */
+static int open_aggregate(struct state *state, int mode)
+{
+	struct props *props = &state->props;
+	char paths[sizeof(props->aggregate)], *path, *sp;
+	snd_pcm_hw_params_t *params;
+	snd_config_t *ref = NULL, *top = NULL;
+	snd_input_t *input = NULL;
+	snd_pcm_t *hndl;
+	unsigned int channels[MAX_AGGREGATE];
+	uint32_t i, j, n_paths = 0, n_bindings = 0;
+	char *conf = NULL;
+	size_t conf_size;
+	FILE *f;
+	int err;
+
+	snd_pcm_hw_params_alloca(&params);
+
+	if ((f = open_memstream(&conf, &conf_size)) == NULL)
+		return -errno;
+
+	fprintf(f, "pcm.spa_aggregate {\n type multi\n slaves {\n");
+
+	snprintf(paths, sizeof(paths), "%s", props->aggregate);
+	for (path = strtok_r(paths, " ", &sp); path; path = strtok_r(NULL, " ", &sp)) {
+		if (n_paths == MAX_AGGREGATE) {
+			spa_log_warn(state->log, NAME" %p: too many devices, ignoring '%s'",
+					state, path);
+			break;
+		}
+		/* the multi plugin needs the channel count of each device */
+		if ((err = snd_pcm_open(&hndl, path, state->stream, SND_PCM_NONBLOCK)) < 0) {
+			spa_log_error(state->log, NAME" %p: can't open '%s': %s",
+					state, path, snd_strerror(err));
+			goto exit;
+		}
+		snd_pcm_hw_params_any(hndl, params);
+		snd_pcm_hw_params_get_channels_max(params, &channels[n_paths]);
+		snd_pcm_close(hndl);
+
+		spa_log_info(state->log, NAME" %p: aggregate '%s' with %u channels",
+				state, path, channels[n_paths]);
+
+		fprintf(f, "  s%u { pcm \"%s\" channels %u }\n",
+				n_paths, path, channels[n_paths]);
+		n_paths++;
+	}
+	fprintf(f, " }\n bindings {\n");
+
+	for (i = 0; i < n_paths; i++) {
+		for (j = 0; j < channels[i]; j++)
+			fprintf(f, "  %u { slave s%u channel %u }\n", n_bindings++, i, j);
+	}
+	fprintf(f, " }\n}\n");
+	fclose(f);
+	f = NULL;
+
+	if (n_paths == 0) {
+		err = -EINVAL;
+		goto exit;
+	}
+
+	/* resolve the slaves with the global configuration */
+	if ((err = snd_config_update_ref(&ref)) < 0 ||
+	    (err = snd_config_copy(&top, ref)) < 0 ||
+	    (err = snd_input_buffer_open(&input, conf, strlen(conf))) < 0 ||
+	    (err = snd_config_load(top, input)) < 0)
+		goto exit;
+
+	err = snd_pcm_open_lconf(&state->hndl, "spa_aggregate", state->stream, mode, top);
+
+exit:
+	if (f)
+		fclose(f);
+	if (input)
+		snd_input_close(input);
+	if (top)
+		snd_config_delete(top);
+	if (ref)
+		snd_config_unref(ref);
+	free(conf);
+	return err;
+}
+
+#define MAX_PROFILES	64
+
+static struct profile profiles[MAX_PROFILES];
+static uint32_t n_profiles;
+
+/* Find the profile of the device, shared by all nodes of the plugin so
+ * that the learned headroom survives closing and opening the device. */
+static struct profile *find_profile(struct state *state)
+{
+	struct props *props = &state->props;
+	char name[sizeof(profiles[0].name)];
+	struct profile *p;
+	uint32_t i;
+
+	snprintf(name, sizeof(name), "%s:%s",
+			state->stream == SND_PCM_STREAM_CAPTURE ? "capture" : "playback",
+			props->aggregate[0] ? props->aggregate : props->device);
+
+	for (i = 0; i < n_profiles; i++) {
+		if (strcmp(profiles[i].name, name) == 0)
+			return &profiles[i];
+	}
+	if (n_profiles == MAX_PROFILES)
+		return NULL;
+
+	p = &profiles[n_profiles++];
+	snprintf(p->name, sizeof(p->name), "%s", name);
+	p->headroom = 0;
+	p->n_xruns = 0;
+	return p;
+}
+
 static int spa_alsa_open(struct state *state)
 {
 	int err;
@@ -28,14 +151,25 @@ static int spa_alsa_open(struct state *state)
 
 	CHECK(snd_output_stdio_attach(&state->output, stderr, 0), "attach failed");
 
-	spa_log_info(state->log, NAME"%p: ALSA device open '%s' %s", state, props->device,
-			state->stream == SND_PCM_STREAM_CAPTURE ? "capture" : "playback");
-	CHECK(snd_pcm_open(&state->hndl,
-			   props->device,
-			   state->stream,
-			   SND_PCM_NONBLOCK |
-			   SND_PCM_NO_AUTO_RESAMPLE |
-			   SND_PCM_NO_AUTO_CHANNELS | SND_PCM_NO_AUTO_FORMAT), "open failed");
+	if (props->aggregate[0] != '\0') {
+		spa_log_info(state->log, NAME"%p: ALSA aggregate open '%s' %s", state,
+				props->aggregate,
+				state->stream == SND_PCM_STREAM_CAPTURE ? "capture" : "playback");
+		CHECK(open_aggregate(state,
+				   SND_PCM_NONBLOCK |
+				   SND_PCM_NO_AUTO_RESAMPLE |
+				   SND_PCM_NO_AUTO_CHANNELS | SND_PCM_NO_AUTO_FORMAT), "open failed");
+	} else {
+		spa_log_info(state->log, NAME"%p: ALSA device open '%s' %s", state,
+				props->device,
+				state->stream == SND_PCM_STREAM_CAPTURE ? "capture" : "playback");
+		CHECK(snd_pcm_open(&state->hndl,
+				   props->device,
+				   state->stream,
+				   SND_PCM_NONBLOCK |
+				   SND_PCM_NO_AUTO_RESAMPLE |
+				   SND_PCM_NO_AUTO_CHANNELS | SND_PCM_NO_AUTO_FORMAT), "open failed");
+	}
 
 	if ((err = spa_system_timerfd_create(state->data_system,
 			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
@@ -57,6 +191,11 @@ static int spa_alsa_open(struct state *state)
 	state->sample_count = 0;
 	state->sample_time = 0;
 
+	state->profile = find_profile(state);
+	state->headroom = SPA_MIN(SPA_MAX(props->headroom,
+			state->profile ? state->profile->headroom : 0), HEADROOM_MAX);
+	spa_log_debug(state->log, NAME" %p: headroom %d", state, state->headroom);
+
 	return 0;
 
 error_exit_close:
@@ -238,6 +377,87 @@ static void sanitize_map(snd_pcm_chmap_t* map)
 
 }
 
+uint32_t spa_alsa_parse_iec958_codecs(const char *str)
+{
+	const struct spa_type_info *t;
+	uint32_t codecs = 0;
+	size_t len;
+
+	while (*str) {
+		str += strspn(str, " ,");
+		len = strcspn(str, " ,");
+		for (t = spa_type_audio_iec958_codec; t->name; t++) {
+			const char *name = strrchr(t->name, ':') + 1;
+			if (t->type != SPA_AUDIO_IEC958_CODEC_UNKNOWN &&
+			    strlen(name) == len && strncmp(name, str, len) == 0)
+				codecs |= 1u << t->type;
+		}
+		str += len;
+	}
+	return codecs;
+}
+
+/* the bitstream is sent unmodified as 16 bits stereo frames, or 8 channels
+ * for the high bitrate codecs, at the rate that carries it */
+static void iec958_to_raw(const struct spa_audio_info_iec958 *iec958, struct spa_audio_info_raw *raw)
+{
+	spa_zero(*raw);
+	raw->format = SPA_AUDIO_FORMAT_S16_LE;
+	raw->flags = SPA_AUDIO_FLAG_UNPOSITIONED;
+	raw->rate = iec958->rate;
+	raw->channels = 2;
+
+	switch (iec958->codec) {
+	case SPA_AUDIO_IEC958_CODEC_EAC3:
+		raw->rate *= 4;
+		break;
+	case SPA_AUDIO_IEC958_CODEC_TRUEHD:
+	case SPA_AUDIO_IEC958_CODEC_DTSHD:
+		raw->rate *= 4;
+		raw->channels = 8;
+		break;
+	default:
+		break;
+	}
+}
+
+static struct spa_pod *enum_iec958_format(struct state *state, struct spa_pod_builder *b,
+		snd_pcm_hw_params_t *params)
+{
+	struct spa_pod_frame f[2];
+	unsigned int min, max;
+	uint32_t i, j;
+	int dir;
+
+	if (snd_pcm_hw_params_get_rate_min(params, &min, &dir) < 0 ||
+	    snd_pcm_hw_params_get_rate_max(params, &max, &dir) < 0)
+		return NULL;
+
+	spa_pod_builder_push_object(b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(b,
+			SPA_FORMAT_mediaType,    SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_iec958),
+			0);
+
+	spa_pod_builder_prop(b, SPA_FORMAT_AUDIO_iec958Codec, 0);
+	spa_pod_builder_push_choice(b, &f[1], SPA_CHOICE_Enum, 0);
+	for (i = 0, j = 0; i < 32; i++) {
+		if (!(state->props.iec958_codecs & (1u << i)))
+			continue;
+		if (j++ == 0)
+			spa_pod_builder_id(b, i);
+		spa_pod_builder_id(b, i);
+	}
+	spa_pod_builder_pop(b, &f[1]);
+
+	spa_pod_builder_add(b,
+			SPA_FORMAT_AUDIO_rate, SPA_POD_CHOICE_RANGE_Int(
+				SPA_CLAMP(DEFAULT_RATE, min, max), min, max),
+			0);
+
+	return spa_pod_builder_pop(b, &f[0]);
+}
+
 int
 spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 		     const struct spa_pod *filter)
@@ -258,12 +478,21 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	bool opened;
 	struct spa_pod_frame f[2];
 	struct spa_result_node_params result;
-	uint32_t count = 0;
+	uint32_t count = 0, n_raw = UINT32_MAX;
 
 	opened = state->opened;
 	if ((err = spa_alsa_open(state)) < 0)
 		return err;
 
+	/* the IEC958 format comes after the raw formats, one per channel map */
+	if (state->props.iec958_codecs != 0 && !state->dsp) {
+		n_raw = 1;
+		if ((maps = snd_pcm_query_chmaps(state->hndl)) != NULL) {
+			for (n_raw = 0; maps[n_raw]; n_raw++);
+			snd_pcm_free_chmaps(maps);
+		}
+	}
+
 	result.id = SPA_PARAM_EnumFormat;
 	result.next = start;
 
@@ -276,6 +505,14 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	snd_pcm_hw_params_alloca(&params);
 	CHECK(snd_pcm_hw_params_any(hndl, params), "Broken configuration: no configurations available");
 
+	if (result.index >= n_raw) {
+		if (result.index > n_raw)
+			goto enum_end;
+		if ((fmt = enum_iec958_format(state, &b, params)) == NULL)
+			goto enum_end;
+		goto filter;
+	}
+
 	spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
 	spa_pod_builder_add(&b,
 			SPA_FORMAT_mediaType,    SPA_POD_Id(SPA_MEDIA_TYPE_audio),
@@ -293,11 +530,18 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	spa_pod_builder_push_choice(&b, &f[1], SPA_CHOICE_None, 0);
 	choice = (struct spa_pod_choice*)spa_pod_builder_frame(&b, &f[1]);
 
-	for (i = 1, j = 0; i < SPA_N_ELEMENTS(format_info); i++) {
+	/* we convert from the format of the device ourselves */
+	if (state->dsp)
+		spa_pod_builder_id(&b, SPA_AUDIO_FORMAT_F32P);
+
+	for (i = 1, j = 0; !state->dsp && i < SPA_N_ELEMENTS(format_info); i++) {
 		const struct format_info *fi = &format_info[i];
 
 		if (snd_pcm_format_mask_test(fmask, fi->format)) {
-			if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_INTERLEAVED)) {
+			if (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_INTERLEAVED) ||
+			    (state->props.aggregate[0] != '\0' &&
+			     (snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) ||
+			      snd_pcm_access_mask_test(amask, SND_PCM_ACCESS_MMAP_COMPLEX)))) {
 				if (j++ == 0)
 					spa_pod_builder_id(&b, fi->spa_format);
 				spa_pod_builder_id(&b, fi->spa_format);
@@ -378,6 +622,7 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 
 	fmt = spa_pod_builder_pop(&b, &f[0]);
 
+      filter:
 	if ((res = spa_pod_filter(&b, &result.param, fmt, filter)) < 0)
 		goto next;
 
@@ -393,6 +638,92 @@ spa_alsa_enum_format(struct state *state, int seq, uint32_t start, uint32_t num,
 	return res;
 }
 
+/* the first format of the device we can convert planar float from and to,
+ * formats are tried in the order of format_info, best quality first */
+static snd_pcm_format_t find_dsp_format(struct state *state, snd_pcm_hw_params_t *params)
+{
+	size_t i;
+
+	for (i = 1; i < SPA_N_ELEMENTS(format_info); i++) {
+		const struct format_info *fi = &format_info[i];
+
+		if (fi->spa_pformat == SPA_AUDIO_FORMAT_UNKNOWN)
+			continue;
+		if (snd_pcm_hw_params_test_format(state->hndl, params, fi->format) == 0)
+			return fi->format;
+	}
+	return SND_PCM_FORMAT_UNKNOWN;
+}
+
+static uint32_t alsa_format_to_spa(snd_pcm_format_t format)
+{
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(format_info); i++) {
+		if (format_info[i].format == format)
+			return format_info[i].spa_format;
+	}
+	return SPA_AUDIO_FORMAT_UNKNOWN;
+}
+
+static int init_dsp(struct state *state, snd_pcm_format_t format)
+{
+	uint32_t fmt = alsa_format_to_spa(format);
+	int res;
+
+	if (state->conv.free)
+		convert_free(&state->conv);
+	spa_zero(state->conv);
+
+	if (state->stream == SND_PCM_STREAM_PLAYBACK) {
+		state->conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+		state->conv.dst_fmt = fmt;
+	} else {
+		state->conv.src_fmt = fmt;
+		state->conv.dst_fmt = SPA_AUDIO_FORMAT_F32P;
+	}
+	state->conv.n_channels = state->channels;
+	state->conv.cpu_flags = state->cpu_flags;
+
+#ifdef HAVE_FMT_OPS
+	res = convert_init(&state->conv);
+#else
+	res = -ENOTSUP;
+#endif
+	if (res < 0) {
+		spa_log_error(state->log, NAME" %p: can't convert to %s: %s", state,
+				snd_pcm_format_name(format), spa_strerror(res));
+		return res;
+	}
+	spa_log_info(state->log, NAME" %p: dsp mode, converting to %s with flags:%08x",
+			state, snd_pcm_format_name(format), state->conv.cpu_flags);
+	return 0;
+}
+
+/* convert between the planar blocks of a buffer and the interleaved
+ * samples in the mmap area */
+static void convert_to_device(struct state *state, void *dst,
+		struct spa_data *d, uint32_t offs, uint32_t n_bytes)
+{
+	const void **src = alloca(state->blocks * sizeof(void*));
+	uint32_t i;
+
+	for (i = 0; i < state->blocks; i++)
+		src[i] = SPA_MEMBER(d[i].data, offs, void);
+	convert_process(&state->conv, &dst, src, n_bytes / state->stride);
+}
+
+static void convert_from_device(struct state *state, struct spa_data *d,
+		uint32_t offs, const void *src, uint32_t n_bytes)
+{
+	void **dst = alloca(state->blocks * sizeof(void*));
+	uint32_t i;
+
+	for (i = 0; i < state->blocks; i++)
+		dst[i] = SPA_MEMBER(d[i].data, offs, void);
+	convert_process(&state->conv, dst, &src, n_bytes / state->stride);
+}
+
 int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_t flags)
 {
 	unsigned int rrate, rchannels;
@@ -400,10 +731,19 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	int err, dir;
 	snd_pcm_hw_params_t *params;
 	snd_pcm_format_t format;
-	struct spa_audio_info_raw *info = &fmt->info.raw;
+	struct spa_audio_info_raw *info = &fmt->info.raw, iec958_info;
 	snd_pcm_t *hndl;
 	unsigned int periods;
 
+	if (fmt->media_subtype == SPA_MEDIA_SUBTYPE_iec958) {
+		if (state->dsp)
+			return -ENOTSUP;
+		iec958_to_raw(&fmt->info.iec958, &iec958_info);
+		info = &iec958_info;
+		/* the receiver decodes at the rate of the bitstream */
+		flags &= ~SPA_NODE_PARAM_FLAG_NEAREST;
+	}
+
 	if ((err = spa_alsa_open(state)) < 0)
 		return err;
 
@@ -415,14 +755,36 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	/* set hardware resampling */
 	CHECK(snd_pcm_hw_params_set_rate_resample(hndl, params, 0), "set_rate_resample");
 	/* set the interleaved read/write format */
-	CHECK(snd_pcm_hw_params_set_access(hndl, params, SND_PCM_ACCESS_MMAP_INTERLEAVED), "set_access");
+	if (state->props.aggregate[0] == '\0' ||
+	    snd_pcm_hw_params_test_access(hndl, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0) {
+		CHECK(snd_pcm_hw_params_set_access(hndl, params, SND_PCM_ACCESS_MMAP_INTERLEAVED), "set_access");
+		state->interleaved = true;
+	} else {
+		/* the devices of an aggregate each have their own memory, the
+		 * samples are copied with the channel areas */
+		if (snd_pcm_hw_params_set_access(hndl, params, SND_PCM_ACCESS_MMAP_NONINTERLEAVED) < 0)
+			CHECK(snd_pcm_hw_params_set_access(hndl, params, SND_PCM_ACCESS_MMAP_COMPLEX), "set_access");
+		state->interleaved = false;
+	}
 
 	/* disable ALSA wakeups, we use a timer */
-	if (snd_pcm_hw_params_can_disable_period_wakeup(params))
+	if (!state->period_wakeup && snd_pcm_hw_params_can_disable_period_wakeup(params))
 		CHECK(snd_pcm_hw_params_set_period_wakeup(hndl, params, 0), "set_period_wakeup");
 
 	/* set the sample format */
-	format = spa_format_to_alsa(info->format);
+	if (state->dsp) {
+		if (info->format != SPA_AUDIO_FORMAT_F32P || !state->interleaved) {
+			spa_log_warn(state->log, NAME" %p: dsp mode needs F32P and interleaved access",
+					state);
+			return -EINVAL;
+		}
+		if ((format = find_dsp_format(state, params)) == SND_PCM_FORMAT_UNKNOWN) {
+			spa_log_warn(state->log, NAME" %p: no format to convert to", state);
+			return -EINVAL;
+		}
+	} else {
+		format = spa_format_to_alsa(info->format);
+	}
 	if (format == SND_PCM_FORMAT_UNKNOWN) {
 		spa_log_warn(state->log, NAME" %p: unknown format %u", state, info->format);
 		return -EINVAL;
@@ -460,9 +822,21 @@ int spa_alsa_set_format(struct state *state, struct spa_audio_info *fmt, uint32_
 	state->channels = info->channels;
 	state->rate = info->rate;
 	state->frame_size = info->channels * (snd_pcm_format_physical_width(format) / 8);
+	state->blocks = 1;
+	state->stride = state->frame_size;
+
+	if (state->dsp) {
+		if ((err = init_dsp(state, format)) < 0)
+			return err;
+		state->blocks = state->channels;
+		state->stride = sizeof(float);
+	}
 
 	dir = 0;
 	period_size = 1024;
+	/* we wake up every period, make it one graph cycle */
+	if (state->period_wakeup && state->position)
+		period_size = state->position->clock.duration;
 	CHECK(snd_pcm_hw_params_set_period_size_near(hndl, params, &period_size, &dir), "set_period_size_near");
 	CHECK(snd_pcm_hw_params_get_buffer_size_max(params, &state->buffer_frames), "get_buffer_size_max");
 	CHECK(snd_pcm_hw_params_set_buffer_size_near(hndl, params, &state->buffer_frames), "set_buffer_size_near");
@@ -502,7 +876,14 @@ static int set_swparams(struct state *state)
 	/* start the transfer */
 	CHECK(snd_pcm_sw_params_set_start_threshold(hndl, params, LONG_MAX), "set_start_threshold");
 
-	CHECK(snd_pcm_sw_params_set_period_event(hndl, params, 0), "set_period_event");
+	if (state->period_wakeup) {
+		/* poll only wakes up on the period interrupt, not when avail_min
+		 * is reached, we keep the buffer filled much less than that */
+		CHECK(snd_pcm_sw_params_set_avail_min(hndl, params, state->buffer_frames), "set_avail_min");
+		CHECK(snd_pcm_sw_params_set_period_event(hndl, params, 1), "set_period_event");
+	} else {
+		CHECK(snd_pcm_sw_params_set_period_event(hndl, params, 0), "set_period_event");
+	}
 
 	/* write the parameters to the playback device */
 	CHECK(snd_pcm_sw_params(hndl, params), "sw_params");
@@ -538,6 +919,47 @@ static void set_loop(struct state *state, double bw)
 	state->bw = bw;
 }
 
+static void set_headroom(struct state *state, uint32_t headroom)
+{
+	if (headroom == state->headroom)
+		return;
+
+	spa_log_info(state->log, NAME" %p: headroom %d -> %d", state,
+			state->headroom, headroom);
+	state->headroom = headroom;
+	if (state->profile)
+		state->profile->headroom = headroom;
+}
+
+/* every xrun adds some headroom, up to the maximum we allow for the
+ * buffer size */
+static void add_headroom(struct state *state)
+{
+	uint32_t max = SPA_MIN(HEADROOM_MAX, state->buffer_frames / 4);
+
+	if (state->profile)
+		state->profile->n_xruns++;
+	set_headroom(state, SPA_MAX(SPA_MIN(state->headroom + HEADROOM_STEP, max),
+				state->headroom));
+	state->headroom_time = state->next_time;
+}
+
+/* give back a step of headroom after a long time without xruns, never
+ * below what was configured */
+static void decay_headroom(struct state *state)
+{
+	if (state->headroom <= state->props.headroom)
+		return;
+	if (state->headroom_time == 0)
+		state->headroom_time = state->next_time;
+	if (state->next_time < state->headroom_time + HEADROOM_DECAY)
+		return;
+
+	set_headroom(state, SPA_MAX(state->headroom - SPA_MIN(state->headroom, HEADROOM_STEP),
+				state->props.headroom));
+	state->headroom_time = state->next_time;
+}
+
 static int alsa_recover(struct state *state, int err)
 {
 	int res, st;
@@ -564,12 +986,14 @@ static int alsa_recover(struct state *state, int err)
 		delay = SPA_TIMEVAL_TO_USEC(&diff);
 		missing = delay * state->rate / SPA_USEC_PER_SEC;
 
-		spa_log_error(state->log, NAME" %p: xrun of %"PRIu64" usec %"PRIu64" %f",
-				state, delay, missing, state->safety);
+		spa_log_error(state->log, NAME" %p: xrun of %"PRIu64" usec %"PRIu64" headroom:%d",
+				state, delay, missing, state->headroom);
 
 		spa_node_call_xrun(&state->callbacks,
 				SPA_TIMEVAL_TO_USEC(&trigger), delay, NULL);
 
+		add_headroom(state);
+
 		state->sample_count += missing ? missing : state->threshold;
 		break;
 	}
@@ -596,7 +1020,7 @@ static int alsa_recover(struct state *state, int err)
 		state->alsa_started = true;
 	} else {
 		state->alsa_started = false;
-		spa_alsa_write(state, state->threshold * 2);
+		spa_alsa_write(state, state->threshold * 2 + state->headroom);
 	}
 
 	return 0;
@@ -616,8 +1040,9 @@ static int get_status(struct state *state, snd_pcm_uframes_t *delay, snd_pcm_ufr
 		state->alsa_recovering = false;
 	}
 
+	decay_headroom(state);
 
-	*target = state->last_threshold;
+	*target = state->last_threshold + state->headroom;
 
 	if (state->matching && state->rate_match) {
 		state->delay = state->rate_match->delay;
@@ -700,7 +1125,9 @@ static int update_time(struct state *state, uint64_t nsec, snd_pcm_sframes_t del
 		state->clock->nsec = nsec;
 		state->clock->position += state->duration;
 		state->clock->duration = state->duration;
-		state->clock->delay = state->duration * corr;
+		/* samples between the graph position and the device */
+		state->clock->delay = state->stream == SND_PCM_STREAM_PLAYBACK ?
+			-delay : delay;
 		state->clock->rate_diff = corr;
 		state->clock->next_nsec = state->next_time;
 	}
@@ -712,6 +1139,70 @@ static int update_time(struct state *state, uint64_t nsec, snd_pcm_sframes_t del
 	return 0;
 }
 
+static void interleaved_areas(struct state *state, void *data, snd_pcm_channel_area_t *areas)
+{
+	unsigned int c, width = snd_pcm_format_physical_width(state->format);
+
+	for (c = 0; c < (unsigned int)state->channels; c++) {
+		areas[c].addr = data;
+		areas[c].first = c * width;
+		areas[c].step = state->frame_size * 8;
+	}
+}
+
+static void copy_to_areas(struct state *state, const snd_pcm_channel_area_t *dst,
+		snd_pcm_uframes_t offset, void *src, size_t n_bytes)
+{
+	snd_pcm_channel_area_t *areas = alloca(state->channels * sizeof(*areas));
+
+	interleaved_areas(state, src, areas);
+	snd_pcm_areas_copy(dst, offset, areas, 0, state->channels,
+			n_bytes / state->frame_size, state->format);
+}
+
+static void copy_from_areas(struct state *state, void *dst,
+		const snd_pcm_channel_area_t *src, snd_pcm_uframes_t offset, size_t n_bytes)
+{
+	snd_pcm_channel_area_t *areas = alloca(state->channels * sizeof(*areas));
+
+	interleaved_areas(state, dst, areas);
+	snd_pcm_areas_copy(areas, 0, src, offset, state->channels,
+			n_bytes / state->frame_size, state->format);
+}
+
+/* Point the free buffers at the space after the write position in the
+ * mmap area. The upstream node then renders the next cycle in place and
+ * spa_alsa_write() only has to commit it. When there is not enough
+ * contiguous space, or a buffer is still queued and would be overwritten,
+ * the buffers use their own memory. */
+static void prepare_direct_buffers(struct state *state)
+{
+	const snd_pcm_channel_area_t *my_areas;
+	snd_pcm_uframes_t offset, frames = state->buffer_frames;
+	void *data = NULL;
+	uint32_t i, maxsize = 0;
+
+	if (!state->direct)
+		return;
+
+	if (spa_list_is_empty(&state->ready) &&
+	    snd_pcm_mmap_begin(state->hndl, &my_areas, &offset, &frames) >= 0 &&
+	    frames >= state->threshold * 2) {
+		data = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, void);
+		maxsize = SPA_MIN(frames * state->frame_size, state->buffer_maxsize);
+	}
+
+	for (i = 0; i < state->n_buffers; i++) {
+		struct buffer *b = &state->buffers[i];
+		struct spa_data *d = b->buf->datas;
+
+		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT))
+			continue;
+		d[0].data = data ? data : b->mem;
+		d[0].maxsize = data ? maxsize : state->buffer_maxsize;
+	}
+}
+
 int spa_alsa_write(struct state *state, snd_pcm_uframes_t silence)
 {
 	snd_pcm_t *hndl = state->hndl;
@@ -786,18 +1277,35 @@ again:
 
 		index = d[0].chunk->offset + state->ready_offset;
 		avail = size - state->ready_offset;
-		avail /= state->frame_size;
+		avail /= state->stride;
 
 		n_frames = SPA_MIN(avail, to_write);
-		n_bytes = n_frames * state->frame_size;
+		n_bytes = n_frames * state->stride;
 
 		offs = index % maxsize;
 		l0 = SPA_MIN(n_bytes, maxsize - offs);
 		l1 = n_bytes - l0;
 
-		spa_memcpy(dst, src + offs, l0);
-		if (l1 > 0)
-			spa_memcpy(dst + l0, src, l1);
+		if (state->dsp) {
+			convert_to_device(state, dst, d, offs, l0);
+			if (l1 > 0)
+				convert_to_device(state, dst + l0 / state->stride * state->frame_size,
+						d, 0, l1);
+		} else if (!state->interleaved) {
+			copy_to_areas(state, my_areas, off, src + offs, l0);
+			if (l1 > 0)
+				copy_to_areas(state, my_areas, off + l0 / state->frame_size, src, l1);
+		} else if (src >= (uint8_t*)my_areas[0].addr &&
+		    src < (uint8_t*)my_areas[0].addr + state->buffer_frames * state->frame_size) {
+			/* rendered in the mmap area, the write position moved
+			 * when it is not in place */
+			if (dst != src + offs)
+				memmove(dst, src + offs, l0);
+		} else {
+			spa_memcpy(dst, src + offs, l0);
+			if (l1 > 0)
+				spa_memcpy(dst + l0, src, l1);
+		}
 
 		state->ready_offset += n_bytes;
 
@@ -851,6 +1359,8 @@ again:
 		}
 		state->alsa_started = true;
 	}
+	prepare_direct_buffers(state);
+
 	return 0;
 }
 
@@ -871,7 +1381,7 @@ push_frames(struct state *state,
 		size_t n_bytes, left;
 		struct buffer *b;
 		struct spa_data *d;
-		uint32_t avail, l0, l1;
+		uint32_t i, avail, l0, l1;
 
 		b = spa_list_first(&state->free, struct buffer, link);
 		spa_list_remove(&b->link);
@@ -883,27 +1393,55 @@ push_frames(struct state *state,
 		}
 
 		d = b->buf->datas;
+		d[0].chunk->offset = 0;
+
+		if (state->direct) {
+			d[0].data = b->mem;
+			d[0].maxsize = state->buffer_maxsize;
+		}
 
-		avail = d[0].maxsize / state->frame_size;
+		avail = d[0].maxsize / state->stride;
 		total_frames = SPA_MIN(avail, frames);
-		n_bytes = total_frames * state->frame_size;
+		n_bytes = total_frames * state->stride;
 
 		if (my_areas) {
 			left = state->buffer_frames - offset;
-			l0 = SPA_MIN(n_bytes, left * state->frame_size);
+			l0 = SPA_MIN(n_bytes, left * state->stride);
 			l1 = n_bytes - l0;
 
-			src = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, uint8_t);
-			spa_memcpy(d[0].data, src, l0);
-			if (l1 > 0)
-				spa_memcpy(SPA_MEMBER(d[0].data, l0, void), my_areas[0].addr, l1);
+			if (state->dsp) {
+				src = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, uint8_t);
+				convert_from_device(state, d, 0, src, l0);
+				if (l1 > 0)
+					convert_from_device(state, d, l0, my_areas[0].addr, l1);
+			} else if (state->direct && l1 == 0) {
+				/* the data is contiguous, hand out the mmap area */
+				d[0].data = my_areas[0].addr;
+				d[0].maxsize = state->buffer_frames * state->frame_size;
+				d[0].chunk->offset = offset * state->frame_size;
+				b->mmap_pos = state->sample_count;
+				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MMAP);
+			} else if (!state->interleaved) {
+				copy_from_areas(state, d[0].data, my_areas, offset, l0);
+				if (l1 > 0)
+					copy_from_areas(state, SPA_MEMBER(d[0].data, l0, void),
+							my_areas, 0, l1);
+			} else {
+				src = SPA_MEMBER(my_areas[0].addr, offset * state->frame_size, uint8_t);
+				spa_memcpy(d[0].data, src, l0);
+				if (l1 > 0)
+					spa_memcpy(SPA_MEMBER(d[0].data, l0, void), my_areas[0].addr, l1);
+			}
 		} else {
-			memset(d[0].data, 0, n_bytes);
+			for (i = 0; i < state->blocks; i++)
+				memset(d[i].data, 0, n_bytes);
 		}
 
-		d[0].chunk->offset = 0;
-		d[0].chunk->size = n_bytes;
-		d[0].chunk->stride = state->frame_size;
+		for (i = 0; i < state->blocks; i++) {
+			d[i].chunk->offset = d[0].chunk->offset;
+			d[i].chunk->size = n_bytes;
+			d[i].chunk->stride = state->stride;
+		}
 
 		SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
 		spa_list_append(&state->ready, &b->link);
@@ -912,6 +1450,35 @@ push_frames(struct state *state,
 }
 
 
+/* Buffers that reference the mmap area are overwritten by the hardware
+ * one buffer size after they were captured. Copy the ones that are still
+ * held when that could happen before the next wakeup. */
+static void release_mmap_buffers(struct state *state, snd_pcm_sframes_t avail)
+{
+	uint64_t limit;
+	uint32_t i;
+
+	limit = state->sample_count + SPA_MAX(avail, 0) + state->threshold * 2;
+
+	for (i = 0; i < state->n_buffers; i++) {
+		struct buffer *b = &state->buffers[i];
+		struct spa_data *d = b->buf->datas;
+
+		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT | BUFFER_FLAG_MMAP) ||
+		    b->mmap_pos + state->buffer_frames > limit)
+			continue;
+
+		spa_log_debug(state->log, NAME" %p: buffer %d held too long, copy",
+				state, b->id);
+		spa_memcpy(b->mem, SPA_MEMBER(d[0].data, d[0].chunk->offset, void),
+				d[0].chunk->size);
+		d[0].data = b->mem;
+		d[0].maxsize = state->buffer_maxsize;
+		d[0].chunk->offset = 0;
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_MMAP);
+	}
+}
+
 int spa_alsa_read(struct state *state, snd_pcm_uframes_t silence)
 {
 	snd_pcm_t *hndl = state->hndl;
@@ -974,6 +1541,9 @@ int spa_alsa_read(struct state *state, snd_pcm_uframes_t silence)
 	if (frames == 0)
 		frames = state->threshold + state->delay;
 
+	if (state->direct)
+		release_mmap_buffers(state, snd_pcm_avail_update(hndl));
+
 	to_read = state->buffer_frames;
 	if ((res = snd_pcm_mmap_begin(hndl, &my_areas, &offset, &to_read)) < 0) {
 		spa_log_error(state->log, NAME" %p: snd_pcm_mmap_begin error: %s",
@@ -1002,11 +1572,45 @@ int spa_alsa_read(struct state *state, snd_pcm_uframes_t silence)
 	return 0;
 }
 
+/* When the quantum shrinks, the device still has the samples of the old,
+ * larger quantum queued and new data would only be heard after they are
+ * played. Throw away the difference so that the new quantum is used from
+ * this cycle on. */
+static void rewind_quantum(struct state *state,
+		snd_pcm_uframes_t *delay, snd_pcm_uframes_t *target)
+{
+	snd_pcm_uframes_t diff = state->last_threshold - state->threshold;
+	snd_pcm_sframes_t avail, res;
+
+	if ((avail = snd_pcm_rewindable(state->hndl)) <= REWIND_SAFEGUARD)
+		return;
+
+	diff = SPA_MIN(diff, (snd_pcm_uframes_t)avail - REWIND_SAFEGUARD);
+
+	if ((res = snd_pcm_rewind(state->hndl, diff)) <= 0) {
+		if (res < 0)
+			spa_log_warn(state->log, NAME" %p: rewind error: %s",
+					state, snd_strerror(res));
+		return;
+	}
+	spa_log_debug(state->log, NAME" %p: quantum %d -> %d, rewind %ld of %lu",
+			state, state->last_threshold, state->threshold, res, *delay);
+
+	*delay -= res;
+	*target -= state->last_threshold - state->threshold;
+	state->sample_count -= res;
+	state->last_threshold = state->threshold;
+}
+
 static int handle_play(struct state *state, uint64_t nsec,
 		snd_pcm_uframes_t delay, snd_pcm_uframes_t target)
 {
 	int res;
 
+	if (state->rewind && state->threshold < state->last_threshold &&
+	    delay > target)
+		rewind_quantum(state, &delay, &target);
+
 	if (delay > target + state->last_threshold) {
 		spa_log_trace(state->log, NAME" %p: early wakeup %ld %ld", state, delay, target);
 		state->next_time = nsec + (delay - target) * SPA_NSEC_PER_SEC / state->rate;
@@ -1104,6 +1708,54 @@ static void alsa_on_timeout_event(struct spa_source *source)
 	set_timeout(state, state->next_time);
 }
 
+static void alsa_on_period_event(struct spa_source *source)
+{
+	struct state *state = source->data;
+	snd_pcm_uframes_t delay, target;
+	struct timespec now;
+	unsigned short revents;
+
+	state->pfd.revents = source->rmask;
+	snd_pcm_poll_descriptors_revents(state->hndl, &state->pfd, 1, &revents);
+	if (revents == 0)
+		return;
+
+	if (state->position) {
+		state->duration = state->position->clock.duration;
+		state->threshold = (state->duration * state->rate + state->rate_denom-1) / state->rate_denom;
+	}
+
+	if (get_status(state, &delay, &target) < 0)
+		return;
+
+	/* the time of the interrupt, the DLL smooths it for the clock */
+	spa_system_clock_gettime(state->data_system, CLOCK_MONOTONIC, &now);
+	state->current_time = SPA_TIMESPEC_TO_NSEC(&now);
+
+	spa_log_trace_fp(state->log, NAME" %p: period %lu %lu %"PRIu64" %d %"PRIi64,
+			state, delay, target, state->current_time,
+			state->threshold, state->sample_count);
+
+	if (state->stream == SND_PCM_STREAM_PLAYBACK)
+		handle_play(state, state->current_time, delay, target);
+	else
+		handle_capture(state, state->current_time, delay, target);
+}
+
+static int setup_period_wakeup(struct state *state)
+{
+	int n;
+
+	if ((n = snd_pcm_poll_descriptors_count(state->hndl)) != 1) {
+		spa_log_warn(state->log, NAME" %p: %d poll descriptors, using a timer",
+				state, n);
+		return -ENOTSUP;
+	}
+	if ((n = snd_pcm_poll_descriptors(state->hndl, &state->pfd, 1)) != 1)
+		return n < 0 ? n : -EIO;
+	return 0;
+}
+
 static void reset_buffers(struct state *this)
 {
 	uint32_t i;
@@ -1128,7 +1780,12 @@ static int set_timers(struct state *state)
 	spa_system_clock_gettime(state->data_system, CLOCK_MONOTONIC, &now);
 	state->next_time = SPA_TIMESPEC_TO_NSEC(&now);
 
-	if (state->slaved) {
+	if (state->source.func == alsa_on_period_event) {
+		/* the device is always ready when we are slaved, don't poll */
+		state->source.mask = state->slaved ? 0 :
+			state->pfd.events & (SPA_IO_IN | SPA_IO_OUT);
+		spa_loop_update_source(state->data_loop, &state->source);
+	} else if (state->slaved) {
 		set_timeout(state, 0);
 	} else {
 		set_timeout(state, state->next_time);
@@ -1158,6 +1815,9 @@ int spa_alsa_start(struct state *state)
 			state->matching = false;
 		}
 		state->duration = state->position->clock.duration;
+		/* when we drive the graph, it runs at our rate */
+		if (!state->slaved && state->clock)
+			state->clock->rate = SPA_FRACTION(1, state->rate);
 		state->rate_denom = state->position->clock.rate.denom;
 	}
 	else {
@@ -1170,7 +1830,7 @@ int spa_alsa_start(struct state *state)
 	state->last_threshold = state->threshold;
 
 	init_loop(state);
-	state->safety = 0.0;
+	state->headroom_time = 0;
 
 	spa_log_debug(state->log, NAME" %p: start %d duration:%d rate:%d slave:%d match:%d",
 			state, state->threshold, state->duration, state->rate_denom,
@@ -1186,10 +1846,16 @@ int spa_alsa_start(struct state *state)
 		return err;
 	}
 
-	state->source.func = alsa_on_timeout_event;
+	if (state->period_wakeup && setup_period_wakeup(state) == 0) {
+		state->source.func = alsa_on_period_event;
+		state->source.fd = state->pfd.fd;
+		state->source.mask = 0;
+	} else {
+		state->source.func = alsa_on_timeout_event;
+		state->source.fd = state->timerfd;
+		state->source.mask = SPA_IO_IN;
+	}
 	state->source.data = state;
-	state->source.fd = state->timerfd;
-	state->source.mask = SPA_IO_IN;
 	state->source.rmask = 0;
 	spa_loop_add_source(state->data_loop, &state->source);
 
@@ -1198,7 +1864,7 @@ int spa_alsa_start(struct state *state)
 
 	if (state->stream == SND_PCM_STREAM_PLAYBACK) {
 		state->alsa_started = false;
-		spa_alsa_write(state, state->threshold * 2);
+		spa_alsa_write(state, state->threshold * 2 + state->headroom);
 	} else {
 		if ((err = snd_pcm_start(state->hndl)) < 0) {
 			spa_log_error(state->log, NAME" %p: snd_pcm_start: %s", state,
@@ -37,6 +37,7 @@ extern "C" {
 #include <spa/support/plugin.h>
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
+#include <spa/support/cpu.h>
 #include <spa/utils/list.h>
 
 #include <spa/node/node.h>
@@ -45,29 +46,50 @@ extern "C" {
 #include <spa/param/param.h>
 #include <spa/param/audio/format-utils.h>
 
+#include "fmt-ops.h"
+
 #define MIN_LATENCY	16
 #define MAX_LATENCY	8192
 
 #define DEFAULT_RATE		48000u
 #define DEFAULT_CHANNELS	2u
 
+#define MAX_AGGREGATE	16
+
 struct props {
 	char device[64];
+	char aggregate[256];
 	char device_name[128];
 	char card_name[128];
 	uint32_t min_latency;
 	uint32_t max_latency;
+	uint32_t headroom;
+	uint32_t iec958_codecs;		/* mask of enum spa_audio_iec958_codec */
 };
 
 #define MAX_BUFFERS 32
 
+#define HEADROOM_STEP	64			/* added after each xrun */
+#define HEADROOM_MAX	2048
+#define HEADROOM_DECAY	(60 * SPA_NSEC_PER_SEC)	/* remove a step after this time without xruns */
+
+/* what we learned about a device, kept while the plugin is loaded */
+struct profile {
+	char name[256];
+	uint32_t headroom;
+	uint32_t n_xruns;
+};
+
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT	(1<<0)
+#define BUFFER_FLAG_MMAP	(1<<1)
 	uint32_t flags;
 	struct spa_buffer *buf;
 	struct spa_meta_header *h;
 	struct spa_list link;
+	void *mem;		/* our memory when we allocated the buffer */
+	uint64_t mmap_pos;	/* sample_count of the data in the mmap area */
 };
 
 #define BW_MAX		0.128
@@ -82,6 +104,7 @@ struct state {
 	struct spa_log *log;
 	struct spa_system *data_system;
 	struct spa_loop *data_loop;
+	uint32_t cpu_flags;
 
 	snd_pcm_stream_t stream;
 	snd_output_t *output;
@@ -107,6 +130,9 @@ struct state {
 	int rate;
 	int channels;
 	size_t frame_size;
+	uint32_t blocks;		/* data blocks in the buffers */
+	size_t stride;			/* bytes of one sample in a block */
+	struct convert conv;		/* between the buffers and the device in dsp mode */
 	int rate_denom;
 	uint32_t delay;
 	uint32_t read_size;
@@ -121,6 +147,10 @@ struct state {
 
 	struct buffer buffers[MAX_BUFFERS];
 	unsigned int n_buffers;
+	void *buffer_mem;
+	size_t buffer_mem_size;
+	int buffer_fd;			/* memfd of buffer_mem or -1 */
+	uint32_t buffer_maxsize;
 
 	struct spa_list free;
 	struct spa_list ready;
@@ -130,6 +160,7 @@ struct state {
 	bool started;
 	struct spa_source source;
 	int timerfd;
+	struct pollfd pfd;		/* of the device in period wakeup mode */
 	uint32_t threshold;
 	uint32_t last_threshold;
 
@@ -141,6 +172,11 @@ struct state {
 	unsigned int alsa_recovering:1;
 	unsigned int slaved:1;
 	unsigned int matching:1;
+	unsigned int direct:1;		/* buffers can point into the mmap area */
+	unsigned int interleaved:1;	/* the mmap area is one interleaved block */
+	unsigned int period_wakeup:1;	/* wake up on period interrupts, not a timer */
+	unsigned int rewind:1;		/* rewind queued samples on quantum changes */
+	unsigned int dsp:1;		/* planar float buffers, converted in the node */
 
 	int64_t sample_count;
 
@@ -150,7 +186,10 @@ struct state {
 	uint64_t base_time;
 
 	uint64_t underrun;
-	double safety;
+
+	struct profile *profile;
+	uint32_t headroom;		/* extra samples in the device */
+	uint64_t headroom_time;		/* last change of the headroom */
 
 	double bw;
 	double z1, z2, z3;
@@ -163,6 +202,7 @@ spa_alsa_enum_format(struct state *state, int seq,
 		     const struct spa_pod *filter);
 
 int spa_alsa_set_format(struct state *state, struct spa_audio_info *info, uint32_t flags);
+uint32_t spa_alsa_parse_iec958_codecs(const char *str);
 
 int spa_alsa_start(struct state *state);
 int spa_alsa_reslave(struct state *state);
@@ -77,6 +77,10 @@ static int seq_open(struct seq_state *state, struct seq_conn *conn)
 	if ((res = snd_seq_nonblock(conn->hndl, 1)) < 0)
 		spa_log_warn(state->log, "can't set nonblock mode: %s", snd_strerror(res));
 
+	/* read all events of a cycle with as few reads as possible */
+	if ((res = snd_seq_set_input_buffer_size(conn->hndl, INPUT_BUFFER_SIZE)) < 0)
+		spa_log_warn(state->log, "can't set input buffer size: %s", snd_strerror(res));
+
 	/* port for receiving */
 	snd_seq_port_info_alloca(&pinfo);
 	snd_seq_port_info_set_name(pinfo, "input");
@@ -150,6 +154,9 @@ static int init_stream(struct seq_state *state, enum spa_direction direction)
 		stream->caps = SND_SEQ_PORT_CAP_SUBS_READ;
 	}
 	snd_midi_event_new(MAX_EVENT_SIZE, &stream->codec);
+	/* always decode the status byte, so we don't need to reset the
+	 * decoder for each event */
+	snd_midi_event_no_status(stream->codec, 1);
 	memset(stream->ports, 0, sizeof(stream->ports));
 	return 0;
 }
@@ -431,24 +438,28 @@ static int process_read(struct seq_state *state)
 {
 	snd_seq_event_t *ev;
 	struct seq_stream *stream = &state->streams[SPA_DIRECTION_OUTPUT];
+	struct seq_port *port = NULL;
 	uint32_t i;
 	long size;
 	uint8_t data[MAX_EVENT_SIZE];
 	int res;
 
-	/* copy all new midi events into their port buffers */
+	/* copy all new midi events into their port buffers. The events
+	 * of a cycle usually come from few ports, remember the last one. */
 	while (snd_seq_event_input(state->event.hndl, &ev) > 0) {
 		const snd_seq_addr_t *addr = &ev->source;
-		struct seq_port *port;
 		uint64_t ev_time, diff;
 		uint32_t offset;
 
 		debug_event(state, ev);
 
-		if ((port = find_port(state, stream, addr)) == NULL) {
-			spa_log_debug(state->log, "unknown port %d.%d",
-					addr->client, addr->port);
-			continue;
+		if (port == NULL || port->addr.client != addr->client ||
+		    port->addr.port != addr->port) {
+			if ((port = find_port(state, stream, addr)) == NULL) {
+				spa_log_debug(state->log, "unknown port %d.%d",
+						addr->client, addr->port);
+				continue;
+			}
 		}
 		if (port->io == NULL || port->n_buffers == 0)
 			continue;
@@ -459,7 +470,6 @@ static int process_read(struct seq_state *state)
 			continue;
 		}
 
-		snd_midi_event_reset_decode(stream->codec);
 		if ((size = snd_midi_event_decode(stream->codec, data, MAX_EVENT_SIZE, ev)) < 0) {
 			spa_log_warn(state->log, "decode failed: %s", snd_strerror(size));
 			continue;
@@ -479,10 +489,13 @@ static int process_read(struct seq_state *state)
 		else
 			diff = 0;
 
-		/* convert the age to samples and convert to an offset */
-		offset = (diff * state->rate.denom) / (state->rate.num * SPA_NSEC_PER_SEC);
+		/* convert the age to samples of the graph clock and convert to an
+		 * offset in this cycle. Events from before the cycle are placed at
+		 * the start, events that arrived after the queue time at the end. */
+		offset = (diff * state->rate.denom) /
+			(state->rate.num * SPA_NSEC_PER_SEC * state->queue_corr);
 		if (state->duration > offset)
-			offset = state->duration - offset;
+			offset = SPA_MIN(state->duration - offset, state->duration - 1);
 		else
 			offset = 0;
 
@@ -627,6 +640,7 @@ static void init_loop(struct seq_state *state)
 {
 	state->bw = 0.0;
 	state->z1 = state->z2 = state->z3 = 0.0;
+	state->queue_corr = 1.0;
 }
 
 static void set_loop(struct seq_state *state, double bw)
@@ -677,6 +691,7 @@ static int update_time(struct seq_state *state, uint64_t nsec, bool slave)
 	state->z3 += state->w2 * state->z2;
 
 	corr = 1.0 - (state->z2 + state->z3);
+	state->queue_corr = corr;
 
 	if ((state->next_time - state->base_time) > BW_PERIOD) {
 		state->base_time = state->next_time;
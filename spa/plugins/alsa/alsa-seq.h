@@ -50,6 +50,7 @@ struct props {
 };
 
 #define MAX_EVENT_SIZE 1024
+#define INPUT_BUFFER_SIZE (64 * 1024)
 #define MAX_PORTS 256
 #define MAX_BUFFERS 32
 
@@ -146,6 +147,7 @@ struct seq_state {
 	uint64_t queue_time;
 	uint64_t queue_base;
 	uint64_t clock_base;
+	double queue_corr;		/* rate of the graph clock against the queue */
 
 	unsigned int opened:1;
 	unsigned int started:1;
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <pthread.h>
 
 #include <libudev.h>
 #include <alsa/asoundlib.h>
@@ -184,38 +185,57 @@ static void unescape(const char *src, char *dst)
 	*d = 0;
 }
 
-static int emit_object_info(struct impl *this, uint32_t id, struct udev_device *dev)
+/* a card and the result of opening its control device, the probes of
+ * the enumerated cards run in parallel */
+struct probe {
+	struct udev_device *dev;
+	uint32_t id;
+	pthread_t thread;
+	bool threaded;
+	int res;
+	int pcm;
+};
+
+static void probe_card(struct probe *p)
 {
-	struct spa_device_object_info info;
 	snd_ctl_t *ctl_hndl;
+	char path[32];
+
+	snprintf(path, sizeof(path), "hw:%u", p->id);
+
+	p->pcm = -1;
+	if ((p->res = snd_ctl_open(&ctl_hndl, path, 0)) < 0)
+		return;
+	p->res = snd_ctl_pcm_next_device(ctl_hndl, &p->pcm);
+	snd_ctl_close(ctl_hndl);
+}
+
+static void *probe_thread(void *data)
+{
+	probe_card(data);
+	return NULL;
+}
+
+static int emit_object_info(struct impl *this, struct probe *p)
+{
+	struct spa_device_object_info info;
+	struct udev_device *dev = p->dev;
+	uint32_t id = p->id;
 	const char *str;
 	char path[32];
 	struct spa_dict_item items[22];
 	uint32_t n_items = 0;
-	int res, pcm;
+	int pcm = p->pcm;
 
 	if ((str = path_get_card_id(udev_device_get_property_value(dev, "DEVPATH"))) == NULL)
 		return 0;
 
 	snprintf(path, sizeof(path), "hw:%d", atoi(str));
 
-	spa_log_info(this->log, "open card %s", path);
-
-	if ((res = snd_ctl_open(&ctl_hndl, path, 0)) < 0) {
-		spa_log_error(this->log, "can't open control for card %s: %s",
-				path, snd_strerror(res));
-		return res;
-	}
-
-	pcm = -1;
-	res = snd_ctl_pcm_next_device(ctl_hndl, &pcm);
-
-	spa_log_info(this->log, "close card %s", path);
-	snd_ctl_close(ctl_hndl);
-
-	if (res < 0) {
-		spa_log_error(this->log, "error iterating devices: %s", snd_strerror(res));
-		return res;
+	if (p->res < 0) {
+		spa_log_error(this->log, "can't probe card %s: %s",
+				path, snd_strerror(p->res));
+		return p->res;
 	}
 	if (pcm < 0) {
 		spa_log_debug(this->log, "no pcm devices for %s", path);
@@ -367,18 +387,19 @@ static int need_notify(struct impl *this, struct udev_device *dev, uint32_t acti
 
 static int emit_device(struct impl *this, uint32_t action, bool enumerated, struct udev_device *dev)
 {
-	uint32_t id;
+	struct probe p = { .dev = dev };
 
-	if (!need_notify(this, dev, action, enumerated, &id))
+	if (!need_notify(this, dev, action, enumerated, &p.id))
 		return 0;
 
 	switch (action) {
 	case ACTION_ADD:
 	case ACTION_CHANGE:
-		emit_object_info(this, id, dev);
+		probe_card(&p);
+		emit_object_info(this, &p);
 		break;
 	default:
-		spa_device_emit_object_info(&this->hooks, id, NULL);
+		spa_device_emit_object_info(&this->hooks, p.id, NULL);
 		break;
 	}
 	return 0;
@@ -452,6 +473,8 @@ static int enum_devices(struct impl *this)
 {
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices;
+	struct probe probes[MAX_CARDS];
+	uint32_t i, n_probes = 0;
 
 	enumerate = udev_enumerate_new(this->udev);
 	if (enumerate == NULL)
@@ -462,18 +485,36 @@ static int enum_devices(struct impl *this)
 
 	devices = udev_enumerate_get_list_entry(enumerate);
 
-	while (devices) {
-		struct udev_device *dev;
+	/* opening a control device can take a while when the card needs to
+	 * be powered up, open all cards at the same time and emit them in
+	 * the order of the enumeration */
+	while (devices && n_probes < MAX_CARDS) {
+		struct probe *p = &probes[n_probes];
 
-		dev = udev_device_new_from_syspath(this->udev, udev_list_entry_get_name(devices));
+		p->dev = udev_device_new_from_syspath(this->udev, udev_list_entry_get_name(devices));
+		devices = udev_list_entry_get_next(devices);
 
-		emit_device(this, ACTION_ADD, true, dev);
+		if (p->dev == NULL)
+			continue;
+		if (!need_notify(this, p->dev, ACTION_ADD, true, &p->id)) {
+			udev_device_unref(p->dev);
+			continue;
+		}
+		p->threaded = pthread_create(&p->thread, NULL, probe_thread, p) == 0;
+		if (!p->threaded)
+			probe_card(p);
+		n_probes++;
+	}
+	udev_enumerate_unref(enumerate);
 
-		udev_device_unref(dev);
+	for (i = 0; i < n_probes; i++) {
+		struct probe *p = &probes[i];
 
-		devices = udev_list_entry_get_next(devices);
+		if (p->threaded)
+			pthread_join(p->thread, NULL);
+		emit_object_info(this, p);
+		udev_device_unref(p->dev);
 	}
-	udev_enumerate_unref(enumerate);
 
 	return 0;
 }
@@ -113,8 +113,19 @@ next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	switch (id) {
-	case SPA_PARAM_EnumPortConfig:
 	case SPA_PARAM_PortConfig:
+		if (!this->use_converter) {
+			if (result.index > 0)
+				return 0;
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamPortConfig, id,
+				SPA_PARAM_PORT_CONFIG_direction, SPA_POD_Id(this->direction),
+				SPA_PARAM_PORT_CONFIG_mode,      SPA_POD_Id(SPA_PARAM_PORT_CONFIG_MODE_passthrough));
+			result.next++;
+			break;
+		}
+		/* fallthrough */
+	case SPA_PARAM_EnumPortConfig:
 	case SPA_PARAM_PropInfo:
 	case SPA_PARAM_Props:
 		if ((res = spa_node_enum_params_sync(this->convert,
@@ -248,6 +259,25 @@ static int debug_params(struct impl *this, struct spa_node *node,
         return 0;
 }
 
+/* the lowest number of buffers the ports accept, before fixation */
+static uint32_t get_min_buffers(const struct spa_pod *param)
+{
+	const struct spa_pod_prop *prop;
+	const struct spa_pod *vals;
+	uint32_t n_vals, choice;
+
+	prop = spa_pod_find_prop(param, NULL, SPA_PARAM_BUFFERS_buffers);
+	if (prop == NULL)
+		return 0;
+
+	vals = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	if (vals->type != SPA_TYPE_Int)
+		return 0;
+	if (choice == SPA_CHOICE_Range && n_vals >= 3)
+		return ((const int32_t *)SPA_POD_BODY_CONST(vals))[1];
+	return SPA_POD_VALUE(struct spa_pod_int, vals);
+}
+
 static int negotiate_buffers(struct impl *this)
 {
 	uint8_t buffer[4096];
@@ -256,7 +286,7 @@ static int negotiate_buffers(struct impl *this)
 	struct spa_pod *param;
 	int res;
 	bool slave_alloc, conv_alloc;
-	uint32_t i, size, buffers, blocks, align, flags;
+	uint32_t i, size, buffers, min_buffers, blocks, align, flags;
 	uint32_t *aligns;
 	struct spa_data *datas;
 	uint32_t slave_flags, conv_flags;
@@ -288,6 +318,7 @@ static int negotiate_buffers(struct impl *this)
 		return -ENOTSUP;
 	}
 
+	min_buffers = get_min_buffers(param);
 	spa_pod_fixate(param);
 
 	slave_flags = this->slave_flags;
@@ -296,6 +327,7 @@ static int negotiate_buffers(struct impl *this)
 	slave_alloc = SPA_FLAG_IS_SET(slave_flags, SPA_PORT_FLAG_CAN_ALLOC_BUFFERS);
 	conv_alloc = SPA_FLAG_IS_SET(conv_flags, SPA_PORT_FLAG_CAN_ALLOC_BUFFERS);
 
+again:
 	flags = 0;
 	if (conv_alloc || slave_alloc) {
 		flags |= SPA_BUFFER_ALLOC_FLAG_NO_DATA;
@@ -311,6 +343,13 @@ static int negotiate_buffers(struct impl *this)
 			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(&align))) < 0)
 		return res;
 
+	/* convert and slave run in the same process call, a buffer goes
+	 * back to the producer in the same or the next cycle. Use as few
+	 * buffers as the ports accept so the same memory stays in the
+	 * cache, but keep two for a slave that holds one over a cycle. */
+	if (min_buffers > 0)
+		buffers = SPA_MIN(buffers, SPA_MAX(min_buffers, 2u));
+
 	spa_log_debug(this->log, "%p: buffers %d, blocks %d, size %d, align %d %d:%d",
 			this, buffers, blocks, size, align, slave_alloc, conv_alloc);
 
@@ -332,15 +371,31 @@ static int negotiate_buffers(struct impl *this)
 		return -errno;
 	this->n_buffers = buffers;
 
+	/* the allocating side goes first so that the other side gets
+	 * buffers with memory */
+	if (slave_alloc) {
+		res = spa_node_port_use_buffers(this->slave,
+			       this->direction, 0,
+			       SPA_NODE_BUFFERS_FLAG_ALLOC,
+			       this->buffers, this->n_buffers);
+		if (res < 0 || SPA_RESULT_IS_ASYNC(res) ||
+		    this->buffers[0]->datas[0].data == NULL) {
+			/* the memory is not there right away, use our own */
+			spa_log_debug(this->log, "%p: slave can't allocate: %d", this, res);
+			slave_alloc = false;
+			goto again;
+		}
+	}
+
 	if ((res = spa_node_port_use_buffers(this->convert,
 		       SPA_DIRECTION_REVERSE(this->direction), 0,
 		       conv_alloc ? SPA_NODE_BUFFERS_FLAG_ALLOC : 0,
 		       this->buffers, this->n_buffers)) < 0)
 		return res;
 
-	if ((res = spa_node_port_use_buffers(this->slave,
-		       this->direction, 0,
-		       slave_alloc ? SPA_NODE_BUFFERS_FLAG_ALLOC : 0,
+	if (!slave_alloc &&
+	    (res = spa_node_port_use_buffers(this->slave,
+		       this->direction, 0, 0,
 		       this->buffers, this->n_buffers)) < 0)
 		return res;
 
@@ -379,6 +434,71 @@ static int configure_format(struct impl *this, uint32_t flags, const struct spa_
 	return res;
 }
 
+static const struct spa_node_events convert_node_events;
+static const struct spa_node_events slave_node_events;
+
+/* In passthrough mode the slave port is exposed as it is and the converter
+ * is bypassed, so that encoded formats (IEC958) reach the device untouched.
+ * The other modes are handled by the converter. */
+static int reconfigure_mode(struct impl *this, bool passthrough, const struct spa_pod *param)
+{
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *convert_param;
+	struct spa_hook l;
+	int res;
+
+	if (passthrough == !this->use_converter)
+		return passthrough ? 0 :
+			spa_node_set_param(this->convert, SPA_PARAM_PortConfig, 0, param);
+
+	if (this->have_format)
+		configure_format(this, 0, NULL);
+
+	if (passthrough) {
+		spa_log_debug(this->log, NAME" %p: passthrough mode", this);
+
+		/* leave a single port on the converter, it replaces the dsp
+		 * ports with port 0 that we then take over with the slave port */
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		convert_param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamPortConfig, SPA_PARAM_PortConfig,
+			SPA_PARAM_PORT_CONFIG_direction,	SPA_POD_Id(this->direction),
+			SPA_PARAM_PORT_CONFIG_mode,		SPA_POD_Id(SPA_PARAM_PORT_CONFIG_MODE_convert));
+		if ((res = spa_node_set_param(this->convert, SPA_PARAM_PortConfig, 0, convert_param)) < 0)
+			return res;
+
+		spa_node_port_set_io(this->slave, this->direction, 0,
+				SPA_IO_RateMatch, NULL, 0);
+
+		this->use_converter = false;
+		this->target = this->slave;
+
+		spa_zero(l);
+		spa_node_add_listener(this->slave, &l, &slave_node_events, this);
+		spa_hook_remove(&l);
+	} else {
+		spa_log_debug(this->log, NAME" %p: converter mode", this);
+
+		spa_node_emit_port_info(&this->hooks, this->direction, 0, NULL);
+
+		this->use_converter = true;
+		this->target = this->convert;
+
+		if ((res = spa_node_set_param(this->convert, SPA_PARAM_PortConfig, 0, param)) < 0)
+			return res;
+
+		link_io(this);
+
+		spa_zero(l);
+		spa_node_add_listener(this->convert, &l, &convert_node_events, this);
+		spa_hook_remove(&l);
+	}
+	this->n_buffers = 0;
+
+	return 0;
+}
+
 static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 			       const struct spa_pod *param)
 {
@@ -407,13 +527,25 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 		break;
 
 	case SPA_PARAM_PortConfig:
+	{
+		enum spa_direction dir;
+		enum spa_param_port_config_mode mode;
+
 		if (this->started)
 			return -EIO;
-		if (this->target != this->slave) {
-			if ((res = spa_node_set_param(this->target, id, flags, param)) < 0)
-				return res;
-		}
+		if (param == NULL)
+			return -EINVAL;
+
+		if (spa_pod_parse_object(param,
+				SPA_TYPE_OBJECT_ParamPortConfig, NULL,
+				SPA_PARAM_PORT_CONFIG_direction,	SPA_POD_Id(&dir),
+				SPA_PARAM_PORT_CONFIG_mode,		SPA_POD_Id(&mode)) < 0)
+			return -EINVAL;
+
+		res = reconfigure_mode(this,
+				mode == SPA_PARAM_PORT_CONFIG_MODE_passthrough, param);
 		break;
+	}
 
 	case SPA_PARAM_Props:
 		if (this->target != this->slave) {
@@ -506,10 +638,12 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 
 	switch (SPA_NODE_COMMAND_ID(command)) {
 	case SPA_NODE_COMMAND_Start:
-		if ((res = negotiate_format(this)) < 0)
-			return res;
-		if ((res = negotiate_buffers(this)) < 0)
-			return res;
+		if (this->use_converter) {
+			if ((res = negotiate_format(this)) < 0)
+				return res;
+			if ((res = negotiate_buffers(this)) < 0)
+				return res;
+		}
 		this->started = true;
 		break;
 	case SPA_NODE_COMMAND_Suspend:
@@ -568,6 +702,9 @@ static void convert_port_info(void *data,
 {
 	struct impl *this = data;
 
+	if (!this->use_converter)
+		return;
+
 	if (direction != this->direction) {
 		if (port_id == 0)
 			return;
@@ -627,6 +764,9 @@ static void slave_port_info(void *data,
 	struct impl *this = data;
 	uint32_t i;
 
+	if (info->change_mask & SPA_PORT_CHANGE_MASK_FLAGS)
+		this->slave_flags = info->flags;
+
 	for (i = 0; i < info->n_params; i++) {
 		uint32_t idx = SPA_ID_INVALID;
 
@@ -641,6 +781,9 @@ static void slave_port_info(void *data,
 		}
 	}
 	emit_node_info(this, false);
+
+	if (!this->use_converter)
+		spa_node_emit_port_info(&this->hooks, direction, port_id, info);
 }
 
 static const struct spa_node_events slave_node_events = {
@@ -657,7 +800,7 @@ static int slave_ready(void *data, int status)
 
 	this->master = true;
 
-	if (this->direction == SPA_DIRECTION_OUTPUT)
+	if (this->direction == SPA_DIRECTION_OUTPUT && this->use_converter)
 		status = spa_node_process(this->convert);
 
 	return spa_node_call_ready(&this->callbacks, status);
@@ -705,11 +848,12 @@ static int impl_node_add_listener(void *object,
 
 	this->add_listener = true;
 
-	if (this->use_converter) {
-		spa_zero(l);
+	spa_zero(l);
+	if (this->use_converter)
 		spa_node_add_listener(this->convert, &l, &convert_node_events, this);
-		spa_hook_remove(&l);
-	}
+	else
+		spa_node_add_listener(this->slave, &l, &slave_node_events, this);
+	spa_hook_remove(&l);
 
 	this->add_listener = false;
 
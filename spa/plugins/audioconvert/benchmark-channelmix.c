@@ -0,0 +1,183 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "benchmark.h"
+
+#include "channelmix-ops.c"
+
+#define MAX_SAMPLES	4096
+#define MAX_CHANNELS	11
+
+#define MAX_COUNT 1000
+
+static float samp_in[MAX_SAMPLES * MAX_CHANNELS];
+static float samp_out[MAX_SAMPLES * MAX_CHANNELS];
+
+static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
+
+struct layout {
+	const char *name;
+	uint32_t src_chan;
+	uint64_t src_mask;
+	uint32_t dst_chan;
+	uint64_t dst_mask;
+};
+
+static const struct layout layouts[] = {
+	{ "channelmix_1_2", 1, MASK_MONO, 2, MASK_STEREO },
+	{ "channelmix_2_1", 2, MASK_STEREO, 1, MASK_MONO },
+	{ "channelmix_2_4", 2, MASK_STEREO, 4, MASK_QUAD },
+	{ "channelmix_2_5p1", 2, MASK_STEREO, 6, MASK_5_1 },
+	{ "channelmix_5p1_2", 6, MASK_5_1, 2, MASK_STEREO },
+	{ "channelmix_5p1_4", 6, MASK_5_1, 4, MASK_QUAD },
+	{ "channelmix_7p1_2", 8, MASK_7_1, 2, MASK_STEREO },
+	{ "channelmix_7p1_4", 8, MASK_7_1, 4, MASK_QUAD },
+	{ "channelmix_n_m", 11, 0, 5, 0 },
+};
+
+struct variant {
+	const char *impl;
+	uint32_t cpu_flags;
+};
+
+static const struct variant variants[] = {
+	{ "c", 0 },
+#if defined (HAVE_SSE)
+	{ "sse", SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_AVX) && defined (HAVE_FMA)
+	{ "avx", SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3 },
+#endif
+#if defined (HAVE_NEON)
+	{ "neon", SPA_CPU_FLAG_NEON },
+#endif
+};
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(layouts) * \
+				SPA_N_ELEMENTS(variants) * 2
+
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("channelmix", results);
+
+static void set_volume(struct channelmix *mix, float volume, uint32_t ramp)
+{
+	float volumes[MAX_CHANNELS];
+	uint32_t i;
+
+	for (i = 0; i < mix->src_chan; i++)
+		volumes[i] = volume;
+	channelmix_set_volume(mix, 1.0f, false, mix->src_chan, volumes, ramp);
+}
+
+static void run_test1(const char *name, const char *impl, struct channelmix *mix,
+		uint32_t ramp, int n_samples)
+{
+	uint32_t i, j;
+	const void *ip[MAX_CHANNELS];
+	void *op[MAX_CHANNELS];
+	uint64_t count, t1, t2;
+
+	for (j = 0; j < mix->src_chan; j++)
+		ip[j] = &samp_in[j * MAX_SAMPLES];
+	for (j = 0; j < mix->dst_chan; j++)
+		op[j] = &samp_out[j * MAX_SAMPLES];
+
+	t1 = bench_now();
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		/* restart the ramp so that every iteration measures the
+		 * ramping function */
+		if (ramp)
+			set_volume(mix, (i & 1) ? 1.0f : 0.5f, ramp);
+		channelmix_process(mix, mix->dst_chan, op, mix->src_chan, ip, n_samples);
+		count++;
+	}
+	t2 = bench_now();
+
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = impl,
+		.n_samples = n_samples,
+		.n_channels = mix->src_chan,
+		.n_params = 2,
+		.params = {
+			{ "dst_channels", mix->dst_chan },
+			{ "ramp", ramp != 0 },
+		},
+		.count = count,
+		.nsec = t2 - t1,
+	});
+}
+
+static void run_layout(const struct layout *l, const struct variant *v)
+{
+	struct channelmix mix;
+	uint32_t i, r;
+
+	for (r = 0; r < 2; r++) {
+		spa_zero(mix);
+		mix.src_chan = l->src_chan;
+		mix.src_mask = l->src_mask;
+		mix.dst_chan = l->dst_chan;
+		mix.dst_mask = l->dst_mask;
+		mix.cpu_flags = v->cpu_flags;
+		if (channelmix_init(&mix) < 0)
+			continue;
+		/* no specialized function for these flags, the C version
+		 * is measured separately */
+		if (v->cpu_flags != 0 && mix.cpu_flags == 0) {
+			channelmix_free(&mix);
+			continue;
+		}
+		set_volume(&mix, 0.5f, 0);
+
+		for (i = 0; i < SPA_N_ELEMENTS(sample_sizes); i++)
+			run_test1(l->name, v->impl, &mix, r ? MAX_SAMPLES : 0, sample_sizes[i]);
+
+		channelmix_free(&mix);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(samp_in); i++)
+		samp_in[i] = drand48() * 2.0 - 1.0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(layouts); i++)
+		for (j = 0; j < SPA_N_ELEMENTS(variants); j++)
+			run_layout(&layouts[i], &variants[j]);
+
+	bench_report(&bench);
+
+	return 0;
+}
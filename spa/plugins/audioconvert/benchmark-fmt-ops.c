@@ -29,31 +29,25 @@
 #include <errno.h>
 #include <time.h>
 
-#include "fmt-ops.c"
+#include "benchmark.h"
 
-struct stats {
-	uint32_t n_samples;
-	uint32_t n_channels;
-	uint64_t perf;
-	const char *name;
-	const char *impl;
-};
+#include "fmt-ops.c"
 
 #define MAX_SAMPLES	4096
 #define MAX_CHANNELS	11
 
 #define MAX_COUNT 1000
 
-static uint8_t samp_in[MAX_SAMPLES * MAX_CHANNELS * 4];
-static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 4];
+static uint8_t samp_in[MAX_SAMPLES * MAX_CHANNELS * 8];
+static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 8];
 
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int channel_counts[] = { 1, 2, 4, 6, 8, 11 };
 
-#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 60
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 120
 
-static uint32_t n_results = 0;
-static struct stats results[MAX_RESULTS];
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("fmt-ops", results);
 
 static void run_test1(const char *name, const char *impl, bool in_packed, bool out_packed,
 		convert_func_t func, int n_channels, int n_samples)
@@ -61,37 +55,32 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 	int i, j;
 	const void *ip[n_channels];
 	void *op[n_channels];
-	struct timespec ts;
 	uint64_t count, t1, t2;
 	struct convert conv;
 
 	conv.n_channels = n_channels;
 
 	for (j = 0; j < n_channels; j++) {
-		ip[j] = &samp_in[j * n_samples * 4];
-		op[j] = &samp_out[j * n_samples * 4];
+		ip[j] = &samp_in[j * n_samples * 8];
+		op[j] = &samp_out[j * n_samples * 8];
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
-
+	t1 = bench_now();
 	count = 0;
 	for (i = 0; i < MAX_COUNT; i++) {
 		func(&conv, op, ip, n_samples);
 		count++;
 	}
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
-
-	spa_assert(n_results < MAX_RESULTS);
+	t2 = bench_now();
 
-	results[n_results++] = (struct stats) {
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = impl,
 		.n_samples = n_samples,
 		.n_channels = n_channels,
-		.perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
-		.name = name,
-		.impl = impl
-	};
+		.count = count,
+		.nsec = t2 - t1,
+	});
 }
 
 static void run_test(const char *name, const char *impl, bool in_packed, bool out_packed, convert_func_t func)
@@ -106,6 +95,17 @@ static void run_test(const char *name, const char *impl, bool in_packed, bool ou
 	}
 }
 
+static void run_test_channels(const char *name, const char *impl, bool in_packed, bool out_packed,
+		convert_func_t func, int n_channels)
+{
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(sample_sizes); i++) {
+		run_test1(name, impl, in_packed, out_packed, func, n_channels,
+			(sample_sizes[i] + (n_channels -1)) / n_channels);
+	}
+}
+
 static void test_f32_u8(void)
 {
 	run_test("test_f32_u8", "c", true, true, conv_f32_to_u8_c);
@@ -127,6 +127,13 @@ static void test_f32_s16(void)
 	run_test("test_f32d_s16", "c", false, true, conv_f32d_to_s16_c);
 #if defined (HAVE_SSE2)
 	run_test("test_f32d_s16", "sse2", false, true, conv_f32d_to_s16_sse2);
+#endif
+#if defined (HAVE_AVX2)
+	run_test("test_f32d_s16", "avx2", false, true, conv_f32d_to_s16_avx2);
+#endif
+#if defined (HAVE_NEON)
+	run_test("test_f32d_s16", "neon", false, true, conv_f32d_to_s16_neon);
+	run_test_channels("test_f32d_s16_2", "neon", false, true, conv_f32d_to_s16_2_neon, 2);
 #endif
 	run_test("test_f32_s16d", "c", true, false, conv_f32_to_s16d_c);
 }
@@ -138,6 +145,18 @@ static void test_s16_f32(void)
 	run_test("test_s16_f32d", "c", true, false, conv_s16_to_f32d_c);
 #if defined (HAVE_SSE2)
 	run_test("test_s16_f32d", "sse2", true, false, conv_s16_to_f32d_sse2);
+	run_test_channels("test_s16_f32d_2", "sse2", true, false, conv_s16_to_f32d_2_sse2, 2);
+#endif
+#if defined (HAVE_AVX2)
+	run_test("test_s16_f32d", "avx2", true, false, conv_s16_to_f32d_avx2);
+	run_test_channels("test_s16_f32d_2", "avx2", true, false, conv_s16_to_f32d_2_avx2, 2);
+#endif
+#if defined (HAVE_AVX512)
+	run_test("test_s16_f32d", "avx512", true, false, conv_s16_to_f32d_avx512);
+#endif
+#if defined (HAVE_NEON)
+	run_test("test_s16_f32d", "neon", true, false, conv_s16_to_f32d_neon);
+	run_test_channels("test_s16_f32d_2", "neon", true, false, conv_s16_to_f32d_2_neon, 2);
 #endif
 }
 
@@ -147,6 +166,13 @@ static void test_f32_s32(void)
 	run_test("test_f32d_s32", "c", false, true, conv_f32d_to_s32_c);
 #if defined (HAVE_SSE2)
 	run_test("test_f32d_s32", "sse2", false, true, conv_f32d_to_s32_sse2);
+#endif
+#if defined (HAVE_AVX2)
+	run_test("test_f32d_s32", "avx2", false, true, conv_f32d_to_s32_avx2);
+#endif
+#if defined (HAVE_NEON)
+	run_test("test_f32d_s32", "neon", false, true, conv_f32d_to_s32_neon);
+	run_test_channels("test_f32d_s32_2", "neon", false, true, conv_f32d_to_s32_2_neon, 2);
 #endif
 	run_test("test_f32_s32d", "c", true, false, conv_f32_to_s32d_c);
 }
@@ -156,12 +182,28 @@ static void test_s32_f32(void)
 	run_test("test_s32_f32", "c", true, true, conv_s32_to_f32_c);
 	run_test("test_s32d_f32", "c", false, true, conv_s32d_to_f32_c);
 	run_test("test_s32_f32d", "c", true, false, conv_s32_to_f32d_c);
+#if defined (HAVE_SSE2)
+	run_test("test_s32_f32d", "sse2", true, false, conv_s32_to_f32d_sse2);
+#endif
+#if defined (HAVE_AVX2)
+	run_test("test_s32_f32d", "avx2", true, false, conv_s32_to_f32d_avx2);
+#endif
+#if defined (HAVE_NEON)
+	run_test("test_s32_f32d", "neon", true, false, conv_s32_to_f32d_neon);
+	run_test_channels("test_s32_f32d_2", "neon", true, false, conv_s32_to_f32d_2_neon, 2);
+#endif
 }
 
 static void test_f32_s24(void)
 {
 	run_test("test_f32_s24", "c", true, true, conv_f32_to_s24_c);
 	run_test("test_f32d_s24", "c", false, true, conv_f32d_to_s24_c);
+#if defined (HAVE_AVX2)
+	run_test("test_f32d_s24", "avx2", false, true, conv_f32d_to_s24_avx2);
+#endif
+#if defined (HAVE_AVX512)
+	run_test("test_f32d_s24", "avx512", false, true, conv_f32d_to_s24_avx512);
+#endif
 	run_test("test_f32_s24d", "c", true, false, conv_f32_to_s24d_c);
 }
 
@@ -179,6 +221,9 @@ static void test_s24_f32(void)
 #if defined (HAVE_SSE41)
 	run_test("test_s24_f32d", "sse41", true, false, conv_s24_to_f32d_sse41);
 #endif
+#if defined (HAVE_AVX2)
+	run_test("test_s24_f32d", "avx2", true, false, conv_s24_to_f32d_avx2);
+#endif
 }
 
 static void test_f32_s24_32(void)
@@ -195,12 +240,82 @@ static void test_s24_32_f32(void)
 	run_test("test_s24_32_f32d", "c", true, false, conv_s24_32_to_f32d_c);
 }
 
+static void test_f64_f32(void)
+{
+	run_test("test_f64_f32", "c", true, true, conv_f64_to_f32_c);
+	run_test("test_f64d_f32", "c", false, true, conv_f64d_to_f32_c);
+	run_test("test_f64_f32d", "c", true, false, conv_f64_to_f32d_c);
+	run_test("test_f64d_f32d", "c", false, false, conv_f64d_to_f32d_c);
+#if defined (HAVE_SSE2)
+	run_test("test_f64_f32d", "sse2", true, false, conv_f64_to_f32d_sse2);
+	run_test("test_f64d_f32d", "sse2", false, false, conv_f64d_to_f32d_sse2);
+#endif
+}
+
+static void test_f32_f64(void)
+{
+	run_test("test_f32_f64", "c", true, true, conv_f32_to_f64_c);
+	run_test("test_f32d_f64", "c", false, true, conv_f32d_to_f64_c);
+	run_test("test_f32_f64d", "c", true, false, conv_f32_to_f64d_c);
+	run_test("test_f32d_f64d", "c", false, false, conv_f32d_to_f64d_c);
+#if defined (HAVE_SSE2)
+	run_test("test_f32d_f64", "sse2", false, true, conv_f32d_to_f64_sse2);
+	run_test("test_f32d_f64d", "sse2", false, false, conv_f32d_to_f64d_sse2);
+#endif
+}
+
+static void test_swapped(void)
+{
+	run_test("test_s16s_f32d", "c", true, false, conv_s16s_to_f32d_c);
+	run_test("test_f32d_s16s", "c", false, true, conv_f32d_to_s16s_c);
+	run_test("test_s32s_f32d", "c", true, false, conv_s32s_to_f32d_c);
+	run_test("test_f32d_s32s", "c", false, true, conv_f32d_to_s32s_c);
+	run_test("test_s24s_f32d", "c", true, false, conv_s24s_to_f32d_c);
+	run_test("test_f32d_s24s", "c", false, true, conv_f32d_to_s24s_c);
+	run_test("test_f32s_f32d", "c", true, false, conv_f32s_to_f32d_c);
+	run_test("test_f32d_f32s", "c", false, true, conv_f32d_to_f32s_c);
+#if defined (HAVE_SSSE3)
+	run_test("test_s16s_f32d", "ssse3", true, false, conv_s16s_to_f32d_ssse3);
+	run_test("test_f32d_s16s", "ssse3", false, true, conv_f32d_to_s16s_ssse3);
+	run_test("test_s32s_f32d", "ssse3", true, false, conv_s32s_to_f32d_ssse3);
+	run_test("test_f32d_s32s", "ssse3", false, true, conv_f32d_to_s32s_ssse3);
+	run_test("test_f32s_f32d", "ssse3", true, false, conv_f32s_to_f32d_ssse3);
+	run_test("test_f32d_f32s", "ssse3", false, true, conv_f32d_to_f32s_ssse3);
+#endif
+#if defined (HAVE_NEON)
+	run_test("test_s16s_f32d", "neon", true, false, conv_s16s_to_f32d_neon);
+	run_test("test_f32d_s16s", "neon", false, true, conv_f32d_to_s16s_neon);
+	run_test("test_s32s_f32d", "neon", true, false, conv_s32s_to_f32d_neon);
+	run_test("test_f32d_s32s", "neon", false, true, conv_f32d_to_s32s_neon);
+#endif
+}
+
 static void test_interleave(void)
 {
 	run_test("test_interleave_8", "c", false, true, conv_interleave_8_c);
 	run_test("test_interleave_16", "c", false, true, conv_interleave_16_c);
 	run_test("test_interleave_24", "c", false, true, conv_interleave_24_c);
 	run_test("test_interleave_32", "c", false, true, conv_interleave_32_c);
+#if defined (HAVE_SSE2)
+	run_test("test_interleave_32", "sse2", false, true, conv_interleave_32_sse2);
+#endif
+#if defined (HAVE_SSSE3)
+	run_test("test_interleave_24", "ssse3", false, true, conv_interleave_24_ssse3);
+#endif
+#if defined (HAVE_AVX2)
+	run_test_channels("test_interleave_32", "avx2", false, true, conv_interleave_32_2_avx2, 2);
+	run_test_channels("test_interleave_32", "avx2", false, true, conv_interleave_32_4_avx2, 4);
+	run_test_channels("test_interleave_32", "avx2", false, true, conv_interleave_32_8_avx2, 8);
+#endif
+#if defined (HAVE_AVX512)
+	run_test_channels("test_interleave_32", "avx512", false, true, conv_interleave_32_2_avx512, 2);
+	run_test_channels("test_interleave_32", "avx512", false, true, conv_interleave_32_4_avx512, 4);
+	run_test_channels("test_interleave_32", "avx512", false, true, conv_interleave_32_8_avx512, 8);
+#endif
+#if defined (HAVE_NEON)
+	run_test_channels("test_interleave_32", "neon", false, true, conv_interleave_32_2_neon, 2);
+	run_test_channels("test_interleave_32", "neon", false, true, conv_interleave_32_4_neon, 4);
+#endif
 }
 
 static void test_deinterleave(void)
@@ -209,23 +324,25 @@ static void test_deinterleave(void)
 	run_test("test_deinterleave_16", "c", true, false, conv_deinterleave_16_c);
 	run_test("test_deinterleave_24", "c", true, false, conv_deinterleave_24_c);
 	run_test("test_deinterleave_32", "c", true, false, conv_deinterleave_32_c);
-}
-
-static int compare_func(const void *_a, const void *_b)
-{
-	const struct stats *a = _a, *b = _b;
-	int diff;
-	if ((diff = strcmp(a->name, b->name)) != 0) return diff;
-	if ((diff = a->n_samples - b->n_samples) != 0) return diff;
-	if ((diff = a->n_channels - b->n_channels) != 0) return diff;
-	if ((diff = b->perf - a->perf) != 0) return diff;
-	return 0;
+#if defined (HAVE_SSE2)
+	run_test("test_deinterleave_32", "sse2", true, false, conv_deinterleave_32_sse2);
+#endif
+#if defined (HAVE_SSSE3)
+	run_test("test_deinterleave_24", "ssse3", true, false, conv_deinterleave_24_ssse3);
+#endif
+#if defined (HAVE_AVX2)
+	run_test_channels("test_deinterleave_32", "avx2", true, false, conv_deinterleave_32_2_avx2, 2);
+	run_test_channels("test_deinterleave_32", "avx2", true, false, conv_deinterleave_32_4_avx2, 4);
+	run_test_channels("test_deinterleave_32", "avx2", true, false, conv_deinterleave_32_8_avx2, 8);
+#endif
+#if defined (HAVE_NEON)
+	run_test_channels("test_deinterleave_32", "neon", true, false, conv_deinterleave_32_2_neon, 2);
+	run_test_channels("test_deinterleave_32", "neon", true, false, conv_deinterleave_32_4_neon, 4);
+#endif
 }
 
 int main(int argc, char *argv[])
 {
-	uint32_t i;
-
 	test_f32_u8();
 	test_u8_f32();
 	test_f32_s16();
@@ -236,15 +353,13 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_f64_f32();
+	test_f32_f64();
+	test_swapped();
 	test_interleave();
 	test_deinterleave();
 
-	qsort(results, n_results, sizeof(struct stats), compare_func);
+	bench_report(&bench);
 
-	for (i = 0; i < n_results; i++) {
-		struct stats *s = &results[i];
-		fprintf(stderr, "%-12."PRIu64" \t%-32.32s %s \t samples %d, channels %d\n",
-				s->perf, s->name, s->impl, s->n_samples, s->n_channels);
-	}
 	return 0;
 }
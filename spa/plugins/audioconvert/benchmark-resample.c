@@ -29,6 +29,8 @@
 #include <errno.h>
 #include <time.h>
 
+#include "benchmark.h"
+
 #include "resample.h"
 #include "resample-native.h"
 
@@ -37,38 +39,31 @@
 
 #define MAX_COUNT 200
 
-struct stats {
-	uint32_t in_rate;
-	uint32_t out_rate;
-	uint32_t n_samples;
-	uint32_t n_channels;
-	uint64_t perf;
-	const char *name;
-	const char *impl;
-};
-
 static float samp_in[MAX_SAMPLES * MAX_CHANNELS];
 static float samp_out[MAX_SAMPLES * MAX_CHANNELS];
 
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int in_rates[] = { 44100, 44100, 48000, 96000, 22050, 96000 };
 static const int out_rates[] = { 44100, 48000, 44100, 48000, 48000, 44100 };
+static const int qualities[] = { RESAMPLE_DEFAULT_QUALITY, 10 };
+static const int channel_counts[] = { 1, 2, 6 };
 
 
-#define MAX_RESAMPLER	5
+#define MAX_RESAMPLER	6
 #define MAX_SIZES	SPA_N_ELEMENTS(sample_sizes)
 #define MAX_RATES	SPA_N_ELEMENTS(in_rates)
-#define MAX_RESULTS	MAX_RESAMPLER * MAX_SIZES * MAX_RATES
+#define MAX_QUALITIES	SPA_N_ELEMENTS(qualities)
+#define MAX_CHANNEL_COUNTS	SPA_N_ELEMENTS(channel_counts)
+#define MAX_RESULTS	MAX_RESAMPLER * MAX_SIZES * MAX_RATES * MAX_QUALITIES * MAX_CHANNEL_COUNTS
 
-static uint32_t n_results = 0;
-static struct stats results[MAX_RESULTS];
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("resample", results);
 
 static void run_test1(const char *name, const char *impl, struct resample *r, int n_samples)
 {
 	uint32_t i, j;
 	const void *ip[MAX_CHANNELS];
 	void *op[MAX_CHANNELS];
-	struct timespec ts;
 	uint64_t count, t1, t2;
 	uint32_t in_len, out_len;
 
@@ -77,9 +72,7 @@ static void run_test1(const char *name, const char *impl, struct resample *r, in
 		op[j] = &samp_out[j * MAX_SAMPLES];
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
-
+	t1 = bench_now();
 	count = 0;
 	for (i = 0; i < MAX_COUNT; i++) {
 		in_len = n_samples;
@@ -87,20 +80,22 @@ static void run_test1(const char *name, const char *impl, struct resample *r, in
 		resample_process(r, ip, &in_len, op, &out_len);
 		count++;
 	}
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+	t2 = bench_now();
 
-	spa_assert(n_results < MAX_RESULTS);
-
-	results[n_results++] = (struct stats) {
-		.in_rate = r->i_rate,
-		.out_rate = r->o_rate,
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = impl,
 		.n_samples = n_samples,
 		.n_channels = r->channels,
-		.perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
-		.name = name,
-		.impl = impl
-	};
+		.n_params = 3,
+		.params = {
+			{ "in_rate", r->i_rate },
+			{ "out_rate", r->o_rate },
+			{ "quality", r->quality },
+		},
+		.count = count,
+		.nsec = t2 - t1,
+	});
 }
 
 static void run_test(const char *name, const char *impl, struct resample *r)
@@ -110,78 +105,48 @@ static void run_test(const char *name, const char *impl, struct resample *r)
 		run_test1(name, impl, r, sample_sizes[i]);
 }
 
-static int compare_func(const void *_a, const void *_b)
+static void run_impl(const char *impl, uint32_t cpu_flags)
 {
-	const struct stats *a = _a, *b = _b;
-	int diff;
-
-	if ((diff = a->in_rate - b->in_rate) != 0) return diff;
-	if ((diff = a->out_rate - b->out_rate) != 0) return diff;
-	if ((diff = a->n_samples - b->n_samples) != 0) return diff;
-	if ((diff = a->n_channels - b->n_channels) != 0) return diff;
-	if ((diff = b->perf - a->perf) != 0) return diff;
-	return 0;
+	struct resample r;
+	uint32_t i, j, k;
+
+	for (i = 0; i < SPA_N_ELEMENTS(qualities); i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(in_rates); j++) {
+			for (k = 0; k < SPA_N_ELEMENTS(channel_counts); k++) {
+				spa_zero(r);
+				r.channels = channel_counts[k];
+				r.cpu_flags = cpu_flags;
+				r.quality = qualities[i];
+				r.i_rate = in_rates[j];
+				r.o_rate = out_rates[j];
+				impl_native_init(&r);
+				run_test("native", impl, &r);
+				resample_free(&r);
+			}
+		}
+	}
 }
 
 int main(int argc, char *argv[])
 {
-	struct resample r;
-	uint32_t i;
-
-	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-		spa_zero(r);
-		r.channels = 2;
-		r.cpu_flags = 0;
-		r.i_rate = in_rates[i];
-		r.o_rate = out_rates[i];
-		impl_native_init(&r);
-		run_test("native", "c", &r);
-		resample_free(&r);
-	}
+	run_impl("c", 0);
 #if defined (HAVE_SSE)
-	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-		spa_zero(r);
-		r.channels = 2;
-		r.cpu_flags = SPA_CPU_FLAG_SSE;
-		r.i_rate = in_rates[i];
-		r.o_rate = out_rates[i];
-		impl_native_init(&r);
-		run_test("native", "sse", &r);
-		resample_free(&r);
-	}
+	run_impl("sse", SPA_CPU_FLAG_SSE);
 #endif
 #if defined (HAVE_SSSE3)
-	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-		spa_zero(r);
-		r.channels = 2;
-		r.cpu_flags = SPA_CPU_FLAG_SSSE3 | SPA_CPU_FLAG_SLOW_UNALIGNED;
-		r.i_rate = in_rates[i];
-		r.o_rate = out_rates[i];
-		impl_native_init(&r);
-		run_test("native", "ssse3", &r);
-		resample_free(&r);
-	}
+	run_impl("ssse3", SPA_CPU_FLAG_SSSE3 | SPA_CPU_FLAG_SLOW_UNALIGNED);
 #endif
 #if defined (HAVE_AVX) && defined(HAVE_FMA)
-	for (i = 0; i < SPA_N_ELEMENTS(in_rates); i++) {
-		spa_zero(r);
-		r.channels = 2;
-		r.cpu_flags = SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3;
-		r.i_rate = in_rates[i];
-		r.o_rate = out_rates[i];
-		impl_native_init(&r);
-		run_test("native", "avx", &r);
-		resample_free(&r);
-	}
+	run_impl("avx", SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3);
+#endif
+#if defined (HAVE_AVX512)
+	run_impl("avx512", SPA_CPU_FLAG_AVX512);
+#endif
+#if defined (HAVE_NEON)
+	run_impl("neon", SPA_CPU_FLAG_NEON);
 #endif
 
-	qsort(results, n_results, sizeof(struct stats), compare_func);
+	bench_report(&bench);
 
-	for (i = 0; i < n_results; i++) {
-		struct stats *s = &results[i];
-		fprintf(stderr, "%-12."PRIu64" \t%-16.16s %s \t%d->%d samples %d, channels %d\n",
-				s->perf, s->name, s->impl, s->in_rate, s->out_rate,
-				s->n_samples, s->n_channels);
-	}
 	return 0;
 }
@@ -0,0 +1,72 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "channelmix-ops.h"
+
+#include <immintrin.h>
+
+/* generic matrix, the zero coefficients of each output are skipped and
+ * 16 samples are accumulated in registers */
+void
+channelmix_f32_n_m_avx(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, k, l, n, unrolled = n_samples & ~15;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float *sp[SPA_AUDIO_MAX_CHANNELS];
+	__m256 cv[SPA_AUDIO_MAX_CHANNELS], sum[2];
+	__m128 t;
+
+	for (i = 0; i < n_dst; i++) {
+		float *di = d[i];
+
+		for (j = k = 0; j < n_src; j++) {
+			if (mix->matrix[i][j] == 0.0f)
+				continue;
+			sp[k] = s[j];
+			cv[k++] = _mm256_set1_ps(mix->matrix[i][j]);
+		}
+		if (k == 0) {
+			memset(di, 0, n_samples * sizeof(float));
+			continue;
+		}
+		for (n = 0; n < unrolled; n += 16) {
+			sum[0] = _mm256_mul_ps(_mm256_loadu_ps(&sp[0][n]), cv[0]);
+			sum[1] = _mm256_mul_ps(_mm256_loadu_ps(&sp[0][n+8]), cv[0]);
+			for (l = 1; l < k; l++) {
+				sum[0] = _mm256_fmadd_ps(_mm256_loadu_ps(&sp[l][n]), cv[l], sum[0]);
+				sum[1] = _mm256_fmadd_ps(_mm256_loadu_ps(&sp[l][n+8]), cv[l], sum[1]);
+			}
+			_mm256_storeu_ps(&di[n], sum[0]);
+			_mm256_storeu_ps(&di[n+8], sum[1]);
+		}
+		for (; n < n_samples; n++) {
+			t = _mm_mul_ss(_mm_load_ss(&sp[0][n]), _mm256_castps256_ps128(cv[0]));
+			for (l = 1; l < k; l++)
+				t = _mm_fmadd_ss(_mm_load_ss(&sp[l][n]), _mm256_castps256_ps128(cv[l]), t);
+			_mm_store_ss(&di[n], t);
+		}
+	}
+}
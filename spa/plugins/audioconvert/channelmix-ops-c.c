@@ -68,6 +68,51 @@ channelmix_f32_n_m_c(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT
 	}
 }
 
+#define RAMP_BLOCK	256u
+
+/* interpolate each coefficient from matrix_ramp to matrix over ramp_len
+ * samples, computed as d = A.s + t * ((B - A).s) so that the loops over
+ * the samples stay simple enough to vectorize */
+void
+channelmix_f32_n_m_ramp_c(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, n, k, chunk;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float scale = 1.0f / mix->ramp_len;
+	float sum[RAMP_BLOCK], delta[RAMP_BLOCK], t[RAMP_BLOCK];
+
+	for (n = 0; n < n_samples; n += chunk) {
+		chunk = SPA_MIN(n_samples - n, RAMP_BLOCK);
+
+		for (k = 0; k < chunk; k++)
+			t[k] = (mix->ramp_pos + n + k + 1) * scale;
+
+		for (i = 0; i < n_dst; i++) {
+			float *di = &d[i][n];
+
+			memset(sum, 0, chunk * sizeof(float));
+			memset(delta, 0, chunk * sizeof(float));
+
+			for (j = 0; j < n_src; j++) {
+				const float *sj = &s[j][n];
+				const float a = mix->matrix_ramp[i][j];
+				const float b = mix->matrix[i][j] - a;
+
+				if (a != 0.0f)
+					for (k = 0; k < chunk; k++)
+						sum[k] += sj[k] * a;
+				if (b != 0.0f)
+					for (k = 0; k < chunk; k++)
+						delta[k] += sj[k] * b;
+			}
+			for (k = 0; k < chunk; k++)
+				di[k] = sum[k] + delta[k] * t[k];
+		}
+	}
+}
+
 #define MASK_MONO	_M(FC)|_M(MONO)|_M(UNKNOWN)
 #define MASK_STEREO	_M(FL)|_M(FR)|_M(UNKNOWN)
 
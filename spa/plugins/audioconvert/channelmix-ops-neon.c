@@ -0,0 +1,312 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+#include "channelmix-ops.h"
+
+#include <arm_neon.h>
+
+void channelmix_copy_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~15;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+
+	if (mix->zero) {
+		for (i = 0; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+	}
+	else if (mix->norm) {
+		for (i = 0; i < n_dst; i++)
+			spa_memcpy(d[i], s[i], n_samples * sizeof(float));
+	}
+	else {
+		for (i = 0; i < n_dst; i++) {
+			float *di = d[i];
+			const float *si = s[i];
+			const float vol = mix->matrix[i][i];
+
+			for(n = 0; n < unrolled; n += 16) {
+				vst1q_f32(&di[n], vmulq_n_f32(vld1q_f32(&si[n]), vol));
+				vst1q_f32(&di[n+4], vmulq_n_f32(vld1q_f32(&si[n+4]), vol));
+				vst1q_f32(&di[n+8], vmulq_n_f32(vld1q_f32(&si[n+8]), vol));
+				vst1q_f32(&di[n+12], vmulq_n_f32(vld1q_f32(&si[n+12]), vol));
+			}
+			for(; n < n_samples; n++)
+				di[n] = si[n] * vol;
+		}
+	}
+}
+
+void
+channelmix_f32_2_4_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~3;
+	float **d = (float **)dst;
+	const float **s = (const float **)src;
+	const float v0 = mix->matrix[0][0];
+	const float v1 = mix->matrix[1][1];
+	float32x4_t in;
+	const float *sFL = s[0], *sFR = s[1];
+	float *dFL = d[0], *dFR = d[1], *dRL = d[2], *dRR = d[3];
+
+	if (mix->zero) {
+		for (i = 0; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+	}
+	else if (mix->norm) {
+		for(n = 0; n < unrolled; n += 4) {
+			in = vld1q_f32(&sFL[n]);
+			vst1q_f32(&dFL[n], in);
+			vst1q_f32(&dRL[n], in);
+			in = vld1q_f32(&sFR[n]);
+			vst1q_f32(&dFR[n], in);
+			vst1q_f32(&dRR[n], in);
+		}
+		for(; n < n_samples; n++) {
+			dFL[n] = dRL[n] = sFL[n];
+			dFR[n] = dRR[n] = sFR[n];
+		}
+	}
+	else {
+		for(n = 0; n < unrolled; n += 4) {
+			in = vmulq_n_f32(vld1q_f32(&sFL[n]), v0);
+			vst1q_f32(&dFL[n], in);
+			vst1q_f32(&dRL[n], in);
+			in = vmulq_n_f32(vld1q_f32(&sFR[n]), v1);
+			vst1q_f32(&dFR[n], in);
+			vst1q_f32(&dRR[n], in);
+		}
+		for(; n < n_samples; n++) {
+			dFL[n] = dRL[n] = sFL[n] * v0;
+			dFR[n] = dRR[n] = sFR[n] * v1;
+		}
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR */
+void
+channelmix_f32_5p1_2_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t n, unrolled = n_samples & ~3;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float v0 = mix->matrix[0][0];
+	const float v1 = mix->matrix[1][1];
+	const float clev = mix->matrix[2][0];
+	const float llev = mix->matrix[3][0];
+	const float slev0 = mix->matrix[4][0];
+	const float slev1 = mix->matrix[4][1];
+	float32x4_t in, ctr;
+	float c;
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3], *sSL = s[4], *sSR = s[5];
+	float *dFL = d[0], *dFR = d[1];
+
+	if (mix->zero) {
+		memset(dFL, 0, n_samples * sizeof(float));
+		memset(dFR, 0, n_samples * sizeof(float));
+	}
+	else if (mix->norm) {
+		for(n = 0; n < unrolled; n += 4) {
+			ctr = vmulq_n_f32(vld1q_f32(&sFC[n]), clev);
+			ctr = vaddq_f32(ctr, vmulq_n_f32(vld1q_f32(&sLFE[n]), llev));
+			in = vmulq_n_f32(vld1q_f32(&sSL[n]), slev0);
+			in = vaddq_f32(in, ctr);
+			in = vaddq_f32(in, vld1q_f32(&sFL[n]));
+			vst1q_f32(&dFL[n], in);
+			in = vmulq_n_f32(vld1q_f32(&sSR[n]), slev1);
+			in = vaddq_f32(in, ctr);
+			in = vaddq_f32(in, vld1q_f32(&sFR[n]));
+			vst1q_f32(&dFR[n], in);
+		}
+		for(; n < n_samples; n++) {
+			c = sFC[n] * clev + sLFE[n] * llev;
+			dFL[n] = sSL[n] * slev0 + c + sFL[n];
+			dFR[n] = sSR[n] * slev1 + c + sFR[n];
+		}
+	}
+	else {
+		for(n = 0; n < unrolled; n += 4) {
+			ctr = vmulq_n_f32(vld1q_f32(&sFC[n]), clev);
+			ctr = vaddq_f32(ctr, vmulq_n_f32(vld1q_f32(&sLFE[n]), llev));
+			in = vmulq_n_f32(vld1q_f32(&sSL[n]), slev0);
+			in = vaddq_f32(in, ctr);
+			in = vaddq_f32(in, vld1q_f32(&sFL[n]));
+			vst1q_f32(&dFL[n], vmulq_n_f32(in, v0));
+			in = vmulq_n_f32(vld1q_f32(&sSR[n]), slev1);
+			in = vaddq_f32(in, ctr);
+			in = vaddq_f32(in, vld1q_f32(&sFR[n]));
+			vst1q_f32(&dFR[n], vmulq_n_f32(in, v1));
+		}
+		for(; n < n_samples; n++) {
+			c = sFC[n] * clev + sLFE[n] * llev;
+			dFL[n] = (sSL[n] * slev0 + c + sFL[n]) * v0;
+			dFR[n] = (sSR[n] * slev1 + c + sFR[n]) * v1;
+		}
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR+FC+LFE*/
+void
+channelmix_f32_5p1_3p1_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~3;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float v0 = mix->matrix[0][0];
+	const float v1 = mix->matrix[1][1];
+	const float slev0 = mix->matrix[0][4];
+	const float slev1 = mix->matrix[1][5];
+	const float v2 = mix->matrix[2][2];
+	const float v3 = mix->matrix[3][3];
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3], *sSL = s[4], *sSR = s[5];
+	float *dFL = d[0], *dFR = d[1], *dFC = d[2], *dLFE = d[3];
+
+	if (mix->zero) {
+		for (i = 0; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+	}
+	else {
+		for(n = 0; n < unrolled; n += 4) {
+			vst1q_f32(&dFL[n], vaddq_f32(
+					vmulq_n_f32(vld1q_f32(&sFL[n]), v0),
+					vmulq_n_f32(vld1q_f32(&sSL[n]), slev0)));
+			vst1q_f32(&dFR[n], vaddq_f32(
+					vmulq_n_f32(vld1q_f32(&sFR[n]), v1),
+					vmulq_n_f32(vld1q_f32(&sSR[n]), slev1)));
+			vst1q_f32(&dFC[n], vmulq_n_f32(vld1q_f32(&sFC[n]), v2));
+			vst1q_f32(&dLFE[n], vmulq_n_f32(vld1q_f32(&sLFE[n]), v3));
+		}
+		for(; n < n_samples; n++) {
+			dFL[n] = sFL[n] * v0 + sSL[n] * slev0;
+			dFR[n] = sFR[n] * v1 + sSR[n] * slev1;
+			dFC[n] = sFC[n] * v2;
+			dLFE[n] = sLFE[n] * v3;
+		}
+	}
+}
+
+/* FL+FR+FC+LFE+SL+SR -> FL+FR+RL+RR*/
+void
+channelmix_f32_5p1_4_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~3;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float clev = mix->matrix[2][2];
+	const float llev = mix->matrix[3][3];
+	const float v0 = mix->matrix[0][0];
+	const float v1 = mix->matrix[1][1];
+	float32x4_t ctr;
+	float c;
+	const float *sFL = s[0], *sFR = s[1], *sFC = s[2], *sLFE = s[3], *sSL = s[4], *sSR = s[5];
+	float *dFL = d[0], *dFR = d[1], *dRL = d[2], *dRR = d[3];
+
+	if (mix->zero) {
+		for (i = 0; i < n_dst; i++)
+			memset(d[i], 0, n_samples * sizeof(float));
+	}
+	else if (mix->norm) {
+		for(n = 0; n < unrolled; n += 4) {
+			ctr = vmulq_n_f32(vld1q_f32(&sFC[n]), clev);
+			ctr = vaddq_f32(ctr, vmulq_n_f32(vld1q_f32(&sLFE[n]), llev));
+			vst1q_f32(&dFL[n], vaddq_f32(vld1q_f32(&sFL[n]), ctr));
+			vst1q_f32(&dFR[n], vaddq_f32(vld1q_f32(&sFR[n]), ctr));
+			vst1q_f32(&dRL[n], vld1q_f32(&sSL[n]));
+			vst1q_f32(&dRR[n], vld1q_f32(&sSR[n]));
+		}
+		for(; n < n_samples; n++) {
+			c = sFC[n] * clev + sLFE[n] * llev;
+			dFL[n] = sFL[n] + c;
+			dFR[n] = sFR[n] + c;
+			dRL[n] = sSL[n];
+			dRR[n] = sSR[n];
+		}
+	}
+	else {
+		for(n = 0; n < unrolled; n += 4) {
+			ctr = vmulq_n_f32(vld1q_f32(&sFC[n]), clev);
+			ctr = vaddq_f32(ctr, vmulq_n_f32(vld1q_f32(&sLFE[n]), llev));
+			vst1q_f32(&dFL[n], vmulq_n_f32(vaddq_f32(vld1q_f32(&sFL[n]), ctr), v0));
+			vst1q_f32(&dFR[n], vmulq_n_f32(vaddq_f32(vld1q_f32(&sFR[n]), ctr), v1));
+			vst1q_f32(&dRL[n], vmulq_n_f32(vld1q_f32(&sSL[n]), v0));
+			vst1q_f32(&dRR[n], vmulq_n_f32(vld1q_f32(&sSR[n]), v1));
+		}
+		for(; n < n_samples; n++) {
+			c = sFC[n] * clev + sLFE[n] * llev;
+			dFL[n] = (sFL[n] + c) * v0;
+			dFR[n] = (sFR[n] + c) * v1;
+			dRL[n] = sSL[n] * v0;
+			dRR[n] = sSR[n] * v1;
+		}
+	}
+}
+
+/* generic matrix, the zero coefficients of each output are skipped and
+ * 8 samples are accumulated in registers */
+void
+channelmix_f32_n_m_neon(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, k, l, n, unrolled = n_samples & ~7;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float *sp[SPA_AUDIO_MAX_CHANNELS];
+	float cv[SPA_AUDIO_MAX_CHANNELS], t;
+	float32x4_t sum[2];
+
+	for (i = 0; i < n_dst; i++) {
+		float *di = d[i];
+
+		for (j = k = 0; j < n_src; j++) {
+			if (mix->matrix[i][j] == 0.0f)
+				continue;
+			sp[k] = s[j];
+			cv[k++] = mix->matrix[i][j];
+		}
+		if (k == 0) {
+			memset(di, 0, n_samples * sizeof(float));
+			continue;
+		}
+		for (n = 0; n < unrolled; n += 8) {
+			sum[0] = vmulq_n_f32(vld1q_f32(&sp[0][n]), cv[0]);
+			sum[1] = vmulq_n_f32(vld1q_f32(&sp[0][n+4]), cv[0]);
+			for (l = 1; l < k; l++) {
+				sum[0] = vaddq_f32(sum[0], vmulq_n_f32(vld1q_f32(&sp[l][n]), cv[l]));
+				sum[1] = vaddq_f32(sum[1], vmulq_n_f32(vld1q_f32(&sp[l][n+4]), cv[l]));
+			}
+			vst1q_f32(&di[n], sum[0]);
+			vst1q_f32(&di[n+4], sum[1]);
+		}
+		for (; n < n_samples; n++) {
+			t = sp[0][n] * cv[0];
+			for (l = 1; l < k; l++)
+				t += sp[l][n] * cv[l];
+			di[n] = t;
+		}
+	}
+}
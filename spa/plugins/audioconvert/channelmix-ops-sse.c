@@ -376,3 +376,47 @@ channelmix_f32_5p1_4_sse(struct channelmix *mix, uint32_t n_dst, void * SPA_REST
 		}
 	}
 }
+
+/* generic matrix, the zero coefficients of each output are skipped and
+ * 8 samples are accumulated in registers */
+void
+channelmix_f32_n_m_sse(struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, j, k, l, n, unrolled = n_samples & ~7;
+	float **d = (float **) dst;
+	const float **s = (const float **) src;
+	const float *sp[SPA_AUDIO_MAX_CHANNELS];
+	__m128 cv[SPA_AUDIO_MAX_CHANNELS], sum[2];
+
+	for (i = 0; i < n_dst; i++) {
+		float *di = d[i];
+
+		for (j = k = 0; j < n_src; j++) {
+			if (mix->matrix[i][j] == 0.0f)
+				continue;
+			sp[k] = s[j];
+			cv[k++] = _mm_set1_ps(mix->matrix[i][j]);
+		}
+		if (k == 0) {
+			memset(di, 0, n_samples * sizeof(float));
+			continue;
+		}
+		for (n = 0; n < unrolled; n += 8) {
+			sum[0] = _mm_mul_ps(_mm_loadu_ps(&sp[0][n]), cv[0]);
+			sum[1] = _mm_mul_ps(_mm_loadu_ps(&sp[0][n+4]), cv[0]);
+			for (l = 1; l < k; l++) {
+				sum[0] = _mm_add_ps(sum[0], _mm_mul_ps(_mm_loadu_ps(&sp[l][n]), cv[l]));
+				sum[1] = _mm_add_ps(sum[1], _mm_mul_ps(_mm_loadu_ps(&sp[l][n+4]), cv[l]));
+			}
+			_mm_storeu_ps(&di[n], sum[0]);
+			_mm_storeu_ps(&di[n+4], sum[1]);
+		}
+		for (; n < n_samples; n++) {
+			sum[0] = _mm_mul_ss(_mm_load_ss(&sp[0][n]), cv[0]);
+			for (l = 1; l < k; l++)
+				sum[0] = _mm_add_ss(sum[0], _mm_mul_ss(_mm_load_ss(&sp[l][n]), cv[l]));
+			_mm_store_ss(&di[n], sum[0]);
+		}
+	}
+}
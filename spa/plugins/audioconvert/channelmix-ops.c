@@ -64,6 +64,11 @@ static const struct channelmix_info {
 	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_sse, SPA_CPU_FLAG_SSE },
 	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_sse, SPA_CPU_FLAG_SSE },
 	{ EQ, 0, EQ, 0, channelmix_copy_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_neon, SPA_CPU_FLAG_NEON },
+	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_neon, SPA_CPU_FLAG_NEON },
+	{ EQ, 0, EQ, 0, channelmix_copy_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ 2, MASK_MONO, 2, MASK_MONO, channelmix_copy_c, 0 },
 	{ 2, MASK_STEREO, 2, MASK_STEREO, channelmix_copy_c, 0 },
@@ -75,33 +80,64 @@ static const struct channelmix_info {
 	{ 4, MASK_3_1, 1, MASK_MONO, channelmix_f32_3p1_1_c, 0 },
 #if defined (HAVE_SSE)
 	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ 2, MASK_STEREO, 4, MASK_QUAD, channelmix_f32_2_4_c, 0 },
 	{ 2, MASK_STEREO, 4, MASK_3_1, channelmix_f32_2_3p1_c, 0 },
 	{ 2, MASK_STEREO, 6, MASK_5_1, channelmix_f32_2_5p1_c, 0 },
 #if defined (HAVE_SSE)
 	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ 6, MASK_5_1, 2, MASK_STEREO, channelmix_f32_5p1_2_c, 0 },
 #if defined (HAVE_SSE)
 	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ 6, MASK_5_1, 4, MASK_QUAD, channelmix_f32_5p1_4_c, 0 },
 
 #if defined (HAVE_SSE)
 	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_neon, SPA_CPU_FLAG_NEON },
 #endif
 	{ 6, MASK_5_1, 4, MASK_3_1, channelmix_f32_5p1_3p1_c, 0 },
 
+	/* the 7.1 downmixes only have C versions, use the generic SIMD
+	 * matrix when available */
+#if defined (HAVE_AVX) && defined (HAVE_FMA)
+	{ 8, MASK_7_1, ANY, 0, channelmix_f32_n_m_avx, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3 },
+#endif
+#if defined (HAVE_SSE)
+	{ 8, MASK_7_1, ANY, 0, channelmix_f32_n_m_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ 8, MASK_7_1, ANY, 0, channelmix_f32_n_m_neon, SPA_CPU_FLAG_NEON },
+#endif
 	{ 8, MASK_7_1, 2, MASK_STEREO, channelmix_f32_7p1_2_c, 0 },
 	{ 8, MASK_7_1, 4, MASK_QUAD, channelmix_f32_7p1_4_c, 0 },
 	{ 8, MASK_7_1, 4, MASK_3_1, channelmix_f32_7p1_3p1_c, 0 },
 
+#if defined (HAVE_AVX) && defined (HAVE_FMA)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_avx, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3 },
+#endif
+#if defined (HAVE_SSE)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_sse, SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_NEON)
+	{ ANY, 0, ANY, 0, channelmix_f32_n_m_neon, SPA_CPU_FLAG_NEON },
+#endif
 	{ ANY, 0, ANY, 0, channelmix_f32_n_m_c, 0 },
 };
 
 #define MATCH_CHAN(a,b)		((a) == ANY || (a) == (b))
-#define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 #define MATCH_MASK(a,b)		((a) == 0 || ((a) & (b)) == (b))
 
 static const struct channelmix_info *find_channelmix_info(uint32_t src_chan, uint64_t src_mask,
@@ -109,7 +145,7 @@ static const struct channelmix_info *find_channelmix_info(uint32_t src_chan, uin
 {
 	size_t i;
 	for (i = 0; i < SPA_N_ELEMENTS(channelmix_table); i++) {
-		if (!MATCH_CPU_FLAGS(channelmix_table[i].cpu_flags, cpu_flags))
+		if (!SPA_CPU_FLAGS_MATCH(channelmix_table[i].cpu_flags, cpu_flags))
 			continue;
 
 		if (src_chan == dst_chan && src_mask == dst_mask)
@@ -347,8 +383,34 @@ static int make_matrix(struct channelmix *mix)
 	return 0;
 }
 
+static void impl_channelmix_process_ramp(struct channelmix *mix,
+		uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+		uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples)
+{
+	uint32_t i, n = SPA_MIN(n_samples, mix->ramp_len - mix->ramp_pos);
+	const void *s[n_src];
+	void *d[n_dst];
+
+	channelmix_f32_n_m_ramp_c(mix, n_dst, dst, n_src, src, n);
+	mix->ramp_pos += n;
+
+	if (channelmix_is_ramping(mix))
+		return;
+
+	/* ramp done, mix the remaining samples with the final matrix */
+	mix->process = mix->process_mix;
+	if (n == n_samples)
+		return;
+
+	for (i = 0; i < n_src; i++)
+		s[i] = SPA_MEMBER(src[i], n * sizeof(float), void);
+	for (i = 0; i < n_dst; i++)
+		d[i] = SPA_MEMBER(dst[i], n * sizeof(float), void);
+	mix->process(mix, n_dst, d, n_src, s, n_samples - n);
+}
+
 static void impl_channelmix_set_volume(struct channelmix *mix, float volume, bool mute,
-		uint32_t n_channel_volumes, float *channel_volumes)
+		uint32_t n_channel_volumes, float *channel_volumes, uint32_t ramp_samples)
 {
 	float volumes[SPA_AUDIO_MAX_CHANNELS];
 	float vol = mute ? 0.0f : volume, sum, t;
@@ -356,6 +418,19 @@ static void impl_channelmix_set_volume(struct channelmix *mix, float volume, boo
 	uint32_t src_chan = mix->src_chan;
 	uint32_t dst_chan = mix->dst_chan;
 
+	if (ramp_samples > 0) {
+		/* start the ramp from the matrix that is currently applied */
+		if (channelmix_is_ramping(mix)) {
+			t = (float)mix->ramp_pos / mix->ramp_len;
+			for (i = 0; i < dst_chan; i++)
+				for (j = 0; j < src_chan; j++)
+					mix->matrix_ramp[i][j] += (mix->matrix[i][j] -
+							mix->matrix_ramp[i][j]) * t;
+		} else {
+			memcpy(mix->matrix_ramp, mix->matrix, sizeof(mix->matrix));
+		}
+	}
+
 	/** apply global volume to channels */
 	sum = 0.0;
 	mix->norm = true;
@@ -400,7 +475,13 @@ static void impl_channelmix_set_volume(struct channelmix *mix, float volume, boo
 				mix->identity = false;
 		}
 	}
-	spa_log_debug(mix->log, "zero:%d norm:%d identity:%d", mix->zero, mix->norm, mix->identity);
+	spa_log_debug(mix->log, "zero:%d norm:%d identity:%d ramp:%u",
+			mix->zero, mix->norm, mix->identity, ramp_samples);
+
+	mix->ramp_len = ramp_samples;
+	mix->ramp_pos = 0;
+	mix->process = ramp_samples > 0 ?
+		impl_channelmix_process_ramp : mix->process_mix;
 }
 
 static void impl_channelmix_free(struct channelmix *mix)
@@ -418,7 +499,8 @@ int channelmix_init(struct channelmix *mix)
 		return -ENOTSUP;
 
 	mix->free = impl_channelmix_free;
-	mix->process = info->process;
+	mix->process = mix->process_mix = info->process;
+	mix->ramp_len = mix->ramp_pos = 0;
 	mix->set_volume = impl_channelmix_set_volume;
 	mix->cpu_flags = info->cpu_flags;
 	return make_matrix(mix);
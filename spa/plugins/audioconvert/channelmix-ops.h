@@ -55,13 +55,22 @@ struct channelmix {
 	unsigned int equal:1;	/* all values are equal */
 	float matrix_orig[SPA_AUDIO_MAX_CHANNELS][SPA_AUDIO_MAX_CHANNELS];
 	float matrix[SPA_AUDIO_MAX_CHANNELS][SPA_AUDIO_MAX_CHANNELS];
+	float matrix_ramp[SPA_AUDIO_MAX_CHANNELS][SPA_AUDIO_MAX_CHANNELS];	/* matrix at ramp start */
+	uint32_t ramp_len;		/* length of the volume ramp in samples */
+	uint32_t ramp_pos;		/* position in the volume ramp */
 
 	void (*process) (struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
 			uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples);
 	void (*set_volume) (struct channelmix *mix, float volume, bool mute,
-			uint32_t n_channel_volumes, float *channel_volumes);
+			uint32_t n_channel_volumes, float *channel_volumes,
+			uint32_t ramp_samples);
 	void (*free) (struct channelmix *mix);
 
+	/* the mixing function of the layout, process points to a ramping
+	 * function while a volume ramp is active */
+	void (*process_mix) (struct channelmix *mix, uint32_t n_dst, void * SPA_RESTRICT dst[n_dst],
+			uint32_t n_src, const void * SPA_RESTRICT src[n_src], uint32_t n_samples);
+
 	void *data;
 };
 
@@ -70,6 +79,7 @@ int channelmix_init(struct channelmix *mix);
 #define channelmix_process(mix,...)	(mix)->process(mix, __VA_ARGS__)
 #define channelmix_set_volume(mix,...)	(mix)->set_volume(mix, __VA_ARGS__)
 #define channelmix_free(mix)		(mix)->free(mix)
+#define channelmix_is_ramping(mix)	((mix)->ramp_pos < (mix)->ramp_len)
 
 #define DEFINE_FUNCTION(name,arch)					\
 void channelmix_##name##_##arch(struct channelmix *mix,			\
@@ -79,6 +89,7 @@ void channelmix_##name##_##arch(struct channelmix *mix,			\
 
 DEFINE_FUNCTION(copy, c);
 DEFINE_FUNCTION(f32_n_m, c);
+DEFINE_FUNCTION(f32_n_m_ramp, c);
 DEFINE_FUNCTION(f32_1_2, c);
 DEFINE_FUNCTION(f32_2_1, c);
 DEFINE_FUNCTION(f32_4_1, c);
@@ -100,4 +111,16 @@ DEFINE_FUNCTION(f32_5p1_2, sse);
 DEFINE_FUNCTION(f32_5p1_3p1, sse);
 DEFINE_FUNCTION(f32_5p1_4, sse);
 DEFINE_FUNCTION(f32_7p1_4, sse);
+DEFINE_FUNCTION(f32_n_m, sse);
+#endif
+#if defined (HAVE_AVX) && defined (HAVE_FMA)
+DEFINE_FUNCTION(f32_n_m, avx);
+#endif
+#if defined (HAVE_NEON)
+DEFINE_FUNCTION(copy, neon);
+DEFINE_FUNCTION(f32_2_4, neon);
+DEFINE_FUNCTION(f32_5p1_2, neon);
+DEFINE_FUNCTION(f32_5p1_3p1, neon);
+DEFINE_FUNCTION(f32_5p1_4, neon);
+DEFINE_FUNCTION(f32_n_m, neon);
 #endif
@@ -54,12 +54,14 @@ struct impl;
 
 #define DEFAULT_MUTE	false
 #define DEFAULT_VOLUME	1.0f
+#define DEFAULT_VOLUME_RAMP_SAMPLES	0
 
 struct props {
 	float volume;
 	bool mute;
 	uint32_t n_channel_volumes;
 	float channel_volumes[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t volume_ramp_samples;
 };
 
 static void props_reset(struct props *props)
@@ -70,6 +72,7 @@ static void props_reset(struct props *props)
 	props->n_channel_volumes = 0;
 	for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++)
 		props->channel_volumes[i] = 1.0;
+	props->volume_ramp_samples = DEFAULT_VOLUME_RAMP_SAMPLES;
 }
 
 struct buffer {
@@ -241,7 +244,7 @@ static int setup_convert(struct impl *this,
 	this->props.n_channel_volumes = SPA_MAX(src_chan, dst_chan);
 
 	channelmix_set_volume(&this->mix, this->props.volume, this->props.mute,
-			this->props.n_channel_volumes, this->props.channel_volumes);
+			this->props.n_channel_volumes, this->props.channel_volumes, 0);
 
 	emit_params_changed(this);
 
@@ -302,6 +305,14 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_PROP_INFO_name, SPA_POD_String("Channel Volumes"),
 				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Float(p->volume, 0.0, 10.0));
 			break;
+		case 3:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_id,   SPA_POD_Id(SPA_PROP_volumeRampSamples),
+				SPA_PROP_INFO_name, SPA_POD_String("Volume Ramp Samples"),
+				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(p->volume_ramp_samples,
+					0, INT32_MAX));
+			break;
 		default:
 			return 0;
 		}
@@ -320,7 +331,8 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_PROP_channelVolumes,	SPA_POD_Array(sizeof(float),
 									SPA_TYPE_Float,
 									p->n_channel_volumes,
-									p->channel_volumes));
+									p->channel_volumes),
+				SPA_PROP_volumeRampSamples,	SPA_POD_Int(p->volume_ramp_samples));
 			break;
 		default:
 			return 0;
@@ -347,31 +359,44 @@ static int apply_props(struct impl *this, const struct spa_pod *param)
 	struct spa_pod_prop *prop;
 	struct spa_pod_object *obj = (struct spa_pod_object *) param;
 	struct props *p = &this->props;
-	int changed = 0;
+	int changed = 0, vol_changed = 0;
 
 	SPA_POD_OBJECT_FOREACH(obj, prop) {
 		switch (prop->key) {
 		case SPA_PROP_volume:
 			if (spa_pod_get_float(&prop->value, &p->volume) == 0)
-				changed++;
+				vol_changed++;
 			break;
 		case SPA_PROP_mute:
 			if (spa_pod_get_bool(&prop->value, &p->mute) == 0)
-				changed++;
+				vol_changed++;
 			break;
 		case SPA_PROP_channelVolumes:
 			if (spa_pod_copy_array(&prop->value, SPA_TYPE_Float,
 					p->channel_volumes, SPA_AUDIO_MAX_CHANNELS) > 0)
+				vol_changed++;
+			break;
+		case SPA_PROP_volumeRampSamples:
+		{
+			int32_t samples;
+			if (spa_pod_get_int(&prop->value, &samples) == 0) {
+				p->volume_ramp_samples = SPA_MAX(samples, 0);
 				changed++;
+			}
 			break;
+		}
 		default:
 			break;
 		}
 	}
-	if (changed && this->mix.set_volume) {
+	/* volume changes are ramped over the ramp length that is
+	 * configured after applying all properties */
+	if (vol_changed && this->mix.set_volume) {
 		channelmix_set_volume(&this->mix, p->volume, p->mute,
-				p->n_channel_volumes, p->channel_volumes);
+				p->n_channel_volumes, p->channel_volumes,
+				p->volume_ramp_samples);
 	}
+	changed += vol_changed;
 	return changed;
 }
 
@@ -887,9 +912,14 @@ static int impl_node_process(void *object)
 		uint32_t n_dst_datas = db->n_datas;
 		const void *src_datas[n_src_datas];
 		void *dst_datas[n_dst_datas];
-		bool is_passthrough;
+		bool is_passthrough, is_empty;
 
-		is_passthrough = this->is_passthrough && this->mix.identity;
+		is_passthrough = this->is_passthrough && this->mix.identity &&
+			!channelmix_is_ramping(&this->mix);
+		/* silent input or an all zero matrix give silence */
+		is_empty = !channelmix_is_ramping(&this->mix) &&
+			(this->mix.zero ||
+			 SPA_FLAG_IS_SET(sb->datas[0].chunk->flags, SPA_CHUNK_FLAG_EMPTY));
 
 		n_samples = sb->datas[0].chunk->size / inport->stride;
 
@@ -899,11 +929,18 @@ static int impl_node_process(void *object)
 			dst_datas[i] = is_passthrough ? (void*)src_datas[i] : dbuf->datas[i];
 			db->datas[i].data = dst_datas[i];
 			db->datas[i].chunk->size = n_samples * outport->stride;
+			db->datas[i].chunk->flags = is_empty ? SPA_CHUNK_FLAG_EMPTY : 0;
 		}
 
-		if (!is_passthrough)
+		if (is_passthrough) {
+			/* nothing to do */
+		} else if (is_empty) {
+			for (i = 0; i < n_dst_datas; i++)
+				memset(dst_datas[i], 0, n_samples * outport->stride);
+		} else {
 			channelmix_process(&this->mix, n_dst_datas, dst_datas,
 				    n_src_datas, src_datas, n_samples);
+		}
 	}
 
 	outio->status = SPA_STATUS_HAVE_DATA;
@@ -0,0 +1,841 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fmt-ops.h"
+
+#include <immintrin.h>
+
+/* transpose the 4x4 matrices in the low and high lanes */
+static inline void transpose_4x4_lanes_avx2(__m256 r[4])
+{
+	__m256 t[4];
+
+	t[0] = _mm256_unpacklo_ps(r[0], r[1]);
+	t[1] = _mm256_unpackhi_ps(r[0], r[1]);
+	t[2] = _mm256_unpacklo_ps(r[2], r[3]);
+	t[3] = _mm256_unpackhi_ps(r[2], r[3]);
+
+	r[0] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(1, 0, 1, 0));
+	r[1] = _mm256_shuffle_ps(t[0], t[2], _MM_SHUFFLE(3, 2, 3, 2));
+	r[2] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(1, 0, 1, 0));
+	r[3] = _mm256_shuffle_ps(t[1], t[3], _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+void
+conv_s16_to_f32d_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m128i in;
+	__m256 out, factor = _mm256_set1_ps(1.0f / S16_SCALE);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm_setr_epi16(
+			s[0*n_channels], s[1*n_channels],
+			s[2*n_channels], s[3*n_channels],
+			s[4*n_channels], s[5*n_channels],
+			s[6*n_channels], s[7*n_channels]);
+		out = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(in));
+		out = _mm256_mul_ps(out, factor);
+		_mm256_storeu_ps(&d0[n], out);
+		s += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+static void
+conv_s16_to_f32d_2s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0], *d1 = d[1];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256i in, t[2];
+	__m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+			_mm256_set1_epi32(n_channels));
+	__m256 out[2], factor = _mm256_set1_ps(1.0f / S16_SCALE);
+
+	for(n = 0; n < unrolled; n += 8) {
+		/* each 32 bit word holds the samples of both channels */
+		in = _mm256_i32gather_epi32((const int*)s, idx, 2);
+
+		t[0] = _mm256_slli_epi32(in, 16);
+		t[0] = _mm256_srai_epi32(t[0], 16);
+		t[1] = _mm256_srai_epi32(in, 16);
+
+		out[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[0]), factor);
+		out[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[1]), factor);
+
+		_mm256_storeu_ps(&d0[n], out[0]);
+		_mm256_storeu_ps(&d1[n], out[1]);
+		s += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		d1[n] = S16_TO_F32(s[1]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s16_to_f32d_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 1 < n_channels; i += 2)
+		conv_s16_to_f32d_2s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_s16_to_f32d_1s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+void
+conv_s16_to_f32d_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	float **d = (float **) dst;
+	float *d0 = d[0], *d1 = d[1];
+	uint32_t n, unrolled = n_samples & ~15;
+	__m256i in[2], t[4];
+	__m256 out[4], factor = _mm256_set1_ps(1.0f / S16_SCALE);
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm256_loadu_si256((__m256i*)(s + 0));
+		in[1] = _mm256_loadu_si256((__m256i*)(s + 16));
+
+		t[0] = _mm256_slli_epi32(in[0], 16);
+		t[0] = _mm256_srai_epi32(t[0], 16);
+		t[1] = _mm256_srai_epi32(in[0], 16);
+		t[2] = _mm256_slli_epi32(in[1], 16);
+		t[2] = _mm256_srai_epi32(t[2], 16);
+		t[3] = _mm256_srai_epi32(in[1], 16);
+
+		out[0] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[0]), factor);
+		out[1] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[1]), factor);
+		out[2] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[2]), factor);
+		out[3] = _mm256_mul_ps(_mm256_cvtepi32_ps(t[3]), factor);
+
+		_mm256_storeu_ps(&d0[n + 0], out[0]);
+		_mm256_storeu_ps(&d1[n + 0], out[1]);
+		_mm256_storeu_ps(&d0[n + 8], out[2]);
+		_mm256_storeu_ps(&d1[n + 8], out[3]);
+
+		s += 32;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		d1[n] = S16_TO_F32(s[1]);
+		s += 2;
+	}
+}
+
+static void
+conv_s24_to_f32d_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint8_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256i in;
+	__m256 out, factor = _mm256_set1_ps(1.0f / S24_SCALE);
+
+	/* the loads read one byte past the sample, leave the last
+	 * sample for the scalar loop */
+	if (unrolled > 0 && unrolled == n_samples)
+		unrolled -= 8;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm256_setr_epi32(
+			*((uint32_t*)&s[0 * n_channels]),
+			*((uint32_t*)&s[3 * n_channels]),
+			*((uint32_t*)&s[6 * n_channels]),
+			*((uint32_t*)&s[9 * n_channels]),
+			*((uint32_t*)&s[12 * n_channels]),
+			*((uint32_t*)&s[15 * n_channels]),
+			*((uint32_t*)&s[18 * n_channels]),
+			*((uint32_t*)&s[21 * n_channels]));
+		in = _mm256_slli_epi32(in, 8);
+		in = _mm256_srai_epi32(in, 8);
+		out = _mm256_cvtepi32_ps(in);
+		out = _mm256_mul_ps(out, factor);
+		_mm256_storeu_ps(&d0[n], out);
+		s += 24 * n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S24_TO_F32(read_s24(s));
+		s += 3 * n_channels;
+	}
+}
+
+void
+conv_s24_to_f32d_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int8_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_s24_to_f32d_1s_avx2(conv, &dst[i], &s[3*i], n_channels, n_samples);
+}
+
+static void
+conv_s32_to_f32d_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int32_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256i in;
+	__m256 out, factor = _mm256_set1_ps(1.0f / S24_SCALE);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm256_setr_epi32(
+			s[0*n_channels], s[1*n_channels],
+			s[2*n_channels], s[3*n_channels],
+			s[4*n_channels], s[5*n_channels],
+			s[6*n_channels], s[7*n_channels]);
+		in = _mm256_srai_epi32(in, 8);
+		out = _mm256_cvtepi32_ps(in);
+		out = _mm256_mul_ps(out, factor);
+		_mm256_storeu_ps(&d0[n], out);
+		s += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S32_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s32_to_f32d_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int32_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_s32_to_f32d_1s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s32_1s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	int32_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in;
+	__m256i out;
+	__m128i t[2];
+	__m256 scale = _mm256_set1_ps(S32_SCALE);
+	__m256 int_min = _mm256_set1_ps(S32_MIN);
+	__m128 in1;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), scale);
+		in = _mm256_min_ps(in, int_min);
+		out = _mm256_cvtps_epi32(in);
+		t[0] = _mm256_castsi256_si128(out);
+		t[1] = _mm256_extracti128_si256(out, 1);
+
+		d[0*n_channels] = _mm_cvtsi128_si32(t[0]);
+		d[1*n_channels] = _mm_extract_epi32(t[0], 1);
+		d[2*n_channels] = _mm_extract_epi32(t[0], 2);
+		d[3*n_channels] = _mm_extract_epi32(t[0], 3);
+		d[4*n_channels] = _mm_cvtsi128_si32(t[1]);
+		d[5*n_channels] = _mm_extract_epi32(t[1], 1);
+		d[6*n_channels] = _mm_extract_epi32(t[1], 2);
+		d[7*n_channels] = _mm_extract_epi32(t[1], 3);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1 = _mm_mul_ss(_mm_load_ss(&s0[n]), _mm256_castps256_ps128(scale));
+		in1 = _mm_min_ss(in1, _mm256_castps256_ps128(int_min));
+		*d = _mm_cvtss_si32(in1);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s32_2s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0], *s1 = s[1];
+	int32_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[2];
+	__m256i out[2], t[2];
+	__m128i p[4];
+	__m256 scale = _mm256_set1_ps(S32_SCALE);
+	__m256 int_min = _mm256_set1_ps(S32_MIN);
+	__m128 in1[2];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), scale);
+		in[1] = _mm256_mul_ps(_mm256_loadu_ps(&s1[n]), scale);
+
+		in[0] = _mm256_min_ps(in[0], int_min);
+		in[1] = _mm256_min_ps(in[1], int_min);
+
+		out[0] = _mm256_cvtps_epi32(in[0]);
+		out[1] = _mm256_cvtps_epi32(in[1]);
+
+		/* samples 0 1 | 4 5 and 2 3 | 6 7 */
+		t[0] = _mm256_unpacklo_epi32(out[0], out[1]);
+		t[1] = _mm256_unpackhi_epi32(out[0], out[1]);
+
+		p[0] = _mm256_castsi256_si128(t[0]);
+		p[1] = _mm256_castsi256_si128(t[1]);
+		p[2] = _mm256_extracti128_si256(t[0], 1);
+		p[3] = _mm256_extracti128_si256(t[1], 1);
+
+		_mm_storel_pd((double*)(d + 0*n_channels), (__m128d)p[0]);
+		_mm_storeh_pd((double*)(d + 1*n_channels), (__m128d)p[0]);
+		_mm_storel_pd((double*)(d + 2*n_channels), (__m128d)p[1]);
+		_mm_storeh_pd((double*)(d + 3*n_channels), (__m128d)p[1]);
+		_mm_storel_pd((double*)(d + 4*n_channels), (__m128d)p[2]);
+		_mm_storeh_pd((double*)(d + 5*n_channels), (__m128d)p[2]);
+		_mm_storel_pd((double*)(d + 6*n_channels), (__m128d)p[3]);
+		_mm_storeh_pd((double*)(d + 7*n_channels), (__m128d)p[3]);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1[0] = _mm_load_ss(&s0[n]);
+		in1[1] = _mm_load_ss(&s1[n]);
+
+		in1[0] = _mm_unpacklo_ps(in1[0], in1[1]);
+
+		in1[0] = _mm_mul_ps(in1[0], _mm256_castps256_ps128(scale));
+		in1[0] = _mm_min_ps(in1[0], _mm256_castps256_ps128(int_min));
+		_mm_storel_epi64((__m128i*)d, _mm_cvtps_epi32(in1[0]));
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s32_4s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0], *s1 = s[1], *s2 = s[2], *s3 = s[3];
+	int32_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[4];
+	__m256i out[4];
+	__m256 scale = _mm256_set1_ps(S32_SCALE);
+	__m256 int_min = _mm256_set1_ps(S32_MIN);
+	__m128 in1[4];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), scale);
+		in[1] = _mm256_mul_ps(_mm256_loadu_ps(&s1[n]), scale);
+		in[2] = _mm256_mul_ps(_mm256_loadu_ps(&s2[n]), scale);
+		in[3] = _mm256_mul_ps(_mm256_loadu_ps(&s3[n]), scale);
+
+		in[0] = _mm256_min_ps(in[0], int_min);
+		in[1] = _mm256_min_ps(in[1], int_min);
+		in[2] = _mm256_min_ps(in[2], int_min);
+		in[3] = _mm256_min_ps(in[3], int_min);
+
+		transpose_4x4_lanes_avx2(in);
+
+		out[0] = _mm256_cvtps_epi32(in[0]);
+		out[1] = _mm256_cvtps_epi32(in[1]);
+		out[2] = _mm256_cvtps_epi32(in[2]);
+		out[3] = _mm256_cvtps_epi32(in[3]);
+
+		_mm_storeu_si128((__m128i*)(d + 0*n_channels), _mm256_castsi256_si128(out[0]));
+		_mm_storeu_si128((__m128i*)(d + 1*n_channels), _mm256_castsi256_si128(out[1]));
+		_mm_storeu_si128((__m128i*)(d + 2*n_channels), _mm256_castsi256_si128(out[2]));
+		_mm_storeu_si128((__m128i*)(d + 3*n_channels), _mm256_castsi256_si128(out[3]));
+		_mm_storeu_si128((__m128i*)(d + 4*n_channels), _mm256_extracti128_si256(out[0], 1));
+		_mm_storeu_si128((__m128i*)(d + 5*n_channels), _mm256_extracti128_si256(out[1], 1));
+		_mm_storeu_si128((__m128i*)(d + 6*n_channels), _mm256_extracti128_si256(out[2], 1));
+		_mm_storeu_si128((__m128i*)(d + 7*n_channels), _mm256_extracti128_si256(out[3], 1));
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1[0] = _mm_load_ss(&s0[n]);
+		in1[1] = _mm_load_ss(&s1[n]);
+		in1[2] = _mm_load_ss(&s2[n]);
+		in1[3] = _mm_load_ss(&s3[n]);
+
+		in1[0] = _mm_unpacklo_ps(in1[0], in1[2]);
+		in1[1] = _mm_unpacklo_ps(in1[1], in1[3]);
+		in1[0] = _mm_unpacklo_ps(in1[0], in1[1]);
+
+		in1[0] = _mm_mul_ps(in1[0], _mm256_castps256_ps128(scale));
+		in1[0] = _mm_min_ps(in1[0], _mm256_castps256_ps128(int_min));
+		_mm_storeu_si128((__m128i*)d, _mm_cvtps_epi32(in1[0]));
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s32_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int32_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s32_4s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i + 1 < n_channels; i += 2)
+		conv_f32d_to_s32_2s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s32_1s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s24_1s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	uint8_t *d = dst;
+	uint32_t n, i, unrolled = n_samples & ~7;
+	__m256 in;
+	int32_t out[8] __attribute__ ((aligned (32)));
+	__m256 int_max = _mm256_set1_ps(S24_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), int_max);
+		in = _mm256_min_ps(int_max, _mm256_max_ps(in, int_min));
+		_mm256_store_si256((__m256i*)out, _mm256_cvttps_epi32(in));
+
+		for (i = 0; i < 8; i++) {
+			write_s24(d, out[i]);
+			d += 3 * n_channels;
+		}
+	}
+	for(; n < n_samples; n++) {
+		write_s24(d, F32_TO_S24(s0[n]));
+		d += 3 * n_channels;
+	}
+}
+
+void
+conv_f32d_to_s24_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int8_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_s24_1s_avx2(conv, &d[3*i], &src[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s16_1s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	int16_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in;
+	__m256i t;
+	__m128i out;
+	__m256 int_max = _mm256_set1_ps(S16_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+	__m128 in1, int_max1 = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min1 = _mm_sub_ps(_mm_setzero_ps(), int_max1);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), int_max);
+		in = _mm256_min_ps(int_max, _mm256_max_ps(in, int_min));
+		t = _mm256_cvtps_epi32(in);
+		out = _mm_packs_epi32(_mm256_castsi256_si128(t),
+				_mm256_extracti128_si256(t, 1));
+
+		d[0*n_channels] = _mm_extract_epi16(out, 0);
+		d[1*n_channels] = _mm_extract_epi16(out, 1);
+		d[2*n_channels] = _mm_extract_epi16(out, 2);
+		d[3*n_channels] = _mm_extract_epi16(out, 3);
+		d[4*n_channels] = _mm_extract_epi16(out, 4);
+		d[5*n_channels] = _mm_extract_epi16(out, 5);
+		d[6*n_channels] = _mm_extract_epi16(out, 6);
+		d[7*n_channels] = _mm_extract_epi16(out, 7);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1 = _mm_mul_ss(_mm_load_ss(&s0[n]), int_max1);
+		in1 = _mm_min_ss(int_max1, _mm_max_ss(in1, int_min1));
+		*d = _mm_cvtss_si32(in1);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s16_2s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0], *s1 = s[1];
+	int16_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[2];
+	__m256i t[2];
+	__m128i p[2], out[2];
+	__m256 int_max = _mm256_set1_ps(S16_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+	__m128 in1[2], int_max1 = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min1 = _mm_sub_ps(_mm_setzero_ps(), int_max1);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), int_max);
+		in[1] = _mm256_mul_ps(_mm256_loadu_ps(&s1[n]), int_max);
+
+		in[0] = _mm256_min_ps(int_max, _mm256_max_ps(in[0], int_min));
+		in[1] = _mm256_min_ps(int_max, _mm256_max_ps(in[1], int_min));
+
+		t[0] = _mm256_cvtps_epi32(in[0]);
+		t[1] = _mm256_cvtps_epi32(in[1]);
+
+		p[0] = _mm_packs_epi32(_mm256_castsi256_si128(t[0]),
+				_mm256_extracti128_si256(t[0], 1));
+		p[1] = _mm_packs_epi32(_mm256_castsi256_si128(t[1]),
+				_mm256_extracti128_si256(t[1], 1));
+
+		out[0] = _mm_unpacklo_epi16(p[0], p[1]);
+		out[1] = _mm_unpackhi_epi16(p[0], p[1]);
+
+		*((int32_t*)(d + 0*n_channels)) = _mm_cvtsi128_si32(out[0]);
+		*((int32_t*)(d + 1*n_channels)) = _mm_extract_epi32(out[0], 1);
+		*((int32_t*)(d + 2*n_channels)) = _mm_extract_epi32(out[0], 2);
+		*((int32_t*)(d + 3*n_channels)) = _mm_extract_epi32(out[0], 3);
+		*((int32_t*)(d + 4*n_channels)) = _mm_cvtsi128_si32(out[1]);
+		*((int32_t*)(d + 5*n_channels)) = _mm_extract_epi32(out[1], 1);
+		*((int32_t*)(d + 6*n_channels)) = _mm_extract_epi32(out[1], 2);
+		*((int32_t*)(d + 7*n_channels)) = _mm_extract_epi32(out[1], 3);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1[0] = _mm_mul_ss(_mm_load_ss(&s0[n]), int_max1);
+		in1[1] = _mm_mul_ss(_mm_load_ss(&s1[n]), int_max1);
+		in1[0] = _mm_min_ss(int_max1, _mm_max_ss(in1[0], int_min1));
+		in1[1] = _mm_min_ss(int_max1, _mm_max_ss(in1[1], int_min1));
+		d[0] = _mm_cvtss_si32(in1[0]);
+		d[1] = _mm_cvtss_si32(in1[1]);
+		d += n_channels;
+	}
+}
+
+static void
+conv_f32d_to_s16_4s_avx2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0], *s1 = s[1], *s2 = s[2], *s3 = s[3];
+	int16_t *d = dst;
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[4];
+	__m256i t[4];
+	__m128i p[4], q[4], out[4];
+	__m256 int_max = _mm256_set1_ps(S16_MAX_F);
+	__m256 int_min = _mm256_sub_ps(_mm256_setzero_ps(), int_max);
+	__m128 in1[4], int_max1 = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min1 = _mm_sub_ps(_mm_setzero_ps(), int_max1);
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_mul_ps(_mm256_loadu_ps(&s0[n]), int_max);
+		in[1] = _mm256_mul_ps(_mm256_loadu_ps(&s1[n]), int_max);
+		in[2] = _mm256_mul_ps(_mm256_loadu_ps(&s2[n]), int_max);
+		in[3] = _mm256_mul_ps(_mm256_loadu_ps(&s3[n]), int_max);
+
+		in[0] = _mm256_min_ps(int_max, _mm256_max_ps(in[0], int_min));
+		in[1] = _mm256_min_ps(int_max, _mm256_max_ps(in[1], int_min));
+		in[2] = _mm256_min_ps(int_max, _mm256_max_ps(in[2], int_min));
+		in[3] = _mm256_min_ps(int_max, _mm256_max_ps(in[3], int_min));
+
+		t[0] = _mm256_cvtps_epi32(in[0]);
+		t[1] = _mm256_cvtps_epi32(in[1]);
+		t[2] = _mm256_cvtps_epi32(in[2]);
+		t[3] = _mm256_cvtps_epi32(in[3]);
+
+		p[0] = _mm_packs_epi32(_mm256_castsi256_si128(t[0]),
+				_mm256_extracti128_si256(t[0], 1));
+		p[1] = _mm_packs_epi32(_mm256_castsi256_si128(t[1]),
+				_mm256_extracti128_si256(t[1], 1));
+		p[2] = _mm_packs_epi32(_mm256_castsi256_si128(t[2]),
+				_mm256_extracti128_si256(t[2], 1));
+		p[3] = _mm_packs_epi32(_mm256_castsi256_si128(t[3]),
+				_mm256_extracti128_si256(t[3], 1));
+
+		q[0] = _mm_unpacklo_epi16(p[0], p[1]);
+		q[1] = _mm_unpackhi_epi16(p[0], p[1]);
+		q[2] = _mm_unpacklo_epi16(p[2], p[3]);
+		q[3] = _mm_unpackhi_epi16(p[2], p[3]);
+
+		out[0] = _mm_unpacklo_epi32(q[0], q[2]);
+		out[1] = _mm_unpackhi_epi32(q[0], q[2]);
+		out[2] = _mm_unpacklo_epi32(q[1], q[3]);
+		out[3] = _mm_unpackhi_epi32(q[1], q[3]);
+
+		_mm_storel_pi((__m64*)(d + 0*n_channels), (__m128)out[0]);
+		_mm_storeh_pi((__m64*)(d + 1*n_channels), (__m128)out[0]);
+		_mm_storel_pi((__m64*)(d + 2*n_channels), (__m128)out[1]);
+		_mm_storeh_pi((__m64*)(d + 3*n_channels), (__m128)out[1]);
+		_mm_storel_pi((__m64*)(d + 4*n_channels), (__m128)out[2]);
+		_mm_storeh_pi((__m64*)(d + 5*n_channels), (__m128)out[2]);
+		_mm_storel_pi((__m64*)(d + 6*n_channels), (__m128)out[3]);
+		_mm_storeh_pi((__m64*)(d + 7*n_channels), (__m128)out[3]);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in1[0] = _mm_mul_ss(_mm_load_ss(&s0[n]), int_max1);
+		in1[1] = _mm_mul_ss(_mm_load_ss(&s1[n]), int_max1);
+		in1[2] = _mm_mul_ss(_mm_load_ss(&s2[n]), int_max1);
+		in1[3] = _mm_mul_ss(_mm_load_ss(&s3[n]), int_max1);
+		in1[0] = _mm_min_ss(int_max1, _mm_max_ss(in1[0], int_min1));
+		in1[1] = _mm_min_ss(int_max1, _mm_max_ss(in1[1], int_min1));
+		in1[2] = _mm_min_ss(int_max1, _mm_max_ss(in1[2], int_min1));
+		in1[3] = _mm_min_ss(int_max1, _mm_max_ss(in1[3], int_min1));
+		d[0] = _mm_cvtss_si32(in1[0]);
+		d[1] = _mm_cvtss_si32(in1[1]);
+		d[2] = _mm_cvtss_si32(in1[2]);
+		d[3] = _mm_cvtss_si32(in1[3]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 3 < n_channels; i += 4)
+		conv_f32d_to_s16_4s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i + 1 < n_channels; i += 2)
+		conv_f32d_to_s16_2s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+	for(; i < n_channels; i++)
+		conv_f32d_to_s16_1s_avx2(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+void
+conv_interleave_32_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float *d = dst[0];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[2], t[2];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_loadu_ps(&s0[n]);
+		in[1] = _mm256_loadu_ps(&s1[n]);
+
+		/* frames 0 1 | 4 5 and 2 3 | 6 7 */
+		t[0] = _mm256_unpacklo_ps(in[0], in[1]);
+		t[1] = _mm256_unpackhi_ps(in[0], in[1]);
+
+		_mm256_storeu_ps(&d[0], _mm256_permute2f128_ps(t[0], t[1], 0x20));
+		_mm256_storeu_ps(&d[8], _mm256_permute2f128_ps(t[0], t[1], 0x31));
+		d += 16;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = s0[n];
+		d[1] = s1[n];
+		d += 2;
+	}
+}
+
+void
+conv_interleave_32_4_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1], *s2 = src[2], *s3 = src[3];
+	float *d = dst[0];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[4];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_loadu_ps(&s0[n]);
+		in[1] = _mm256_loadu_ps(&s1[n]);
+		in[2] = _mm256_loadu_ps(&s2[n]);
+		in[3] = _mm256_loadu_ps(&s3[n]);
+
+		/* frames 0 | 4, 1 | 5, 2 | 6 and 3 | 7 */
+		transpose_4x4_lanes_avx2(in);
+
+		_mm256_storeu_ps(&d[0], _mm256_permute2f128_ps(in[0], in[1], 0x20));
+		_mm256_storeu_ps(&d[8], _mm256_permute2f128_ps(in[2], in[3], 0x20));
+		_mm256_storeu_ps(&d[16], _mm256_permute2f128_ps(in[0], in[1], 0x31));
+		_mm256_storeu_ps(&d[24], _mm256_permute2f128_ps(in[2], in[3], 0x31));
+		d += 32;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = s0[n];
+		d[1] = s1[n];
+		d[2] = s2[n];
+		d[3] = s3[n];
+		d += 4;
+	}
+}
+
+void
+conv_interleave_32_8_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	float *d = dst[0];
+	uint32_t n, i, unrolled = n_samples & ~7;
+	__m256 a[4], b[4];
+
+	for(n = 0; n < unrolled; n += 8) {
+		for (i = 0; i < 4; i++) {
+			a[i] = _mm256_loadu_ps(&s[i][n]);
+			b[i] = _mm256_loadu_ps(&s[i + 4][n]);
+		}
+		/* channels 0-3 and 4-7 of frames i | i + 4 */
+		transpose_4x4_lanes_avx2(a);
+		transpose_4x4_lanes_avx2(b);
+
+		for (i = 0; i < 4; i++) {
+			_mm256_storeu_ps(&d[8 * i], _mm256_permute2f128_ps(a[i], b[i], 0x20));
+			_mm256_storeu_ps(&d[8 * (i + 4)], _mm256_permute2f128_ps(a[i], b[i], 0x31));
+		}
+		d += 64;
+	}
+	for(; n < n_samples; n++) {
+		for (i = 0; i < 8; i++)
+			d[i] = s[i][n];
+		d += 8;
+	}
+}
+
+void
+conv_deinterleave_32_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[2], t[2];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_loadu_ps(&s[0]);
+		in[1] = _mm256_loadu_ps(&s[8]);
+
+		/* frames 0 1 | 4 5 and 2 3 | 6 7 */
+		t[0] = _mm256_permute2f128_ps(in[0], in[1], 0x20);
+		t[1] = _mm256_permute2f128_ps(in[0], in[1], 0x31);
+
+		_mm256_storeu_ps(&d0[n], _mm256_shuffle_ps(t[0], t[1], _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm256_storeu_ps(&d1[n], _mm256_shuffle_ps(t[0], t[1], _MM_SHUFFLE(3, 1, 3, 1)));
+		s += 16;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = s[0];
+		d1[n] = s[1];
+		s += 2;
+	}
+}
+
+void
+conv_deinterleave_32_4_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s = src[0];
+	float *d0 = dst[0], *d1 = dst[1], *d2 = dst[2], *d3 = dst[3];
+	uint32_t n, unrolled = n_samples & ~7;
+	__m256 in[4], t[4];
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm256_loadu_ps(&s[0]);
+		in[1] = _mm256_loadu_ps(&s[8]);
+		in[2] = _mm256_loadu_ps(&s[16]);
+		in[3] = _mm256_loadu_ps(&s[24]);
+
+		/* frames 0 | 4, 1 | 5, 2 | 6 and 3 | 7 */
+		t[0] = _mm256_permute2f128_ps(in[0], in[2], 0x20);
+		t[1] = _mm256_permute2f128_ps(in[0], in[2], 0x31);
+		t[2] = _mm256_permute2f128_ps(in[1], in[3], 0x20);
+		t[3] = _mm256_permute2f128_ps(in[1], in[3], 0x31);
+
+		transpose_4x4_lanes_avx2(t);
+
+		_mm256_storeu_ps(&d0[n], t[0]);
+		_mm256_storeu_ps(&d1[n], t[1]);
+		_mm256_storeu_ps(&d2[n], t[2]);
+		_mm256_storeu_ps(&d3[n], t[3]);
+		s += 32;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = s[0];
+		d1[n] = s[1];
+		d2[n] = s[2];
+		d3[n] = s[3];
+		s += 4;
+	}
+}
+
+void
+conv_deinterleave_32_8_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s = src[0];
+	float **d = (float **) dst;
+	uint32_t n, i, unrolled = n_samples & ~7;
+	__m256 in[2], a[4], b[4];
+
+	for(n = 0; n < unrolled; n += 8) {
+		/* channels 0-3 and 4-7 of frames i | i + 4 */
+		for (i = 0; i < 4; i++) {
+			in[0] = _mm256_loadu_ps(&s[8 * i]);
+			in[1] = _mm256_loadu_ps(&s[8 * (i + 4)]);
+			a[i] = _mm256_permute2f128_ps(in[0], in[1], 0x20);
+			b[i] = _mm256_permute2f128_ps(in[0], in[1], 0x31);
+		}
+		transpose_4x4_lanes_avx2(a);
+		transpose_4x4_lanes_avx2(b);
+
+		for (i = 0; i < 4; i++) {
+			_mm256_storeu_ps(&d[i][n], a[i]);
+			_mm256_storeu_ps(&d[i + 4][n], b[i]);
+		}
+		s += 64;
+	}
+	for(; n < n_samples; n++) {
+		for (i = 0; i < 8; i++)
+			d[i][n] = s[i];
+		s += 8;
+	}
+}
@@ -0,0 +1,288 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fmt-ops.h"
+
+#include <immintrin.h>
+
+static inline __m512i sample_index_avx512(uint32_t stride)
+{
+	return _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+				8, 9, 10, 11, 12, 13, 14, 15),
+			_mm512_set1_epi32(stride));
+}
+
+static void
+conv_s16_to_f32d_1s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled = n_samples & ~15;
+	__m128i in[2];
+	__m512 out, factor = _mm512_set1_ps(1.0f / S16_SCALE);
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm_setr_epi16(
+			s[0*n_channels], s[1*n_channels],
+			s[2*n_channels], s[3*n_channels],
+			s[4*n_channels], s[5*n_channels],
+			s[6*n_channels], s[7*n_channels]);
+		in[1] = _mm_setr_epi16(
+			s[8*n_channels], s[9*n_channels],
+			s[10*n_channels], s[11*n_channels],
+			s[12*n_channels], s[13*n_channels],
+			s[14*n_channels], s[15*n_channels]);
+		out = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(
+					_mm256_set_m128i(in[1], in[0])));
+		out = _mm512_mul_ps(out, factor);
+		_mm512_storeu_ps(&d0[n], out);
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+static void
+conv_s16_to_f32d_2s_avx512(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const int16_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0], *d1 = d[1];
+	uint32_t n, unrolled = n_samples & ~15;
+	__m512i in, t[2], idx = sample_index_avx512(n_channels);
+	__m512 out[2], factor = _mm512_set1_ps(1.0f / S16_SCALE);
+
+	for(n = 0; n < unrolled; n += 16) {
+		/* each 32 bit word holds the samples of both channels */
+		in = _mm512_i32gather_epi32(idx, s, 2);
+
+		t[0] = _mm512_srai_epi32(_mm512_slli_epi32(in, 16), 16);
+		t[1] = _mm512_srai_epi32(in, 16);
+
+		out[0] = _mm512_mul_ps(_mm512_cvtepi32_ps(t[0]), factor);
+		out[1] = _mm512_mul_ps(_mm512_cvtepi32_ps(t[1]), factor);
+
+		_mm512_storeu_ps(&d0[n], out[0]);
+		_mm512_storeu_ps(&d1[n], out[1]);
+		s += 16*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16_TO_F32(s[0]);
+		d1[n] = S16_TO_F32(s[1]);
+		s += n_channels;
+	}
+}
+
+extern void conv_s16_to_f32d_1s_avx2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples);
+
+void
+conv_s16_to_f32d_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const int16_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i + 1 < n_channels; i += 2)
+		conv_s16_to_f32d_2s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+#if defined (HAVE_AVX2)
+	for(; i < n_channels; i++)
+		conv_s16_to_f32d_1s_avx2(conv, &dst[i], &s[i], n_channels, n_samples);
+#endif
+	for(; i < n_channels; i++)
+		conv_s16_to_f32d_1s_avx512(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s24_1s_avx512(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	uint8_t *d = dst;
+	uint32_t n, i, unrolled = n_samples & ~15;
+	__m512 in;
+	int32_t out[16] __attribute__ ((aligned (64)));
+	__m512 int_max = _mm512_set1_ps(S24_MAX_F);
+	__m512 int_min = _mm512_sub_ps(_mm512_setzero_ps(), int_max);
+
+	for(n = 0; n < unrolled; n += 16) {
+		in = _mm512_mul_ps(_mm512_loadu_ps(&s0[n]), int_max);
+		in = _mm512_min_ps(int_max, _mm512_max_ps(in, int_min));
+		_mm512_store_si512((__m512i*)out, _mm512_cvttps_epi32(in));
+
+		for (i = 0; i < 16; i++) {
+			write_s24(d, out[i]);
+			d += 3 * n_channels;
+		}
+	}
+	for(; n < n_samples; n++) {
+		write_s24(d, F32_TO_S24(s0[n]));
+		d += 3 * n_channels;
+	}
+}
+
+void
+conv_f32d_to_s24_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int8_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_s24_1s_avx512(conv, &d[3*i], &src[i], n_channels, n_samples);
+}
+
+static inline __m512 interleave_lo_avx512(__m512 a, __m512 b)
+{
+	return _mm512_permutex2var_ps(a, _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+				4, 20, 5, 21, 6, 22, 7, 23), b);
+}
+
+static inline __m512 interleave_hi_avx512(__m512 a, __m512 b)
+{
+	return _mm512_permutex2var_ps(a, _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27,
+				12, 28, 13, 29, 14, 30, 15, 31), b);
+}
+
+static inline __m512 interleave_lo_pd_avx512(__m512 a, __m512 b)
+{
+	return _mm512_castpd_ps(_mm512_permutex2var_pd(_mm512_castps_pd(a),
+				_mm512_setr_epi64(0, 8, 1, 9, 2, 10, 3, 11), _mm512_castps_pd(b)));
+}
+
+static inline __m512 interleave_hi_pd_avx512(__m512 a, __m512 b)
+{
+	return _mm512_castpd_ps(_mm512_permutex2var_pd(_mm512_castps_pd(a),
+				_mm512_setr_epi64(4, 12, 5, 13, 6, 14, 7, 15), _mm512_castps_pd(b)));
+}
+
+/* 16 samples of 4 channels to 16 frames */
+static inline void interleave_4_avx512(__m512 r[4])
+{
+	__m512 t[4];
+
+	t[0] = interleave_lo_avx512(r[0], r[1]);
+	t[1] = interleave_hi_avx512(r[0], r[1]);
+	t[2] = interleave_lo_avx512(r[2], r[3]);
+	t[3] = interleave_hi_avx512(r[2], r[3]);
+
+	r[0] = interleave_lo_pd_avx512(t[0], t[2]);
+	r[1] = interleave_hi_pd_avx512(t[0], t[2]);
+	r[2] = interleave_lo_pd_avx512(t[1], t[3]);
+	r[3] = interleave_hi_pd_avx512(t[1], t[3]);
+}
+
+/* 16 frames of 4 channels to 16 samples per channel */
+
+void
+conv_interleave_32_2_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s0 = src[0], *s1 = src[1];
+	float *d = dst[0];
+	uint32_t n, unrolled = n_samples & ~15;
+	__m512 in[2];
+
+	for(n = 0; n < unrolled; n += 16) {
+		in[0] = _mm512_loadu_ps(&s0[n]);
+		in[1] = _mm512_loadu_ps(&s1[n]);
+
+		_mm512_storeu_ps(&d[0], interleave_lo_avx512(in[0], in[1]));
+		_mm512_storeu_ps(&d[16], interleave_hi_avx512(in[0], in[1]));
+		d += 32;
+	}
+	for(; n < n_samples; n++) {
+		d[0] = s0[n];
+		d[1] = s1[n];
+		d += 2;
+	}
+}
+
+void
+conv_interleave_32_4_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	float *d = dst[0];
+	uint32_t n, i, unrolled = n_samples & ~15;
+	__m512 in[4];
+
+	for(n = 0; n < unrolled; n += 16) {
+		for (i = 0; i < 4; i++)
+			in[i] = _mm512_loadu_ps(&s[i][n]);
+
+		interleave_4_avx512(in);
+
+		for (i = 0; i < 4; i++)
+			_mm512_storeu_ps(&d[16 * i], in[i]);
+		d += 64;
+	}
+	for(; n < n_samples; n++) {
+		for (i = 0; i < 4; i++)
+			d[i] = s[i][n];
+		d += 4;
+	}
+}
+
+void
+conv_interleave_32_8_avx512(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	float *d = dst[0];
+	uint32_t n, i, unrolled = n_samples & ~15;
+	__m512 a[4], b[4];
+	__m512i lo = _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11);
+	__m512i hi = _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15);
+
+	for(n = 0; n < unrolled; n += 16) {
+		for (i = 0; i < 4; i++) {
+			a[i] = _mm512_loadu_ps(&s[i][n]);
+			b[i] = _mm512_loadu_ps(&s[i + 4][n]);
+		}
+		/* frames 4i to 4i + 3 of channels 0-3 and 4-7 */
+		interleave_4_avx512(a);
+		interleave_4_avx512(b);
+
+		for (i = 0; i < 4; i++) {
+			_mm512_storeu_pd(&d[32 * i], _mm512_permutex2var_pd(_mm512_castps_pd(a[i]),
+						lo, _mm512_castps_pd(b[i])));
+			_mm512_storeu_pd(&d[32 * i + 16], _mm512_permutex2var_pd(_mm512_castps_pd(a[i]),
+						hi, _mm512_castps_pd(b[i])));
+		}
+		d += 128;
+	}
+	for(; n < n_samples; n++) {
+		for (i = 0; i < 8; i++)
+			d[i] = s[i][n];
+		d += 8;
+	}
+}
+
@@ -625,6 +625,134 @@ conv_f32d_to_s24_c(struct convert *conv, void * SPA_RESTRICT dst[], const void *
 	}
 }
 
+/* fill the dither buffer with noise in LSB units. n_samples is rounded up to
+ * a multiple of 4 so that the 4 generators advance in lockstep, like the
+ * SIMD versions do. */
+static void update_dither_c(struct convert *conv, uint32_t n_samples)
+{
+	uint32_t n, *r = conv->random;
+	float *dither = conv->dither;
+
+	n_samples = SPA_ROUND_UP_N(n_samples, 4);
+
+	if (conv->dither_method == DITHER_METHOD_RECTANGULAR) {
+		for (n = 0; n < n_samples; n++)
+			dither[n] = lcnoise(&r[n & 3]) * DITHER_SCALE;
+	} else {
+		for (n = 0; n < n_samples; n++) {
+			float t = lcnoise(&r[n & 3]) * DITHER_SCALE;
+			dither[n] = t + lcnoise(&r[n & 3]) * DITHER_SCALE;
+		}
+	}
+}
+
+void
+conv_f32d_to_s16_dither_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	int16_t *d = dst[0];
+	uint32_t i, j, k, chunk, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *si = s[i];
+		int16_t *di = &d[i];
+
+		for (j = 0; j < n_samples;) {
+			chunk = SPA_MIN(n_samples - j, DITHER_SIZE);
+			update_dither_c(conv, chunk);
+			for (k = 0; k < chunk; k++, j++)
+				di[j * n_channels] = F32_TO_S16_D(si[j], conv->dither[k]);
+		}
+	}
+}
+
+void
+conv_f32d_to_s24_dither_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint8_t *d = dst[0];
+	uint32_t i, j, k, chunk, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *si = s[i];
+		uint8_t *di = &d[i * 3];
+
+		for (j = 0; j < n_samples;) {
+			chunk = SPA_MIN(n_samples - j, DITHER_SIZE);
+			update_dither_c(conv, chunk);
+			for (k = 0; k < chunk; k++, j++)
+				write_s24(&di[j * n_channels * 3], F32_TO_S24_D(si[j], conv->dither[k]));
+		}
+	}
+}
+
+/* First order error feedback: the quantization error of the previous sample
+ * is subtracted from the next one, which moves the noise to the high
+ * frequencies where it is less audible. The feedback loop is sequential in
+ * time so this is only done in C. The error is kept in LSB units and bounded
+ * so that clipping can't make the loop run away. */
+#define NS_MAX_ERROR	2.0f
+
+void
+conv_f32d_to_s16_shaped_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	int16_t *d = dst[0];
+	uint32_t i, j, k, chunk, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *si = s[i];
+		int16_t *di = &d[i];
+		float t, e = i < MAX_NS ? conv->ns_data[i] : 0.0f;
+		int16_t v;
+
+		for (j = 0; j < n_samples;) {
+			chunk = SPA_MIN(n_samples - j, DITHER_SIZE);
+			update_dither_c(conv, chunk);
+			for (k = 0; k < chunk; k++, j++) {
+				t = si[j] * S16_SCALE - e;
+				v = lrintf(SPA_CLAMP(t + conv->dither[k], S16_MIN, S16_MAX));
+				e = SPA_CLAMP(v - t, -NS_MAX_ERROR, NS_MAX_ERROR);
+				di[j * n_channels] = v;
+			}
+		}
+		if (i < MAX_NS)
+			conv->ns_data[i] = e;
+	}
+}
+
+void
+conv_f32d_to_s24_shaped_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint8_t *d = dst[0];
+	uint32_t i, j, k, chunk, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *si = s[i];
+		uint8_t *di = &d[i * 3];
+		float t, e = i < MAX_NS ? conv->ns_data[i] : 0.0f;
+		int32_t v;
+
+		for (j = 0; j < n_samples;) {
+			chunk = SPA_MIN(n_samples - j, DITHER_SIZE);
+			update_dither_c(conv, chunk);
+			for (k = 0; k < chunk; k++, j++) {
+				t = si[j] * S24_SCALE - e;
+				v = lrintf(SPA_CLAMP(t + conv->dither[k], S24_MIN, S24_MAX));
+				e = SPA_CLAMP(v - t, -NS_MAX_ERROR, NS_MAX_ERROR);
+				write_s24(&di[j * n_channels * 3], v);
+			}
+		}
+		if (i < MAX_NS)
+			conv->ns_data[i] = e;
+	}
+}
+
 
 void
 conv_f32d_to_s24_32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
@@ -683,6 +811,352 @@ conv_f32d_to_s24_32_c(struct convert *conv, void * SPA_RESTRICT dst[], const voi
 	}
 }
 
+void
+conv_f64d_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const double *s = src[i];
+		float *d = dst[i];
+
+		for (j = 0; j < n_samples; j++)
+			d[j] = (float)s[j];
+	}
+}
+
+void
+conv_f64_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const double *s = src[0];
+	float *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = (float)s[i];
+}
+
+void
+conv_f64_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const double *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = (float)*s++;
+	}
+}
+
+void
+conv_f64d_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const double **s = (const double **) src;
+	float *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			*d++ = (float)s[i][j];
+	}
+}
+
+void
+conv_f32d_to_f64d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *s = src[i];
+		double *d = dst[i];
+
+		for (j = 0; j < n_samples; j++)
+			d[j] = s[j];
+	}
+}
+
+void
+conv_f32_to_f64_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const float *s = src[0];
+	double *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = s[i];
+}
+
+void
+conv_f32_to_f64d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float *s = src[0];
+	double **d = (double **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = *s++;
+	}
+}
+
+void
+conv_f32d_to_f64_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	double *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			*d++ = s[i][j];
+	}
+}
+
+void
+conv_s16s_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const uint16_t *s = src[0];
+	float *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = S16S_TO_F32(s[i]);
+}
+
+void
+conv_s16s_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint16_t *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = S16S_TO_F32(*s++);
+	}
+}
+
+void
+conv_f32_to_s16s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const float *s = src[0];
+	uint16_t *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = F32_TO_S16S(s[i]);
+}
+
+void
+conv_f32d_to_s16s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint16_t *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			*d++ = F32_TO_S16S(s[i][j]);
+	}
+}
+
+void
+conv_s32s_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const uint32_t *s = src[0];
+	float *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = S32S_TO_F32(s[i]);
+}
+
+void
+conv_s32s_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = S32S_TO_F32(*s++);
+	}
+}
+
+void
+conv_f32_to_s32s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const float *s = src[0];
+	uint32_t *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = F32_TO_S32S(s[i]);
+}
+
+void
+conv_f32d_to_s32s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint32_t *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			*d++ = F32_TO_S32S(s[i][j]);
+	}
+}
+
+void
+conv_s24s_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const uint8_t *s = src[0];
+	float *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++) {
+		d[i] = S24_TO_F32(read_s24s(s));
+		s += 3;
+	}
+}
+
+void
+conv_s24s_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint8_t *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++) {
+			d[i][j] = S24_TO_F32(read_s24s(s));
+			s += 3;
+		}
+	}
+}
+
+void
+conv_f32_to_s24s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const float *s = src[0];
+	uint8_t *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++) {
+		write_s24s(d, F32_TO_S24(s[i]));
+		d += 3;
+	}
+}
+
+void
+conv_f32d_to_s24s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint8_t *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++) {
+			write_s24s(d, F32_TO_S24(s[i][j]));
+			d += 3;
+		}
+	}
+}
+
+void
+conv_f32s_to_f32_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const uint32_t *s = src[0];
+	float *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		d[i] = read_f32s(&s[i]);
+}
+
+void
+conv_f32s_to_f32d_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	float **d = (float **) dst;
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			d[i][j] = read_f32s(s++);
+	}
+}
+
+void
+conv_f32_to_f32s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n_channels = conv->n_channels;
+	const float *s = src[0];
+	uint32_t *d = dst[0];
+
+	n_samples *= n_channels;
+
+	for (i = 0; i < n_samples; i++)
+		write_f32s(&d[i], s[i]);
+}
+
+void
+conv_f32d_to_f32s_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	uint32_t *d = dst[0];
+	uint32_t i, j, n_channels = conv->n_channels;
+
+	for (j = 0; j < n_samples; j++) {
+		for (i = 0; i < n_channels; i++)
+			write_f32s(d++, s[i][j]);
+	}
+}
+
 void
 conv_deinterleave_8_c(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
 		uint32_t n_samples)
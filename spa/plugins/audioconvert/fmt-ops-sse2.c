@@ -724,3 +724,373 @@ conv_f32d_to_s16_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const voi
 	for(; i < n_channels; i++)
 		conv_f32d_to_s16_1s_sse2(conv, &d[i], &src[i], n_channels, n_samples);
 }
+
+static inline __m128i mullo_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i t0 = _mm_mul_epu32(a, b);
+	__m128i t1 = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(t0, _MM_SHUFFLE(0, 0, 2, 0)),
+				  _mm_shuffle_epi32(t1, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* same noise as update_dither_c, one generator per lane */
+static void update_dither_sse2(struct convert *conv, uint32_t n_samples)
+{
+	uint32_t n;
+	float *dither = conv->dither;
+	__m128i r = _mm_loadu_si128((__m128i*)conv->random);
+	__m128i mul = _mm_set1_epi32(96314165);
+	__m128i add = _mm_set1_epi32(907633515);
+	__m128 scale = _mm_set1_ps(DITHER_SCALE), t;
+
+	if (conv->dither_method == DITHER_METHOD_RECTANGULAR) {
+		for (n = 0; n < n_samples; n += 4) {
+			r = _mm_add_epi32(mullo_epi32_sse2(r, mul), add);
+			_mm_store_ps(&dither[n], _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+		}
+	} else {
+		for (n = 0; n < n_samples; n += 4) {
+			r = _mm_add_epi32(mullo_epi32_sse2(r, mul), add);
+			t = _mm_mul_ps(_mm_cvtepi32_ps(r), scale);
+			r = _mm_add_epi32(mullo_epi32_sse2(r, mul), add);
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_cvtepi32_ps(r), scale));
+			_mm_store_ps(&dither[n], t);
+		}
+	}
+	_mm_storeu_si128((__m128i*)conv->random, r);
+}
+
+static void
+conv_f32d_to_s16_dither_1s_sse2(struct convert *conv, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src;
+	int16_t *d = dst;
+	float *dither = conv->dither;
+	uint32_t n, m, chunk, unrolled;
+	__m128 in;
+	__m128i out;
+	__m128 int_max = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+
+	for (n = 0; n < n_samples;) {
+		chunk = SPA_MIN(n_samples - n, DITHER_SIZE);
+		update_dither_sse2(conv, chunk);
+		unrolled = chunk & ~3;
+
+		for (m = 0; m < unrolled; m += 4, n += 4) {
+			in = _mm_mul_ps(_mm_loadu_ps(&s[n]), int_max);
+			in = _mm_add_ps(in, _mm_load_ps(&dither[m]));
+			in = _mm_min_ps(int_max, _mm_max_ps(in, int_min));
+			out = _mm_cvtps_epi32(in);
+			out = _mm_packs_epi32(out, out);
+
+			d[(n+0)*n_channels] = _mm_extract_epi16(out, 0);
+			d[(n+1)*n_channels] = _mm_extract_epi16(out, 1);
+			d[(n+2)*n_channels] = _mm_extract_epi16(out, 2);
+			d[(n+3)*n_channels] = _mm_extract_epi16(out, 3);
+		}
+		for (; m < chunk; m++, n++)
+			d[n*n_channels] = F32_TO_S16_D(s[n], dither[m]);
+	}
+}
+
+void
+conv_f32d_to_s16_dither_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	int16_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++)
+		conv_f32d_to_s16_dither_1s_sse2(conv, &d[i], src[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s24_dither_1s_sse2(struct convert *conv, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s = src;
+	uint8_t *d = dst;
+	float *dither = conv->dither;
+	uint32_t n, m, chunk, unrolled, stride = n_channels * 3;
+	__m128 in;
+	int32_t out[4] SPA_ALIGNED(16);
+	__m128 int_max = _mm_set1_ps(S24_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+
+	for (n = 0; n < n_samples;) {
+		chunk = SPA_MIN(n_samples - n, DITHER_SIZE);
+		update_dither_sse2(conv, chunk);
+		unrolled = chunk & ~3;
+
+		for (m = 0; m < unrolled; m += 4, n += 4) {
+			in = _mm_mul_ps(_mm_loadu_ps(&s[n]), int_max);
+			in = _mm_add_ps(in, _mm_load_ps(&dither[m]));
+			in = _mm_min_ps(int_max, _mm_max_ps(in, int_min));
+			_mm_store_si128((__m128i*)out, _mm_cvtps_epi32(in));
+
+			write_s24(&d[(n+0)*stride], out[0]);
+			write_s24(&d[(n+1)*stride], out[1]);
+			write_s24(&d[(n+2)*stride], out[2]);
+			write_s24(&d[(n+3)*stride], out[3]);
+		}
+		for (; m < chunk; m++, n++)
+			write_s24(&d[n*stride], F32_TO_S24_D(s[n], dither[m]));
+	}
+}
+
+void
+conv_f32d_to_s24_dither_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint8_t *d = dst[0];
+	uint32_t i, n_channels = conv->n_channels;
+
+	for (i = 0; i < n_channels; i++)
+		conv_f32d_to_s24_dither_1s_sse2(conv, &d[i*3], src[i], n_channels, n_samples);
+}
+
+/* Deinterleave in tiles of 4 channels by 4 samples with a register
+ * transpose, channels beyond the last full tile are copied one by one.
+ * This is inlined into the per channel count versions below so that the
+ * channel loop is unrolled for a constant count. */
+static inline void
+deinterleave_32_tiled_sse2(float **d, const float *s, uint32_t n_channels, uint32_t n_samples)
+{
+	uint32_t n, c, unrolled = n_samples & ~3, tiled = n_channels & ~3;
+	__m128 t[4];
+
+	for (n = 0; n < unrolled; n += 4) {
+		for (c = 0; c < tiled; c += 4) {
+			t[0] = _mm_loadu_ps(&s[0*n_channels + c]);
+			t[1] = _mm_loadu_ps(&s[1*n_channels + c]);
+			t[2] = _mm_loadu_ps(&s[2*n_channels + c]);
+			t[3] = _mm_loadu_ps(&s[3*n_channels + c]);
+			_MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+			_mm_storeu_ps(&d[c+0][n], t[0]);
+			_mm_storeu_ps(&d[c+1][n], t[1]);
+			_mm_storeu_ps(&d[c+2][n], t[2]);
+			_mm_storeu_ps(&d[c+3][n], t[3]);
+		}
+		for (; c < n_channels; c++) {
+			d[c][n+0] = s[0*n_channels + c];
+			d[c][n+1] = s[1*n_channels + c];
+			d[c][n+2] = s[2*n_channels + c];
+			d[c][n+3] = s[3*n_channels + c];
+		}
+		s += 4*n_channels;
+	}
+	for (; n < n_samples; n++) {
+		for (c = 0; c < n_channels; c++)
+			d[c][n] = s[c];
+		s += n_channels;
+	}
+}
+
+static inline void
+interleave_32_tiled_sse2(float *d, const float **s, uint32_t n_channels, uint32_t n_samples)
+{
+	uint32_t n, c, unrolled = n_samples & ~3, tiled = n_channels & ~3;
+	__m128 t[4];
+
+	for (n = 0; n < unrolled; n += 4) {
+		for (c = 0; c < tiled; c += 4) {
+			t[0] = _mm_loadu_ps(&s[c+0][n]);
+			t[1] = _mm_loadu_ps(&s[c+1][n]);
+			t[2] = _mm_loadu_ps(&s[c+2][n]);
+			t[3] = _mm_loadu_ps(&s[c+3][n]);
+			_MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+			_mm_storeu_ps(&d[0*n_channels + c], t[0]);
+			_mm_storeu_ps(&d[1*n_channels + c], t[1]);
+			_mm_storeu_ps(&d[2*n_channels + c], t[2]);
+			_mm_storeu_ps(&d[3*n_channels + c], t[3]);
+		}
+		for (; c < n_channels; c++) {
+			d[0*n_channels + c] = s[c][n+0];
+			d[1*n_channels + c] = s[c][n+1];
+			d[2*n_channels + c] = s[c][n+2];
+			d[3*n_channels + c] = s[c][n+3];
+		}
+		d += 4*n_channels;
+	}
+	for (; n < n_samples; n++) {
+		for (c = 0; c < n_channels; c++)
+			d[c] = s[c][n];
+		d += n_channels;
+	}
+}
+
+#define MAKE_INTERLEAVE_32(chans)								\
+void												\
+conv_deinterleave_32_##chans##_sse2(struct convert *conv, void * SPA_RESTRICT dst[],		\
+		const void * SPA_RESTRICT src[], uint32_t n_samples)				\
+{												\
+	deinterleave_32_tiled_sse2((float **)dst, src[0], chans, n_samples);			\
+}												\
+void												\
+conv_interleave_32_##chans##_sse2(struct convert *conv, void * SPA_RESTRICT dst[],		\
+		const void * SPA_RESTRICT src[], uint32_t n_samples)				\
+{												\
+	interleave_32_tiled_sse2(dst[0], (const float **)src, chans, n_samples);		\
+}
+
+MAKE_INTERLEAVE_32(4);
+MAKE_INTERLEAVE_32(8);
+MAKE_INTERLEAVE_32(16);
+MAKE_INTERLEAVE_32(32);
+MAKE_INTERLEAVE_32(64);
+
+void
+conv_deinterleave_32_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	deinterleave_32_tiled_sse2((float **)dst, src[0], conv->n_channels, n_samples);
+}
+
+void
+conv_interleave_32_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	interleave_32_tiled_sse2(dst[0], (const float **)src, conv->n_channels, n_samples);
+}
+
+void
+conv_f64d_to_f32d_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n, unrolled, n_channels = conv->n_channels;
+	__m128d in[2];
+	__m128 out;
+
+	for (i = 0; i < n_channels; i++) {
+		const double *s = src[i];
+		float *d = dst[i];
+
+		if (SPA_IS_ALIGNED(s, 16) &&
+		    SPA_IS_ALIGNED(d, 16))
+			unrolled = n_samples & ~3;
+		else
+			unrolled = 0;
+
+		for(n = 0; n < unrolled; n += 4) {
+			in[0] = _mm_load_pd(&s[n]);
+			in[1] = _mm_load_pd(&s[n+2]);
+			out = _mm_movelh_ps(_mm_cvtpd_ps(in[0]), _mm_cvtpd_ps(in[1]));
+			_mm_store_ps(&d[n], out);
+		}
+		for(; n < n_samples; n++)
+			d[n] = (float)s[n];
+	}
+}
+
+static void
+conv_f64_to_f32d_1s_sse2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const double *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled;
+	__m128d in[2];
+	__m128 out;
+
+	if (SPA_IS_ALIGNED(d0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in[0] = _mm_set_pd(s[1*n_channels], s[0*n_channels]);
+		in[1] = _mm_set_pd(s[3*n_channels], s[2*n_channels]);
+		out = _mm_movelh_ps(_mm_cvtpd_ps(in[0]), _mm_cvtpd_ps(in[1]));
+		_mm_store_ps(&d0[n], out);
+		s += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = (float)s[0];
+		s += n_channels;
+	}
+}
+
+void
+conv_f64_to_f32d_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const double *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f64_to_f32d_1s_sse2(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+void
+conv_f32d_to_f64d_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, n, unrolled, n_channels = conv->n_channels;
+	__m128 in;
+
+	for (i = 0; i < n_channels; i++) {
+		const float *s = src[i];
+		double *d = dst[i];
+
+		if (SPA_IS_ALIGNED(s, 16) &&
+		    SPA_IS_ALIGNED(d, 16))
+			unrolled = n_samples & ~3;
+		else
+			unrolled = 0;
+
+		for(n = 0; n < unrolled; n += 4) {
+			in = _mm_load_ps(&s[n]);
+			_mm_store_pd(&d[n], _mm_cvtps_pd(in));
+			_mm_store_pd(&d[n+2], _mm_cvtps_pd(_mm_movehl_ps(in, in)));
+		}
+		for(; n < n_samples; n++)
+			d[n] = s[n];
+	}
+}
+
+static void
+conv_f32d_to_f64_1s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	double *d = dst;
+	uint32_t n, unrolled;
+	__m128 in;
+	__m128d out[2];
+
+	if (SPA_IS_ALIGNED(s0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_load_ps(&s0[n]);
+		out[0] = _mm_cvtps_pd(in);
+		out[1] = _mm_cvtps_pd(_mm_movehl_ps(in, in));
+
+		_mm_storel_pd(&d[0*n_channels], out[0]);
+		_mm_storeh_pd(&d[1*n_channels], out[0]);
+		_mm_storel_pd(&d[2*n_channels], out[1]);
+		_mm_storeh_pd(&d[3*n_channels], out[1]);
+		d += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		*d = s0[n];
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_f64_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	double *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_f64_1s_sse2(conv, &d[i], &src[i], n_channels, n_samples);
+}
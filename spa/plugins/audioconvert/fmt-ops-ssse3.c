@@ -22,6 +22,8 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "fmt-ops.h"
 
 #include <tmmintrin.h>
@@ -110,3 +112,394 @@ conv_s24_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const vo
 	for(; i < n_channels; i++)
 		conv_s24_to_f32d_1s_sse2(conv, &dst[i], &s[3*i], n_channels, n_samples);
 }
+
+/* 4 packed 24 bits samples are 12 bytes, don't touch the 4 bytes after
+ * them, they can be past the end of the buffer */
+static inline __m128i load_s24x4(const uint8_t *s)
+{
+	int32_t t;
+	memcpy(&t, s + 8, 4);
+	return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)s), _mm_cvtsi32_si128(t));
+}
+
+static inline void store_s24x4(uint8_t *d, __m128i v)
+{
+	int32_t t = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+	_mm_storel_epi64((__m128i*)d, v);
+	memcpy(d + 8, &t, 4);
+}
+
+/* Tiles of 4 channels by 4 samples. The samples are spread to 32 bits
+ * lanes, transposed and packed again, the 4th byte of each lane is
+ * never used. */
+void
+conv_deinterleave_24_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint8_t *s = src[0];
+	uint8_t **d = (uint8_t **) dst;
+	uint32_t n, c, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3, tiled = n_channels & ~3;
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m128 t[4];
+
+	for (n = 0; n < unrolled; n += 4) {
+		for (c = 0; c < tiled; c += 4) {
+			t[0] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[(0*n_channels + c) * 3]), spread));
+			t[1] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[(1*n_channels + c) * 3]), spread));
+			t[2] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[(2*n_channels + c) * 3]), spread));
+			t[3] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[(3*n_channels + c) * 3]), spread));
+			_MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+			store_s24x4(&d[c+0][n*3], _mm_shuffle_epi8(_mm_castps_si128(t[0]), pack));
+			store_s24x4(&d[c+1][n*3], _mm_shuffle_epi8(_mm_castps_si128(t[1]), pack));
+			store_s24x4(&d[c+2][n*3], _mm_shuffle_epi8(_mm_castps_si128(t[2]), pack));
+			store_s24x4(&d[c+3][n*3], _mm_shuffle_epi8(_mm_castps_si128(t[3]), pack));
+		}
+		for (; c < n_channels; c++) {
+			memcpy(&d[c][(n+0)*3], &s[(0*n_channels + c) * 3], 3);
+			memcpy(&d[c][(n+1)*3], &s[(1*n_channels + c) * 3], 3);
+			memcpy(&d[c][(n+2)*3], &s[(2*n_channels + c) * 3], 3);
+			memcpy(&d[c][(n+3)*3], &s[(3*n_channels + c) * 3], 3);
+		}
+		s += 12 * n_channels;
+	}
+	for (; n < n_samples; n++) {
+		for (c = 0; c < n_channels; c++)
+			memcpy(&d[c][n*3], &s[c*3], 3);
+		s += 3 * n_channels;
+	}
+}
+
+void
+conv_interleave_24_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint8_t **s = (const uint8_t **) src;
+	uint8_t *d = dst[0];
+	uint32_t n, c, n_channels = conv->n_channels;
+	uint32_t unrolled = n_samples & ~3, tiled = n_channels & ~3;
+	const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	__m128 t[4];
+
+	for (n = 0; n < unrolled; n += 4) {
+		for (c = 0; c < tiled; c += 4) {
+			t[0] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[c+0][n*3]), spread));
+			t[1] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[c+1][n*3]), spread));
+			t[2] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[c+2][n*3]), spread));
+			t[3] = _mm_castsi128_ps(_mm_shuffle_epi8(load_s24x4(&s[c+3][n*3]), spread));
+			_MM_TRANSPOSE4_PS(t[0], t[1], t[2], t[3]);
+			store_s24x4(&d[(0*n_channels + c) * 3], _mm_shuffle_epi8(_mm_castps_si128(t[0]), pack));
+			store_s24x4(&d[(1*n_channels + c) * 3], _mm_shuffle_epi8(_mm_castps_si128(t[1]), pack));
+			store_s24x4(&d[(2*n_channels + c) * 3], _mm_shuffle_epi8(_mm_castps_si128(t[2]), pack));
+			store_s24x4(&d[(3*n_channels + c) * 3], _mm_shuffle_epi8(_mm_castps_si128(t[3]), pack));
+		}
+		for (; c < n_channels; c++) {
+			memcpy(&d[(0*n_channels + c) * 3], &s[c][(n+0)*3], 3);
+			memcpy(&d[(1*n_channels + c) * 3], &s[c][(n+1)*3], 3);
+			memcpy(&d[(2*n_channels + c) * 3], &s[c][(n+2)*3], 3);
+			memcpy(&d[(3*n_channels + c) * 3], &s[c][(n+3)*3], 3);
+		}
+		d += 12 * n_channels;
+	}
+	for (; n < n_samples; n++) {
+		for (c = 0; c < n_channels; c++)
+			memcpy(&d[c*3], &s[c][n*3], 3);
+		d += 3 * n_channels;
+	}
+}
+
+/* The _OE formats gather the samples like the native ones and swap the
+ * bytes of each lane with a single shuffle */
+static void
+conv_s16s_to_f32d_1s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint16_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled;
+	__m128i in;
+	__m128 out, factor = _mm_set1_ps(1.0f / S16_SCALE);
+	/* swap the 16 bits sample into the upper half of each lane */
+	const __m128i swap = _mm_setr_epi8(-1, -1, 1, 0, -1, -1, 5, 4, -1, -1, 9, 8, -1, -1, 13, 12);
+
+	if (SPA_IS_ALIGNED(d0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_setr_epi32(s[0*n_channels],
+				    s[1*n_channels],
+				    s[2*n_channels],
+				    s[3*n_channels]);
+		in = _mm_shuffle_epi8(in, swap);
+		in = _mm_srai_epi32(in, 16);
+		out = _mm_cvtepi32_ps(in);
+		out = _mm_mul_ps(out, factor);
+		_mm_store_ps(&d0[n], out);
+		s += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S16S_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s16s_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint16_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_s16s_to_f32d_1s_ssse3(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_s32s_to_f32d_1s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint32_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled;
+	__m128i in;
+	__m128 out, factor = _mm_set1_ps(1.0f / S24_SCALE);
+	const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	if (SPA_IS_ALIGNED(d0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_setr_epi32(s[0*n_channels],
+				    s[1*n_channels],
+				    s[2*n_channels],
+				    s[3*n_channels]);
+		in = _mm_shuffle_epi8(in, swap);
+		in = _mm_srai_epi32(in, 8);
+		out = _mm_cvtepi32_ps(in);
+		out = _mm_mul_ps(out, factor);
+		_mm_store_ps(&d0[n], out);
+		s += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = S32S_TO_F32(s[0]);
+		s += n_channels;
+	}
+}
+
+void
+conv_s32s_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_s32s_to_f32d_1s_ssse3(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32s_to_f32d_1s_ssse3(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const uint32_t *s = src;
+	float **d = (float **) dst;
+	float *d0 = d[0];
+	uint32_t n, unrolled;
+	__m128i in;
+	const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	if (SPA_IS_ALIGNED(d0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in = _mm_setr_epi32(s[0*n_channels],
+				    s[1*n_channels],
+				    s[2*n_channels],
+				    s[3*n_channels]);
+		in = _mm_shuffle_epi8(in, swap);
+		_mm_store_ps(&d0[n], _mm_castsi128_ps(in));
+		s += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		d0[n] = read_f32s(s);
+		s += n_channels;
+	}
+}
+
+void
+conv_f32s_to_f32d_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	const uint32_t *s = src[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32s_to_f32d_1s_ssse3(conv, &dst[i], &s[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s16s_1s_ssse3(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	uint16_t *d = dst;
+	uint32_t n, unrolled;
+	__m128 in[2];
+	__m128i out[2];
+	__m128 int_max = _mm_set1_ps(S16_MAX_F);
+	__m128 int_min = _mm_sub_ps(_mm_setzero_ps(), int_max);
+	const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+	if (SPA_IS_ALIGNED(s0, 16))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm_mul_ps(_mm_load_ps(&s0[n]), int_max);
+		in[1] = _mm_mul_ps(_mm_load_ps(&s0[n+4]), int_max);
+		in[0] = _mm_min_ps(int_max, _mm_max_ps(in[0], int_min));
+		in[1] = _mm_min_ps(int_max, _mm_max_ps(in[1], int_min));
+		out[0] = _mm_cvtps_epi32(in[0]);
+		out[1] = _mm_cvtps_epi32(in[1]);
+		out[0] = _mm_packs_epi32(out[0], out[1]);
+		out[0] = _mm_shuffle_epi8(out[0], swap);
+
+		d[0*n_channels] = _mm_extract_epi16(out[0], 0);
+		d[1*n_channels] = _mm_extract_epi16(out[0], 1);
+		d[2*n_channels] = _mm_extract_epi16(out[0], 2);
+		d[3*n_channels] = _mm_extract_epi16(out[0], 3);
+		d[4*n_channels] = _mm_extract_epi16(out[0], 4);
+		d[5*n_channels] = _mm_extract_epi16(out[0], 5);
+		d[6*n_channels] = _mm_extract_epi16(out[0], 6);
+		d[7*n_channels] = _mm_extract_epi16(out[0], 7);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in[0] = _mm_mul_ss(_mm_load_ss(&s0[n]), int_max);
+		in[0] = _mm_min_ss(int_max, _mm_max_ss(in[0], int_min));
+		*d = bswap_16((uint16_t)_mm_cvtss_si32(in[0]));
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16s_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint16_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_s16s_1s_ssse3(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_s32s_1s_ssse3(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	uint32_t *d = dst;
+	uint32_t n, unrolled;
+	__m128 in[1];
+	__m128i out[4];
+	__m128 scale = _mm_set1_ps(S32_SCALE);
+	__m128 int_min = _mm_set1_ps(S32_MIN);
+	const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	if (SPA_IS_ALIGNED(s0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in[0] = _mm_mul_ps(_mm_load_ps(&s0[n]), scale);
+		in[0] = _mm_min_ps(in[0], int_min);
+		out[0] = _mm_cvtps_epi32(in[0]);
+		out[0] = _mm_shuffle_epi8(out[0], swap);
+		out[1] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(0, 3, 2, 1));
+		out[2] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(1, 0, 3, 2));
+		out[3] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(2, 1, 0, 3));
+
+		d[0*n_channels] = _mm_cvtsi128_si32(out[0]);
+		d[1*n_channels] = _mm_cvtsi128_si32(out[1]);
+		d[2*n_channels] = _mm_cvtsi128_si32(out[2]);
+		d[3*n_channels] = _mm_cvtsi128_si32(out[3]);
+		d += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in[0] = _mm_load_ss(&s0[n]);
+		in[0] = _mm_mul_ss(in[0], scale);
+		in[0] = _mm_min_ss(in[0], int_min);
+		*d = bswap_32((uint32_t)_mm_cvtss_si32(in[0]));
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s32s_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_s32s_1s_ssse3(conv, &d[i], &src[i], n_channels, n_samples);
+}
+
+static void
+conv_f32d_to_f32s_1s_ssse3(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_channels, uint32_t n_samples)
+{
+	const float **s = (const float **) src;
+	const float *s0 = s[0];
+	uint32_t *d = dst;
+	uint32_t n, unrolled;
+	__m128i out[4];
+	const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+	if (SPA_IS_ALIGNED(s0, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		out[0] = _mm_shuffle_epi8(_mm_castps_si128(_mm_load_ps(&s0[n])), swap);
+		out[1] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(0, 3, 2, 1));
+		out[2] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(1, 0, 3, 2));
+		out[3] = _mm_shuffle_epi32(out[0], _MM_SHUFFLE(2, 1, 0, 3));
+
+		d[0*n_channels] = _mm_cvtsi128_si32(out[0]);
+		d[1*n_channels] = _mm_cvtsi128_si32(out[1]);
+		d[2*n_channels] = _mm_cvtsi128_si32(out[2]);
+		d[3*n_channels] = _mm_cvtsi128_si32(out[3]);
+		d += 4*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		write_f32s(d, s0[n]);
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_f32s_ssse3(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t *d = dst[0];
+	uint32_t i = 0, n_channels = conv->n_channels;
+
+	for(; i < n_channels; i++)
+		conv_f32d_to_f32s_1s_ssse3(conv, &d[i], &src[i], n_channels, n_samples);
+}
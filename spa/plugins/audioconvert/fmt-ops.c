@@ -24,6 +24,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #include <spa/support/cpu.h>
@@ -42,6 +43,7 @@ struct conv_info {
 	uint32_t cpu_flags;
 
 	convert_func_t process;
+	uint32_t dither;
 };
 
 static struct conv_info conv_table[] =
@@ -55,20 +57,79 @@ static struct conv_info conv_table[] =
 
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s16_to_f32_c },
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s16d_to_f32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_2_avx2 },
+#endif
+#if defined (HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX512, conv_s16_to_f32d_avx512 },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s16_to_f32d_avx2 },
+#endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_SSE2, conv_s16_to_f32d_2_sse2 },
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_s16_to_f32d_sse2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_NEON, conv_s16_to_f32d_2_neon },
+	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s16_to_f32d_neon },
 #endif
 	{ SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s16_to_f32d_c },
 	{ SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s16d_to_f32_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 4, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 8, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_NEON, conv_deinterleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 4, SPA_CPU_FLAG_NEON, conv_deinterleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 4, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 8, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 16, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 32, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 64, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 2, SPA_CPU_FLAG_AVX512, conv_interleave_32_2_avx512 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 4, SPA_CPU_FLAG_AVX512, conv_interleave_32_4_avx512 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 8, SPA_CPU_FLAG_AVX512, conv_interleave_32_8_avx512 },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 2, SPA_CPU_FLAG_AVX2, conv_interleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 4, SPA_CPU_FLAG_AVX2, conv_interleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 8, SPA_CPU_FLAG_AVX2, conv_interleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 2, SPA_CPU_FLAG_NEON, conv_interleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 4, SPA_CPU_FLAG_NEON, conv_interleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 4, SPA_CPU_FLAG_SSE2, conv_interleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 8, SPA_CPU_FLAG_SSE2, conv_interleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 16, SPA_CPU_FLAG_SSE2, conv_interleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 32, SPA_CPU_FLAG_SSE2, conv_interleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 64, SPA_CPU_FLAG_SSE2, conv_interleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 0, SPA_CPU_FLAG_SSE2, conv_interleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_interleave_32_c },
 
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s32_to_f32d_avx2 },
+#endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_s32_to_f32d_sse2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 2, SPA_CPU_FLAG_NEON, conv_s32_to_f32d_2_neon },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s32_to_f32d_neon },
 #endif
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s32_to_f32_c },
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s32d_to_f32d_c },
@@ -77,6 +138,9 @@ static struct conv_info conv_table[] =
 
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_to_f32_c },
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24d_to_f32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_AVX2, conv_s24_to_f32d_avx2 },
+#endif
 #if defined (HAVE_SSSE3)
 //	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSSE3, conv_s24_to_f32d_ssse3 },
 #endif
@@ -94,6 +158,44 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24_32_to_f32d_c },
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24_32d_to_f32_c },
 
+	{ SPA_AUDIO_FORMAT_F64, SPA_AUDIO_FORMAT_F32, 0, 0, conv_f64_to_f32_c },
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F64P, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_f64d_to_f32d_sse2 },
+#endif
+	{ SPA_AUDIO_FORMAT_F64P, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_f64d_to_f32d_c },
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F64, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSE2, conv_f64_to_f32d_sse2 },
+#endif
+	{ SPA_AUDIO_FORMAT_F64, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_f64_to_f32d_c },
+	{ SPA_AUDIO_FORMAT_F64P, SPA_AUDIO_FORMAT_F32, 0, 0, conv_f64d_to_f32_c },
+
+	{ SPA_AUDIO_FORMAT_S16_OE, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s16s_to_f32_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_S16_OE, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSSE3, conv_s16s_to_f32d_ssse3 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S16_OE, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s16s_to_f32d_neon },
+#endif
+	{ SPA_AUDIO_FORMAT_S16_OE, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s16s_to_f32d_c },
+
+	{ SPA_AUDIO_FORMAT_S32_OE, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s32s_to_f32_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_S32_OE, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSSE3, conv_s32s_to_f32d_ssse3 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32_OE, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_NEON, conv_s32s_to_f32d_neon },
+#endif
+	{ SPA_AUDIO_FORMAT_S32_OE, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s32s_to_f32d_c },
+
+	{ SPA_AUDIO_FORMAT_S24_OE, SPA_AUDIO_FORMAT_F32, 0, 0, conv_s24s_to_f32_c },
+	{ SPA_AUDIO_FORMAT_S24_OE, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_s24s_to_f32d_c },
+
+	{ SPA_AUDIO_FORMAT_F32_OE, SPA_AUDIO_FORMAT_F32, 0, 0, conv_f32s_to_f32_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_F32_OE, SPA_AUDIO_FORMAT_F32P, 0, SPA_CPU_FLAG_SSSE3, conv_f32s_to_f32d_ssse3 },
+#endif
+	{ SPA_AUDIO_FORMAT_F32_OE, SPA_AUDIO_FORMAT_F32P, 0, 0, conv_f32s_to_f32d_c },
+
 	/* from f32 */
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_U8, 0, 0, conv_f32_to_u8_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_f32d_to_u8d_c },
@@ -103,22 +205,56 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32_to_s16_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32d_to_s16d_c },
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S16P, 0, 0, conv_f32_to_s16d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s16_avx2 },
+#endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_sse2 },
 #endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 2, SPA_CPU_FLAG_NEON, conv_f32d_to_s16_2_neon },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_NEON, conv_f32d_to_s16_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_dither_sse2, DITHER_METHOD_RECTANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s16_dither_sse2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_dither_c, DITHER_METHOD_RECTANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_dither_c, DITHER_METHOD_TRIANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_shaped_c, DITHER_METHOD_SHAPED },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16, 0, 0, conv_f32d_to_s16_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32_to_s32_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32d_to_s32d_c },
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_f32_to_s32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s32_avx2 },
+#endif
 #if defined (HAVE_SSE2)
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s32_sse2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 2, SPA_CPU_FLAG_NEON, conv_f32d_to_s32_2_neon },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_NEON, conv_f32d_to_s32_neon },
 #endif
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_f32d_to_s32_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32_to_s24_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32d_to_s24d_c },
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_f32_to_s24d_c },
+#if defined (HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_AVX512, conv_f32d_to_s24_avx512 },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_AVX2, conv_f32d_to_s24_avx2 },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s24_dither_sse2, DITHER_METHOD_RECTANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_s24_dither_sse2, DITHER_METHOD_TRIANGULAR },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_dither_c, DITHER_METHOD_RECTANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_dither_c, DITHER_METHOD_TRIANGULAR },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_shaped_c, DITHER_METHOD_SHAPED },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_f32d_to_s24_c },
 
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32_to_s24_32_c },
@@ -126,6 +262,44 @@ static struct conv_info conv_table[] =
 	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_f32_to_s24_32d_c },
 	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_f32d_to_s24_32_c },
 
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F64, 0, 0, conv_f32_to_f64_c },
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F64P, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_f64d_sse2 },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F64P, 0, 0, conv_f32d_to_f64d_c },
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F64P, 0, 0, conv_f32_to_f64d_c },
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F64, 0, SPA_CPU_FLAG_SSE2, conv_f32d_to_f64_sse2 },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F64, 0, 0, conv_f32d_to_f64_c },
+
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S16_OE, 0, 0, conv_f32_to_s16s_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16_OE, 0, SPA_CPU_FLAG_SSSE3, conv_f32d_to_s16s_ssse3 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16_OE, 0, SPA_CPU_FLAG_NEON, conv_f32d_to_s16s_neon },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S16_OE, 0, 0, conv_f32d_to_s16s_c },
+
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S32_OE, 0, 0, conv_f32_to_s32s_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32_OE, 0, SPA_CPU_FLAG_SSSE3, conv_f32d_to_s32s_ssse3 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32_OE, 0, SPA_CPU_FLAG_NEON, conv_f32d_to_s32s_neon },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S32_OE, 0, 0, conv_f32d_to_s32s_c },
+
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_S24_OE, 0, 0, conv_f32_to_s24s_c },
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_S24_OE, 0, 0, conv_f32d_to_s24s_c },
+
+	{ SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32_OE, 0, 0, conv_f32_to_f32s_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32_OE, 0, SPA_CPU_FLAG_SSSE3, conv_f32d_to_f32s_ssse3 },
+#endif
+	{ SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32_OE, 0, 0, conv_f32d_to_f32s_c },
+
 	/* u8 */
 	{ SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_U8, 0, 0, conv_copy8_c },
 	{ SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8P, 0, 0, conv_copy8d_c },
@@ -141,35 +315,119 @@ static struct conv_info conv_table[] =
 	/* s32 */
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 2, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 4, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 8, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 2, SPA_CPU_FLAG_NEON, conv_deinterleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 4, SPA_CPU_FLAG_NEON, conv_deinterleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 4, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 8, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 16, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 32, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 64, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 0, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 2, SPA_CPU_FLAG_AVX512, conv_interleave_32_2_avx512 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 4, SPA_CPU_FLAG_AVX512, conv_interleave_32_4_avx512 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 8, SPA_CPU_FLAG_AVX512, conv_interleave_32_8_avx512 },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 2, SPA_CPU_FLAG_AVX2, conv_interleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 4, SPA_CPU_FLAG_AVX2, conv_interleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 8, SPA_CPU_FLAG_AVX2, conv_interleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 2, SPA_CPU_FLAG_NEON, conv_interleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 4, SPA_CPU_FLAG_NEON, conv_interleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 4, SPA_CPU_FLAG_SSE2, conv_interleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 8, SPA_CPU_FLAG_SSE2, conv_interleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 16, SPA_CPU_FLAG_SSE2, conv_interleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 32, SPA_CPU_FLAG_SSE2, conv_interleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 64, SPA_CPU_FLAG_SSE2, conv_interleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 0, SPA_CPU_FLAG_SSE2, conv_interleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, 0, 0, conv_interleave_32_c },
 
 	/* s24 */
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24, 0, 0, conv_copy24_c },
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_copy24d_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24P, 0, SPA_CPU_FLAG_SSSE3, conv_deinterleave_24_ssse3 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24P, 0, 0, conv_deinterleave_24_c },
+#if defined (HAVE_SSSE3)
+	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24, 0, SPA_CPU_FLAG_SSSE3, conv_interleave_24_ssse3 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24, 0, 0, conv_interleave_24_c },
 
 	/* s24_32 */
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_copy32_c },
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_copy32d_c },
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 2, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 4, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 8, SPA_CPU_FLAG_AVX2, conv_deinterleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 2, SPA_CPU_FLAG_NEON, conv_deinterleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 4, SPA_CPU_FLAG_NEON, conv_deinterleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 4, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 8, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 16, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 32, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 64, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 0, SPA_CPU_FLAG_SSE2, conv_deinterleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32P, 0, 0, conv_deinterleave_32_c },
+#if defined (HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 2, SPA_CPU_FLAG_AVX512, conv_interleave_32_2_avx512 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 4, SPA_CPU_FLAG_AVX512, conv_interleave_32_4_avx512 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 8, SPA_CPU_FLAG_AVX512, conv_interleave_32_8_avx512 },
+#endif
+#if defined (HAVE_AVX2)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 2, SPA_CPU_FLAG_AVX2, conv_interleave_32_2_avx2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 4, SPA_CPU_FLAG_AVX2, conv_interleave_32_4_avx2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 8, SPA_CPU_FLAG_AVX2, conv_interleave_32_8_avx2 },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 2, SPA_CPU_FLAG_NEON, conv_interleave_32_2_neon },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 4, SPA_CPU_FLAG_NEON, conv_interleave_32_4_neon },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 4, SPA_CPU_FLAG_SSE2, conv_interleave_32_4_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 8, SPA_CPU_FLAG_SSE2, conv_interleave_32_8_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 16, SPA_CPU_FLAG_SSE2, conv_interleave_32_16_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 32, SPA_CPU_FLAG_SSE2, conv_interleave_32_32_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 64, SPA_CPU_FLAG_SSE2, conv_interleave_32_64_sse2 },
+	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 0, SPA_CPU_FLAG_SSE2, conv_interleave_32_sse2 },
+#endif
 	{ SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, 0, 0, conv_interleave_32_c },
 };
 
 #define MATCH_CHAN(a,b)		((a) == 0 || (a) == (b))
-#define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 
 static const struct conv_info *find_conv_info(uint32_t src_fmt, uint32_t dst_fmt,
-		uint32_t n_channels, uint32_t cpu_flags)
+		uint32_t n_channels, uint32_t cpu_flags, uint32_t dither)
 {
 	size_t i;
 
 	for (i = 0; i < SPA_N_ELEMENTS(conv_table); i++) {
 		if (conv_table[i].src_fmt == src_fmt &&
 		    conv_table[i].dst_fmt == dst_fmt &&
+		    conv_table[i].dither == dither &&
 		    MATCH_CHAN(conv_table[i].n_channels, n_channels) &&
-		    MATCH_CPU_FLAGS(conv_table[i].cpu_flags, cpu_flags))
+		    SPA_CPU_FLAGS_MATCH(conv_table[i].cpu_flags, cpu_flags))
 			return &conv_table[i];
 	}
 	return NULL;
@@ -183,11 +441,23 @@ static void impl_convert_free(struct convert *conv)
 int convert_init(struct convert *conv)
 {
 	const struct conv_info *info;
+	uint32_t i;
 
-	info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels, conv->cpu_flags);
+	info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+			conv->cpu_flags, conv->dither_method);
+	if (info == NULL && conv->dither_method != DITHER_METHOD_NONE) {
+		/* no dithering for this conversion */
+		conv->dither_method = DITHER_METHOD_NONE;
+		info = find_conv_info(conv->src_fmt, conv->dst_fmt, conv->n_channels,
+				conv->cpu_flags, conv->dither_method);
+	}
 	if (info == NULL)
 		return -ENOTSUP;
 
+	for (i = 0; i < SPA_N_ELEMENTS(conv->random); i++)
+		conv->random[i] = random();
+	memset(conv->ns_data, 0, sizeof(conv->ns_data));
+
 	conv->is_passthrough = conv->src_fmt == conv->dst_fmt;
 	conv->cpu_flags = info->cpu_flags;
 	conv->process = info->process;
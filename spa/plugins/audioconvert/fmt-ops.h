@@ -23,6 +23,7 @@
  */
 
 #include <math.h>
+#include <byteswap.h>
 
 #include <spa/utils/defs.h>
 
@@ -53,6 +54,28 @@
 #define S32_TO_F32(v)	S24_TO_F32((v) >> 8)
 #define F32_TO_S32(v)	(F32_TO_S24(v) << 8)
 
+/* the _OE formats are stored with the bytes swapped */
+#define S16S_TO_F32(v)	S16_TO_F32(bswap_16(v))
+#define F32_TO_S16S(v)	bswap_16(F32_TO_S16(v))
+#define S32S_TO_F32(v)	S32_TO_F32((int32_t)bswap_32(v))
+#define F32_TO_S32S(v)	bswap_32(F32_TO_S32(v))
+
+static inline float read_f32s(const void *src)
+{
+	union { uint32_t i; float f; } v = { .i = bswap_32(*(const uint32_t*)src) };
+	return v.f;
+}
+
+static inline void write_f32s(void *dst, float val)
+{
+	union { float f; uint32_t i; } v = { .f = val };
+	*(uint32_t*)dst = bswap_32(v.i);
+}
+
+/* dithered conversions add the noise in units of the target LSB and round */
+#define F32_TO_S16_D(v,d)	(int16_t)lrintf(SPA_CLAMP((v) * S16_SCALE + (d), S16_MIN, S16_MAX))
+#define F32_TO_S24_D(v,d)	(int32_t)lrintf(SPA_CLAMP((v) * S24_SCALE + (d), S24_MIN, S24_MAX))
+
 static inline int32_t read_s24(const void *src)
 {
 	const int8_t *s = src;
@@ -63,6 +86,16 @@ static inline int32_t read_s24(const void *src)
 #endif
 }
 
+static inline int32_t read_s24s(const void *src)
+{
+	const int8_t *s = src;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return (((int32_t)s[0] << 16) | ((uint32_t)(uint8_t)s[1] << 8) | (uint32_t)(uint8_t)s[2]);
+#else
+	return (((int32_t)s[2] << 16) | ((uint32_t)(uint8_t)s[1] << 8) | (uint32_t)(uint8_t)s[0]);
+#endif
+}
+
 static inline void write_s24(void *dst, int32_t val)
 {
 	uint8_t *d = dst;
@@ -77,6 +110,35 @@ static inline void write_s24(void *dst, int32_t val)
 #endif
 }
 
+static inline void write_s24s(void *dst, int32_t val)
+{
+	uint8_t *d = dst;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	d[0] = (uint8_t) (val >> 16);
+	d[1] = (uint8_t) (val >> 8);
+	d[2] = (uint8_t) (val);
+#else
+	d[0] = (uint8_t) (val);
+	d[1] = (uint8_t) (val >> 8);
+	d[2] = (uint8_t) (val >> 16);
+#endif
+}
+
+#define DITHER_METHOD_NONE		0
+#define DITHER_METHOD_RECTANGULAR	1	/* 1 LSB peak-to-peak uniform noise */
+#define DITHER_METHOD_TRIANGULAR	2	/* 2 LSB peak-to-peak triangular noise */
+#define DITHER_METHOD_SHAPED		3	/* triangular noise with error feedback */
+
+#define DITHER_SIZE	(1u << 8)
+#define DITHER_SCALE	(1.0f / 4294967296.0f)
+
+/* simple LCG, 4 of these run in parallel to feed one SIMD lane each */
+static inline int32_t lcnoise(uint32_t *state)
+{
+	*state = (*state * 96314165) + 907633515;
+	return (int32_t)*state;
+}
+
 #define MAX_NS	64
 
 struct convert {
@@ -84,8 +146,11 @@ struct convert {
 	uint32_t dst_fmt;
 	uint32_t n_channels;
 	uint32_t cpu_flags;
+	uint32_t dither_method;
 
 	unsigned int is_passthrough:1;
+	uint32_t random[4];
+	float dither[DITHER_SIZE] SPA_ALIGNED(16);
 	float ns_data[MAX_NS];
 	uint32_t ns_idx;
 	uint32_t ns_size;
@@ -148,10 +213,38 @@ DEFINE_FUNCTION(f32d_to_s24d, c);
 DEFINE_FUNCTION(f32_to_s24, c);
 DEFINE_FUNCTION(f32_to_s24d, c);
 DEFINE_FUNCTION(f32d_to_s24, c);
+DEFINE_FUNCTION(f32d_to_s16_dither, c);
+DEFINE_FUNCTION(f32d_to_s16_shaped, c);
+DEFINE_FUNCTION(f32d_to_s24_dither, c);
+DEFINE_FUNCTION(f32d_to_s24_shaped, c);
 DEFINE_FUNCTION(f32d_to_s24_32d, c);
 DEFINE_FUNCTION(f32_to_s24_32, c);
 DEFINE_FUNCTION(f32_to_s24_32d, c);
 DEFINE_FUNCTION(f32d_to_s24_32, c);
+DEFINE_FUNCTION(f64d_to_f32d, c);
+DEFINE_FUNCTION(f64_to_f32, c);
+DEFINE_FUNCTION(f64_to_f32d, c);
+DEFINE_FUNCTION(f64d_to_f32, c);
+DEFINE_FUNCTION(f32d_to_f64d, c);
+DEFINE_FUNCTION(f32_to_f64, c);
+DEFINE_FUNCTION(f32_to_f64d, c);
+DEFINE_FUNCTION(f32d_to_f64, c);
+DEFINE_FUNCTION(s16s_to_f32, c);
+DEFINE_FUNCTION(s16s_to_f32d, c);
+DEFINE_FUNCTION(f32_to_s16s, c);
+DEFINE_FUNCTION(f32d_to_s16s, c);
+DEFINE_FUNCTION(s32s_to_f32, c);
+DEFINE_FUNCTION(s32s_to_f32d, c);
+DEFINE_FUNCTION(f32_to_s32s, c);
+DEFINE_FUNCTION(f32d_to_s32s, c);
+DEFINE_FUNCTION(s24s_to_f32, c);
+DEFINE_FUNCTION(s24s_to_f32d, c);
+DEFINE_FUNCTION(f32_to_s24s, c);
+DEFINE_FUNCTION(f32d_to_s24s, c);
+DEFINE_FUNCTION(f32s_to_f32, c);
+DEFINE_FUNCTION(f32s_to_f32d, c);
+DEFINE_FUNCTION(f32_to_f32s, c);
+DEFINE_FUNCTION(f32d_to_f32s, c);
 DEFINE_FUNCTION(deinterleave_8, c);
 DEFINE_FUNCTION(deinterleave_16, c);
 DEFINE_FUNCTION(deinterleave_24, c);
@@ -168,11 +261,76 @@ DEFINE_FUNCTION(s24_to_f32d, sse2);
 DEFINE_FUNCTION(s32_to_f32d, sse2);
 DEFINE_FUNCTION(f32d_to_s32, sse2);
 DEFINE_FUNCTION(f32d_to_s16, sse2);
+DEFINE_FUNCTION(f32d_to_s16_dither, sse2);
+DEFINE_FUNCTION(f32d_to_s24_dither, sse2);
+DEFINE_FUNCTION(interleave_32_4, sse2);
+DEFINE_FUNCTION(interleave_32_8, sse2);
+DEFINE_FUNCTION(interleave_32_16, sse2);
+DEFINE_FUNCTION(interleave_32_32, sse2);
+DEFINE_FUNCTION(interleave_32_64, sse2);
+DEFINE_FUNCTION(interleave_32, sse2);
+DEFINE_FUNCTION(deinterleave_32_4, sse2);
+DEFINE_FUNCTION(deinterleave_32_8, sse2);
+DEFINE_FUNCTION(deinterleave_32_16, sse2);
+DEFINE_FUNCTION(deinterleave_32_32, sse2);
+DEFINE_FUNCTION(deinterleave_32_64, sse2);
+DEFINE_FUNCTION(deinterleave_32, sse2);
+DEFINE_FUNCTION(f64d_to_f32d, sse2);
+DEFINE_FUNCTION(f64_to_f32d, sse2);
+DEFINE_FUNCTION(f32d_to_f64d, sse2);
+DEFINE_FUNCTION(f32d_to_f64, sse2);
 #endif
 #if defined(HAVE_SSSE3)
 DEFINE_FUNCTION(s24_to_f32d, ssse3);
+DEFINE_FUNCTION(interleave_24, ssse3);
+DEFINE_FUNCTION(deinterleave_24, ssse3);
+DEFINE_FUNCTION(s16s_to_f32d, ssse3);
+DEFINE_FUNCTION(s32s_to_f32d, ssse3);
+DEFINE_FUNCTION(f32s_to_f32d, ssse3);
+DEFINE_FUNCTION(f32d_to_s16s, ssse3);
+DEFINE_FUNCTION(f32d_to_s32s, ssse3);
+DEFINE_FUNCTION(f32d_to_f32s, ssse3);
 #endif
 #if defined(HAVE_SSE41)
 DEFINE_FUNCTION(s24_to_f32d, sse41);
-
+#endif
+#if defined(HAVE_AVX2)
+DEFINE_FUNCTION(s16_to_f32d_2, avx2);
+DEFINE_FUNCTION(s16_to_f32d, avx2);
+DEFINE_FUNCTION(s24_to_f32d, avx2);
+DEFINE_FUNCTION(s32_to_f32d, avx2);
+DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(f32d_to_s24, avx2);
+DEFINE_FUNCTION(f32d_to_s32, avx2);
+DEFINE_FUNCTION(interleave_32_2, avx2);
+DEFINE_FUNCTION(interleave_32_4, avx2);
+DEFINE_FUNCTION(interleave_32_8, avx2);
+DEFINE_FUNCTION(deinterleave_32_2, avx2);
+DEFINE_FUNCTION(deinterleave_32_4, avx2);
+DEFINE_FUNCTION(deinterleave_32_8, avx2);
+#endif
+#if defined(HAVE_AVX512)
+DEFINE_FUNCTION(s16_to_f32d, avx512);
+DEFINE_FUNCTION(f32d_to_s24, avx512);
+DEFINE_FUNCTION(interleave_32_2, avx512);
+DEFINE_FUNCTION(interleave_32_4, avx512);
+DEFINE_FUNCTION(interleave_32_8, avx512);
+#endif
+#if defined(HAVE_NEON)
+DEFINE_FUNCTION(s16_to_f32d_2, neon);
+DEFINE_FUNCTION(s16_to_f32d, neon);
+DEFINE_FUNCTION(s32_to_f32d_2, neon);
+DEFINE_FUNCTION(s32_to_f32d, neon);
+DEFINE_FUNCTION(f32d_to_s16_2, neon);
+DEFINE_FUNCTION(f32d_to_s16, neon);
+DEFINE_FUNCTION(f32d_to_s32_2, neon);
+DEFINE_FUNCTION(f32d_to_s32, neon);
+DEFINE_FUNCTION(interleave_32_2, neon);
+DEFINE_FUNCTION(interleave_32_4, neon);
+DEFINE_FUNCTION(deinterleave_32_2, neon);
+DEFINE_FUNCTION(deinterleave_32_4, neon);
+DEFINE_FUNCTION(s16s_to_f32d, neon);
+DEFINE_FUNCTION(s32s_to_f32d, neon);
+DEFINE_FUNCTION(f32d_to_s16s, neon);
+DEFINE_FUNCTION(f32d_to_s32s, neon);
 #endif
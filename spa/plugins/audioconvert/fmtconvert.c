@@ -55,7 +55,7 @@
 #define MAX_PORTS	128
 
 #define PROP_DEFAULT_TRUNCATE	false
-#define PROP_DEFAULT_DITHER	0
+#define PROP_DEFAULT_DITHER	DITHER_METHOD_NONE
 
 struct impl;
 
@@ -70,6 +70,17 @@ static void props_reset(struct props *props)
 	props->dither = PROP_DEFAULT_DITHER;
 }
 
+static uint32_t dither_method_from_label(const char *label)
+{
+	if (strcmp(label, "rectangular") == 0)
+		return DITHER_METHOD_RECTANGULAR;
+	else if (strcmp(label, "triangular") == 0)
+		return DITHER_METHOD_TRIANGULAR;
+	else if (strcmp(label, "shaped") == 0)
+		return DITHER_METHOD_SHAPED;
+	return DITHER_METHOD_NONE;
+}
+
 struct buffer {
 	uint32_t id;
 #define BUFFER_FLAG_OUT		(1 << 0)
@@ -124,6 +135,7 @@ struct impl {
 	struct convert conv;
 	unsigned int started:1;
 	unsigned int is_passthrough:1;
+	unsigned int zero_silence:1;
 };
 
 #define CHECK_PORT(this,d,id)		(id == 0)
@@ -140,6 +152,29 @@ static int can_convert(const struct spa_audio_info *info1, const struct spa_audi
 	return 1;
 }
 
+static bool is_zero_silence(uint32_t format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_U8:
+	case SPA_AUDIO_FORMAT_U8P:
+	case SPA_AUDIO_FORMAT_U16_LE:
+	case SPA_AUDIO_FORMAT_U16_BE:
+	case SPA_AUDIO_FORMAT_U24_32_LE:
+	case SPA_AUDIO_FORMAT_U24_32_BE:
+	case SPA_AUDIO_FORMAT_U32_LE:
+	case SPA_AUDIO_FORMAT_U32_BE:
+	case SPA_AUDIO_FORMAT_U24_LE:
+	case SPA_AUDIO_FORMAT_U24_BE:
+	case SPA_AUDIO_FORMAT_U20_LE:
+	case SPA_AUDIO_FORMAT_U20_BE:
+	case SPA_AUDIO_FORMAT_U18_LE:
+	case SPA_AUDIO_FORMAT_U18_BE:
+		return false;
+	default:
+		return true;
+	}
+}
+
 static int setup_convert(struct impl *this)
 {
 	uint32_t src_fmt, dst_fmt;
@@ -187,14 +222,16 @@ static int setup_convert(struct impl *this)
 	this->conv.dst_fmt = dst_fmt;
 	this->conv.n_channels = outformat.info.raw.channels;
 	this->conv.cpu_flags = this->cpu_flags;
+	this->conv.dither_method = this->props.dither;
 
 	if ((res = convert_init(&this->conv)) < 0)
 		return res;
 
-	spa_log_info(this->log, NAME " %p: got converter features %08x:%08x", this,
-			this->cpu_flags, this->conv.cpu_flags);
+	spa_log_info(this->log, NAME " %p: got converter features %08x:%08x dither:%d", this,
+			this->cpu_flags, this->conv.cpu_flags, this->conv.dither_method);
 
 	this->is_passthrough = this->conv.is_passthrough;
+	this->zero_silence = is_zero_silence(dst_fmt);
 
 	return 0;
 }
@@ -345,7 +382,7 @@ static int port_enum_formats(void *object,
 			    info.info.raw.format == SPA_AUDIO_FORMAT_F32P ||
 			    info.info.raw.format == SPA_AUDIO_FORMAT_F32) {
 				spa_pod_builder_add(builder,
-					SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(18,
+					SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(20,
 								info.info.raw.format,
 								SPA_AUDIO_FORMAT_U8P,
 								SPA_AUDIO_FORMAT_U8,
@@ -363,7 +400,9 @@ static int port_enum_formats(void *object,
 								SPA_AUDIO_FORMAT_S24_OE,
 								SPA_AUDIO_FORMAT_S24_32P,
 								SPA_AUDIO_FORMAT_S24_32,
-								SPA_AUDIO_FORMAT_S24_32_OE),
+								SPA_AUDIO_FORMAT_S24_32_OE,
+								SPA_AUDIO_FORMAT_F64P,
+								SPA_AUDIO_FORMAT_F64),
 					0);
 			} else {
 				spa_pod_builder_add(builder,
@@ -539,6 +578,9 @@ static int calc_width(struct spa_audio_info *info)
 	case SPA_AUDIO_FORMAT_S24:
 	case SPA_AUDIO_FORMAT_S24_OE:
 		return 3;
+	case SPA_AUDIO_FORMAT_F64P:
+	case SPA_AUDIO_FORMAT_F64:
+		return 8;
 	default:
 		return 4;
 	}
@@ -800,6 +842,7 @@ static int impl_node_process(void *object)
 	uint32_t i, n_src_datas, n_dst_datas;
 	int res = 0;
 	uint32_t n_samples, size, maxsize, offs;
+	bool is_empty;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -846,6 +889,7 @@ static int impl_node_process(void *object)
 		src_datas[i] = SPA_MEMBER(inb->datas[i].data, offs, void);
 	}
 	n_samples = size / inport->stride;
+	is_empty = SPA_FLAG_IS_SET(inb->datas[0].chunk->flags, SPA_CHUNK_FLAG_EMPTY);
 
 	outb = outbuf->outbuf;
 
@@ -860,16 +904,32 @@ static int impl_node_process(void *object)
 			this->is_passthrough);
 
 	for (i = 0; i < n_dst_datas; i++) {
+		struct spa_data *d = &outb->datas[this->remap[i]];
+
+		/* the peer can move dynamic data, like the ALSA sink does to
+		 * let us write into the device memory directly */
+		if (!this->is_passthrough &&
+		    SPA_FLAG_IS_SET(d->flags, SPA_DATA_FLAG_DYNAMIC) && d->data != NULL)
+			outbuf->datas[this->remap[i]] = d->data;
+
 		dst_datas[i] = this->is_passthrough ?
 			(void*)src_datas[i] :
 			outbuf->datas[this->remap[i]];
-		outb->datas[this->remap[i]].data = dst_datas[i];
+		d->data = dst_datas[i];
 		outb->datas[i].chunk->offset = 0;
 		outb->datas[i].chunk->size = n_samples * outport->stride;
+		outb->datas[i].chunk->flags = is_empty ? SPA_CHUNK_FLAG_EMPTY : 0;
 	}
 
-	if (!this->is_passthrough)
+	if (this->is_passthrough) {
+		/* nothing to do */
+	} else if (is_empty && this->zero_silence) {
+		/* silence converts to all zero samples */
+		for (i = 0; i < n_dst_datas; i++)
+			memset(dst_datas[i], 0, n_samples * outport->stride);
+	} else {
 		convert_process(&this->conv, dst_datas, src_datas, n_samples);
+	}
 
 	inio->status = SPA_STATUS_NEED_DATA;
 	res |= SPA_STATUS_NEED_DATA;
@@ -997,6 +1057,12 @@ impl_init(const struct spa_handle_factory *factory,
 	this->info.n_params = 0;
 	props_reset(&this->props);
 
+	if (info != NULL) {
+		const char *str;
+		if ((str = spa_dict_lookup(info, "dither.method")) != NULL)
+			this->props.dither = dither_method_from_label(str);
+	}
+
 	init_port(this, SPA_DIRECTION_OUTPUT, 0);
 	init_port(this, SPA_DIRECTION_INPUT, 0);
 
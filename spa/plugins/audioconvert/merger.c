@@ -112,10 +112,12 @@ struct impl {
 	unsigned int started:1;
 	unsigned int monitor:1;
 	unsigned int have_profile:1;
-
-	float empty[MAX_SAMPLES*2 + MAX_ALIGN];
 };
 
+/* silence for inputs without data, only read so all mergers in the
+ * process share it */
+static float empty[MAX_SAMPLES*2] SPA_ALIGNED(MAX_ALIGN);
+
 #define CHECK_IN_PORT(this,d,p)		((d) == SPA_DIRECTION_INPUT && (p) < this->port_count)
 #define CHECK_OUT_PORT(this,d,p)	((d) == SPA_DIRECTION_OUTPUT && (p) <= this->monitor_count)
 #define CHECK_PORT(this,d,p)		(CHECK_OUT_PORT(this,d,p) || CHECK_IN_PORT (this,d,p))
@@ -411,10 +413,12 @@ static int port_enum_formats(void *object,
 				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
 				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
 				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-				SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(13,
+				SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(15,
 							SPA_AUDIO_FORMAT_F32,
 							SPA_AUDIO_FORMAT_F32,
 							SPA_AUDIO_FORMAT_F32P,
+							SPA_AUDIO_FORMAT_F64,
+							SPA_AUDIO_FORMAT_F64P,
 							SPA_AUDIO_FORMAT_S32,
 							SPA_AUDIO_FORMAT_S32P,
 							SPA_AUDIO_FORMAT_S24_32,
@@ -595,6 +599,8 @@ static int calc_width(struct spa_audio_info *info)
 	case SPA_AUDIO_FORMAT_S24:
 	case SPA_AUDIO_FORMAT_S24_OE:
 		return 3;
+	case SPA_AUDIO_FORMAT_F64:
+		return 8;
 	default:
 		return 4;
 	}
@@ -965,7 +971,7 @@ static int impl_node_process(void *object)
 		struct port *inport = GET_IN_PORT(this, i);
 
 		if (get_in_buffer(this, inport, &sbuf) < 0) {
-			src_datas[n_src_datas++] = SPA_PTR_ALIGN(this->empty, MAX_ALIGN, void);
+			src_datas[n_src_datas++] = empty;
 			continue;
 		}
 
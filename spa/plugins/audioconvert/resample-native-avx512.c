@@ -0,0 +1,77 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include "resample-native-impl.h"
+
+#include <immintrin.h>
+
+/* n_taps is a multiple of 8 and the taps are 64 byte aligned, the last
+ * block of 8 taps is done with a masked load. */
+static void inner_product_avx512(float *d, const float * SPA_RESTRICT s,
+		const float * SPA_RESTRICT taps, uint32_t n_taps)
+{
+	__m512 sz[2] = { _mm512_setzero_ps(), _mm512_setzero_ps() };
+	uint32_t i = 0, n_taps32 = n_taps & ~0x1f, n_taps16 = n_taps & ~0xf;
+
+	for (; i < n_taps32; i += 32) {
+		sz[0] = _mm512_fmadd_ps(_mm512_loadu_ps(s + i + 0),
+				_mm512_load_ps(taps + i + 0), sz[0]);
+		sz[1] = _mm512_fmadd_ps(_mm512_loadu_ps(s + i + 16),
+				_mm512_load_ps(taps + i + 16), sz[1]);
+	}
+	for (; i < n_taps16; i += 16) {
+		sz[0] = _mm512_fmadd_ps(_mm512_loadu_ps(s + i),
+				_mm512_load_ps(taps + i), sz[0]);
+	}
+	if (i < n_taps) {
+		sz[1] = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(0xff, s + i),
+				_mm512_maskz_load_ps(0xff, taps + i), sz[1]);
+	}
+	*d = _mm512_reduce_add_ps(_mm512_add_ps(sz[0], sz[1]));
+}
+
+static void inner_product_ip_avx512(float *d, const float * SPA_RESTRICT s,
+	const float * SPA_RESTRICT t0, const float * SPA_RESTRICT t1, float x,
+	uint32_t n_taps)
+{
+	__m512 sz[2] = { _mm512_setzero_ps(), _mm512_setzero_ps() }, tz;
+	uint32_t i, n_taps16 = n_taps & ~0xf;
+
+	for (i = 0; i < n_taps16; i += 16) {
+		tz = _mm512_loadu_ps(s + i);
+		sz[0] = _mm512_fmadd_ps(tz, _mm512_load_ps(t0 + i), sz[0]);
+		sz[1] = _mm512_fmadd_ps(tz, _mm512_load_ps(t1 + i), sz[1]);
+	}
+	if (i < n_taps) {
+		tz = _mm512_maskz_loadu_ps(0xff, s + i);
+		sz[0] = _mm512_fmadd_ps(tz, _mm512_maskz_load_ps(0xff, t0 + i), sz[0]);
+		sz[1] = _mm512_fmadd_ps(tz, _mm512_maskz_load_ps(0xff, t1 + i), sz[1]);
+	}
+	sz[1] = _mm512_mul_ps(_mm512_sub_ps(sz[1], sz[0]), _mm512_set1_ps(x));
+	*d = _mm512_reduce_add_ps(_mm512_add_ps(sz[0], sz[1]));
+}
+
+MAKE_RESAMPLER_FULL(avx512);
+MAKE_RESAMPLER_INTER(avx512);
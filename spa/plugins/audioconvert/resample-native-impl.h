@@ -28,6 +28,8 @@
 
 #include "resample.h"
 
+struct filter_bank;
+
 typedef void (*resample_func_t)(struct resample *r,
         const void * SPA_RESTRICT src[], uint32_t *in_len,
         void * SPA_RESTRICT dst[], uint32_t offs, uint32_t *out_len);
@@ -43,9 +45,12 @@ struct native_data {
 	uint32_t frac;
 	uint32_t filter_stride;
 	uint32_t filter_stride_os;
+	uint32_t phase_shift;
+	float phase_scale;
 	uint32_t hist;
 	float **history;
 	resample_func_t func;
+	struct filter_bank *bank;
 	float *filter;
 	float *hist_mem;
 };
@@ -82,37 +87,45 @@ DEFINE_RESAMPLER(copy,arch)							\
 	*out_len = offs;							\
 }
 
+/* the phase schedule is computed once for a block of output samples and
+ * then applied to all channels */
+#define RESAMPLE_BLOCK	64
+
 #define MAKE_RESAMPLER_FULL(arch)						\
 DEFINE_RESAMPLER(full,arch)							\
 {										\
 	struct native_data *data = r->data;					\
 	uint32_t n_taps = data->n_taps, stride = data->filter_stride_os;	\
 	uint32_t index, phase, n_phases = data->out_rate;			\
-	uint32_t c, o, olen = *out_len, ilen = *in_len;				\
+	uint32_t c, i, n, o, olen = *out_len, ilen = *in_len;			\
 	uint32_t inc = data->inc, frac = data->frac;				\
+	uint32_t idx[RESAMPLE_BLOCK];						\
+	const float *taps[RESAMPLE_BLOCK];					\
 										\
 	if (r->channels == 0)							\
 		return;								\
 										\
-	for (c = 0; c < r->channels; c++) {					\
-		const float *s = src[c];					\
-		float *d = dst[c];						\
-										\
-		index = 0;							\
-		phase = data->phase;						\
-										\
-		for (o = offs; o < olen && index + n_taps <= ilen; o++) {	\
-			const float *ip, *taps;					\
+	index = 0;								\
+	phase = data->phase;							\
 										\
-			ip = &s[index];						\
-			taps = &data->filter[phase * stride];			\
+	for (o = offs; o < olen && index + n_taps <= ilen; o += n) {		\
+		for (n = 0; n < RESAMPLE_BLOCK && o + n < olen &&		\
+				index + n_taps <= ilen; n++) {			\
+			idx[n] = index;						\
+			taps[n] = &data->filter[phase * stride];		\
 			index += inc;						\
 			phase += frac;						\
 			if (phase >= n_phases) {				\
 				phase -= n_phases;				\
 				index += 1;					\
 			}							\
-			inner_product_##arch(&d[o], ip, taps, n_taps);		\
+		}								\
+		for (c = 0; c < r->channels; c++) {				\
+			const float *s = src[c];				\
+			float *d = &((float*)dst[c])[o];			\
+			for (i = 0; i < n; i++)					\
+				inner_product_##arch(&d[i], &s[idx[i]],		\
+						taps[i], n_taps);		\
 		}								\
 	}									\
 	*in_len = index;							\
@@ -125,40 +138,41 @@ DEFINE_RESAMPLER(inter,arch)							\
 {										\
 	struct native_data *data = r->data;					\
 	uint32_t index, phase, stride = data->filter_stride;			\
-	uint32_t n_phases = data->n_phases, out_rate = data->out_rate;		\
-	uint32_t n_taps = data->n_taps;						\
-	uint32_t c, o, olen = *out_len, ilen = *in_len;				\
+	uint32_t out_rate = data->out_rate, n_taps = data->n_taps;		\
+	uint32_t shift = data->phase_shift, mask = (1u << shift) - 1;		\
+	float scale = data->phase_scale;					\
+	uint32_t c, i, n, o, olen = *out_len, ilen = *in_len;			\
 	uint32_t inc = data->inc, frac = data->frac;				\
+	uint32_t idx[RESAMPLE_BLOCK];						\
+	const float *taps[RESAMPLE_BLOCK];					\
+	float x[RESAMPLE_BLOCK];						\
 										\
 	if (r->channels == 0)							\
 		return;								\
 										\
-	for (c = 0; c < r->channels; c++) {					\
-		const float *s = src[c];					\
-		float *d = dst[c];						\
-										\
-		index = 0;							\
-		phase = data->phase;						\
-										\
-		for (o = offs; o < olen && index + n_taps <= ilen; o++) {	\
-			const float *ip, *t0, *t1;				\
-			float ph, x;						\
-			uint32_t offset;					\
-										\
-			ip = &s[index];						\
-			ph = (float)phase * n_phases / out_rate;		\
-			offset = floor(ph);					\
-			x = ph - (float)offset;					\
+	index = 0;								\
+	phase = data->phase;							\
 										\
-			t0 = &data->filter[(offset + 0) * stride];		\
-			t1 = &data->filter[(offset + 1) * stride];		\
+	for (o = offs; o < olen && index + n_taps <= ilen; o += n) {		\
+		for (n = 0; n < RESAMPLE_BLOCK && o + n < olen &&		\
+				index + n_taps <= ilen; n++) {			\
+			idx[n] = index;						\
+			taps[n] = &data->filter[(phase >> shift) * stride];	\
+			x[n] = (float)(phase & mask) * scale;			\
 			index += inc;						\
 			phase += frac;						\
 			if (phase >= out_rate) {				\
 				phase -= out_rate;				\
 				index += 1;					\
 			}							\
-			inner_product_ip_##arch(&d[o], ip, t0, t1, x, n_taps);	\
+		}								\
+		for (c = 0; c < r->channels; c++) {				\
+			const float *s = src[c];				\
+			float *d = &((float*)dst[c])[o];			\
+			for (i = 0; i < n; i++)					\
+				inner_product_ip_##arch(&d[i], &s[idx[i]],	\
+						taps[i], taps[i] + stride,	\
+						x[i], n_taps);			\
 		}								\
 	}									\
 	*in_len = index;							\
@@ -166,7 +180,6 @@ DEFINE_RESAMPLER(inter,arch)							\
 	data->phase = phase;							\
 }
 
-
 DEFINE_RESAMPLER(copy,c);
 DEFINE_RESAMPLER(full,c);
 DEFINE_RESAMPLER(inter,c);
@@ -183,3 +196,11 @@ DEFINE_RESAMPLER(inter,ssse3);
 DEFINE_RESAMPLER(full,avx);
 DEFINE_RESAMPLER(inter,avx);
 #endif
+#if defined (HAVE_AVX512)
+DEFINE_RESAMPLER(full,avx512);
+DEFINE_RESAMPLER(inter,avx512);
+#endif
+#if defined (HAVE_NEON)
+DEFINE_RESAMPLER(full,neon);
+DEFINE_RESAMPLER(inter,neon);
+#endif
@@ -0,0 +1,68 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resample-native-impl.h"
+
+#include <arm_neon.h>
+
+static inline float hsum_neon(float32x4_t sum)
+{
+	float32x2_t s = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+	return vget_lane_f32(vpadd_f32(s, s), 0);
+}
+
+static void inner_product_neon(float *d, const float * SPA_RESTRICT s,
+		const float * SPA_RESTRICT taps, uint32_t n_taps)
+{
+	float32x4_t sum[2] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) };
+	uint32_t i;
+
+	for (i = 0; i < n_taps; i += 8) {
+		sum[0] = vmlaq_f32(sum[0], vld1q_f32(s + i + 0), vld1q_f32(taps + i + 0));
+		sum[1] = vmlaq_f32(sum[1], vld1q_f32(s + i + 4), vld1q_f32(taps + i + 4));
+	}
+	*d = hsum_neon(vaddq_f32(sum[0], sum[1]));
+}
+
+static void inner_product_ip_neon(float *d, const float * SPA_RESTRICT s,
+	const float * SPA_RESTRICT t0, const float * SPA_RESTRICT t1, float x,
+	uint32_t n_taps)
+{
+	float32x4_t sum[2] = { vdupq_n_f32(0.0f), vdupq_n_f32(0.0f) }, t;
+	uint32_t i;
+
+	for (i = 0; i < n_taps; i += 8) {
+		t = vld1q_f32(s + i + 0);
+		sum[0] = vmlaq_f32(sum[0], t, vld1q_f32(t0 + i + 0));
+		sum[1] = vmlaq_f32(sum[1], t, vld1q_f32(t1 + i + 0));
+		t = vld1q_f32(s + i + 4);
+		sum[0] = vmlaq_f32(sum[0], t, vld1q_f32(t0 + i + 4));
+		sum[1] = vmlaq_f32(sum[1], t, vld1q_f32(t1 + i + 4));
+	}
+	sum[1] = vmulq_n_f32(vsubq_f32(sum[1], sum[0]), x);
+	*d = hsum_neon(vaddq_f32(sum[0], sum[1]));
+}
+
+MAKE_RESAMPLER_FULL(neon);
+MAKE_RESAMPLER_INTER(neon);
@@ -22,6 +22,10 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <pthread.h>
+
+#include <spa/utils/list.h>
+
 #include "resample-native-impl.h"
 
 struct quality {
@@ -29,8 +33,6 @@ struct quality {
 	double cutoff;
 };
 
-#define DEFAULT_QUALITY	4
-
 static const struct quality blackman_qualities[] = {
 	{ 8, 0.5, },
 	{ 16, 0.6, },
@@ -75,9 +77,75 @@ static int build_filter(float *taps, uint32_t stride, uint32_t n_taps, uint32_t
 	return 0;
 }
 
+/* filter banks are shared between all resamplers with the same
+ * parameters */
+struct filter_bank {
+	struct spa_list link;
+	int ref;
+	const struct quality *q;
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t n_taps;
+	uint32_t n_phases;
+	uint32_t stride;
+	float *taps;
+};
+
+static struct spa_list filter_banks = SPA_LIST_INIT(&filter_banks);
+static pthread_mutex_t filter_banks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct filter_bank *filter_bank_acquire(const struct quality *q,
+		uint32_t in_rate, uint32_t out_rate, uint32_t n_taps,
+		uint32_t n_phases, uint32_t stride, double cutoff)
+{
+	struct filter_bank *f;
+	size_t size = stride * sizeof(float) * (n_phases + 1);
+
+	pthread_mutex_lock(&filter_banks_lock);
+	spa_list_for_each(f, &filter_banks, link) {
+		if (f->q == q && f->in_rate == in_rate && f->out_rate == out_rate &&
+		    f->n_taps == n_taps && f->n_phases == n_phases &&
+		    f->stride == stride) {
+			f->ref++;
+			goto done;
+		}
+	}
+	if ((f = malloc(sizeof(struct filter_bank) + size + 64)) == NULL)
+		goto done;
+
+	f->ref = 1;
+	f->q = q;
+	f->in_rate = in_rate;
+	f->out_rate = out_rate;
+	f->n_taps = n_taps;
+	f->n_phases = n_phases;
+	f->stride = stride;
+	f->taps = SPA_MEMBER_ALIGN(f, sizeof(struct filter_bank), 64, float);
+	build_filter(f->taps, stride, n_taps, n_phases, cutoff);
+	spa_list_append(&filter_banks, &f->link);
+done:
+	pthread_mutex_unlock(&filter_banks_lock);
+	return f;
+}
+
+static void filter_bank_release(struct filter_bank *f)
+{
+	pthread_mutex_lock(&filter_banks_lock);
+	if (--f->ref == 0) {
+		spa_list_remove(&f->link);
+		free(f);
+	}
+	pthread_mutex_unlock(&filter_banks_lock);
+}
+
 static void impl_native_free(struct resample *r)
 {
-	free(r->data);
+	struct native_data *d = r->data;
+
+	if (d) {
+		filter_bank_release(d->bank);
+		free(d);
+	}
 	r->data = NULL;
 }
 
@@ -97,16 +165,27 @@ static void impl_native_update_rate(struct resample *r, double rate)
 	uint32_t in_rate, out_rate, phase, gcd, old_out_rate;
 
 	old_out_rate = data->out_rate;
-	in_rate = r->i_rate / rate;
-	out_rate = r->o_rate;
 	phase = data->phase;
 
-	gcd = calc_gcd(in_rate, out_rate);
-	in_rate /= gcd;
-	out_rate /= gcd;
+	if (rate == 1.0) {
+		in_rate = r->i_rate;
+		out_rate = r->o_rate;
+		gcd = calc_gcd(in_rate, out_rate);
+		in_rate /= gcd;
+		out_rate /= gcd;
+	} else {
+		/* drift compensation, the phase is kept in fixed units of
+		 * 1 << phase_shift per filter phase. The denominator does not
+		 * change with the rate so the phase never needs rescaling
+		 * between updates and the resolution of the rate is well
+		 * below 1 ppm. */
+		out_rate = data->n_phases << data->phase_shift;
+		in_rate = (uint32_t)(out_rate * (double)r->i_rate /
+				(r->o_rate * rate) + 0.5);
+	}
 
 	data->rate = rate;
-	data->phase = phase * out_rate / old_out_rate;
+	data->phase = (uint64_t)phase * out_rate / old_out_rate;
 	data->in_rate = in_rate;
 	data->out_rate = out_rate;
 
@@ -133,6 +212,14 @@ static void impl_native_update_rate(struct resample *r, double rate)
 #if defined(HAVE_AVX) && defined(HAVE_FMA)
 		if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3))
 			data->func = is_full ? do_resample_full_avx : do_resample_inter_avx;
+#endif
+#if defined(HAVE_AVX512)
+		if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_AVX512))
+			data->func = is_full ? do_resample_full_avx512 : do_resample_inter_avx512;
+#endif
+#if defined (HAVE_NEON)
+		if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_NEON))
+			data->func = is_full ? do_resample_full_neon : do_resample_inter_neon;
 #endif
 	}
 }
@@ -142,7 +229,7 @@ static uint32_t impl_native_in_len(struct resample *r, uint32_t out_len)
 	struct native_data *data = r->data;
 	uint32_t in_len;
 
-	in_len = (data->phase + out_len * data->frac) / data->out_rate;
+	in_len = (data->phase + (uint64_t)out_len * data->frac) / data->out_rate;
 	in_len += out_len * data->inc +	(data->n_taps - data->hist);
 
 	spa_log_trace_fp(r->log, "native %p: hist:%d %d->%d", r, data->hist, out_len, in_len);
@@ -256,9 +343,9 @@ static uint32_t impl_native_delay (struct resample *r)
 static int impl_native_init(struct resample *r)
 {
 	struct native_data *d;
-	const struct quality *q = &blackman_qualities[DEFAULT_QUALITY];
+	const struct quality *q;
 	double scale;
-	uint32_t c, n_taps, n_phases, filter_size, in_rate, out_rate, gcd, filter_stride;
+	uint32_t c, n_taps, n_phases, in_rate, out_rate, gcd, filter_stride;
 	uint32_t history_stride, history_size, oversample;
 
 	r->free = impl_native_free;
@@ -268,6 +355,8 @@ static int impl_native_init(struct resample *r)
 	r->reset = impl_native_reset;
 	r->delay = impl_native_delay;
 
+	q = &blackman_qualities[SPA_MIN(r->quality, SPA_N_ELEMENTS(blackman_qualities) - 1)];
+
 	gcd = calc_gcd(r->i_rate, r->o_rate);
 
 	in_rate = r->i_rate / gcd;
@@ -284,12 +373,10 @@ static int impl_native_init(struct resample *r)
 	n_phases *= oversample;
 
 	filter_stride = SPA_ROUND_UP_N(n_taps * sizeof(float), 64);
-	filter_size = filter_stride * (n_phases + 1);
 	history_stride = SPA_ROUND_UP_N(2 * n_taps * sizeof(float), 64);
 	history_size = r->channels * history_stride;
 
 	d = malloc(sizeof(struct native_data) +
-			filter_size +
 			history_size +
 			(r->channels * sizeof(float*)) +
 			64);
@@ -297,21 +384,32 @@ static int impl_native_init(struct resample *r)
 	if (d == NULL)
 		return -errno;
 
+	d->bank = filter_bank_acquire(q, in_rate, out_rate, n_taps, n_phases,
+			filter_stride / sizeof(float), scale);
+	if (d->bank == NULL) {
+		int res = -errno;
+		free(d);
+		return res;
+	}
+
 	r->data = d;
 	d->n_taps = n_taps;
 	d->n_phases = n_phases;
 	d->in_rate = in_rate;
 	d->out_rate = out_rate;
-	d->filter = SPA_MEMBER_ALIGN(d, sizeof(struct native_data), 64, float);
-	d->hist_mem = SPA_MEMBER_ALIGN(d->filter, filter_size, 64, float);
+	d->filter = d->bank->taps;
+	d->hist_mem = SPA_MEMBER_ALIGN(d, sizeof(struct native_data), 64, float);
 	d->history = SPA_MEMBER(d->hist_mem, history_size, float*);
 	d->filter_stride = filter_stride / sizeof(float);
 	d->filter_stride_os = d->filter_stride * oversample;
+	/* fractional phase bits for the drift compensation mode */
+	for (d->phase_shift = 16; d->phase_shift > 0 &&
+			((uint64_t)n_phases << d->phase_shift) > (1u << 24);)
+		d->phase_shift--;
+	d->phase_scale = 1.0f / (1u << d->phase_shift);
 	for (c = 0; c < r->channels; c++)
 		d->history[c] = SPA_MEMBER(d->hist_mem, c * history_stride, float);
 
-	build_filter(d->filter, d->filter_stride, n_taps, n_phases, scale);
-
 	spa_log_debug(r->log, "native %p: in:%d out:%d n_taps:%d n_phases:%d",
 			r, in_rate, out_rate, n_taps, n_phases);
 
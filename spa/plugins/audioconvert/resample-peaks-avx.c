@@ -0,0 +1,52 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resample-peaks-impl.h"
+
+#include <immintrin.h>
+
+static inline float hmax_ps(__m256 val)
+{
+	__m128 t = _mm_max_ps(_mm256_castps256_ps128(val),
+			_mm256_extractf128_ps(val, 1));
+	t = _mm_max_ps(t, _mm_movehl_ps(t, t));
+	t = _mm_max_ss(t, _mm_shuffle_ps(t, t, 0x55));
+	return _mm_cvtss_f32(t);
+}
+
+DEFINE_PEAKS_FUNCTION(avx)
+{
+	uint32_t i, unrolled = n_samples & ~15;
+	__m256 max[2], mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	max[0] = max[1] = _mm256_set1_ps(m);
+	for (i = 0; i < unrolled; i += 16) {
+		max[0] = _mm256_max_ps(_mm256_and_ps(mask, _mm256_loadu_ps(&s[i + 0])), max[0]);
+		max[1] = _mm256_max_ps(_mm256_and_ps(mask, _mm256_loadu_ps(&s[i + 8])), max[1]);
+	}
+	m = hmax_ps(_mm256_max_ps(max[0], max[1]));
+	for (; i < n_samples; i++)
+		m = SPA_MAX(fabsf(s[i]), m);
+	return m;
+}
@@ -0,0 +1,51 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "resample.h"
+
+struct peaks_data {
+	uint32_t o_count;
+	uint32_t i_count;
+	float (*abs_max) (float m, const float * SPA_RESTRICT s, uint32_t n_samples);
+	float max_f[0];
+};
+
+/* return the max of m and the absolute values of n_samples from s */
+#define DEFINE_PEAKS_FUNCTION(arch)						\
+float peaks_abs_max_##arch(float m, const float * SPA_RESTRICT s, uint32_t n_samples)
+
+DEFINE_PEAKS_FUNCTION(c);
+#if defined (HAVE_SSE)
+DEFINE_PEAKS_FUNCTION(sse);
+#endif
+#if defined (HAVE_AVX)
+DEFINE_PEAKS_FUNCTION(avx);
+#endif
+#if defined (HAVE_NEON)
+DEFINE_PEAKS_FUNCTION(neon);
+#endif
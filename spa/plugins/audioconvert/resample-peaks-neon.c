@@ -0,0 +1,47 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resample-peaks-impl.h"
+
+#include <arm_neon.h>
+
+DEFINE_PEAKS_FUNCTION(neon)
+{
+	uint32_t i, unrolled = n_samples & ~7;
+	float32x4_t max[2];
+	float32x2_t t;
+
+	max[0] = max[1] = vdupq_n_f32(m);
+	for (i = 0; i < unrolled; i += 8) {
+		max[0] = vmaxq_f32(vabsq_f32(vld1q_f32(&s[i + 0])), max[0]);
+		max[1] = vmaxq_f32(vabsq_f32(vld1q_f32(&s[i + 4])), max[1]);
+	}
+	max[0] = vmaxq_f32(max[0], max[1]);
+	t = vmax_f32(vget_low_f32(max[0]), vget_high_f32(max[0]));
+	t = vpmax_f32(t, t);
+	m = vget_lane_f32(t, 0);
+	for (; i < n_samples; i++)
+		m = SPA_MAX(fabsf(s[i]), m);
+	return m;
+}
@@ -0,0 +1,52 @@
+/* Spa
+ *
+ * Copyright © 2018 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "resample-peaks-impl.h"
+
+#include <xmmintrin.h>
+
+static inline float hmax_ps(__m128 val)
+{
+	__m128 t = _mm_movehl_ps(val, val);
+	t = _mm_max_ps(t, val);
+	t = _mm_max_ss(t, _mm_shuffle_ps(t, t, 0x55));
+	return _mm_cvtss_f32(t);
+}
+
+DEFINE_PEAKS_FUNCTION(sse)
+{
+	uint32_t i, unrolled = n_samples & ~3;
+	__m128 in, max = _mm_set1_ps(m), mask = _mm_andnot_ps(_mm_set_ps1(-0.0f),
+			_mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()));
+
+	for (i = 0; i < unrolled; i += 4) {
+		in = _mm_loadu_ps(&s[i]);
+		in = _mm_and_ps(mask, in);
+		max = _mm_max_ps(in, max);
+	}
+	m = hmax_ps(max);
+	for (; i < n_samples; i++)
+		m = SPA_MAX(fabsf(s[i]), m);
+	return m;
+}
@@ -22,17 +22,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include <math.h>
-
-struct peaks_data {
-	uint32_t o_count;
-	uint32_t i_count;
-	float max_f[0];
-};
-
-#if defined (__SSE__)
-#include "resample-peaks-sse.h"
-#endif
+#include "resample-peaks-impl.h"
 
 static void impl_peaks_free(struct resample *r)
 {
@@ -54,29 +44,32 @@ static void impl_peaks_process(struct resample *r,
 	if (r->channels == 0)
 		return;
 
-	for (c = 0; c < r->channels; c++) {
-		const float *s = src[c];
-		float *d = dst[c], m = pd->max_f[c];
-
-		o_count = pd->o_count;
-		i_count = pd->i_count;
-		o = i = 0;
+	o_count = pd->o_count;
+	i_count = pd->i_count;
+	o = i = 0;
 
-		while (i < *in_len && o < *out_len) {
-			end = ((uint64_t) (o_count + 1) * r->i_rate) / r->o_rate;
-			end = end > i_count ? end - i_count : 0;
-			chunk = SPA_MIN(end, *in_len);
+	/* the chunks are the same for all channels, do them all in one pass */
+	while (i < *in_len && o < *out_len) {
+		end = ((uint64_t) (o_count + 1) * r->i_rate) / r->o_rate;
+		end = end > i_count ? end - i_count : 0;
+		chunk = SPA_MIN(end, *in_len);
 
-			for (; i < chunk; i++)
-				m = SPA_MAX(fabsf(s[i]), m);
-
-			if (i == end) {
-				d[o++] = m;
-				m = 0.0f;
-				o_count++;
+		if (chunk > i) {
+			for (c = 0; c < r->channels; c++) {
+				const float *s = src[c];
+				pd->max_f[c] = pd->abs_max(pd->max_f[c], &s[i], chunk - i);
+			}
+			i = chunk;
+		}
+		if (i == end) {
+			for (c = 0; c < r->channels; c++) {
+				float *d = dst[c];
+				d[o] = pd->max_f[c];
+				pd->max_f[c] = 0.0f;
 			}
+			o++;
+			o_count++;
 		}
-		pd->max_f[c] = m;
 	}
 
 	*out_len = o;
@@ -102,18 +95,26 @@ static int impl_peaks_init(struct resample *r)
 
 	r->free = impl_peaks_free;
 	r->update_rate = impl_peaks_update_rate;
-#if defined (__SSE__)
-	if (r->cpu_flags & SPA_CPU_FLAG_SSE)
-		r->process = impl_peaks_process_sse;
-	else
-#endif
-		r->process = impl_peaks_process;
-
+	r->process = impl_peaks_process;
 	r->reset = impl_peaks_reset;
-	d = r->data = calloc(1, sizeof(struct peaks_data) * sizeof(float) * r->channels);
+	d = r->data = calloc(1, sizeof(struct peaks_data) + sizeof(float) * r->channels);
 	if (r->data == NULL)
 		return -errno;
 
+	d->abs_max = peaks_abs_max_c;
+#if defined (HAVE_SSE)
+	if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_SSE))
+		d->abs_max = peaks_abs_max_sse;
+#endif
+#if defined (HAVE_AVX)
+	if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_AVX))
+		d->abs_max = peaks_abs_max_avx;
+#endif
+#if defined (HAVE_NEON)
+	if (SPA_FLAG_IS_SET(r->cpu_flags, SPA_CPU_FLAG_NEON))
+		d->abs_max = peaks_abs_max_neon;
+#endif
+
 	spa_log_debug(r->log, "peaks %p: in:%d out:%d", r, r->i_rate, r->o_rate);
 
 	d->i_count = d->o_count = 0;
@@ -50,6 +50,7 @@
 
 #define MAX_SAMPLES	8192
 #define MAX_BUFFERS	32
+#define MAX_DATAS	32
 
 struct impl;
 
@@ -69,6 +70,7 @@ struct buffer {
 	struct spa_list link;
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
+	void *datas[MAX_DATAS];
 };
 
 struct port {
@@ -119,6 +121,8 @@ struct impl {
 	int mode;
 	unsigned int started:1;
 	unsigned int peaks:1;
+	unsigned int is_passthrough:1;
+	unsigned int in_passthrough:1;
 
 	struct resample resample;
 };
@@ -160,6 +164,7 @@ static int setup_convert(struct impl *this,
 	this->resample.channels = src_info->info.raw.channels;
 	this->resample.i_rate = src_info->info.raw.rate;
 	this->resample.o_rate = dst_info->info.raw.rate;
+	this->resample.quality = RESAMPLE_DEFAULT_QUALITY;
 	this->resample.log = this->log;
 
 	if (this->peaks)
@@ -167,6 +172,13 @@ static int setup_convert(struct impl *this,
 	else
 		err = impl_native_init(&this->resample);
 
+	/* with equal rates the output is the input, delayed by the filter.
+	 * Forward the input buffers directly for as long as no rate
+	 * adjustment is requested. */
+	this->is_passthrough = !this->peaks &&
+		this->resample.i_rate == this->resample.o_rate;
+	this->in_passthrough = false;
+
 	return err;
 }
 
@@ -602,6 +614,9 @@ impl_node_port_use_buffers(void *object,
 		b->outbuf = buffers[i];
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
 
+		if (buffers[i]->n_datas > MAX_DATAS)
+			return -EINVAL;
+
 		for (j = 0; j < buffers[i]->n_datas; j++) {
 			if (size == SPA_ID_INVALID)
 				size = d[j].maxsize;
@@ -614,6 +629,10 @@ impl_node_port_use_buffers(void *object,
 					      buffers[i]);
 				return -EINVAL;
 			}
+			b->datas[j] = d[j].data;
+			if (direction == SPA_DIRECTION_OUTPUT &&
+			    !SPA_FLAG_IS_SET(d[j].flags, SPA_DATA_FLAG_DYNAMIC))
+				this->is_passthrough = false;
 		}
 
 		if (direction == SPA_DIRECTION_OUTPUT)
@@ -713,6 +732,7 @@ static int impl_node_process(void *object)
 	void **dst_datas;
 	bool flush_out = false;
 	bool flush_in = false;
+	bool is_passthrough;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -779,6 +799,42 @@ static int impl_node_process(void *object)
 		}
 	}
 
+	is_passthrough = this->is_passthrough &&
+		inport->offset == 0 && outport->offset == 0 &&
+		size <= db->datas[0].maxsize &&
+		(this->io_rate_match == NULL ||
+		 !SPA_FLAG_IS_SET(this->io_rate_match->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE));
+
+	if (is_passthrough != this->in_passthrough) {
+		spa_log_debug(this->log, NAME " %p: passthrough %d", this, is_passthrough);
+		/* the history is stale after forwarding buffers */
+		if (!is_passthrough)
+			resample_reset(&this->resample);
+		this->in_passthrough = is_passthrough;
+	}
+
+	if (is_passthrough) {
+		for (i = 0; i < db->n_datas; i++) {
+			db->datas[i].data = sb->datas[i].data;
+			db->datas[i].chunk->offset = sb->datas[i].chunk->offset;
+			db->datas[i].chunk->size = size;
+			db->datas[i].chunk->flags = sb->datas[i].chunk->flags;
+		}
+		inio->status = SPA_STATUS_NEED_DATA;
+		outio->status = SPA_STATUS_HAVE_DATA;
+		outio->buffer_id = dbuf->id;
+		dequeue_buffer(this, dbuf);
+
+		if (this->io_rate_match) {
+			this->io_rate_match->delay = 0;
+			this->io_rate_match->size = max;
+		}
+		return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+	}
+
+	for (i = 0; i < db->n_datas; i++)
+		db->datas[i].data = dbuf->datas[i];
+
 	in_len = (size - inport->offset) / sizeof(float);
 	out_len = (maxsize - outport->offset) / sizeof(float);
 
@@ -803,6 +859,7 @@ static int impl_node_process(void *object)
 	for (i = 0; i < db->n_datas; i++) {
 		db->datas[i].chunk->size = outport->offset + (out_len * sizeof(float));
 		db->datas[i].chunk->offset = 0;
+		db->datas[i].chunk->flags = 0;
 	}
 
 	inport->offset += in_len * sizeof(float);
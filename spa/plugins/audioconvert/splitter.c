@@ -113,10 +113,13 @@ struct impl {
 	unsigned int started:1;
 
 	bool have_profile;
-
-	float empty[MAX_SAMPLES*2 + MAX_ALIGN];
 };
 
+/* output that nobody takes is written here. The splitters that run on
+ * one data thread run one after the other so they can share it and it
+ * stays in the cache */
+static __thread float scratch[MAX_SAMPLES*2] SPA_ALIGNED(MAX_ALIGN);
+
 #define CHECK_OUT_PORT(this,d,p)	((d) == SPA_DIRECTION_OUTPUT && (p) < this->port_count)
 #define CHECK_IN_PORT(this,d,p)		((d) == SPA_DIRECTION_INPUT && (p) == 0)
 #define CHECK_PORT(this,d,p)		(CHECK_OUT_PORT(this,d,p) || CHECK_IN_PORT (this,d,p))
@@ -388,11 +391,13 @@ static int port_enum_formats(void *object,
 				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
 				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
 				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
-				SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(18,
+				SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(20,
 							SPA_AUDIO_FORMAT_F32,
 							SPA_AUDIO_FORMAT_F32P,
 							SPA_AUDIO_FORMAT_F32,
 							SPA_AUDIO_FORMAT_F32_OE,
+							SPA_AUDIO_FORMAT_F64P,
+							SPA_AUDIO_FORMAT_F64,
 							SPA_AUDIO_FORMAT_S32P,
 							SPA_AUDIO_FORMAT_S32,
 							SPA_AUDIO_FORMAT_S32_OE,
@@ -582,6 +587,9 @@ static int calc_width(struct spa_audio_info *info)
 	case SPA_AUDIO_FORMAT_S24:
 	case SPA_AUDIO_FORMAT_S24_OE:
 		return 3;
+	case SPA_AUDIO_FORMAT_F64P:
+	case SPA_AUDIO_FORMAT_F64:
+		return 8;
 	default:
 		return 4;
 	}
@@ -880,7 +888,7 @@ static int impl_node_process(void *object)
 			outio->status = -EPIPE;
           empty:
 			spa_log_trace_fp(this->log, NAME" %p: %d skip output", this, i);
-			dst_datas[n_dst_datas++] = SPA_PTR_ALIGN(this->empty, MAX_ALIGN, void);
+			dst_datas[n_dst_datas++] = scratch;
 			continue;
 		}
 
@@ -904,7 +912,7 @@ static int impl_node_process(void *object)
 	}
 	while (n_dst_datas < this->port_count) {
 		spa_log_trace_fp(this->log, NAME" %p: %d fill output", this, n_dst_datas);
-		dst_datas[n_dst_datas++] = SPA_PTR_ALIGN(this->empty, MAX_ALIGN, void);
+		dst_datas[n_dst_datas++] = scratch;
 	}
 
 	spa_log_trace_fp(this->log, NAME " %p: n_src:%d n_dst:%d n_samples:%d max:%d stride:%d p:%d", this,
@@ -118,6 +118,53 @@ static void test_7p1_N(void)
 	test_mix(8, _M(FL)|_M(FR)|_M(LFE)|_M(FC)|_M(SL)|_M(SR)|_M(RL)|_M(RR), 2, _M(FL)|_M(FR), (float[]) { 0.5, 0.5 });
 }
 
+static void test_volume_ramp(void)
+{
+	struct channelmix mix;
+	float in[2][300], out[2][300], volumes[2] = { 1.0f, 1.0f };
+	const void *src[2] = { in[0], in[1] };
+	void *dst[2] = { out[0], out[1] };
+	uint32_t i;
+
+	spa_zero(mix);
+	mix.src_chan = 2;
+	mix.dst_chan = 2;
+	mix.src_mask = _M(FL)|_M(FR);
+	mix.dst_mask = _M(FL)|_M(FR);
+	mix.log = &logger.log;
+
+	spa_assert(channelmix_init(&mix) == 0);
+	channelmix_set_volume(&mix, 1.0f, false, 2, volumes, 0);
+	spa_assert(!channelmix_is_ramping(&mix));
+
+	for (i = 0; i < 300; i++)
+		in[0][i] = in[1][i] = 1.0f;
+
+	/* fade out over 200 samples, in two blocks */
+	channelmix_set_volume(&mix, 0.0f, false, 2, volumes, 200);
+	spa_assert(channelmix_is_ramping(&mix));
+
+	channelmix_process(&mix, 2, dst, 2, src, 100);
+	spa_assert(channelmix_is_ramping(&mix));
+	for (i = 0; i < 100; i++) {
+		spa_assert(fabsf(out[0][i] - (1.0f - (i + 1) / 200.0f)) < 1e-6f);
+		spa_assert(out[0][i] == out[1][i]);
+	}
+	channelmix_process(&mix, 2, dst, 2, src, 300);
+	spa_assert(!channelmix_is_ramping(&mix));
+	for (i = 0; i < 100; i++)
+		spa_assert(fabsf(out[0][i] - (0.5f - (i + 1) / 200.0f)) < 1e-6f);
+	for (i = 100; i < 300; i++)
+		spa_assert(out[0][i] == 0.0f && out[1][i] == 0.0f);
+
+	/* a new ramp starts from the current position of the old one */
+	channelmix_set_volume(&mix, 1.0f, false, 2, volumes, 100);
+	channelmix_process(&mix, 2, dst, 2, src, 50);
+	channelmix_set_volume(&mix, 0.0f, false, 2, volumes, 100);
+	channelmix_process(&mix, 2, dst, 2, src, 1);
+	spa_assert(fabsf(out[0][0] - 0.495f) < 1e-6f);
+}
+
 int main(int argc, char *argv[])
 {
 	logger.log.level = SPA_LOG_LEVEL_TRACE;
@@ -128,6 +175,7 @@ int main(int argc, char *argv[])
 	test_4_N();
 	test_5p1_N();
 	test_7p1_N();
+	test_volume_ramp();
 
 	return 0;
 }
@@ -36,10 +36,11 @@
 #define N_SAMPLES	253
 #define N_CHANNELS	11
 
-static uint8_t samp_in[N_SAMPLES * 4];
-static uint8_t samp_out[N_SAMPLES * 4];
-static uint8_t temp_in[N_SAMPLES * N_CHANNELS * 4];
-static uint8_t temp_out[N_SAMPLES * N_CHANNELS * 4];
+/* aligned so that the SIMD functions take their vector loops */
+static uint8_t samp_in[N_SAMPLES * 8] SPA_ALIGNED(32);
+static uint8_t samp_out[N_SAMPLES * 8] SPA_ALIGNED(32);
+static uint8_t temp_in[N_SAMPLES * N_CHANNELS * 8] SPA_ALIGNED(32);
+static uint8_t temp_out[N_SAMPLES * N_CHANNELS * 8] SPA_ALIGNED(32);
 
 static void run_test(const char *name,
 		const void *in, size_t in_size, const void *out, size_t out_size, size_t n_samples,
@@ -76,6 +77,11 @@ static void run_test(const char *name,
 		case 4:
 			conv_interleave_32_c(&conv, tp, ip, N_SAMPLES);
 			break;
+		case 8:
+			for (i = 0; i < N_SAMPLES; i++)
+				for (j = 0; j < N_CHANNELS; j++)
+					memcpy(&temp_in[(i * N_CHANNELS + j) * 8], &samp_in[i * 8], 8);
+			break;
 		default:
 			fprintf(stderr, "unknown size %zd\n", in_size);
 			return;
@@ -260,6 +266,224 @@ static void test_s24_32_f32(void)
 			false, false, conv_s24_32d_to_f32d_c);
 }
 
+static void test_f64_f32(void)
+{
+	const double in[] = { 0.0, 1.0, -1.0, 0.5, -0.5, 0.25, -0.25 };
+	const float out[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 0.25f, -0.25f };
+
+	run_test("test_f64_f32", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_f64_to_f32_c);
+	run_test("test_f64d_f32", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f64d_to_f32_c);
+	run_test("test_f64_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_f64_to_f32d_c);
+	run_test("test_f64d_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, false, conv_f64d_to_f32d_c);
+#if defined(HAVE_SSE2)
+	run_test("test_f64_f32d_sse2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_f64_to_f32d_sse2);
+	run_test("test_f64d_f32d_sse2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, false, conv_f64d_to_f32d_sse2);
+#endif
+}
+
+static void test_f32_f64(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 0.25f, -0.25f };
+	const double out[] = { 0.0, 1.0, -1.0, 0.5, -0.5, 0.25, -0.25 };
+
+	run_test("test_f32_f64", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_f32_to_f64_c);
+	run_test("test_f32d_f64", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_f64_c);
+	run_test("test_f32_f64d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_f32_to_f64d_c);
+	run_test("test_f32d_f64d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, false, conv_f32d_to_f64d_c);
+#if defined(HAVE_SSE2)
+	run_test("test_f32d_f64_sse2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_f64_sse2);
+	run_test("test_f32d_f64d_sse2", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, false, conv_f32d_to_f64d_sse2);
+#endif
+}
+
+static void test_f32_s16s(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
+	const uint16_t out[] = { 0, 0xff7f, 0x0180, 0xff3f, 0x01c0, 0xff7f, 0x0180 };
+
+	run_test("test_f32_s16s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_f32_to_s16s_c);
+	run_test("test_f32d_s16s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s16s_c);
+#if defined(HAVE_SSSE3)
+	{
+		/* the SIMD version rounds, only use values that don't need it */
+		const float rin[] = { 0.0f, 1.0f, -1.0f, 1.1f, -1.1f };
+		const uint16_t rout[] = { 0, 0xff7f, 0x0180, 0xff7f, 0x0180 };
+
+		run_test("test_f32d_s16s_ssse3", rin, sizeof(rin[0]), rout, sizeof(rout[0]),
+				SPA_N_ELEMENTS(rout), false, true, conv_f32d_to_s16s_ssse3);
+	}
+#endif
+}
+
+static void test_s16s_f32(void)
+{
+	const uint16_t in[] = { 0, 0xff7f, 0x0180, 0xff3f, 0x01c0, };
+	const float out[] = { 0.0f, 1.0f, -1.0f, 0.4999847412f, -0.4999847412f };
+
+	run_test("test_s16s_f32", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_s16s_to_f32_c);
+	run_test("test_s16s_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s16s_to_f32d_c);
+#if defined(HAVE_SSSE3)
+	run_test("test_s16s_f32d_ssse3", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s16s_to_f32d_ssse3);
+#endif
+}
+
+static void test_f32_s32s(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
+	const uint32_t out[] = { 0, 0x00ffff7f, 0x00010080, 0x00ffff3f, 0x000100c0,
+					0x00ffff7f, 0x00010080 };
+
+	run_test("test_f32_s32s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_f32_to_s32s_c);
+	run_test("test_f32d_s32s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_s32s_c);
+}
+
+static void test_s32s_f32(void)
+{
+	const uint32_t in[] = { 0, 0x00ffff7f, 0x00010080, 0x00ffff3f, 0x000100c0 };
+	const float out[] = { 0.0f, 1.0f, -1.0f, 0.4999999404f, -0.4999999404f, };
+
+	run_test("test_s32s_f32", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_s32s_to_f32_c);
+	run_test("test_s32s_f32d", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s32s_to_f32d_c);
+#if defined(HAVE_SSSE3)
+	run_test("test_s32s_f32d_ssse3", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s32s_to_f32d_ssse3);
+#endif
+}
+
+static void test_f32_s24s(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, 1.1f, -1.1f };
+	const uint8_t out[] = { 0x00, 0x00, 0x00, 0x7f, 0xff, 0xff, 0x80, 0x00, 0x01,
+		0x3f, 0xff, 0xff, 0xc0, 0x00, 0x01, 0x7f, 0xff, 0xff, 0x80, 0x00, 0x01 };
+
+	run_test("test_f32_s24s", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			true, true, conv_f32_to_s24s_c);
+	run_test("test_f32d_s24s", in, sizeof(in[0]), out, 3, SPA_N_ELEMENTS(in),
+			false, true, conv_f32d_to_s24s_c);
+}
+
+static void test_s24s_f32(void)
+{
+	const uint8_t in[] = { 0x00, 0x00, 0x00, 0x7f, 0xff, 0xff, 0x80, 0x00, 0x01,
+		0x3f, 0xff, 0xff, 0xc0, 0x00, 0x01,  };
+	const float out[] = { 0.0f, 1.0f, -1.0f, 0.4999999404f, -0.4999999404f, };
+
+	run_test("test_s24s_f32", in, 3, out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_s24s_to_f32_c);
+	run_test("test_s24s_f32d", in, 3, out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, false, conv_s24s_to_f32d_c);
+}
+
+static void test_f32_f32s(void)
+{
+	const float in[] = { 0.0f, 1.0f, -1.0f, 0.5f, -0.5f, };
+	const uint32_t out[] = { 0, 0x0000803f, 0x000080bf, 0x0000003f, 0x000000bf, };
+
+	run_test("test_f32_f32s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			true, true, conv_f32_to_f32s_c);
+	run_test("test_f32d_f32s", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_f32s_c);
+#if defined(HAVE_SSSE3)
+	run_test("test_f32d_f32s_ssse3", in, sizeof(in[0]), out, sizeof(out[0]), SPA_N_ELEMENTS(out),
+			false, true, conv_f32d_to_f32s_ssse3);
+#endif
+
+	run_test("test_f32s_f32", out, sizeof(out[0]), in, sizeof(in[0]), SPA_N_ELEMENTS(in),
+			true, true, conv_f32s_to_f32_c);
+	run_test("test_f32s_f32d", out, sizeof(out[0]), in, sizeof(in[0]), SPA_N_ELEMENTS(in),
+			true, false, conv_f32s_to_f32d_c);
+#if defined(HAVE_SSSE3)
+	run_test("test_f32s_f32d_ssse3", out, sizeof(out[0]), in, sizeof(in[0]), SPA_N_ELEMENTS(in),
+			true, false, conv_f32s_to_f32d_ssse3);
+#endif
+}
+
+#define MAX_CHANNELS	64
+
+static uint8_t tile_in[N_SAMPLES * MAX_CHANNELS * 4];
+static uint8_t tile_out[N_SAMPLES * MAX_CHANNELS * 4];
+static uint8_t tile_ref[N_SAMPLES * MAX_CHANNELS * 4];
+
+/* the SIMD versions must deinterleave like the C version and interleave
+ * back to the input */
+static void run_test_interleave(const char *name, uint32_t width, uint32_t n_channels,
+		convert_func_t deinterleave, convert_func_t interleave, convert_func_t ref)
+{
+	struct convert conv;
+	const void *ip[MAX_CHANNELS];
+	void *op[MAX_CHANNELS], *rp[MAX_CHANNELS];
+	uint32_t i, stride = N_SAMPLES * width, size = stride * n_channels;
+
+	fprintf(stderr, "test %s %d channels:\n", name, n_channels);
+
+	spa_zero(conv);
+	conv.n_channels = n_channels;
+
+	for (i = 0; i < size; i++)
+		tile_in[i] = random();
+	for (i = 0; i < n_channels; i++) {
+		op[i] = &tile_out[i * stride];
+		rp[i] = &tile_ref[i * stride];
+	}
+	ip[0] = tile_in;
+	deinterleave(&conv, op, ip, N_SAMPLES);
+	ref(&conv, rp, ip, N_SAMPLES);
+	spa_assert(memcmp(tile_out, tile_ref, size) == 0);
+
+	for (i = 0; i < n_channels; i++)
+		ip[i] = &tile_ref[i * stride];
+	op[0] = tile_out;
+	memset(tile_out, 0, size);
+	interleave(&conv, op, ip, N_SAMPLES);
+	spa_assert(memcmp(tile_out, tile_in, size) == 0);
+}
+
+static void test_interleave(void)
+{
+#if defined(HAVE_SSE2)
+	static const uint32_t channels[] = { 1, 2, 3, 6, 11, 12, 24 };
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(channels); i++)
+		run_test_interleave("interleave_32_sse2", 4, channels[i],
+				conv_deinterleave_32_sse2, conv_interleave_32_sse2,
+				conv_deinterleave_32_c);
+	run_test_interleave("interleave_32_64_sse2", 4, 64,
+			conv_deinterleave_32_64_sse2, conv_interleave_32_64_sse2,
+			conv_deinterleave_32_c);
+#endif
+#if defined(HAVE_SSSE3)
+	for (i = 0; i < SPA_N_ELEMENTS(channels); i++)
+		run_test_interleave("interleave_24_ssse3", 3, channels[i],
+				conv_deinterleave_24_ssse3, conv_interleave_24_ssse3,
+				conv_deinterleave_24_c);
+	run_test_interleave("interleave_24_ssse3", 3, 64,
+			conv_deinterleave_24_ssse3, conv_interleave_24_ssse3,
+			conv_deinterleave_24_c);
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -273,5 +497,15 @@ int main(int argc, char *argv[])
 	test_s24_f32();
 	test_f32_s24_32();
 	test_s24_32_f32();
+	test_f64_f32();
+	test_f32_f64();
+	test_f32_s16s();
+	test_s16s_f32();
+	test_f32_s32s();
+	test_s32s_f32();
+	test_f32_s24s();
+	test_s24s_f32();
+	test_f32_f32s();
+	test_interleave();
 	return 0;
 }
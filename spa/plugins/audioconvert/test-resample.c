@@ -36,6 +36,7 @@ SPA_LOG_IMPL(logger);
 
 #include "resample.h"
 #include "resample-native.h"
+#include "resample-peaks.h"
 
 #define N_SAMPLES	253
 #define N_CHANNELS	11
@@ -69,6 +70,7 @@ static void test_native(void)
 
 	spa_zero(r);
 	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
 	r.channels = 1;
 	r.i_rate = 44100;
 	r.o_rate = 44100;
@@ -78,6 +80,7 @@ static void test_native(void)
 
 	spa_zero(r);
 	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
 	r.channels = 1;
 	r.i_rate = 44100;
 	r.o_rate = 48000;
@@ -89,7 +92,7 @@ static void test_native(void)
 static void pull_blocks(struct resample *r, uint32_t size)
 {
 	uint32_t i;
-	float in[size];
+	float in[size * 2];
 	float out[size];
 	const void *src[1];
 	void *dst[1];
@@ -120,6 +123,7 @@ static void test_in_len(void)
 
 	spa_zero(r);
 	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
 	r.channels = 1;
 	r.i_rate = 32000;
 	r.o_rate = 48000;
@@ -129,6 +133,7 @@ static void test_in_len(void)
 
 	spa_zero(r);
 	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
 	r.channels = 1;
 	r.i_rate = 44100;
 	r.o_rate = 48000;
@@ -138,6 +143,7 @@ static void test_in_len(void)
 
 	spa_zero(r);
 	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
 	r.channels = 1;
 	r.i_rate = 48000;
 	r.o_rate = 44100;
@@ -146,12 +152,125 @@ static void test_in_len(void)
 	pull_blocks(&r, 1024);
 }
 
+static void test_in_len_drift(void)
+{
+	struct resample r;
+	static const double rates[] = { 1.001, 0.999, 1.0000123, 0.9999877, 1.0 };
+	uint32_t i;
+
+	spa_zero(r);
+	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
+	r.channels = 1;
+	r.i_rate = 48000;
+	r.o_rate = 48000;
+	impl_native_init(&r);
+
+	for (i = 0; i < SPA_N_ELEMENTS(rates); i++) {
+		resample_update_rate(&r, rates[i]);
+		pull_blocks(&r, 1024);
+	}
+
+	spa_zero(r);
+	r.log = &logger.log;
+	r.quality = RESAMPLE_DEFAULT_QUALITY;
+	r.channels = 1;
+	r.i_rate = 44100;
+	r.o_rate = 48000;
+	impl_native_init(&r);
+
+	for (i = 0; i < SPA_N_ELEMENTS(rates); i++) {
+		resample_update_rate(&r, rates[i]);
+		pull_blocks(&r, 1024);
+	}
+}
+
+static void test_shared_filter(void)
+{
+	struct resample r1, r2, r3;
+	struct native_data *d1, *d2, *d3;
+	int ref;
+
+	spa_zero(r1);
+	r1.log = &logger.log;
+	r1.quality = RESAMPLE_DEFAULT_QUALITY;
+	r1.channels = 2;
+	r1.i_rate = 44100;
+	r1.o_rate = 48000;
+	spa_assert(impl_native_init(&r1) == 0);
+
+	spa_zero(r2);
+	r2.log = &logger.log;
+	r2.quality = RESAMPLE_DEFAULT_QUALITY;
+	r2.channels = 6;
+	r2.i_rate = 44100;
+	r2.o_rate = 48000;
+	spa_assert(impl_native_init(&r2) == 0);
+
+	spa_zero(r3);
+	r3.log = &logger.log;
+	r3.quality = RESAMPLE_DEFAULT_QUALITY;
+	r3.channels = 2;
+	r3.i_rate = 48000;
+	r3.o_rate = 44100;
+	spa_assert(impl_native_init(&r3) == 0);
+
+	d1 = r1.data;
+	d2 = r2.data;
+	d3 = r3.data;
+	spa_assert(d1->bank == d2->bank);
+	spa_assert(d1->filter == d2->filter);
+	spa_assert(d1->bank != d3->bank);
+	spa_assert(d1->bank->ref >= 2);
+	ref = d1->bank->ref;
+
+	resample_free(&r1);
+	spa_assert(d2->bank->ref == ref - 1);
+	resample_free(&r2);
+	resample_free(&r3);
+}
+
+static void test_peaks(void)
+{
+	struct resample r;
+	float in[2][480], out[2][16];
+	const void *src[2] = { in[0], in[1] };
+	void *dst[2] = { out[0], out[1] };
+	uint32_t i, in_len, out_len;
+
+	spa_zero(r);
+	r.log = &logger.log;
+	r.channels = 2;
+	r.i_rate = 48000;
+	r.o_rate = 1000;
+	spa_assert(impl_peaks_init(&r) == 0);
+
+	for (i = 0; i < 480; i++) {
+		in[0][i] = (i % 48) / 100.0f;
+		in[1][i] = -(float)i / 1000.0f;
+	}
+	in_len = 480;
+	out_len = 16;
+	resample_process(&r, src, &in_len, dst, &out_len);
+
+	spa_assert(in_len == 480);
+	spa_assert(out_len == 10);
+	for (i = 0; i < out_len; i++) {
+		spa_assert(out[0][i] == 0.47f);
+		spa_assert(out[1][i] == (i * 48 + 47) / 1000.0f);
+	}
+	resample_free(&r);
+}
+
 int main(int argc, char *argv[])
 {
 	logger.log.level = SPA_LOG_LEVEL_TRACE;
 
 	test_native();
 	test_in_len();
+	test_in_len_drift();
+	test_shared_filter();
+	test_peaks();
 
 	return 0;
 }
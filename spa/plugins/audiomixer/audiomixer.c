@@ -626,7 +626,7 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return -ENOTSUP;
 }
 
-static inline void
+static inline bool
 add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, int layer)
 {
 	size_t insize;
@@ -638,6 +638,7 @@ add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, i
 	bool mute = *port->io_mute;
 	const void *s0[2], *s1[2];
 	uint32_t n_src;
+	bool mixed;
 
 	b = spa_list_first(&port->queue, struct buffer, link);
 
@@ -665,13 +666,16 @@ add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, i
 	s1[n_src] = data;
 	n_src++;
 
-	if (volume < 0.001 || mute) {
+	if (volume < 0.001 || mute ||
+	    SPA_FLAG_IS_SET(d[0].chunk->flags, SPA_CHUNK_FLAG_EMPTY)) {
 		/* silence, do nothing */
+		mixed = false;
 	}
 	else {
 		mix_ops_process(&this->ops, out, s0, n_src, len1);
 		if (len2 > 0)
 			mix_ops_process(&this->ops, SPA_MEMBER(out, len1, void), s1, n_src, len2);
+		mixed = true;
 	}
 	port->queued_bytes -= outsize;
 
@@ -685,6 +689,7 @@ add_port_data(struct impl *this, void *out, size_t outsize, struct port *port, i
 		spa_log_trace(this->log, NAME " %p: keeping buffer %d on port %d %zd %zd",
 			      this, b->id, port->id, port->queued_bytes, outsize);
 	}
+	return mixed;
 }
 
 static int mix_output(struct impl *this, size_t n_bytes)
@@ -724,6 +729,7 @@ static int mix_output(struct impl *this, size_t n_bytes)
 
 	for (layer = 0, i = 0; i < this->last_port; i++) {
 		struct port *in_port = GET_IN_PORT(this, i);
+		bool mixed;
 
 		if (in_port->io == NULL || in_port->n_buffers == 0)
 			continue;
@@ -733,15 +739,20 @@ static int mix_output(struct impl *this, size_t n_bytes)
 			continue;
 		}
 
-		add_port_data(this, SPA_MEMBER(od[0].data, offset, void), len1, in_port, layer);
+		mixed = add_port_data(this, SPA_MEMBER(od[0].data, offset, void), len1, in_port, layer);
 		if (len2 > 0)
-			add_port_data(this, od[0].data, len2, in_port, layer);
-		layer++;
+			mixed |= add_port_data(this, od[0].data, len2, in_port, layer);
+		if (mixed)
+			layer++;
 	}
 
+	if (layer == 0)
+		memset(SPA_MEMBER(od[0].data, offset, void), 0, n_bytes);
+
 	od[0].chunk->offset = index;
 	od[0].chunk->size = n_bytes;
 	od[0].chunk->stride = 0;
+	od[0].chunk->flags = layer == 0 ? SPA_CHUNK_FLAG_EMPTY : 0;
 
 	outio->buffer_id = outbuf->id;
 	outio->status = SPA_STATUS_HAVE_DATA;
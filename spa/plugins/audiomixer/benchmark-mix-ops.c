@@ -0,0 +1,164 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "benchmark.h"
+
+#include "mix-ops.c"
+
+#define MAX_SAMPLES	8192
+#define MAX_SOURCES	8
+
+#define MAX_COUNT 1000
+
+static double samp_in[MAX_SAMPLES * MAX_SOURCES];
+static double samp_out[MAX_SAMPLES];
+
+static const int sample_sizes[] = { 0, 1, 128, 513, 4096, 8192 };
+static const int source_counts[] = { 1, 2, 4, 8 };
+
+struct format {
+	const char *name;
+	uint32_t fmt;
+};
+
+static const struct format formats[] = {
+	{ "mix_f32", SPA_AUDIO_FORMAT_F32 },
+	{ "mix_f64", SPA_AUDIO_FORMAT_F64 },
+};
+
+struct variant {
+	const char *impl;
+	uint32_t cpu_flags;
+};
+
+static const struct variant variants[] = {
+	{ "c", 0 },
+#if defined (HAVE_SSE)
+	{ "sse", SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_SSE2)
+	{ "sse2", SPA_CPU_FLAG_SSE2 },
+#endif
+#if defined (HAVE_AVX) && defined (HAVE_FMA)
+	{ "avx", SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3 },
+#endif
+#if defined (HAVE_AVX512)
+	{ "avx512", SPA_CPU_FLAG_AVX512 },
+#endif
+#if defined (HAVE_NEON)
+	{ "neon", SPA_CPU_FLAG_NEON },
+#endif
+};
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(source_counts) * \
+				SPA_N_ELEMENTS(formats) * SPA_N_ELEMENTS(variants) * 2
+
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("mix-ops", results);
+
+static void run_test1(const char *name, const char *impl, struct mix_ops *ops,
+		bool gain, uint32_t n_src, int n_samples)
+{
+	uint32_t i, j;
+	const void *ip[MAX_SOURCES];
+	float gains[MAX_SOURCES];
+	uint64_t count, t1, t2;
+
+	for (j = 0; j < n_src; j++) {
+		ip[j] = &samp_in[j * MAX_SAMPLES];
+		gains[j] = 0.5f;
+	}
+
+	t1 = bench_now();
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		if (gain)
+			mix_ops_process_gain(ops, samp_out, ip, gains, n_src, n_samples);
+		else
+			mix_ops_process(ops, samp_out, ip, n_src, n_samples);
+		count++;
+	}
+	t2 = bench_now();
+
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = impl,
+		.n_samples = n_samples,
+		.n_channels = 1,
+		.n_params = 2,
+		.params = {
+			{ "sources", n_src },
+			{ "gain", gain },
+		},
+		.count = count,
+		.nsec = t2 - t1,
+	});
+}
+
+static void run_format(const struct format *f, const struct variant *v)
+{
+	struct mix_ops ops;
+	uint32_t i, j, g;
+
+	spa_zero(ops);
+	ops.fmt = f->fmt;
+	ops.n_channels = 1;
+	ops.cpu_flags = v->cpu_flags;
+	if (mix_ops_init(&ops) < 0)
+		return;
+	/* no specialized function for these flags, the C version
+	 * is measured separately */
+	if (v->cpu_flags != 0 && ops.cpu_flags == 0) {
+		mix_ops_free(&ops);
+		return;
+	}
+
+	for (g = 0; g < 2; g++)
+		for (i = 0; i < SPA_N_ELEMENTS(source_counts); i++)
+			for (j = 0; j < SPA_N_ELEMENTS(sample_sizes); j++)
+				run_test1(f->name, v->impl, &ops, g, source_counts[i],
+						sample_sizes[j]);
+
+	mix_ops_free(&ops);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+		for (j = 0; j < SPA_N_ELEMENTS(variants); j++)
+			run_format(&formats[i], &variants[j]);
+
+	bench_report(&bench);
+
+	return 0;
+}
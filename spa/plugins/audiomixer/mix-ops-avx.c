@@ -133,3 +133,67 @@ mix_f32_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTR
 	for (; i < n_src; i++)
 		mix_2(dst, src[i], n_samples);
 }
+
+void
+mix_gain_f32_avx(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~31;
+	float *d = dst;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+
+	/* accumulate all sources in registers, dst is written once. Odd and
+	 * even sources go to separate accumulators to halve the length of
+	 * the FMA dependency chain. */
+	for (n = 0; n < unrolled; n += 32) {
+		__m256 g, g2, acc[4], acc2[4];
+		const float *s = src[0], *s2;
+
+		g = _mm256_set1_ps(gain[0]);
+		acc[0] = _mm256_mul_ps(_mm256_loadu_ps(&s[n +  0]), g);
+		acc[1] = _mm256_mul_ps(_mm256_loadu_ps(&s[n +  8]), g);
+		acc[2] = _mm256_mul_ps(_mm256_loadu_ps(&s[n + 16]), g);
+		acc[3] = _mm256_mul_ps(_mm256_loadu_ps(&s[n + 24]), g);
+		acc2[0] = acc2[1] = acc2[2] = acc2[3] = _mm256_setzero_ps();
+
+		for (i = 1; i + 1 < n_src; i += 2) {
+			s = src[i];
+			s2 = src[i + 1];
+			g = _mm256_set1_ps(gain[i]);
+			g2 = _mm256_set1_ps(gain[i + 1]);
+			acc[0] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n +  0]), g, acc[0]);
+			acc[1] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n +  8]), g, acc[1]);
+			acc[2] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n + 16]), g, acc[2]);
+			acc[3] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n + 24]), g, acc[3]);
+			acc2[0] = _mm256_fmadd_ps(_mm256_loadu_ps(&s2[n +  0]), g2, acc2[0]);
+			acc2[1] = _mm256_fmadd_ps(_mm256_loadu_ps(&s2[n +  8]), g2, acc2[1]);
+			acc2[2] = _mm256_fmadd_ps(_mm256_loadu_ps(&s2[n + 16]), g2, acc2[2]);
+			acc2[3] = _mm256_fmadd_ps(_mm256_loadu_ps(&s2[n + 24]), g2, acc2[3]);
+		}
+		if (i < n_src) {
+			s = src[i];
+			g = _mm256_set1_ps(gain[i]);
+			acc[0] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n +  0]), g, acc[0]);
+			acc[1] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n +  8]), g, acc[1]);
+			acc[2] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n + 16]), g, acc[2]);
+			acc[3] = _mm256_fmadd_ps(_mm256_loadu_ps(&s[n + 24]), g, acc[3]);
+		}
+		_mm256_storeu_ps(&d[n +  0], _mm256_add_ps(acc[0], acc2[0]));
+		_mm256_storeu_ps(&d[n +  8], _mm256_add_ps(acc[1], acc2[1]));
+		_mm256_storeu_ps(&d[n + 16], _mm256_add_ps(acc[2], acc2[2]));
+		_mm256_storeu_ps(&d[n + 24], _mm256_add_ps(acc[3], acc2[3]));
+	}
+	for (; n < n_samples; n++) {
+		const float *s = src[0];
+		__m128 acc = _mm_mul_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[0]));
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc = _mm_fmadd_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[i]), acc);
+		}
+		_mm_store_ss(&d[n], acc);
+	}
+}
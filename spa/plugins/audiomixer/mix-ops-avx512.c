@@ -0,0 +1,132 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#include <immintrin.h>
+
+void
+mix_f32_avx512(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~31, remain = n_samples & 15;
+	float *d = dst;
+	__mmask16 mask = (1u << remain) - 1;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+
+	/* accumulate all sources in registers, dst is written once */
+	for (n = 0; n < unrolled; n += 32) {
+		const float *s = src[0];
+		__m512 acc[2];
+
+		acc[0] = _mm512_loadu_ps(&s[n +  0]);
+		acc[1] = _mm512_loadu_ps(&s[n + 16]);
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc[0] = _mm512_add_ps(acc[0], _mm512_loadu_ps(&s[n +  0]));
+			acc[1] = _mm512_add_ps(acc[1], _mm512_loadu_ps(&s[n + 16]));
+		}
+		_mm512_storeu_ps(&d[n +  0], acc[0]);
+		_mm512_storeu_ps(&d[n + 16], acc[1]);
+	}
+	for (; n < n_samples; n += 16) {
+		__mmask16 m = n + 16 <= n_samples ? 0xffff : mask;
+		const float *s = src[0];
+		__m512 acc;
+
+		acc = _mm512_maskz_loadu_ps(m, &s[n]);
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(m, &s[n]));
+		}
+		_mm512_mask_storeu_ps(&d[n], m, acc);
+	}
+}
+
+void
+mix_gain_f32_avx512(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~31, remain = n_samples & 15;
+	float *d = dst;
+	__mmask16 mask = (1u << remain) - 1;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+
+	/* odd and even sources use separate accumulators to shorten the
+	 * FMA dependency chain */
+	for (n = 0; n < unrolled; n += 32) {
+		const float *s = src[0], *s2;
+		__m512 g, g2, acc[2], acc2[2];
+
+		g = _mm512_set1_ps(gain[0]);
+		acc[0] = _mm512_mul_ps(_mm512_loadu_ps(&s[n +  0]), g);
+		acc[1] = _mm512_mul_ps(_mm512_loadu_ps(&s[n + 16]), g);
+		acc2[0] = acc2[1] = _mm512_setzero_ps();
+		for (i = 1; i + 1 < n_src; i += 2) {
+			s = src[i];
+			s2 = src[i + 1];
+			g = _mm512_set1_ps(gain[i]);
+			g2 = _mm512_set1_ps(gain[i + 1]);
+			acc[0] = _mm512_fmadd_ps(_mm512_loadu_ps(&s[n +  0]), g, acc[0]);
+			acc[1] = _mm512_fmadd_ps(_mm512_loadu_ps(&s[n + 16]), g, acc[1]);
+			acc2[0] = _mm512_fmadd_ps(_mm512_loadu_ps(&s2[n +  0]), g2, acc2[0]);
+			acc2[1] = _mm512_fmadd_ps(_mm512_loadu_ps(&s2[n + 16]), g2, acc2[1]);
+		}
+		if (i < n_src) {
+			s = src[i];
+			g = _mm512_set1_ps(gain[i]);
+			acc[0] = _mm512_fmadd_ps(_mm512_loadu_ps(&s[n +  0]), g, acc[0]);
+			acc[1] = _mm512_fmadd_ps(_mm512_loadu_ps(&s[n + 16]), g, acc[1]);
+		}
+		_mm512_storeu_ps(&d[n +  0], _mm512_add_ps(acc[0], acc2[0]));
+		_mm512_storeu_ps(&d[n + 16], _mm512_add_ps(acc[1], acc2[1]));
+	}
+	for (; n < n_samples; n += 16) {
+		__mmask16 m = n + 16 <= n_samples ? 0xffff : mask;
+		const float *s = src[0];
+		__m512 acc;
+
+		acc = _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &s[n]), _mm512_set1_ps(gain[0]));
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, &s[n]),
+					_mm512_set1_ps(gain[i]), acc);
+		}
+		_mm512_mask_storeu_ps(&d[n], m, acc);
+	}
+}
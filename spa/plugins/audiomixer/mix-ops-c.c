@@ -67,3 +67,49 @@ mix_f64_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRIC
 			d[n] += s[n];
 	}
 }
+
+void
+mix_gain_f32_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n;
+	float *d = dst;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+	for (n = 0; n < n_samples; n++) {
+		const float *s = src[0];
+		d[n] = s[n] * gain[0];
+	}
+	for (i = 1; i < n_src; i++) {
+		const float *s = src[i];
+		const float g = gain[i];
+		for (n = 0; n < n_samples; n++)
+			d[n] += s[n] * g;
+	}
+}
+
+void
+mix_gain_f64_c(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n;
+	double *d = dst;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(double));
+		return;
+	}
+	for (n = 0; n < n_samples; n++) {
+		const double *s = src[0];
+		d[n] = s[n] * gain[0];
+	}
+	for (i = 1; i < n_src; i++) {
+		const double *s = src[i];
+		const double g = gain[i];
+		for (n = 0; n < n_samples; n++)
+			d[n] += s[n] * g;
+	}
+}
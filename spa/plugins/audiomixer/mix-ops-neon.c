@@ -0,0 +1,121 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "mix-ops.h"
+
+#include <arm_neon.h>
+
+static inline void mix_2(float * dst, const float * SPA_RESTRICT src, uint32_t n_samples)
+{
+	uint32_t n, unrolled = n_samples & ~15;
+	float32x4_t in1[4], in2[4];
+
+	for (n = 0; n < unrolled; n += 16) {
+		in1[0] = vld1q_f32(&dst[n+ 0]);
+		in1[1] = vld1q_f32(&dst[n+ 4]);
+		in1[2] = vld1q_f32(&dst[n+ 8]);
+		in1[3] = vld1q_f32(&dst[n+12]);
+
+		in2[0] = vld1q_f32(&src[n+ 0]);
+		in2[1] = vld1q_f32(&src[n+ 4]);
+		in2[2] = vld1q_f32(&src[n+ 8]);
+		in2[3] = vld1q_f32(&src[n+12]);
+
+		vst1q_f32(&dst[n+ 0], vaddq_f32(in1[0], in2[0]));
+		vst1q_f32(&dst[n+ 4], vaddq_f32(in1[1], in2[1]));
+		vst1q_f32(&dst[n+ 8], vaddq_f32(in1[2], in2[2]));
+		vst1q_f32(&dst[n+12], vaddq_f32(in1[3], in2[3]));
+	}
+	for (; n < n_samples; n++)
+		dst[n] += src[n];
+}
+
+void
+mix_f32_neon(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i;
+
+	if (n_src == 0)
+		memset(dst, 0, n_samples * sizeof(float));
+	else if (dst != src[0])
+		memcpy(dst, src[0], n_samples * sizeof(float));
+
+	for (i = 1; i < n_src; i++) {
+		mix_2(dst, src[i], n_samples);
+	}
+}
+
+void
+mix_gain_f32_neon(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~15;
+	float *d = dst;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+
+	/* accumulate all sources in registers, dst is written once */
+	for (n = 0; n < unrolled; n += 16) {
+		float32x4_t acc[4];
+		const float *s = src[0];
+		float g = gain[0];
+
+		acc[0] = vmulq_n_f32(vld1q_f32(&s[n+ 0]), g);
+		acc[1] = vmulq_n_f32(vld1q_f32(&s[n+ 4]), g);
+		acc[2] = vmulq_n_f32(vld1q_f32(&s[n+ 8]), g);
+		acc[3] = vmulq_n_f32(vld1q_f32(&s[n+12]), g);
+
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			g = gain[i];
+			acc[0] = vmlaq_n_f32(acc[0], vld1q_f32(&s[n+ 0]), g);
+			acc[1] = vmlaq_n_f32(acc[1], vld1q_f32(&s[n+ 4]), g);
+			acc[2] = vmlaq_n_f32(acc[2], vld1q_f32(&s[n+ 8]), g);
+			acc[3] = vmlaq_n_f32(acc[3], vld1q_f32(&s[n+12]), g);
+		}
+		vst1q_f32(&d[n+ 0], acc[0]);
+		vst1q_f32(&d[n+ 4], acc[1]);
+		vst1q_f32(&d[n+ 8], acc[2]);
+		vst1q_f32(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		const float *s = src[0];
+		float acc = s[n] * gain[0];
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc += s[n] * gain[i];
+		}
+		d[n] = acc;
+	}
+}
@@ -87,3 +87,50 @@ mix_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTR
 		mix_2(dst, src[i], n_samples);
 	}
 }
+
+void
+mix_gain_f32_sse(struct mix_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
+		const float gain[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, n, unrolled = n_samples & ~15;
+	float *d = dst;
+
+	if (n_src == 0) {
+		memset(dst, 0, n_samples * sizeof(float));
+		return;
+	}
+
+	/* accumulate all sources in registers, dst is written once */
+	for (n = 0; n < unrolled; n += 16) {
+		__m128 g, acc[4];
+		const float *s = src[0];
+
+		g = _mm_set1_ps(gain[0]);
+		acc[0] = _mm_mul_ps(_mm_loadu_ps(&s[n+ 0]), g);
+		acc[1] = _mm_mul_ps(_mm_loadu_ps(&s[n+ 4]), g);
+		acc[2] = _mm_mul_ps(_mm_loadu_ps(&s[n+ 8]), g);
+		acc[3] = _mm_mul_ps(_mm_loadu_ps(&s[n+12]), g);
+
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			g = _mm_set1_ps(gain[i]);
+			acc[0] = _mm_add_ps(acc[0], _mm_mul_ps(_mm_loadu_ps(&s[n+ 0]), g));
+			acc[1] = _mm_add_ps(acc[1], _mm_mul_ps(_mm_loadu_ps(&s[n+ 4]), g));
+			acc[2] = _mm_add_ps(acc[2], _mm_mul_ps(_mm_loadu_ps(&s[n+ 8]), g));
+			acc[3] = _mm_add_ps(acc[3], _mm_mul_ps(_mm_loadu_ps(&s[n+12]), g));
+		}
+		_mm_storeu_ps(&d[n+ 0], acc[0]);
+		_mm_storeu_ps(&d[n+ 4], acc[1]);
+		_mm_storeu_ps(&d[n+ 8], acc[2]);
+		_mm_storeu_ps(&d[n+12], acc[3]);
+	}
+	for (; n < n_samples; n++) {
+		const float *s = src[0];
+		__m128 acc = _mm_mul_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[0]));
+		for (i = 1; i < n_src; i++) {
+			s = src[i];
+			acc = _mm_add_ss(acc, _mm_mul_ss(_mm_load_ss(&s[n]), _mm_set_ss(gain[i])));
+		}
+		_mm_store_ss(&d[n], acc);
+	}
+}
@@ -34,6 +34,9 @@
 
 typedef void (*mix_func_t) (struct mix_ops *ops, void * SPA_RESTRICT dst,
 		const void * SPA_RESTRICT src[], uint32_t n_src, uint32_t n_samples);
+typedef void (*mix_gain_func_t) (struct mix_ops *ops, void * SPA_RESTRICT dst,
+		const void * SPA_RESTRICT src[], const float gain[],
+		uint32_t n_src, uint32_t n_samples);
 
 struct mix_info {
 	uint32_t fmt;
@@ -41,32 +44,40 @@ struct mix_info {
 	uint32_t cpu_flags;
 	uint32_t stride;
 	mix_func_t process;
+	mix_gain_func_t process_gain;
 };
 
 static struct mix_info mix_table[] =
 {
 	/* f32 */
+#if defined(HAVE_AVX512)
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX512, 4, mix_f32_avx512, mix_gain_f32_avx512 },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX512, 4, mix_f32_avx512, mix_gain_f32_avx512 },
+#endif
 #if defined(HAVE_AVX)
-	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
-	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX, 4, mix_f32_avx },
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 4, mix_f32_avx, mix_gain_f32_avx },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_AVX | SPA_CPU_FLAG_FMA3, 4, mix_f32_avx, mix_gain_f32_avx },
 #endif
 #if defined (HAVE_SSE)
-	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
-	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse },
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse, mix_gain_f32_sse },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_SSE, 4, mix_f32_sse, mix_gain_f32_sse },
+#endif
+#if defined (HAVE_NEON)
+	{ SPA_AUDIO_FORMAT_F32, 1, SPA_CPU_FLAG_NEON, 4, mix_f32_neon, mix_gain_f32_neon },
+	{ SPA_AUDIO_FORMAT_F32P, 1, SPA_CPU_FLAG_NEON, 4, mix_f32_neon, mix_gain_f32_neon },
 #endif
-	{ SPA_AUDIO_FORMAT_F32, 1, 0, 4, mix_f32_c },
-	{ SPA_AUDIO_FORMAT_F32P, 1, 0, 4, mix_f32_c },
+	{ SPA_AUDIO_FORMAT_F32, 1, 0, 4, mix_f32_c, mix_gain_f32_c },
+	{ SPA_AUDIO_FORMAT_F32P, 1, 0, 4, mix_f32_c, mix_gain_f32_c },
 
 #if defined (HAVE_SSE2)
-	{ SPA_AUDIO_FORMAT_F64, 1, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2 },
-	{ SPA_AUDIO_FORMAT_F64P, 1, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2 },
+	{ SPA_AUDIO_FORMAT_F64, 1, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2, mix_gain_f64_c },
+	{ SPA_AUDIO_FORMAT_F64P, 1, SPA_CPU_FLAG_SSE2, 8, mix_f64_sse2, mix_gain_f64_c },
 #endif
-	{ SPA_AUDIO_FORMAT_F64, 1, 0, 8, mix_f64_c },
-	{ SPA_AUDIO_FORMAT_F64P, 1, 0, 8, mix_f64_c },
+	{ SPA_AUDIO_FORMAT_F64, 1, 0, 8, mix_f64_c, mix_gain_f64_c },
+	{ SPA_AUDIO_FORMAT_F64P, 1, 0, 8, mix_f64_c, mix_gain_f64_c },
 };
 
 #define MATCH_CHAN(a,b)		((a) == 0 || (a) == (b))
-#define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
 
 static const struct mix_info *find_mix_info(uint32_t fmt,
 		uint32_t n_channels, uint32_t cpu_flags)
@@ -76,7 +87,7 @@ static const struct mix_info *find_mix_info(uint32_t fmt,
 	for (i = 0; i < SPA_N_ELEMENTS(mix_table); i++) {
 		if (mix_table[i].fmt == fmt &&
 		    MATCH_CHAN(mix_table[i].n_channels, n_channels) &&
-		    MATCH_CPU_FLAGS(mix_table[i].cpu_flags, cpu_flags))
+		    SPA_CPU_FLAGS_MATCH(mix_table[i].cpu_flags, cpu_flags))
 			return &mix_table[i];
 	}
 	return NULL;
@@ -105,6 +116,7 @@ int mix_ops_init(struct mix_ops *ops)
 	ops->cpu_flags = info->cpu_flags;
 	ops->clear = impl_mix_ops_clear;
 	ops->process = info->process;
+	ops->process_gain = info->process_gain;
 	ops->free = impl_mix_ops_free;
 
 	return 0;
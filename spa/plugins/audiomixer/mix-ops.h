@@ -34,6 +34,10 @@ struct mix_ops {
 			void * SPA_RESTRICT dst,
 			const void * SPA_RESTRICT src[], uint32_t n_src,
 			uint32_t n_samples);
+	void (*process_gain) (struct mix_ops *ops,
+			void * SPA_RESTRICT dst,
+			const void * SPA_RESTRICT src[], const float gain[],
+			uint32_t n_src, uint32_t n_samples);
 	void (*free) (struct mix_ops *ops);
 
 	const void *priv;
@@ -43,6 +47,7 @@ int mix_ops_init(struct mix_ops *ops);
 
 #define mix_ops_clear(ops,...)		(ops)->clear(ops, __VA_ARGS__)
 #define mix_ops_process(ops,...)	(ops)->process(ops, __VA_ARGS__)
+#define mix_ops_process_gain(ops,...)	(ops)->process_gain(ops, __VA_ARGS__)
 #define mix_ops_free(ops)		(ops)->free(ops)
 
 #define DEFINE_FUNCTION(name,arch) \
@@ -50,15 +55,32 @@ void mix_##name##_##arch(struct mix_ops *ops, void * SPA_RESTRICT dst,	\
 		const void * SPA_RESTRICT src[], uint32_t n_src,		\
 		uint32_t n_samples)						\
 
+#define DEFINE_GAIN_FUNCTION(name,arch) \
+void mix_gain_##name##_##arch(struct mix_ops *ops, void * SPA_RESTRICT dst,	\
+		const void * SPA_RESTRICT src[], const float gain[],		\
+		uint32_t n_src, uint32_t n_samples)				\
+
 DEFINE_FUNCTION(f32, c);
 DEFINE_FUNCTION(f64, c);
+DEFINE_GAIN_FUNCTION(f32, c);
+DEFINE_GAIN_FUNCTION(f64, c);
 
 #if defined(HAVE_SSE)
 DEFINE_FUNCTION(f32, sse);
+DEFINE_GAIN_FUNCTION(f32, sse);
 #endif
 #if defined(HAVE_SSE2)
 DEFINE_FUNCTION(f64, sse2);
 #endif
 #if defined(HAVE_AVX)
 DEFINE_FUNCTION(f32, avx);
+DEFINE_GAIN_FUNCTION(f32, avx);
+#endif
+#if defined(HAVE_AVX512)
+DEFINE_FUNCTION(f32, avx512);
+DEFINE_GAIN_FUNCTION(f32, avx512);
+#endif
+#if defined(HAVE_NEON)
+DEFINE_FUNCTION(f32, neon);
+DEFINE_GAIN_FUNCTION(f32, neon);
 #endif
@@ -51,8 +51,8 @@
 #define PORT_DEFAULT_MUTE	false
 
 struct port_props {
-	double volume;
-	int32_t mute;
+	float volume;
+	bool mute;
 };
 
 static void port_props_reset(struct port_props *props)
@@ -255,8 +255,9 @@ static int impl_node_add_port(void *object, enum spa_direction direction, uint32
 	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
 	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
 	port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->params[5] = SPA_PARAM_INFO(SPA_PARAM_Props, SPA_PARAM_INFO_READWRITE);
 	port->info.params = port->params;
-	port->info.n_params = 5;
+	port->info.n_params = 6;
 
 	this->port_count++;
 	if (this->last_port <= port_id)
@@ -419,6 +420,22 @@ next:
 			return 0;
 		}
 		break;
+
+	case SPA_PARAM_Props:
+		if (direction != SPA_DIRECTION_INPUT)
+			return -ENOENT;
+
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_Props, id,
+				SPA_PROP_volume, SPA_POD_Float(port->props.volume),
+				SPA_PROP_mute,   SPA_POD_Bool(port->props.mute));
+			break;
+		default:
+			return 0;
+		}
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -553,11 +570,30 @@ impl_node_port_set_param(void *object,
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
 
-	if (id == SPA_PARAM_Format) {
+	switch (id) {
+	case SPA_PARAM_Format:
 		return port_set_format(this, direction, port_id, flags, param);
+	case SPA_PARAM_Props:
+	{
+		struct port *port;
+
+		if (direction != SPA_DIRECTION_INPUT)
+			return -ENOENT;
+
+		port = GET_IN_PORT(this, port_id);
+		if (param == NULL) {
+			port_props_reset(&port->props);
+			return 0;
+		}
+		spa_pod_parse_object(param,
+			SPA_TYPE_OBJECT_Props, NULL,
+			SPA_PROP_volume, SPA_POD_OPT_Float(&port->props.volume),
+			SPA_PROP_mute,   SPA_POD_OPT_Bool(&port->props.mute));
+		return 0;
 	}
-	else
+	default:
 		return -ENOENT;
+	}
 }
 
 static int
@@ -663,6 +699,8 @@ static int impl_node_process(void *object)
         struct buffer **buffers;
         struct buffer *outb;
 	const void **datas;
+	float *gains;
+	bool unity = true;
 
 	spa_return_val_if_fail(this != NULL, -EINVAL);
 
@@ -684,6 +722,7 @@ static int impl_node_process(void *object)
 
         buffers = alloca(MAX_PORTS * sizeof(struct buffer *));
         datas = alloca(MAX_PORTS * sizeof(void *));
+	gains = alloca(MAX_PORTS * sizeof(float));
         n_buffers = 0;
 
 	maxsize = MAX_SAMPLES * sizeof(float);
@@ -712,9 +751,17 @@ static int impl_node_process(void *object)
 		spa_log_trace_fp(this->log, NAME " %p: mix input %d %p->%p %d %d %d", this,
 				i, inio, outio, inio->status, inio->buffer_id, maxsize);
 
+		inio->status = SPA_STATUS_NEED_DATA;
+
+		if (inport->props.mute || inport->props.volume == 0.0f ||
+		    SPA_FLAG_IS_SET(inb->buffer->datas[0].chunk->flags, SPA_CHUNK_FLAG_EMPTY))
+			continue;
+		if (inport->props.volume != 1.0f)
+			unity = false;
+
+		gains[n_buffers] = inport->props.volume;
 		datas[n_buffers] = inb->buffer->datas[0].data;
 		buffers[n_buffers++] = inb;
-		inio->status = SPA_STATUS_NEED_DATA;
 	}
 
 	outb = dequeue_buffer(this, outport);
@@ -725,7 +772,7 @@ static int impl_node_process(void *object)
 
 	n_samples = maxsize / sizeof(float);
 
-	if (n_buffers == 1) {
+	if (n_buffers == 1 && unity) {
 		*outb->buffer = *buffers[0]->buffer;
 	}
 	else {
@@ -736,8 +783,14 @@ static int impl_node_process(void *object)
 		outb->datas[0].chunk->offset = 0;
 		outb->datas[0].chunk->size = n_samples * sizeof(float);
 		outb->datas[0].chunk->stride = sizeof(float);
-
-		mix_ops_process(&this->ops, outb->datas[0].data, datas, n_buffers, n_samples);
+		outb->datas[0].chunk->flags = n_buffers == 0 ? SPA_CHUNK_FLAG_EMPTY : 0;
+
+		if (unity)
+			mix_ops_process(&this->ops, outb->datas[0].data,
+					datas, n_buffers, n_samples);
+		else
+			mix_ops_process_gain(&this->ops, outb->datas[0].data,
+					datas, gains, n_buffers, n_samples);
 	}
 
 	outio->buffer_id = outb->id;
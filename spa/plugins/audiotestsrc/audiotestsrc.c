@@ -101,7 +101,7 @@ struct port {
 	struct spa_audio_info current_format;
 	size_t bpf;
 	render_func_t render_func;
-	float accumulator;
+	double accumulator;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -26,13 +26,16 @@
 
 #define M_PI_M2 ( M_PI + M_PI )
 
+/* The sine is made with a rotating phasor, so that sin() is only needed
+ * at the start of each block. The phase is recomputed from the accumulator
+ * for every block and the rounding errors don't build up. */
 #define DEFINE_SINE(type,scale)								\
 static void										\
 audio_test_src_create_sine_##type (struct impl *this, type *samples, size_t n_samples)	\
 {											\
 	size_t i;									\
 	uint32_t c, channels;								\
-	float step, amp;								\
+	double step, amp, s, co, ds, dc, t;						\
 	float freq = this->props.freq;							\
 	float volume = this->props.volume;						\
 											\
@@ -40,15 +43,44 @@ audio_test_src_create_sine_##type (struct impl *this, type *samples, size_t n_sa
 	step = M_PI_M2 * freq / this->port.current_format.info.raw.rate;		\
 	amp = volume * scale;								\
 											\
-	for (i = 0; i < n_samples; i++) {						\
-		type val;								\
-		this->port.accumulator += step;						\
-		if (this->port.accumulator >= M_PI_M2)					\
-			this->port.accumulator -= M_PI_M2;				\
-		val = (type) (sin (this->port.accumulator) * amp);			\
-		for (c = 0; c < channels; ++c)						\
-			*samples++ = val;						\
+	s = sin(this->port.accumulator);						\
+	co = cos(this->port.accumulator);						\
+	ds = sin(step);									\
+	dc = cos(step);									\
+											\
+	switch (channels) {								\
+	case 1:										\
+		for (i = 0; i < n_samples; i++) {					\
+			t = s * dc + co * ds;						\
+			co = co * dc - s * ds;						\
+			s = t;								\
+			*samples++ = (type) (s * amp);					\
+		}									\
+		break;									\
+	case 2:										\
+		for (i = 0; i < n_samples; i++) {					\
+			type val;							\
+			t = s * dc + co * ds;						\
+			co = co * dc - s * ds;						\
+			s = t;								\
+			val = (type) (s * amp);						\
+			samples[0] = samples[1] = val;					\
+			samples += 2;							\
+		}									\
+		break;									\
+	default:									\
+		for (i = 0; i < n_samples; i++) {					\
+			type val;							\
+			t = s * dc + co * ds;						\
+			co = co * dc - s * ds;						\
+			s = t;								\
+			val = (type) (s * amp);						\
+			for (c = 0; c < channels; ++c)					\
+				*samples++ = val;					\
+		}									\
+		break;									\
 	}										\
+	this->port.accumulator = fmod(this->port.accumulator + n_samples * step, M_PI_M2); \
 }
 
 DEFINE_SINE(int16_t, 32767.0);
@@ -0,0 +1,351 @@
+/* Spa A2DP AAC codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/audio/format.h>
+
+#include <fdk-aac/aacenc_lib.h>
+
+#include "rtp.h"
+#include "a2dp-codecs.h"
+
+#define MIN_BITRATE	64000
+
+struct impl {
+	HANDLE_AACENCODER aacenc;
+
+	size_t mtu;
+	int codesize;
+
+	uint32_t rate;
+	uint32_t channels;
+
+	int max_bitrate;
+	int cur_bitrate;
+};
+
+static const struct {
+	uint32_t config;
+	uint32_t rate;
+} aac_frequencies[] = {
+	{ AAC_SAMPLING_FREQ_48000, 48000 },
+	{ AAC_SAMPLING_FREQ_44100, 44100 },
+	{ AAC_SAMPLING_FREQ_96000, 96000 },
+	{ AAC_SAMPLING_FREQ_88200, 88200 },
+	{ AAC_SAMPLING_FREQ_64000, 64000 },
+	{ AAC_SAMPLING_FREQ_32000, 32000 },
+	{ AAC_SAMPLING_FREQ_24000, 24000 },
+	{ AAC_SAMPLING_FREQ_22050, 22050 },
+	{ AAC_SAMPLING_FREQ_16000, 16000 },
+	{ AAC_SAMPLING_FREQ_12000, 12000 },
+	{ AAC_SAMPLING_FREQ_11025, 11025 },
+	{ AAC_SAMPLING_FREQ_8000, 8000 },
+};
+
+static int codec_fill_caps(const struct a2dp_codec *codec,
+		uint8_t caps[A2DP_MAX_CAPS_SIZE])
+{
+	memcpy(caps, &bluez_a2dp_aac, sizeof(bluez_a2dp_aac));
+	return sizeof(bluez_a2dp_aac);
+}
+
+static int codec_select_config(const struct a2dp_codec *codec,
+		const void *caps, size_t caps_size,
+		uint8_t config[A2DP_MAX_CAPS_SIZE])
+{
+	a2dp_aac_t conf;
+	uint32_t i, freq;
+
+	if (caps_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, caps, sizeof(conf));
+
+	/* the encoder only does low complexity */
+	if (conf.object_type & AAC_OBJECT_TYPE_MPEG2_AAC_LC)
+		conf.object_type = AAC_OBJECT_TYPE_MPEG2_AAC_LC;
+	else if (conf.object_type & AAC_OBJECT_TYPE_MPEG4_AAC_LC)
+		conf.object_type = AAC_OBJECT_TYPE_MPEG4_AAC_LC;
+	else
+		return -ENOTSUP;
+
+	freq = AAC_GET_FREQUENCY(conf);
+	for (i = 0; i < SPA_N_ELEMENTS(aac_frequencies); i++) {
+		if (freq & aac_frequencies[i].config)
+			break;
+	}
+	if (i == SPA_N_ELEMENTS(aac_frequencies))
+		return -ENOTSUP;
+	AAC_SET_FREQUENCY(conf, aac_frequencies[i].config);
+
+	if (conf.channels & AAC_CHANNELS_2)
+		conf.channels = AAC_CHANNELS_2;
+	else if (conf.channels & AAC_CHANNELS_1)
+		conf.channels = AAC_CHANNELS_1;
+	else
+		return -ENOTSUP;
+
+	conf.vbr = conf.vbr && bluez_a2dp_aac.vbr;
+
+	memcpy(config, &conf, sizeof(conf));
+
+	return sizeof(conf);
+}
+
+static int codec_validate_config(const struct a2dp_codec *codec,
+		const void *config, size_t config_size,
+		struct spa_audio_info *info)
+{
+	a2dp_aac_t conf;
+	uint32_t i, freq;
+
+	if (config_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, config, sizeof(conf));
+
+	freq = AAC_GET_FREQUENCY(conf);
+	for (i = 0; i < SPA_N_ELEMENTS(aac_frequencies); i++) {
+		if (freq == aac_frequencies[i].config)
+			break;
+	}
+	if (i == SPA_N_ELEMENTS(aac_frequencies))
+		return -EINVAL;
+
+	spa_zero(*info);
+	info->media_type = SPA_MEDIA_TYPE_audio;
+	info->media_subtype = SPA_MEDIA_SUBTYPE_raw;
+	info->info.raw.format = SPA_AUDIO_FORMAT_S16;
+	info->info.raw.rate = aac_frequencies[i].rate;
+
+	switch (conf.channels) {
+	case AAC_CHANNELS_1:
+		info->info.raw.channels = 1;
+		info->info.raw.position[0] = SPA_AUDIO_CHANNEL_MONO;
+		break;
+	case AAC_CHANNELS_2:
+		info->info.raw.channels = 2;
+		info->info.raw.position[0] = SPA_AUDIO_CHANNEL_FL;
+		info->info.raw.position[1] = SPA_AUDIO_CHANNEL_FR;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int set_bitrate(struct impl *this, int bitrate)
+{
+	bitrate = SPA_CLAMP(bitrate, MIN_BITRATE, this->max_bitrate);
+
+	if (this->cur_bitrate == bitrate)
+		return 0;
+
+	if (aacEncoder_SetParam(this->aacenc, AACENC_BITRATE, bitrate) != AACENC_OK)
+		return -EIO;
+
+	this->cur_bitrate = bitrate;
+
+	return bitrate;
+}
+
+static void *codec_init(const struct a2dp_codec *codec,
+		const void *config, size_t config_size,
+		const struct spa_audio_info *info, size_t mtu)
+{
+	struct impl *this;
+	a2dp_aac_t conf;
+	AACENC_InfoStruct enc_info = { 0 };
+	int bitrate, res = -EIO;
+
+	if (config_size < sizeof(conf)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	memcpy(&conf, config, sizeof(conf));
+
+	if ((this = calloc(1, sizeof(struct impl))) == NULL)
+		return NULL;
+
+	this->mtu = mtu;
+	this->rate = info->info.raw.rate;
+	this->channels = info->info.raw.channels;
+
+	if (aacEncOpen(&this->aacenc, 0, this->channels) != AACENC_OK)
+		goto error;
+
+	if (aacEncoder_SetParam(this->aacenc, AACENC_AOT, AOT_AAC_LC) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_SAMPLERATE, this->rate) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_CHANNELMODE,
+		    this->channels == 1 ? MODE_1 : MODE_2) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_CHANNELORDER, 1) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_TRANSMUX, TT_MP4_LATM_MCP1) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_HEADER_PERIOD, 1) != AACENC_OK ||
+	    aacEncoder_SetParam(this->aacenc, AACENC_AFTERBURNER, 1) != AACENC_OK)
+		goto error;
+
+	/* a frame of 1024 samples must fit in one packet */
+	bitrate = (mtu - sizeof(struct rtp_header)) * 8 * this->rate / 1024;
+	if (AAC_GET_BITRATE(conf) > 0)
+		bitrate = SPA_MIN(bitrate, (int)AAC_GET_BITRATE(conf));
+	this->max_bitrate = bitrate;
+
+	if (conf.vbr) {
+		if (aacEncoder_SetParam(this->aacenc, AACENC_BITRATEMODE, 5) != AACENC_OK ||
+		    aacEncoder_SetParam(this->aacenc, AACENC_PEAK_BITRATE, bitrate) != AACENC_OK)
+			goto error;
+	} else if (set_bitrate(this, bitrate) < 0)
+		goto error;
+
+	if (aacEncEncode(this->aacenc, NULL, NULL, NULL, NULL) != AACENC_OK ||
+	    aacEncInfo(this->aacenc, &enc_info) != AACENC_OK)
+		goto error;
+
+	this->codesize = enc_info.frameLength * this->channels * sizeof(int16_t);
+
+	return this;
+
+error:
+	if (this->aacenc)
+		aacEncClose(&this->aacenc);
+	free(this);
+	errno = -res;
+	return NULL;
+}
+
+static void codec_deinit(void *data)
+{
+	struct impl *this = data;
+	if (this->aacenc)
+		aacEncClose(&this->aacenc);
+	free(this);
+}
+
+static int codec_get_block_size(void *data)
+{
+	struct impl *this = data;
+	return this->codesize;
+}
+
+static int codec_get_num_blocks(void *data)
+{
+	return 1;
+}
+
+static int codec_start_encode(void *data,
+		void *dst, size_t dst_size, uint16_t seqnum, uint32_t timestamp)
+{
+	struct rtp_header *header = dst;
+
+	if (dst_size < sizeof(struct rtp_header))
+		return -ENOSPC;
+
+	memset(header, 0, sizeof(struct rtp_header));
+	header->v = 2;
+	header->pt = 96;
+	header->sequence_number = htons(seqnum);
+	header->timestamp = htonl(timestamp);
+	header->ssrc = htonl(1);
+
+	return sizeof(struct rtp_header);
+}
+
+static int codec_encode(void *data,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size,
+		size_t *dst_out, int *need_flush)
+{
+	struct impl *this = data;
+	void *in_ptr = (void *) src, *out_ptr = dst;
+	INT in_id = IN_AUDIO_DATA, out_id = OUT_BITSTREAM_DATA;
+	INT in_size = src_size, out_size = dst_size;
+	INT in_el_size = sizeof(int16_t), out_el_size = 1;
+	AACENC_BufDesc in_buf = {
+		.numBufs = 1,
+		.bufs = &in_ptr,
+		.bufferIdentifiers = &in_id,
+		.bufSizes = &in_size,
+		.bufElSizes = &in_el_size,
+	};
+	AACENC_BufDesc out_buf = {
+		.numBufs = 1,
+		.bufs = &out_ptr,
+		.bufferIdentifiers = &out_id,
+		.bufSizes = &out_size,
+		.bufElSizes = &out_el_size,
+	};
+	AACENC_InArgs in_args = {
+		.numInSamples = src_size / sizeof(int16_t),
+	};
+	AACENC_OutArgs out_args = { 0 };
+
+	if (aacEncEncode(this->aacenc, &in_buf, &out_buf, &in_args, &out_args) != AACENC_OK)
+		return -EIO;
+
+	*dst_out = out_args.numOutBytes;
+	/* one frame per packet, nothing is sent while the encoder fills its delay */
+	*need_flush = out_args.numOutBytes > 0;
+
+	return out_args.numInSamples * sizeof(int16_t);
+}
+
+static int codec_reduce_bitpool(void *data)
+{
+	struct impl *this = data;
+	if (this->cur_bitrate == 0)
+		return -ENOTSUP;
+	return set_bitrate(this, this->cur_bitrate * 3 / 4);
+}
+
+static int codec_increase_bitpool(void *data)
+{
+	struct impl *this = data;
+	if (this->cur_bitrate == 0)
+		return -ENOTSUP;
+	return set_bitrate(this, this->cur_bitrate * 9 / 8);
+}
+
+const struct a2dp_codec a2dp_codec_aac = {
+	.codec_id = A2DP_CODEC_MPEG24,
+	.name = "AAC",
+	.description = "AAC",
+	.fill_caps = codec_fill_caps,
+	.select_config = codec_select_config,
+	.validate_config = codec_validate_config,
+	.init = codec_init,
+	.deinit = codec_deinit,
+	.get_block_size = codec_get_block_size,
+	.get_num_blocks = codec_get_num_blocks,
+	.start_encode = codec_start_encode,
+	.encode = codec_encode,
+	.reduce_bitpool = codec_reduce_bitpool,
+	.increase_bitpool = codec_increase_bitpool,
+};
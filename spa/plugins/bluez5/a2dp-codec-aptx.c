@@ -0,0 +1,210 @@
+/* Spa A2DP aptX codec
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/audio/format.h>
+
+#include <openaptx.h>
+
+#include "a2dp-codecs.h"
+
+/* 4 stereo samples of 24 bits are coded in 4 bytes, encode 16 of
+ * those groups at once */
+#define GROUP_SIZE	(4 * 2 * 3)
+#define CODED_SIZE	4
+#define BLOCK_GROUPS	16
+
+struct impl {
+	struct aptx_context *aptx;
+	size_t mtu;
+};
+
+static const struct {
+	uint32_t config;
+	uint32_t rate;
+} aptx_frequencies[] = {
+	{ APTX_SAMPLING_FREQ_48000, 48000 },
+	{ APTX_SAMPLING_FREQ_44100, 44100 },
+	{ APTX_SAMPLING_FREQ_32000, 32000 },
+	{ APTX_SAMPLING_FREQ_16000, 16000 },
+};
+
+static int codec_fill_caps(const struct a2dp_codec *codec,
+		uint8_t caps[A2DP_MAX_CAPS_SIZE])
+{
+	memcpy(caps, &bluez_a2dp_aptx, sizeof(bluez_a2dp_aptx));
+	return sizeof(bluez_a2dp_aptx);
+}
+
+static int codec_select_config(const struct a2dp_codec *codec,
+		const void *caps, size_t caps_size,
+		uint8_t config[A2DP_MAX_CAPS_SIZE])
+{
+	a2dp_aptx_t conf;
+	uint32_t i;
+
+	if (caps_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, caps, sizeof(conf));
+
+	if (conf.info.vendor_id != APTX_VENDOR_ID ||
+	    conf.info.codec_id != APTX_CODEC_ID)
+		return -ENOTSUP;
+
+	for (i = 0; i < SPA_N_ELEMENTS(aptx_frequencies); i++) {
+		if (conf.frequency & aptx_frequencies[i].config)
+			break;
+	}
+	if (i == SPA_N_ELEMENTS(aptx_frequencies))
+		return -ENOTSUP;
+	conf.frequency = aptx_frequencies[i].config;
+
+	/* the encoder only does stereo */
+	if (conf.channel_mode & APTX_CHANNEL_MODE_STEREO)
+		conf.channel_mode = APTX_CHANNEL_MODE_STEREO;
+	else
+		return -ENOTSUP;
+
+	memcpy(config, &conf, sizeof(conf));
+
+	return sizeof(conf);
+}
+
+static int codec_validate_config(const struct a2dp_codec *codec,
+		const void *config, size_t config_size,
+		struct spa_audio_info *info)
+{
+	a2dp_aptx_t conf;
+	uint32_t i;
+
+	if (config_size < sizeof(conf))
+		return -EINVAL;
+
+	memcpy(&conf, config, sizeof(conf));
+
+	for (i = 0; i < SPA_N_ELEMENTS(aptx_frequencies); i++) {
+		if (conf.frequency == aptx_frequencies[i].config)
+			break;
+	}
+	if (i == SPA_N_ELEMENTS(aptx_frequencies))
+		return -EINVAL;
+	if (conf.channel_mode != APTX_CHANNEL_MODE_STEREO)
+		return -EINVAL;
+
+	spa_zero(*info);
+	info->media_type = SPA_MEDIA_TYPE_audio;
+	info->media_subtype = SPA_MEDIA_SUBTYPE_raw;
+	info->info.raw.format = SPA_AUDIO_FORMAT_S24;
+	info->info.raw.rate = aptx_frequencies[i].rate;
+	info->info.raw.channels = 2;
+	info->info.raw.position[0] = SPA_AUDIO_CHANNEL_FL;
+	info->info.raw.position[1] = SPA_AUDIO_CHANNEL_FR;
+
+	return 0;
+}
+
+static void *codec_init(const struct a2dp_codec *codec,
+		const void *config, size_t config_size,
+		const struct spa_audio_info *info, size_t mtu)
+{
+	struct impl *this;
+
+	if ((this = calloc(1, sizeof(struct impl))) == NULL)
+		return NULL;
+
+	if ((this->aptx = aptx_init(0)) == NULL) {
+		free(this);
+		errno = ENOMEM;
+		return NULL;
+	}
+	this->mtu = mtu;
+
+	return this;
+}
+
+static void codec_deinit(void *data)
+{
+	struct impl *this = data;
+	aptx_finish(this->aptx);
+	free(this);
+}
+
+static int codec_get_block_size(void *data)
+{
+	return GROUP_SIZE * BLOCK_GROUPS;
+}
+
+static int codec_get_num_blocks(void *data)
+{
+	struct impl *this = data;
+	return this->mtu / (CODED_SIZE * BLOCK_GROUPS);
+}
+
+static int codec_start_encode(void *data,
+		void *dst, size_t dst_size, uint16_t seqnum, uint32_t timestamp)
+{
+	/* plain aptX is sent without RTP header */
+	return 0;
+}
+
+static int codec_encode(void *data,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size,
+		size_t *dst_out, int *need_flush)
+{
+	struct impl *this = data;
+	size_t processed;
+
+	processed = aptx_encode(this->aptx, src, src_size, dst, dst_size, dst_out);
+	if (processed == 0 && src_size >= GROUP_SIZE)
+		return -ENOSPC;
+
+	*need_flush = dst_size - *dst_out < CODED_SIZE * BLOCK_GROUPS;
+
+	return processed;
+}
+
+const struct a2dp_codec a2dp_codec_aptx = {
+	.codec_id = A2DP_CODEC_VENDOR,
+	.vendor = { .vendor_id = APTX_VENDOR_ID,
+		.codec_id = APTX_CODEC_ID },
+	.name = "APTX",
+	.description = "aptX",
+	.fill_caps = codec_fill_caps,
+	.select_config = codec_select_config,
+	.validate_config = codec_validate_config,
+	.init = codec_init,
+	.deinit = codec_deinit,
+	.get_block_size = codec_get_block_size,
+	.get_num_blocks = codec_get_num_blocks,
+	.start_encode = codec_start_encode,
+	.encode = codec_encode,
+};
@@ -121,3 +121,14 @@ const a2dp_aptx_t bluez_a2dp_aptx = {
 		APTX_SAMPLING_FREQ_48000,
 };
 #endif
+
+const struct a2dp_codec * const a2dp_codecs[] = {
+#if ENABLE_APTX
+	&a2dp_codec_aptx,
+#endif
+#if ENABLE_AAC
+	&a2dp_codec_aac,
+#endif
+	&a2dp_codec_sbc,
+	NULL
+};
@@ -26,6 +26,9 @@
 #define BLUEALSA_A2DPCODECS_H_
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include <spa/param/audio/format.h>
 
 #define A2DP_CODEC_SBC			0x00
 #define A2DP_CODEC_MPEG12		0x01
@@ -295,4 +298,60 @@ extern const a2dp_aac_t bluez_a2dp_aac;
 extern const a2dp_aptx_t bluez_a2dp_aptx;
 #endif
 
+#define A2DP_MAX_CAPS_SIZE	254
+
+/* an encoder for the a2dp sink, the methods after init run in the
+ * encoder thread */
+struct a2dp_codec {
+	uint8_t codec_id;
+	a2dp_vendor_codec_t vendor;
+
+	const char *name;		/**< in the endpoint path */
+	const char *description;
+
+	/* endpoint capabilities and configuration */
+	int (*fill_caps) (const struct a2dp_codec *codec,
+			uint8_t caps[A2DP_MAX_CAPS_SIZE]);
+	int (*select_config) (const struct a2dp_codec *codec,
+			const void *caps, size_t caps_size,
+			uint8_t config[A2DP_MAX_CAPS_SIZE]);
+	int (*validate_config) (const struct a2dp_codec *codec,
+			const void *config, size_t config_size,
+			struct spa_audio_info *info);
+
+	void *(*init) (const struct a2dp_codec *codec,
+			const void *config, size_t config_size,
+			const struct spa_audio_info *info, size_t mtu);
+	void (*deinit) (void *data);
+
+	/** bytes of PCM taken by one encode call */
+	int (*get_block_size) (void *data);
+	/** encode calls that fit in one packet */
+	int (*get_num_blocks) (void *data);
+
+	/** write the headers of a new packet and return their size */
+	int (*start_encode) (void *data,
+			void *dst, size_t dst_size, uint16_t seqnum, uint32_t timestamp);
+	/** encode one block, \a need_flush is set when the packet is full */
+	int (*encode) (void *data,
+			const void *src, size_t src_size,
+			void *dst, size_t dst_size,
+			size_t *dst_out, int *need_flush);
+
+	/* trade quality for bandwidth, can be NULL */
+	int (*reduce_bitpool) (void *data);
+	int (*increase_bitpool) (void *data);
+};
+
+extern const struct a2dp_codec a2dp_codec_sbc;
+#if ENABLE_AAC
+extern const struct a2dp_codec a2dp_codec_aac;
+#endif
+#if ENABLE_APTX
+extern const struct a2dp_codec a2dp_codec_aptx;
+#endif
+
+/** the available codecs in order of preference, NULL terminated */
+extern const struct a2dp_codec * const a2dp_codecs[];
+
 #endif
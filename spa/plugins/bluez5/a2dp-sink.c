@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <poll.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 
@@ -33,6 +35,7 @@
 #include <spa/support/log.h>
 #include <spa/support/system.h>
 #include <spa/utils/list.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
@@ -46,8 +49,6 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
-#include <sbc/sbc.h>
-
 #include "defs.h"
 #include "rtp.h"
 #include "a2dp-codecs.h"
@@ -58,8 +59,12 @@ struct props {
 };
 
 #define FILL_FRAMES 2
-#define MAX_FRAME_COUNT 32
+#define LOW_LATENCY_BLOCKS 2	/* codec blocks per packet in low-latency mode */
+
+#define ADAPT_DOWN_INTERVAL	(SPA_NSEC_PER_SEC / 5)
+#define ADAPT_UP_INTERVAL	(SPA_NSEC_PER_SEC * 3)
 #define MAX_BUFFERS 32
+#define RING_SIZE (32 * 1024)	/* PCM between the data thread and the encoder */
 
 struct buffer {
 	uint32_t id;
@@ -86,7 +91,6 @@ struct port {
 	struct spa_list ready;
 
 	size_t ready_offset;
-	unsigned int need_data:1;
 };
 
 struct impl {
@@ -112,32 +116,39 @@ struct impl {
 
 	unsigned int started:1;
 	unsigned int slaved:1;
+	unsigned int low_latency:1;
 
 	struct spa_source source;
 	int timerfd;
 	int threshold;
-	struct spa_source flush_source;
+
+	pthread_t encoder;
+	int encoder_fd;
+	bool encoding;
+	struct spa_ringbuffer ring;
+	uint8_t ring_data[RING_SIZE];
 
 	struct spa_io_clock *clock;
 	struct spa_io_position *position;
 
-	sbc_t sbc;
-	int read_size;
+	const struct a2dp_codec *codec;
+	void *codec_data;
+	int block_size;
+	int num_blocks;
 	int write_size;
 	int write_samples;
-	int frame_length;
-	int codesize;
 	uint8_t buffer[4096];
 	int buffer_used;
 	int frame_count;
+	unsigned int need_flush:1;
 	uint16_t seqnum;
 	uint32_t timestamp;
 
-	int min_bitpool;
-	int max_bitpool;
-
 	uint64_t last_time;
 	uint64_t last_error;
+	uint64_t last_increase;
+	int sndbuf;
+	int queued;		/* bytes in the socket after the last write */
 
 	struct timespec now;
 	uint64_t start_time;
@@ -349,39 +360,35 @@ static inline void calc_timeout(size_t target, size_t current,
 
 static int reset_buffer(struct impl *this)
 {
-	this->buffer_used = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+	int res;
+
+	if ((res = this->codec->start_encode(this->codec_data,
+				this->buffer, this->write_size,
+				this->seqnum, this->timestamp)) < 0)
+		return res;
+
+	this->buffer_used = res;
 	this->frame_count = 0;
+	this->need_flush = false;
 	return 0;
 }
 
 static int send_buffer(struct impl *this)
 {
 	int val, written;
-	struct rtp_header *header;
-	struct rtp_payload *payload;
-
-	header = (struct rtp_header *)this->buffer;
-	payload = (struct rtp_payload *)(this->buffer + sizeof(struct rtp_header));
-	memset(this->buffer, 0, sizeof(struct rtp_header)+sizeof(struct rtp_payload));
-
-	payload->frame_count = this->frame_count;
-	header->v = 2;
-	header->pt = 1;
-	header->sequence_number = htons(this->seqnum);
-	header->timestamp = htonl(this->timestamp);
-	header->ssrc = htonl(1);
-
-	ioctl(this->transport->fd, TIOCOUTQ, &val);
-
-	spa_log_trace(this->log, NAME " %p: send %d %u %u %u %"PRIu64" %d",
-			this, this->frame_count, this->seqnum, this->timestamp, this->buffer_used,
-			this->sample_time, val);
 
 	written = write(this->transport->fd, this->buffer, this->buffer_used);
-	spa_log_trace(this->log, NAME " %p: send %d", this, written);
 	if (written < 0)
 		return -errno;
 
+	/* on bluetooth sockets this is the free space in the send buffer */
+	if (ioctl(this->transport->fd, TIOCOUTQ, &val) == 0 && this->sndbuf > 0)
+		this->queued = SPA_MAX(this->sndbuf - val, 0);
+
+	spa_log_trace(this->log, NAME " %p: send %d %u %u %u %"PRIu64" %d %d",
+			this, this->frame_count, this->seqnum, this->timestamp, this->buffer_used,
+			this->sample_count, written, this->queued);
+
 	this->timestamp = this->sample_count;
 	this->seqnum++;
 	reset_buffer(this);
@@ -391,28 +398,29 @@ static int send_buffer(struct impl *this)
 
 static int encode_buffer(struct impl *this, const void *data, int size)
 {
-	int processed;
-	ssize_t out_encoded;
+	int processed, need_flush = 0;
+	size_t out_encoded = 0;
 	struct port *port = &this->port;
 
 	spa_log_trace(this->log, NAME " %p: encode %d used %d, %d %d %d/%d",
 			this, size, this->buffer_used, port->frame_size, this->write_size,
-			this->frame_count, MAX_FRAME_COUNT);
+			this->frame_count, this->num_blocks);
 
-	if (this->frame_count > MAX_FRAME_COUNT)
+	if (this->need_flush)
 		return -ENOSPC;
 
-	processed = sbc_encode(&this->sbc, data, size,
+	processed = this->codec->encode(this->codec_data, data, size,
 			       this->buffer + this->buffer_used,
 			       this->write_size - this->buffer_used,
-			       &out_encoded);
+			       &out_encoded, &need_flush);
 	if (processed < 0)
 		return processed;
 
 	this->sample_count += processed / port->frame_size;
-	this->sample_time += processed / port->frame_size;
-	this->frame_count += processed / this->codesize;
+	this->frame_count++;
 	this->buffer_used += out_encoded;
+	this->need_flush = need_flush ||
+		(this->low_latency && this->frame_count >= this->num_blocks);
 
 	spa_log_trace(this->log, NAME " %p: processed %d %zd used %d",
 			this, processed, out_encoded, this->buffer_used);
@@ -420,18 +428,12 @@ static int encode_buffer(struct impl *this, const void *data, int size)
 	return processed;
 }
 
-static bool need_flush(struct impl *this)
-{
-	return (this->buffer_used + this->frame_length > this->write_size) ||
-		this->frame_count > MAX_FRAME_COUNT;
-}
-
 static int flush_buffer(struct impl *this, bool force)
 {
 	spa_log_trace(this->log, NAME" %p: %d %d %d", this,
-			this->buffer_used, this->frame_length, this->write_size);
+			this->buffer_used, this->need_flush, this->write_size);
 
-	if (force || need_flush(this))
+	if (force || this->need_flush)
 		return send_buffer(this);
 
 	return 0;
@@ -445,7 +447,7 @@ static int fill_socket(struct impl *this, uint64_t now_time)
 	while (frames < FILL_FRAMES) {
 		int processed, written;
 
-		processed = encode_buffer(this, zero_buffer, sizeof(zero_buffer));
+		processed = encode_buffer(this, zero_buffer, this->block_size);
 		if (processed < 0)
 			return processed;
 		if (processed == 0)
@@ -465,67 +467,210 @@ static int fill_socket(struct impl *this, uint64_t now_time)
 	return 0;
 }
 
-static int add_data(struct impl *this, const void *data, int size)
+static void update_write_samples(struct impl *this)
 {
-	int processed, total = 0;
+	struct port *port = &this->port;
+
+	this->block_size = this->codec->get_block_size(this->codec_data);
+	this->num_blocks = this->codec->get_num_blocks(this->codec_data);
+	if (this->low_latency)
+		this->num_blocks = SPA_MIN(this->num_blocks, LOW_LATENCY_BLOCKS);
+	this->write_samples = this->num_blocks * (this->block_size / port->frame_size);
+}
 
-	while (size > 0) {
-		processed = encode_buffer(this, data, size);
+static int reduce_bitpool(struct impl *this)
+{
+	int res;
+
+	if (this->codec->reduce_bitpool == NULL)
+		return -ENOTSUP;
+	if ((res = this->codec->reduce_bitpool(this->codec_data)) > 0) {
+		spa_log_debug(this->log, NAME" %p: reduced bitpool %d", this, res);
+		update_write_samples(this);
+	}
+	return res;
+}
 
-		if (processed == -ENOSPC || processed == 0)
+static int increase_bitpool(struct impl *this)
+{
+	int res;
+
+	if (this->codec->increase_bitpool == NULL)
+		return -ENOTSUP;
+	if ((res = this->codec->increase_bitpool(this->codec_data)) > 0) {
+		spa_log_debug(this->log, NAME" %p: increased bitpool %d", this, res);
+		update_write_samples(this);
+	}
+	return res;
+}
+
+/* lower the bitpool as soon as the socket queue grows, before writes fail,
+ * and raise it again after the queue stayed short for a while */
+static void adapt_bitpool(struct impl *this, uint64_t now_time)
+{
+	if (this->sndbuf <= 0)
+		return;
+
+	if (this->queued > this->sndbuf / 2) {
+		if (now_time - this->last_error > ADAPT_DOWN_INTERVAL) {
+			spa_log_debug(this->log, NAME " %p: queued %d/%d", this,
+					this->queued, this->sndbuf);
+			reduce_bitpool(this);
+			this->last_error = now_time;
+		}
+	}
+	else if (this->queued <= this->write_size &&
+	    now_time - this->last_error > ADAPT_UP_INTERVAL &&
+	    now_time - this->last_increase > ADAPT_UP_INTERVAL) {
+		increase_bitpool(this);
+		this->last_increase = now_time;
+	}
+}
+
+/* encode the PCM in the ring and send the packets, runs in the encoder thread */
+static int encode_ring(struct impl *this, uint64_t now_time)
+{
+	uint8_t pcm[4096];
+	uint32_t index;
+	int32_t avail;
+	int processed, written;
+
+	while (true) {
+		if (this->need_flush) {
+			written = send_buffer(this);
+			if (written == -EAGAIN) {
+				if (now_time - this->last_error > ADAPT_DOWN_INTERVAL) {
+					reduce_bitpool(this);
+					this->last_error = now_time;
+				}
+				return written;
+			}
+			else if (written < 0)
+				return written;
+
+			adapt_bitpool(this, now_time);
+		}
+
+		avail = spa_ringbuffer_get_read_index(&this->ring, &index);
+		if (avail < this->block_size)
 			break;
-		if (processed < 0)
-			return 0;
 
-		data = SPA_MEMBER(data, processed, void);
-		size -= processed;
-		total += processed;
+		spa_ringbuffer_read_data(&this->ring, this->ring_data, RING_SIZE,
+				index & (RING_SIZE - 1), pcm, this->block_size);
+
+		processed = encode_buffer(this, pcm, this->block_size);
+		if (processed == -ENOSPC && this->frame_count > 0) {
+			/* the frames grew after a bitpool change, send what we have */
+			this->need_flush = true;
+			continue;
+		}
+		if (processed <= 0)
+			return processed;
+
+		spa_ringbuffer_read_update(&this->ring, index + processed);
 	}
-	return total;
+	return 0;
 }
 
-static int set_bitpool(struct impl *this, int bitpool)
+static void *encoder_thread(void *data)
 {
-	struct port *port = &this->port;
+	struct impl *this = data;
+	struct pollfd pfd[2];
+	struct timespec now;
+	uint64_t count;
+	int res;
 
-	if (bitpool < this->min_bitpool)
-		bitpool = this->min_bitpool;
-	if (bitpool > this->max_bitpool)
-		bitpool = this->max_bitpool;
+	pfd[0].fd = this->encoder_fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = this->transport->fd;
+	pfd[1].events = 0;
 
-	if (this->sbc.bitpool == bitpool)
-		return 0;
+	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &now);
+	if ((res = fill_socket(this, SPA_TIMESPEC_TO_NSEC(&now))) < 0)
+		spa_log_error(this->log, NAME " %p: error fill socket %s", this, spa_strerror(res));
 
-	this->sbc.bitpool = bitpool;
+	while (this->encoding) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			spa_log_error(this->log, NAME " %p: poll error %m", this);
+			break;
+		}
+		if (pfd[1].revents & (POLLERR | POLLHUP)) {
+			spa_log_warn(this->log, NAME " %p: error %d", this, pfd[1].revents);
+			break;
+		}
+		if (pfd[0].revents & POLLIN)
+			spa_system_eventfd_read(this->data_system, this->encoder_fd, &count);
+
+		spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &now);
+
+		res = encode_ring(this, SPA_TIMESPEC_TO_NSEC(&now));
+		if (res < 0 && res != -EAGAIN)
+			spa_log_trace(this->log, NAME " %p: error encoding %s", this,
+					spa_strerror(res));
+
+		/* wait for room in the socket before sending the next packet */
+		pfd[1].events = res == -EAGAIN ? POLLOUT : 0;
+	}
+	return NULL;
+}
 
-	spa_log_debug(this->log, NAME" %p: set bitpool %d", this, this->sbc.bitpool);
+static int start_encoder(struct impl *this)
+{
+	int res;
 
-	this->codesize = sbc_get_codesize(&this->sbc);
-	this->frame_length = sbc_get_frame_length(&this->sbc);
+	spa_ringbuffer_init(&this->ring);
 
-	this->read_size = this->transport->read_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_size = this->transport->write_mtu
-		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_samples = (this->write_size / this->frame_length) *
-		(this->codesize / port->frame_size);
+	this->encoder_fd = spa_system_eventfd_create(this->data_system,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	if (this->encoder_fd < 0)
+		return this->encoder_fd;
 
+	this->encoding = true;
+	if ((res = pthread_create(&this->encoder, NULL, encoder_thread, this)) != 0) {
+		this->encoding = false;
+		spa_system_close(this->data_system, this->encoder_fd);
+		return -res;
+	}
 	return 0;
 }
 
-static int reduce_bitpool(struct impl *this)
+static void stop_encoder(struct impl *this)
 {
-	return set_bitpool(this, this->sbc.bitpool - 2);
+	if (!this->encoding)
+		return;
+
+	this->encoding = false;
+	spa_system_eventfd_write(this->data_system, this->encoder_fd, 1);
+	pthread_join(this->encoder, NULL);
+	spa_system_close(this->data_system, this->encoder_fd);
 }
 
-static int increase_bitpool(struct impl *this)
+static uint32_t push_data(struct impl *this, const void *data, uint32_t size)
 {
-	return set_bitpool(this, this->sbc.bitpool + 1);
+	struct port *port = &this->port;
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&this->ring, &index);
+
+	size = SPA_MIN(size, RING_SIZE - (uint32_t)filled);
+	size -= size % port->frame_size;
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_write_data(&this->ring, this->ring_data, RING_SIZE,
+			index & (RING_SIZE - 1), data, size);
+	spa_ringbuffer_write_update(&this->ring, index + size);
+
+	this->sample_time += size / port->frame_size;
+
+	return size;
 }
 
 static int flush_data(struct impl *this, uint64_t now_time)
 {
-	int written;
 	uint32_t total_frames;
 	uint64_t elapsed;
 	int64_t queued;
@@ -556,15 +701,12 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		l0 = SPA_MIN(n_bytes, d[0].maxsize - offs);
 		l1 = n_bytes - l0;
 
-		n_bytes = add_data(this, src + offs, l0);
-		if (n_bytes > 0 && l1 > 0)
-			n_bytes += add_data(this, src, l1);
-		if (n_bytes <= 0) {
-			port->need_data = true;
-			spa_list_remove(&b->link);
-			b->outstanding = true;
-			spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
-			port->ready_offset = 0;
+		n_bytes = push_data(this, src + offs, l0);
+		if (n_bytes == l0 && l1 > 0)
+			n_bytes += push_data(this, src, l1);
+		if (n_bytes == 0) {
+			/* the encoder is behind, keep the buffer until it catches up */
+			spa_log_trace(this->log, NAME " %p: ring full", this);
 			break;
 		}
 
@@ -585,31 +727,8 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		spa_log_trace(this->log, NAME " %p: written %u frames", this, total_frames);
 	}
 
-	written = flush_buffer(this, false);
-	if (written == -EAGAIN) {
-		spa_log_trace(this->log, NAME" %p: delay flush %"PRIu64, this, this->sample_time);
-		if ((this->flush_source.mask & SPA_IO_OUT) == 0) {
-			this->flush_source.mask = SPA_IO_OUT;
-			spa_loop_update_source(this->data_loop, &this->flush_source);
-			this->source.mask = 0;
-			spa_loop_update_source(this->data_loop, &this->source);
-			return 0;
-		}
-	}
-	else if (written < 0) {
-		spa_log_trace(this->log, NAME" %p: error flushing %s", this,
-				spa_strerror(written));
-		return written;
-	}
-	else if (written > 0) {
-		if (now_time - this->last_error > SPA_NSEC_PER_SEC * 3) {
-			increase_bitpool(this);
-			this->last_error = now_time;
-		}
-	}
-
-	this->flush_source.mask = 0;
-	spa_loop_update_source(this->data_loop, &this->flush_source);
+	if (total_frames > 0)
+		spa_system_eventfd_write(this->data_system, this->encoder_fd, 1);
 
 	if (now_time > this->start_time)
 		elapsed = now_time - this->start_time;
@@ -630,11 +749,6 @@ static int flush_data(struct impl *this, uint64_t now_time)
 				this->sample_time = queued;
 				this->start_time = now_time;
 			}
-			if (!spa_list_is_empty(&port->ready) &&
-			    now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
-				reduce_bitpool(this);
-				this->last_error = now_time;
-			}
 		}
 		calc_timeout(queued,
 			     FILL_FRAMES * this->write_samples,
@@ -652,33 +766,10 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	return 0;
 }
 
-static void a2dp_on_flush(struct spa_source *source)
-{
-	struct impl *this = source->data;
-	uint64_t now_time;
-
-	spa_log_trace(this->log, NAME" %p: flushing", this);
-
-	if ((source->rmask & SPA_IO_OUT) == 0) {
-		spa_log_warn(this->log, NAME" %p: error %d", this, source->rmask);
-		if (this->flush_source.loop)
-			spa_loop_remove_source(this->data_loop, &this->flush_source);
-		this->source.mask = 0;
-		spa_loop_update_source(this->data_loop, &this->source);
-		return;
-	}
-
-	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &this->now);
-	now_time = this->now.tv_sec * SPA_NSEC_PER_SEC + this->now.tv_nsec;
-
-	flush_data(this, now_time);
-}
-
 static void a2dp_on_timeout(struct spa_source *source)
 {
 	struct impl *this = source->data;
 	struct port *port = &this->port;
-	int err;
 	uint64_t exp, now_time;
 	struct spa_io_buffers *io = port->io;
 
@@ -692,13 +783,10 @@ static void a2dp_on_timeout(struct spa_source *source)
 			now_time, now_time - this->last_time);
 	this->last_time = now_time;
 
-	if (this->start_time == 0) {
-		if ((err = fill_socket(this, now_time)) < 0)
-			spa_log_error(this->log, "error fill socket %s", spa_strerror(err));
+	if (this->start_time == 0)
 		this->start_time = now_time;
-	}
 
-	if (spa_list_is_empty(&port->ready) || port->need_data) {
+	if (spa_list_is_empty(&port->ready)) {
 		spa_log_trace(this->log, NAME " %p: %d", this, io->status);
 
 		io->status = SPA_STATUS_NEED_DATA;
@@ -709,110 +797,104 @@ static void a2dp_on_timeout(struct spa_source *source)
 }
 
 
-static int init_sbc(struct impl *this)
+static int init_codec(struct impl *this)
 {
-        struct spa_bt_transport *transport = this->transport;
-	a2dp_sbc_t *conf = transport->configuration;
-
-	sbc_init(&this->sbc, 0);
-	this->sbc.endian = SBC_LE;
-
-	if (conf->frequency & SBC_SAMPLING_FREQ_48000)
-		this->sbc.frequency = SBC_FREQ_48000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_44100)
-		this->sbc.frequency = SBC_FREQ_44100;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_32000)
-		this->sbc.frequency = SBC_FREQ_32000;
-	else if (conf->frequency & SBC_SAMPLING_FREQ_16000)
-		this->sbc.frequency = SBC_FREQ_16000;
-	else
-		return -EINVAL;
+	struct spa_bt_transport *transport = this->transport;
+	struct port *port = &this->port;
 
-	if (conf->channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		this->sbc.mode = SBC_MODE_JOINT_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_STEREO)
-		this->sbc.mode = SBC_MODE_STEREO;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		this->sbc.mode = SBC_MODE_DUAL_CHANNEL;
-	else if (conf->channel_mode & SBC_CHANNEL_MODE_MONO)
-		this->sbc.mode = SBC_MODE_MONO;
-	else
-		return -EINVAL;
+	this->codec_data = this->codec->init(this->codec,
+			transport->configuration, transport->configuration_len,
+			&port->current_format, transport->write_mtu);
+	if (this->codec_data == NULL)
+		return -errno;
 
-	switch (conf->subbands) {
-	case SBC_SUBBANDS_4:
-		this->sbc.subbands = SBC_SB_4;
-		break;
-	case SBC_SUBBANDS_8:
-		this->sbc.subbands = SBC_SB_8;
-		break;
-	default:
-		return -EINVAL;
-	}
+	this->write_size = SPA_MIN(transport->write_mtu, sizeof(this->buffer));
+	this->seqnum = 0;
 
-	if (conf->allocation_method & SBC_ALLOCATION_LOUDNESS)
-		this->sbc.allocation = SBC_AM_LOUDNESS;
-	else
-		this->sbc.allocation = SBC_AM_SNR;
+	update_write_samples(this);
 
-	switch (conf->block_length) {
-	case SBC_BLOCK_LENGTH_4:
-		this->sbc.blocks = SBC_BLK_4;
-		break;
-	case SBC_BLOCK_LENGTH_8:
-		this->sbc.blocks = SBC_BLK_8;
-		break;
-	case SBC_BLOCK_LENGTH_12:
-		this->sbc.blocks = SBC_BLK_12;
-		break;
-	case SBC_BLOCK_LENGTH_16:
-		this->sbc.blocks = SBC_BLK_16;
-		break;
-	default:
+	if (this->block_size <= 0 || this->block_size > 4096 || this->num_blocks <= 0) {
+		spa_log_error(this->log, NAME " %p: invalid block size %d:%d",
+				this, this->block_size, this->num_blocks);
+		this->codec->deinit(this->codec_data);
+		this->codec_data = NULL;
 		return -EINVAL;
 	}
 
-	this->min_bitpool = SPA_MAX(conf->min_bitpool, 12);
-	this->max_bitpool = conf->max_bitpool;
+	spa_log_debug(this->log, NAME " %p: %s block_size %d num_blocks %d write_size %d",
+			this, this->codec->name, this->block_size, this->num_blocks,
+			this->write_size);
 
-	set_bitpool(this, conf->max_bitpool);
+	return 0;
+}
 
-	this->seqnum = 0;
+static void deinit_codec(struct impl *this)
+{
+	if (this->codec_data == NULL)
+		return;
+	this->codec->deinit(this->codec_data);
+	this->codec_data = NULL;
+}
 
-        spa_log_debug(this->log, NAME " %p: codesize %d frame_length %d size %d:%d %d",
-			this, this->codesize, this->frame_length, this->read_size, this->write_size,
-			this->sbc.bitpool);
+static const struct spa_dict_item node_info_items[] = {
+	{ SPA_KEY_DEVICE_API, "bluez5" },
+	{ SPA_KEY_MEDIA_CLASS, "Audio/Sink" },
+	{ SPA_KEY_NODE_DRIVER, "true" },
+};
 
-	return 0;
+static void emit_node_info(struct impl *this, bool full)
+{
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		struct spa_dict_item items[SPA_N_ELEMENTS(node_info_items) + 1];
+		uint32_t n_items = SPA_N_ELEMENTS(node_info_items);
+		char latency[64];
+
+		memcpy(items, node_info_items, sizeof(node_info_items));
+
+		/* ask for a graph quantum of one packet once the codec is known */
+		if (this->low_latency && this->write_samples > 0) {
+			snprintf(latency, sizeof(latency), "%d/%d", this->write_samples,
+					this->port.current_format.info.raw.rate);
+			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_NODE_LATENCY, latency);
+		}
+		this->info.props = &SPA_DICT_INIT(items, n_items);
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = 0;
+	}
 }
 
-static int do_start(struct impl *this)
+static int transport_start(struct impl *this)
 {
 	int res, val;
 	socklen_t len;
 
-	if (this->started)
-		return 0;
-
-	this->slaved = is_slaved(this);
-
-        spa_log_debug(this->log, NAME " %p: start slaved:%d", this, this->slaved);
-
-	if ((res = spa_bt_transport_acquire(this->transport, false)) < 0)
+	if ((res = init_codec(this)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't init codec: %s",
+				this, spa_strerror(res));
+		spa_bt_transport_release(this->transport);
 		return res;
+	}
 
-	init_sbc(this);
+	if (this->low_latency) {
+		this->info.change_mask |= SPA_NODE_CHANGE_MASK_PROPS;
+		emit_node_info(this, false);
+	}
 
 	val = FILL_FRAMES * this->transport->write_mtu;
 	if (setsockopt(this->transport->fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
 		spa_log_warn(this->log, NAME " %p: SO_SNDBUF %m", this);
 
+	this->sndbuf = 0;
+	this->queued = 0;
 	len = sizeof(val);
 	if (getsockopt(this->transport->fd, SOL_SOCKET, SO_SNDBUF, &val, &len) < 0) {
 		spa_log_warn(this->log, NAME " %p: SO_SNDBUF %m", this);
 	}
 	else {
 		spa_log_debug(this->log, NAME " %p: SO_SNDBUF: %d", this, val);
+		this->sndbuf = val;
 	}
 
 	val = FILL_FRAMES * this->transport->read_mtu;
@@ -825,6 +907,14 @@ static int do_start(struct impl *this)
 
 	reset_buffer(this);
 
+	if ((res = start_encoder(this)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't start encoder: %s",
+				this, spa_strerror(res));
+		deinit_codec(this);
+		spa_bt_transport_release(this->transport);
+		return res;
+	}
+
 	this->source.data = this;
 	this->source.fd = this->timerfd;
 	this->source.func = a2dp_on_timeout;
@@ -832,19 +922,36 @@ static int do_start(struct impl *this)
 	this->source.rmask = 0;
 	spa_loop_add_source(this->data_loop, &this->source);
 
-	this->flush_source.data = this;
-	this->flush_source.fd = this->transport->fd;
-	this->flush_source.func = a2dp_on_flush;
-	this->flush_source.mask = 0;
-	this->flush_source.rmask = 0;
-	spa_loop_add_source(this->data_loop, &this->flush_source);
-
 	set_timers(this);
-	this->started = true;
 
 	return 0;
 }
 
+static int do_start(struct impl *this)
+{
+	int res;
+
+	if (this->started)
+		return 0;
+
+	this->slaved = is_slaved(this);
+
+        spa_log_debug(this->log, NAME " %p: start slaved:%d", this, this->slaved);
+
+	this->started = true;
+
+	/* the transport is usually acquired later, in transport_acquired() */
+	res = spa_bt_transport_acquire(this->transport, false);
+	if (res == -EINPROGRESS)
+		return 0;
+	if (res >= 0)
+		res = transport_start(this);
+	if (res < 0)
+		this->started = false;
+
+	return res;
+}
+
 static int do_remove_source(struct spa_loop *loop,
 			    bool async,
 			    uint32_t seq,
@@ -862,8 +969,6 @@ static int do_remove_source(struct spa_loop *loop,
 	ts.it_interval.tv_sec = 0;
 	ts.it_interval.tv_nsec = 0;
 	spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
-	if (this->flush_source.loop)
-		spa_loop_remove_source(this->data_loop, &this->flush_source);
 
 	return 0;
 }
@@ -879,6 +984,9 @@ static int do_stop(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
 
+	stop_encoder(this);
+	deinit_codec(this);
+
 	this->started = false;
 
 	if (this->transport)
@@ -918,23 +1026,6 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 	return 0;
 }
 
-static const struct spa_dict_item node_info_items[] = {
-	{ SPA_KEY_DEVICE_API, "bluez5" },
-	{ SPA_KEY_MEDIA_CLASS, "Audio/Sink" },
-	{ SPA_KEY_NODE_DRIVER, "true" },
-};
-
-static void emit_node_info(struct impl *this, bool full)
-{
-	if (full)
-		this->info.change_mask = this->info_all;
-	if (this->info.change_mask) {
-		this->info.props = &SPA_DICT_INIT_ARRAY(node_info_items);
-		spa_node_emit_info(&this->hooks, &this->info);
-		this->info.change_mask = 0;
-	}
-}
-
 static void emit_port_info(struct impl *this, struct port *port, bool full)
 {
 	if (full)
@@ -1033,48 +1124,20 @@ impl_node_port_enum_params(void *object, int seq,
 
 	switch (id) {
 	case SPA_PARAM_EnumFormat:
+	{
+		struct spa_audio_info info;
+
 		if (result.index > 0)
 			return 0;
 
-		switch (this->transport->codec) {
-		case A2DP_CODEC_SBC:
-		{
-			a2dp_sbc_t *config = this->transport->configuration;
-			struct spa_audio_info_raw info = { 0, };
-
-			info.format = SPA_AUDIO_FORMAT_S16;
-			if ((info.rate = a2dp_sbc_get_frequency(config)) < 0)
-				return -EIO;
-			if ((info.channels = a2dp_sbc_get_channels(config)) < 0)
-				return -EIO;
-
-			switch (info.channels) {
-			case 1:
-				info.position[0] = SPA_AUDIO_CHANNEL_MONO;
-				break;
-			case 2:
-				info.position[0] = SPA_AUDIO_CHANNEL_FL;
-				info.position[1] = SPA_AUDIO_CHANNEL_FR;
-				break;
-			default:
-				return -EIO;
-			}
-
-			param = spa_format_audio_raw_build(&b, id, &info);
-			break;
-		}
-		case A2DP_CODEC_MPEG24:
-		{
-			param = spa_pod_builder_add_object(&b,
-				SPA_TYPE_OBJECT_Format, id,
-				SPA_FORMAT_mediaType,     SPA_POD_Id(SPA_MEDIA_TYPE_audio),
-				SPA_FORMAT_mediaSubtype,  SPA_POD_Id(SPA_MEDIA_SUBTYPE_aac));
-			break;
-		}
-		default:
+		if (this->codec->validate_config(this->codec,
+				this->transport->configuration,
+				this->transport->configuration_len, &info) < 0)
 			return -EIO;
-		}
+
+		param = spa_format_audio_raw_build(&b, id, &info.info.raw);
 		break;
+	}
 
 	case SPA_PARAM_Format:
 		if (!port->have_format)
@@ -1164,7 +1227,16 @@ static int port_set_format(struct impl *this, struct port *port,
 		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 			return -EINVAL;
 
-		port->frame_size = info.info.raw.channels * 2;
+		switch (info.info.raw.format) {
+		case SPA_AUDIO_FORMAT_S16:
+			port->frame_size = info.info.raw.channels * 2;
+			break;
+		case SPA_AUDIO_FORMAT_S24:
+			port->frame_size = info.info.raw.channels * 3;
+			break;
+		default:
+			return -EINVAL;
+		}
 		port->current_format = info;
 		port->have_format = true;
 		this->threshold = this->props.min_latency;
@@ -1315,7 +1387,6 @@ static int impl_node_process(void *object)
 
 		spa_list_append(&port->ready, &b->link);
 		b->outstanding = false;
-		port->need_data = false;
 
 		this->threshold = SPA_MIN(b->buf->datas[0].chunk->size / port->frame_size,
 				this->props.max_latency);
@@ -1353,9 +1424,26 @@ static void transport_destroy(void *data)
 	this->transport = NULL;
 }
 
+static void transport_acquired(void *data, int res)
+{
+	struct impl *this = data;
+
+	if (!this->started || this->source.loop != NULL)
+		return;
+
+	if (res >= 0)
+		res = transport_start(this);
+	if (res < 0) {
+		spa_log_error(this->log, NAME " %p: can't start transport: %s",
+				this, spa_strerror(res));
+		this->started = false;
+	}
+}
+
 static const struct spa_bt_transport_events transport_events = {
 	SPA_VERSION_BT_TRANSPORT_EVENTS,
         .destroy = transport_destroy,
+        .acquired = transport_acquired,
 };
 
 static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
@@ -1465,13 +1553,23 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&port->ready);
 
 	for (i = 0; info && i < info->n_items; i++) {
+		const char *str = info->items[i].value;
 		if (strcmp(info->items[i].key, SPA_KEY_API_BLUEZ5_TRANSPORT) == 0)
-			sscanf(info->items[i].value, "pointer:%p", &this->transport);
+			sscanf(str, "pointer:%p", &this->transport);
+		else if (strcmp(info->items[i].key, SPA_KEY_API_BLUEZ5_LOW_LATENCY) == 0)
+			this->low_latency = strcmp(str, "true") == 0 || atoi(str) == 1;
 	}
 	if (this->transport == NULL) {
 		spa_log_error(this->log, "a transport is needed");
 		return -EINVAL;
 	}
+	this->codec = this->transport->a2dp_codec;
+	if (this->codec == NULL && this->transport->codec == A2DP_CODEC_SBC)
+		this->codec = &a2dp_codec_sbc;
+	if (this->codec == NULL) {
+		spa_log_error(this->log, "codec %d is not supported", this->transport->codec);
+		return -ENOTSUP;
+	}
 	spa_bt_transport_add_listener(this->transport,
 			&this->transport_listener, &transport_events, this);
 
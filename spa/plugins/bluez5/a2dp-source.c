@@ -451,7 +451,11 @@ static int transport_start(struct impl *this)
 {
 	int res, val;
 
-	if ((res = spa_bt_transport_acquire(this->transport, false)) < 0)
+	/* when in progress, this is called again from transport_acquired() */
+	res = spa_bt_transport_acquire(this->transport, false);
+	if (res == -EINPROGRESS)
+		return 0;
+	if (res < 0)
 		return res;
 
 	sbc_init_a2dp(&this->sbc, 0, this->transport->configuration,
@@ -1042,10 +1046,25 @@ static void transport_state_changed(void *data, enum spa_bt_transport_state old,
 	}
 }
 
+static void transport_acquired(void *data, int res)
+{
+	struct impl *this = data;
+
+	if (!this->started || this->source.loop != NULL)
+		return;
+
+	if (res >= 0)
+		res = transport_start(this);
+	if (res < 0)
+		spa_log_error(this->log, NAME" %p: can't start transport: %s",
+				this, spa_strerror(res));
+}
+
 static const struct spa_bt_transport_events transport_events = {
 	SPA_VERSION_BT_TRANSPORT_EVENTS,
         .destroy = transport_destroy,
         .state_changed = transport_state_changed,
+        .acquired = transport_acquired,
 };
 
 static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <fcntl.h>
 
 #include <bluetooth/bluetooth.h>
@@ -47,6 +48,7 @@
 #include <spa/utils/type.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 
 #include "a2dp-codecs.h"
 #include "defs.h"
@@ -72,6 +74,11 @@ struct spa_bt_monitor {
 	struct spa_list device_list;
 	struct spa_list transport_list;
 
+	/* the GetManagedObjects() reply, parsed in batches from the main loop */
+	DBusMessage *objects_reply;
+	DBusMessageIter objects_iter;
+	struct spa_source objects_source;
+
 	unsigned int filters_added:1;
 };
 
@@ -86,202 +93,31 @@ static inline void add_dict(struct spa_pod_builder *builder, const char *key, co
 	spa_pod_builder_string(builder, val);
 }
 
-static uint8_t a2dp_default_bitpool(struct spa_bt_monitor *monitor, uint8_t freq, uint8_t mode) {
-	/* These bitpool values were chosen based on the A2DP spec recommendation */
-	switch (freq) {
-	case SBC_SAMPLING_FREQ_16000:
-        case SBC_SAMPLING_FREQ_32000:
-		return 53;
-
-	case SBC_SAMPLING_FREQ_44100:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 31;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 53;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 53;
-	case SBC_SAMPLING_FREQ_48000:
-		switch (mode) {
-		case SBC_CHANNEL_MODE_MONO:
-		case SBC_CHANNEL_MODE_DUAL_CHANNEL:
-			return 29;
-
-		case SBC_CHANNEL_MODE_STEREO:
-		case SBC_CHANNEL_MODE_JOINT_STEREO:
-			return 51;
-		}
-
-		spa_log_warn(monitor->log, "Invalid channel mode %u", mode);
-		return 51;
-	}
-	spa_log_warn(monitor->log, "Invalid sampling freq %u", freq);
-	return 53;
-}
-
-static int select_configuration_sbc(struct spa_bt_monitor *monitor, void *capabilities, size_t size, void *config)
-{
-	a2dp_sbc_t *cap, conf;
-	int bitpool;
-
-	if (size < sizeof(conf)) {
-		spa_log_error(monitor->log, "Capabilities array has invalid size");
-		return -ENOSPC;
-	}
-	cap = capabilities;
-	conf = *cap;
-
-	if (conf.frequency & SBC_SAMPLING_FREQ_48000)
-		conf.frequency = SBC_SAMPLING_FREQ_48000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_44100)
-		conf.frequency = SBC_SAMPLING_FREQ_44100;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_32000)
-		conf.frequency = SBC_SAMPLING_FREQ_32000;
-	else if (conf.frequency & SBC_SAMPLING_FREQ_16000)
-		conf.frequency = SBC_SAMPLING_FREQ_16000;
-	else {
-		spa_log_error(monitor->log, "No supported sampling frequencies: 0x%x", conf.frequency);
-		return -ENOTSUP;
-	}
-
-	if (conf.channel_mode & SBC_CHANNEL_MODE_JOINT_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_STEREO)
-		conf.channel_mode = SBC_CHANNEL_MODE_STEREO;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_DUAL_CHANNEL)
-		conf.channel_mode = SBC_CHANNEL_MODE_DUAL_CHANNEL;
-	else if (conf.channel_mode & SBC_CHANNEL_MODE_MONO)
-		conf.channel_mode = SBC_CHANNEL_MODE_MONO;
-	else {
-		spa_log_error(monitor->log, "No supported channel modes: 0x%x", conf.channel_mode);
-		return -ENOTSUP;
-	}
-
-	if (conf.block_length & SBC_BLOCK_LENGTH_16)
-		conf.block_length = SBC_BLOCK_LENGTH_16;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_12)
-		conf.block_length = SBC_BLOCK_LENGTH_12;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_8)
-		conf.block_length = SBC_BLOCK_LENGTH_8;
-	else if (conf.block_length & SBC_BLOCK_LENGTH_4)
-		conf.block_length = SBC_BLOCK_LENGTH_4;
-	else {
-		spa_log_error(monitor->log, "No supported block lengths: 0x%x", conf.block_length);
-		return -ENOTSUP;
-	}
-
-	if (conf.subbands & SBC_SUBBANDS_8)
-		conf.subbands = SBC_SUBBANDS_8;
-	else if (conf.subbands & SBC_SUBBANDS_4)
-		conf.subbands = SBC_SUBBANDS_4;
-	else {
-		spa_log_error(monitor->log, "No supported subbands: 0x%x", conf.subbands);
-		return -ENOTSUP;
-	}
-
-	if (conf.allocation_method & SBC_ALLOCATION_LOUDNESS)
-		conf.allocation_method = SBC_ALLOCATION_LOUDNESS;
-	else if (conf.allocation_method & SBC_ALLOCATION_SNR)
-		conf.allocation_method = SBC_ALLOCATION_SNR;
-	else {
-		spa_log_error(monitor->log, "No supported allocation: 0x%x", conf.allocation_method);
-		return -ENOTSUP;
-	}
-
-	bitpool = a2dp_default_bitpool(monitor, conf.frequency, conf.channel_mode);
-
-	conf.min_bitpool = SPA_MAX(MIN_BITPOOL, conf.min_bitpool);
-	conf.max_bitpool = SPA_MIN(bitpool, conf.max_bitpool);
-	memcpy(config, &conf, size);
-
-	spa_log_debug(monitor->log, "SelectConfiguration(): %d %d %d %d ",
-			conf.frequency, conf.channel_mode, conf.min_bitpool, conf.max_bitpool);
-
-	return 0;
-}
-
-static int select_configuration_aac(struct spa_bt_monitor *monitor, void *capabilities, size_t size, void *config)
+/* endpoint paths are /A2DP/<codec name>/<Source|Sink>/<n> */
+static const struct a2dp_codec *a2dp_endpoint_to_codec(const char *path)
 {
-	a2dp_aac_t *cap, conf;
-	int freq;
-
-	if (size < sizeof(conf)) {
-		spa_log_error(monitor->log, "Capabilities array has invalid size");
-		return -ENOSPC;
-	}
-	cap = capabilities;
-	conf = *cap;
-
-	if (conf.object_type & AAC_OBJECT_TYPE_MPEG2_AAC_LC)
-		conf.object_type = AAC_OBJECT_TYPE_MPEG2_AAC_LC;
-	else if (conf.object_type & AAC_OBJECT_TYPE_MPEG4_AAC_LC)
-		conf.object_type = AAC_OBJECT_TYPE_MPEG4_AAC_LC;
-	else if (conf.object_type & AAC_OBJECT_TYPE_MPEG4_AAC_LTP)
-		conf.object_type = AAC_OBJECT_TYPE_MPEG4_AAC_LTP;
-	else if (conf.object_type & AAC_OBJECT_TYPE_MPEG4_AAC_SCA)
-		conf.object_type = AAC_OBJECT_TYPE_MPEG4_AAC_SCA;
-	else {
-		spa_log_error(monitor->log, "No supported object type: 0x%x", conf.object_type);
-		return -ENOTSUP;
-	}
+	const char *name;
+	size_t i, len;
 
-	freq = AAC_GET_FREQUENCY(conf);
-	if (freq & AAC_SAMPLING_FREQ_48000)
-		freq = AAC_SAMPLING_FREQ_48000;
-	else if (freq & AAC_SAMPLING_FREQ_44100)
-		freq = AAC_SAMPLING_FREQ_44100;
-	else if (freq & AAC_SAMPLING_FREQ_64000)
-		freq = AAC_SAMPLING_FREQ_64000;
-	else if (freq & AAC_SAMPLING_FREQ_32000)
-		freq = AAC_SAMPLING_FREQ_32000;
-	else if (freq & AAC_SAMPLING_FREQ_88200)
-		freq = AAC_SAMPLING_FREQ_88200;
-	else if (freq & AAC_SAMPLING_FREQ_96000)
-		freq = AAC_SAMPLING_FREQ_96000;
-	else if (freq & AAC_SAMPLING_FREQ_24000)
-		freq = AAC_SAMPLING_FREQ_24000;
-	else if (freq & AAC_SAMPLING_FREQ_22050)
-		freq = AAC_SAMPLING_FREQ_22050;
-	else if (freq & AAC_SAMPLING_FREQ_16000)
-		freq = AAC_SAMPLING_FREQ_16000;
-	else if (freq & AAC_SAMPLING_FREQ_12000)
-		freq = AAC_SAMPLING_FREQ_12000;
-	else if (freq & AAC_SAMPLING_FREQ_11025)
-		freq = AAC_SAMPLING_FREQ_11025;
-	else if (freq & AAC_SAMPLING_FREQ_8000)
-		freq = AAC_SAMPLING_FREQ_8000;
-	else {
-		spa_log_error(monitor->log, "No supported sampling frequency: 0x%0x", freq);
-		return -ENOTSUP;
-	}
-	AAC_SET_FREQUENCY(conf, freq);
+	if (strstr(path, "/A2DP/") != path)
+		return NULL;
 
-	if (conf.channels & AAC_CHANNELS_2)
-		conf.channels = AAC_CHANNELS_2;
-	else if (conf.channels & AAC_CHANNELS_1)
-		conf.channels = AAC_CHANNELS_1;
-	else {
-		spa_log_error(monitor->log, "No supported channels: 0x%0x", conf.channels);
-		return -ENOTSUP;
+	name = path + strlen("/A2DP/");
+	for (i = 0; a2dp_codecs[i]; i++) {
+		len = strlen(a2dp_codecs[i]->name);
+		if (strncmp(name, a2dp_codecs[i]->name, len) == 0 && name[len] == '/')
+			return a2dp_codecs[i];
 	}
-	memcpy(config, &conf, size);
-
-	spa_log_debug(monitor->log, "SelectConfiguration() %d %d %d", conf.object_type, freq, conf.channels);
-
-	return 0;
+	return NULL;
 }
 
 static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBusMessage *m, void *userdata)
 {
 	struct spa_bt_monitor *monitor = userdata;
 	const char *path;
-	uint8_t *cap, config[16];
+	uint8_t *cap, config[A2DP_MAX_CAPS_SIZE];
 	uint8_t *pconf = (uint8_t *) config;
+	const struct a2dp_codec *codec;
 	DBusMessage *r;
 	DBusError err;
 	int size, res;
@@ -297,20 +133,22 @@ static DBusHandlerResult endpoint_select_configuration(DBusConnection *conn, DBu
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 	}
 
-	if (strstr(path, "/A2DP/SBC/") == path) {
-		res = select_configuration_sbc(monitor, cap, size, config);
-	} else if (strstr(path, "/A2DP/MPEG24/") == path) {
-		res = select_configuration_aac(monitor, cap, size, config);
-	} else
+	if ((codec = a2dp_endpoint_to_codec(path)) != NULL)
+		res = codec->select_config(codec, cap, size, config);
+	else
 		res = -ENOTSUP;
 
 	if (res < 0) {
+		spa_log_error(monitor->log, "Endpoint %s: can't select configuration: %s",
+				path, spa_strerror(res));
 		if ((r = dbus_message_new_error(m, "org.bluez.Error.InvalidArguments",
 				"Unable to select configuration")) == NULL)
 			return DBUS_HANDLER_RESULT_NEED_MEMORY;
 		goto exit_send;
 	}
 
+	size = res;
+
 	if ((r = dbus_message_new_method_return(m)) == NULL)
 		return DBUS_HANDLER_RESULT_NEED_MEMORY;
 	if (!dbus_message_append_args(r, DBUS_TYPE_ARRAY,
@@ -822,6 +660,18 @@ static void transport_set_state(struct spa_bt_transport *transport, enum spa_bt_
 	}
 }
 
+static void transport_cancel_acquire(struct spa_bt_transport *transport)
+{
+	DBusPendingCall *call = transport->acquire_call;
+
+	if (call == NULL)
+		return;
+
+	transport->acquire_call = NULL;
+	dbus_pending_call_cancel(call);
+	dbus_pending_call_unref(call);
+}
+
 static void transport_free(struct spa_bt_transport *transport)
 {
 	struct spa_bt_monitor *monitor = transport->monitor;
@@ -832,6 +682,7 @@ static void transport_free(struct spa_bt_transport *transport)
 
 	spa_bt_transport_emit_destroy(transport);
 
+	transport_cancel_acquire(transport);
 	spa_bt_transport_destroy(transport);
 
 	spa_list_remove(&transport->link);
@@ -931,46 +782,33 @@ static int transport_update_props(struct spa_bt_transport *transport,
 	return 0;
 }
 
-static int transport_acquire(void *data, bool optional)
+static void transport_acquire_reply(DBusPendingCall *pending, void *user_data)
 {
-	struct spa_bt_transport *transport = data;
+	struct spa_bt_transport *transport = user_data;
 	struct spa_bt_monitor *monitor = transport->monitor;
-	DBusMessage *m, *r;
+	DBusMessage *r;
 	DBusError err;
 	int ret = 0;
-	const char *method = optional ? "TryAcquire" : "Acquire";
 
-	if (transport->fd >= 0)
-		return 0;
+	r = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	transport->acquire_call = NULL;
 
-	m = dbus_message_new_method_call(BLUEZ_SERVICE,
-					 transport->path,
-					 BLUEZ_MEDIA_TRANSPORT_INTERFACE,
-					 method);
-	if (m == NULL)
-		return -ENOMEM;
+	if (r == NULL)
+		return;
 
 	dbus_error_init(&err);
 
-	r = dbus_connection_send_with_reply_and_block(monitor->conn, m, -1, &err);
-	dbus_message_unref(m);
-	m = NULL;
-
-	if (r == NULL) {
-		if (optional && strcmp(err.name, "org.bluez.Error.NotAvailable") == 0) {
+	if (dbus_message_get_type(r) == DBUS_MESSAGE_TYPE_ERROR) {
+		if (transport->acquire_optional &&
+		    dbus_message_is_error(r, "org.bluez.Error.NotAvailable")) {
 			spa_log_info(monitor->log, "Failed optional acquire of unavailable transport %s",
 					transport->path);
 		}
 		else {
-			spa_log_error(monitor->log, "Transport %s() failed for transport %s (%s)",
-					method, transport->path, err.message);
+			spa_log_error(monitor->log, "Acquire() failed for transport %s: %s",
+					transport->path, dbus_message_get_error_name(r));
 		}
-		dbus_error_free(&err);
-		return -EIO;
-	}
-
-	if (dbus_message_get_type(r) == DBUS_MESSAGE_TYPE_ERROR) {
-		spa_log_error(monitor->log, "%s returned error: %s", method, dbus_message_get_error_name(r));
 		ret = -EIO;
 		goto finish;
 	}
@@ -980,25 +818,81 @@ static int transport_acquire(void *data, bool optional)
 				   DBUS_TYPE_UINT16, &transport->read_mtu,
 				   DBUS_TYPE_UINT16, &transport->write_mtu,
 				   DBUS_TYPE_INVALID)) {
-		spa_log_error(monitor->log, "Failed to parse %s() reply: %s", method, err.message);
+		spa_log_error(monitor->log, "Failed to parse Acquire() reply: %s", err.message);
 		dbus_error_free(&err);
 		ret = -EIO;
 		goto finish;
 	}
-	spa_log_debug(monitor->log, "transport %p: %s %s, fd %d MTU %d:%d", transport, method,
+	spa_log_debug(monitor->log, "transport %p: acquired %s, fd %d MTU %d:%d", transport,
 			transport->path, transport->fd, transport->read_mtu, transport->write_mtu);
 
 finish:
 	dbus_message_unref(r);
-	return ret;
+	spa_bt_transport_emit_acquired(transport, ret);
+}
+
+/* the reply is handled in the main loop, the acquired event is emitted with
+ * the result. Returns 0 when the transport was already acquired. */
+static int transport_acquire(void *data, bool optional)
+{
+	struct spa_bt_transport *transport = data;
+	struct spa_bt_monitor *monitor = transport->monitor;
+	DBusMessage *m;
+	DBusPendingCall *call;
+	const char *method = optional ? "TryAcquire" : "Acquire";
+
+	if (transport->fd >= 0)
+		return 0;
+	if (transport->acquire_call != NULL)
+		return -EINPROGRESS;
+
+	m = dbus_message_new_method_call(BLUEZ_SERVICE,
+					 transport->path,
+					 BLUEZ_MEDIA_TRANSPORT_INTERFACE,
+					 method);
+	if (m == NULL)
+		return -ENOMEM;
+
+	if (!dbus_connection_send_with_reply(monitor->conn, m, &call, -1) || call == NULL) {
+		dbus_message_unref(m);
+		return -EIO;
+	}
+	dbus_message_unref(m);
+
+	spa_log_debug(monitor->log, "transport %p: %s %s", transport, method, transport->path);
+
+	transport->acquire_call = call;
+	transport->acquire_optional = optional;
+	dbus_pending_call_set_notify(call, transport_acquire_reply, transport, NULL);
+
+	return -EINPROGRESS;
+}
+
+static void transport_release_reply(DBusPendingCall *pending, void *user_data)
+{
+	struct spa_bt_monitor *monitor = user_data;
+	DBusMessage *r;
+
+	r = dbus_pending_call_steal_reply(pending);
+	dbus_pending_call_unref(pending);
+	if (r == NULL)
+		return;
+
+	if (dbus_message_get_type(r) == DBUS_MESSAGE_TYPE_ERROR)
+		spa_log_error(monitor->log, "Failed to release transport: %s",
+				dbus_message_get_error_name(r));
+
+	dbus_message_unref(r);
 }
 
 static int transport_release(void *data)
 {
 	struct spa_bt_transport *transport = data;
 	struct spa_bt_monitor *monitor = transport->monitor;
-	DBusMessage *m, *r;
-	DBusError err;
+	DBusMessage *m;
+	DBusPendingCall *call;
+
+	transport_cancel_acquire(transport);
 
 	if (transport->fd < 0)
 		return 0;
@@ -1016,22 +910,10 @@ static int transport_release(void *data)
 	if (m == NULL)
 		return -ENOMEM;
 
-	dbus_error_init(&err);
-
-	r = dbus_connection_send_with_reply_and_block(monitor->conn, m, -1, &err);
+	/* nothing waits for the release, errors are only logged */
+	if (dbus_connection_send_with_reply(monitor->conn, m, &call, -1) && call != NULL)
+		dbus_pending_call_set_notify(call, transport_release_reply, monitor, NULL);
 	dbus_message_unref(m);
-	m = NULL;
-
-	if (r != NULL)
-		dbus_message_unref(r);
-
-	if (dbus_error_is_set(&err)) {
-		spa_log_error(monitor->log, "Failed to release transport %s: %s",
-				transport->path, err.message);
-		dbus_error_free(&err);
-	}
-	else
-		spa_log_info(monitor->log, "Transport %s released", transport->path);
 
 	return 0;
 }
@@ -1072,6 +954,7 @@ static DBusHandlerResult endpoint_set_configuration(DBusConnection *conn,
 
 		spa_bt_transport_set_implementation(transport, &transport_impl, transport);
 	}
+	transport->a2dp_codec = a2dp_endpoint_to_codec(path);
 	transport_update_props(transport, &it[1], NULL);
 
 	if (transport->device == NULL) {
@@ -1218,9 +1101,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 				  const char *path,
 				  const char *uuid,
 				  enum spa_bt_profile profile,
-				  uint16_t codec,
-				  const void *configuration,
-				  size_t configuration_size)
+				  const struct a2dp_codec *codec)
 {
 	const char *profile_path;
 	char *object_path, *str;
@@ -1230,42 +1111,24 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	DBusMessage *m;
 	DBusMessageIter it[5];
 	DBusPendingCall *call;
+	uint8_t caps[A2DP_MAX_CAPS_SIZE], *pcaps = caps;
+	int caps_size;
 
 	switch (profile) {
 	case SPA_BT_PROFILE_A2DP_SOURCE:
-		switch (codec) {
-		case A2DP_CODEC_SBC:
-			profile_path = "/A2DP/SBC/Source";
-			break;
-		case A2DP_CODEC_MPEG24:
-			/* We don't support MPEG24 for now */
-			return -ENOTSUP;
-			/* profile_path = "/A2DP/MPEG24/Source";
-			break; */
-		default:
-			return -ENOTSUP;
-		}
+		profile_path = "Source";
 		break;
 	case SPA_BT_PROFILE_A2DP_SINK:
-		switch (codec) {
-		case A2DP_CODEC_SBC:
-			profile_path = "/A2DP/SBC/Sink";
-			break;
-
-		case A2DP_CODEC_MPEG24:
-			/* We don't support MPEG24 for now */
-			return -ENOTSUP;
-			/* profile_path = "/A2DP/MPEG24/Sink";
-			break; */
-		default:
-			return -ENOTSUP;
-		}
+		profile_path = "Sink";
 		break;
 	default:
 		return -ENOTSUP;
 	}
 
-	asprintf(&object_path, "%s/%d", profile_path, monitor->count++);
+	if ((caps_size = codec->fill_caps(codec, caps)) < 0)
+		return caps_size;
+
+	asprintf(&object_path, "/A2DP/%s/%s/%d", codec->name, profile_path, monitor->count++);
 
 	spa_log_debug(monitor->log, "Registering endpoint: %s", object_path);
 
@@ -1298,7 +1161,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	str = "Codec";
 	dbus_message_iter_append_basic(&it[2], DBUS_TYPE_STRING, &str);
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "y", &it[3]);
-	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec);
+	dbus_message_iter_append_basic(&it[3], DBUS_TYPE_BYTE, &codec->codec_id);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
 
@@ -1308,7 +1171,7 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 	dbus_message_iter_open_container(&it[2], DBUS_TYPE_VARIANT, "ay", &it[3]);
 	dbus_message_iter_open_container(&it[3], DBUS_TYPE_ARRAY, "y", &it[4]);
 	dbus_message_iter_append_fixed_array (&it[4], DBUS_TYPE_BYTE,
-			&configuration, configuration_size);
+			&pcaps, caps_size);
 	dbus_message_iter_close_container(&it[3], &it[4]);
 	dbus_message_iter_close_container(&it[2], &it[3]);
 	dbus_message_iter_close_container(&it[1], &it[2]);
@@ -1324,31 +1187,20 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 static int adapter_register_endpoints(struct spa_bt_adapter *a)
 {
 	struct spa_bt_monitor *monitor = a->monitor;
+	int i;
 
-	/* We don't support MPEG24 for now */
-	/*
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SOURCE,
-			       SPA_BT_PROFILE_A2DP_SOURCE,
-			       A2DP_CODEC_MPEG24,
-			       &bluez_a2dp_aac, sizeof(bluez_a2dp_aac));
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SINK,
-			       SPA_BT_PROFILE_A2DP_SINK,
-			       A2DP_CODEC_MPEG24,
-			       &bluez_a2dp_aac, sizeof(bluez_a2dp_aac));
-	*/
+	/* the codecs are only used for encoding, the a2dp source
+	 * node can only decode SBC */
+	for (i = 0; a2dp_codecs[i]; i++)
+		register_a2dp_endpoint(monitor, a->path,
+				       SPA_BT_UUID_A2DP_SOURCE,
+				       SPA_BT_PROFILE_A2DP_SOURCE,
+				       a2dp_codecs[i]);
 
-	register_a2dp_endpoint(monitor, a->path,
-			       SPA_BT_UUID_A2DP_SOURCE,
-			       SPA_BT_PROFILE_A2DP_SOURCE,
-			       A2DP_CODEC_SBC,
-			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
 	register_a2dp_endpoint(monitor, a->path,
 			       SPA_BT_UUID_A2DP_SINK,
 			       SPA_BT_PROFILE_A2DP_SINK,
-			       A2DP_CODEC_SBC,
-			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+			       &a2dp_codec_sbc);
 	return 0;
 }
 
@@ -1458,6 +1310,24 @@ fail:
 	return -1;
 }
 
+/* mSBC frames are passed to the controller without transcoding */
+static int sco_set_voice(struct spa_bt_transport *t, int sock)
+{
+	struct spa_bt_monitor *monitor = t->monitor;
+	struct bt_voice voice;
+
+	if (t->codec != HFP_AUDIO_CODEC_MSBC)
+		return 0;
+
+	memset(&voice, 0, sizeof(voice));
+	voice.setting = BT_VOICE_TRANSPARENT;
+	if (setsockopt(sock, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice)) < 0) {
+		spa_log_error(monitor->log, "setsockopt(BT_VOICE): %m");
+		return -errno;
+	}
+	return 0;
+}
+
 static int sco_do_connect(struct spa_bt_transport *t)
 {
 	struct spa_bt_monitor *monitor = t->monitor;
@@ -1498,6 +1368,9 @@ static int sco_do_connect(struct spa_bt_transport *t)
 		goto fail_close;
 	}
 
+	if (sco_set_voice(t, sock) < 0)
+		goto fail_close;
+
 	memset(&addr, 0, len);
 	addr.sco_family = AF_BLUETOOTH;
 	bacpy(&addr.sco_bdaddr, &dst);
@@ -1618,6 +1491,9 @@ static int sco_listen(struct spa_bt_transport *t)
 		goto fail_close;
 	}
 
+	if (sco_set_voice(t, sock) < 0)
+		goto fail_close;
+
 	spa_log_info(monitor->log, "transport %p: doing listen", t);
 	if (listen(sock, 1) < 0) {
 		spa_log_error(monitor->log, "listen(): %m");
@@ -1724,6 +1600,8 @@ static DBusHandlerResult profile_new_connection(DBusConnection *conn, DBusMessag
 	t->device = d;
 	spa_list_append(&t->device->transport_list, &t->device_link);
 	t->profile = profile;
+	/* only the HSP commands are handled, there is no codec negotiation yet */
+	t->codec = HFP_AUDIO_CODEC_CVSD;
 
 	td = t->user_data;
 	td->rfcomm.func = rfcomm_event;
@@ -1979,11 +1857,79 @@ static void interface_added(struct spa_bt_monitor *monitor,
 	}
 }
 
+#define OBJECTS_PER_BATCH	8
+
+static void stop_parse_objects(struct spa_bt_monitor *monitor)
+{
+	if (monitor->objects_source.loop)
+		spa_loop_remove_source(monitor->main_loop, &monitor->objects_source);
+	if (monitor->objects_source.fd >= 0)
+		close(monitor->objects_source.fd);
+	monitor->objects_source.fd = -1;
+	if (monitor->objects_reply)
+		dbus_message_unref(monitor->objects_reply);
+	monitor->objects_reply = NULL;
+}
+
+/* handle the next objects of the reply, returns true when there are more */
+static bool parse_objects(struct spa_bt_monitor *monitor)
+{
+	DBusMessageIter *iter = &monitor->objects_iter, it[4];
+	int n_objects;
+
+	for (n_objects = 0; n_objects < OBJECTS_PER_BATCH; n_objects++) {
+		const char *object_path;
+
+		if (dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_INVALID)
+			return false;
+
+		dbus_message_iter_recurse(iter, &it[0]);
+		dbus_message_iter_get_basic(&it[0], &object_path);
+		dbus_message_iter_next(&it[0]);
+		dbus_message_iter_recurse(&it[0], &it[1]);
+
+		while (dbus_message_iter_get_arg_type(&it[1]) != DBUS_TYPE_INVALID) {
+			const char *interface_name;
+
+			dbus_message_iter_recurse(&it[1], &it[2]);
+			dbus_message_iter_get_basic(&it[2], &interface_name);
+			dbus_message_iter_next(&it[2]);
+			dbus_message_iter_recurse(&it[2], &it[3]);
+
+			interface_added(monitor, monitor->conn,
+					object_path, interface_name,
+					&it[3]);
+
+			dbus_message_iter_next(&it[1]);
+		}
+		dbus_message_iter_next(iter);
+	}
+	return dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_INVALID;
+}
+
+static void parse_objects_event(struct spa_source *source)
+{
+	struct spa_bt_monitor *monitor = source->data;
+	uint64_t count;
+
+	if (read(source->fd, &count, sizeof(count)) != sizeof(count))
+		spa_log_warn(monitor->log, "error reading eventfd: %m");
+
+	if (parse_objects(monitor)) {
+		count = 1;
+		if (write(source->fd, &count, sizeof(count)) == sizeof(count))
+			return;
+		spa_log_warn(monitor->log, "error writing eventfd: %m");
+	}
+	stop_parse_objects(monitor);
+}
+
 static void get_managed_objects_reply(DBusPendingCall *pending, void *user_data)
 {
 	struct spa_bt_monitor *monitor = user_data;
 	DBusMessage *r;
-	DBusMessageIter it[6];
+	DBusMessageIter it;
+	uint64_t count = 1;
 
 	r = dbus_pending_call_steal_reply(pending);
 	if (r == NULL)
@@ -2000,41 +1946,39 @@ static void get_managed_objects_reply(DBusPendingCall *pending, void *user_data)
 		goto finish;
 	}
 
-	if (!dbus_message_iter_init(r, &it[0]) ||
+	if (!dbus_message_iter_init(r, &it) ||
 	    strcmp(dbus_message_get_signature(r), "a{oa{sa{sv}}}") != 0) {
 		spa_log_error(monitor->log, "Invalid reply signature for GetManagedObjects()");
 		goto finish;
 	}
 
-	dbus_message_iter_recurse(&it[0], &it[1]);
-
-	while (dbus_message_iter_get_arg_type(&it[1]) != DBUS_TYPE_INVALID) {
-		const char *object_path;
+	stop_parse_objects(monitor);
+	dbus_message_iter_recurse(&it, &monitor->objects_iter);
 
-		dbus_message_iter_recurse(&it[1], &it[2]);
-		dbus_message_iter_get_basic(&it[2], &object_path);
-		dbus_message_iter_next(&it[2]);
-		dbus_message_iter_recurse(&it[2], &it[3]);
-
-		while (dbus_message_iter_get_arg_type(&it[3]) != DBUS_TYPE_INVALID) {
-			const char *interface_name;
-
-			dbus_message_iter_recurse(&it[3], &it[4]);
-			dbus_message_iter_get_basic(&it[4], &interface_name);
-			dbus_message_iter_next(&it[4]);
-			dbus_message_iter_recurse(&it[4], &it[5]);
-
-			interface_added(monitor, monitor->conn,
-					object_path, interface_name,
-					&it[5]);
+	/* with many paired devices, the reply is parsed in batches so that
+	 * other events can run in between */
+	if (!parse_objects(monitor))
+		goto finish;
 
-			dbus_message_iter_next(&it[3]);
-		}
-		dbus_message_iter_next(&it[1]);
+	monitor->objects_source.data = monitor;
+	monitor->objects_source.func = parse_objects_event;
+	monitor->objects_source.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	monitor->objects_source.mask = SPA_IO_IN;
+	monitor->objects_source.rmask = 0;
+	if (monitor->objects_source.fd < 0 ||
+	    write(monitor->objects_source.fd, &count, sizeof(count)) != sizeof(count)) {
+		spa_log_warn(monitor->log, "can't defer object parsing: %m");
+		while (parse_objects(monitor));
+		stop_parse_objects(monitor);
+		goto finish;
 	}
+	monitor->objects_reply = r;
+	r = NULL;
+	spa_loop_add_source(monitor->main_loop, &monitor->objects_source);
 
       finish:
-	dbus_message_unref(r);
+	if (r)
+		dbus_message_unref(r);
         dbus_pending_call_unref(pending);
 	return;
 }
@@ -2219,6 +2163,9 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct spa_bt_monitor *monitor = (struct spa_bt_monitor *) handle;
+
+	stop_parse_objects(monitor);
 	return 0;
 }
 
@@ -2282,6 +2229,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&this->adapter_list);
 	spa_list_init(&this->device_list);
 	spa_list_init(&this->transport_list);
+	this->objects_source.fd = -1;
 
 	return 0;
 }
@@ -107,6 +107,24 @@ extern "C" {
 
 #define HSP_HS_DEFAULT_CHANNEL  3
 
+#define HFP_AUDIO_CODEC_CVSD	0x01
+#define HFP_AUDIO_CODEC_MSBC	0x02
+
+/* an mSBC packet is a 2 byte H2 header, one frame and a padding byte */
+#define MSBC_DECODED_SIZE	240
+#define MSBC_ENCODED_SIZE	57
+#define MSBC_PACKET_SIZE	60
+#define MSBC_H2_SYNC		0x01
+#define MSBC_H2_SEQ(n)		((const uint8_t[]) { 0x08, 0x38, 0xc8, 0xf8 })[(n) & 3]
+
+/* the sequence number is sent twice, in bits 4-5 and 6-7 of the second byte */
+static inline bool msbc_is_h2_header(const uint8_t *p)
+{
+	return p[0] == MSBC_H2_SYNC && (p[1] & 0x0f) == 0x08 &&
+		((p[1] >> 4) & 1) == ((p[1] >> 5) & 1) &&
+		((p[1] >> 6) & 1) == ((p[1] >> 7) & 1);
+}
+
 enum spa_bt_profile {
         SPA_BT_PROFILE_NULL =		0,
         SPA_BT_PROFILE_A2DP_SOURCE =	(1 << 0),
@@ -161,6 +179,7 @@ static inline const char *spa_bt_profile_name (enum spa_bt_profile profile) {
 }
 
 struct spa_bt_monitor;
+struct a2dp_codec;
 
 struct spa_bt_adapter {
 	struct spa_list link;
@@ -212,6 +231,8 @@ struct spa_bt_transport_events {
 	void (*destroy) (void *data);
 	void (*state_changed) (void *data, enum spa_bt_transport_state old,
 			enum spa_bt_transport_state state);
+	/** an asynchronous acquire completed, the fd is valid when res is 0 */
+	void (*acquired) (void *data, int res);
 };
 
 struct spa_bt_transport_implementation {
@@ -232,10 +253,13 @@ struct spa_bt_transport {
 	enum spa_bt_profile profile;
 	enum spa_bt_transport_state state;
 	int codec;
+	const struct a2dp_codec *a2dp_codec;
 	void *configuration;
 	int configuration_len;
 
 	bool acquired;
+	void *acquire_call;		/* pending D-Bus acquire */
+	bool acquire_optional;
 	int fd;
 	uint16_t read_mtu;
 	uint16_t write_mtu;
@@ -250,6 +274,7 @@ struct spa_bt_transport {
 								m, v, ##__VA_ARGS__)
 #define spa_bt_transport_emit_destroy(t)		spa_bt_transport_emit(t, destroy, 0)
 #define spa_bt_transport_emit_state_changed(t,...)	spa_bt_transport_emit(t, state_changed, 0, __VA_ARGS__)
+#define spa_bt_transport_emit_acquired(t,r)		spa_bt_transport_emit(t, acquired, 0, r)
 
 #define spa_bt_transport_add_listener(t,listener,events,data) \
         spa_hook_list_append(&(t)->listener_list, listener, events, data)
@@ -266,6 +291,7 @@ struct spa_bt_transport {
 	res;						\
 })
 
+/* returns -EINPROGRESS when the result comes later with the acquired event */
 #define spa_bt_transport_acquire(t,o)	spa_bt_transport_impl(t, acquire, 0, o)
 #define spa_bt_transport_release(t)	spa_bt_transport_impl(t, release, 0)
 #define spa_bt_transport_destroy(t)	spa_bt_transport_impl(t, destroy, 0)
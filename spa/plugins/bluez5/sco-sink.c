@@ -35,6 +35,7 @@
 #include <spa/utils/list.h>
 #include <spa/utils/keys.h>
 #include <spa/utils/names.h>
+#include <spa/utils/result.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -45,6 +46,8 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
+#include <sbc/sbc.h>
+
 #include "defs.h"
 
 struct props {
@@ -55,6 +58,11 @@ struct props {
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
 
+#define DEFAULT_MTU	48
+#define MAX_BATCH	8		/* packets sent in one call */
+#define MAX_MTU		512
+#define OUT_BUFFER_SIZE	(MAX_BATCH * MAX_MTU)
+
 struct buffer {
 	uint32_t id;
 	unsigned int outstanding:1;
@@ -78,6 +86,7 @@ struct port {
 
 	struct spa_list free;
 	struct spa_list ready;
+	uint32_t ready_offset;
 
 	unsigned int need_data:1;
 };
@@ -112,6 +121,18 @@ struct impl {
 	/* Flags */
 	unsigned int started:1;
 	unsigned int slaved:1;
+	unsigned int msbc:1;
+
+	/* mSBC encoder, fed with one frame of samples at a time */
+	sbc_t msbc_enc;
+	uint8_t msbc_seq;
+	uint8_t pcm_buf[MSBC_DECODED_SIZE];
+	uint32_t pcm_size;
+
+	/* Data waiting to be sent in packets of mtu bytes */
+	uint32_t mtu;
+	uint8_t out_buf[OUT_BUFFER_SIZE];
+	uint32_t out_size;
 
 	/* Sources */
 	struct spa_source source;
@@ -343,42 +364,117 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	return 0;
 }
 
-static bool write_data(struct impl *this, const uint8_t *data, uint32_t size, uint32_t *total_written)
+static int encode_msbc(struct impl *this)
+{
+	uint8_t *p = this->out_buf + this->out_size;
+	ssize_t processed, written;
+
+	p[0] = MSBC_H2_SYNC;
+	p[1] = MSBC_H2_SEQ(this->msbc_seq++);
+
+	processed = sbc_encode(&this->msbc_enc, this->pcm_buf, MSBC_DECODED_SIZE,
+			p + 2, MSBC_ENCODED_SIZE, &written);
+	this->pcm_size = 0;
+	if (processed < 0 || written != MSBC_ENCODED_SIZE) {
+		spa_log_warn(this->log, NAME " %p: mSBC encoding error %zd", this, processed);
+		return -EIO;
+	}
+	p[2 + MSBC_ENCODED_SIZE] = 0;
+
+	this->out_size += MSBC_PACKET_SIZE;
+	return 0;
+}
+
+/* append samples to the outgoing data, returns the number of bytes consumed */
+static uint32_t queue_data(struct impl *this, const uint8_t *data, uint32_t size)
 {
-	uint32_t local_total_written = 0;
-	const uint32_t mtu_size = this->transport->write_mtu;
-
-	while (local_total_written <= (size - mtu_size)) {
-		const int bytes_written = write(this->sock_fd, data, mtu_size);
-		if (bytes_written < 0) {
-			spa_log_warn(this->log, "error writting data: %s", strerror(errno));
-			return false;
+	uint32_t n, consumed = 0;
+
+	if (!this->msbc) {
+		consumed = SPA_MIN(size, sizeof(this->out_buf) - this->out_size);
+		memcpy(this->out_buf + this->out_size, data, consumed);
+		this->out_size += consumed;
+		return consumed;
+	}
+
+	while (consumed < size && this->out_size + MSBC_PACKET_SIZE <= sizeof(this->out_buf)) {
+		n = SPA_MIN(size - consumed, MSBC_DECODED_SIZE - this->pcm_size);
+		memcpy(this->pcm_buf + this->pcm_size, data + consumed, n);
+		this->pcm_size += n;
+		consumed += n;
+
+		if (this->pcm_size == MSBC_DECODED_SIZE)
+			encode_msbc(this);
+	}
+	return consumed;
+}
+
+/* send the queued data as packets of mtu bytes, a batch of them per call. A
+ * partial packet stays queued until more data arrives. */
+static int flush_packets(struct impl *this)
+{
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	uint32_t i, n_packets, sent = 0;
+	int res = 0;
+
+	while ((n_packets = SPA_MIN((this->out_size - sent) / this->mtu, MAX_BATCH)) > 0) {
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < n_packets; i++) {
+			iov[i].iov_base = this->out_buf + sent + i * this->mtu;
+			iov[i].iov_len = this->mtu;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		res = sendmmsg(this->sock_fd, msgs, n_packets, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			break;
+		}
+		sent += res * this->mtu;
+
+		if ((uint32_t)res < n_packets) {
+			res = -EAGAIN;
+			break;
 		}
+		res = 0;
+	}
 
-		data += bytes_written;
-		local_total_written += bytes_written;
+	if (sent > 0) {
+		memmove(this->out_buf, this->out_buf + sent, this->out_size - sent);
+		this->out_size -= sent;
 	}
 
-	/* TODO: For now we assume the size is always a mutliple of mtu_size */
-	if (local_total_written != size)
-		spa_log_warn(this->log, "dropping some audio as buffer size is not multiple of mtu");
+	spa_log_trace(this->log, NAME " %p: sent %u, queued %u: %d", this,
+			sent, this->out_size, res);
+
+	return res;
+}
+
+static void update_flush_source(struct impl *this, bool wait)
+{
+	uint32_t mask = wait ? SPA_IO_OUT : 0;
 
-	if (total_written)
-		*total_written = local_total_written;
-	return true;
+	if (this->flush_source.loop && this->flush_source.mask != mask) {
+		this->flush_source.mask = mask;
+		spa_loop_update_source(this->data_loop, &this->flush_source);
+	}
 }
 
 static int render_buffers(struct impl *this, uint64_t now_time)
 {
 	struct port *port = &this->port;
+	int res = 0;
 
 	/* Render the buffer */
 	while (!spa_list_is_empty(&port->ready)) {
 		uint8_t *src;
 		struct buffer *b;
 		struct spa_data *d;
-		uint32_t offset, size;
-		uint32_t total_written = 0;
+		uint32_t offset, size, queued;
 
 		/* Get the buffer and datas */
 		b = spa_list_first(&port->ready, struct buffer, link);
@@ -386,55 +482,64 @@ static int render_buffers(struct impl *this, uint64_t now_time)
 
 		/* Get the data, offset and size */
 		src = d[0].data;
-		offset = d[0].chunk->offset;
-		size = d[0].chunk->size;
+		offset = d[0].chunk->offset + port->ready_offset;
+		size = d[0].chunk->size - port->ready_offset;
+
+		/* Queue the samples, this stops when the queue is full */
+		queued = queue_data(this, src + offset, size);
+		port->ready_offset += queued;
+
+		/* Update the sample count */
+		this->sample_count += queued / port->frame_size;
 
 		/* Write data */
-		if (!write_data(this, src + offset, size, &total_written)) {
+		res = flush_packets(this);
+		if (res < 0 && res != -EAGAIN) {
+			spa_log_warn(this->log, "error writing data: %s", spa_strerror(res));
+			this->out_size = 0;
 			port->need_data = true;
+			port->ready_offset = 0;
 			spa_list_remove(&b->link);
 			b->outstanding = true;
 			spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
 			break;
 		}
 
-		/* Update the sample count */
-		this->sample_count += total_written / port->frame_size;
+		if (port->ready_offset < d[0].chunk->size) {
+			/* Wait until the socket can take more */
+			if (queued == 0)
+				break;
+			continue;
+		}
 
 		/* Remove the buffer and mark it as reusable */
+		port->ready_offset = 0;
 		spa_list_remove(&b->link);
 		b->outstanding = true;
 		spa_node_call_reuse_buffer(&this->callbacks, 0, b->id);
 	}
 
+	update_flush_source(this, res == -EAGAIN);
+
 	/* Set next timeout */
 	set_next_timeout(this, now_time);
 
 	return 0;
 }
 
-static void fill_socket (struct impl *this)
+static void fill_socket(struct impl *this)
 {
-  struct port *port = &this->port;
-  static const uint8_t zero_buffer[1024 * 4] = { 0, };
-  uint32_t fill_size = this->transport->write_mtu;
-  uint32_t fills = 0;
-  uint32_t total_written = 0;
-
-  /* Fill the socked */
-  while (fills < FILL_FRAMES) {
-          uint32_t written = 0;
-
-          /* Write the data */
-          if (!write_data(this, zero_buffer, fill_size, &written))
-                  break;
-
-          total_written += written;
-          fills++;
-  }
-
-  /* Update the sample count */
-  this->sample_count += total_written / port->frame_size;
+	struct port *port = &this->port;
+	static const uint8_t zero_buffer[FILL_FRAMES * MAX_MTU] = { 0, };
+	uint32_t fill_size, queued;
+
+	/* Fill the socket with silence, encoded in mSBC frames when needed */
+	fill_size = FILL_FRAMES * (this->msbc ? MSBC_DECODED_SIZE : this->mtu);
+	queued = queue_data(this, zero_buffer, fill_size);
+	flush_packets(this);
+
+	/* Update the sample count */
+	this->sample_count += queued / port->frame_size;
 }
 
 static void sco_on_flush(struct spa_source *source)
@@ -515,8 +620,35 @@ static int do_start(struct impl *this)
 	if (this->sock_fd < 0)
 		return -1;
 
+	/* Odd or missing MTUs are seen with some adapters. mSBC packets are sent
+	 * whole when they fit, otherwise the stream is split over the smaller
+	 * packets of the transparent USB alternate settings. */
+	this->mtu = this->transport->write_mtu;
+	if (this->mtu == 0 || this->mtu > MAX_MTU) {
+		spa_log_warn(this->log, NAME " %p: invalid mtu %u, using %u", this,
+				this->mtu, DEFAULT_MTU);
+		this->mtu = DEFAULT_MTU;
+	}
+	if (this->msbc)
+		this->mtu = SPA_MIN(this->mtu, (uint32_t)MSBC_PACKET_SIZE);
+	else if (this->mtu > 1)
+		this->mtu &= ~1u;	/* don't split samples over packets */
+
+	this->out_size = 0;
+	this->pcm_size = 0;
+	this->msbc_seq = 0;
+	this->port.ready_offset = 0;
+
+	if (this->msbc) {
+		if (sbc_init_msbc(&this->msbc_enc, 0) < 0) {
+			spa_log_error(this->log, NAME " %p: can't init mSBC encoder", this);
+			goto fail_release;
+		}
+		this->msbc_enc.endian = SBC_LE;
+	}
+
 	/* Set the write MTU */
-	val = FILL_FRAMES * this->transport->write_mtu;
+	val = FILL_FRAMES * this->mtu;
 	if (setsockopt(this->sock_fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
 		spa_log_warn(this->log, "sco-sink %p: SO_SNDBUF %m", this);
 
@@ -553,6 +685,12 @@ static int do_start(struct impl *this)
 	this->started = true;
 
 	return 0;
+
+fail_release:
+	spa_bt_transport_release(this->transport);
+	close(this->sock_fd);
+	this->sock_fd = -1;
+	return -EIO;
 }
 
 static int do_remove_source(struct spa_loop *loop,
@@ -596,6 +734,9 @@ static int do_stop(struct impl *this)
 		this->sock_fd = -1;
 	}
 
+	if (this->msbc)
+		sbc_finish(&this->msbc_enc);
+
 	return res;
 }
 
@@ -753,12 +894,9 @@ impl_node_port_enum_params(void *object, int seq,
 		info.channels = 1;
 		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
 
-		/* TODO: For now we only handle HSP profiles which has always CVSD format,
-		 * but we eventually need to support HFP that can have both CVSD and MSBC formats */
-
-		 /* CVSD format has a rate of 8kHz
-		  * MSBC format has a rate of 16kHz */
-		info.rate = 8000;
+		/* CVSD format has a rate of 8kHz
+		 * MSBC format has a rate of 16kHz */
+		info.rate = this->msbc ? 16000 : 8000;
 
 		/* build the param */
 		param = spa_format_audio_raw_build(&b, id, &info);
@@ -1165,6 +1303,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_bt_transport_add_listener(this->transport,
 			&this->transport_listener, &transport_events, this);
 	this->sock_fd = -1;
+	this->msbc = this->transport->codec == HFP_AUDIO_CODEC_MSBC;
 
 	this->timerfd = spa_system_timerfd_create(this->data_system,
 			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
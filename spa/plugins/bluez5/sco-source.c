@@ -47,6 +47,8 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/pod/filter.h>
 
+#include <sbc/sbc.h>
+
 #include "defs.h"
 
 struct props {
@@ -57,6 +59,11 @@ struct props {
 #define FILL_FRAMES 2
 #define MAX_BUFFERS 32
 
+#define DEFAULT_MTU	48
+#define MAX_BATCH	8		/* packets received in one call */
+#define MAX_MTU		512
+#define IN_BUFFER_SIZE	(MAX_BATCH * MAX_MTU)
+
 struct buffer {
 	uint32_t id;
 	unsigned int outstanding:1;
@@ -108,6 +115,14 @@ struct impl {
 
 	unsigned int started:1;
 	unsigned int slaved:1;
+	unsigned int msbc:1;
+
+	sbc_t msbc_dec;
+
+	/* Received data that was not yet copied or decoded */
+	uint32_t mtu;
+	uint8_t in_buf[IN_BUFFER_SIZE];
+	uint32_t in_size;
 
 	struct spa_source source;
 
@@ -293,35 +308,98 @@ static void reset_buffers(struct port *port)
 	}
 }
 
-static bool read_data(struct impl *this, uint8_t *data, uint32_t size, uint32_t *total_read) {
-	const uint32_t mtu_size = this->transport->read_mtu;
-	uint32_t local_total_read = 0;
+/* receive the queued packets, a batch of them per call. Packets can be
+ * shorter than the mtu, they are packed together in the input buffer. */
+static int read_packets(struct impl *this)
+{
+	struct mmsghdr msgs[MAX_BATCH];
+	struct iovec iov[MAX_BATCH];
+	uint32_t i, n_packets;
+	int res;
+
+	while ((n_packets = SPA_MIN((sizeof(this->in_buf) - this->in_size) / this->mtu,
+					MAX_BATCH)) > 0) {
+		memset(msgs, 0, sizeof(msgs));
+		for (i = 0; i < n_packets; i++) {
+			iov[i].iov_base = this->in_buf + this->in_size + i * this->mtu;
+			iov[i].iov_len = this->mtu;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
 
-	/* Read chunks of mtu_size */
-	while (local_total_read <= (size - mtu_size)) {
-		const int bytes_read = read(this->sock_fd, data, mtu_size);
-		if (bytes_read < 0) {
+		res = recvmmsg(this->sock_fd, msgs, n_packets, MSG_DONTWAIT, NULL);
+		if (res < 0) {
 			/* Retry */
 			if (errno == EINTR)
 				continue;
 
-			/* Socked has no data */
+			/* Socket has no data */
 			if (errno == EAGAIN || errno == EWOULDBLOCK)
-			    goto done;
+				break;
 
 			/* Error */
 			spa_log_error(this->log, "read error: %s", strerror(errno));
-			return false;
+			return -errno;
 		}
 
-		data += bytes_read;
-		local_total_read += bytes_read;
+		for (i = 0; i < (uint32_t)res; i++) {
+			memmove(this->in_buf + this->in_size, iov[i].iov_base, msgs[i].msg_len);
+			this->in_size += msgs[i].msg_len;
+		}
+		if ((uint32_t)res < n_packets)
+			break;
+	}
+	return 0;
+}
+
+/* decode the complete mSBC frames, the H2 header is used to find the start of
+ * a frame so that the stream resyncs after lost or split packets */
+static uint32_t decode_msbc(struct impl *this, uint8_t *data, uint32_t size)
+{
+	uint32_t i = 0, total = 0;
+	size_t written;
+	ssize_t res;
+
+	while (this->in_size - i >= 2 + MSBC_ENCODED_SIZE &&
+	    size - total >= MSBC_DECODED_SIZE) {
+		if (!msbc_is_h2_header(&this->in_buf[i]) || this->in_buf[i + 2] != 0xad) {
+			i++;
+			continue;
+		}
+		res = sbc_decode(&this->msbc_dec, &this->in_buf[i + 2], MSBC_ENCODED_SIZE,
+				data + total, size - total, &written);
+		if (res < 0) {
+			spa_log_debug(this->log, NAME " %p: mSBC decoding error %zd", this, res);
+			i++;
+			continue;
+		}
+		total += written;
+		i += 2 + MSBC_ENCODED_SIZE;
 	}
 
-done:
-	if (total_read)
-	  *total_read = local_total_read;
-	return true;
+	memmove(this->in_buf, this->in_buf + i, this->in_size - i);
+	this->in_size -= i;
+
+	return total;
+}
+
+/* move the received samples to data, returns the number of bytes written */
+static uint32_t read_data(struct impl *this, uint8_t *data, uint32_t size)
+{
+	struct port *port = &this->port;
+	uint32_t total;
+
+	if (this->msbc)
+		return decode_msbc(this, data, size);
+
+	total = SPA_MIN(size, this->in_size);
+	total -= total % port->frame_size;
+
+	memcpy(data, this->in_buf, total);
+	memmove(this->in_buf, this->in_buf + total, this->in_size - total);
+	this->in_size -= total;
+
+	return total;
 }
 
 static void recycle_buffer(struct impl *this, struct port *port, uint32_t buffer_id)
@@ -357,14 +435,18 @@ static void sco_on_ready_read(struct spa_source *source)
 		spa_assert(buffer_data->data);
 
 		/* Read sco data */
-		if (!read_data(this, buffer_data->data, buffer_data->maxsize, &total_read)) {
+		if (read_packets(this) < 0) {
+			spa_list_append(&port->free, &buffer->link);
 			if (this->source.loop)
 				spa_loop_remove_source(this->data_loop, &this->source);
 			return;
 		}
+		total_read = read_data(this, buffer_data->data, buffer_data->maxsize);
 
 		/* Append a ready buffer if data could be read */
-		if (total_read > 0) {
+		if (total_read == 0) {
+			spa_list_append(&port->free, &buffer->link);
+		} else {
 			/* Update the buffer offset, size and stride */
 			buffer_data->chunk->offset = 0;
 			buffer_data->chunk->size = total_read;
@@ -421,6 +503,26 @@ static int do_start(struct impl *this)
 	if (this->sock_fd < 0)
 		return -1;
 
+	/* Some adapters report odd or no MTU, short packets are handled when reading */
+	this->mtu = this->transport->read_mtu;
+	if (this->mtu == 0 || this->mtu > MAX_MTU) {
+		spa_log_warn(this->log, NAME " %p: invalid mtu %u, using %u", this,
+				this->mtu, DEFAULT_MTU);
+		this->mtu = DEFAULT_MTU;
+	}
+	this->in_size = 0;
+
+	if (this->msbc) {
+		if (sbc_init_msbc(&this->msbc_dec, 0) < 0) {
+			spa_log_error(this->log, NAME " %p: can't init mSBC decoder", this);
+			spa_bt_transport_release(this->transport);
+			close(this->sock_fd);
+			this->sock_fd = -1;
+			return -EIO;
+		}
+		this->msbc_dec.endian = SBC_LE;
+	}
+
 	/* Set the write MTU */
 	val = FILL_FRAMES * this->transport->write_mtu;
 	if (setsockopt(this->sock_fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) < 0)
@@ -492,6 +594,9 @@ static int do_stop(struct impl *this)
 		this->sock_fd = -1;
 	}
 
+	if (this->msbc)
+		sbc_finish(&this->msbc_dec);
+
 	return res;
 }
 
@@ -653,12 +758,9 @@ impl_node_port_enum_params(void *object, int seq,
 		info.channels = 1;
 		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
 
-		 /* TODO: For now we only handle HSP profiles which has always CVSD format,
-		 * but we eventually need to support HFP that can have both CVSD and MSBC formats */
-
-		 /* CVSD format has a rate of 8kHz
-		  * MSBC format has a rate of 16kHz */
-		info.rate = 8000;
+		/* CVSD format has a rate of 8kHz
+		 * MSBC format has a rate of 16kHz */
+		info.rate = this->msbc ? 16000 : 8000;
 
 		/* build the param */
 		param = spa_format_audio_raw_build(&b, id, &info);
@@ -1076,6 +1178,7 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_bt_transport_add_listener(this->transport,
 			&this->transport_listener, &transport_events, this);
 	this->sock_fd = -1;
+	this->msbc = this->transport->codec == HFP_AUDIO_CODEC_MSBC;
 
 	return 0;
 }
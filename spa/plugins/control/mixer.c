@@ -92,6 +92,11 @@ struct impl {
 
 	unsigned int have_format:1;
 	unsigned int started:1;
+
+	/* merge state, kept here so process doesn't need the stack */
+	struct spa_pod_sequence *seq[MAX_PORTS];
+	struct spa_pod_control *ctrl[MAX_PORTS];
+	uint32_t heap[MAX_PORTS];
 };
 
 #define CHECK_FREE_IN_PORT(this,d,p) ((d) == SPA_DIRECTION_INPUT && (p) < MAX_PORTS && !this->in_ports[(p)].valid)
@@ -561,16 +566,48 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return queue_buffer(this, port, &port->buffers[buffer_id]);
 }
 
+/* the heap is ordered on the offset of the next control of each
+ * sequence, equal offsets keep the order of the inputs */
+static inline bool ctrl_before(struct impl *this, uint32_t a, uint32_t b)
+{
+	uint32_t oa = this->ctrl[a]->offset, ob = this->ctrl[b]->offset;
+	return oa < ob || (oa == ob && a < b);
+}
+
+static void heap_sift_down(struct impl *this, uint32_t n_heap, uint32_t i)
+{
+	uint32_t *heap = this->heap;
+
+	while (true) {
+		uint32_t min = i, l = 2 * i + 1, r = l + 1, t;
+
+		if (l < n_heap && ctrl_before(this, heap[l], heap[min]))
+			min = l;
+		if (r < n_heap && ctrl_before(this, heap[r], heap[min]))
+			min = r;
+		if (min == i)
+			break;
+		t = heap[i];
+		heap[i] = heap[min];
+		heap[min] = t;
+		i = min;
+	}
+}
+
+static inline bool ctrl_valid(struct impl *this, uint32_t i)
+{
+	return spa_pod_control_is_inside(&this->seq[i]->body,
+			SPA_POD_BODY_SIZE(this->seq[i]), this->ctrl[i]);
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
 	struct port *outport;
 	struct spa_io_buffers *outio;
-	uint32_t n_seq, i;
-        struct spa_pod_sequence **seq;
-        struct spa_pod_control **ctrl;
-	struct spa_pod_builder builder;
-	struct spa_pod_frame f;
+	uint32_t n_seq, n_heap, i;
+	struct spa_pod_sequence *out;
+	uint32_t pos;
         struct buffer *outb;
 	struct spa_data *d;
 
@@ -598,9 +635,7 @@ static int impl_node_process(void *object)
                 return -EPIPE;
         }
 
-	ctrl = alloca(MAX_PORTS * sizeof(struct spa_pod_control *));
-	seq = alloca(MAX_PORTS * sizeof(struct spa_pod_sequence *));
-        n_seq = 0;
+        n_seq = n_heap = 0;
 
 	/* collect all sequence pod on input ports */
 	for (i = 0; i < this->last_port; i++) {
@@ -632,45 +667,53 @@ static int impl_node_process(void *object)
 		if (!spa_pod_is_sequence(pod))
 			continue;
 
-		seq[n_seq] = pod;
-		ctrl[n_seq] = spa_pod_control_first(&seq[n_seq]->body);
+		this->seq[n_seq] = pod;
+		this->ctrl[n_seq] = spa_pod_control_first(&this->seq[n_seq]->body);
 		inio->status = SPA_STATUS_NEED_DATA;
+		if (ctrl_valid(this, n_seq))
+			this->heap[n_heap++] = n_seq;
 		n_seq++;
 	}
+	for (i = n_heap / 2; i > 0; i--)
+		heap_sift_down(this, n_heap, i - 1);
 
 	d = outb->buffer->datas;
 
-	/* prepare to write into output */
-	spa_pod_builder_init(&builder, d->data, d->maxsize);
-	spa_pod_builder_push_sequence(&builder, &f, 0);
-
-	/* merge sort all sequences into output buffer */
-	while (true) {
-		struct spa_pod_control *next = NULL;
-		uint32_t next_index = 0;
-
-		for (i = 0; i < n_seq; i++) {
-			if (!spa_pod_control_is_inside(&seq[i]->body,
-					SPA_POD_BODY_SIZE(seq[i]), ctrl[i]))
-				continue;
-
-			if (next == NULL || ctrl[i]->offset < next->offset) {
-				next = ctrl[i];
-				next_index = i;
-			}
-		}
-		if (next == NULL)
-			break;
+	/* the controls are copied as they are into the output sequence,
+	 * no need to parse or build the values */
+	out = d->data;
+	pos = sizeof(struct spa_pod_sequence);
+	if (d->maxsize < pos) {
+		queue_buffer(this, outport, outb);
+		return -ENOSPC;
+	}
 
-		spa_pod_builder_control(&builder, next->offset, next->type);
-		spa_pod_builder_primitive(&builder, &next->value);
+	while (n_heap > 0) {
+		uint32_t idx = this->heap[0];
+		struct spa_pod_control *c = this->ctrl[idx];
+		uint32_t size = SPA_POD_CONTROL_SIZE(c);
+		uint32_t padded = SPA_ROUND_UP_N(size, 8);
 
-		ctrl[next_index] = spa_pod_control_next(ctrl[next_index]);
+		if (pos + padded > d->maxsize) {
+			spa_log_trace_fp(this->log, NAME " %p: output full, dropping controls", this);
+			break;
+		}
+		memcpy(SPA_MEMBER(out, pos, void), c, size);
+		memset(SPA_MEMBER(out, pos + size, void), 0, padded - size);
+		pos += padded;
+
+		this->ctrl[idx] = spa_pod_control_next(c);
+		if (!ctrl_valid(this, idx))
+			this->heap[0] = this->heap[--n_heap];
+		heap_sift_down(this, n_heap, 0);
 	}
-	spa_pod_builder_pop(&builder, &f);
+	out->pod.type = SPA_TYPE_Sequence;
+	out->pod.size = pos - sizeof(struct spa_pod);
+	out->body.unit = 0;
+	out->body.pad = 0;
 
 	d->chunk->offset = 0;
-	d->chunk->size = builder.state.offset;
+	d->chunk->size = pos;
 	d->chunk->stride = 1;
 	d->chunk->flags = 0;
 
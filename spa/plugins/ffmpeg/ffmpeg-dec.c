@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -35,14 +36,22 @@
 #include <spa/node/io.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/param/video/format.h>
+#include <spa/param/param.h>
 #include <spa/pod/filter.h>
 
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+
+#define NAME "ffmpeg-dec"
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
 #define GET_PORT(this,d,p)		(d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
 
 #define MAX_BUFFERS    32
+#define MAX_PACKET_SIZE	(4 * 1024 * 1024)
 
 struct buffer {
 	uint32_t id;
@@ -87,8 +96,76 @@ struct impl {
 	struct port out_ports[1];
 
 	bool started;
+
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	AVFrame *frame;
+	bool have_frame;		/**< frame was decoded but not copied yet */
+	enum AVPixelFormat pix_fmt;	/**< of the output format */
+};
+
+static const struct {
+	enum AVCodecID codec_id;
+	uint32_t subtype;
+} codec_map[] = {
+	{ AV_CODEC_ID_H264, SPA_MEDIA_SUBTYPE_h264 },
+	{ AV_CODEC_ID_MJPEG, SPA_MEDIA_SUBTYPE_mjpg },
+	{ AV_CODEC_ID_H263, SPA_MEDIA_SUBTYPE_h263 },
+	{ AV_CODEC_ID_MPEG1VIDEO, SPA_MEDIA_SUBTYPE_mpeg1 },
+	{ AV_CODEC_ID_MPEG2VIDEO, SPA_MEDIA_SUBTYPE_mpeg2 },
+	{ AV_CODEC_ID_MPEG4, SPA_MEDIA_SUBTYPE_mpeg4 },
+	{ AV_CODEC_ID_VC1, SPA_MEDIA_SUBTYPE_vc1 },
+	{ AV_CODEC_ID_VP8, SPA_MEDIA_SUBTYPE_vp8 },
+	{ AV_CODEC_ID_VP9, SPA_MEDIA_SUBTYPE_vp9 },
+};
+
+static const struct {
+	enum AVPixelFormat pix_fmt;
+	uint32_t format;
+} format_map[] = {
+	{ AV_PIX_FMT_YUV420P, SPA_VIDEO_FORMAT_I420 },
+	{ AV_PIX_FMT_YUVJ420P, SPA_VIDEO_FORMAT_I420 },
+	{ AV_PIX_FMT_NV12, SPA_VIDEO_FORMAT_NV12 },
+	{ AV_PIX_FMT_YUYV422, SPA_VIDEO_FORMAT_YUY2 },
+	{ AV_PIX_FMT_UYVY422, SPA_VIDEO_FORMAT_UYVY },
+	{ AV_PIX_FMT_YUV422P, SPA_VIDEO_FORMAT_Y42B },
+	{ AV_PIX_FMT_YUVJ422P, SPA_VIDEO_FORMAT_Y42B },
+	{ AV_PIX_FMT_YUV444P, SPA_VIDEO_FORMAT_Y444 },
+	{ AV_PIX_FMT_YUVJ444P, SPA_VIDEO_FORMAT_Y444 },
 };
 
+static uint32_t codec_to_subtype(const AVCodec *codec)
+{
+	uint32_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(codec_map); i++)
+		if (codec_map[i].codec_id == codec->id)
+			return codec_map[i].subtype;
+	return SPA_ID_INVALID;
+}
+
+static enum AVPixelFormat format_to_pix_fmt(uint32_t format)
+{
+	uint32_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(format_map); i++)
+		if (format_map[i].format == format)
+			return format_map[i].pix_fmt;
+	return AV_PIX_FMT_NONE;
+}
+
+/* the J variants only differ in range, the data is the same */
+static bool pix_fmt_compatible(enum AVPixelFormat a, enum AVPixelFormat b)
+{
+	uint32_t i, fa = SPA_ID_INVALID, fb = SPA_ID_INVALID;
+	for (i = 0; i < SPA_N_ELEMENTS(format_map); i++) {
+		if (format_map[i].pix_fmt == a)
+			fa = format_map[i].format;
+		if (format_map[i].pix_fmt == b)
+			fb = format_map[i].format;
+	}
+	return a == b || (fa != SPA_ID_INVALID && fa == fb);
+}
+
 static int impl_node_enum_params(void *object, int seq,
 			uint32_t id, uint32_t start, uint32_t num,
 			const struct spa_pod *filter)
@@ -108,6 +185,39 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	return -ENOTSUP;
 }
 
+static void close_context(struct impl *this)
+{
+	avcodec_free_context(&this->context);
+	av_frame_unref(this->frame);
+	this->have_frame = false;
+}
+
+/* Frame threading decodes several frames in parallel at the cost of a
+ * few frames of latency, slice threading is used when the codec can't
+ * do frames. The decoded frames are only copied when an output buffer
+ * is free so the queue into the graph is bounded by the number of
+ * buffers, the codec stops taking packets when it has no room left. */
+static int open_context(struct impl *this)
+{
+	int res;
+
+	if ((this->context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	this->context->thread_count = 0;
+	this->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if ((res = avcodec_open2(this->context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %s",
+				this, this->codec->name, av_err2str(res));
+		avcodec_free_context(&this->context);
+		return -EIO;
+	}
+	spa_log_info(this->log, NAME " %p: opened %s with %d threads", this,
+			this->codec->name, this->context->thread_count);
+	return 0;
+}
+
 static int impl_node_send_command(void *object, const struct spa_command *command)
 {
 	struct impl *this = object;
@@ -117,6 +227,14 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 
 	switch (SPA_NODE_COMMAND_ID(command)) {
 	case SPA_NODE_COMMAND_Start:
+		if (!GET_IN_PORT(this, 0)->have_format ||
+		    !GET_OUT_PORT(this, 0)->have_format)
+			return -EIO;
+		if (this->context == NULL) {
+			int res;
+			if ((res = open_context(this)) < 0)
+				return res;
+		}
 		this->started = true;
 		break;
 	case SPA_NODE_COMMAND_Pause:
@@ -201,16 +319,51 @@ static int port_enum_formats(void *object,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
+	struct impl *this = object;
+	struct spa_pod_frame f[2];
+	uint32_t i, subtype;
+
 	if (!IS_VALID_PORT(object, direction, port_id))
 		return -EINVAL;
 
-	switch (index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	if (index > 0)
 		return 0;
+
+	if (direction == SPA_DIRECTION_INPUT) {
+		if ((subtype = codec_to_subtype(this->codec)) == SPA_ID_INVALID)
+			return 0;
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype));
+		return 1;
 	}
+
+	spa_pod_builder_push_object(builder, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(builder,
+		SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+		SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+		0);
+	spa_pod_builder_prop(builder, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(builder, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_I420);
+	for (i = 0; i < SPA_N_ELEMENTS(format_map); i++) {
+		if (i > 0 && format_map[i].format == format_map[i-1].format)
+			continue;
+		spa_pod_builder_id(builder, format_map[i].format);
+	}
+	spa_pod_builder_pop(builder, &f[1]);
+	spa_pod_builder_add(builder,
+		SPA_FORMAT_VIDEO_size,      SPA_POD_CHOICE_RANGE_Rectangle(
+						&SPA_RECTANGLE(320, 240),
+						&SPA_RECTANGLE(1, 1),
+						&SPA_RECTANGLE(8192, 8192)),
+		SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+						&SPA_FRACTION(25, 1),
+						&SPA_FRACTION(0, 1),
+						&SPA_FRACTION(INT32_MAX, 1)),
+		0);
+	*param = spa_pod_builder_pop(builder, &f[0]);
 	return 1;
 }
 
@@ -232,7 +385,14 @@ static int port_get_format(void *object,
 	if (index > 0)
 		return 0;
 
-	*param = NULL;
+	if (direction == SPA_DIRECTION_INPUT)
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(port->current_format.media_type),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(port->current_format.media_subtype));
+	else
+		*param = spa_format_video_raw_build(builder, SPA_PARAM_Format,
+				&port->current_format.info.raw);
 
 	return 1;
 }
@@ -271,6 +431,32 @@ impl_node_port_enum_params(void *object, int seq,
 			return res;
 		break;
 
+	case SPA_PARAM_Buffers:
+	{
+		struct port *port = GET_PORT(this, direction, port_id);
+		struct spa_video_info_raw *raw_info = &port->current_format.info.raw;
+		int size;
+
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT)
+			size = MAX_PACKET_SIZE;
+		else
+			size = av_image_get_buffer_size(this->pix_fmt,
+					raw_info->size.width, raw_info->size.height, 1);
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(4, 2, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(0),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+	}
 	default:
 		return -ENOENT;
 	}
@@ -295,7 +481,7 @@ static int port_set_format(void *object,
 	struct port *port;
 	int res;
 
-	if (this == NULL || format == NULL)
+	if (this == NULL)
 		return -EINVAL;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
@@ -305,22 +491,35 @@ static int port_set_format(void *object,
 
 	if (format == NULL) {
 		port->have_format = false;
+		port->n_buffers = 0;
+		close_context(this);
 	} else {
 		struct spa_video_info info = { 0 };
+		enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
 
 		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
 			return res;
 
-		if (info.media_type != SPA_MEDIA_TYPE_video &&
-		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		if (info.media_type != SPA_MEDIA_TYPE_video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != codec_to_subtype(this->codec))
+				return -EINVAL;
+		} else {
+			if (info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+				return -EINVAL;
+			if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
+				return -EINVAL;
+			if ((pix_fmt = format_to_pix_fmt(info.info.raw.format)) == AV_PIX_FMT_NONE)
+				return -ENOTSUP;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
 			port->current_format = info;
 			port->have_format = true;
+			if (direction == SPA_DIRECTION_OUTPUT)
+				this->pix_fmt = pix_fmt;
 		}
 	}
 	return 0;
@@ -347,13 +546,44 @@ impl_node_port_use_buffers(void *object,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
-	if (object == NULL)
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i;
+
+	if (this == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(object, direction, port_id))
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	spa_list_init(&port->free);
+	spa_list_init(&port->ready);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		b->id = i;
+		b->flags = 0;
+		b->outbuf = buffers[i];
+
+		if (buffers[i]->n_datas < 1 || buffers[i]->datas[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p",
+					this, buffers[i]);
+			return -EINVAL;
+		}
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_append(&port->free, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -382,39 +612,149 @@ impl_node_port_set_io(void *object,
 	return 0;
 }
 
+static void recycle_buffer(struct impl *this, uint32_t id)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+
+	if (id >= port->n_buffers)
+		return;
+	spa_list_append(&port->free, &port->buffers[id].link);
+}
+
+/* copy the decoded frame to a free buffer, false when there is none */
+static bool output_frame(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	AVFrame *frame = this->frame;
+	struct buffer *b;
+	struct spa_data *d;
+	int size;
+
+	if (spa_list_is_empty(&port->free))
+		return false;
+
+	if (!pix_fmt_compatible(frame->format, this->pix_fmt) ||
+	    frame->width != (int)port->current_format.info.raw.size.width ||
+	    frame->height != (int)port->current_format.info.raw.size.height) {
+		spa_log_warn(this->log, NAME " %p: dropping frame %dx%d %s, not the negotiated format",
+				this, frame->width, frame->height,
+				av_get_pix_fmt_name(frame->format));
+		goto done;
+	}
+
+	b = spa_list_first(&port->free, struct buffer, link);
+	d = &b->outbuf->datas[0];
+
+	size = av_image_copy_to_buffer(d->data, d->maxsize,
+			(const uint8_t * const *)frame->data, frame->linesize,
+			frame->format, frame->width, frame->height, 1);
+	if (size < 0) {
+		spa_log_warn(this->log, NAME " %p: can't copy frame: %s",
+				this, av_err2str(size));
+		goto done;
+	}
+	spa_list_remove(&b->link);
+
+	d->chunk->offset = 0;
+	d->chunk->size = size;
+	d->chunk->stride = av_image_get_linesize(frame->format, frame->width, 0);
+	spa_list_append(&port->ready, &b->link);
+
+done:
+	av_frame_unref(frame);
+	this->have_frame = false;
+	return true;
+}
+
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *inport, *outport;
+	struct spa_io_buffers *input, *output;
+	struct buffer *b;
+	int res, status = 0;
 
 	if (this == NULL)
 		return -EINVAL;
 
-	port = &this->out_ports[0];
+	inport = GET_IN_PORT(this, 0);
+	outport = GET_OUT_PORT(this, 0);
 
-	if ((output = port->io) == NULL)
+	if ((output = outport->io) == NULL ||
+	    (input = inport->io) == NULL)
 		return -EIO;
 
-	if (!port->have_format) {
+	if (!outport->have_format || this->context == NULL) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	recycle_buffer(this, output->buffer_id);
+	output->buffer_id = SPA_ID_INVALID;
+
+	/* pass a new packet, the codec refuses it while it has a backlog
+	 * of frames and then the packet stays on the input */
+	if (input->status == SPA_STATUS_HAVE_DATA &&
+	    input->buffer_id < inport->n_buffers) {
+		struct spa_data *d = &inport->buffers[input->buffer_id].outbuf->datas[0];
+		uint32_t offset = d->chunk->offset, size = d->chunk->size;
+
+		/* the codec reads past the end, decode in place when the
+		 * buffer has room for the padding */
+		if (offset + size + AV_INPUT_BUFFER_PADDING_SIZE <= d->maxsize) {
+			this->packet->data = SPA_MEMBER(d->data, offset, uint8_t);
+			this->packet->size = size;
+			memset(this->packet->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+			res = avcodec_send_packet(this->context, this->packet);
+		} else {
+			res = -ENOSPC;
+		}
+		if (res != AVERROR(EAGAIN)) {
+			if (res < 0)
+				spa_log_warn(this->log, NAME " %p: decode error: %s",
+						this, av_err2str(res));
+			input->status = SPA_STATUS_NEED_DATA;
+			status |= SPA_STATUS_NEED_DATA;
+		}
+	} else if (input->status != SPA_STATUS_HAVE_DATA) {
+		status |= SPA_STATUS_NEED_DATA;
+	}
 
-	return SPA_STATUS_OK;
+	while (true) {
+		if (!this->have_frame) {
+			if (avcodec_receive_frame(this->context, this->frame) < 0)
+				break;
+			this->have_frame = true;
+		}
+		if (!output_frame(this))
+			break;
+	}
+
+	if (!spa_list_is_empty(&outport->ready)) {
+		b = spa_list_first(&outport->ready, struct buffer, link);
+		spa_list_remove(&b->link);
+		output->buffer_id = b->id;
+		output->status = SPA_STATUS_HAVE_DATA;
+		status |= SPA_STATUS_HAVE_DATA;
+	}
+	return status;
 }
 
 static int
 impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
 {
-	if (object == NULL)
+	struct impl *this = object;
+
+	if (this == NULL)
 		return -EINVAL;
 
 	if (port_id != 0)
 		return -EINVAL;
 
-	return -ENOTSUP;
+	recycle_buffer(this, buffer_id);
+	return 0;
 }
 
 static const struct spa_node_methods impl_node = {
@@ -453,8 +793,25 @@ impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
 	return 0;
 }
 
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this = (struct impl *) handle;
+
+	close_context(this);
+	av_packet_free(&this->packet);
+	av_frame_free(&this->frame);
+	return 0;
+}
+
+size_t
+spa_ffmpeg_dec_get_size(void)
+{
+	return sizeof(struct impl);
+}
+
 int
 spa_ffmpeg_dec_init(struct spa_handle *handle,
+		    const AVCodec *codec,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
@@ -464,9 +821,18 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	uint32_t i;
 
 	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
 
 	this = (struct impl *) handle;
 
+	this->codec = codec;
+	this->packet = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->packet == NULL || this->frame == NULL) {
+		impl_clear(handle);
+		return -ENOMEM;
+	}
+
 	for (i = 0; i < n_support; i++) {
 		if (support[i].type == SPA_TYPE_INTERFACE_Log)
 			this->log = support[i].data;
@@ -494,8 +860,11 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	port->info.flags = 0;
 	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
 	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
 	port->info.params = port->params;
-	port->info.n_params = 2;
+	port->info.n_params = 3;
+	spa_list_init(&port->free);
+	spa_list_init(&port->ready);
 
 	port = GET_OUT_PORT(this, 0);
 	port->direction = SPA_DIRECTION_OUTPUT;
@@ -506,8 +875,11 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	port->info.flags = 0;
 	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
 	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
 	port->info.params = port->params;
-	port->info.n_params = 2;
+	port->info.n_params = 3;
+	spa_list_init(&port->free);
+	spa_list_init(&port->ready);
 
 	return 0;
 }
@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <spa/support/plugin.h>
 #include <spa/node/node.h>
@@ -31,7 +32,8 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
+size_t spa_ffmpeg_dec_get_size(void);
+int spa_ffmpeg_dec_init(struct spa_handle *handle, const AVCodec *codec, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
 int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
@@ -43,10 +45,22 @@ ffmpeg_dec_init(const struct spa_handle_factory *factory,
 		const struct spa_support *support,
 		uint32_t n_support)
 {
+	const AVCodec *codec;
+
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
+	if ((codec = avcodec_find_decoder_by_name(factory->name + strlen("decoder."))) == NULL)
+		return -ENOENT;
+
+	return spa_ffmpeg_dec_init(handle, codec, info, support, n_support);
+}
+
+static size_t
+ffmpeg_dec_get_size(const struct spa_handle_factory *factory,
+		const struct spa_dict *params)
+{
+	return spa_ffmpeg_dec_get_size();
 }
 
 static int
@@ -108,8 +122,10 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 	if (av_codec_is_encoder(c)) {
 		snprintf(name, 128, "encoder.%s", c->name);
 		f.init = ffmpeg_enc_init;
+		f.get_size = NULL;
 	} else {
 		snprintf(name, 128, "decoder.%s", c->name);
+		f.get_size = ffmpeg_dec_get_size;
 		f.init = ffmpeg_dec_init;
 	}
 	f.name = name;
@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -107,6 +108,7 @@ struct impl {
 	struct spa_hook client_listener;
 
 	unsigned int started:1;
+	unsigned int zero_copy:1;
 };
 
 #define CHECK_IN_PORT(this,p)		((p) < this->n_in_ports)
@@ -332,10 +334,37 @@ impl_node_set_callbacks(void *object,
 	return 0;
 }
 
+/* Point the dynamic buffers of the peers at the jack port memory of this
+ * cycle. The peer then renders straight into jack and process only has
+ * to check that the data is already in place. */
+static void prepare_buffers(struct impl *this)
+{
+	uint32_t i, j, n_frames = this->client->buffer_size;
+
+	for (i = 0; i < this->n_in_ports; i++) {
+		struct port *port = GET_IN_PORT(this, i);
+		void *dst = NULL;
+
+		for (j = 0; j < port->n_buffers; j++) {
+			struct spa_data *d = &port->buffers[j].outbuf->datas[0];
+
+			if (!SPA_FLAG_IS_SET(d->flags, SPA_DATA_FLAG_DYNAMIC))
+				continue;
+			if (dst == NULL)
+				dst = jack_port_get_buffer(port->jack_port, n_frames);
+			d->data = dst;
+			d->maxsize = n_frames * port->stride;
+		}
+	}
+}
+
 static void client_process(void *data)
 {
 	struct impl *this = data;
 
+	if (this->zero_copy)
+		prepare_buffers(this);
+
 	if (this->clock) {
 		struct spa_io_clock *c = this->clock;
 		c->nsec = this->client->current_usecs * SPA_NSEC_PER_USEC;
@@ -774,7 +803,8 @@ static int impl_node_process(void *object)
 		b = &port->buffers[io->buffer_id];
 		src = &b->outbuf->datas[0];
 
-		spa_memcpy(dst, src->data, n_frames * port->stride);
+		if (src->data != dst)
+			spa_memcpy(dst, src->data, n_frames * port->stride);
 
 		io->status = SPA_STATUS_NEED_DATA;
 
@@ -854,8 +884,12 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 
 	for (i = 0; info && i < info->n_items; i++) {
+		const char *str = info->items[i].value;
+
 		if (strcmp(info->items[i].key, SPA_KEY_API_JACK_CLIENT) == 0)
-			sscanf(info->items[i].value, "pointer:%p", &this->client);
+			sscanf(str, "pointer:%p", &this->client);
+		else if (strcmp(info->items[i].key, SPA_KEY_API_JACK_ZERO_COPY) == 0)
+			this->zero_copy = strcmp(str, "true") == 0 || atoi(str) == 1;
 	}
 	if (this->client == NULL) {
 		spa_log_error(this->log, NAME" %p: missing "SPA_KEY_API_JACK_CLIENT
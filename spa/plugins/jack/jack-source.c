@@ -24,6 +24,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -77,6 +78,7 @@ struct port {
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
+	void *mem;		/* our memory when we allocated the buffers */
 
 	struct spa_list empty;
 
@@ -109,6 +111,7 @@ struct impl {
 	struct spa_hook client_listener;
 
 	unsigned int started:1;
+	unsigned int zero_copy:1;
 };
 
 #define CHECK_OUT_PORT(this,p)		((p) < this->n_out_ports)
@@ -382,6 +385,8 @@ static int init_port(struct impl *this, struct port *port)
 			SPA_PORT_CHANGE_MASK_PARAMS;
 	port->info = SPA_PORT_INFO_INIT();
 	port->info.flags = SPA_PORT_FLAG_NO_REF;
+	if (this->zero_copy)
+		port->info.flags |= SPA_PORT_FLAG_CAN_ALLOC_BUFFERS;
 
 	port->items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_FORMAT_DSP, "32 bit float mono audio");
 	port->props = SPA_DICT_INIT(port->items, 1);
@@ -608,6 +613,8 @@ static int clear_buffers(struct impl *this, struct port *port)
 		spa_list_init(&port->empty);
 		this->started = false;
 	}
+	free(port->mem);
+	port->mem = NULL;
 	return 0;
 }
 
@@ -702,13 +709,29 @@ impl_node_port_use_buffers(void *object,
 
 	clear_buffers(this, port);
 
+	if (n_buffers > 0 && (flags & SPA_NODE_BUFFERS_FLAG_ALLOC)) {
+		/* the buffers are pointed at the jack port memory in process,
+		 * the memory is only used before the first cycle */
+		port->mem = calloc(n_buffers, MAX_SAMPLES * port->stride);
+		if (port->mem == NULL)
+			return -errno;
+	}
+
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b;
+		struct spa_data *d = buffers[i]->datas;
 
 		b = &port->buffers[i];
 		b->id = i;
 		b->outbuf = buffers[i];
 		b->flags = 0;
+
+		if (port->mem) {
+			d[0].type = SPA_DATA_MemPtr;
+			d[0].flags |= SPA_DATA_FLAG_DYNAMIC;
+			d[0].data = SPA_MEMBER(port->mem, i * MAX_SAMPLES * port->stride, void);
+			d[0].maxsize = MAX_SAMPLES * port->stride;
+		}
 		spa_list_append(&port->empty, &b->link);
 	}
 	port->n_buffers = n_buffers;
@@ -791,7 +814,13 @@ static int impl_node_process(void *object)
 		src = jack_port_get_buffer(port->jack_port, n_frames);
 
 		d = &b->outbuf->datas[0];
-		spa_memcpy(d->data, src, n_frames * port->stride);
+		if (port->mem) {
+			/* valid until the end of the jack cycle */
+			d->data = (void*)src;
+			d->maxsize = n_frames * port->stride;
+		} else {
+			spa_memcpy(d->data, src, n_frames * port->stride);
+		}
 		d->chunk->offset = 0;
 		d->chunk->size = n_frames * port->stride;
 		d->chunk->stride = port->stride;
@@ -842,6 +871,14 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+	for (i = 0; i < this->n_out_ports; i++)
+		clear_buffers(this, GET_OUT_PORT(this, i));
 	return 0;
 }
 
@@ -876,8 +913,12 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 
 	for (i = 0; info && i < info->n_items; i++) {
+		const char *str = info->items[i].value;
+
 		if (strcmp(info->items[i].key, SPA_KEY_API_JACK_CLIENT) == 0)
-			sscanf(info->items[i].value, "pointer:%p", &this->client);
+			sscanf(str, "pointer:%p", &this->client);
+		else if (strcmp(info->items[i].key, SPA_KEY_API_JACK_ZERO_COPY) == 0)
+			this->zero_copy = strcmp(str, "true") == 0 || atoi(str) == 1;
 	}
 	if (this->client == NULL) {
 		spa_log_error(this->log, NAME" %p: missing "SPA_KEY_API_JACK_CLIENT
@@ -0,0 +1,1061 @@
+/* Spa RTP Sink
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/loop.h>
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/utils/list.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/monitor/device.h>
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/node/io.h>
+#include <spa/param/param.h>
+#include <spa/param/audio/format.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+
+#include "rtp.h"
+
+#define NAME "rtp-sink"
+
+#define MAX_BUFFERS	32
+#define MAX_SAMPLES	8192
+#define DEFAULT_DURATION	1024
+
+struct buffer {
+	uint32_t id;
+	unsigned int outstanding:1;
+	struct spa_buffer *buf;
+};
+
+struct port {
+	struct spa_audio_info current_format;
+	unsigned int have_format:1;
+
+	uint64_t info_all;
+	struct spa_port_info info;
+	struct spa_io_buffers *io;
+	struct spa_param_info params[8];
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct spa_log *log;
+	struct spa_loop *data_loop;
+	struct spa_system *data_system;
+
+	struct spa_hook_list hooks;
+	struct spa_callbacks callbacks;
+
+	uint64_t info_all;
+	struct spa_node_info info;
+	struct spa_param_info params[8];
+
+	struct rtp_config config;
+	struct port port;
+
+	unsigned int started:1;
+	unsigned int slaved:1;
+	unsigned int marker:1;
+
+	int fd;
+	int ptp_fd;
+	clockid_t ptp_clock;
+
+	struct spa_source source;
+	int timerfd;
+
+	struct spa_io_clock *clock;
+	struct spa_io_position *position;
+
+	uint32_t duration;
+	uint64_t next_ts;		/* media clock frame of the next wakeup */
+	uint64_t next_time;		/* monotonic time of the next wakeup */
+	uint64_t last_mono;
+	uint64_t last_ptp;
+	double rate_diff;
+
+	uint32_t ts;			/* rtp timestamp of the next frame to send */
+	uint16_t seq;
+	uint32_t ssrc;
+
+	uint32_t n_packets;		/* complete packets waiting to be sent */
+	uint32_t pending;		/* frames in the packet being filled */
+	struct mmsghdr msgs[RTP_MAX_PACKETS];
+	struct iovec iov[RTP_MAX_PACKETS];
+	uint8_t packets[RTP_MAX_PACKETS][RTP_MAX_PACKET];
+};
+
+#define CHECK_PORT(this,d,p)    ((d) == SPA_DIRECTION_INPUT && (p) == 0)
+
+static int impl_node_enum_params(void *object, int seq,
+			uint32_t id, uint32_t start, uint32_t num,
+			const struct spa_pod *filter)
+{
+	return -ENOENT;
+}
+
+static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	return -ENOENT;
+}
+
+static inline uint64_t get_time(struct impl *this, clockid_t clock_id)
+{
+	struct timespec now;
+	spa_system_clock_gettime(this->data_system, clock_id, &now);
+	return SPA_TIMESPEC_TO_NSEC(&now);
+}
+
+static int set_timers(struct impl *this)
+{
+	struct itimerspec ts;
+
+	ts.it_value.tv_sec = 0;
+	ts.it_value.tv_nsec = this->slaved ? 0 : 1;
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+
+	return spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
+}
+
+static int do_reslave(struct spa_loop *loop,
+			bool async,
+			uint32_t seq,
+			const void *data,
+			size_t size,
+			void *user_data)
+{
+	struct impl *this = user_data;
+	set_timers(this);
+	return 0;
+}
+
+static inline bool is_slaved(struct impl *this)
+{
+	return this->position && this->clock && this->position->clock.id != this->clock->id;
+}
+
+static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	struct impl *this = object;
+	bool slaved;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	switch (id) {
+	case SPA_IO_Clock:
+		this->clock = data;
+		if (this->clock)
+			snprintf(this->clock->name, sizeof(this->clock->name),
+					"api.rtp.%s", this->config.ptp_device[0] ?
+					this->config.ptp_device : "tai");
+		break;
+	case SPA_IO_Position:
+		this->position = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	slaved = is_slaved(this);
+	if (this->started && slaved != this->slaved) {
+		spa_log_debug(this->log, NAME " %p: reslave %d->%d", this, this->slaved, slaved);
+		this->slaved = slaved;
+		spa_loop_invoke(this->data_loop, do_reslave, 0, NULL, 0, true, this);
+	}
+	return 0;
+}
+
+static void flush_packets(struct impl *this)
+{
+	uint32_t i;
+	int res;
+
+	if (this->n_packets == 0)
+		return;
+
+	/* packets that can't be sent in time are dropped, there is no point in
+	 * retrying because the receiver plays them at their timestamp */
+	res = sendmmsg(this->fd, this->msgs, this->n_packets, MSG_DONTWAIT);
+	if (res < 0)
+		spa_log_trace(this->log, NAME " %p: send error: %m", this);
+	else if ((uint32_t)res < this->n_packets)
+		spa_log_trace(this->log, NAME " %p: sent %d of %u packets",
+				this, res, this->n_packets);
+
+	/* move the packet that is being filled to the front */
+	if (this->pending > 0) {
+		memcpy(this->packets[0], this->packets[this->n_packets],
+				sizeof(struct rtp_header) + this->pending * this->config.frame_size);
+	}
+	for (i = 0; i < this->n_packets; i++)
+		this->iov[i].iov_len = 0;
+	this->n_packets = 0;
+}
+
+static void write_frames(struct impl *this, const uint8_t *src, uint32_t n_frames)
+{
+	struct rtp_config *c = &this->config;
+
+	while (n_frames > 0) {
+		uint8_t *packet = this->packets[this->n_packets];
+		uint32_t avail;
+
+		if (this->pending == 0) {
+			struct rtp_header *header = (struct rtp_header *)packet;
+
+			spa_zero(*header);
+			header->v = RTP_VERSION;
+			header->pt = RTP_PAYLOAD_TYPE;
+			header->m = this->marker;
+			header->sequence_number = htons(this->seq++);
+			header->timestamp = htonl(this->ts);
+			header->ssrc = htonl(this->ssrc);
+			this->marker = false;
+		}
+		avail = SPA_MIN(c->ptime - this->pending, n_frames);
+
+		rtp_swap_samples(c, packet + sizeof(struct rtp_header) +
+				this->pending * c->frame_size, src, avail);
+
+		src += avail * c->frame_size;
+		n_frames -= avail;
+		this->pending += avail;
+		this->ts += avail;
+
+		if (this->pending == c->ptime) {
+			this->iov[this->n_packets].iov_len = sizeof(struct rtp_header) +
+				c->ptime * c->frame_size;
+			this->pending = 0;
+			if (++this->n_packets == RTP_MAX_PACKETS)
+				flush_packets(this);
+		}
+	}
+}
+
+/* restart the stream at the current media clock time, receivers use the
+ * marker bit to detect the discontinuity */
+static void resync(struct impl *this, uint64_t ptp_time)
+{
+	uint64_t media = rtp_media_frames(ptp_time, this->config.rate);
+
+	spa_log_debug(this->log, NAME " %p: resync %u -> %"PRIu64, this,
+			this->ts, media);
+
+	this->next_ts = media;
+	this->ts = (uint32_t) media;
+	this->pending = 0;
+	this->marker = true;
+}
+
+static void on_timeout(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	struct port *port = &this->port;
+	struct spa_io_buffers *io = port->io;
+	struct itimerspec ts;
+	uint64_t exp, now_mono, now_ptp, media, ts_time;
+	uint32_t rate = this->config.rate;
+	int64_t wait;
+
+	if (this->started && spa_system_timerfd_read(this->data_system, this->timerfd, &exp) < 0)
+		spa_log_warn(this->log, NAME " %p: error reading timerfd: %m", this);
+
+	if (!this->started || this->slaved)
+		return;
+
+	now_mono = get_time(this, CLOCK_MONOTONIC);
+	now_ptp = get_time(this, this->ptp_clock);
+
+	/* track the rate of the PTP clock against the monotonic clock, this
+	 * is the rate the graph runs at when we drive it */
+	if (this->last_mono != 0 && now_mono > this->last_mono) {
+		double corr = (double)(now_ptp - this->last_ptp) /
+			(double)(now_mono - this->last_mono);
+		if (corr > 0.9 && corr < 1.1)
+			this->rate_diff += (corr - this->rate_diff) * 0.01;
+	}
+	this->last_mono = now_mono;
+	this->last_ptp = now_ptp;
+
+	if (this->position)
+		this->duration = this->position->clock.duration;
+	if (this->duration == 0)
+		this->duration = DEFAULT_DURATION;
+
+	media = rtp_media_frames(now_ptp, rate);
+	if (this->next_ts == 0 ||
+	    media > this->next_ts + 2 * this->duration ||
+	    media + 2 * this->duration < this->next_ts)
+		resync(this, now_ptp);
+
+	this->next_ts += this->duration;
+	ts_time = (this->next_ts / rate) * SPA_NSEC_PER_SEC +
+		(this->next_ts % rate) * SPA_NSEC_PER_SEC / rate;
+	wait = (int64_t)(ts_time - now_ptp);
+	this->next_time = now_mono + (int64_t)(SPA_MAX(wait, 0) / this->rate_diff);
+
+	if (this->clock) {
+		this->clock->nsec = now_mono;
+		this->clock->rate = SPA_FRACTION(1, rate);
+		this->clock->position += this->duration;
+		this->clock->duration = this->duration;
+		this->clock->delay = 0;
+		this->clock->rate_diff = this->rate_diff;
+		this->clock->next_nsec = this->next_time;
+	}
+
+	spa_log_trace_fp(this->log, NAME " %p: timeout %"PRIu64" %"PRIu64" %f",
+			this, now_mono, this->next_time, this->rate_diff);
+
+	ts.it_value.tv_sec = this->next_time / SPA_NSEC_PER_SEC;
+	ts.it_value.tv_nsec = this->next_time % SPA_NSEC_PER_SEC;
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+	spa_system_timerfd_settime(this->data_system, this->timerfd,
+			SPA_FD_TIMER_ABSTIME, &ts, NULL);
+
+	if (io) {
+		io->status = SPA_STATUS_NEED_DATA;
+		spa_node_call_ready(&this->callbacks, SPA_STATUS_NEED_DATA);
+	}
+}
+
+static int do_start(struct impl *this)
+{
+	uint32_t i;
+	int res;
+
+	if (this->started)
+		return 0;
+
+	if ((res = rtp_open_socket(&this->config, false)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open socket: %s",
+				this, spa_strerror(res));
+		return res;
+	}
+	this->fd = res;
+
+	for (i = 0; i < RTP_MAX_PACKETS; i++) {
+		this->iov[i].iov_base = this->packets[i];
+		this->iov[i].iov_len = 0;
+		spa_zero(this->msgs[i]);
+		this->msgs[i].msg_hdr.msg_iov = &this->iov[i];
+		this->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	this->n_packets = 0;
+	this->pending = 0;
+	this->seq = rand();
+	this->ssrc = rand();
+	this->rate_diff = 1.0;
+	this->last_mono = 0;
+	this->next_ts = 0;
+
+	resync(this, get_time(this, this->ptp_clock));
+
+	this->slaved = is_slaved(this);
+	spa_log_debug(this->log, NAME " %p: start slaved:%d", this, this->slaved);
+
+	this->started = true;
+
+	this->source.data = this;
+	this->source.fd = this->timerfd;
+	this->source.func = on_timeout;
+	this->source.mask = SPA_IO_IN;
+	this->source.rmask = 0;
+	spa_loop_add_source(this->data_loop, &this->source);
+
+	set_timers(this);
+
+	return 0;
+}
+
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+	struct itimerspec ts;
+
+	if (this->source.loop)
+		spa_loop_remove_source(this->data_loop, &this->source);
+	ts.it_value.tv_sec = 0;
+	ts.it_value.tv_nsec = 0;
+	ts.it_interval.tv_sec = 0;
+	ts.it_interval.tv_nsec = 0;
+	spa_system_timerfd_settime(this->data_system, this->timerfd, 0, &ts, NULL);
+
+	return 0;
+}
+
+static int do_stop(struct impl *this)
+{
+	if (!this->started)
+		return 0;
+
+	spa_log_trace(this->log, NAME " %p: stop", this);
+
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+
+	this->started = false;
+
+	if (this->fd >= 0) {
+		close(this->fd);
+		this->fd = -1;
+	}
+	return 0;
+}
+
+static int impl_node_send_command(void *object, const struct spa_command *command)
+{
+	struct impl *this = object;
+	struct port *port;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	port = &this->port;
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (!port->have_format)
+			return -EIO;
+		if (port->n_buffers == 0)
+			return -EIO;
+
+		if ((res = do_start(this)) < 0)
+			return res;
+		break;
+	case SPA_NODE_COMMAND_Pause:
+		if ((res = do_stop(this)) < 0)
+			return res;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static const struct spa_dict_item node_info_items[] = {
+	{ SPA_KEY_DEVICE_API, "rtp" },
+	{ SPA_KEY_MEDIA_CLASS, "Audio/Sink" },
+	{ SPA_KEY_NODE_DRIVER, "true" },
+};
+
+static void emit_node_info(struct impl *this, bool full)
+{
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		this->info.props = &SPA_DICT_INIT_ARRAY(node_info_items);
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = 0;
+	}
+}
+
+static void emit_port_info(struct impl *this, struct port *port, bool full)
+{
+	if (full)
+		port->info.change_mask = port->info_all;
+	if (port->info.change_mask) {
+		spa_node_emit_port_info(&this->hooks,
+				SPA_DIRECTION_INPUT, 0, &port->info);
+		port->info.change_mask = 0;
+	}
+}
+
+static int
+impl_node_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct impl *this = object;
+	struct spa_hook_list save;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_hook_list_isolate(&this->hooks, &save, listener, events, data);
+
+	emit_node_info(this, true);
+	emit_port_info(this, &this->port, true);
+
+	spa_hook_list_join(&this->hooks, &save);
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(void *object,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	this->callbacks = SPA_CALLBACKS_INIT(callbacks, data);
+
+	return 0;
+}
+
+static int impl_node_sync(void *object, int seq)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_node_emit_result(&this->hooks, seq, 0, 0, NULL);
+
+	return 0;
+}
+
+static int impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static void build_info(struct impl *this, struct spa_audio_info_raw *info)
+{
+	spa_zero(*info);
+	info->format = this->config.format;
+	info->rate = this->config.rate;
+	info->channels = this->config.channels;
+	SPA_FLAG_SET(info->flags, SPA_AUDIO_FLAG_UNPOSITIONED);
+}
+
+static int
+impl_node_port_enum_params(void *object, int seq,
+			enum spa_direction direction, uint32_t port_id,
+			uint32_t id, uint32_t start, uint32_t num,
+			const struct spa_pod *filter)
+{
+
+	struct impl *this = object;
+	struct port *port;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	struct spa_audio_info_raw info;
+	uint32_t count = 0;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = &this->port;
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		if (result.index > 0)
+			return 0;
+		build_info(this, &info);
+		param = spa_format_audio_raw_build(&b, id, &info);
+		break;
+
+	case SPA_PARAM_Format:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_format_audio_raw_build(&b, id, &port->current_format.info.raw);
+		break;
+
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+							MAX_SAMPLES * this->config.frame_size,
+							16 * this->config.frame_size,
+							INT32_MAX),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->config.frame_size),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	do_stop(this);
+	if (port->n_buffers > 0) {
+		spa_log_debug(this->log, NAME " %p: clear buffers", this);
+		port->n_buffers = 0;
+	}
+	return 0;
+}
+
+static int port_set_format(struct impl *this, struct port *port,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	int err;
+
+	if (format == NULL) {
+		spa_log_debug(this->log, NAME " %p: clear format", this);
+		clear_buffers(this, port);
+		port->have_format = false;
+	} else {
+		struct spa_audio_info info = { 0 };
+
+		if ((err = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
+			return err;
+
+		if (info.media_type != SPA_MEDIA_TYPE_audio ||
+		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+			return -EINVAL;
+
+		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+			return -EINVAL;
+
+		if (info.info.raw.format != this->config.format ||
+		    info.info.raw.rate != this->config.rate ||
+		    info.info.raw.channels != this->config.channels)
+			return -EINVAL;
+
+		port->current_format = info;
+		port->have_format = true;
+	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->info.change_mask |= SPA_PORT_CHANGE_MASK_RATE;
+		port->info.rate = SPA_FRACTION(1, port->current_format.info.raw.rate);
+		port->params[2] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[2] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(void *object,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	switch (id) {
+	case SPA_PARAM_Format:
+		return port_set_format(this, &this->port, flags, param);
+	default:
+		return -ENOENT;
+	}
+}
+
+static int
+impl_node_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t flags,
+		struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = &this->port;
+
+	spa_log_debug(this->log, NAME " %p: use buffers %d", this, n_buffers);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		b->buf = buffers[i];
+		b->id = i;
+		b->outstanding = true;
+
+		if (buffers[i]->datas[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: need mapped memory", this);
+			return -EINVAL;
+		}
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_set_io(void *object,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t id,
+		      void *data, size_t size)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = &this->port;
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		port->io = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_process(void *object)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct spa_io_buffers *io;
+	struct spa_data *d;
+	uint32_t offs, size;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	port = &this->port;
+	io = port->io;
+	spa_return_val_if_fail(io != NULL, -EIO);
+
+	if (io->status != SPA_STATUS_HAVE_DATA || io->buffer_id >= port->n_buffers)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (!this->started) {
+		io->status = SPA_STATUS_OK;
+		return SPA_STATUS_HAVE_DATA;
+	}
+
+	if (this->slaved) {
+		/* someone else drives the graph, keep the timestamps close to the
+		 * media clock so that a drifting driver does not make us send
+		 * packets that receivers consider too late or too early */
+		uint64_t now_ptp = get_time(this, this->ptp_clock);
+		uint64_t media = rtp_media_frames(now_ptp, this->config.rate);
+		uint32_t limit = 4 * SPA_MAX(this->position->clock.duration, this->config.ptime);
+		int32_t diff = (int32_t)((uint32_t)media - this->ts);
+
+		if (diff > (int32_t)limit || diff < -(int32_t)limit) {
+			flush_packets(this);
+			resync(this, now_ptp);
+		}
+	}
+
+	d = port->buffers[io->buffer_id].buf->datas;
+	offs = SPA_MIN(d[0].chunk->offset, d[0].maxsize);
+	size = SPA_MIN(d[0].chunk->size, d[0].maxsize - offs);
+
+	spa_log_trace_fp(this->log, NAME " %p: process buffer %u size %u",
+			this, io->buffer_id, size);
+
+	write_frames(this, SPA_MEMBER(d[0].data, offs, uint8_t),
+			size / this->config.frame_size);
+	flush_packets(this);
+
+	io->status = SPA_STATUS_OK;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_node_add_listener,
+	.set_callbacks = impl_node_set_callbacks,
+	.sync = impl_node_sync,
+	.enum_params = impl_node_enum_params,
+	.set_param = impl_node_set_param,
+	.set_io = impl_node_set_io,
+	.send_command = impl_node_send_command,
+	.add_port = impl_node_add_port,
+	.remove_port = impl_node_remove_port,
+	.port_enum_params = impl_node_port_enum_params,
+	.port_set_param = impl_node_port_set_param,
+	.port_use_buffers = impl_node_port_use_buffers,
+	.port_set_io = impl_node_port_set_io,
+	.port_reuse_buffer = impl_node_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (type == SPA_TYPE_INTERFACE_Node)
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this = (struct impl *) handle;
+
+	do_stop(this);
+	if (this->timerfd >= 0)
+		spa_system_close(this->data_system, this->timerfd);
+	if (this->ptp_fd >= 0)
+		close(this->ptp_fd);
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		switch (support[i].type) {
+		case SPA_TYPE_INTERFACE_Log:
+			this->log = support[i].data;
+			break;
+		case SPA_TYPE_INTERFACE_DataLoop:
+			this->data_loop = support[i].data;
+			break;
+		case SPA_TYPE_INTERFACE_DataSystem:
+			this->data_system = support[i].data;
+			break;
+		}
+	}
+	if (this->data_loop == NULL) {
+		spa_log_error(this->log, "a data loop is needed");
+		return -EINVAL;
+	}
+	if (this->data_system == NULL) {
+		spa_log_error(this->log, "a data system is needed");
+		return -EINVAL;
+	}
+
+	this->fd = -1;
+	this->ptp_fd = -1;
+	this->timerfd = -1;
+
+	if ((res = rtp_config_parse(&this->config, info,
+				SPA_KEY_API_RTP_DESTINATION_IP,
+				SPA_KEY_API_RTP_DESTINATION_PORT, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: invalid stream description, a valid %s is needed",
+				this, SPA_KEY_API_RTP_DESTINATION_IP);
+		return res;
+	}
+	if ((res = rtp_open_ptp_clock(&this->config, &this->ptp_clock)) < -1) {
+		spa_log_error(this->log, NAME " %p: can't open PTP clock %s: %s",
+				this, this->config.ptp_device, spa_strerror(res));
+		return res;
+	}
+	this->ptp_fd = res;
+
+	spa_hook_list_init(&this->hooks);
+
+	this->node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, this);
+
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PROPS;
+	this->info = SPA_NODE_INFO_INIT();
+	this->info.max_input_ports = 1;
+	this->info.flags = SPA_NODE_FLAG_RT;
+
+	port = &this->port;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = SPA_PORT_FLAG_LIVE |
+			   SPA_PORT_FLAG_PHYSICAL |
+			   SPA_PORT_FLAG_TERMINAL;
+	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->info.params = port->params;
+	port->info.n_params = 4;
+
+	this->timerfd = spa_system_timerfd_create(this->data_system,
+			CLOCK_MONOTONIC, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+
+	spa_log_info(this->log, NAME " %p: %u channels at %u Hz, %u frames per packet",
+			this, this->config.channels, this->config.rate, this->config.ptime);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+
+	return 1;
+}
+
+static const struct spa_dict_item info_items[] = {
+	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ SPA_KEY_FACTORY_DESCRIPTION, "Send audio as an RTP/AES67 stream" },
+	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_RTP_DESTINATION_IP"=<ip> "
+		"["SPA_KEY_API_RTP_DESTINATION_PORT"=<port>] "
+		"["SPA_KEY_API_RTP_ENCODING"=L16|L24] "
+		"["SPA_KEY_API_RTP_PTP_DEVICE"=<device>]" },
+};
+
+static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
+
+const struct spa_handle_factory spa_rtp_sink_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_API_RTP_SINK,
+	&info,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info,
+};
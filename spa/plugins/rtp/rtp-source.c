@@ -0,0 +1,1008 @@
+/* Spa RTP Source
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/loop.h>
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/utils/list.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/monitor/device.h>
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/node/io.h>
+#include <spa/param/param.h>
+#include <spa/param/audio/format.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+
+#include "rtp.h"
+
+#define NAME "rtp-source"
+
+#define MAX_BUFFERS	32
+#define MAX_SAMPLES	8192
+#define RING_SIZE	(1024 * 1024)	/* jitter buffer, indexed by rtp timestamp */
+
+struct buffer {
+	uint32_t id;
+	unsigned int outstanding:1;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+	struct spa_list link;
+};
+
+struct port {
+	struct spa_audio_info current_format;
+	unsigned int have_format:1;
+
+	uint64_t info_all;
+	struct spa_port_info info;
+	struct spa_io_buffers *io;
+	struct spa_param_info params[8];
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+
+	struct spa_list free;
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct spa_log *log;
+	struct spa_loop *data_loop;
+	struct spa_system *data_system;
+
+	struct spa_hook_list hooks;
+	struct spa_callbacks callbacks;
+
+	uint64_t info_all;
+	struct spa_node_info info;
+	struct spa_param_info params[8];
+
+	struct rtp_config config;
+	struct port port;
+
+	unsigned int started:1;
+	unsigned int have_sync:1;
+
+	struct spa_source source;
+
+	struct spa_io_clock *clock;
+	struct spa_io_position *position;
+
+	uint32_t read_ts;		/* rtp timestamp of the next frame to output */
+	uint32_t write_ts;		/* rtp timestamp after the newest received frame */
+	uint16_t seq;
+	uint64_t sample_count;
+
+	uint32_t ring_frames;		/* power of two */
+	uint8_t ring[RING_SIZE];
+
+	struct mmsghdr msgs[RTP_MAX_PACKETS];
+	struct iovec iov[RTP_MAX_PACKETS];
+	uint8_t packets[RTP_MAX_PACKETS][RTP_MAX_PACKET];
+};
+
+#define CHECK_PORT(this,d,p)    ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+
+static int impl_node_enum_params(void *object, int seq,
+			uint32_t id, uint32_t start, uint32_t num,
+			const struct spa_pod *filter)
+{
+	return -ENOENT;
+}
+
+static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	return -ENOENT;
+}
+
+static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	switch (id) {
+	case SPA_IO_Clock:
+		this->clock = data;
+		break;
+	case SPA_IO_Position:
+		this->position = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static void ring_write(struct impl *this, uint32_t ts, const uint8_t *src, uint32_t n_frames)
+{
+	struct rtp_config *c = &this->config;
+	uint32_t index = ts & (this->ring_frames - 1);
+	uint32_t l0 = SPA_MIN(n_frames, this->ring_frames - index);
+
+	rtp_swap_samples(c, &this->ring[index * c->frame_size], src, l0);
+	if (l0 < n_frames)
+		rtp_swap_samples(c, this->ring, src + l0 * c->frame_size, n_frames - l0);
+}
+
+/* copy out of the ring and clear what was read, so that frames of packets
+ * that never arrive play as silence the next time around */
+static void ring_read(struct impl *this, uint32_t ts, uint8_t *dst, uint32_t n_frames)
+{
+	uint32_t frame_size = this->config.frame_size;
+	uint32_t index = ts & (this->ring_frames - 1);
+	uint32_t l0 = SPA_MIN(n_frames, this->ring_frames - index) * frame_size;
+	uint32_t l1 = n_frames * frame_size - l0;
+
+	memcpy(dst, &this->ring[index * frame_size], l0);
+	memset(&this->ring[index * frame_size], 0, l0);
+	if (l1 > 0) {
+		memcpy(dst + l0, this->ring, l1);
+		memset(this->ring, 0, l1);
+	}
+}
+
+static void reset_sync(struct impl *this, uint32_t ts)
+{
+	spa_log_debug(this->log, NAME " %p: sync to %u, latency %u", this,
+			ts, this->config.latency);
+
+	memset(this->ring, 0, this->ring_frames * this->config.frame_size);
+	this->read_ts = ts - this->config.latency;
+	this->write_ts = ts;
+	this->have_sync = true;
+}
+
+static void receive_packet(struct impl *this, uint8_t *data, uint32_t len)
+{
+	struct rtp_config *c = &this->config;
+	struct rtp_header *header = (struct rtp_header *)data;
+	uint32_t hlen, ts, n_frames;
+	int32_t diff;
+
+	if (len < sizeof(*header) || header->v != RTP_VERSION)
+		return;
+
+	hlen = sizeof(*header) + header->cc * 4;
+	if (len < hlen)
+		return;
+
+	ts = ntohl(header->timestamp);
+	n_frames = (len - hlen) / c->frame_size;
+	data += hlen;
+
+	if (this->have_sync && ntohs(header->sequence_number) != this->seq)
+		spa_log_trace(this->log, NAME " %p: expected seq %u, got %u", this,
+				this->seq, ntohs(header->sequence_number));
+	this->seq = ntohs(header->sequence_number) + 1;
+
+	if (!this->have_sync || header->m)
+		reset_sync(this, ts);
+
+	diff = (int32_t)(ts - this->read_ts);
+	if (diff + (int32_t)n_frames <= 0) {
+		spa_log_trace(this->log, NAME " %p: late packet %u, at %u", this,
+				ts, this->read_ts);
+		return;
+	}
+	if (diff + n_frames > this->ring_frames) {
+		spa_log_warn(this->log, NAME " %p: packet %u too far ahead of %u, resync",
+				this, ts, this->read_ts);
+		reset_sync(this, ts);
+		diff = (int32_t)(ts - this->read_ts);
+	}
+	if (diff < 0) {
+		/* only the tail of the packet is still in time */
+		data += -diff * c->frame_size;
+		n_frames += diff;
+		ts -= diff;
+	}
+	ring_write(this, ts, data, n_frames);
+
+	if ((int32_t)(ts + n_frames - this->write_ts) > 0)
+		this->write_ts = ts + n_frames;
+}
+
+static void on_receive(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	int i, res;
+
+	if (source->rmask & (SPA_IO_ERR | SPA_IO_HUP)) {
+		spa_log_error(this->log, NAME " %p: socket error", this);
+		return;
+	}
+
+	do {
+		res = recvmmsg(this->source.fd, this->msgs, RTP_MAX_PACKETS, MSG_DONTWAIT, NULL);
+		if (res < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				spa_log_warn(this->log, NAME " %p: receive error: %m", this);
+			break;
+		}
+		for (i = 0; i < res; i++)
+			receive_packet(this, this->packets[i], this->msgs[i].msg_len);
+	} while (res == RTP_MAX_PACKETS);
+}
+
+static int do_start(struct impl *this)
+{
+	uint32_t i;
+	int res;
+
+	if (this->started)
+		return 0;
+
+	if ((res = rtp_open_socket(&this->config, true)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open socket: %s",
+				this, spa_strerror(res));
+		return res;
+	}
+
+	for (i = 0; i < RTP_MAX_PACKETS; i++) {
+		this->iov[i].iov_base = this->packets[i];
+		this->iov[i].iov_len = RTP_MAX_PACKET;
+		spa_zero(this->msgs[i]);
+		this->msgs[i].msg_hdr.msg_iov = &this->iov[i];
+		this->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	this->have_sync = false;
+	this->sample_count = 0;
+
+	spa_log_debug(this->log, NAME " %p: start", this);
+
+	this->started = true;
+
+	this->source.data = this;
+	this->source.fd = res;
+	this->source.func = on_receive;
+	this->source.mask = SPA_IO_IN;
+	this->source.rmask = 0;
+	spa_loop_add_source(this->data_loop, &this->source);
+
+	return 0;
+}
+
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+
+	if (this->source.loop)
+		spa_loop_remove_source(this->data_loop, &this->source);
+
+	return 0;
+}
+
+static int do_stop(struct impl *this)
+{
+	if (!this->started)
+		return 0;
+
+	spa_log_trace(this->log, NAME " %p: stop", this);
+
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+
+	this->started = false;
+
+	close(this->source.fd);
+	this->source.fd = -1;
+
+	return 0;
+}
+
+static int impl_node_send_command(void *object, const struct spa_command *command)
+{
+	struct impl *this = object;
+	struct port *port;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	port = &this->port;
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (!port->have_format)
+			return -EIO;
+		if (port->n_buffers == 0)
+			return -EIO;
+
+		if ((res = do_start(this)) < 0)
+			return res;
+		break;
+	case SPA_NODE_COMMAND_Pause:
+		if ((res = do_stop(this)) < 0)
+			return res;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static const struct spa_dict_item node_info_items[] = {
+	{ SPA_KEY_DEVICE_API, "rtp" },
+	{ SPA_KEY_MEDIA_CLASS, "Audio/Source" },
+};
+
+static void emit_node_info(struct impl *this, bool full)
+{
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		this->info.props = &SPA_DICT_INIT_ARRAY(node_info_items);
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = 0;
+	}
+}
+
+static void emit_port_info(struct impl *this, struct port *port, bool full)
+{
+	if (full)
+		port->info.change_mask = port->info_all;
+	if (port->info.change_mask) {
+		spa_node_emit_port_info(&this->hooks,
+				SPA_DIRECTION_OUTPUT, 0, &port->info);
+		port->info.change_mask = 0;
+	}
+}
+
+static int
+impl_node_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct impl *this = object;
+	struct spa_hook_list save;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_hook_list_isolate(&this->hooks, &save, listener, events, data);
+
+	emit_node_info(this, true);
+	emit_port_info(this, &this->port, true);
+
+	spa_hook_list_join(&this->hooks, &save);
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(void *object,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	this->callbacks = SPA_CALLBACKS_INIT(callbacks, data);
+
+	return 0;
+}
+
+static int impl_node_sync(void *object, int seq)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_node_emit_result(&this->hooks, seq, 0, 0, NULL);
+
+	return 0;
+}
+
+static int impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static void build_info(struct impl *this, struct spa_audio_info_raw *info)
+{
+	spa_zero(*info);
+	info->format = this->config.format;
+	info->rate = this->config.rate;
+	info->channels = this->config.channels;
+	SPA_FLAG_SET(info->flags, SPA_AUDIO_FLAG_UNPOSITIONED);
+}
+
+static int
+impl_node_port_enum_params(void *object, int seq,
+			enum spa_direction direction, uint32_t port_id,
+			uint32_t id, uint32_t start, uint32_t num,
+			const struct spa_pod *filter)
+{
+
+	struct impl *this = object;
+	struct port *port;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	struct spa_audio_info_raw info;
+	uint32_t count = 0;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = &this->port;
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		if (result.index > 0)
+			return 0;
+		build_info(this, &info);
+		param = spa_format_audio_raw_build(&b, id, &info);
+		break;
+
+	case SPA_PARAM_Format:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_format_audio_raw_build(&b, id, &port->current_format.info.raw);
+		break;
+
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+							MAX_SAMPLES * this->config.frame_size,
+							16 * this->config.frame_size,
+							INT32_MAX),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(this->config.frame_size),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+
+	case SPA_PARAM_Meta:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	do_stop(this);
+	if (port->n_buffers > 0) {
+		spa_log_debug(this->log, NAME " %p: clear buffers", this);
+		spa_list_init(&port->free);
+		port->n_buffers = 0;
+	}
+	return 0;
+}
+
+static int port_set_format(struct impl *this, struct port *port,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	int err;
+
+	if (format == NULL) {
+		spa_log_debug(this->log, NAME " %p: clear format", this);
+		clear_buffers(this, port);
+		port->have_format = false;
+	} else {
+		struct spa_audio_info info = { 0 };
+
+		if ((err = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
+			return err;
+
+		if (info.media_type != SPA_MEDIA_TYPE_audio ||
+		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+			return -EINVAL;
+
+		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+			return -EINVAL;
+
+		if (info.info.raw.format != this->config.format ||
+		    info.info.raw.rate != this->config.rate ||
+		    info.info.raw.channels != this->config.channels)
+			return -EINVAL;
+
+		port->current_format = info;
+		port->have_format = true;
+	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->info.change_mask |= SPA_PORT_CHANGE_MASK_RATE;
+		port->info.rate = SPA_FRACTION(1, port->current_format.info.raw.rate);
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(void *object,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	switch (id) {
+	case SPA_PARAM_Format:
+		return port_set_format(this, &this->port, flags, param);
+	default:
+		return -ENOENT;
+	}
+}
+
+static int
+impl_node_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t flags,
+		struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = &this->port;
+
+	spa_log_debug(this->log, NAME " %p: use buffers %d", this, n_buffers);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		b->buf = buffers[i];
+		b->id = i;
+		b->outstanding = false;
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+
+		if (buffers[i]->datas[0].data == NULL) {
+			spa_log_error(this->log, NAME " %p: need mapped memory", this);
+			return -EINVAL;
+		}
+		spa_list_append(&port->free, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_set_io(void *object,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t id,
+		      void *data, size_t size)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = &this->port;
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		port->io = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static void recycle_buffer(struct impl *this, struct port *port, uint32_t buffer_id)
+{
+	struct buffer *b = &port->buffers[buffer_id];
+
+	if (b->outstanding) {
+		spa_log_trace(this->log, NAME " %p: recycle buffer %u", this, buffer_id);
+		spa_list_append(&port->free, &b->link);
+		b->outstanding = false;
+	}
+}
+
+static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(port_id == 0, -EINVAL);
+
+	port = &this->port;
+
+	if (port->n_buffers == 0)
+		return -EIO;
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, port, buffer_id);
+
+	return 0;
+}
+
+/* keep the amount of buffered data around the configured latency. We don't
+ * resample; when the graph clock and the sender drift apart we skip or
+ * repeat (as silence) the difference once it gets larger than two cycles */
+static void correct_drift(struct impl *this, uint32_t duration)
+{
+	uint32_t latency = this->config.latency;
+	int32_t filled = (int32_t)(this->write_ts - this->read_ts);
+
+	if (filled > (int32_t)(latency + 2 * duration)) {
+		spa_log_debug(this->log, NAME " %p: skip %d frames", this,
+				filled - (int32_t)latency);
+		this->read_ts = this->write_ts - latency;
+	} else if (filled < (int32_t)latency - 2 * (int32_t)duration) {
+		spa_log_debug(this->log, NAME " %p: insert %d frames", this,
+				(int32_t)latency - filled);
+		this->read_ts = this->write_ts - latency;
+	}
+}
+
+static int impl_node_process(void *object)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct spa_io_buffers *io;
+	struct buffer *b;
+	struct spa_data *d;
+	uint32_t n_frames, frame_size = this->config.frame_size;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	port = &this->port;
+	io = port->io;
+	spa_return_val_if_fail(io != NULL, -EIO);
+
+	if (io->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (io->buffer_id < port->n_buffers) {
+		recycle_buffer(this, port, io->buffer_id);
+		io->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_trace(this->log, NAME " %p: out of buffers", this);
+		return -EPIPE;
+	}
+	b = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	d = b->buf->datas;
+
+	n_frames = d[0].maxsize / frame_size;
+	if (this->position)
+		n_frames = SPA_MIN(n_frames, (uint32_t)this->position->clock.duration);
+	n_frames = SPA_MIN(n_frames, this->ring_frames);
+
+	if (this->have_sync) {
+		correct_drift(this, n_frames);
+		ring_read(this, this->read_ts, d[0].data, n_frames);
+		this->read_ts += n_frames;
+	} else {
+		memset(d[0].data, 0, n_frames * frame_size);
+	}
+
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = n_frames * frame_size;
+	d[0].chunk->stride = frame_size;
+
+	if (b->h) {
+		b->h->seq = this->sample_count;
+		b->h->pts = this->position ? this->position->clock.nsec : 0;
+		b->h->dts_offset = 0;
+	}
+	this->sample_count += n_frames;
+
+	io->buffer_id = b->id;
+	io->status = SPA_STATUS_HAVE_DATA;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_node_add_listener,
+	.set_callbacks = impl_node_set_callbacks,
+	.sync = impl_node_sync,
+	.enum_params = impl_node_enum_params,
+	.set_param = impl_node_set_param,
+	.set_io = impl_node_set_io,
+	.send_command = impl_node_send_command,
+	.add_port = impl_node_add_port,
+	.remove_port = impl_node_remove_port,
+	.port_enum_params = impl_node_port_enum_params,
+	.port_set_param = impl_node_port_set_param,
+	.port_use_buffers = impl_node_port_use_buffers,
+	.port_set_io = impl_node_port_set_io,
+	.port_reuse_buffer = impl_node_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (type == SPA_TYPE_INTERFACE_Node)
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this = (struct impl *) handle;
+
+	do_stop(this);
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		switch (support[i].type) {
+		case SPA_TYPE_INTERFACE_Log:
+			this->log = support[i].data;
+			break;
+		case SPA_TYPE_INTERFACE_DataLoop:
+			this->data_loop = support[i].data;
+			break;
+		case SPA_TYPE_INTERFACE_DataSystem:
+			this->data_system = support[i].data;
+			break;
+		}
+	}
+	if (this->data_loop == NULL) {
+		spa_log_error(this->log, "a data loop is needed");
+		return -EINVAL;
+	}
+
+	if ((res = rtp_config_parse(&this->config, info,
+				SPA_KEY_API_RTP_SOURCE_IP,
+				SPA_KEY_API_RTP_SOURCE_PORT, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: invalid stream description, a valid %s is needed",
+				this, SPA_KEY_API_RTP_SOURCE_IP);
+		return res;
+	}
+
+	/* the largest power of two of frames that fits in the ring */
+	this->ring_frames = 1;
+	while (this->ring_frames * 2 * this->config.frame_size <= RING_SIZE)
+		this->ring_frames *= 2;
+
+	if (this->config.latency + 2 * MAX_SAMPLES > this->ring_frames) {
+		spa_log_error(this->log, NAME " %p: latency %u too large, max %u",
+				this, this->config.latency, this->ring_frames - 2 * MAX_SAMPLES);
+		return -EINVAL;
+	}
+
+	this->source.fd = -1;
+
+	spa_hook_list_init(&this->hooks);
+
+	this->node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, this);
+
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PROPS;
+	this->info = SPA_NODE_INFO_INIT();
+	this->info.max_output_ports = 1;
+	this->info.flags = SPA_NODE_FLAG_RT;
+
+	port = &this->port;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = SPA_PORT_FLAG_LIVE |
+			   SPA_PORT_FLAG_PHYSICAL |
+			   SPA_PORT_FLAG_TERMINAL;
+	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->info.params = port->params;
+	port->info.n_params = 5;
+	spa_list_init(&port->free);
+
+	spa_log_info(this->log, NAME " %p: %u channels at %u Hz, latency %u frames",
+			this, this->config.channels, this->config.rate, this->config.latency);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+
+	return 1;
+}
+
+static const struct spa_dict_item info_items[] = {
+	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ SPA_KEY_FACTORY_DESCRIPTION, "Receive an RTP/AES67 audio stream" },
+	{ SPA_KEY_FACTORY_USAGE, SPA_KEY_API_RTP_SOURCE_IP"=<ip> "
+		"["SPA_KEY_API_RTP_SOURCE_PORT"=<port>] "
+		"["SPA_KEY_API_RTP_ENCODING"=L16|L24] "
+		"["SPA_KEY_API_RTP_LATENCY"=<frames>]" },
+};
+
+static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
+
+const struct spa_handle_factory spa_rtp_source_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_API_RTP_SOURCE,
+	&info,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info,
+};
@@ -0,0 +1,303 @@
+/* Spa RTP
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_RTP_H
+#define SPA_RTP_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <endian.h>
+#include <byteswap.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/dict.h>
+#include <spa/utils/keys.h>
+#include <spa/param/audio/raw.h>
+
+#define RTP_VERSION		2
+#define RTP_PAYLOAD_TYPE	96	/* dynamic, as AES67 streams use */
+#define RTP_MAX_PACKET		1500
+#define RTP_MAX_PACKETS		64	/* packets per sendmmsg/recvmmsg */
+
+#define DEFAULT_PORT		5004
+#define DEFAULT_RATE		48000
+#define DEFAULT_CHANNELS	2
+#define DEFAULT_PTIME		1000	/* microseconds, the AES67 default */
+#define DEFAULT_LATENCY		256	/* frames */
+
+struct rtp_header {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	unsigned cc:4;
+	unsigned x:1;
+	unsigned p:1;
+	unsigned v:2;
+
+	unsigned pt:7;
+	unsigned m:1;
+#elif __BYTE_ORDER == __BIG_ENDIAN
+	unsigned v:2;
+	unsigned p:1;
+	unsigned x:1;
+	unsigned cc:4;
+
+	unsigned m:1;
+	unsigned pt:7;
+#else
+#error "Unknown byte order"
+#endif
+	uint16_t sequence_number;
+	uint32_t timestamp;
+	uint32_t ssrc;
+	uint32_t csrc[0];
+} __attribute__ ((packed));
+
+struct rtp_config {
+	uint32_t format;		/* native sample format of the port, S16 or S24 */
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t sample_size;		/* bytes per sample on the wire */
+	uint32_t frame_size;		/* bytes per frame on the wire and in the port */
+	uint32_t ptime;			/* frames per packet */
+	uint32_t latency;		/* receive latency in frames */
+
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	char ifname[IF_NAMESIZE];
+	char ptp_device[64];
+};
+
+static inline int rtp_parse_addr(const char *ip, uint16_t port,
+		struct sockaddr_storage *addr, socklen_t *len)
+{
+	struct sockaddr_in *sa4 = (struct sockaddr_in*)addr;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6*)addr;
+
+	spa_zero(*addr);
+	if (inet_pton(AF_INET, ip, &sa4->sin_addr) == 1) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_port = htons(port);
+		*len = sizeof(*sa4);
+	} else if (inet_pton(AF_INET6, ip, &sa6->sin6_addr) == 1) {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_port = htons(port);
+		*len = sizeof(*sa6);
+	} else
+		return -EINVAL;
+	return 0;
+}
+
+/* parse the stream description, the ip and port keys are those of the
+ * sink or the source */
+static inline int rtp_config_parse(struct rtp_config *c, const struct spa_dict *info,
+		const char *ip_key, const char *port_key, const char *default_ip)
+{
+	const char *str, *ip = default_ip;
+	uint32_t port = DEFAULT_PORT, ptime = DEFAULT_PTIME;
+
+	spa_zero(*c);
+	c->format = SPA_AUDIO_FORMAT_S24;
+	c->sample_size = 3;
+	c->rate = DEFAULT_RATE;
+	c->channels = DEFAULT_CHANNELS;
+	c->latency = DEFAULT_LATENCY;
+
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_ENCODING)) != NULL) {
+		if (strcmp(str, "L16") == 0) {
+			c->format = SPA_AUDIO_FORMAT_S16;
+			c->sample_size = 2;
+		} else if (strcmp(str, "L24") != 0)
+			return -EINVAL;
+	}
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_RATE)) != NULL)
+		c->rate = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_CHANNELS)) != NULL)
+		c->channels = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_PTIME)) != NULL)
+		ptime = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_LATENCY)) != NULL)
+		c->latency = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_INTERFACE)) != NULL)
+		strncpy(c->ifname, str, sizeof(c->ifname) - 1);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_RTP_PTP_DEVICE)) != NULL)
+		strncpy(c->ptp_device, str, sizeof(c->ptp_device) - 1);
+	if (info && (str = spa_dict_lookup(info, ip_key)) != NULL)
+		ip = str;
+	if (info && (str = spa_dict_lookup(info, port_key)) != NULL)
+		port = atoi(str);
+
+	if (c->rate == 0 || c->channels == 0 || c->channels > SPA_AUDIO_MAX_CHANNELS ||
+	    port == 0 || port > 65535 || ip == NULL)
+		return -EINVAL;
+
+	c->frame_size = c->sample_size * c->channels;
+	c->ptime = SPA_MAX((uint64_t)ptime * c->rate / 1000000, 1u);
+	if (sizeof(struct rtp_header) + c->ptime * c->frame_size > RTP_MAX_PACKET)
+		return -EINVAL;
+
+	return rtp_parse_addr(ip, port, &c->addr, &c->addr_len);
+}
+
+static inline bool rtp_is_multicast(const struct rtp_config *c)
+{
+	if (c->addr.ss_family == AF_INET)
+		return IN_MULTICAST(ntohl(((const struct sockaddr_in*)&c->addr)->sin_addr.s_addr));
+	return IN6_IS_ADDR_MULTICAST(&((const struct sockaddr_in6*)&c->addr)->sin6_addr);
+}
+
+/* open a socket to send to, or when receive is set, to receive on the
+ * address of the config */
+static inline int rtp_open_socket(const struct rtp_config *c, bool receive)
+{
+	int fd, val, res, ifindex = 0;
+	bool multicast = rtp_is_multicast(c);
+
+	if ((fd = socket(c->addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+
+	if (c->ifname[0] && (ifindex = if_nametoindex(c->ifname)) == 0) {
+		res = -errno;
+		goto error;
+	}
+
+	/* expedited forwarding, as AES67 recommends for media */
+	val = 46 << 2;
+	if (c->addr.ss_family == AF_INET)
+		setsockopt(fd, IPPROTO_IP, IP_TOS, &val, sizeof(val));
+	else
+		setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &val, sizeof(val));
+	val = 6;
+	setsockopt(fd, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val));
+
+	if (receive) {
+		val = 1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0)
+			goto error_errno;
+		if (bind(fd, (struct sockaddr*)&c->addr, c->addr_len) < 0)
+			goto error_errno;
+
+		if (multicast && c->addr.ss_family == AF_INET) {
+			struct ip_mreqn mr;
+			spa_zero(mr);
+			mr.imr_multiaddr = ((const struct sockaddr_in*)&c->addr)->sin_addr;
+			mr.imr_ifindex = ifindex;
+			if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mr, sizeof(mr)) < 0)
+				goto error_errno;
+		} else if (multicast) {
+			struct ipv6_mreq mr6;
+			spa_zero(mr6);
+			mr6.ipv6mr_multiaddr = ((const struct sockaddr_in6*)&c->addr)->sin6_addr;
+			mr6.ipv6mr_interface = ifindex;
+			if (setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mr6, sizeof(mr6)) < 0)
+				goto error_errno;
+		}
+	} else {
+		if (multicast && c->addr.ss_family == AF_INET) {
+			struct ip_mreqn mr;
+			spa_zero(mr);
+			mr.imr_ifindex = ifindex;
+			if (ifindex && setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &mr, sizeof(mr)) < 0)
+				goto error_errno;
+			val = 32;
+			setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &val, sizeof(val));
+		} else if (multicast) {
+			if (ifindex && setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+						&ifindex, sizeof(ifindex)) < 0)
+				goto error_errno;
+			val = 32;
+			setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &val, sizeof(val));
+		}
+		if (connect(fd, (struct sockaddr*)&c->addr, c->addr_len) < 0)
+			goto error_errno;
+	}
+	return fd;
+
+error_errno:
+	res = -errno;
+error:
+	close(fd);
+	return res;
+}
+
+#define CLOCKFD			3
+#define FD_TO_CLOCKID(fd)	((clockid_t) ((((unsigned int) ~(fd)) << 3) | CLOCKFD))
+
+/* the clock that the media clock follows, a PTP hardware clock or else
+ * CLOCK_TAI, which phc2sys keeps in sync with the PTP grandmaster */
+static inline int rtp_open_ptp_clock(const struct rtp_config *c, clockid_t *clock_id)
+{
+	int fd;
+
+	if (c->ptp_device[0] == '\0') {
+		*clock_id = CLOCK_TAI;
+		return -1;
+	}
+	if ((fd = open(c->ptp_device, O_RDONLY | O_CLOEXEC)) < 0)
+		return -errno;
+	*clock_id = FD_TO_CLOCKID(fd);
+	return fd;
+}
+
+/* the media clock position in frames at PTP time nsec */
+static inline uint64_t rtp_media_frames(uint64_t nsec, uint32_t rate)
+{
+	return (nsec / SPA_NSEC_PER_SEC) * rate +
+		(nsec % SPA_NSEC_PER_SEC) * rate / SPA_NSEC_PER_SEC;
+}
+
+/* samples are native in the port and big endian on the wire */
+static inline void rtp_swap_samples(const struct rtp_config *c, void *dst,
+		const void *src, uint32_t n_frames)
+{
+	uint32_t i, n_samples = n_frames * c->channels;
+
+#if __BYTE_ORDER == __BIG_ENDIAN
+	memcpy(dst, src, n_samples * c->sample_size);
+#else
+	if (c->sample_size == 2) {
+		const uint16_t *s = src;
+		uint16_t *d = dst;
+		for (i = 0; i < n_samples; i++)
+			d[i] = bswap_16(s[i]);
+	} else {
+		const uint8_t *s = src;
+		uint8_t *d = dst;
+		for (i = 0; i < n_samples; i++, s += 3, d += 3) {
+			uint8_t t = s[0];
+			d[1] = s[1];
+			d[0] = s[2];
+			d[2] = t;
+		}
+	}
+#endif
+}
+
+#endif /* SPA_RTP_H */
@@ -174,11 +174,11 @@ impl_init(const struct spa_handle_factory *factory,
 
 	if (info) {
 		if ((str = spa_dict_lookup(info, SPA_KEY_CPU_FORCE)) != NULL)
-			this->flags = atoi(str);
+			this->force = strtoul(str, NULL, 0);
 	}
 
-	spa_log_debug(this->log, NAME " %p: count:%d align:%d flags:%08x",
-			this, this->count, this->max_align, this->flags);
+	spa_log_debug(this->log, NAME " %p: count:%d align:%d flags:%08x force:%08x",
+			this, this->count, this->max_align, this->flags, this->force);
 
 	return 0;
 }
@@ -34,15 +34,19 @@
 
 #include <evl/evl.h>
 #include <evl/timer.h>
+#include <evl/flags.h>
 
 #include <spa/support/log.h>
 #include <spa/support/system.h>
 #include <spa/support/plugin.h>
 #include <spa/utils/type.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
 
 #define NAME "evl-system"
 
 #define MAX_POLL	512
+#define MAX_EVENTS	256
 
 struct poll_entry {
 	int pfd;
@@ -51,6 +55,15 @@ struct poll_entry {
 	void *data;
 };
 
+/* non-blocking eventfds are event flag groups so that they can be
+ * signaled and waited for out-of-band, between the EVL threads of the
+ * data loops. The flags only wake up, the count is kept next to them. */
+struct event_entry {
+	int fd;
+	struct evl_flags flags;
+	uint64_t count;
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_system system;
@@ -60,18 +73,49 @@ struct impl {
 	struct poll_entry entries[MAX_POLL];
 	uint32_t n_entries;
 
-	uint32_t n_xbuf;
-	int attached;
+	struct event_entry events[MAX_EVENTS];
+	uint32_t n_events;
+
 	int pid;
 };
 
+/* the EVL thread of the current thread, every thread that waits on a
+ * pollfd is attached to the EVL core once */
+static __thread int attached;
+static int n_threads;
+
+static int attach_thread(struct impl *impl)
+{
+	int res;
+
+	if (SPA_LIKELY(attached > 0))
+		return 0;
+
+	res = evl_attach_self("pw-evl-%d-%d", impl->pid,
+			__atomic_add_fetch(&n_threads, 1, __ATOMIC_RELAXED));
+	if (res == -EBUSY)
+		res = 1;
+	if (res < 0) {
+		spa_log_error(impl->log, NAME " %p: can't attach thread: %s",
+				impl, spa_strerror(res));
+		return res;
+	}
+	attached = res;
+	spa_log_debug(impl->log, NAME " %p: attached thread %d", impl, res);
+	return 0;
+}
+
 static ssize_t impl_read(void *object, int fd, void *buf, size_t count)
 {
+	if (evl_is_inband())
+		return read(fd, buf, count);
 	return oob_read(fd, buf, count);
 }
 
 static ssize_t impl_write(void *object, int fd, const void *buf, size_t count)
 {
+	if (evl_is_inband())
+		return write(fd, buf, count);
 	return oob_write(fd, buf, count);
 }
 
@@ -89,8 +133,26 @@ static int impl_ioctl(void *object, int fd, unsigned long request, ...)
 	return res;
 }
 
+static inline struct event_entry *find_event(struct impl *impl, int fd)
+{
+	uint32_t i;
+	for (i = 0; i < impl->n_events; i++) {
+		struct event_entry *e = &impl->events[i];
+		if (e->fd == fd)
+			return e;
+	}
+	return NULL;
+}
+
 static int impl_close(void *object, int fd)
 {
+	struct impl *impl = object;
+	struct event_entry *e;
+
+	if ((e = find_event(impl, fd)) != NULL) {
+		e->fd = -1;
+		return evl_close_flags(&e->flags);
+	}
 	return close(fd);
 }
 
@@ -143,10 +205,12 @@ static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void
 	struct impl *impl = object;
 	struct poll_entry *e;
 
-	if (impl->n_entries == MAX_POLL)
-		return -ENOSPC;
-
-	e = &impl->entries[impl->n_entries++];
+	/* reuse the entry of a removed fd first */
+	if ((e = find_entry(impl, -1, -1)) == NULL) {
+		if (impl->n_entries == MAX_POLL)
+			return -ENOSPC;
+		e = &impl->entries[impl->n_entries++];
+	}
 	e->pfd = pfd;
 	e->fd = fd;
 	e->events = events;
@@ -190,21 +254,25 @@ static int impl_pollfd_wait(void *object, int pfd,
 	struct timespec tv;
 	int i, j, res;
 
-	if (impl->attached == 0) {
-		res = evl_attach_self("evl-thread-%d-%p", impl->pid, impl);
-		if (res < 0)
-			return res;
-		impl->attached = res;
-	}
+	if (SPA_UNLIKELY((res = attach_thread(impl)) < 0))
+		return res;
 
 	if (timeout == -1) {
-		tv.tv_sec = 0;
-		tv.tv_nsec = 0;
+		res = evl_poll(pfd, pollset, n_ev);
 	} else {
-		tv.tv_sec = timeout / SPA_MSEC_PER_SEC;
-		tv.tv_nsec = (timeout % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+		/* the timeout of evl_timedpoll is an absolute time, a zero
+		 * timeout would block forever. */
+		evl_read_clock(EVL_CLOCK_MONOTONIC, &tv);
+		tv.tv_sec += timeout / SPA_MSEC_PER_SEC;
+		tv.tv_nsec += (timeout % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+		if (tv.tv_nsec >= SPA_NSEC_PER_SEC) {
+			tv.tv_sec++;
+			tv.tv_nsec -= SPA_NSEC_PER_SEC;
+		}
+		res = evl_timedpoll(pfd, pollset, n_ev, &tv);
+		if (res == -ETIMEDOUT)
+			return 0;
 	}
-	res = evl_timedpoll(pfd, pollset, n_ev, &tv);
 	if (SPA_UNLIKELY(res < 0))
 		return res;
 
@@ -277,31 +345,70 @@ static int impl_timerfd_read(void *object, int fd, uint64_t *expirations)
 static int impl_eventfd_create(void *object, int flags)
 {
 	struct impl *impl = object;
-	int res;
+	struct event_entry *e;
+	int fl = 0, res;
+
+	/* blocking reads and semaphores are used in-band, to wait for
+	 * a loop or a worker, use a regular eventfd for them */
+	if (!(flags & SPA_FD_NONBLOCK) || (flags & SPA_FD_EVENT_SEMAPHORE)) {
+		if (flags & SPA_FD_CLOEXEC)
+			fl |= EFD_CLOEXEC;
+		if (flags & SPA_FD_NONBLOCK)
+			fl |= EFD_NONBLOCK;
+		if (flags & SPA_FD_EVENT_SEMAPHORE)
+			fl |= EFD_SEMAPHORE;
+		res = eventfd(0, fl);
+		return res < 0 ? -errno : res;
+	}
 
-	res = evl_new_xbuf(1024, 1024, "xbuf-%d-%p-%d", impl->pid, impl, impl->n_xbuf);
-	if (res < 0)
+	if ((e = find_event(impl, -1)) == NULL) {
+		if (impl->n_events == MAX_EVENTS)
+			return -ENOSPC;
+		e = &impl->events[impl->n_events++];
+	}
+	res = evl_new_flags(&e->flags, EVL_CLOCK_MONOTONIC, 0,
+			"flags-%d-%p-%td", impl->pid, impl, e - impl->events);
+	if (res < 0) {
+		e->fd = -1;
 		return res;
-
-	impl->n_xbuf++;
-
-	if (flags & SPA_FD_NONBLOCK)
-		fcntl(res, F_SETFL, fcntl(res, F_GETFL) | O_NONBLOCK);
+	}
+	e->fd = res;
+	e->count = 0;
 
 	return res;
 }
 
+/* the count is added before posting, the next read consumes the bits and
+ * takes the count of all writes before it, like an eventfd does */
 static int impl_eventfd_write(void *object, int fd, uint64_t count)
 {
-	if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-		return -errno;
-	return 0;
+	struct impl *impl = object;
+	struct event_entry *e;
+
+	if ((e = find_event(impl, fd)) == NULL) {
+		if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+			return -errno;
+		return 0;
+	}
+	__atomic_add_fetch(&e->count, count, __ATOMIC_RELEASE);
+	return evl_post_flags(&e->flags, 1);
 }
 
 static int impl_eventfd_read(void *object, int fd, uint64_t *count)
 {
-	if (oob_read(fd, count, sizeof(uint64_t)) != sizeof(uint64_t))
-		return -errno;
+	struct impl *impl = object;
+	struct event_entry *e;
+	int res, bits;
+
+	if ((e = find_event(impl, fd)) == NULL) {
+		if (read(fd, count, sizeof(uint64_t)) != sizeof(uint64_t))
+			return -errno;
+		return 0;
+	}
+	if ((res = evl_trywait_flags(&e->flags, &bits)) < 0)
+		return res == -EWOULDBLOCK ? -EAGAIN : res;
+
+	*count = __atomic_exchange_n(&e->count, 0, __ATOMIC_ACQUIRE);
 	return 0;
 }
 
@@ -383,7 +490,18 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *impl;
+	uint32_t i;
+
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	for (i = 0; i < impl->n_events; i++) {
+		struct event_entry *e = &impl->events[i];
+		if (e->fd != -1)
+			evl_close_flags(&e->flags);
+	}
 	return 0;
 }
 
@@ -426,7 +544,8 @@ impl_init(const struct spa_handle_factory *factory,
 	}
 	impl->pid = getpid();
 
-	if ((res = evl_attach_self("evl-system-%d-%p", impl->pid, impl)) < 0) {
+	/* threads attach themselves when they first poll */
+	if ((res = evl_init()) < 0) {
 		spa_log_error(impl->log, NAME " %p: init failed: %s", impl, spa_strerror(res));
 		return res;
 	}
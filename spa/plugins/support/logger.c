@@ -41,6 +41,7 @@
 #define DEFAULT_LOG_LEVEL SPA_LOG_LEVEL_INFO
 
 #define TRACE_BUFFER (16*1024)
+#define LOCK_SPINS 64
 
 struct impl {
 	struct spa_handle handle;
@@ -52,11 +53,42 @@ struct impl {
 	struct spa_source source;
 	struct spa_ringbuffer trace_rb;
 	uint8_t trace_data[TRACE_BUFFER];
+	int write_lock;
+	uint32_t dropped;
 
 	unsigned int have_source:1;
 	unsigned int colors:1;
+	unsigned int async:1;
 };
 
+/* Queue a formatted line for the loop thread. Messages are dropped and
+ * counted when the ring is full or when another thread holds the write
+ * side for too long, the caller never blocks. */
+static bool queue_line(struct impl *impl, const char *line, int32_t size)
+{
+	uint32_t index, spins = 0;
+	int32_t filled;
+
+	while (__atomic_test_and_set(&impl->write_lock, __ATOMIC_ACQUIRE)) {
+		if (++spins == LOCK_SPINS)
+			goto dropped;
+	}
+	filled = spa_ringbuffer_get_write_index(&impl->trace_rb, &index);
+	if (filled < 0 || filled + size > TRACE_BUFFER) {
+		__atomic_clear(&impl->write_lock, __ATOMIC_RELEASE);
+		goto dropped;
+	}
+	spa_ringbuffer_write_data(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
+				  index & (TRACE_BUFFER - 1), line, size);
+	spa_ringbuffer_write_update(&impl->trace_rb, index + size);
+	__atomic_clear(&impl->write_lock, __ATOMIC_RELEASE);
+	return true;
+
+dropped:
+	__atomic_fetch_add(&impl->dropped, 1, __ATOMIC_RELAXED);
+	return false;
+}
+
 static void
 impl_log_logv(void *object,
 	      enum spa_log_level level,
@@ -73,7 +105,8 @@ impl_log_logv(void *object,
 	int size;
 	bool do_trace;
 
-	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
+	do_trace = impl->have_source && (impl->async || level == SPA_LOG_LEVEL_TRACE);
+	if (do_trace && level == SPA_LOG_LEVEL_TRACE)
 		level++;
 
 	if (impl->colors) {
@@ -91,19 +124,16 @@ impl_log_logv(void *object,
 	size = snprintf(location, sizeof(location), "%s[%s][%s:%i %s()] %s%s\n",
 		prefix, levels[level], strrchr(file, '/') + 1, line, func, text, suffix);
 
-	if (SPA_UNLIKELY(do_trace)) {
-		uint32_t index;
-
-		spa_ringbuffer_get_write_index(&impl->trace_rb, &index);
-		spa_ringbuffer_write_data(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
-					  index & (TRACE_BUFFER - 1), location, size);
-		spa_ringbuffer_write_update(&impl->trace_rb, index + size);
+	size = SPA_MIN(size, (int)sizeof(location) - 1);
 
-		if (spa_system_eventfd_write(impl->system, impl->source.fd, 1) < 0)
+	if (SPA_UNLIKELY(do_trace)) {
+		if (queue_line(impl, location, size) &&
+		    spa_system_eventfd_write(impl->system, impl->source.fd, 1) < 0)
 			fprintf(impl->file, "error signaling eventfd: %s\n", strerror(errno));
-	} else
+	} else {
 		fputs(location, impl->file);
-	fflush(impl->file);
+		fflush(impl->file);
+	}
 }
 
 
@@ -121,23 +151,15 @@ impl_log_log(void *object,
 	va_end(args);
 }
 
-static void on_trace_event(struct spa_source *source)
+static void flush_trace(struct impl *impl)
 {
-	struct impl *impl = source->data;
 	int32_t avail;
 	uint32_t index;
-	uint64_t count;
-
-	if (spa_system_eventfd_read(impl->system, source->fd, &count) < 0)
-		fprintf(impl->file, "failed to read event fd: %s", strerror(errno));
+	uint32_t dropped;
 
 	while ((avail = spa_ringbuffer_get_read_index(&impl->trace_rb, &index)) > 0) {
 		int32_t offset, first;
 
-		if (avail > TRACE_BUFFER) {
-			index += avail - TRACE_BUFFER;
-			avail = TRACE_BUFFER;
-		}
 		offset = index & (TRACE_BUFFER - 1);
 		first = SPA_MIN(avail, TRACE_BUFFER - offset);
 
@@ -148,6 +170,21 @@ static void on_trace_event(struct spa_source *source)
 		spa_ringbuffer_read_update(&impl->trace_rb, index + avail);
 		fflush(impl->file);
         }
+	if ((dropped = __atomic_exchange_n(&impl->dropped, 0, __ATOMIC_RELAXED)) > 0) {
+		fprintf(impl->file, "[W][logger] %u messages dropped\n", dropped);
+		fflush(impl->file);
+	}
+}
+
+static void on_trace_event(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	uint64_t count;
+
+	if (spa_system_eventfd_read(impl->system, source->fd, &count) < 0)
+		fprintf(impl->file, "failed to read event fd: %s", strerror(errno));
+
+	flush_trace(impl);
 }
 
 static const struct spa_log_methods impl_log = {
@@ -183,6 +220,7 @@ static int impl_clear(struct spa_handle *handle)
 
 	if (this->have_source) {
 		spa_loop_remove_source(this->source.loop, &this->source);
+		flush_trace(this);
 		close(this->source.fd);
 		this->have_source = false;
 	}
@@ -252,6 +290,8 @@ impl_init(const struct spa_handle_factory *factory,
 			this->colors = (strcmp(str, "true") == 0 || atoi(str) == 1);
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_LEVEL)) != NULL)
 			this->log.level = atoi(str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_ASYNC)) != NULL)
+			this->async = (strcmp(str, "true") == 0 || atoi(str) == 1);
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_FILE)) != NULL) {
 			this->file = fopen(str, "w");
 			if (this->file == NULL)
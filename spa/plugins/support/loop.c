@@ -28,6 +28,8 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sched.h>
 #include <pthread.h>
 
 #include <spa/support/loop.h>
@@ -38,23 +40,43 @@
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type.h>
-#include <spa/utils/ringbuffer.h>
 
 #define NAME "loop"
 
 #define DATAS_SIZE (4096 * 8)
+#define MAX_ACKS 32
+
+/* payloads up to INLINE_SIZE are copied into the queue, larger ones are
+ * passed by reference for blocking invokes or copied into a slab */
+#define INLINE_SIZE	128
+#define MAX_SLABS	32
+#define SLAB_SIZE	2048
+
+/* timer wheel, 6 levels of 64 slots with ticks of 65.5us cover 52 days */
+#define WHEEL_BITS		6
+#define WHEEL_SIZE		(1 << WHEEL_BITS)
+#define WHEEL_MASK		(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS		6
+#define WHEEL_TICK_SHIFT	16
 
 /** \cond */
 
+/* completion of a blocking invoke, each waiting thread has its own */
+struct invoke_ack {
+	int fd;
+	int res;
+};
+
 struct invoke_item {
-	size_t item_size;
+	uint32_t committed;		/* set when the item can be run */
+	uint32_t item_size;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	void *data;
 	size_t size;
-	bool block;
+	uint32_t slab;			/* 1 + index of the slab with the data or 0 */
+	struct invoke_ack *ack;		/* completion for blocking invokes */
 	void *user_data;
-	int res;
 };
 
 static int loop_signal_event(void *object, struct spa_source *source);
@@ -74,12 +96,38 @@ struct impl {
 
 	int poll_fd;
 	pthread_t thread;
+	uint64_t busy_poll;		/* nsec to poll before blocking */
 
 	struct spa_source *wakeup;
-	int ack_fd;
 
-	struct spa_ringbuffer buffer;
+	/* invoke queue: any number of threads reserve space by moving
+	 * write_index and commit their item when it is filled in. Only the
+	 * loop thread runs the items, in order, and moves read_index. */
+	uint32_t write_index;
+	uint32_t read_index;
 	uint8_t buffer_data[DATAS_SIZE];
+	uint32_t wakeup_pending;	/* the wakeup was signaled and not handled */
+
+	uint32_t acks_busy;		/* bitmask of acks in use */
+	struct invoke_ack acks[MAX_ACKS];
+
+	uint32_t slabs_busy;		/* bitmask of slabs in use */
+	uint8_t slab_data[MAX_SLABS][SLAB_SIZE];
+
+	/* All timers of the loop are kept in a hierarchical timer wheel and
+	 * share one timerfd that is armed for the first one to expire. A
+	 * timer is on the level of the highest group of WHEEL_BITS in which
+	 * its tick differs from the current tick, in the slot given by its
+	 * tick in that group. Walking the levels up and the slots of a level
+	 * in order visits the timers in the order they expire. */
+	struct {
+		struct spa_source source;
+		uint64_t tick;				/* current tick */
+		uint64_t armed;				/* expiry the fd is armed for */
+		uint64_t occupied[WHEEL_LEVELS];	/* bitmask of non-empty slots */
+		struct spa_list slots[WHEEL_LEVELS][WHEEL_SIZE];
+		struct spa_list overflow;		/* too far in the future */
+	} wheel;
 };
 
 struct source_impl {
@@ -97,7 +145,23 @@ struct source_impl {
 		spa_source_signal_func_t signal;
 	} func;
 	bool enabled;
+
+	struct {
+		struct spa_list link;		/* link in a wheel slot */
+		uint64_t expire;		/* absolute expiry in nsec, 0 when disarmed */
+		uint64_t interval;
+		uint64_t expirations;		/* for the callback */
+		uint32_t level;
+		uint32_t slot;
+		bool queued;
+	} timer;
 };
+
+/* the loop that the current thread is batching invokes for */
+static __thread struct {
+	struct impl *impl;
+	uint32_t depth;
+} batch;
 /** \endcond */
 
 static int loop_add_source(void *object, struct spa_source *source)
@@ -120,32 +184,126 @@ static int loop_remove_source(void *object, struct spa_source *source)
 	return spa_system_pollfd_del(impl->system, impl->poll_fd, source->fd);
 }
 
-static void flush_items(struct impl *impl, bool async)
+static void *get_slab(struct impl *impl, uint32_t *index)
+{
+	uint32_t busy, idx;
+
+	busy = __atomic_load_n(&impl->slabs_busy, __ATOMIC_RELAXED);
+	do {
+		if (busy == ~0u)
+			return NULL;
+		idx = __builtin_ctz(~busy);
+	} while (!__atomic_compare_exchange_n(&impl->slabs_busy, &busy, busy | (1u << idx),
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	*index = idx;
+	return impl->slab_data[idx];
+}
+
+static void release_slab(struct impl *impl, uint32_t index)
 {
-	uint32_t index;
+	__atomic_fetch_and(&impl->slabs_busy, ~(1u << index), __ATOMIC_RELEASE);
+}
+
+static void flush_items(struct impl *impl)
+{
+	uint32_t index, offset, l0, item_size;
 	int res;
 
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	/* new items from now on need a new wakeup. The fence orders this with
+	 * the loads of the committed flags below. */
+	__atomic_store_n(&impl->wakeup_pending, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	index = impl->read_index;
+
+	while (true) {
 		struct invoke_item *item;
-		bool block;
+		struct invoke_ack *ack;
+
+		offset = index & (DATAS_SIZE - 1);
+		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
+
+		/* stop at the first item that is still being filled in, its
+		 * producer signals the wakeup again when it is done */
+		if (index == __atomic_load_n(&impl->write_index, __ATOMIC_ACQUIRE) ||
+		    !__atomic_load_n(&item->committed, __ATOMIC_ACQUIRE))
+			break;
 
-		item = SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
-		block = item->block;
+		ack = item->ack;
 
-		item->res = item->func ? item->func(&impl->loop,
+		res = item->func ? item->func(&impl->loop,
 				true, item->seq, item->data, item->size,
 			   item->user_data) : 0;
 
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		if (item->slab > 0)
+			release_slab(impl, item->slab - 1);
 
-		if (block && async) {
-			if ((res = spa_system_eventfd_write(impl->system, impl->ack_fd, 1)) < 0)
+		/* clear the space so that no stale committed flag is found
+		 * when a later item header ends up at this place */
+		item_size = item->item_size;
+		l0 = SPA_MIN(item_size, DATAS_SIZE - offset);
+		memset(item, 0, l0);
+		memset(impl->buffer_data, 0, item_size - l0);
+		index += item_size;
+
+		__atomic_store_n(&impl->read_index, index, __ATOMIC_RELEASE);
+
+		if (ack != NULL) {
+			ack->res = res;
+			if ((res = spa_system_eventfd_write(impl->system, ack->fd, 1)) < 0)
 				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
 						impl, spa_strerror(res));
 		}
 	}
 }
 
+/* signal the wakeup only when it is not pending yet, so that a burst of
+ * invokes wakes up the loop once */
+static void wakeup_loop(struct impl *impl)
+{
+	if (__atomic_exchange_n(&impl->wakeup_pending, 1, __ATOMIC_SEQ_CST) == 0)
+		loop_signal_event(impl, impl->wakeup);
+}
+
+static struct invoke_ack *get_ack(struct impl *impl)
+{
+	struct invoke_ack *ack;
+	uint32_t busy, idx;
+	int res;
+
+	busy = __atomic_load_n(&impl->acks_busy, __ATOMIC_RELAXED);
+	do {
+		while (busy == ~0u) {
+			/* more than MAX_ACKS threads are blocked on this loop */
+			sched_yield();
+			busy = __atomic_load_n(&impl->acks_busy, __ATOMIC_RELAXED);
+		}
+		idx = __builtin_ctz(~busy);
+	} while (!__atomic_compare_exchange_n(&impl->acks_busy, &busy, busy | (1u << idx),
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	ack = &impl->acks[idx];
+	if (ack->fd == -1) {
+		if ((res = spa_system_eventfd_create(impl->system,
+				SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
+			spa_log_error(impl->log, NAME " %p: can't create ack event: %s",
+					impl, spa_strerror(res));
+			__atomic_fetch_and(&impl->acks_busy, ~(1u << idx), __ATOMIC_RELEASE);
+			errno = -res;
+			return NULL;
+		}
+		ack->fd = res;
+	}
+	return ack;
+}
+
+static void release_ack(struct impl *impl, struct invoke_ack *ack)
+{
+	uint32_t idx = ack - impl->acks;
+	__atomic_fetch_and(&impl->acks_busy, ~(1u << idx), __ATOMIC_RELEASE);
+}
+
 static int
 loop_invoke(void *object,
 	    spa_invoke_func_t func,
@@ -158,65 +316,102 @@ loop_invoke(void *object,
 	struct impl *impl = object;
 	bool in_thread = pthread_equal(impl->thread, pthread_self());
 	struct invoke_item *item;
+	struct invoke_ack *ack = NULL;
+	uint32_t slab = 0;
 	int res;
 
 	if (in_thread) {
-		flush_items(impl, false);
+		flush_items(impl);
 		res = func ? func(&impl->loop, false, seq, data, size, user_data) : 0;
 	} else {
-		int32_t filled;
-		uint32_t avail, idx, offset, l0;
-
-		filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-		if (filled < 0 || filled > DATAS_SIZE) {
-			spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
-			return -EPIPE;
+		uint32_t idx, filled, offset, l0, item_size;
+		void *item_data, *ref = NULL;
+		size_t copy = size;
+
+		if (block && (ack = get_ack(impl)) == NULL)
+			return -errno;
+
+		if (size > INLINE_SIZE) {
+			/* a blocking caller waits until the item ran, its data
+			 * can be used in place */
+			if (block)
+				ref = (void*)data;
+			else if (size <= SLAB_SIZE &&
+			    (ref = get_slab(impl, &slab)) != NULL) {
+				memcpy(ref, data, size);
+				slab++;
+			}
+			if (ref != NULL)
+				copy = 0;
 		}
-		avail = DATAS_SIZE - filled;
-		if (avail < sizeof(struct invoke_item)) {
-			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
-			return -EPIPE;
-		}
-		offset = idx & (DATAS_SIZE - 1);
 
-		l0 = DATAS_SIZE - offset;
+		idx = __atomic_load_n(&impl->write_index, __ATOMIC_RELAXED);
+		do {
+			filled = idx - __atomic_load_n(&impl->read_index, __ATOMIC_ACQUIRE);
+			if (filled > DATAS_SIZE) {
+				spa_log_warn(impl->log, NAME " %p: queue xrun %u", impl, filled);
+				if (slab > 0)
+					release_slab(impl, slab - 1);
+				res = -EPIPE;
+				goto done;
+			}
+			offset = idx & (DATAS_SIZE - 1);
+			l0 = DATAS_SIZE - offset;
+
+			if (l0 > sizeof(struct invoke_item) + copy) {
+				item_data = SPA_MEMBER(impl->buffer_data,
+						offset + sizeof(struct invoke_item), void);
+				item_size = sizeof(struct invoke_item) + copy;
+				if (l0 < sizeof(struct invoke_item) + item_size)
+					item_size = l0;
+			} else {
+				item_data = impl->buffer_data;
+				item_size = l0 + copy;
+			}
+			if (item_size > DATAS_SIZE - filled) {
+				spa_log_warn(impl->log, NAME " %p: queue full %u", impl,
+						DATAS_SIZE - filled);
+				/* make sure a batch in progress gets drained */
+				wakeup_loop(impl);
+				if (slab > 0)
+					release_slab(impl, slab - 1);
+				res = -EPIPE;
+				goto done;
+			}
+		} while (!__atomic_compare_exchange_n(&impl->write_index, &idx, idx + item_size,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
 
 		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
+		item->item_size = item_size;
 		item->func = func;
 		item->seq = seq;
+		item->data = ref ? ref : item_data;
 		item->size = size;
-		item->block = block;
+		item->slab = slab;
+		item->ack = ack;
 		item->user_data = user_data;
+		if (copy > 0)
+			memcpy(item->data, data, copy);
 
-		spa_log_trace(impl->log, NAME " %p: add item %p filled:%d", impl, item, filled);
+		spa_log_trace(impl->log, NAME " %p: add item %p filled:%u", impl, item, filled);
 
-		if (l0 > sizeof(struct invoke_item) + size) {
-			item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-			item->item_size = sizeof(struct invoke_item) + size;
-			if (l0 < sizeof(struct invoke_item) + item->item_size)
-				item->item_size = l0;
-		} else {
-			item->data = impl->buffer_data;
-			item->item_size = l0 + size;
-		}
-		memcpy(item->data, data, size);
+		__atomic_store_n(&item->committed, 1, __ATOMIC_RELEASE);
 
-		spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
-
-		loop_signal_event(impl, impl->wakeup);
+		if (block || batch.impl != impl)
+			wakeup_loop(impl);
 
 		if (block) {
 			uint64_t count = 1;
 
 			spa_loop_control_hook_before(&impl->hooks_list);
 
-			if ((res = spa_system_eventfd_read(impl->system, impl->ack_fd, &count)) < 0)
+			if ((res = spa_system_eventfd_read(impl->system, ack->fd, &count)) < 0)
 				spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
 						impl, spa_strerror(res));
 
 			spa_loop_control_hook_after(&impl->hooks_list);
 
-			res = item->res;
+			res = ack->res;
 		}
 		else {
 			if (seq != SPA_ID_INVALID)
@@ -225,13 +420,44 @@ loop_invoke(void *object,
 				res = 0;
 		}
 	}
+done:
+	if (ack)
+		release_ack(impl, ack);
 	return res;
 }
 
+static int loop_begin_batch(void *object)
+{
+	struct impl *impl = object;
+
+	if (batch.impl != NULL && batch.impl != impl)
+		return -EBUSY;
+
+	batch.impl = impl;
+	batch.depth++;
+	return 0;
+}
+
+static int loop_commit_batch(void *object)
+{
+	struct impl *impl = object;
+
+	if (batch.impl != impl)
+		return -EINVAL;
+
+	if (--batch.depth == 0) {
+		batch.impl = NULL;
+		if (__atomic_load_n(&impl->write_index, __ATOMIC_ACQUIRE) !=
+		    __atomic_load_n(&impl->read_index, __ATOMIC_ACQUIRE))
+			wakeup_loop(impl);
+	}
+	return 0;
+}
+
 static void wakeup_func(void *data, uint64_t count)
 {
 	struct impl *impl = data;
-	flush_items(impl, true);
+	flush_items(impl);
 }
 
 static int loop_get_fd(void *object)
@@ -272,6 +498,35 @@ static inline void process_destroy(struct impl *impl)
 	spa_list_init(&impl->destroy_list);
 }
 
+static inline uint64_t get_time_ns(struct impl *impl)
+{
+	struct timespec now;
+	spa_system_clock_gettime(impl->system, CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_NSEC(&now);
+}
+
+/* poll the fds without blocking until one becomes ready or the busy-poll
+ * time is over. This avoids the latency of being woken up when events
+ * come in quickly after each other. */
+static int busy_poll(struct impl *impl, struct spa_poll_event *ep, int n_ep)
+{
+	uint64_t end = 0, now;
+	int nfds;
+
+	while (true) {
+		nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, n_ep, 0);
+		if (nfds != 0)
+			break;
+
+		now = get_time_ns(impl);
+		if (end == 0)
+			end = now + impl->busy_poll;
+		else if (now >= end)
+			break;
+	}
+	return nfds;
+}
+
 static int loop_iterate(void *object, int timeout)
 {
 	struct impl *impl = object;
@@ -281,7 +536,13 @@ static int loop_iterate(void *object, int timeout)
 
 	spa_loop_control_hook_before(&impl->hooks_list);
 
-	nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, SPA_N_ELEMENTS(ep), timeout);
+	if (impl->busy_poll && timeout != 0)
+		nfds = busy_poll(impl, ep, SPA_N_ELEMENTS(ep));
+	else
+		nfds = 0;
+
+	if (nfds == 0)
+		nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, SPA_N_ELEMENTS(ep), timeout);
 
 	spa_loop_control_hook_after(&impl->hooks_list);
 
@@ -484,18 +745,230 @@ static int loop_signal_event(void *object, struct spa_source *source)
 	return res;
 }
 
-static void source_timer_func(struct spa_source *source)
+static void wheel_place(struct impl *impl, struct source_impl *s)
 {
-	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
-	uint64_t expirations;
+	uint64_t tick, diff;
+	uint32_t level, slot;
+
+	tick = SPA_MAX(s->timer.expire >> WHEEL_TICK_SHIFT, impl->wheel.tick);
+	diff = tick ^ impl->wheel.tick;
+	level = diff ? (63 - __builtin_clzll(diff)) / WHEEL_BITS : 0;
+
+	if (level < WHEEL_LEVELS) {
+		slot = (tick >> (level * WHEEL_BITS)) & WHEEL_MASK;
+		spa_list_append(&impl->wheel.slots[level][slot], &s->timer.link);
+		impl->wheel.occupied[level] |= 1ull << slot;
+	} else {
+		slot = 0;
+		spa_list_append(&impl->wheel.overflow, &s->timer.link);
+	}
+	s->timer.level = level;
+	s->timer.slot = slot;
+	s->timer.queued = true;
+}
+
+static void wheel_unlink(struct impl *impl, struct source_impl *s)
+{
+	uint32_t level = s->timer.level, slot = s->timer.slot;
+
+	if (!s->timer.queued)
+		return;
+
+	spa_list_remove(&s->timer.link);
+	s->timer.queued = false;
+
+	if (level < WHEEL_LEVELS && spa_list_is_empty(&impl->wheel.slots[level][slot]))
+		impl->wheel.occupied[level] &= ~(1ull << slot);
+}
+
+static void wheel_collect(struct impl *impl, struct spa_list *list, struct spa_list *to)
+{
+	struct source_impl *s;
+
+	spa_list_consume(s, list, timer.link) {
+		spa_list_remove(&s->timer.link);
+		spa_list_append(to, &s->timer.link);
+		s->timer.level = WHEEL_LEVELS;
+	}
+}
+
+static inline uint64_t slot_range(uint32_t first, uint32_t last)
+{
+	uint64_t mask;
+
+	if (first > last)
+		return 0;
+	mask = last == WHEEL_MASK ? ~0ull : (1ull << (last + 1)) - 1;
+	return mask & ~((1ull << first) - 1);
+}
+
+/* move the current tick to @tick and take out all the timers that need
+ * to be placed again. Those are the timers of the slots that were passed
+ * and of the slots that now share the higher groups with the tick. */
+static void wheel_advance(struct impl *impl, uint64_t tick, struct spa_list *to)
+{
+	uint64_t old = impl->wheel.tick, mask;
+	uint32_t level, shift, oi, ni, slot;
+
+	if (tick < old)
+		tick = old;
+	impl->wheel.tick = tick;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		shift = level * WHEEL_BITS;
+		oi = (old >> shift) & WHEEL_MASK;
+		ni = (tick >> shift) & WHEEL_MASK;
+
+		if ((old >> (shift + WHEEL_BITS)) == (tick >> (shift + WHEEL_BITS)))
+			mask = slot_range(level == 0 ? oi : oi + 1, ni);
+		else
+			mask = ~0ull;
+
+		mask &= impl->wheel.occupied[level];
+		impl->wheel.occupied[level] &= ~mask;
+
+		while (mask) {
+			slot = __builtin_ctzll(mask);
+			wheel_collect(impl, &impl->wheel.slots[level][slot], to);
+			mask &= mask - 1;
+		}
+	}
+	shift = (WHEEL_LEVELS - 1) * WHEEL_BITS;
+	if ((old >> shift) != (tick >> shift))
+		wheel_collect(impl, &impl->wheel.overflow, to);
+}
+
+static uint64_t wheel_next_expire(struct impl *impl)
+{
+	struct spa_list *list = &impl->wheel.overflow;
+	struct source_impl *s;
+	uint64_t expire = UINT64_MAX;
+	uint32_t level;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		if (impl->wheel.occupied[level]) {
+			list = &impl->wheel.slots[level][__builtin_ctzll(impl->wheel.occupied[level])];
+			break;
+		}
+	}
+	spa_list_for_each(s, list, timer.link)
+		expire = SPA_MIN(expire, s->timer.expire);
+
+	return expire == UINT64_MAX ? 0 : expire;
+}
+
+/* arm the timerfd for the first timer to expire */
+static int wheel_arm(struct impl *impl)
+{
+	struct itimerspec its;
+	uint64_t expire;
 	int res;
 
-	if ((res = spa_system_timerfd_read(impl->impl->system,
+	expire = wheel_next_expire(impl);
+	if (expire == impl->wheel.armed)
+		return 0;
+
+	spa_zero(its);
+	its.it_value.tv_sec = expire / SPA_NSEC_PER_SEC;
+	its.it_value.tv_nsec = expire % SPA_NSEC_PER_SEC;
+
+	if ((res = spa_system_timerfd_settime(impl->system, impl->wheel.source.fd,
+			SPA_FD_TIMER_ABSTIME, &its, NULL)) < 0)
+		return res;
+
+	impl->wheel.armed = expire;
+	return 0;
+}
+
+static void wheel_source_func(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	struct spa_list moved, expired;
+	struct source_impl *s;
+	uint64_t now, expirations;
+	int res;
+
+	if ((res = spa_system_timerfd_read(impl->system,
 				source->fd, &expirations)) < 0)
-		spa_log_warn(impl->impl->log, NAME " %p: failed to read timer fd %d: %s",
-				source, source->fd, spa_strerror(res));
+		spa_log_warn(impl->log, NAME " %p: failed to read timer fd %d: %s",
+				impl, source->fd, spa_strerror(res));
+
+	impl->wheel.armed = 0;
+
+	now = get_time_ns(impl);
+
+	spa_list_init(&moved);
+	spa_list_init(&expired);
+
+	wheel_advance(impl, now >> WHEEL_TICK_SHIFT, &moved);
+
+	spa_list_consume(s, &moved, timer.link) {
+		spa_list_remove(&s->timer.link);
+		s->timer.queued = false;
+
+		if (s->timer.expire <= now) {
+			/* level WHEEL_LEVELS leaves the bitmasks alone when
+			 * the timer is unlinked from here */
+			spa_list_append(&expired, &s->timer.link);
+			s->timer.queued = true;
+		} else {
+			wheel_place(impl, s);
+		}
+	}
+
+	/* the callbacks can update or destroy any timer, take them out one
+	 * by one */
+	spa_list_consume(s, &expired, timer.link) {
+		spa_list_remove(&s->timer.link);
+		s->timer.queued = false;
+
+		if (s->timer.interval) {
+			expirations = 1 + (now - s->timer.expire) / s->timer.interval;
+			s->timer.expire += expirations * s->timer.interval;
+			wheel_place(impl, s);
+		} else {
+			expirations = 1;
+			s->timer.expire = 0;
+		}
+		s->timer.expirations = expirations;
+		s->source.func(&s->source);
+	}
+
+	if ((res = wheel_arm(impl)) < 0)
+		spa_log_warn(impl->log, NAME " %p: failed to arm timer fd %d: %s",
+				impl, source->fd, spa_strerror(res));
+}
+
+static int wheel_init(struct impl *impl)
+{
+	int res;
+
+	if (impl->wheel.source.fd != -1)
+		return 0;
+
+	if ((res = spa_system_timerfd_create(impl->system, CLOCK_MONOTONIC,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
+		return res;
+
+	impl->wheel.source.func = wheel_source_func;
+	impl->wheel.source.data = impl;
+	impl->wheel.source.fd = res;
+	impl->wheel.source.mask = SPA_IO_IN;
+	impl->wheel.tick = get_time_ns(impl) >> WHEEL_TICK_SHIFT;
+	impl->wheel.armed = 0;
+
+	if ((res = loop_add_source(impl, &impl->wheel.source)) < 0) {
+		spa_system_close(impl->system, impl->wheel.source.fd);
+		impl->wheel.source.fd = -1;
+		return res;
+	}
+	return 0;
+}
 
-	impl->func.timer(source->data, expirations);
+static void source_timer_func(struct spa_source *source)
+{
+	struct source_impl *impl = SPA_CONTAINER_OF(source, struct source_impl, source);
+	impl->func.timer(source->data, impl->timer.expirations);
 }
 
 static struct spa_source *loop_add_timer(void *object,
@@ -505,36 +978,27 @@ static struct spa_source *loop_add_timer(void *object,
 	struct source_impl *source;
 	int res;
 
-	source = calloc(1, sizeof(struct source_impl));
-	if (source == NULL)
+	if ((res = wheel_init(impl)) < 0)
 		goto error_exit;
 
-	if ((res = spa_system_timerfd_create(impl->system, CLOCK_MONOTONIC,
-			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
-		goto error_exit_free;
+	source = calloc(1, sizeof(struct source_impl));
+	if (source == NULL)
+		return NULL;
 
+	/* timers are not polled, the wheel dispatches them */
 	source->source.loop = &impl->loop;
 	source->source.func = source_timer_func;
 	source->source.data = data;
-	source->source.fd = res;
-	source->source.mask = SPA_IO_IN;
+	source->source.fd = -1;
 	source->impl = impl;
-	source->close = true;
 	source->func.timer = func;
 
-	if ((res = loop_add_source(impl, &source->source)) < 0)
-		goto error_exit_close;
-
 	spa_list_insert(&impl->source_list, &source->link);
 
 	return &source->source;
 
-error_exit_close:
-	spa_system_close(impl->system, source->source.fd);
-error_exit_free:
-	free(source);
-	errno = -res;
 error_exit:
+	errno = -res;
 	return NULL;
 }
 
@@ -543,25 +1007,28 @@ loop_update_timer(void *object, struct spa_source *source,
 		  struct timespec *value, struct timespec *interval, bool absolute)
 {
 	struct impl *impl = object;
-	struct itimerspec its;
-	int flags = 0, res;
+	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
+	uint64_t expire = 0;
 
-	spa_zero(its);
 	if (value) {
-		its.it_value = *value;
+		expire = SPA_TIMESPEC_TO_NSEC(value);
 	} else if (interval) {
-		its.it_value = *interval;
+		expire = SPA_TIMESPEC_TO_NSEC(interval);
 		absolute = true;
 	}
-	if (interval)
-		its.it_interval = *interval;
-	if (absolute)
-		flags |= SPA_FD_TIMER_ABSTIME;
+	/* like a timerfd, a zero value disarms the timer */
+	if (expire != 0 && !absolute)
+		expire += get_time_ns(impl);
 
-	if ((res = spa_system_timerfd_settime(impl->system, source->fd, flags, &its, NULL)) < 0)
-		return res;
+	wheel_unlink(impl, s);
 
-	return 0;
+	s->timer.expire = expire;
+	s->timer.interval = interval ? SPA_TIMESPEC_TO_NSEC(interval) : 0;
+
+	if (expire != 0)
+		wheel_place(impl, s);
+
+	return wheel_arm(impl);
 }
 
 static void source_signal_func(struct spa_source *source)
@@ -623,7 +1090,9 @@ static void loop_destroy_source(void *object, struct spa_source *source)
 
 	spa_list_remove(&impl->link);
 
-	if (source->loop)
+	if (source->func == source_timer_func)
+		wheel_unlink(impl->impl, impl);
+	else if (source->loop)
 		loop_remove_source(impl->impl, source);
 
 	if (source->fd != -1 && impl->close) {
@@ -639,6 +1108,8 @@ static const struct spa_loop_methods impl_loop = {
 	.update_source = loop_update_source,
 	.remove_source = loop_remove_source,
 	.invoke = loop_invoke,
+	.begin_batch = loop_begin_batch,
+	.commit_batch = loop_commit_batch,
 };
 
 static const struct spa_loop_control_methods impl_loop_control = {
@@ -693,6 +1164,7 @@ static int impl_clear(struct spa_handle *handle)
 {
 	struct impl *impl;
 	struct source_impl *source;
+	uint32_t i;
 
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
@@ -703,7 +1175,14 @@ static int impl_clear(struct spa_handle *handle)
 
 	process_destroy(impl);
 
-	spa_system_close(impl->system, impl->ack_fd);
+	for (i = 0; i < MAX_ACKS; i++) {
+		if (impl->acks[i].fd != -1)
+			spa_system_close(impl->system, impl->acks[i].fd);
+	}
+	if (impl->wheel.source.fd != -1) {
+		loop_remove_source(impl, &impl->wheel.source);
+		spa_system_close(impl->system, impl->wheel.source.fd);
+	}
 	spa_system_close(impl->system, impl->poll_fd);
 
 	return 0;
@@ -724,6 +1203,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *impl;
+	const char *str;
 	uint32_t i;
 	int res;
 
@@ -774,7 +1254,24 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	spa_ringbuffer_init(&impl->buffer);
+	impl->write_index = impl->read_index = 0;
+	memset(impl->buffer_data, 0, sizeof(impl->buffer_data));
+	impl->wakeup_pending = 0;
+	impl->acks_busy = 0;
+	for (i = 0; i < MAX_ACKS; i++)
+		impl->acks[i].fd = -1;
+
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_LOOP_BUSY_POLL)) != NULL)
+		impl->busy_poll = strtoull(str, NULL, 10) * SPA_NSEC_PER_USEC;
+
+	impl->wheel.source.fd = -1;
+	for (i = 0; i < WHEEL_LEVELS; i++) {
+		uint32_t j;
+		impl->wheel.occupied[i] = 0;
+		for (j = 0; j < WHEEL_SIZE; j++)
+			spa_list_init(&impl->wheel.slots[i][j]);
+	}
+	spa_list_init(&impl->wheel.overflow);
 
 	impl->wakeup = loop_add_event(impl, wakeup_func, impl);
 	if (impl->wakeup == NULL) {
@@ -782,20 +1279,11 @@ impl_init(const struct spa_handle_factory *factory,
 		spa_log_error(impl->log, NAME " %p: can't create wakeup event: %m", impl);
 		goto error_exit_free_poll;
 	}
-	if ((res = spa_system_eventfd_create(impl->system,
-			SPA_FD_EVENT_SEMAPHORE | SPA_FD_CLOEXEC)) < 0) {
-		spa_log_error(impl->log, NAME " %p: can't create ack event: %s",
-				impl, spa_strerror(res));
-		goto error_exit_free_wakeup;
-	}
-	impl->ack_fd = res;
 
 	spa_log_debug(impl->log, NAME " %p: initialized", impl);
 
 	return 0;
 
-error_exit_free_wakeup:
-	loop_destroy_source(impl, impl->wakeup);
 error_exit_free_poll:
 	spa_system_close(impl->system, impl->poll_fd);
 error_exit:
@@ -31,6 +31,7 @@ extern const struct spa_handle_factory spa_support_logger_factory;
 extern const struct spa_handle_factory spa_support_system_factory;
 extern const struct spa_handle_factory spa_support_cpu_factory;
 extern const struct spa_handle_factory spa_support_loop_factory;
+extern const struct spa_handle_factory spa_support_node_driver_factory;
 
 SPA_EXPORT
 int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
@@ -51,6 +52,9 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 	case 3:
 		*factory = &spa_support_loop_factory;
 		break;
+	case 4:
+		*factory = &spa_support_node_driver_factory;
+		break;
 	default:
 		return 0;
 	}
@@ -0,0 +1,612 @@
+/* Spa
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include <linux/io_uring.h>
+
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/type.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+
+#define NAME "uring-system"
+
+#define RING_ENTRIES	64
+
+/* A spa_system on top of epoll, eventfd and timerfd, like the default
+ * one, that uses io_uring to batch the eventfd writes made by the thread
+ * that polls. Those writes are queued on the submission ring and are all
+ * submitted with one io_uring_enter() before the thread goes back to
+ * sleep in pollfd_wait(). This is what the data thread does when it
+ * triggers the peers of a node, so one cycle costs one syscall for all
+ * the wakeups instead of one per peer.
+ *
+ * Writes from other threads and all other operations go straight to the
+ * kernel. When the kernel has no io_uring support, everything does. */
+struct ring {
+	int fd;
+
+	void *sq_ptr;
+	size_t sq_size;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t sq_mask;
+	uint32_t *sq_array;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	void *cq_ptr;
+	size_t cq_size;
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t cq_mask;
+	struct io_uring_cqe *cqes;
+
+	uint32_t tail;			/* local submission tail */
+	uint32_t n_queued;		/* entries that are not submitted yet */
+	uint64_t values[RING_ENTRIES];	/* eventfd values of the queued writes */
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_system system;
+
+        struct spa_log *log;
+
+	struct ring ring;
+	pthread_t owner;		/* the thread that polls and may queue */
+	bool have_owner;
+};
+
+static int ring_init(struct ring *r)
+{
+	struct io_uring_params p;
+	uint32_t i;
+	int res;
+
+	spa_zero(p);
+	r->fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+	if (r->fd < 0)
+		return -errno;
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_size = r->cq_size = SPA_MAX(r->sq_size, r->cq_size);
+
+	r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto error_close;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ptr = r->sq_ptr;
+	} else {
+		r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto error_unmap_sq;
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto error_unmap_cq;
+
+	r->sq_head = SPA_MEMBER(r->sq_ptr, p.sq_off.head, uint32_t);
+	r->sq_tail = SPA_MEMBER(r->sq_ptr, p.sq_off.tail, uint32_t);
+	r->sq_mask = *SPA_MEMBER(r->sq_ptr, p.sq_off.ring_mask, uint32_t);
+	r->sq_array = SPA_MEMBER(r->sq_ptr, p.sq_off.array, uint32_t);
+	r->cq_head = SPA_MEMBER(r->cq_ptr, p.cq_off.head, uint32_t);
+	r->cq_tail = SPA_MEMBER(r->cq_ptr, p.cq_off.tail, uint32_t);
+	r->cq_mask = *SPA_MEMBER(r->cq_ptr, p.cq_off.ring_mask, uint32_t);
+	r->cqes = SPA_MEMBER(r->cq_ptr, p.cq_off.cqes, struct io_uring_cqe);
+
+	/* the slots are used in order, map them once */
+	for (i = 0; i < p.sq_entries; i++)
+		r->sq_array[i] = i;
+
+	r->tail = *r->sq_tail;
+	r->n_queued = 0;
+	return 0;
+
+error_unmap_cq:
+	res = -errno;
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	goto error_unmap;
+error_unmap_sq:
+	res = -errno;
+error_unmap:
+	munmap(r->sq_ptr, r->sq_size);
+	goto error;
+error_close:
+	res = -errno;
+error:
+	close(r->fd);
+	r->fd = -1;
+	return res;
+}
+
+static void ring_clear(struct ring *r)
+{
+	if (r->fd < 0)
+		return;
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	munmap(r->sq_ptr, r->sq_size);
+	close(r->fd);
+	r->fd = -1;
+}
+
+/* submit the queued entries and wait until they have all completed so
+ * that their slots and values can be used again */
+static int ring_flush(struct impl *impl)
+{
+	struct ring *r = &impl->ring;
+	uint32_t head, n = r->n_queued;
+	int res;
+
+	if (n == 0)
+		return 0;
+
+	__atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+	r->n_queued = 0;
+
+	do {
+		res = syscall(__NR_io_uring_enter, r->fd, n, n, IORING_ENTER_GETEVENTS, NULL, 0);
+	} while (res < 0 && errno == EINTR);
+	if (res < 0) {
+		res = -errno;
+		spa_log_warn(impl->log, NAME " %p: submit failed: %s", impl, spa_strerror(res));
+		return res;
+	}
+
+	head = *r->cq_head;
+	while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+		int fd = cqe->user_data >> 32;
+		uint32_t idx = cqe->user_data & r->sq_mask;
+
+		if (cqe->res < 0) {
+			/* kernels without IORING_OP_WRITE fail here, do it now */
+			spa_log_debug(impl->log, NAME " %p: queued write to %d failed: %s",
+					impl, fd, spa_strerror(cqe->res));
+			if (write(fd, &r->values[idx], sizeof(uint64_t)) != sizeof(uint64_t))
+				spa_log_warn(impl->log, NAME " %p: write to %d failed: %m",
+						impl, fd);
+		}
+		head++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static inline bool can_queue(struct impl *impl)
+{
+	return impl->ring.fd >= 0 && impl->have_owner &&
+		pthread_equal(impl->owner, pthread_self());
+}
+
+static int ring_queue_write(struct impl *impl, int fd, uint64_t count)
+{
+	struct ring *r = &impl->ring;
+	struct io_uring_sqe *sqe;
+	uint32_t idx;
+	int res;
+
+	if (r->n_queued == RING_ENTRIES &&
+	    (res = ring_flush(impl)) < 0)
+		return res;
+
+	idx = r->tail & r->sq_mask;
+	r->values[idx] = count;
+
+	sqe = &r->sqes[idx];
+	spa_zero(*sqe);
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t) &r->values[idx];
+	sqe->len = sizeof(uint64_t);
+	sqe->user_data = ((uint64_t) fd << 32) | idx;
+
+	r->tail++;
+	r->n_queued++;
+	return 0;
+}
+
+static ssize_t impl_read(void *object, int fd, void *buf, size_t count)
+{
+	ssize_t res = read(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static ssize_t impl_write(void *object, int fd, const void *buf, size_t count)
+{
+	ssize_t res = write(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_ioctl(void *object, int fd, unsigned long request, ...)
+{
+	int res;
+	va_list ap;
+	long arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, long);
+	res = ioctl(fd, request, arg);
+	va_end(ap);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_close(void *object, int fd)
+{
+	struct impl *impl = object;
+	int res;
+
+	/* don't let a queued write go to a reused fd */
+	if (impl->ring.n_queued > 0 && can_queue(impl))
+		ring_flush(impl);
+
+	res = close(fd);
+	return res < 0 ? -errno : res;
+}
+
+/* clock */
+static int impl_clock_gettime(void *object,
+			int clockid, struct timespec *value)
+{
+	int res = clock_gettime(clockid, value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_clock_getres(void *object,
+			int clockid, struct timespec *res)
+{
+	int r = clock_getres(clockid, res);
+	return r < 0 ? -errno : r;
+}
+
+/* poll */
+static int impl_pollfd_create(void *object, int flags)
+{
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= EPOLL_CLOEXEC;
+	res = epoll_create1(fl);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct epoll_event ep;
+	int res;
+
+	spa_zero(ep);
+	ep.events = events;
+	ep.data.ptr = data;
+
+	res = epoll_ctl(pfd, EPOLL_CTL_ADD, fd, &ep);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_pollfd_mod(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct epoll_event ep;
+	int res;
+
+	spa_zero(ep);
+	ep.events = events;
+	ep.data.ptr = data;
+
+	res = epoll_ctl(pfd, EPOLL_CTL_MOD, fd, &ep);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_pollfd_del(void *object, int pfd, int fd)
+{
+	int res = epoll_ctl(pfd, EPOLL_CTL_DEL, fd, NULL);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_pollfd_wait(void *object, int pfd,
+		struct spa_poll_event *ev, int n_ev, int timeout)
+{
+	struct impl *impl = object;
+	struct epoll_event ep[n_ev];
+	int i, nfds;
+
+	impl->owner = pthread_self();
+	impl->have_owner = true;
+
+	if (impl->ring.n_queued > 0)
+		ring_flush(impl);
+
+	if (SPA_UNLIKELY((nfds = epoll_wait(pfd, ep, n_ev, timeout)) < 0))
+		return -errno;
+
+        for (i = 0; i < nfds; i++) {
+                ev[i].events = ep[i].events;
+                ev[i].data = ep[i].data.ptr;
+        }
+	return nfds;
+}
+
+/* timers */
+static int impl_timerfd_create(void *object, int clockid, int flags)
+{
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= TFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= TFD_NONBLOCK;
+	res = timerfd_create(clockid, fl);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_settime(void *object,
+			int fd, int flags,
+			const struct itimerspec *new_value,
+			struct itimerspec *old_value)
+{
+	int fl = 0, res;
+	if (flags & SPA_FD_TIMER_ABSTIME)
+		fl |= TFD_TIMER_ABSTIME;
+	if (flags & SPA_FD_TIMER_CANCEL_ON_SET)
+		fl |= TFD_TIMER_CANCEL_ON_SET;
+	res = timerfd_settime(fd, fl, new_value, old_value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_gettime(void *object,
+			int fd, struct itimerspec *curr_value)
+{
+	int res = timerfd_gettime(fd, curr_value);
+	return res < 0 ? -errno : res;
+
+}
+static int impl_timerfd_read(void *object, int fd, uint64_t *expirations)
+{
+	if (read(fd, expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* events */
+static int impl_eventfd_create(void *object, int flags)
+{
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= EFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= EFD_NONBLOCK;
+	if (flags & SPA_FD_EVENT_SEMAPHORE)
+		fl |= EFD_SEMAPHORE;
+	res = eventfd(0, fl);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_eventfd_write(void *object, int fd, uint64_t count)
+{
+	struct impl *impl = object;
+
+	if (can_queue(impl))
+		return ring_queue_write(impl, fd, count);
+
+	if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+static int impl_eventfd_read(void *object, int fd, uint64_t *count)
+{
+	if (read(fd, count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* signals */
+static int impl_signalfd_create(void *object, int signal, int flags)
+{
+	sigset_t mask;
+	int res, fl = 0;
+
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= SFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= SFD_NONBLOCK;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, signal);
+	res = signalfd(-1, &mask, fl);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_signalfd_read(void *object, int fd, int *signal)
+{
+	struct signalfd_siginfo signal_info;
+	int len;
+
+	len = read(fd, &signal_info, sizeof signal_info);
+	if (!(len == -1 && errno == EAGAIN) && len != sizeof signal_info)
+		return -errno;
+
+	*signal = signal_info.ssi_signo;
+
+	return 0;
+}
+
+static const struct spa_system_methods impl_system = {
+	SPA_VERSION_SYSTEM_METHODS,
+	.read = impl_read,
+	.write = impl_write,
+	.ioctl = impl_ioctl,
+	.close = impl_close,
+	.clock_gettime = impl_clock_gettime,
+	.clock_getres = impl_clock_getres,
+	.pollfd_create = impl_pollfd_create,
+	.pollfd_add = impl_pollfd_add,
+	.pollfd_mod = impl_pollfd_mod,
+	.pollfd_del = impl_pollfd_del,
+	.pollfd_wait = impl_pollfd_wait,
+	.timerfd_create = impl_timerfd_create,
+	.timerfd_settime = impl_timerfd_settime,
+	.timerfd_gettime = impl_timerfd_gettime,
+	.timerfd_read = impl_timerfd_read,
+	.eventfd_create = impl_eventfd_create,
+	.eventfd_write = impl_eventfd_write,
+	.eventfd_read = impl_eventfd_read,
+	.signalfd_create = impl_signalfd_create,
+	.signalfd_read = impl_signalfd_read,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	switch (type) {
+	case SPA_TYPE_INTERFACE_System:
+		*interface = &impl->system;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+	ring_flush(impl);
+	ring_clear(&impl->ring);
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *impl;
+	uint32_t i;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	impl = (struct impl *) handle;
+	impl->system.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_System,
+			SPA_VERSION_SYSTEM,
+			&impl_system, impl);
+
+	for (i = 0; i < n_support; i++) {
+		switch (support[i].type) {
+		case SPA_TYPE_INTERFACE_Log:
+			impl->log = support[i].data;
+			break;
+		}
+	}
+
+	if ((res = ring_init(&impl->ring)) < 0)
+		spa_log_warn(impl->log, NAME " %p: no io_uring, not batching writes: %s",
+				impl, spa_strerror(res));
+
+	spa_log_debug(impl->log, NAME " %p: initialized", impl);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_System,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	if (*index >= SPA_N_ELEMENTS(impl_interfaces))
+		return 0;
+
+	*info = &impl_interfaces[(*index)++];
+	return 1;
+}
+
+const struct spa_handle_factory spa_support_uring_system_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_SUPPORT_SYSTEM,
+	NULL,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info
+};
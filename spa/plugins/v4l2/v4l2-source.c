@@ -74,6 +74,7 @@ struct buffer {
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
 	struct v4l2_buffer v4l2_buffer;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	void *ptr;
 };
 
@@ -96,6 +97,13 @@ struct port {
 	struct v4l2_frmsizeenum frmsize;
 	struct v4l2_frmivalenum frmival;
 
+	/* the unfiltered EnumFormat results, built once to avoid probing
+	 * the device again on every enumeration */
+	void *format_cache;
+	uint32_t format_cache_size;
+	uint32_t format_cache_next;
+	bool format_cache_complete;
+
 	bool have_format;
 	struct spa_video_info current_format;
 	struct spa_fraction rate;
@@ -256,6 +264,7 @@ static int impl_node_set_param(void *object,
 		spa_pod_parse_object(param,
 			SPA_TYPE_OBJECT_Props, NULL,
 			SPA_PROP_device, SPA_POD_OPT_Stringn(p->device, sizeof(p->device)));
+		clear_format_cache(&this->out_ports[0]);
 		break;
 	}
 	default:
@@ -499,19 +508,32 @@ static int impl_node_port_enum_params(void *object, int seq,
 			return res;
 		break;
 	case SPA_PARAM_Buffers:
+	{
+		uint32_t types = (1 << SPA_DATA_MemPtr) | (1 << SPA_DATA_MemFd);
+		uint32_t i, n_planes, size = 0;
+
 		if (!port->have_format)
 			return -EIO;
 		if (result.index > 0)
 			return 0;
 
+		n_planes = port_n_planes(port);
+		for (i = 0; i < n_planes; i++)
+			size = SPA_MAX(size, port_plane_size(port, i));
+
+		if (spa_v4l2_can_import_dmabuf(this))
+			types |= (1 << SPA_DATA_DmaBuf);
+
 		param = spa_pod_builder_add_object(&b,
 			SPA_TYPE_OBJECT_ParamBuffers, id,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(MAX_BUFFERS, 2, MAX_BUFFERS),
-			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
-			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->fmt.fmt.pix.sizeimage),
-			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->fmt.fmt.pix.bytesperline),
-			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(n_planes),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port_plane_stride(port, 0)),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16),
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(types));
 		break;
+	}
 
 	case SPA_PARAM_Meta:
 		switch (result.index) {
@@ -904,6 +926,14 @@ static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **i
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	clear_format_cache(&this->out_ports[0]);
+
 	return 0;
 }
 
@@ -95,12 +95,62 @@ error:
 	return -err;
 }
 
-int spa_v4l2_is_capture(struct spa_v4l2_device *dev)
+static uint32_t spa_v4l2_device_caps(struct spa_v4l2_device *dev)
 {
 	uint32_t caps = dev->cap.capabilities;
 	if ((caps & V4L2_CAP_DEVICE_CAPS))
 		caps = dev->cap.device_caps;
-	return (caps & V4L2_CAP_VIDEO_CAPTURE) == V4L2_CAP_VIDEO_CAPTURE;
+	return caps;
+}
+
+int spa_v4l2_is_capture(struct spa_v4l2_device *dev)
+{
+	uint32_t caps = spa_v4l2_device_caps(dev);
+	return (caps & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE)) != 0;
+}
+
+/* the single-planar API is used when the driver has both */
+static enum v4l2_buf_type spa_v4l2_capture_type(struct spa_v4l2_device *dev)
+{
+	if (spa_v4l2_device_caps(dev) & V4L2_CAP_VIDEO_CAPTURE)
+		return V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	return V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+static uint32_t port_n_planes(struct port *port)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return SPA_MAX(port->fmt.fmt.pix_mp.num_planes, 1u);
+	return 1;
+}
+
+static uint32_t port_plane_stride(struct port *port, uint32_t plane)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].bytesperline;
+	return port->fmt.fmt.pix.bytesperline;
+}
+
+static uint32_t port_plane_size(struct port *port, uint32_t plane)
+{
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type))
+		return port->fmt.fmt.pix_mp.plane_fmt[plane].sizeimage;
+	return port->fmt.fmt.pix.sizeimage;
+}
+
+/* with the multi-planar API, the planes of a buffer are described in a
+ * separate array that the v4l2_buffer points to */
+static void buffer_init(struct port *port, struct buffer *b, uint32_t index)
+{
+	spa_zero(b->v4l2_buffer);
+	b->v4l2_buffer.type = port->type;
+	b->v4l2_buffer.memory = port->memtype;
+	b->v4l2_buffer.index = index;
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		spa_zero(b->planes);
+		b->v4l2_buffer.m.planes = b->planes;
+		b->v4l2_buffer.length = port_n_planes(port);
+	}
 }
 
 int spa_v4l2_close(struct spa_v4l2_device *dev)
@@ -146,11 +196,13 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	uint32_t i;
+	uint32_t i, j, n_planes;
 
 	if (port->n_buffers == 0)
 		return 0;
 
+	n_planes = port_n_planes(port);
+
 	for (i = 0; i < port->n_buffers; i++) {
 		struct buffer *b;
 		struct spa_data *d;
@@ -171,10 +223,21 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 			close(d[0].fd);
 		}
 		d[0].type = SPA_ID_INVALID;
+
+		/* the other planes only come from mmap_init */
+		for (j = 1; j < n_planes && j < b->outbuf->n_datas; j++) {
+			if (d[j].type == SPA_DATA_MemPtr &&
+			    SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_MAPPED))
+				munmap(d[j].data, d[j].maxsize);
+			else if (d[j].type == SPA_DATA_DmaBuf &&
+			    SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_ALLOCATED))
+				close(d[j].fd);
+			d[j].type = SPA_ID_INVALID;
+		}
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -518,6 +581,54 @@ filter_framerate(struct v4l2_frmivalenum *frmival,
 
 #define FOURCC_ARGS(f) (f)&0x7f,((f)>>8)&0x7f,((f)>>16)&0x7f,((f)>>24)&0x7f
 
+static void clear_format_cache(struct port *port)
+{
+	free(port->format_cache);
+	port->format_cache = NULL;
+	port->format_cache_size = 0;
+	port->format_cache_next = 0;
+	port->format_cache_complete = false;
+}
+
+static int cache_format(struct port *port, const struct spa_pod *param)
+{
+	uint32_t size = SPA_ROUND_UP_N(SPA_POD_SIZE(param), 8);
+	void *data;
+
+	if ((data = realloc(port->format_cache, port->format_cache_size + size)) == NULL) {
+		clear_format_cache(port);
+		return -ENOMEM;
+	}
+	memcpy(SPA_MEMBER(data, port->format_cache_size, void), param, SPA_POD_SIZE(param));
+	port->format_cache = data;
+	port->format_cache_size += size;
+	return 0;
+}
+
+static int enum_cached_format(struct impl *this, struct port *port, int seq,
+		uint32_t start, uint32_t num)
+{
+	struct spa_result_node_params result;
+	uint32_t offset = 0, index = 0, count = 0;
+
+	result.id = SPA_PARAM_EnumFormat;
+
+	while (offset < port->format_cache_size && count < num) {
+		struct spa_pod *param = SPA_MEMBER(port->format_cache, offset, struct spa_pod);
+
+		offset += SPA_ROUND_UP_N(SPA_POD_SIZE(param), 8);
+		if (index++ < start)
+			continue;
+
+		result.index = index - 1;
+		result.next = index;
+		result.param = param;
+		spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+		count++;
+	}
+	return 0;
+}
+
 static int
 spa_v4l2_enum_format(struct impl *this, int seq,
 		     uint32_t start, uint32_t num,
@@ -534,17 +645,29 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	struct spa_pod_frame f[2];
 	struct spa_result_node_params result;
 	uint32_t count = 0;
+	bool caching;
+
+	if (filter == NULL && port->format_cache_complete)
+		return enum_cached_format(this, port, seq, start, num);
+
+	/* fill the cache while the formats are enumerated from the start,
+	 * without filter and without skipping results */
+	if (filter == NULL && start == 0)
+		clear_format_cache(port);
+	caching = filter == NULL && start == port->format_cache_next;
 
 	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
 		return res;
 
+	port->type = spa_v4l2_capture_type(dev);
+
 	result.id = SPA_PARAM_EnumFormat;
 	result.next = start;
 
 	if (result.next == 0) {
 		spa_zero(port->fmtdesc);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -814,18 +937,46 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	spa_pod_builder_pop(&b, &f[1]);
 	result.param = spa_pod_builder_pop(&b, &f[0]);
 
+	if (caching && cache_format(port, result.param) < 0)
+		caching = false;
+
 	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
 
 	if (++count != num)
 		goto next;
 
+	if (caching)
+		port->format_cache_next = result.next;
+	res = 0;
+	goto exit;
+
       enum_end:
+	if (caching)
+		port->format_cache_complete = true;
 	res = 0;
       exit:
 	spa_v4l2_close(dev);
 	return res;
 }
 
+/* check if the device can import dmabufs, only valid while there are no buffers */
+static bool spa_v4l2_can_import_dmabuf(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	struct spa_v4l2_device *dev = &port->dev;
+	struct v4l2_requestbuffers reqbuf;
+
+	if (port->n_buffers > 0)
+		return port->memtype == V4L2_MEMORY_DMABUF;
+
+	spa_zero(reqbuf);
+	reqbuf.type = port->type;
+	reqbuf.memory = V4L2_MEMORY_DMABUF;
+	reqbuf.count = 0;
+
+	return xioctl(dev->fd, VIDIOC_REQBUFS, &reqbuf) == 0;
+}
+
 static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format, bool try_only)
 {
 	struct port *port = &this->out_ports[0];
@@ -840,8 +991,6 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 
 	spa_zero(fmt);
 	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
 	switch (format->media_subtype) {
 	case SPA_MEDIA_SUBTYPE_raw:
@@ -873,11 +1022,26 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		return -EINVAL;
 	}
 
+	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
+		return res;
 
-	fmt.fmt.pix.pixelformat = info->fourcc;
-	fmt.fmt.pix.field = V4L2_FIELD_ANY;
-	fmt.fmt.pix.width = size->width;
-	fmt.fmt.pix.height = size->height;
+	port->type = spa_v4l2_capture_type(dev);
+	fmt.type = port->type;
+	streamparm.type = port->type;
+
+	/* width, height and pixelformat are at the same place in pix and
+	 * pix_mp so the checks below can use pix for both */
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		fmt.fmt.pix_mp.pixelformat = info->fourcc;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix_mp.width = size->width;
+		fmt.fmt.pix_mp.height = size->height;
+	} else {
+		fmt.fmt.pix.pixelformat = info->fourcc;
+		fmt.fmt.pix.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix.width = size->width;
+		fmt.fmt.pix.height = size->height;
+	}
 	streamparm.parm.capture.timeperframe.numerator = framerate->denom;
 	streamparm.parm.capture.timeperframe.denominator = framerate->num;
 
@@ -888,9 +1052,6 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 
 	reqfmt = fmt;
 
-	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
-		return res;
-
 	cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(dev->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -902,10 +1063,11 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if (xioctl(dev->fd, VIDIOC_S_PARM, &streamparm) < 0)
 		spa_log_warn(this->log, "VIDIOC_S_PARM: %m");
 
-	spa_log_info(this->log, "v4l2: got %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
+	spa_log_info(this->log, "v4l2: got %08x %dx%d %d/%d planes:%u", fmt.fmt.pix.pixelformat,
 		     fmt.fmt.pix.width, fmt.fmt.pix.height,
 		     streamparm.parm.capture.timeperframe.denominator,
-		     streamparm.parm.capture.timeperframe.numerator);
+		     streamparm.parm.capture.timeperframe.numerator,
+		     V4L2_TYPE_IS_MULTIPLANAR(port->type) ? fmt.fmt.pix_mp.num_planes : 1);
 
 	if (reqfmt.fmt.pix.pixelformat != fmt.fmt.pix.pixelformat ||
 	    reqfmt.fmt.pix.width != fmt.fmt.pix.width ||
@@ -1167,13 +1329,22 @@ static int mmap_read(struct impl *this)
 	struct spa_v4l2_device *dev = &port->dev;
 	struct spa_io_buffers *io;
 	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	struct buffer *b;
 	struct spa_data *d;
+	uint32_t i, n_planes;
 	int64_t pts;
 
+	n_planes = port_n_planes(port);
+
 	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.type = port->type;
 	buf.memory = port->memtype;
+	if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+		spa_zero(planes);
+		buf.m.planes = planes;
+		buf.length = n_planes;
+	}
 
 	if (xioctl(dev->fd, VIDIOC_DQBUF, &buf) < 0)
 		return -errno;
@@ -1201,12 +1372,19 @@ static int mmap_read(struct impl *this)
 	}
 
 	d = b->outbuf->datas;
-	d[0].chunk->offset = 0;
-	d[0].chunk->size = buf.bytesused;
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
-	d[0].chunk->flags = 0;
-	if (buf.flags & V4L2_BUF_FLAG_ERROR)
-		d[0].flags |= SPA_CHUNK_FLAG_CORRUPTED;
+	for (i = 0; i < n_planes; i++) {
+		if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+			d[i].chunk->offset = planes[i].data_offset;
+			d[i].chunk->size = planes[i].bytesused - planes[i].data_offset;
+		} else {
+			d[i].chunk->offset = 0;
+			d[i].chunk->size = buf.bytesused;
+		}
+		d[i].chunk->stride = port_plane_stride(port, i);
+		d[i].chunk->flags = 0;
+		if (buf.flags & V4L2_BUF_FLAG_ERROR)
+			d[i].flags |= SPA_CHUNK_FLAG_CORRUPTED;
+	}
 
 	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUTSTANDING);
 
@@ -1268,8 +1446,13 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 		}
 	}
 
+	if (port->memtype == V4L2_MEMORY_USERPTR && port_n_planes(port) > 1) {
+		spa_log_error(this->log, "v4l2: can't use memory for multi-planar formats");
+		return -ENOTSUP;
+	}
+
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1294,16 +1477,13 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 		spa_log_info(this->log, "v4l2: import buffer %p", buffers[i]);
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < port_n_planes(port)) {
 			spa_log_error(this->log, "v4l2: invalid memory on buffer %p", buffers[i]);
 			return -EINVAL;
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init(port, b, i);
 
 		if (port->memtype == V4L2_MEMORY_USERPTR) {
 			if (d[0].data == NULL) {
@@ -1327,7 +1507,15 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 			b->v4l2_buffer.length = d[0].maxsize;
 		}
 		else if (port->memtype == V4L2_MEMORY_DMABUF) {
-			b->v4l2_buffer.m.fd = d[0].fd;
+			if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+				uint32_t j;
+				for (j = 0; j < b->v4l2_buffer.length; j++) {
+					b->planes[j].m.fd = d[j].fd;
+					b->planes[j].length = d[j].maxsize;
+				}
+			} else {
+				b->v4l2_buffer.m.fd = d[0].fd;
+			}
 		}
 		else
 			return -EIO;
@@ -1346,12 +1534,15 @@ mmap_init(struct impl *this,
 	struct port *port = &this->out_ports[0];
 	struct spa_v4l2_device *dev = &port->dev;
 	struct v4l2_requestbuffers reqbuf;
-	unsigned int i;
+	unsigned int i, j, n_planes;
+	bool use_expbuf = port->export_buf;
+	int res;
 
 	port->memtype = V4L2_MEMORY_MMAP;
+	n_planes = port_n_planes(port);
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1367,16 +1558,14 @@ mmap_init(struct impl *this,
 		spa_log_error(this->log, "v4l2: can't allocate enough buffers");
 		return -ENOMEM;
 	}
-	if (port->export_buf)
-		spa_log_info(this->log, "v4l2: using EXPBUF");
-
 	for (i = 0; i < reqbuf.count; i++) {
 		struct buffer *b;
 		struct spa_data *d;
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < n_planes) {
 			spa_log_error(this->log, "v4l2: invalid buffer data");
-			return -EINVAL;
+			res = -EINVAL;
+			goto error;
 		}
 
 		b = &port->buffers[i];
@@ -1385,63 +1574,100 @@ mmap_init(struct impl *this,
 		b->flags = BUFFER_FLAG_OUTSTANDING;
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		buffer_init(port, b, i);
 
 		if (xioctl(dev->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			spa_log_error(this->log, "VIDIOC_QUERYBUF: %m");
-			return -errno;
+			res = -errno;
+			goto error;
 		}
 
 		d = buffers[i]->datas;
-		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
-		d[0].chunk->offset = 0;
-		d[0].chunk->size = 0;
-		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
-		d[0].chunk->flags = 0;
-
-		if (port->export_buf) {
-			struct v4l2_exportbuffer expbuf;
-
-			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			expbuf.index = i;
-			expbuf.flags = O_CLOEXEC | O_RDONLY;
-			if (xioctl(dev->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-				spa_log_error(this->log, "VIDIOC_EXPBUF: %m");
-				continue;
+		for (j = 0; j < n_planes; j++) {
+			uint32_t length, offset;
+
+			if (V4L2_TYPE_IS_MULTIPLANAR(port->type)) {
+				length = b->planes[j].length;
+				offset = b->planes[j].m.mem_offset;
+			} else {
+				length = b->v4l2_buffer.length;
+				offset = b->v4l2_buffer.m.offset;
 			}
-			d[0].type = SPA_DATA_DmaBuf;
-			d[0].flags = SPA_DATA_FLAG_READABLE;
-			d[0].fd = expbuf.fd;
-			d[0].data = NULL;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
-			spa_log_debug(this->log, "v4l2: EXPBUF fd:%d", expbuf.fd);
-		} else {
-			d[0].type = SPA_DATA_MemPtr;
-			d[0].flags = SPA_DATA_FLAG_READABLE;
-			d[0].fd = -1;
-			d[0].data = mmap(NULL,
-					 b->v4l2_buffer.length,
-					 PROT_READ, MAP_SHARED,
-					 dev->fd,
-					 b->v4l2_buffer.m.offset);
-			if (d[0].data == MAP_FAILED) {
-				spa_log_error(this->log, "mmap: %m");
-				continue;
+
+			d[j].mapoffset = 0;
+			d[j].maxsize = length;
+			d[j].chunk->offset = 0;
+			d[j].chunk->size = 0;
+			d[j].chunk->stride = port_plane_stride(port, j);
+			d[j].chunk->flags = 0;
+
+			if (use_expbuf) {
+				struct v4l2_exportbuffer expbuf;
+
+				spa_zero(expbuf);
+				expbuf.type = port->type;
+				expbuf.index = i;
+				expbuf.plane = j;
+				expbuf.flags = O_CLOEXEC | O_RDONLY;
+				if (xioctl(dev->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+					/* the driver can't export, map all buffers instead */
+					if (i == 0 && j == 0 && (errno == ENOTTY || errno == EINVAL)) {
+						spa_log_info(this->log, "v4l2: no EXPBUF, using mmap");
+						use_expbuf = false;
+					} else {
+						spa_log_error(this->log, "VIDIOC_EXPBUF: %m");
+						res = -errno;
+						goto error;
+					}
+				} else {
+					if (i == 0 && j == 0)
+						spa_log_info(this->log, "v4l2: using EXPBUF");
+					d[j].type = SPA_DATA_DmaBuf;
+					d[j].flags = SPA_DATA_FLAG_READABLE;
+					d[j].fd = expbuf.fd;
+					d[j].data = NULL;
+					SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
+					spa_log_debug(this->log, "v4l2: EXPBUF fd:%d plane:%u", expbuf.fd, j);
+				}
+			}
+			if (!use_expbuf) {
+				d[j].type = SPA_DATA_MemPtr;
+				d[j].flags = SPA_DATA_FLAG_READABLE;
+				d[j].fd = -1;
+				d[j].data = mmap(NULL,
+						 length,
+						 PROT_READ, MAP_SHARED,
+						 dev->fd,
+						 offset);
+				if (d[j].data == MAP_FAILED) {
+					spa_log_error(this->log, "mmap: %m");
+					res = -errno;
+					goto error;
+				}
+				if (j == 0)
+					b->ptr = d[j].data;
+				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+				spa_log_debug(this->log, "v4l2: mmap ptr:%p plane:%u", d[j].data, j);
 			}
-			b->ptr = d[0].data;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
-			spa_log_debug(this->log, "v4l2: mmap ptr:%p", d[0].data);
 		}
 		spa_v4l2_buffer_recycle(this, i);
 	}
 	port->n_buffers = reqbuf.count;
 
 	return 0;
+
+error:
+	/* release the buffers that were set up, a half usable set is worse
+	 * than failing the allocation */
+	port->n_buffers = i;
+	if (i > 0) {
+		spa_v4l2_clear_buffers(this);
+	} else {
+		reqbuf.count = 0;
+		if (xioctl(dev->fd, VIDIOC_REQBUFS, &reqbuf) < 0)
+			spa_log_warn(this->log, "VIDIOC_REQBUFS: %m");
+	}
+	return res;
 }
 
 static int userptr_init(struct impl *this)
@@ -1496,7 +1722,7 @@ static int spa_v4l2_stream_on(struct impl *this)
 
 	spa_log_debug(this->log, "starting");
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMON: %m");
 		return -errno;
@@ -1544,7 +1770,7 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, port);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(dev->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMOFF: %m");
 		return -errno;
@@ -0,0 +1,193 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <spa/support/cpu.h>
+#include <spa/param/video/raw.h>
+
+#include "video-ops.c"
+
+#define WIDTH	77
+#define HEIGHT	9
+#define STRIDE	(WIDTH * 4 + 32)
+
+#define MAX_WIDTH	160
+#define MAX_HEIGHT	20
+
+static uint8_t frame_in[MAX_WIDTH * 4 * MAX_HEIGHT];
+static uint8_t frame_out[MAX_WIDTH * 4 * MAX_HEIGHT];
+static uint8_t frame_ref[MAX_WIDTH * 4 * MAX_HEIGHT];
+
+static void setup_planes(const struct format_desc *desc, uint8_t *data,
+		uint32_t stride, uint32_t height, void *planes[], uint32_t strides[])
+{
+	uint32_t i;
+
+	for (i = 0; i < desc->n_planes; i++) {
+		strides[i] = convert_plane_stride(desc, i, stride);
+		planes[i] = data;
+		data += strides[i] * ((height + (1 << desc->vsub[i]) - 1) >> desc->vsub[i]);
+	}
+}
+
+static void test_black_white(void)
+{
+	const uint8_t in[] = { 16, 128, 235, 128 };
+	const uint8_t rgbx[] = { 0, 0, 0, 255, 255, 255, 255, 255 };
+	const void *s[1] = { in };
+	void *d[1] = { frame_out };
+	uint32_t stride = 8;
+	struct convert conv = { 0 };
+
+	fprintf(stderr, "test black_white:\n");
+	conv_yuy2_to_rgbx_c(&conv, d, &stride, s, &stride, 2, 1);
+	spa_assert(memcmp(frame_out, rgbx, sizeof(rgbx)) == 0);
+
+	d[0] = frame_ref;
+	s[0] = frame_out;
+	conv_rgbx_to_yuy2_c(&conv, d, &stride, s, &stride, 2, 1);
+	spa_assert(memcmp(frame_ref, in, sizeof(in)) == 0);
+}
+
+static void run_test(const char *name, uint32_t src_fmt, uint32_t dst_fmt,
+		convert_func_t func, convert_func_t ref)
+{
+	const struct format_desc *src_desc = convert_find_format(src_fmt);
+	const struct format_desc *dst_desc = convert_find_format(dst_fmt);
+	struct convert conv = { 0 };
+	void *s[MAX_PLANES], *d[MAX_PLANES], *r[MAX_PLANES];
+	uint32_t s_stride[MAX_PLANES], d_stride[MAX_PLANES];
+	uint32_t i;
+
+	fprintf(stderr, "test %s:\n", name);
+
+	for (i = 0; i < sizeof(frame_in); i++)
+		frame_in[i] = random();
+	memset(frame_out, 0, sizeof(frame_out));
+	memset(frame_ref, 0, sizeof(frame_ref));
+
+	conv.src_desc = src_desc;
+	conv.dst_desc = dst_desc;
+
+	setup_planes(src_desc, frame_in, STRIDE, HEIGHT, s, s_stride);
+	setup_planes(dst_desc, frame_out, STRIDE, HEIGHT, d, d_stride);
+	setup_planes(dst_desc, frame_ref, STRIDE, HEIGHT, r, d_stride);
+
+	func(&conv, d, d_stride, (const void **)s, s_stride, WIDTH, HEIGHT);
+	ref(&conv, r, d_stride, (const void **)s, s_stride, WIDTH, HEIGHT);
+
+	spa_assert(memcmp(frame_out, frame_ref, sizeof(frame_out)) == 0);
+}
+
+static void test_simd(void)
+{
+#if defined(HAVE_SSE2)
+	run_test("yuy2_to_rgbx_sse2", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx,
+			conv_yuy2_to_rgbx_sse2, conv_yuy2_to_rgbx_c);
+	run_test("uyvy_to_bgrx_sse2", SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_BGRx,
+			conv_uyvy_to_bgrx_sse2, conv_uyvy_to_bgrx_c);
+	run_test("nv12_to_rgbx_sse2", SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_RGBx,
+			conv_nv12_to_rgbx_sse2, conv_nv12_to_rgbx_c);
+	run_test("i420_to_bgrx_sse2", SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_BGRx,
+			conv_i420_to_bgrx_sse2, conv_i420_to_bgrx_c);
+#endif
+#if defined(HAVE_AVX2)
+	run_test("yuy2_to_bgrx_avx2", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_BGRx,
+			conv_yuy2_to_bgrx_avx2, conv_yuy2_to_bgrx_c);
+	run_test("uyvy_to_rgbx_avx2", SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_RGBx,
+			conv_uyvy_to_rgbx_avx2, conv_uyvy_to_rgbx_c);
+	run_test("nv12_to_bgrx_avx2", SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx,
+			conv_nv12_to_bgrx_avx2, conv_nv12_to_bgrx_c);
+	run_test("i420_to_rgbx_avx2", SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_RGBx,
+			conv_i420_to_rgbx_avx2, conv_i420_to_rgbx_c);
+#endif
+}
+
+/* a flat color survives conversion between YUV formats and scaling */
+static void test_convert(uint32_t src_fmt, uint32_t dst_fmt, uint32_t dst_width, uint32_t dst_height)
+{
+	struct convert conv = { 0 };
+	const uint8_t pair[] = { 81, 90, 81, 240 };	/* red */
+	void *s[MAX_PLANES], *d[MAX_PLANES];
+	uint32_t s_stride[MAX_PLANES], d_stride[MAX_PLANES];
+	uint32_t x, y;
+
+	fprintf(stderr, "test convert %u->%u %ux%u:\n", src_fmt, dst_fmt, dst_width, dst_height);
+
+	conv.src_fmt = src_fmt;
+	conv.dst_fmt = dst_fmt;
+	conv.src_width = WIDTH;
+	conv.src_height = HEIGHT;
+	conv.dst_width = dst_width;
+	conv.dst_height = dst_height;
+	conv.cpu_flags = SPA_CPU_FLAG_SSE2;
+	spa_assert(convert_init(&conv) == 0);
+
+	setup_planes(conv.src_desc, frame_in, STRIDE, HEIGHT, s, s_stride);
+	setup_planes(conv.dst_desc, frame_out, (dst_width + 1) / 2 * conv.dst_desc->bytes[0],
+			dst_height, d, d_stride);
+
+	for (y = 0; y < HEIGHT; y++)
+		for (x = 0; x < s_stride[0]; x++)
+			((uint8_t*)s[0])[y * s_stride[0] + x] = pair[x & 3];
+
+	convert_process(&conv, d, d_stride, (const void **)s, s_stride);
+
+	for (y = 0; y < dst_height; y++) {
+		const uint8_t *row = SPA_MEMBER(d[0], y * d_stride[0], uint8_t);
+		for (x = 0; x < dst_width; x++) {
+			const uint8_t *p;
+			switch (dst_fmt) {
+			case SPA_VIDEO_FORMAT_I420:
+			case SPA_VIDEO_FORMAT_NV12:
+				spa_assert(abs(row[x] - 81) <= 1);
+				break;
+			case SPA_VIDEO_FORMAT_RGBx:
+				p = &row[x * 4];
+				spa_assert(p[0] == 255 && p[1] == 0 && p[2] == 0);
+				break;
+			}
+		}
+	}
+	if (dst_fmt == SPA_VIDEO_FORMAT_I420) {
+		const uint8_t *u = d[1], *v = d[2];
+		spa_assert(u[0] == 90 && v[0] == 240);
+	}
+	convert_free(&conv);
+}
+
+int main(int argc, char *argv[])
+{
+	test_black_white();
+	test_simd();
+	test_convert(SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx, WIDTH, HEIGHT);
+	test_convert(SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_I420, WIDTH, HEIGHT);
+	test_convert(SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_NV12, WIDTH, HEIGHT);
+	test_convert(SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx, 40, 5);
+	test_convert(SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_I420, 150, 20);
+	return 0;
+}
@@ -0,0 +1,184 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "video-ops.h"
+
+#include <immintrin.h>
+
+#define ROW(p,stride,y)	SPA_MEMBER(p, (size_t)(stride) * (y), uint8_t)
+
+/* 16 pixels, 0-7 in the low and 8-15 in the high lane, same math as
+ * the SSE2 version */
+static inline void
+yuv_to_rgbx_16(uint8_t *d, __m256i y, __m256i u, __m256i v, bool bgr)
+{
+	__m256i r, g, b, rg, bx, lo, hi;
+
+	y = _mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), _mm256_set1_epi16(75));
+	y = _mm256_add_epi16(y, _mm256_set1_epi16(YUV_ROUND));
+	u = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+	v = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+
+	r = _mm256_adds_epi16(y, _mm256_mullo_epi16(v, _mm256_set1_epi16(102)));
+	g = _mm256_adds_epi16(y, _mm256_mullo_epi16(u, _mm256_set1_epi16(-25)));
+	g = _mm256_adds_epi16(g, _mm256_mullo_epi16(v, _mm256_set1_epi16(-52)));
+	b = _mm256_adds_epi16(y, _mm256_mullo_epi16(u, _mm256_set1_epi16(129)));
+
+	r = _mm256_srai_epi16(r, YUV_SHIFT);
+	g = _mm256_srai_epi16(g, YUV_SHIFT);
+	b = _mm256_srai_epi16(b, YUV_SHIFT);
+
+	if (bgr) {
+		__m256i t = r;
+		r = b;
+		b = t;
+	}
+	r = _mm256_packus_epi16(r, r);
+	g = _mm256_packus_epi16(g, g);
+	b = _mm256_packus_epi16(b, b);
+
+	rg = _mm256_unpacklo_epi8(r, g);
+	bx = _mm256_unpacklo_epi8(b, _mm256_set1_epi8(-1));
+	lo = _mm256_unpacklo_epi16(rg, bx);	/* pixels 0-3 and 8-11 */
+	hi = _mm256_unpackhi_epi16(rg, bx);	/* pixels 4-7 and 12-15 */
+	_mm256_storeu_si256((__m256i*)d, _mm256_permute2x128_si256(lo, hi, 0x20));
+	_mm256_storeu_si256((__m256i*)(d + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline void split_uv(__m256i uv, __m256i *u, __m256i *v)
+{
+	*u = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)),
+			_MM_SHUFFLE(2, 2, 0, 0));
+	*v = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)),
+			_MM_SHUFFLE(3, 3, 1, 1));
+}
+
+static inline void
+packed_to_rgb(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool uyvy, bool bgr,
+		void (*tail) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height))
+{
+	uint32_t x, y, unrolled = width & ~15;
+	const __m256i mask = _mm256_set1_epi16(0xff);
+	__m256i in, yy, uv, u, v;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = ROW(src[0], src_stride[0], y);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x < unrolled; x += 16) {
+			in = _mm256_loadu_si256((const __m256i*)s);
+			if (uyvy) {
+				yy = _mm256_srli_epi16(in, 8);
+				uv = _mm256_and_si256(in, mask);
+			} else {
+				yy = _mm256_and_si256(in, mask);
+				uv = _mm256_srli_epi16(in, 8);
+			}
+			split_uv(uv, &u, &v);
+			yuv_to_rgbx_16(d, yy, u, v, bgr);
+			s += 32;
+			d += 64;
+		}
+	}
+	if (unrolled < width) {
+		const void *s[1] = { SPA_MEMBER(src[0], unrolled * 2, void) };
+		void *d[1] = { SPA_MEMBER(dst[0], unrolled * 4, void) };
+		tail(conv, d, dst_stride, s, src_stride, width - unrolled, height);
+	}
+}
+
+static inline void
+planar_to_rgb(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool interleaved, bool bgr,
+		void (*tail) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height))
+{
+	uint32_t x, y, unrolled = width & ~15;
+	__m256i yy, u, v;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *sy = ROW(src[0], src_stride[0], y);
+		const uint8_t *su = ROW(src[1], src_stride[1], y >> 1);
+		const uint8_t *sv = interleaved ? NULL : ROW(src[2], src_stride[2], y >> 1);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x < unrolled; x += 16) {
+			yy = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)sy));
+			if (interleaved) {
+				__m128i uv = _mm_loadu_si128((const __m128i*)su);
+				split_uv(_mm256_cvtepu8_epi16(uv), &u, &v);
+				su += 16;
+			} else {
+				__m128i t;
+				t = _mm_loadl_epi64((const __m128i*)su);
+				u = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(t, t));
+				t = _mm_loadl_epi64((const __m128i*)sv);
+				v = _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(t, t));
+				su += 8;
+				sv += 8;
+			}
+			yuv_to_rgbx_16(d, yy, u, v, bgr);
+			sy += 16;
+			d += 64;
+		}
+	}
+	if (unrolled < width) {
+		const void *s[3];
+		void *d[1] = { SPA_MEMBER(dst[0], unrolled * 4, void) };
+
+		s[0] = SPA_MEMBER(src[0], unrolled, void);
+		if (interleaved) {
+			s[1] = SPA_MEMBER(src[1], unrolled, void);
+		} else {
+			s[1] = SPA_MEMBER(src[1], unrolled / 2, void);
+			s[2] = SPA_MEMBER(src[2], unrolled / 2, void);
+		}
+		tail(conv, d, dst_stride, s, src_stride, width - unrolled, height);
+	}
+}
+
+#define MAKE_FUNCTION(name,func,...)						\
+void										\
+conv_##name##_avx2(struct convert *conv, void * SPA_RESTRICT dst[],		\
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],	\
+		const uint32_t src_stride[], uint32_t width, uint32_t height)	\
+{										\
+	func(conv, dst, dst_stride, src, src_stride, width, height,		\
+			__VA_ARGS__, conv_##name##_c);				\
+}
+
+MAKE_FUNCTION(yuy2_to_rgbx, packed_to_rgb, false, false)
+MAKE_FUNCTION(yuy2_to_bgrx, packed_to_rgb, false, true)
+MAKE_FUNCTION(uyvy_to_rgbx, packed_to_rgb, true, false)
+MAKE_FUNCTION(uyvy_to_bgrx, packed_to_rgb, true, true)
+MAKE_FUNCTION(nv12_to_rgbx, planar_to_rgb, true, false)
+MAKE_FUNCTION(nv12_to_bgrx, planar_to_rgb, true, true)
+MAKE_FUNCTION(i420_to_rgbx, planar_to_rgb, false, false)
+MAKE_FUNCTION(i420_to_bgrx, planar_to_rgb, false, true)
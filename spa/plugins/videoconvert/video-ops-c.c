@@ -0,0 +1,229 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "video-ops.h"
+
+#define ROW(p,stride,y)	SPA_MEMBER(p, (size_t)(stride) * (y), uint8_t)
+
+void
+conv_copy_c(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height)
+{
+	const struct format_desc *desc = conv->dst_desc;
+	uint32_t i, y, h, size;
+
+	for (i = 0; i < desc->n_planes; i++) {
+		size = (width + 1) / 2 * desc->bytes[i];
+		h = (height + (1 << desc->vsub[i]) - 1) >> desc->vsub[i];
+		for (y = 0; y < h; y++)
+			memcpy(ROW(dst[i], dst_stride[i], y), ROW(src[i], src_stride[i], y), size);
+	}
+}
+
+void
+conv_swap_rb_c(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = ROW(src[0], src_stride[0], y);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+		for (x = 0; x < width; x++) {
+			d[0] = s[2];
+			d[1] = s[1];
+			d[2] = s[0];
+			d[3] = s[3];
+			d += 4;
+			s += 4;
+		}
+	}
+}
+
+/* packed 4:2:2, yo is the offset of the first Y and uo of U in a pixel pair */
+static inline void
+packed_to_rgb(void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, int yo, int uo, int ro, int bo)
+{
+	uint32_t x, y;
+	int vo = uo + 2;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = ROW(src[0], src_stride[0], y);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x + 1 < width; x += 2) {
+			yuv_to_rgbx(d, s[yo], s[uo], s[vo], ro, bo);
+			yuv_to_rgbx(d + 4, s[yo + 2], s[uo], s[vo], ro, bo);
+			d += 8;
+			s += 4;
+		}
+		if (x < width)
+			yuv_to_rgbx(d, s[yo], s[uo], s[vo], ro, bo);
+	}
+}
+
+/* 4:2:0 with the chroma in one interleaved plane (NV12) or two planes (I420) */
+static inline void
+planar_to_rgb(void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool interleaved, int ro, int bo)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *sy = ROW(src[0], src_stride[0], y);
+		const uint8_t *su, *sv;
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+		uint32_t step;
+
+		if (interleaved) {
+			su = ROW(src[1], src_stride[1], y >> 1);
+			sv = su + 1;
+			step = 2;
+		} else {
+			su = ROW(src[1], src_stride[1], y >> 1);
+			sv = ROW(src[2], src_stride[2], y >> 1);
+			step = 1;
+		}
+		for (x = 0; x + 1 < width; x += 2) {
+			yuv_to_rgbx(d, sy[0], su[0], sv[0], ro, bo);
+			yuv_to_rgbx(d + 4, sy[1], su[0], sv[0], ro, bo);
+			d += 8;
+			sy += 2;
+			su += step;
+			sv += step;
+		}
+		if (x < width)
+			yuv_to_rgbx(d, sy[0], su[0], sv[0], ro, bo);
+	}
+}
+
+static inline void
+rgb_to_packed(void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, int yo, int uo, int ro, int bo)
+{
+	uint32_t x, y;
+	int vo = uo + 2;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = ROW(src[0], src_stride[0], y);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x < width; x += 2) {
+			/* an odd last pixel is paired with itself */
+			const uint8_t *s1 = x + 1 < width ? s + 4 : s;
+			int32_t r = s[ro] + s1[ro], g = s[1] + s1[1], b = s[bo] + s1[bo];
+
+			d[yo] = rgb_to_y(s[ro], s[1], s[bo]);
+			d[yo + 2] = rgb_to_y(s1[ro], s1[1], s1[bo]);
+			d[uo] = rgb_to_u(r >> 1, g >> 1, b >> 1);
+			d[vo] = rgb_to_v(r >> 1, g >> 1, b >> 1);
+			d += 4;
+			s += 8;
+		}
+	}
+}
+
+static inline void
+rgb_to_planar(void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool interleaved, int ro, int bo)
+{
+	uint32_t x, y;
+
+	for (y = 0; y < height; y += 2) {
+		const uint8_t *s0 = ROW(src[0], src_stride[0], y);
+		const uint8_t *s1 = y + 1 < height ? ROW(src[0], src_stride[0], y + 1) : s0;
+		uint8_t *d0 = ROW(dst[0], dst_stride[0], y);
+		uint8_t *d1 = y + 1 < height ? ROW(dst[0], dst_stride[0], y + 1) : d0;
+		uint8_t *du, *dv;
+		uint32_t step;
+
+		if (interleaved) {
+			du = ROW(dst[1], dst_stride[1], y >> 1);
+			dv = du + 1;
+			step = 2;
+		} else {
+			du = ROW(dst[1], dst_stride[1], y >> 1);
+			dv = ROW(dst[2], dst_stride[2], y >> 1);
+			step = 1;
+		}
+		for (x = 0; x < width; x += 2) {
+			uint32_t n = x + 1 < width ? 4 : 0;
+			int32_t r, g, b;
+
+			d0[0] = rgb_to_y(s0[ro], s0[1], s0[bo]);
+			d1[0] = rgb_to_y(s1[ro], s1[1], s1[bo]);
+			if (n) {
+				d0[1] = rgb_to_y(s0[n + ro], s0[n + 1], s0[n + bo]);
+				d1[1] = rgb_to_y(s1[n + ro], s1[n + 1], s1[n + bo]);
+			}
+			r = s0[ro] + s0[n + ro] + s1[ro] + s1[n + ro];
+			g = s0[1] + s0[n + 1] + s1[1] + s1[n + 1];
+			b = s0[bo] + s0[n + bo] + s1[bo] + s1[n + bo];
+			du[0] = rgb_to_u(r >> 2, g >> 2, b >> 2);
+			dv[0] = rgb_to_v(r >> 2, g >> 2, b >> 2);
+
+			s0 += 8;
+			s1 += 8;
+			d0 += 2;
+			d1 += 2;
+			du += step;
+			dv += step;
+		}
+	}
+}
+
+#define MAKE_FUNCTION(name,func,...)						\
+void										\
+conv_##name##_c(struct convert *conv, void * SPA_RESTRICT dst[],		\
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],	\
+		const uint32_t src_stride[], uint32_t width, uint32_t height)	\
+{										\
+	func(dst, dst_stride, src, src_stride, width, height, __VA_ARGS__);	\
+}
+
+MAKE_FUNCTION(yuy2_to_rgbx, packed_to_rgb, 0, 1, 0, 2)
+MAKE_FUNCTION(yuy2_to_bgrx, packed_to_rgb, 0, 1, 2, 0)
+MAKE_FUNCTION(uyvy_to_rgbx, packed_to_rgb, 1, 0, 0, 2)
+MAKE_FUNCTION(uyvy_to_bgrx, packed_to_rgb, 1, 0, 2, 0)
+MAKE_FUNCTION(nv12_to_rgbx, planar_to_rgb, true, 0, 2)
+MAKE_FUNCTION(nv12_to_bgrx, planar_to_rgb, true, 2, 0)
+MAKE_FUNCTION(i420_to_rgbx, planar_to_rgb, false, 0, 2)
+MAKE_FUNCTION(i420_to_bgrx, planar_to_rgb, false, 2, 0)
+MAKE_FUNCTION(rgbx_to_yuy2, rgb_to_packed, 0, 1, 0, 2)
+MAKE_FUNCTION(bgrx_to_yuy2, rgb_to_packed, 0, 1, 2, 0)
+MAKE_FUNCTION(rgbx_to_uyvy, rgb_to_packed, 1, 0, 0, 2)
+MAKE_FUNCTION(bgrx_to_uyvy, rgb_to_packed, 1, 0, 2, 0)
+MAKE_FUNCTION(rgbx_to_nv12, rgb_to_planar, true, 0, 2)
+MAKE_FUNCTION(bgrx_to_nv12, rgb_to_planar, true, 2, 0)
+MAKE_FUNCTION(rgbx_to_i420, rgb_to_planar, false, 0, 2)
+MAKE_FUNCTION(bgrx_to_i420, rgb_to_planar, false, 2, 0)
@@ -0,0 +1,189 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "video-ops.h"
+
+#include <emmintrin.h>
+
+#define ROW(p,stride,y)	SPA_MEMBER(p, (size_t)(stride) * (y), uint8_t)
+
+/* 8 pixels of Y, U and V in 16 bits lanes to RGBx. The saturating adds
+ * only clip values that are out of range anyway so this gives the same
+ * result as the C version. */
+static inline void
+yuv_to_rgbx_8(uint8_t *d, __m128i y, __m128i u, __m128i v, bool bgr)
+{
+	__m128i r, g, b, rg, bx;
+
+	y = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), _mm_set1_epi16(75));
+	y = _mm_add_epi16(y, _mm_set1_epi16(YUV_ROUND));
+	u = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	v = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+	r = _mm_adds_epi16(y, _mm_mullo_epi16(v, _mm_set1_epi16(102)));
+	g = _mm_adds_epi16(y, _mm_mullo_epi16(u, _mm_set1_epi16(-25)));
+	g = _mm_adds_epi16(g, _mm_mullo_epi16(v, _mm_set1_epi16(-52)));
+	b = _mm_adds_epi16(y, _mm_mullo_epi16(u, _mm_set1_epi16(129)));
+
+	r = _mm_srai_epi16(r, YUV_SHIFT);
+	g = _mm_srai_epi16(g, YUV_SHIFT);
+	b = _mm_srai_epi16(b, YUV_SHIFT);
+
+	if (bgr) {
+		__m128i t = r;
+		r = b;
+		b = t;
+	}
+	r = _mm_packus_epi16(r, r);
+	g = _mm_packus_epi16(g, g);
+	b = _mm_packus_epi16(b, b);
+
+	rg = _mm_unpacklo_epi8(r, g);
+	bx = _mm_unpacklo_epi8(b, _mm_set1_epi8(-1));
+	_mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi16(rg, bx));
+	_mm_storeu_si128((__m128i*)(d + 16), _mm_unpackhi_epi16(rg, bx));
+}
+
+/* U0 V0 U1 V1 U2 V2 U3 V3 in 16 bits lanes to one U and V per pixel */
+static inline void split_uv(__m128i uv, __m128i *u, __m128i *v)
+{
+	*u = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(2, 2, 0, 0)),
+			_MM_SHUFFLE(2, 2, 0, 0));
+	*v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(uv, _MM_SHUFFLE(3, 3, 1, 1)),
+			_MM_SHUFFLE(3, 3, 1, 1));
+}
+
+static inline void
+packed_to_rgb(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool uyvy, bool bgr,
+		void (*tail) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height))
+{
+	uint32_t x, y, unrolled = width & ~7;
+	const __m128i mask = _mm_set1_epi16(0xff);
+	__m128i in, yy, uv, u, v;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *s = ROW(src[0], src_stride[0], y);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x < unrolled; x += 8) {
+			in = _mm_loadu_si128((const __m128i*)s);
+			if (uyvy) {
+				yy = _mm_srli_epi16(in, 8);
+				uv = _mm_and_si128(in, mask);
+			} else {
+				yy = _mm_and_si128(in, mask);
+				uv = _mm_srli_epi16(in, 8);
+			}
+			split_uv(uv, &u, &v);
+			yuv_to_rgbx_8(d, yy, u, v, bgr);
+			s += 16;
+			d += 32;
+		}
+	}
+	if (unrolled < width) {
+		const void *s[1] = { SPA_MEMBER(src[0], unrolled * 2, void) };
+		void *d[1] = { SPA_MEMBER(dst[0], unrolled * 4, void) };
+		tail(conv, d, dst_stride, s, src_stride, width - unrolled, height);
+	}
+}
+
+static inline void
+planar_to_rgb(struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+		const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+		uint32_t width, uint32_t height, bool interleaved, bool bgr,
+		void (*tail) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height))
+{
+	uint32_t x, y, unrolled = width & ~7;
+	const __m128i zero = _mm_setzero_si128();
+	__m128i yy, u, v;
+
+	for (y = 0; y < height; y++) {
+		const uint8_t *sy = ROW(src[0], src_stride[0], y);
+		const uint8_t *su = ROW(src[1], src_stride[1], y >> 1);
+		const uint8_t *sv = interleaved ? NULL : ROW(src[2], src_stride[2], y >> 1);
+		uint8_t *d = ROW(dst[0], dst_stride[0], y);
+
+		for (x = 0; x < unrolled; x += 8) {
+			yy = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)sy), zero);
+			if (interleaved) {
+				__m128i uv = _mm_loadl_epi64((const __m128i*)su);
+				split_uv(_mm_unpacklo_epi8(uv, zero), &u, &v);
+				su += 8;
+			} else {
+				int32_t t;
+				memcpy(&t, su, 4);
+				u = _mm_cvtsi32_si128(t);
+				memcpy(&t, sv, 4);
+				v = _mm_cvtsi32_si128(t);
+				u = _mm_unpacklo_epi8(_mm_unpacklo_epi8(u, u), zero);
+				v = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v, v), zero);
+				su += 4;
+				sv += 4;
+			}
+			yuv_to_rgbx_8(d, yy, u, v, bgr);
+			sy += 8;
+			d += 32;
+		}
+	}
+	if (unrolled < width) {
+		const void *s[3];
+		void *d[1] = { SPA_MEMBER(dst[0], unrolled * 4, void) };
+
+		s[0] = SPA_MEMBER(src[0], unrolled, void);
+		if (interleaved) {
+			s[1] = SPA_MEMBER(src[1], unrolled, void);
+		} else {
+			s[1] = SPA_MEMBER(src[1], unrolled / 2, void);
+			s[2] = SPA_MEMBER(src[2], unrolled / 2, void);
+		}
+		tail(conv, d, dst_stride, s, src_stride, width - unrolled, height);
+	}
+}
+
+#define MAKE_FUNCTION(name,func,...)						\
+void										\
+conv_##name##_sse2(struct convert *conv, void * SPA_RESTRICT dst[],		\
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],	\
+		const uint32_t src_stride[], uint32_t width, uint32_t height)	\
+{										\
+	func(conv, dst, dst_stride, src, src_stride, width, height,		\
+			__VA_ARGS__, conv_##name##_c);				\
+}
+
+MAKE_FUNCTION(yuy2_to_rgbx, packed_to_rgb, false, false)
+MAKE_FUNCTION(yuy2_to_bgrx, packed_to_rgb, false, true)
+MAKE_FUNCTION(uyvy_to_rgbx, packed_to_rgb, true, false)
+MAKE_FUNCTION(uyvy_to_bgrx, packed_to_rgb, true, true)
+MAKE_FUNCTION(nv12_to_rgbx, planar_to_rgb, true, false)
+MAKE_FUNCTION(nv12_to_bgrx, planar_to_rgb, true, true)
+MAKE_FUNCTION(i420_to_rgbx, planar_to_rgb, false, false)
+MAKE_FUNCTION(i420_to_bgrx, planar_to_rgb, false, true)
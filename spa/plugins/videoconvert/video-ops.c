@@ -0,0 +1,347 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+#include <spa/param/video/raw.h>
+
+#include "video-ops.h"
+
+typedef void (*convert_func_t) (struct convert *conv, void * SPA_RESTRICT dst[],
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],
+		const uint32_t src_stride[], uint32_t width, uint32_t height);
+
+static const struct format_desc format_table[] =
+{
+	{ SPA_VIDEO_FORMAT_RGBx, 1, { 8, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_BGRx, 1, { 8, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_RGBA, 1, { 8, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_BGRA, 1, { 8, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_YUY2, 1, { 4, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_UYVY, 1, { 4, }, { 0, } },
+	{ SPA_VIDEO_FORMAT_NV12, 2, { 2, 2, }, { 0, 1, } },
+	{ SPA_VIDEO_FORMAT_I420, 3, { 2, 1, 1, }, { 0, 1, 1, } },
+};
+
+const struct format_desc *convert_find_format(uint32_t format)
+{
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(format_table); i++) {
+		if (format_table[i].format == format)
+			return &format_table[i];
+	}
+	return NULL;
+}
+
+uint32_t convert_plane_stride(const struct format_desc *desc, uint32_t plane, uint32_t stride)
+{
+	return stride * desc->bytes[plane] / desc->bytes[0];
+}
+
+uint32_t convert_frame_size(const struct format_desc *desc, uint32_t stride, uint32_t height)
+{
+	uint32_t i, size = 0;
+
+	for (i = 0; i < desc->n_planes; i++)
+		size += convert_plane_stride(desc, i, stride) *
+			((height + (1 << desc->vsub[i]) - 1) >> desc->vsub[i]);
+	return size;
+}
+
+/* the alpha formats are handled like the x formats, we write 0xff */
+static uint32_t rgb_format(uint32_t format)
+{
+	switch (format) {
+	case SPA_VIDEO_FORMAT_RGBA:
+		return SPA_VIDEO_FORMAT_RGBx;
+	case SPA_VIDEO_FORMAT_BGRA:
+		return SPA_VIDEO_FORMAT_BGRx;
+	default:
+		return format;
+	}
+}
+
+struct conv_info {
+	uint32_t src_fmt;
+	uint32_t dst_fmt;
+	uint32_t cpu_flags;
+
+	convert_func_t process;
+};
+
+static struct conv_info conv_table[] =
+{
+#if defined (HAVE_AVX2)
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_AVX2, conv_yuy2_to_rgbx_avx2 },
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_AVX2, conv_yuy2_to_bgrx_avx2 },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_AVX2, conv_uyvy_to_rgbx_avx2 },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_AVX2, conv_uyvy_to_bgrx_avx2 },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_AVX2, conv_nv12_to_rgbx_avx2 },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_AVX2, conv_nv12_to_bgrx_avx2 },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_AVX2, conv_i420_to_rgbx_avx2 },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_AVX2, conv_i420_to_bgrx_avx2 },
+#endif
+#if defined (HAVE_SSE2)
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_SSE2, conv_yuy2_to_rgbx_sse2 },
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_SSE2, conv_yuy2_to_bgrx_sse2 },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_SSE2, conv_uyvy_to_rgbx_sse2 },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_SSE2, conv_uyvy_to_bgrx_sse2 },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_SSE2, conv_nv12_to_rgbx_sse2 },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_SSE2, conv_nv12_to_bgrx_sse2 },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_RGBx, SPA_CPU_FLAG_SSE2, conv_i420_to_rgbx_sse2 },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_BGRx, SPA_CPU_FLAG_SSE2, conv_i420_to_bgrx_sse2 },
+#endif
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_RGBx, 0, conv_yuy2_to_rgbx_c },
+	{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_BGRx, 0, conv_yuy2_to_bgrx_c },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_RGBx, 0, conv_uyvy_to_rgbx_c },
+	{ SPA_VIDEO_FORMAT_UYVY, SPA_VIDEO_FORMAT_BGRx, 0, conv_uyvy_to_bgrx_c },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_RGBx, 0, conv_nv12_to_rgbx_c },
+	{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx, 0, conv_nv12_to_bgrx_c },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_RGBx, 0, conv_i420_to_rgbx_c },
+	{ SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_BGRx, 0, conv_i420_to_bgrx_c },
+
+	{ SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_YUY2, 0, conv_rgbx_to_yuy2_c },
+	{ SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_YUY2, 0, conv_bgrx_to_yuy2_c },
+	{ SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_UYVY, 0, conv_rgbx_to_uyvy_c },
+	{ SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_UYVY, 0, conv_bgrx_to_uyvy_c },
+	{ SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_NV12, 0, conv_rgbx_to_nv12_c },
+	{ SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_NV12, 0, conv_bgrx_to_nv12_c },
+	{ SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_I420, 0, conv_rgbx_to_i420_c },
+	{ SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_I420, 0, conv_bgrx_to_i420_c },
+
+	{ SPA_VIDEO_FORMAT_RGBx, SPA_VIDEO_FORMAT_BGRx, 0, conv_swap_rb_c },
+	{ SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_RGBx, 0, conv_swap_rb_c },
+};
+
+
+static const struct conv_info *find_conv_info(uint32_t src_fmt, uint32_t dst_fmt,
+		uint32_t cpu_flags)
+{
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(conv_table); i++) {
+		if (conv_table[i].src_fmt == src_fmt &&
+		    conv_table[i].dst_fmt == dst_fmt &&
+		    SPA_CPU_FLAGS_MATCH(conv_table[i].cpu_flags, cpu_flags))
+			return &conv_table[i];
+	}
+	return NULL;
+}
+
+static void offset_planes(const struct format_desc *desc, const void * SPA_RESTRICT planes[],
+		const uint32_t stride[], uint32_t y, const void *res[])
+{
+	uint32_t i;
+	for (i = 0; i < desc->n_planes; i++)
+		res[i] = SPA_MEMBER(planes[i], (size_t)stride[i] * (y >> desc->vsub[i]), void);
+}
+
+/* the same size, convert directly or through an RGBx band */
+static void impl_convert_process(struct convert *conv, void * SPA_RESTRICT dst[],
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],
+		const uint32_t src_stride[])
+{
+	uint32_t y, n, width = conv->dst_width, height = conv->dst_height;
+	uint32_t band_stride = width * 4;
+	const void *s[MAX_PLANES], *b[1] = { conv->band };
+	void *d[MAX_PLANES], *bd[1] = { conv->band };
+
+	if (conv->from_rgb == NULL) {
+		conv->to_rgb(conv, dst, dst_stride, src, src_stride, width, height);
+		return;
+	}
+	for (y = 0; y < height; y += BAND_ROWS) {
+		n = SPA_MIN(BAND_ROWS, height - y);
+		offset_planes(conv->src_desc, src, src_stride, y, s);
+		offset_planes(conv->dst_desc, (const void **)dst, dst_stride, y, (const void **)d);
+		conv->to_rgb(conv, bd, &band_stride, s, src_stride, width, n);
+		conv->from_rgb(conv, d, dst_stride, b, &band_stride, width, n);
+	}
+}
+
+/* scale with the nearest source pixel. Each source row that is needed is
+ * converted to RGBx once and the destination is produced in bands. */
+static void impl_convert_process_scale(struct convert *conv, void * SPA_RESTRICT dst[],
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],
+		const uint32_t src_stride[])
+{
+	uint32_t x, y, i, n, sy, last = UINT32_MAX;
+	uint32_t line_stride = conv->src_width * 4, band_stride = conv->dst_width * 4;
+	const void *s[MAX_PLANES], *b[1] = { conv->band };
+	void *d[MAX_PLANES], *l[1] = { conv->line };
+	const uint32_t *line = NULL;
+
+	for (y = 0; y < conv->dst_height; y += BAND_ROWS) {
+		n = SPA_MIN(BAND_ROWS, conv->dst_height - y);
+
+		for (i = 0; i < n; i++) {
+			uint32_t *row = SPA_MEMBER(conv->band, i * band_stride, uint32_t);
+
+			sy = (uint64_t)(y + i) * conv->src_height / conv->dst_height;
+			if (sy != last) {
+				offset_planes(conv->src_desc, src, src_stride, sy, s);
+				if (conv->to_rgb) {
+					conv->to_rgb(conv, l, &line_stride, s, src_stride,
+							conv->src_width, 1);
+					line = (const uint32_t *)conv->line;
+				} else {
+					line = s[0];
+				}
+				last = sy;
+			}
+			for (x = 0; x < conv->dst_width; x++)
+				row[x] = line[conv->xmap[x]];
+		}
+		offset_planes(conv->dst_desc, (const void **)dst, dst_stride, y, (const void **)d);
+		if (conv->from_rgb)
+			conv->from_rgb(conv, d, dst_stride, b, &band_stride, conv->dst_width, n);
+		else
+			conv_copy_c(conv, d, dst_stride, b, &band_stride, conv->dst_width, n);
+	}
+}
+
+static void impl_convert_process_copy(struct convert *conv, void * SPA_RESTRICT dst[],
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],
+		const uint32_t src_stride[])
+{
+	conv_copy_c(conv, dst, dst_stride, src, src_stride, conv->dst_width, conv->dst_height);
+}
+
+static void impl_convert_free(struct convert *conv)
+{
+	free(conv->xmap);
+	free(conv->line);
+	free(conv->band);
+	conv->xmap = NULL;
+	conv->line = NULL;
+	conv->band = NULL;
+	conv->process = NULL;
+}
+
+static int init_scale(struct convert *conv, uint32_t src_fmt, uint32_t dst_fmt)
+{
+	const struct conv_info *info;
+	uint32_t x, fmt, cpu_flags = 0;
+
+	/* the rows are scaled in a 32 bits RGB format, pick the one that
+	 * needs the least conversions */
+	if (dst_fmt == SPA_VIDEO_FORMAT_RGBx || dst_fmt == SPA_VIDEO_FORMAT_BGRx)
+		fmt = dst_fmt;
+	else if (src_fmt == SPA_VIDEO_FORMAT_BGRx)
+		fmt = src_fmt;
+	else
+		fmt = SPA_VIDEO_FORMAT_RGBx;
+
+	if (src_fmt != fmt) {
+		if ((info = find_conv_info(src_fmt, fmt, conv->cpu_flags)) == NULL)
+			return -ENOTSUP;
+		conv->to_rgb = info->process;
+		cpu_flags |= info->cpu_flags;
+	}
+	if (dst_fmt != fmt) {
+		if ((info = find_conv_info(fmt, dst_fmt, conv->cpu_flags)) == NULL)
+			return -ENOTSUP;
+		conv->from_rgb = info->process;
+		cpu_flags |= info->cpu_flags;
+	}
+
+	conv->xmap = calloc(conv->dst_width, sizeof(uint32_t));
+	conv->line = calloc(conv->src_width + 1, 4);
+	conv->band = calloc(conv->dst_width + 1, 4 * BAND_ROWS);
+	if (conv->xmap == NULL || conv->line == NULL || conv->band == NULL) {
+		impl_convert_free(conv);
+		return -ENOMEM;
+	}
+	for (x = 0; x < conv->dst_width; x++)
+		conv->xmap[x] = (uint64_t)x * conv->src_width / conv->dst_width;
+
+	conv->process = impl_convert_process_scale;
+	conv->cpu_flags = cpu_flags;
+	return 0;
+}
+
+int convert_init(struct convert *conv)
+{
+	const struct conv_info *info, *from;
+	uint32_t src_fmt, dst_fmt;
+
+	conv->src_desc = convert_find_format(conv->src_fmt);
+	conv->dst_desc = convert_find_format(conv->dst_fmt);
+	if (conv->src_desc == NULL || conv->dst_desc == NULL)
+		return -ENOTSUP;
+	if (conv->src_width == 0 || conv->src_height == 0 ||
+	    conv->dst_width == 0 || conv->dst_height == 0)
+		return -EINVAL;
+
+	src_fmt = rgb_format(conv->src_fmt);
+	dst_fmt = rgb_format(conv->dst_fmt);
+
+	conv->xmap = NULL;
+	conv->line = NULL;
+	conv->band = NULL;
+	conv->to_rgb = conv->from_rgb = NULL;
+	conv->free = impl_convert_free;
+	conv->is_passthrough = false;
+
+	if (conv->src_width != conv->dst_width ||
+	    conv->src_height != conv->dst_height)
+		return init_scale(conv, src_fmt, dst_fmt);
+
+	if (src_fmt == dst_fmt) {
+		conv->is_passthrough = true;
+		conv->process = impl_convert_process_copy;
+		conv->cpu_flags = 0;
+		return 0;
+	}
+
+	conv->process = impl_convert_process;
+
+	/* one step when either side is RGB */
+	if ((info = find_conv_info(src_fmt, dst_fmt, conv->cpu_flags)) != NULL) {
+		conv->to_rgb = info->process;
+		conv->cpu_flags = info->cpu_flags;
+		return 0;
+	}
+
+	/* between YUV formats through an RGBx band */
+	info = find_conv_info(src_fmt, SPA_VIDEO_FORMAT_RGBx, conv->cpu_flags);
+	from = find_conv_info(SPA_VIDEO_FORMAT_RGBx, dst_fmt, conv->cpu_flags);
+	if (info == NULL || from == NULL)
+		return -ENOTSUP;
+
+	conv->band = calloc(conv->dst_width + 1, 4 * BAND_ROWS);
+	if (conv->band == NULL)
+		return -ENOMEM;
+
+	conv->to_rgb = info->process;
+	conv->from_rgb = from->process;
+	conv->cpu_flags = info->cpu_flags | from->cpu_flags;
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <spa/utils/defs.h>
+
+#define MAX_PLANES	3
+
+/* frames are converted in bands of this many rows, the intermediate RGBx
+ * band of a 4K frame then stays in the cache */
+#define BAND_ROWS	16u
+
+/* BT.601 limited range, 6 bits of precision so that the SIMD versions
+ * can do the same math in 16 bits lanes */
+#define YUV_Y(y)	(((int32_t)(y) - 16) * 75)
+#define YUV_RV(v)	(((int32_t)(v) - 128) * 102)
+#define YUV_GU(u)	(((int32_t)(u) - 128) * -25)
+#define YUV_GV(v)	(((int32_t)(v) - 128) * -52)
+#define YUV_BU(u)	(((int32_t)(u) - 128) * 129)
+#define YUV_ROUND	32
+#define YUV_SHIFT	6
+
+static inline uint8_t clamp_u8(int32_t v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* r, g and b are at offsets ro, 1 and bo in a 4 byte pixel */
+static inline void yuv_to_rgbx(uint8_t *d, int32_t y, int32_t u, int32_t v, int ro, int bo)
+{
+	int32_t yy = YUV_Y(y) + YUV_ROUND;
+	d[ro] = clamp_u8((yy + YUV_RV(v)) >> YUV_SHIFT);
+	d[1]  = clamp_u8((yy + YUV_GU(u) + YUV_GV(v)) >> YUV_SHIFT);
+	d[bo] = clamp_u8((yy + YUV_BU(u)) >> YUV_SHIFT);
+	d[3]  = 0xff;
+}
+
+static inline uint8_t rgb_to_y(int32_t r, int32_t g, int32_t b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgb_to_u(int32_t r, int32_t g, int32_t b)
+{
+	return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t rgb_to_v(int32_t r, int32_t g, int32_t b)
+{
+	return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+struct format_desc {
+	uint32_t format;
+	uint32_t n_planes;
+	uint32_t bytes[MAX_PLANES];	/* bytes of two pixels in each plane */
+	uint32_t vsub[MAX_PLANES];	/* log2 of the vertical subsampling */
+};
+
+const struct format_desc *convert_find_format(uint32_t format);
+
+/* default layout of the planes in one block of memory */
+uint32_t convert_plane_stride(const struct format_desc *desc, uint32_t plane, uint32_t stride);
+uint32_t convert_frame_size(const struct format_desc *desc, uint32_t stride, uint32_t height);
+
+struct convert {
+	uint32_t src_fmt;
+	uint32_t dst_fmt;
+	uint32_t src_width;
+	uint32_t src_height;
+	uint32_t dst_width;
+	uint32_t dst_height;
+	uint32_t cpu_flags;
+
+	unsigned int is_passthrough:1;
+
+	const struct format_desc *src_desc;
+	const struct format_desc *dst_desc;
+
+	/* src to RGBx, or straight to dst when there is no from_rgb. When
+	 * scaling from RGB there is no to_rgb. */
+	void (*to_rgb) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height);
+	/* RGBx to dst */
+	void (*from_rgb) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[],
+			uint32_t width, uint32_t height);
+
+	uint32_t *xmap;		/* source column of each destination column */
+	uint8_t *line;		/* one RGBx row of the source when scaling */
+	uint8_t *band;		/* BAND_ROWS RGBx rows of the destination */
+
+	void (*process) (struct convert *conv, void * SPA_RESTRICT dst[], const uint32_t dst_stride[],
+			const void * SPA_RESTRICT src[], const uint32_t src_stride[]);
+	void (*free) (struct convert *conv);
+};
+
+int convert_init(struct convert *conv);
+
+#define convert_process(conv,...)	(conv)->process(conv, __VA_ARGS__)
+#define convert_free(conv)		(conv)->free(conv)
+
+#define DEFINE_FUNCTION(name,arch) \
+void conv_##name##_##arch(struct convert *conv, void * SPA_RESTRICT dst[],	\
+		const uint32_t dst_stride[], const void * SPA_RESTRICT src[],	\
+		const uint32_t src_stride[], uint32_t width, uint32_t height)
+
+DEFINE_FUNCTION(copy, c);
+DEFINE_FUNCTION(swap_rb, c);
+DEFINE_FUNCTION(yuy2_to_rgbx, c);
+DEFINE_FUNCTION(yuy2_to_bgrx, c);
+DEFINE_FUNCTION(uyvy_to_rgbx, c);
+DEFINE_FUNCTION(uyvy_to_bgrx, c);
+DEFINE_FUNCTION(nv12_to_rgbx, c);
+DEFINE_FUNCTION(nv12_to_bgrx, c);
+DEFINE_FUNCTION(i420_to_rgbx, c);
+DEFINE_FUNCTION(i420_to_bgrx, c);
+DEFINE_FUNCTION(rgbx_to_yuy2, c);
+DEFINE_FUNCTION(bgrx_to_yuy2, c);
+DEFINE_FUNCTION(rgbx_to_uyvy, c);
+DEFINE_FUNCTION(bgrx_to_uyvy, c);
+DEFINE_FUNCTION(rgbx_to_nv12, c);
+DEFINE_FUNCTION(bgrx_to_nv12, c);
+DEFINE_FUNCTION(rgbx_to_i420, c);
+DEFINE_FUNCTION(bgrx_to_i420, c);
+
+#if defined(HAVE_SSE2)
+DEFINE_FUNCTION(yuy2_to_rgbx, sse2);
+DEFINE_FUNCTION(yuy2_to_bgrx, sse2);
+DEFINE_FUNCTION(uyvy_to_rgbx, sse2);
+DEFINE_FUNCTION(uyvy_to_bgrx, sse2);
+DEFINE_FUNCTION(nv12_to_rgbx, sse2);
+DEFINE_FUNCTION(nv12_to_bgrx, sse2);
+DEFINE_FUNCTION(i420_to_rgbx, sse2);
+DEFINE_FUNCTION(i420_to_bgrx, sse2);
+#endif
+#if defined(HAVE_AVX2)
+DEFINE_FUNCTION(yuy2_to_rgbx, avx2);
+DEFINE_FUNCTION(yuy2_to_bgrx, avx2);
+DEFINE_FUNCTION(uyvy_to_rgbx, avx2);
+DEFINE_FUNCTION(uyvy_to_bgrx, avx2);
+DEFINE_FUNCTION(nv12_to_rgbx, avx2);
+DEFINE_FUNCTION(nv12_to_bgrx, avx2);
+DEFINE_FUNCTION(i420_to_rgbx, avx2);
+DEFINE_FUNCTION(i420_to_bgrx, avx2);
+#endif
@@ -38,6 +38,8 @@
 
 #define NAME "videoadapter"
 
+#define MAX_DAMAGE	16
+
 /** \cond */
 
 struct impl {
@@ -136,7 +138,6 @@ next:
 	return 0;
 }
 
-#if 0
 static int link_io(struct impl *this)
 {
 	int res;
@@ -184,7 +185,6 @@ static int link_io(struct impl *this)
 	}
 	return 0;
 }
-#endif
 
 static void emit_node_info(struct impl *this, bool full)
 {
@@ -350,7 +350,9 @@ static int slave_ready(void *data, int status)
 
 	spa_log_trace(this->log, NAME " %p: ready %d", this, status);
 
-	if (this->direction == SPA_DIRECTION_OUTPUT)
+	this->master = true;
+
+	if (this->direction == SPA_DIRECTION_OUTPUT && this->use_converter)
 		status = spa_node_process(this->convert);
 
 	return spa_node_call_ready(&this->callbacks, status);
@@ -574,6 +576,7 @@ static int negotiate_buffers(struct impl *this)
 	int32_t size, buffers, blocks, align, flags;
 	uint32_t *aligns;
 	struct spa_data *datas;
+	struct spa_meta metas[2];
 	uint32_t slave_flags, conv_flags;
 
 	spa_log_debug(this->log, "%p: %d", this, this->n_buffers);
@@ -639,8 +642,15 @@ static int negotiate_buffers(struct impl *this)
 		aligns[i] = align;
 	}
 
+	/* let the damage of the slave reach the converter */
+	metas[0].type = SPA_META_Header;
+	metas[0].size = sizeof(struct spa_meta_header);
+	metas[1].type = SPA_META_VideoDamage;
+	metas[1].size = sizeof(struct spa_meta_region) * MAX_DAMAGE;
+
 	free(this->buffers);
-	this->buffers = spa_buffer_alloc_array(buffers, flags, 0, NULL, blocks, datas, aligns);
+	this->buffers = spa_buffer_alloc_array(buffers, flags,
+			SPA_N_ELEMENTS(metas), metas, blocks, datas, aligns);
 	if (this->buffers == NULL)
 		return -errno;
 	this->n_buffers = buffers;
@@ -761,8 +771,8 @@ static int impl_node_process(void *object)
 	struct impl *this = object;
 	int status;
 
-	spa_log_trace_fp(this->log, "%p: process convert:%u",
-			this, this->use_converter);
+	spa_log_trace_fp(this->log, "%p: process convert:%u master:%d",
+			this, this->use_converter, this->master);
 
 	if (this->direction == SPA_DIRECTION_INPUT) {
 		if (this->use_converter)
@@ -778,6 +788,8 @@ static int impl_node_process(void *object)
 		if (this->use_converter)
 			status = spa_node_process(this->convert);
 	}
+	this->master = false;
+
 	return status;
 }
 
@@ -825,9 +837,13 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	spa_hook_remove(&this->target_listener);
 	spa_hook_remove(&this->slave_listener);
 	spa_node_set_callbacks(this->slave, NULL, NULL);
 
+	if (this->use_converter)
+		spa_handle_clear(this->hnd_convert);
+
 	if (this->buffers)
 		free(this->buffers);
 	this->buffers = NULL;
@@ -843,9 +859,7 @@ impl_get_size(const struct spa_handle_factory *factory,
 {
 	size_t size = 0;
 
-#if 0
 	size += spa_handle_factory_get_size(&spa_videoconvert_factory, params);
-#endif
 	size += sizeof(struct impl);
 
 	return size;
@@ -859,9 +873,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *this;
-#if 0
 	void *iface;
-#endif
 	const char *str;
 	uint32_t i;
 
@@ -897,28 +909,29 @@ impl_init(const struct spa_handle_factory *factory,
 			&impl_node, this);
 	spa_hook_list_init(&this->hooks);
 
-#if 0
-	this->hnd_convert = SPA_MEMBER(this, sizeof(struct impl), struct spa_handle);
-	spa_handle_factory_init(&spa_videooconvert_factory,
-				this->hnd_convert,
-				info, support, n_support);
-
-	spa_handle_get_interface(this->hnd_convert, SPA_TYPE_INTERFACE_Node, &iface);
-	this->convert = iface;
-	this->target = this->convert;
-	spa_node_add_listener(this->convert,
-			&this->convert_listener, &target_node_events, this);
+	/* the converter is only used when asked for, most video consumers
+	 * can handle the formats of the device directly */
+	if ((str = spa_dict_lookup(info, "video.adapt.convert")) != NULL &&
+	    (strcmp(str, "true") == 0 || atoi(str) == 1)) {
+		int res;
 
-	this->use_converter = true;
-	link_io(this);
+		this->hnd_convert = SPA_MEMBER(this, sizeof(struct impl), struct spa_handle);
+		if ((res = spa_handle_factory_init(&spa_videoconvert_factory,
+					this->hnd_convert,
+					info, support, n_support)) < 0)
+			return res;
 
-#else
-	this->target = this->slave;
+		spa_handle_get_interface(this->hnd_convert, SPA_TYPE_INTERFACE_Node, &iface);
+		this->convert = iface;
+		this->target = this->convert;
+		this->use_converter = true;
+		link_io(this);
+	} else {
+		this->target = this->slave;
+	}
 	spa_node_add_listener(this->target,
 			&this->target_listener, &target_node_events, this);
 
-#endif
-
 	this->info_all = SPA_NODE_CHANGE_MASK_PARAMS;
 	this->info = SPA_NODE_INFO_INIT();
 	this->info.max_input_ports = 0;
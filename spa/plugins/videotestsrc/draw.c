@@ -23,6 +23,7 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 
 typedef enum {
 	GRAY = 0,
@@ -264,25 +265,119 @@ static void draw_snow(DrawingData * dd)
 	}
 }
 
-static int draw(struct impl *this, char *data)
+/* The pattern is drawn once for a format, size and pattern and copied
+ * into the buffers. The snow is refreshed for each frame with copies of a
+ * line of snow that is twice as wide as the frame, from a random offset. */
+struct pattern_cache {
+	uint32_t format;
+	uint32_t pattern;
+	int width;
+	int height;
+	int stride;
+	int bpp;
+	int snow_x;
+	int snow_y;
+	char *frame;
+	char *snow;
+};
+
+static void free_pattern_cache(struct port *port)
 {
+	struct pattern_cache *c = port->cache;
+
+	if (c == NULL)
+		return;
+	free(c->frame);
+	free(c->snow);
+	free(c);
+	port->cache = NULL;
+}
+
+static struct pattern_cache *make_pattern_cache(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct pattern_cache *c;
 	DrawingData dd;
-	int res;
+	int align;
 
-	init_colors();
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		return NULL;
+
+	c->format = port->current_format.info.raw.format;
+	c->pattern = this->props.pattern;
+	c->width = port->current_format.info.raw.size.width;
+	c->height = port->current_format.info.raw.size.height;
+	c->stride = port->stride;
+	c->bpp = c->format == SPA_VIDEO_FORMAT_UYVY ? 2 : 3;
+	/* UYVY shares the chroma of two pixels */
+	align = c->format == SPA_VIDEO_FORMAT_UYVY ? 2 : 1;
+
+	c->frame = malloc(c->stride * c->height);
+	c->snow = malloc(SPA_ROUND_UP_N(2 * c->width, 2) * c->bpp);
+	if (c->frame == NULL || c->snow == NULL)
+		goto error;
 
-	if ((res = drawing_data_init(&dd, this, data)) < 0)
-		return res;
+	if (drawing_data_init(&dd, this, c->frame) < 0)
+		goto error;
 
-	switch (this->props.pattern) {
+	switch (c->pattern) {
 	case PATTERN_SMPTE_SNOW:
 		draw_smpte_snow(&dd);
+		c->snow_x = 3 * (c->width / 6) + 3 * (c->width / 12);
+		c->snow_y = 3 * c->height / 4;
 		break;
 	case PATTERN_SNOW:
 		draw_snow(&dd);
+		c->snow_x = 0;
+		c->snow_y = 0;
 		break;
 	default:
-		return -ENOTSUP;
+		goto error;
+	}
+	c->snow_x = SPA_ROUND_UP_N(c->snow_x, align);
+
+	dd.line = c->snow;
+	dd.width = SPA_ROUND_UP_N(2 * c->width, 2);
+	dd.height = 1;
+	draw_snow(&dd);
+
+	return c;
+error:
+	free(c->frame);
+	free(c->snow);
+	free(c);
+	return NULL;
+}
+
+static int draw(struct impl *this, char *data)
+{
+	struct port *port = &this->port;
+	struct pattern_cache *c = port->cache;
+	int y, len, offset;
+
+	init_colors();
+
+	if (c == NULL ||
+	    c->format != port->current_format.info.raw.format ||
+	    c->pattern != this->props.pattern ||
+	    c->width != (int) port->current_format.info.raw.size.width ||
+	    c->height != (int) port->current_format.info.raw.size.height ||
+	    c->stride != port->stride) {
+		free_pattern_cache(port);
+		if ((port->cache = c = make_pattern_cache(this)) == NULL)
+			return -ENOTSUP;
+	}
+
+	memcpy(data, c->frame, c->stride * c->height);
+
+	len = (c->width - c->snow_x) * c->bpp;
+	if (len <= 0)
+		return 0;
+
+	for (y = c->snow_y; y < c->height; y++) {
+		offset = (rand() % (c->width + 1)) & ~1;
+		memcpy(data + y * c->stride + c->snow_x * c->bpp,
+				c->snow + offset * c->bpp, len);
 	}
 	return 0;
 }
@@ -68,6 +68,8 @@ static void reset_props(struct props *props)
 #define MAX_BUFFERS 16
 #define MAX_PORTS 1
 
+struct pattern_cache;
+
 struct buffer {
 	uint32_t id;
 	struct spa_buffer *outbuf;
@@ -92,6 +94,8 @@ struct port {
 	uint32_t n_buffers;
 
 	struct spa_list empty;
+
+	struct pattern_cache *cache;
 };
 
 struct impl {
@@ -836,6 +840,8 @@ static int impl_clear(struct spa_handle *handle)
 		spa_loop_remove_source(this->data_loop, &this->timer_source);
 	close(this->timer_source.fd);
 
+	free_pattern_cache(&this->port);
+
 	return 0;
 }
 
@@ -0,0 +1,155 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "benchmark.h"
+
+#include "volume-ops.c"
+
+#define MAX_SAMPLES	4096
+#define MAX_CHANNELS	8
+
+#define MAX_COUNT 1000
+
+static float samp_in[MAX_SAMPLES * MAX_CHANNELS];
+static float samp_out[MAX_SAMPLES * MAX_CHANNELS];
+
+static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
+static const int channel_counts[] = { 1, 2, 4, 6, 8 };
+
+struct format {
+	const char *name;
+	uint32_t fmt;
+};
+
+static const struct format formats[] = {
+	{ "volume_f32", SPA_AUDIO_FORMAT_F32 },
+	{ "volume_s16", SPA_AUDIO_FORMAT_S16 },
+};
+
+struct variant {
+	const char *impl;
+	uint32_t cpu_flags;
+};
+
+static const struct variant variants[] = {
+	{ "c", 0 },
+#if defined (HAVE_SSE)
+	{ "sse", SPA_CPU_FLAG_SSE },
+#endif
+#if defined (HAVE_AVX)
+	{ "avx", SPA_CPU_FLAG_AVX },
+#endif
+#if defined (HAVE_NEON)
+	{ "neon", SPA_CPU_FLAG_NEON },
+#endif
+};
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * \
+				SPA_N_ELEMENTS(formats) * SPA_N_ELEMENTS(variants) * 2
+
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("volume-ops", results);
+
+static void run_test1(const char *name, const char *impl, struct volume_ops *ops,
+		bool ramp, int n_samples)
+{
+	uint32_t i, j;
+	float gain[MAX_CHANNELS], step[MAX_CHANNELS];
+	uint64_t count, t1, t2;
+
+	for (j = 0; j < ops->n_channels; j++) {
+		gain[j] = 0.5f;
+		step[j] = ramp ? 0.5f / MAX_SAMPLES : 0.0f;
+	}
+
+	t1 = bench_now();
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		volume_ops_process(ops, samp_out, samp_in, gain, step, n_samples);
+		count++;
+	}
+	t2 = bench_now();
+
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = impl,
+		.n_samples = n_samples,
+		.n_channels = ops->n_channels,
+		.n_params = 1,
+		.params = {
+			{ "ramp", ramp },
+		},
+		.count = count,
+		.nsec = t2 - t1,
+	});
+}
+
+static void run_format(const struct format *f, const struct variant *v)
+{
+	struct volume_ops ops;
+	uint32_t i, j, r;
+
+	for (i = 0; i < SPA_N_ELEMENTS(channel_counts); i++) {
+		spa_zero(ops);
+		ops.fmt = f->fmt;
+		ops.n_channels = channel_counts[i];
+		ops.cpu_flags = v->cpu_flags;
+		if (volume_ops_init(&ops) < 0)
+			continue;
+		/* no specialized function for these flags, the C version
+		 * is measured separately */
+		if (v->cpu_flags != 0 && ops.cpu_flags == 0) {
+			volume_ops_free(&ops);
+			continue;
+		}
+		for (r = 0; r < 2; r++)
+			for (j = 0; j < SPA_N_ELEMENTS(sample_sizes); j++)
+				run_test1(f->name, v->impl, &ops, r, sample_sizes[j]);
+
+		volume_ops_free(&ops);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, j;
+
+	for (i = 0; i < SPA_N_ELEMENTS(samp_in); i++)
+		samp_in[i] = drand48() * 2.0 - 1.0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+		for (j = 0; j < SPA_N_ELEMENTS(variants); j++)
+			run_format(&formats[i], &variants[j]);
+
+	bench_report(&bench);
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "volume-ops.h"
+
+#include <immintrin.h>
+
+void
+volume_f32_avx(struct volume_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		const float * SPA_RESTRICT gain, const float * SPA_RESTRICT step,
+		uint32_t n_frames)
+{
+	uint32_t i, n, n_channels = ops->n_channels;
+	uint32_t n_samples = n_frames * n_channels, unrolled = n_samples & ~31;
+	const float *s = src;
+	float *d = dst;
+	float gl[8], il[8];
+	__m256 base, g[4], inc;
+
+	/* n_channels divides 8, lane i holds channel i % n_channels of
+	 * frame i / n_channels */
+	for (i = 0; i < 8; i++) {
+		uint32_t c = i % n_channels;
+		gl[i] = gain[c] + step[c] * (i / n_channels);
+		il[i] = step[c] * (8 / n_channels);
+	}
+	base = _mm256_loadu_ps(gl);
+	inc = _mm256_loadu_ps(il);
+
+	for (n = 0; n < unrolled; n += 32) {
+		/* restart from base to avoid accumulating rounding errors */
+		g[0] = _mm256_add_ps(base, _mm256_mul_ps(inc, _mm256_set1_ps(n / 8)));
+		g[1] = _mm256_add_ps(g[0], inc);
+		g[2] = _mm256_add_ps(g[1], inc);
+		g[3] = _mm256_add_ps(g[2], inc);
+
+		_mm256_storeu_ps(&d[n +  0], _mm256_mul_ps(_mm256_loadu_ps(&s[n +  0]), g[0]));
+		_mm256_storeu_ps(&d[n +  8], _mm256_mul_ps(_mm256_loadu_ps(&s[n +  8]), g[1]));
+		_mm256_storeu_ps(&d[n + 16], _mm256_mul_ps(_mm256_loadu_ps(&s[n + 16]), g[2]));
+		_mm256_storeu_ps(&d[n + 24], _mm256_mul_ps(_mm256_loadu_ps(&s[n + 24]), g[3]));
+	}
+	for (; n < n_samples; n++) {
+		uint32_t c = n % n_channels;
+		d[n] = s[n] * (gain[c] + step[c] * (n / n_channels));
+	}
+}
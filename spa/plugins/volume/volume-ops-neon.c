@@ -0,0 +1,73 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "volume-ops.h"
+
+#include <arm_neon.h>
+
+void
+volume_f32_neon(struct volume_ops *ops, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		const float * SPA_RESTRICT gain, const float * SPA_RESTRICT step,
+		uint32_t n_frames)
+{
+	uint32_t i, n, n_channels = ops->n_channels;
+	uint32_t n_samples = n_frames * n_channels, unrolled = n_samples & ~15;
+	const float *s = src;
+	float *d = dst;
+	float gl[4], il[4];
+	float32x4_t base, g[4], inc;
+
+	/* n_channels divides 4, lane i holds channel i % n_channels of
+	 * frame i / n_channels */
+	for (i = 0; i < 4; i++) {
+		uint32_t c = i % n_channels;
+		gl[i] = gain[c] + step[c] * (i / n_channels);
+		il[i] = step[c] * (4 / n_channels);
+	}
+	base = vld1q_f32(gl);
+	inc = vld1q_f32(il);
+
+	for (n = 0; n < unrolled; n += 16) {
+		/* restart from base to avoid accumulating rounding errors */
+		g[0] = vaddq_f32(base, vmulq_f32(inc, vdupq_n_f32(n / 4)));
+		g[1] = vaddq_f32(g[0], inc);
+		g[2] = vaddq_f32(g[1], inc);
+		g[3] = vaddq_f32(g[2], inc);
+
+		vst1q_f32(&d[n +  0], vmulq_f32(vld1q_f32(&s[n +  0]), g[0]));
+		vst1q_f32(&d[n +  4], vmulq_f32(vld1q_f32(&s[n +  4]), g[1]));
+		vst1q_f32(&d[n +  8], vmulq_f32(vld1q_f32(&s[n +  8]), g[2]));
+		vst1q_f32(&d[n + 12], vmulq_f32(vld1q_f32(&s[n + 12]), g[3]));
+	}
+	for (; n < n_samples; n++) {
+		uint32_t c = n % n_channels;
+		d[n] = s[n] * (gain[c] + step[c] * (n / n_channels));
+	}
+}
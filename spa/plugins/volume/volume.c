@@ -25,9 +25,11 @@
 #include <errno.h>
 #include <string.h>
 #include <stddef.h>
+#include <math.h>
 
 #include <spa/support/plugin.h>
 #include <spa/support/log.h>
+#include <spa/support/cpu.h>
 #include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/utils.h>
@@ -36,20 +38,46 @@
 #include <spa/param/param.h>
 #include <spa/pod/filter.h>
 
+#include "volume-ops.h"
+
 #define NAME "volume"
 
-#define DEFAULT_VOLUME 1.0
+enum {
+	RAMP_SCALE_LINEAR,
+	RAMP_SCALE_LOG,
+};
+
+#define DEFAULT_VOLUME 1.0f
 #define DEFAULT_MUTE false
+#define DEFAULT_RAMP_SAMPLES 0
+#define DEFAULT_RAMP_SCALE RAMP_SCALE_LINEAR
+
+/* ramps are evaluated exactly every RAMP_BLOCK frames and interpolated
+ * linearly in between */
+#define RAMP_BLOCK	256u
+/* lowest gain of a log ramp, -60dB */
+#define RAMP_LOG_MIN	0.001f
 
 struct props {
-	double volume;
+	float volume;
 	bool mute;
+	uint32_t n_channel_volumes;
+	float channel_volumes[SPA_AUDIO_MAX_CHANNELS];
+	int32_t ramp_samples;
+	int32_t ramp_scale;
 };
 
 static void reset_props(struct props *props)
 {
+	uint32_t i;
+
 	props->volume = DEFAULT_VOLUME;
 	props->mute = DEFAULT_MUTE;
+	props->n_channel_volumes = 0;
+	for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++)
+		props->channel_volumes[i] = 1.0f;
+	props->ramp_samples = DEFAULT_RAMP_SAMPLES;
+	props->ramp_scale = DEFAULT_RAMP_SCALE;
 }
 
 #define MAX_SAMPLES     8192
@@ -89,6 +117,8 @@ struct impl {
 	struct spa_node node;
 
 	struct spa_log *log;
+	struct spa_cpu *cpu;
+	uint32_t cpu_flags;
 
 	uint64_t info_all;
 	struct spa_node_info info;
@@ -100,6 +130,17 @@ struct impl {
 	struct spa_audio_info current_format;
 	int bpf;
 
+	struct volume_ops ops;
+	uint32_t n_channels;
+	float gain[SPA_AUDIO_MAX_CHANNELS];		/* current gain */
+	float ramp_start[SPA_AUDIO_MAX_CHANNELS];
+	float ramp_end[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t ramp_pos;
+	uint32_t ramp_len;
+	int32_t ramp_scale;
+	unsigned int is_unity:1;
+	unsigned int is_zero:1;
+
 	struct port in_ports[1];
 	struct port out_ports[1];
 
@@ -121,6 +162,7 @@ static int impl_node_enum_params(void *object, int seq,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct spa_pod_frame f[2];
 	struct props *p;
 	struct spa_result_node_params result;
 	uint32_t count = 0;
@@ -154,6 +196,37 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_PROP_INFO_name, SPA_POD_String("Mute"),
 				SPA_PROP_INFO_type, SPA_POD_Bool(p->mute));
 			break;
+		case 2:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_id,   SPA_POD_Id(SPA_PROP_channelVolumes),
+				SPA_PROP_INFO_name, SPA_POD_String("Channel Volumes"),
+				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Float(p->volume, 0.0, 10.0));
+			break;
+		case 3:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_id,   SPA_POD_Id(SPA_PROP_volumeRampSamples),
+				SPA_PROP_INFO_name, SPA_POD_String("Volume Ramp Samples"),
+				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(p->ramp_samples,
+					0, INT32_MAX));
+			break;
+		case 4:
+			spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_PropInfo, id);
+			spa_pod_builder_add(&b,
+				SPA_PROP_INFO_id,     SPA_POD_Id(SPA_PROP_volumeRampScale),
+				SPA_PROP_INFO_name,   SPA_POD_String("Volume Ramp Scale"),
+				SPA_PROP_INFO_type,   SPA_POD_Int(p->ramp_scale),
+				0);
+			spa_pod_builder_prop(&b, SPA_PROP_INFO_labels, 0);
+			spa_pod_builder_push_struct(&b, &f[1]);
+			spa_pod_builder_int(&b, RAMP_SCALE_LINEAR);
+			spa_pod_builder_string(&b, "Linear");
+			spa_pod_builder_int(&b, RAMP_SCALE_LOG);
+			spa_pod_builder_string(&b, "Logarithmic");
+			spa_pod_builder_pop(&b, &f[1]);
+			param = spa_pod_builder_pop(&b, &f[0]);
+			break;
 		default:
 			return 0;
 		}
@@ -163,8 +236,14 @@ static int impl_node_enum_params(void *object, int seq,
 		case 0:
 			param = spa_pod_builder_add_object(&b,
 				SPA_TYPE_OBJECT_Props, id,
-				SPA_PROP_volume, SPA_POD_Float(p->volume),
-				SPA_PROP_mute,   SPA_POD_Bool(p->mute));
+				SPA_PROP_volume,		SPA_POD_Float(p->volume),
+				SPA_PROP_mute,			SPA_POD_Bool(p->mute),
+				SPA_PROP_channelVolumes,	SPA_POD_Array(sizeof(float),
+									SPA_TYPE_Float,
+									p->n_channel_volumes,
+									p->channel_volumes),
+				SPA_PROP_volumeRampSamples,	SPA_POD_Int(p->ramp_samples),
+				SPA_PROP_volumeRampScale,	SPA_POD_Int(p->ramp_scale));
 			break;
 		default:
 			return 0;
@@ -190,6 +269,108 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	return -ENOTSUP;
 }
 
+static void ramp_gain(struct impl *this, uint32_t pos, float *gain)
+{
+	uint32_t c;
+	float t = (float)pos / this->ramp_len;
+
+	for (c = 0; c < this->n_channels; c++) {
+		float a = this->ramp_start[c], b = this->ramp_end[c];
+
+		if (pos >= this->ramp_len)
+			gain[c] = b;
+		else if (this->ramp_scale == RAMP_SCALE_LOG) {
+			a = SPA_MAX(a, RAMP_LOG_MIN);
+			b = SPA_MAX(b, RAMP_LOG_MIN);
+			gain[c] = a * powf(b / a, t);
+		} else
+			gain[c] = a + (b - a) * t;
+	}
+}
+
+static void update_gain(struct impl *this)
+{
+	struct props *p = &this->props;
+	float target[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t c;
+	bool unity = true, zero = true;
+
+	for (c = 0; c < this->n_channels; c++) {
+		if (p->mute)
+			target[c] = 0.0f;
+		else if (c < p->n_channel_volumes)
+			target[c] = p->volume * p->channel_volumes[c];
+		else
+			target[c] = p->volume;
+		unity &= target[c] == 1.0f;
+		zero &= target[c] == 0.0f;
+	}
+
+	if (p->ramp_samples > 0 && this->started) {
+		/* start from where a running ramp is now */
+		if (this->ramp_len > 0)
+			ramp_gain(this, this->ramp_pos, this->gain);
+		memcpy(this->ramp_start, this->gain, this->n_channels * sizeof(float));
+		this->ramp_pos = 0;
+		this->ramp_len = p->ramp_samples;
+		this->ramp_scale = p->ramp_scale;
+	} else {
+		this->ramp_len = 0;
+	}
+	memcpy(this->ramp_end, target, this->n_channels * sizeof(float));
+	if (this->ramp_len == 0)
+		memcpy(this->gain, target, this->n_channels * sizeof(float));
+
+	this->is_unity = unity;
+	this->is_zero = zero;
+}
+
+static int apply_props(struct impl *this, const struct spa_pod *param)
+{
+	struct spa_pod_prop *prop;
+	struct spa_pod_object *obj = (struct spa_pod_object *) param;
+	struct props *p = &this->props;
+	int changed = 0;
+
+	SPA_POD_OBJECT_FOREACH(obj, prop) {
+		switch (prop->key) {
+		case SPA_PROP_volume:
+			if (spa_pod_get_float(&prop->value, &p->volume) == 0)
+				changed++;
+			break;
+		case SPA_PROP_mute:
+			if (spa_pod_get_bool(&prop->value, &p->mute) == 0)
+				changed++;
+			break;
+		case SPA_PROP_channelVolumes:
+		{
+			uint32_t n;
+			if ((n = spa_pod_copy_array(&prop->value, SPA_TYPE_Float,
+					p->channel_volumes, SPA_AUDIO_MAX_CHANNELS)) > 0) {
+				p->n_channel_volumes = n;
+				changed++;
+			}
+			break;
+		}
+		case SPA_PROP_volumeRampSamples:
+			if (spa_pod_get_int(&prop->value, &p->ramp_samples) == 0)
+				p->ramp_samples = SPA_MAX(p->ramp_samples, 0);
+			break;
+		case SPA_PROP_volumeRampScale:
+			spa_pod_get_int(&prop->value, &p->ramp_scale);
+			break;
+		default:
+			break;
+		}
+	}
+	/* the new gain is ramped to with the ramp settings from the
+	 * same update */
+	if (changed)
+		update_gain(this);
+
+	return changed;
+}
+
 static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 			       const struct spa_pod *param)
 {
@@ -200,16 +381,12 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	switch (id) {
 	case SPA_PARAM_Props:
 	{
-		struct props *p = &this->props;
-
 		if (param == NULL) {
-			reset_props(p);
+			reset_props(&this->props);
+			update_gain(this);
 			return 0;
 		}
-		spa_pod_parse_object(param,
-			SPA_TYPE_OBJECT_Props, NULL,
-			SPA_PROP_volume, SPA_POD_OPT_Float(&p->volume),
-			SPA_PROP_mute,   SPA_POD_OPT_Bool(&p->mute));
+		apply_props(this, param);
 		break;
 	}
 	default:
@@ -316,9 +493,9 @@ static int port_enum_formats(void *object,
 			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
 			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
 			SPA_FORMAT_AUDIO_format,   SPA_POD_CHOICE_ENUM_Id(3,
-							SPA_AUDIO_FORMAT_S16,
-							SPA_AUDIO_FORMAT_S16,
-							SPA_AUDIO_FORMAT_S32),
+							SPA_AUDIO_FORMAT_F32,
+							SPA_AUDIO_FORMAT_F32,
+							SPA_AUDIO_FORMAT_S16),
 			SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(44100, 1, INT32_MAX),
 			SPA_FORMAT_AUDIO_channels, SPA_POD_CHOICE_RANGE_Int(2, 1, INT32_MAX));
 		break;
@@ -465,9 +642,27 @@ static int port_set_format(void *object,
 		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
 			return -EINVAL;
 
-		this->bpf = 2 * info.info.raw.channels;
+		if (info.info.raw.channels == 0 ||
+		    info.info.raw.channels > SPA_AUDIO_MAX_CHANNELS)
+			return -EINVAL;
+
+		this->ops.fmt = info.info.raw.format;
+		this->ops.n_channels = info.info.raw.channels;
+		this->ops.cpu_flags = this->cpu_flags;
+		if ((res = volume_ops_init(&this->ops)) < 0)
+			return res;
+
+		spa_log_debug(this->log, NAME " %p: got volume features %08x:%08x",
+				this, this->cpu_flags, this->ops.cpu_flags);
+
+		this->bpf = (info.info.raw.format == SPA_AUDIO_FORMAT_S16 ?
+				sizeof(int16_t) : sizeof(float)) * info.info.raw.channels;
+		this->n_channels = info.info.raw.channels;
 		this->current_format = info;
 		port->have_format = true;
+
+		this->ramp_len = 0;
+		update_gain(this);
 	}
 
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
@@ -532,7 +727,7 @@ impl_node_port_use_buffers(void *object,
 		b->flags = direction == SPA_DIRECTION_INPUT ? BUFFER_FLAG_OUT : 0;
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
 
-		if (d[0].data == NULL) {
+		if (d[0].data != NULL) {
 			b->ptr = d[0].data;
 			b->size = d[0].maxsize;
 		} else {
@@ -621,16 +816,66 @@ static struct buffer *find_free_buffer(struct impl *this, struct port *port)
 	return b;
 }
 
+static void process_frames(struct impl *this, void *dst, const void *src, uint32_t n_frames)
+{
+	float gain[SPA_AUDIO_MAX_CHANNELS], end[SPA_AUDIO_MAX_CHANNELS];
+	float step[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t c, chunk;
+
+	while (n_frames > 0) {
+		if (this->ramp_len > 0) {
+			chunk = SPA_MIN(n_frames, RAMP_BLOCK);
+			chunk = SPA_MIN(chunk, this->ramp_len - this->ramp_pos);
+
+			ramp_gain(this, this->ramp_pos, gain);
+			ramp_gain(this, this->ramp_pos + chunk, end);
+			for (c = 0; c < this->n_channels; c++)
+				step[c] = (end[c] - gain[c]) / chunk;
+
+			this->ramp_pos += chunk;
+			if (this->ramp_pos >= this->ramp_len) {
+				this->ramp_len = 0;
+				memcpy(this->gain, this->ramp_end, this->n_channels * sizeof(float));
+			}
+			volume_ops_process(&this->ops, dst, src, gain, step, chunk);
+		} else {
+			chunk = n_frames;
+			if (this->is_unity) {
+				if (dst != src)
+					memcpy(dst, src, chunk * this->bpf);
+			} else if (this->is_zero) {
+				memset(dst, 0, chunk * this->bpf);
+			} else {
+				memset(step, 0, this->n_channels * sizeof(float));
+				volume_ops_process(&this->ops, dst, src, this->gain, step, chunk);
+			}
+		}
+		dst = SPA_MEMBER(dst, chunk * this->bpf, void);
+		src = SPA_MEMBER(src, chunk * this->bpf, void);
+		n_frames -= chunk;
+	}
+}
+
+static void skip_frames(struct impl *this, uint32_t n_frames)
+{
+	if (this->ramp_len == 0)
+		return;
+
+	this->ramp_pos += n_frames;
+	if (this->ramp_pos >= this->ramp_len) {
+		this->ramp_len = 0;
+		memcpy(this->gain, this->ramp_end, this->n_channels * sizeof(float));
+	}
+}
+
 static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf)
 {
-	uint32_t i, n_samples, n_bytes;
+	uint32_t n_bytes;
 	struct spa_data *sd, *dd;
-	int16_t *src, *dst;
-	double volume;
+	void *src, *dst;
 	uint32_t written, towrite, savail, davail;
 	uint32_t sindex, dindex;
-
-	volume = this->props.volume;
+	bool is_empty, is_zero;
 
 	sd = sbuf->datas;
 	dd = dbuf->datas;
@@ -642,21 +887,31 @@ static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buf
 	davail = dd[0].maxsize - davail;
 
 	towrite = SPA_MIN(savail, davail);
+	towrite -= towrite % this->bpf;
 	written = 0;
 
+	is_empty = SPA_FLAG_IS_SET(sd[0].chunk->flags, SPA_CHUNK_FLAG_EMPTY);
+	is_zero = this->is_zero && this->ramp_len == 0;
+
 	while (written < towrite) {
 		uint32_t soffset = sindex % sd[0].maxsize;
 		uint32_t doffset = dindex % dd[0].maxsize;
 
-		src = SPA_MEMBER(sd[0].data, soffset, int16_t);
-		dst = SPA_MEMBER(dd[0].data, doffset, int16_t);
+		src = SPA_MEMBER(sd[0].data, soffset, void);
+		dst = SPA_MEMBER(dd[0].data, doffset, void);
 
-		n_bytes = SPA_MIN(towrite, sd[0].maxsize - soffset);
+		n_bytes = SPA_MIN(towrite - written, sd[0].maxsize - soffset);
 		n_bytes = SPA_MIN(n_bytes, dd[0].maxsize - doffset);
+		n_bytes -= n_bytes % this->bpf;
+		if (n_bytes == 0)
+			break;
 
-		n_samples = n_bytes / sizeof(int16_t);
-		for (i = 0; i < n_samples; i++)
-			dst[i] = src[i] * volume;
+		if (is_empty) {
+			memset(dst, 0, n_bytes);
+			skip_frames(this, n_bytes / this->bpf);
+		} else {
+			process_frames(this, dst, src, n_bytes / this->bpf);
+		}
 
 		sindex += n_bytes;
 		dindex += n_bytes;
@@ -665,6 +920,7 @@ static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buf
 	dd[0].chunk->offset = 0;
 	dd[0].chunk->size = written;
 	dd[0].chunk->stride = 0;
+	dd[0].chunk->flags = is_empty || is_zero ? SPA_CHUNK_FLAG_EMPTY : 0;
 }
 
 static int impl_node_process(void *object)
@@ -788,7 +1044,11 @@ impl_init(const struct spa_handle_factory *factory,
 	for (i = 0; i < n_support; i++) {
 		if (support[i].type == SPA_TYPE_INTERFACE_Log)
 			this->log = support[i].data;
+		else if (support[i].type == SPA_TYPE_INTERFACE_CPU)
+			this->cpu = support[i].data;
 	}
+	if (this->cpu)
+		this->cpu_flags = spa_cpu_get_flags(this->cpu);
 
 	spa_hook_list_init(&this->hooks);
 
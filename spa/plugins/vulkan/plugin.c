@@ -27,6 +27,8 @@
 #include <spa/support/plugin.h>
 
 extern const struct spa_handle_factory spa_vulkan_compute_source_factory;
+extern const struct spa_handle_factory spa_vulkan_compute_filter_factory;
+extern const struct spa_handle_factory spa_vulkan_audio_convolver_factory;
 
 SPA_EXPORT
 int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
@@ -38,6 +40,12 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 	case 0:
 		*factory = &spa_vulkan_compute_source_factory;
 		break;
+	case 1:
+		*factory = &spa_vulkan_compute_filter_factory;
+		break;
+	case 2:
+		*factory = &spa_vulkan_audio_convolver_factory;
+		break;
 	default:
 		return 0;
 	}
@@ -0,0 +1,1002 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/log.h>
+#include <spa/utils/list.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/node/io.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/param.h>
+#include <spa/pod/filter.h>
+
+#include "vulkan-utils.h"
+
+#define NAME "vulkan-audio-convolver"
+
+#define DEFAULT_CONVOLVE_SHADER	"spa/plugins/vulkan/shaders/convolve.spv"
+#define DEFAULT_RATE		48000
+#define DEFAULT_CHANNELS	2
+#define DEFAULT_BATCH		4096
+#define MAX_CHANNELS		64
+#define MAX_TAPS		(1 << 20)
+#define MAX_SAMPLES		8192
+#define MAX_BATCH		(1 << 16)
+
+/* the GPU works on one batch while the next one is collected, the
+ * buffers are used in turn */
+#define N_BATCH_BUFFERS		2
+
+struct buffer {
+	uint32_t id;
+#define BUFFER_FLAG_OUT (1<<0)
+	uint32_t flags;
+	struct spa_buffer *outbuf;
+	struct spa_list link;
+};
+
+struct port {
+	uint64_t info_all;
+	struct spa_port_info info;
+	enum spa_direction direction;
+	struct spa_param_info params[5];
+
+	struct spa_io_buffers *io;
+	struct spa_io_latency *latency;
+
+	bool have_format;
+	struct spa_audio_info format;
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+
+	struct spa_list empty;
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct spa_log *log;
+
+	uint64_t info_all;
+	struct spa_node_info info;
+
+	struct spa_hook_list hooks;
+	struct spa_callbacks callbacks;
+
+	bool started;
+
+	char shader[256];
+	uint32_t channels;
+	uint32_t batch;
+	uint32_t taps;
+	float *ir;			/* taps of all channels, planar */
+
+	struct vulkan_state state;
+	uint32_t current;		/* batch buffer that is filled and read */
+	uint32_t pos;			/* samples in the current batch */
+	bool have_buffers;
+
+	struct port port[2];
+};
+
+#define CHECK_PORT(this,d,p)  ((p) == 0)
+#define GET_PORT(this,d,p)    (&this->port[d])
+
+/* floats between the start of the buffer and the history of channel 0 */
+#define HISTORY_OFFSET(this)	((this)->channels * (this)->taps)
+/* history and new samples of one channel */
+#define HISTORY_SIZE(this)	((this)->taps - 1 + (this)->batch)
+
+static float *in_samples(struct impl *this, uint32_t buffer, uint32_t channel)
+{
+	float *d = this->state.in_buffers[buffer].ptr;
+	return d + HISTORY_OFFSET(this) + channel * HISTORY_SIZE(this);
+}
+
+static float *out_samples(struct impl *this, uint32_t buffer, uint32_t channel)
+{
+	float *d = this->state.buffers[buffer].ptr;
+	return d + channel * this->batch;
+}
+
+/* the added latency is the batch that is collected and the batch that
+ * is processed meanwhile */
+static void update_latency(struct impl *this, struct port *port)
+{
+	struct spa_io_latency *l = port->latency;
+
+	if (l == NULL || !port->have_format)
+		return;
+
+	l->rate = SPA_FRACTION(1, port->format.info.raw.rate);
+	l->min = l->max = N_BATCH_BUFFERS * this->batch;
+}
+
+static int load_ir(struct impl *this, const char *filename)
+{
+	struct stat st;
+	ssize_t size;
+	int fd, res;
+
+	if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0) {
+		res = -errno;
+		spa_log_error(this->log, NAME " %p: can't open %s: %m", this, filename);
+		return res;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto exit;
+	}
+	this->taps = st.st_size / (sizeof(float) * this->channels);
+	if (this->taps == 0 || this->taps > MAX_TAPS) {
+		spa_log_error(this->log, NAME " %p: %s: invalid size %" PRIi64 " for %d channels",
+				this, filename, (int64_t)st.st_size, this->channels);
+		res = -EINVAL;
+		goto exit;
+	}
+	size = this->taps * this->channels * sizeof(float);
+	if ((this->ir = malloc(size)) == NULL) {
+		res = -errno;
+		goto exit;
+	}
+	if (read(fd, this->ir, size) != size) {
+		res = -EIO;
+		free(this->ir);
+		this->ir = NULL;
+		goto exit;
+	}
+	res = 0;
+exit:
+	close(fd);
+	return res;
+}
+
+static int alloc_batch_buffers(struct impl *this)
+{
+	uint32_t i;
+	int res;
+
+	if (this->have_buffers)
+		return 0;
+
+	this->state.constants.frame = this->taps;
+	this->state.constants.width = this->batch;
+	this->state.constants.height = this->channels;
+
+	if ((res = spa_vulkan_prepare(&this->state)) < 0)
+		return res;
+
+	if ((res = spa_vulkan_alloc_host_buffers(&this->state, N_BATCH_BUFFERS,
+			this->channels * this->batch * sizeof(float),
+			(HISTORY_OFFSET(this) + this->channels * HISTORY_SIZE(this)) *
+				sizeof(float))) < 0)
+		return res;
+
+	for (i = 0; i < N_BATCH_BUFFERS; i++)
+		memcpy(this->state.in_buffers[i].ptr, this->ir,
+				HISTORY_OFFSET(this) * sizeof(float));
+
+	this->have_buffers = true;
+	return 0;
+}
+
+static void free_batch_buffers(struct impl *this)
+{
+	if (!this->have_buffers)
+		return;
+	spa_vulkan_use_buffers(&this->state, 0, 0, NULL);
+	spa_vulkan_use_input_buffers(&this->state, 0, 0, NULL);
+	spa_vulkan_unprepare(&this->state);
+	this->have_buffers = false;
+}
+
+static void reset_batch_buffers(struct impl *this)
+{
+	uint32_t i, c;
+
+	for (i = 0; i < N_BATCH_BUFFERS; i++) {
+		for (c = 0; c < this->channels; c++) {
+			memset(in_samples(this, i, c), 0, HISTORY_SIZE(this) * sizeof(float));
+			memset(out_samples(this, i, c), 0, this->batch * sizeof(float));
+		}
+	}
+	this->current = 0;
+	this->pos = 0;
+}
+
+/* the current batch is complete, give it to the GPU and continue with the
+ * batch that was submitted before it, its result is read while the new
+ * samples are collected */
+static int flush_batch(struct impl *this)
+{
+	struct vulkan_state *s = &this->state;
+	uint32_t c, prev = this->current;
+	int res;
+
+	if ((res = spa_vulkan_process(s, prev, prev)) < 0)
+		return res;
+
+	this->current = (prev + 1) % N_BATCH_BUFFERS;
+	this->pos = 0;
+
+	/* when the GPU is slower than realtime this blocks */
+	if (s->n_busy >= N_BATCH_BUFFERS &&
+	    (res = spa_vulkan_wait(s)) < 0)
+		return res;
+	s->ready_buffer_id = SPA_ID_INVALID;
+
+	/* the last taps - 1 samples are the history of the next batch */
+	for (c = 0; c < this->channels; c++)
+		memcpy(in_samples(this, this->current, c),
+			in_samples(this, prev, c) + this->batch,
+			(this->taps - 1) * sizeof(float));
+
+	return 0;
+}
+
+static int impl_node_enum_params(void *object, int seq,
+				 uint32_t id, uint32_t start, uint32_t num,
+				 const struct spa_pod *filter)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_send_command(void *object, const struct spa_command *command)
+{
+	struct impl *this = object;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (!this->port[0].have_format || !this->port[1].have_format)
+			return -EIO;
+		if (this->port[0].n_buffers == 0 || this->port[1].n_buffers == 0)
+			return -EIO;
+
+		if (this->started)
+			return 0;
+
+		if ((res = alloc_batch_buffers(this)) < 0) {
+			spa_log_error(this->log, NAME " %p: can't allocate GPU buffers: %s",
+					this, spa_strerror(res));
+			return res;
+		}
+		reset_batch_buffers(this);
+		spa_vulkan_start(&this->state);
+		this->started = true;
+		break;
+
+	case SPA_NODE_COMMAND_Suspend:
+	case SPA_NODE_COMMAND_Pause:
+		if (!this->started)
+			return 0;
+
+		this->started = false;
+		spa_vulkan_stop(&this->state);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static void emit_node_info(struct impl *this, bool full)
+{
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = 0;
+	}
+}
+
+static void emit_port_info(struct impl *this, struct port *port, bool full)
+{
+	if (full)
+		port->info.change_mask = port->info_all;
+	if (port->info.change_mask) {
+		spa_node_emit_port_info(&this->hooks,
+				port->direction, 0, &port->info);
+		port->info.change_mask = 0;
+	}
+}
+
+static int
+impl_node_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct impl *this = object;
+	struct spa_hook_list save;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_hook_list_isolate(&this->hooks, &save, listener, events, data);
+
+	emit_node_info(this, true);
+	emit_port_info(this, &this->port[0], true);
+	emit_port_info(this, &this->port[1], true);
+
+	spa_hook_list_join(&this->hooks, &save);
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(void *object,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	this->callbacks = SPA_CALLBACKS_INIT(callbacks, data);
+
+	return 0;
+}
+
+static int impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int port_enum_formats(void *object,
+			     enum spa_direction direction, uint32_t port_id,
+			     uint32_t index,
+			     struct spa_pod **param,
+			     struct spa_pod_builder *builder)
+{
+	struct impl *this = object;
+	struct port *other = GET_PORT(this, SPA_DIRECTION_REVERSE(direction), port_id);
+
+	switch (index) {
+	case 0:
+		if (other->have_format) {
+			*param = spa_pod_builder_add_object(builder,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
+				SPA_FORMAT_AUDIO_rate,     SPA_POD_Int(other->format.info.raw.rate),
+				SPA_FORMAT_AUDIO_channels, SPA_POD_Int(this->channels));
+		} else {
+			*param = spa_pod_builder_add_object(builder,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+				SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
+				SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(DEFAULT_RATE, 1, INT32_MAX),
+				SPA_FORMAT_AUDIO_channels, SPA_POD_Int(this->channels));
+		}
+		break;
+	default:
+		return 0;
+	}
+	return 1;
+}
+
+static int
+impl_node_port_enum_params(void *object, int seq,
+			enum spa_direction direction, uint32_t port_id,
+			uint32_t id, uint32_t start, uint32_t num,
+			const struct spa_pod *filter)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = GET_PORT(this, direction, port_id);
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		if ((res = port_enum_formats(this, direction, port_id,
+						result.index, &param, &b)) <= 0)
+			return res;
+		break;
+
+	case SPA_PARAM_Format:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_format_audio_raw_build(&b, id, &port->format.info.raw);
+		break;
+
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(1, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(this->channels),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+							MAX_SAMPLES * sizeof(float),
+							16 * sizeof(float),
+							INT32_MAX),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(sizeof(float)),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Latency),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_latency)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		if (this->started) {
+			spa_vulkan_stop(&this->state);
+			this->started = false;
+		}
+		port->n_buffers = 0;
+		spa_list_init(&port->empty);
+	}
+	return 0;
+}
+
+static int port_set_format(struct impl *this, struct port *port,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	struct port *other = GET_PORT(this, SPA_DIRECTION_REVERSE(port->direction), 0);
+	int res;
+
+	if (format == NULL) {
+		port->have_format = false;
+		clear_buffers(this, port);
+		if (!other->have_format)
+			free_batch_buffers(this);
+	} else {
+		struct spa_audio_info info = { 0 };
+
+		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
+			return res;
+
+		if (info.media_type != SPA_MEDIA_TYPE_audio ||
+		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+			return -EINVAL;
+
+		if (spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+			return -EINVAL;
+
+		if (info.info.raw.format != SPA_AUDIO_FORMAT_F32P ||
+		    info.info.raw.channels != this->channels)
+			return -EINVAL;
+
+		if (other->have_format &&
+		    info.info.raw.rate != other->format.info.raw.rate)
+			return -EINVAL;
+
+		port->format = info;
+		port->have_format = true;
+		update_latency(this, port);
+	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(void *object,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this = object;
+	struct port *port;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = GET_PORT(this, direction, port_id);
+
+	switch (id) {
+	case SPA_PARAM_Format:
+		res = port_set_format(this, port, flags, param);
+		break;
+	default:
+		return -ENOENT;
+	}
+	return res;
+}
+
+static int
+impl_node_port_use_buffers(void *object,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t flags,
+			   struct spa_buffer **buffers,
+			   uint32_t n_buffers)
+{
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i, j;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		if (buffers[i]->n_datas != this->channels)
+			return -EINVAL;
+		for (j = 0; j < buffers[i]->n_datas; j++) {
+			if (buffers[i]->datas[j].data == NULL) {
+				spa_log_error(this->log, NAME " %p: invalid memory on buffer %d",
+						this, i);
+				return -EINVAL;
+			}
+		}
+		b->id = i;
+		b->outbuf = buffers[i];
+		b->flags = 0;
+
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_set_io(void *object,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t id,
+		      void *data, size_t size)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+	port = GET_PORT(this, direction, port_id);
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		port->io = data;
+		break;
+	case SPA_IO_Latency:
+		port->latency = data;
+		update_latency(this, port);
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static inline void reuse_buffer(struct impl *this, struct port *port, uint32_t id)
+{
+	struct buffer *b = &port->buffers[id];
+
+	if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT)) {
+		spa_log_trace_fp(this->log, NAME " %p: reuse buffer %d", this, id);
+
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUT);
+		spa_list_append(&port->empty, &b->link);
+	}
+}
+
+static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(port_id == 0, -EINVAL);
+	port = GET_PORT(this, SPA_DIRECTION_OUTPUT, port_id);
+	spa_return_val_if_fail(buffer_id < port->n_buffers, -EINVAL);
+
+	reuse_buffer(this, port, buffer_id);
+
+	return 0;
+}
+
+static int impl_node_process(void *object)
+{
+	struct impl *this = object;
+	struct port *inport, *outport;
+	struct spa_io_buffers *inio, *outio;
+	struct spa_buffer *sb, *db;
+	struct buffer *b;
+	uint32_t c, n_samples, done, chunk;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	inport = GET_PORT(this, SPA_DIRECTION_INPUT, 0);
+	outport = GET_PORT(this, SPA_DIRECTION_OUTPUT, 0);
+	inio = inport->io;
+	outio = outport->io;
+	spa_return_val_if_fail(inio != NULL, -EIO);
+	spa_return_val_if_fail(outio != NULL, -EIO);
+
+	if (outio->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (outio->buffer_id < outport->n_buffers) {
+		reuse_buffer(this, outport, outio->buffer_id);
+		outio->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (inio->status != SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_NEED_DATA;
+
+	if (!this->started)
+		return -EIO;
+
+	if (inio->buffer_id >= inport->n_buffers)
+		return inio->status = -EINVAL;
+
+	if (spa_list_is_empty(&outport->empty))
+		return outio->status = -EPIPE;
+
+	b = spa_list_first(&outport->empty, struct buffer, link);
+	spa_list_remove(&b->link);
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+
+	sb = inport->buffers[inio->buffer_id].outbuf;
+	db = b->outbuf;
+
+	n_samples = sb->datas[0].chunk->size / sizeof(float);
+	n_samples = SPA_MIN(n_samples, db->datas[0].maxsize / sizeof(float));
+
+	/* copy into the batch that is collected and out of the result of
+	 * the batch before it, in pieces that end on a batch boundary */
+	for (done = 0; done < n_samples; done += chunk) {
+		chunk = SPA_MIN(n_samples - done, this->batch - this->pos);
+
+		for (c = 0; c < this->channels; c++) {
+			const float *src = SPA_MEMBER(sb->datas[c].data,
+					sb->datas[c].chunk->offset, float);
+
+			memcpy(in_samples(this, this->current, c) + this->taps - 1 + this->pos,
+					src + done, chunk * sizeof(float));
+			memcpy((float*)db->datas[c].data + done,
+					out_samples(this, this->current, c) + this->pos,
+					chunk * sizeof(float));
+		}
+		this->pos += chunk;
+
+		if (this->pos == this->batch &&
+		    (res = flush_batch(this)) < 0) {
+			spa_log_error(this->log, NAME " %p: can't process batch: %s",
+					this, spa_strerror(res));
+			spa_list_append(&outport->empty, &b->link);
+			SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUT);
+			return res;
+		}
+	}
+	for (c = 0; c < this->channels; c++) {
+		db->datas[c].chunk->offset = 0;
+		db->datas[c].chunk->size = n_samples * sizeof(float);
+		db->datas[c].chunk->stride = sizeof(float);
+	}
+
+	outio->buffer_id = b->id;
+	outio->status = SPA_STATUS_HAVE_DATA;
+	inio->status = SPA_STATUS_NEED_DATA;
+
+	return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_node_add_listener,
+	.set_callbacks = impl_node_set_callbacks,
+	.enum_params = impl_node_enum_params,
+	.set_param = impl_node_set_param,
+	.set_io = impl_node_set_io,
+	.send_command = impl_node_send_command,
+	.add_port = impl_node_add_port,
+	.remove_port = impl_node_remove_port,
+	.port_enum_params = impl_node_port_enum_params,
+	.port_set_param = impl_node_port_set_param,
+	.port_use_buffers = impl_node_port_use_buffers,
+	.port_set_io = impl_node_port_set_io,
+	.port_reuse_buffer = impl_node_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t type, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (type == SPA_TYPE_INTERFACE_Node)
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (this->started)
+		spa_vulkan_stop(&this->state);
+	free_batch_buffers(this);
+	free(this->ir);
+
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static void init_port(struct port *port, enum spa_direction direction)
+{
+	port->direction = direction;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = SPA_PORT_FLAG_NO_REF;
+	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->info.params = port->params;
+	port->info.n_params = 5;
+	spa_list_init(&port->empty);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	const char *str;
+	uint32_t i;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		if (support[i].type == SPA_TYPE_INTERFACE_Log)
+			this->log = support[i].data;
+	}
+
+	this->channels = DEFAULT_CHANNELS;
+	this->batch = DEFAULT_BATCH;
+	snprintf(this->shader, sizeof(this->shader), "%s", DEFAULT_CONVOLVE_SHADER);
+
+	if (info && (str = spa_dict_lookup(info, "audio.channels")) != NULL)
+		this->channels = atoi(str);
+	if (info && (str = spa_dict_lookup(info, "convolver.batch")) != NULL)
+		this->batch = atoi(str);
+	if (info && (str = spa_dict_lookup(info, "vulkan.shader")) != NULL)
+		snprintf(this->shader, sizeof(this->shader), "%s", str);
+
+	if (this->channels == 0 || this->channels > MAX_CHANNELS) {
+		spa_log_error(this->log, NAME " %p: invalid channels %d", this, this->channels);
+		return -EINVAL;
+	}
+	if (this->batch == 0 || this->batch > MAX_BATCH) {
+		spa_log_error(this->log, NAME " %p: invalid batch %d", this, this->batch);
+		return -EINVAL;
+	}
+	if (info == NULL || (str = spa_dict_lookup(info, "convolver.ir")) == NULL) {
+		spa_log_error(this->log, NAME " %p: no convolver.ir given", this);
+		return -EINVAL;
+	}
+	if ((res = load_ir(this, str)) < 0)
+		return res;
+
+	spa_hook_list_init(&this->hooks);
+
+	this->node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, this);
+
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS;
+	this->info = SPA_NODE_INFO_INIT();
+	this->info.max_input_ports = 1;
+	this->info.max_output_ports = 1;
+	this->info.flags = SPA_NODE_FLAG_RT;
+
+	init_port(&this->port[SPA_DIRECTION_INPUT], SPA_DIRECTION_INPUT);
+	init_port(&this->port[SPA_DIRECTION_OUTPUT], SPA_DIRECTION_OUTPUT);
+
+	this->state.log = this->log;
+	this->state.shaderName = this->shader;
+	this->state.has_input = true;
+
+	spa_log_info(this->log, NAME " %p: %d channels, %d taps, batch %d",
+			this, this->channels, this->taps, this->batch);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+	return 1;
+}
+
+static const struct spa_dict_item info_items[] = {
+	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ SPA_KEY_FACTORY_DESCRIPTION, "Convolve audio with an impulse response on the GPU" },
+};
+
+static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
+
+const struct spa_handle_factory spa_vulkan_audio_convolver_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_API_VULKAN_AUDIO_CONVOLVER,
+	&info,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info,
+};
@@ -27,6 +27,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <poll.h>
 #include <sys/timerfd.h>
 
 #include <spa/support/plugin.h>
@@ -68,6 +69,7 @@ struct buffer {
 	uint32_t flags;
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
+	struct spa_meta_sync_fence *sync;
 	struct spa_list link;
 };
 
@@ -258,57 +260,109 @@ static void read_timer(struct impl *this)
 	}
 }
 
+static void close_fd(int32_t *fd)
+{
+	if (*fd >= 0)
+		close(*fd);
+	*fd = -1;
+}
+
+/* check the release fence of a buffer that the consumer recycled while
+ * it was still reading it */
+static bool buffer_released(struct buffer *b)
+{
+	struct pollfd pfd;
+
+	if (b->sync == NULL || b->sync->release_fd < 0)
+		return true;
+
+	pfd.fd = b->sync->release_fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, 0) == 0)
+		return false;
+
+	close_fd(&b->sync->release_fd);
+	return true;
+}
+
+static void queue_buffer(struct impl *this, struct port *port, struct buffer *b)
+{
+	b->outbuf->datas[0].chunk->offset = 0;
+	b->outbuf->datas[0].chunk->size = b->outbuf->datas[0].maxsize;
+	b->outbuf->datas[0].chunk->stride = port->stride;
+
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
+	spa_list_append(&port->ready, &b->link);
+}
+
 static int make_buffer(struct impl *this)
 {
-	struct buffer *b;
+	struct buffer *b, *fenced = NULL;
 	struct port *port = &this->port;
-	uint32_t n_bytes;
-	int res;
+	int res, fd;
 
 	read_timer(this);
 
-	if ((res = spa_vulkan_ready(&this->state)) < 0) {
+	/* frames are rendered in the order they are submitted, collect the
+	 * oldest one when it is complete */
+	if ((res = spa_vulkan_ready(&this->state)) < 0 &&
+	    !spa_vulkan_can_process(&this->state)) {
 		res = SPA_STATUS_OK;
 		goto next;
 	}
+	res = SPA_STATUS_OK;
+
+	if (spa_vulkan_can_process(&this->state)) {
+		if (spa_list_is_empty(&port->empty)) {
+			if (this->state.n_busy == 0 &&
+			    this->state.ready_buffer_id == SPA_ID_INVALID) {
+				set_timer(this, false);
+				spa_log_error(this->log, NAME " %p: out of buffers", this);
+				return -EPIPE;
+			}
+		} else if (buffer_released(spa_list_first(&port->empty, struct buffer, link))) {
+			b = spa_list_first(&port->empty, struct buffer, link);
+			spa_list_remove(&b->link);
 
-	if (spa_list_is_empty(&port->empty)) {
-		set_timer(this, false);
-		spa_log_error(this->log, NAME " %p: out of buffers", this);
-		return -EPIPE;
-	}
-	b = spa_list_first(&port->empty, struct buffer, link);
-	spa_list_remove(&b->link);
-
-	n_bytes = b->outbuf->datas[0].maxsize;
-
-	spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->id);
+			spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->id);
 
-	this->state.constants.time = this->elapsed_time / (float) SPA_NSEC_PER_SEC;
-	this->state.constants.frame = this->frame_count;
+			if (b->h) {
+				b->h->seq = this->frame_count;
+				b->h->pts = this->start_time + this->elapsed_time;
+				b->h->dts_offset = 0;
+			}
 
-	spa_vulkan_process(&this->state, b->id);
+			this->state.constants.time = this->elapsed_time / (float) SPA_NSEC_PER_SEC;
+			this->state.constants.frame = this->frame_count;
+
+			if (spa_vulkan_process(&this->state, b->id, SPA_ID_INVALID) >= 0 &&
+			    b->sync != NULL) {
+				/* queue the frame now, the consumer waits for
+				 * the fence on the GPU */
+				fd = spa_vulkan_export_fence(&this->state);
+				if (fd >= 0 || fd == -EALREADY) {
+					b->sync->acquire_fd = fd >= 0 ? fd : -1;
+					fenced = b;
+				}
+			}
+		}
+	}
 
 	if (this->state.ready_buffer_id != SPA_ID_INVALID) {
-		struct buffer *b = &port->buffers[this->state.ready_buffer_id];
+		b = &port->buffers[this->state.ready_buffer_id];
 
 		this->state.ready_buffer_id = SPA_ID_INVALID;
 
 		spa_log_trace(this->log, NAME " %p: ready buffer %d", this, b->id);
 
-		b->outbuf->datas[0].chunk->offset = 0;
-		b->outbuf->datas[0].chunk->size = n_bytes;
-		b->outbuf->datas[0].chunk->stride = port->stride;
-
-		if (b->h) {
-			b->h->seq = this->frame_count;
-			b->h->pts = this->start_time + this->elapsed_time;
-			b->h->dts_offset = 0;
-		}
-
-		SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUT);
-		spa_list_append(&port->ready, &b->link);
+		queue_buffer(this, port, b);
+		res = SPA_STATUS_HAVE_DATA;
+	}
+	if (fenced != NULL) {
+		spa_log_trace(this->log, NAME " %p: fenced buffer %d fd:%d", this,
+				fenced->id, fenced->sync->acquire_fd);
 
+		queue_buffer(this, port, fenced);
 		res = SPA_STATUS_HAVE_DATA;
 	}
 next:
@@ -326,6 +380,10 @@ static inline void reuse_buffer(struct impl *this, struct port *port, uint32_t i
 	if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUT)) {
 		spa_log_trace(this->log, NAME " %p: reuse buffer %d", this, id);
 
+		/* the consumer should have taken the fence */
+		if (b->sync)
+			close_fd(&b->sync->acquire_fd);
+
 		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUT);
 		spa_list_append(&port->empty, &b->link);
 
@@ -334,6 +392,23 @@ static inline void reuse_buffer(struct impl *this, struct port *port, uint32_t i
 	}
 }
 
+/* take back the buffers of the frames that were still in flight */
+static void drain_buffers(struct impl *this)
+{
+	struct port *port = &this->port;
+	struct vulkan_state *s = &this->state;
+
+	while (true) {
+		if (s->ready_buffer_id != SPA_ID_INVALID) {
+			struct buffer *b = &port->buffers[s->ready_buffer_id];
+			spa_list_append(&port->empty, &b->link);
+			s->ready_buffer_id = SPA_ID_INVALID;
+		}
+		if (s->n_busy == 0 || spa_vulkan_ready(s) < 0)
+			break;
+	}
+}
+
 static void on_output(struct spa_source *source)
 {
 	struct impl *this = source->data;
@@ -408,6 +483,7 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 		this->started = false;
 		set_timer(this, false);
 		spa_vulkan_stop(&this->state);
+		drain_buffers(this);
 		break;
 	default:
 		return -ENOTSUP;
@@ -592,6 +668,12 @@ impl_node_port_enum_params(void *object, int seq,
 				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
 				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
 			break;
+		case 1:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_SyncFence),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_sync_fence)));
+			break;
 
 		default:
 			return 0;
@@ -614,8 +696,17 @@ impl_node_port_enum_params(void *object, int seq,
 
 static int clear_buffers(struct impl *this, struct port *port)
 {
+	uint32_t i;
+
 	if (port->n_buffers > 0) {
 		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		for (i = 0; i < port->n_buffers; i++) {
+			struct buffer *b = &port->buffers[i];
+			if (b->sync) {
+				close_fd(&b->sync->acquire_fd);
+				close_fd(&b->sync->release_fd);
+			}
+		}
 		spa_vulkan_use_buffers(&this->state, 0, 0, NULL);
 		port->n_buffers = 0;
 		spa_list_init(&port->empty);
@@ -730,6 +821,11 @@ impl_node_port_use_buffers(void *object,
 		b->outbuf = buffers[i];
 		b->flags = 0;
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+		b->sync = spa_buffer_find_meta_data(buffers[i], SPA_META_SyncFence, sizeof(*b->sync));
+		if (b->sync) {
+			b->sync->acquire_fd = -1;
+			b->sync->release_fd = -1;
+		}
 
 		spa_list_append(&port->empty, &b->link);
 	}
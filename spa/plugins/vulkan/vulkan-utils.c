@@ -5,6 +5,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <string.h>
 #include <alloca.h>
 #include <errno.h>
@@ -22,6 +23,9 @@
 #define VULKAN_INSTANCE_FUNCTION(name)						\
 	PFN_##name name = (PFN_##name)vkGetInstanceProcAddr(s->instance, #name)
 
+#define VULKAN_DEVICE_FUNCTION(name)						\
+	PFN_##name name = (PFN_##name)vkGetDeviceProcAddr(s->device, #name)
+
 static int vkresult_to_errno(VkResult result)
 {
 	switch (result) {
@@ -162,6 +166,23 @@ static int findPhysicalDevice(struct vulkan_state *s)
 	return 0;
 }
 
+static bool hasDeviceExtension(struct vulkan_state *s, const char *name)
+{
+	VkExtensionProperties *props;
+	uint32_t i, count = 0;
+
+	if (vkEnumerateDeviceExtensionProperties(s->physicalDevice, NULL, &count, NULL) != VK_SUCCESS)
+		return false;
+	props = alloca(count * sizeof(*props));
+	if (vkEnumerateDeviceExtensionProperties(s->physicalDevice, NULL, &count, props) != VK_SUCCESS)
+		return false;
+	for (i = 0; i < count; i++) {
+		if (strcmp(props[i].extensionName, name) == 0)
+			return true;
+	}
+	return false;
+}
+
 static int createDevice(struct vulkan_state *s)
 {
 	VkDeviceQueueCreateInfo queueCreateInfo = {
@@ -172,26 +193,29 @@ static int createDevice(struct vulkan_state *s)
 	};
 	const char *extensions[] = {
 		VK_KHR_EXTERNAL_MEMORY_EXTENSION_NAME,
-		VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME
+		VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+		VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+		/* optional, must stay last */
+		VK_KHR_EXTERNAL_FENCE_EXTENSION_NAME,
+		VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME,
 	};
 	VkDeviceCreateInfo deviceCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
 		.queueCreateInfoCount = 1,
 		.pQueueCreateInfos = &queueCreateInfo,
-		.enabledExtensionCount = 2,
+		.enabledExtensionCount = SPA_N_ELEMENTS(extensions),
 		.ppEnabledExtensionNames = extensions,
 	};
 
+	s->have_sync_fd = hasDeviceExtension(s, VK_KHR_EXTERNAL_FENCE_EXTENSION_NAME) &&
+		hasDeviceExtension(s, VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME);
+	if (!s->have_sync_fd)
+		deviceCreateInfo.enabledExtensionCount -= 2;
+
 	VK_CHECK_RESULT(vkCreateDevice(s->physicalDevice, &deviceCreateInfo, NULL, &s->device));
 
 	vkGetDeviceQueue(s->device, s->queueFamilyIndex, 0, &s->queue);
 
-	VkFenceCreateInfo fenceCreateInfo = {
-		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-		.flags = 0,
-	};
-	VK_CHECK_RESULT(vkCreateFence(s->device, &fenceCreateInfo, NULL, &s->fence));
-
 	return 0;
 }
 
@@ -213,13 +237,15 @@ static uint32_t findMemoryType(struct vulkan_state *s,
 
 static int createDescriptors(struct vulkan_state *s)
 {
+	/* one set for each buffer, a set can't be changed while a frame
+	 * that uses it is in flight */
 	VkDescriptorPoolSize descriptorPoolSize = {
 		.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 1
+		.descriptorCount = MAX_BUFFERS * 2
 	};
 	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.maxSets = 1,
+		.maxSets = MAX_BUFFERS,
 		.poolSizeCount = 1,
 		.pPoolSizes = &descriptorPoolSize,
 	};
@@ -228,38 +254,40 @@ static int createDescriptors(struct vulkan_state *s)
 				&descriptorPoolCreateInfo, NULL,
 				&s->descriptorPool));
 
-	VkDescriptorSetLayoutBinding descriptorSetLayoutBinding = {
-		.binding = 0,
-		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-		.descriptorCount = 1,
-		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+	VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2] = {
+		{
+			.binding = 0,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+		},
+		{
+			.binding = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+		},
 	};
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-		.bindingCount = 1,
-		.pBindings = &descriptorSetLayoutBinding
+		.bindingCount = s->has_input ? 2 : 1,
+		.pBindings = descriptorSetLayoutBindings
 	};
 	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(s->device,
 				&descriptorSetLayoutCreateInfo, NULL,
 				&s->descriptorSetLayout));
-
-	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = s->descriptorPool,
-		.descriptorSetCount = 1,
-		.pSetLayouts = &s->descriptorSetLayout
-	};
-
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(s->device,
-				&descriptorSetAllocateInfo,
-				&s->descriptorSet));
 	return 0;
 }
 
 static int createBuffer(struct vulkan_state *s, uint32_t id)
 {
+	VkExternalMemoryBufferCreateInfo externalInfo = {
+		.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+	};
 	VkBufferCreateInfo bufferCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &externalInfo,
 		.size = s->bufferSize,
 		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
@@ -272,8 +300,13 @@ static int createBuffer(struct vulkan_state *s, uint32_t id)
 	vkGetBufferMemoryRequirements(s->device,
 			s->buffers[id].buffer, &memoryRequirements);
 
+	VkExportMemoryAllocateInfo exportInfo = {
+		.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+	};
 	VkMemoryAllocateInfo allocateInfo = {
 		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = &exportInfo,
 		.allocationSize = memoryRequirements.size
 	};
 	allocateInfo.memoryTypeIndex = findMemoryType(s,
@@ -289,10 +322,107 @@ static int createBuffer(struct vulkan_state *s, uint32_t id)
 	return 0;
 }
 
-static int updateDescriptors(struct vulkan_state *s, uint32_t buffer_id)
+/* wrap the dmabuf of an input buffer in a storage buffer, vulkan takes
+ * ownership of the fd so a duplicate is imported */
+static int importBuffer(struct vulkan_state *s, uint32_t id, struct spa_buffer *buf)
 {
-	if (s->current_buffer_id == buffer_id)
-		return 0;
+	struct spa_data *d = &buf->datas[0];
+	struct vulkan_buffer *vb = &s->in_buffers[id];
+	VULKAN_INSTANCE_FUNCTION(vkGetMemoryFdPropertiesKHR);
+	VkMemoryRequirements memoryRequirements;
+	VkResult result;
+	int fd;
+
+	if (d->type != SPA_DATA_DmaBuf) {
+		spa_log_error(s->log, "input buffer %d is not a dmabuf", id);
+		return -ENOTSUP;
+	}
+
+	VkExternalMemoryBufferCreateInfo externalInfo = {
+		.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+	};
+	VkBufferCreateInfo bufferCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.pNext = &externalInfo,
+		.size = d->maxsize,
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VK_CHECK_RESULT(vkCreateBuffer(s->device,
+				&bufferCreateInfo, NULL, &vb->buffer));
+
+	vkGetBufferMemoryRequirements(s->device, vb->buffer, &memoryRequirements);
+
+	VkMemoryFdPropertiesKHR fdProperties = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR,
+	};
+	VK_CHECK_RESULT(vkGetMemoryFdPropertiesKHR(s->device,
+				VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+				d->fd, &fdProperties));
+
+	if ((fd = dup(d->fd)) < 0)
+		return -errno;
+
+	VkImportMemoryFdInfoKHR importInfo = {
+		.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+		.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+		.fd = fd,
+	};
+	VkMemoryAllocateInfo allocateInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.pNext = &importInfo,
+		.allocationSize = memoryRequirements.size,
+		.memoryTypeIndex = findMemoryType(s,
+				memoryRequirements.memoryTypeBits &
+				fdProperties.memoryTypeBits, 0),
+	};
+	result = vkAllocateMemory(s->device, &allocateInfo, NULL, &vb->memory);
+	if (result != VK_SUCCESS) {
+		close(fd);
+		spa_log_error(s->log, "can't import dmabuf of input buffer %d: %d",
+				id, result);
+		return -vkresult_to_errno(result);
+	}
+	VK_CHECK_RESULT(vkBindBufferMemory(s->device, vb->buffer, vb->memory, 0));
+	vb->buf = buf;
+
+	return 0;
+}
+
+static int updateInputDescriptor(struct vulkan_state *s, uint32_t buffer_id,
+		uint32_t in_buffer_id)
+{
+	VkDescriptorBufferInfo descriptorBufferInfo = {
+		.buffer = s->in_buffers[in_buffer_id].buffer,
+		.offset = 0,
+		.range = VK_WHOLE_SIZE,
+	};
+	VkWriteDescriptorSet writeDescriptorSet = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = s->buffers[buffer_id].descriptorSet,
+		.dstBinding = 1,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.pBufferInfo = &descriptorBufferInfo,
+	};
+	vkUpdateDescriptorSets(s->device, 1, &writeDescriptorSet, 0, NULL);
+
+	return 0;
+}
+
+static int createDescriptorSet(struct vulkan_state *s, uint32_t buffer_id)
+{
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = s->descriptorPool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &s->descriptorSetLayout
+	};
+
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(s->device,
+				&descriptorSetAllocateInfo,
+				&s->buffers[buffer_id].descriptorSet));
 
 	VkDescriptorBufferInfo descriptorBufferInfo = {
 		.buffer = s->buffers[buffer_id].buffer,
@@ -301,14 +431,13 @@ static int updateDescriptors(struct vulkan_state *s, uint32_t buffer_id)
 	};
 	VkWriteDescriptorSet writeDescriptorSet = {
 		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-		.dstSet = s->descriptorSet,
+		.dstSet = s->buffers[buffer_id].descriptorSet,
 		.dstBinding = 0,
 		.descriptorCount = 1,
 		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 		.pBufferInfo = &descriptorBufferInfo,
 	};
 	vkUpdateDescriptorSets(s->device, 1, &writeDescriptorSet, 0, NULL);
-	s->current_buffer_id = buffer_id;
 
 	return 0;
 }
@@ -387,8 +516,10 @@ static int createComputePipeline(struct vulkan_state *s, const char *shader_file
 	return 0;
 }
 
-static int createCommandBuffer(struct vulkan_state *s)
+static int createCommandBuffers(struct vulkan_state *s)
 {
+	uint32_t i;
+
 	VkCommandPoolCreateInfo commandPoolCreateInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
 		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
@@ -402,45 +533,64 @@ static int createCommandBuffer(struct vulkan_state *s)
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
 		.commandPool = s->commandPool,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandBufferCount = 1,
+		.commandBufferCount = MAX_IN_FLIGHT,
 	};
         VK_CHECK_RESULT(vkAllocateCommandBuffers(s->device,
 				&commandBufferAllocateInfo,
-				&s->commandBuffer));
+				s->commandBuffers));
+
+	VkExportFenceCreateInfo exportInfo = {
+		.sType = VK_STRUCTURE_TYPE_EXPORT_FENCE_CREATE_INFO,
+		.handleTypes = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
+	};
+	VkFenceCreateInfo fenceCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.pNext = s->have_sync_fd ? &exportInfo : NULL,
+		.flags = 0,
+	};
+	for (i = 0; i < MAX_IN_FLIGHT; i++) {
+		VK_CHECK_RESULT(vkCreateFence(s->device, &fenceCreateInfo, NULL, &s->fences[i]));
+		s->fence_fds[i] = -1;
+	}
 
 	return 0;
 }
 
-static int runCommandBuffer(struct vulkan_state *s)
+/* the push constants change with each frame so the commands are recorded
+ * again, in the command buffer of a free slot */
+static int runCommandBuffer(struct vulkan_state *s, uint32_t buffer_id)
 {
+	uint32_t slot = (s->busy_head + s->n_busy) % MAX_IN_FLIGHT;
+	VkCommandBuffer commandBuffer = s->commandBuffers[slot];
 	VkCommandBufferBeginInfo beginInfo = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
-	VK_CHECK_RESULT(vkBeginCommandBuffer(s->commandBuffer, &beginInfo));
+	VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &beginInfo));
 
-	vkCmdBindPipeline(s->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, s->pipeline);
-	vkCmdPushConstants (s->commandBuffer,
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, s->pipeline);
+	vkCmdPushConstants (commandBuffer,
 			s->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
 			0, sizeof(struct push_constants), (const void *) &s->constants);
-	vkCmdBindDescriptorSets(s->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-			s->pipelineLayout, 0, 1, &s->descriptorSet, 0, NULL);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			s->pipelineLayout, 0, 1, &s->buffers[buffer_id].descriptorSet, 0, NULL);
 
-	vkCmdDispatch(s->commandBuffer,
+	vkCmdDispatch(commandBuffer,
 			(uint32_t)ceil(s->constants.width / (float)WORKGROUP_SIZE),
 			(uint32_t)ceil(s->constants.height / (float)WORKGROUP_SIZE), 1);
 
-	VK_CHECK_RESULT(vkEndCommandBuffer(s->commandBuffer));
+	VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 
-	VK_CHECK_RESULT(vkResetFences(s->device, 1, &s->fence));
+	VK_CHECK_RESULT(vkResetFences(s->device, 1, &s->fences[slot]));
 
 	VkSubmitInfo submitInfo = {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
 		.commandBufferCount = 1,
-		.pCommandBuffers = &s->commandBuffer,
+		.pCommandBuffers = &commandBuffer,
 	};
-        VK_CHECK_RESULT(vkQueueSubmit(s->queue, 1, &submitInfo, s->fence));
-	s->busy_buffer_id = s->current_buffer_id;
+        VK_CHECK_RESULT(vkQueueSubmit(s->queue, 1, &submitInfo, s->fences[slot]));
+	s->busy_buffer_ids[slot] = buffer_id;
+	s->n_busy++;
 
 	return 0;
 }
@@ -450,10 +600,13 @@ static void clear_buffers(struct vulkan_state *s)
 	uint32_t i;
 
 	for (i = 0; i < s->n_buffers; i++) {
-		close(s->buffers[i].buf->datas[0].fd);
+		if (s->buffers[i].buf)
+			close(s->buffers[i].buf->datas[0].fd);
 		vkFreeMemory(s->device, s->buffers[i].memory, NULL);
 		vkDestroyBuffer(s->device, s->buffers[i].buffer, NULL);
 	}
+	if (s->n_buffers > 0)
+		vkResetDescriptorPool(s->device, s->descriptorPool, 0);
 	s->n_buffers = 0;
 }
 
@@ -461,6 +614,7 @@ int spa_vulkan_use_buffers(struct vulkan_state *s, uint32_t flags,
 		uint32_t n_buffers, struct spa_buffer **buffers)
 {
 	uint32_t i;
+	int res;
 	VULKAN_INSTANCE_FUNCTION(vkGetMemoryFdKHR);
 
 	clear_buffers(s);
@@ -486,10 +640,114 @@ int spa_vulkan_use_buffers(struct vulkan_state *s, uint32_t flags,
 		buffers[i]->datas[0].fd = fd;
 		buffers[i]->datas[0].mapoffset = 0;
 		buffers[i]->datas[0].maxsize = s->bufferSize;
+
+		if ((res = createDescriptorSet(s, i)) < 0)
+			return res;
+	}
+	s->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int createHostBuffer(struct vulkan_state *s, struct vulkan_buffer *vb, uint32_t size)
+{
+	VkBufferCreateInfo bufferCreateInfo = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VkMemoryRequirements memoryRequirements;
+
+	VK_CHECK_RESULT(vkCreateBuffer(s->device,
+				&bufferCreateInfo, NULL, &vb->buffer));
+
+	vkGetBufferMemoryRequirements(s->device, vb->buffer, &memoryRequirements);
+
+	VkMemoryAllocateInfo allocateInfo = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = memoryRequirements.size
+	};
+	allocateInfo.memoryTypeIndex = findMemoryType(s,
+			memoryRequirements.memoryTypeBits,
+			VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+	VK_CHECK_RESULT(vkAllocateMemory(s->device,
+				&allocateInfo, NULL, &vb->memory));
+	VK_CHECK_RESULT(vkBindBufferMemory(s->device, vb->buffer, vb->memory, 0));
+	VK_CHECK_RESULT(vkMapMemory(s->device, vb->memory, 0, VK_WHOLE_SIZE, 0, &vb->ptr));
+	memset(vb->ptr, 0, size);
+	vb->buf = NULL;
+
+	return 0;
+}
+
+static void clear_input_buffers(struct vulkan_state *s)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->n_in_buffers; i++) {
+		vkFreeMemory(s->device, s->in_buffers[i].memory, NULL);
+		vkDestroyBuffer(s->device, s->in_buffers[i].buffer, NULL);
+	}
+	s->n_in_buffers = 0;
+}
+
+int spa_vulkan_use_input_buffers(struct vulkan_state *s, uint32_t flags,
+		uint32_t n_buffers, struct spa_buffer **buffers)
+{
+	uint32_t i;
+	int res;
+
+	clear_input_buffers(s);
+
+	for (i = 0; i < n_buffers; i++) {
+		if ((res = importBuffer(s, i, buffers[i])) < 0) {
+			s->n_in_buffers = i;
+			clear_input_buffers(s);
+			return res;
+		}
+	}
+	s->n_in_buffers = n_buffers;
+
+	return 0;
+}
+
+/* mapped pairs of output and input buffers that are filled and read by
+ * the CPU, buffer i of both is used with spa_vulkan_process(s, i, i) */
+int spa_vulkan_alloc_host_buffers(struct vulkan_state *s, uint32_t n_buffers,
+		uint32_t size, uint32_t in_size)
+{
+	uint32_t i;
+	int res;
+
+	clear_buffers(s);
+	clear_input_buffers(s);
+
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	for (i = 0; i < n_buffers; i++) {
+		/* handles that are not created yet stay VK_NULL_HANDLE, which
+		 * are ignored when the buffers are cleared */
+		spa_zero(s->buffers[i]);
+		spa_zero(s->in_buffers[i]);
+		s->n_buffers = i + 1;
+		s->n_in_buffers = i + 1;
+		if ((res = createHostBuffer(s, &s->buffers[i], size)) < 0 ||
+		    (res = createHostBuffer(s, &s->in_buffers[i], in_size)) < 0 ||
+		    (res = createDescriptorSet(s, i)) < 0)
+			goto error;
 	}
 	s->n_buffers = n_buffers;
+	s->n_in_buffers = n_buffers;
 
 	return 0;
+error:
+	clear_buffers(s);
+	clear_input_buffers(s);
+	return res;
 }
 
 int spa_vulkan_prepare(struct vulkan_state *s)
@@ -499,8 +757,8 @@ int spa_vulkan_prepare(struct vulkan_state *s)
 		findPhysicalDevice(s);
 		createDevice(s);
 		createDescriptors(s);
-		createComputePipeline(s, "spa/plugins/vulkan/shaders/main.spv");
-		createCommandBuffer(s);
+		createComputePipeline(s, s->shaderName ? s->shaderName : DEFAULT_SHADER);
+		createCommandBuffers(s);
 		s->prepared = true;
 	}
 	return 0;
@@ -508,7 +766,15 @@ int spa_vulkan_prepare(struct vulkan_state *s)
 
 int spa_vulkan_unprepare(struct vulkan_state *s)
 {
+	uint32_t i;
+
 	if (s->prepared) {
+		clear_input_buffers(s);
+		for (i = 0; i < MAX_IN_FLIGHT; i++) {
+			vkDestroyFence(s->device, s->fences[i], NULL);
+			if (s->fence_fds[i] >= 0)
+				close(s->fence_fds[i]);
+		}
 		vkDestroyShaderModule(s->device, s->computeShaderModule, NULL);
 		vkDestroyDescriptorPool(s->device, s->descriptorPool, NULL);
 		vkDestroyDescriptorSetLayout(s->device, s->descriptorSetLayout, NULL);
@@ -524,40 +790,151 @@ int spa_vulkan_unprepare(struct vulkan_state *s)
 
 int spa_vulkan_start(struct vulkan_state *s)
 {
-	s->current_buffer_id = SPA_ID_INVALID;
-	s->busy_buffer_id = SPA_ID_INVALID;
+	uint32_t i;
+
+	for (i = 0; i < MAX_IN_FLIGHT; i++) {
+		if (s->fence_fds[i] >= 0)
+			close(s->fence_fds[i]);
+		s->fence_fds[i] = -1;
+	}
+	s->exported = 0;
+	s->busy_head = 0;
+	s->n_busy = 0;
 	s->ready_buffer_id = SPA_ID_INVALID;
 	return 0;
 }
 
+/* after this, all frames in flight are complete and can be collected
+ * with spa_vulkan_ready() */
 int spa_vulkan_stop(struct vulkan_state *s)
 {
         VK_CHECK_RESULT(vkDeviceWaitIdle(s->device));
 	return 0;
 }
 
+static int pollFence(struct vulkan_state *s, int timeout)
+{
+	uint32_t slot = s->busy_head;
+	struct pollfd pfd = { .fd = s->fence_fds[slot], .events = POLLIN };
+	int res;
+
+	if (pfd.fd >= 0) {
+		while ((res = poll(&pfd, 1, timeout)) < 0 && errno == EINTR);
+		if (res < 0)
+			return -errno;
+		if (res == 0)
+			return -EBUSY;
+		close(pfd.fd);
+		s->fence_fds[slot] = -1;
+	}
+	return 0;
+}
+
+static void completeFrame(struct vulkan_state *s)
+{
+	SPA_FLAG_CLEAR(s->exported, 1u << s->busy_head);
+	s->ready_buffer_id = s->busy_buffer_ids[s->busy_head];
+	s->busy_head = (s->busy_head + 1) % MAX_IN_FLIGHT;
+	s->n_busy--;
+}
+
+/* check the oldest frame in flight and place its buffer in
+ * ready_buffer_id when it is complete */
 int spa_vulkan_ready(struct vulkan_state *s)
 {
-	VkResult result;
+	VkResult status;
+	int res;
 
-	if (s->busy_buffer_id == SPA_ID_INVALID)
+	if (s->n_busy == 0)
 		return 0;
 
-	result = vkGetFenceStatus(s->device, s->fence);
-	if (result == VK_NOT_READY)
-		return -EBUSY;
-	VK_CHECK_RESULT(result);
-
-	s->ready_buffer_id = s->busy_buffer_id;
-	s->busy_buffer_id = SPA_ID_INVALID;
+	if (SPA_FLAG_IS_SET(s->exported, 1u << s->busy_head)) {
+		if ((res = pollFence(s, 0)) < 0)
+			return res;
+	} else {
+		status = vkGetFenceStatus(s->device, s->fences[s->busy_head]);
+		if (status == VK_NOT_READY)
+			return -EBUSY;
+		VK_CHECK_RESULT(status);
+	}
+	completeFrame(s);
 
 	return 0;
 }
 
-int spa_vulkan_process(struct vulkan_state *s, uint32_t buffer_id)
+/* block until the oldest frame in flight is complete */
+int spa_vulkan_wait(struct vulkan_state *s)
 {
-	updateDescriptors(s, buffer_id);
-	runCommandBuffer(s);
+	int res;
+
+	if (s->n_busy == 0)
+		return 0;
+
+	if (SPA_FLAG_IS_SET(s->exported, 1u << s->busy_head)) {
+		if ((res = pollFence(s, -1)) < 0)
+			return res;
+	} else {
+		VK_CHECK_RESULT(vkWaitForFences(s->device, 1, &s->fences[s->busy_head],
+					VK_TRUE, UINT64_MAX));
+	}
+	completeFrame(s);
 
 	return 0;
 }
+
+bool spa_vulkan_can_process(struct vulkan_state *s)
+{
+	return s->n_busy < MAX_IN_FLIGHT;
+}
+
+int spa_vulkan_process(struct vulkan_state *s, uint32_t buffer_id, uint32_t in_buffer_id)
+{
+	if (!spa_vulkan_can_process(s))
+		return -EBUSY;
+
+	/* the set of an output buffer is not in use by a pending frame
+	 * when the buffer is free again */
+	if (s->has_input) {
+		if (in_buffer_id >= s->n_in_buffers)
+			return -EINVAL;
+		updateInputDescriptor(s, buffer_id, in_buffer_id);
+	}
+
+	return runCommandBuffer(s, buffer_id);
+}
+
+/* export the fence of the frame submitted last as a sync_file fd that the
+ * caller owns. On success, and with -EALREADY when the frame is already
+ * complete, the buffer of the frame is handed to the caller and will not
+ * be returned in ready_buffer_id. Returns the fd or a negative errno */
+int spa_vulkan_export_fence(struct vulkan_state *s)
+{
+	uint32_t slot;
+	int fd = -1;
+
+	if (!s->have_sync_fd)
+		return -ENOTSUP;
+	if (s->n_busy == 0)
+		return -EINVAL;
+
+	slot = (s->busy_head + s->n_busy - 1) % MAX_IN_FLIGHT;
+	if (!SPA_FLAG_IS_SET(s->exported, 1u << slot)) {
+		VULKAN_DEVICE_FUNCTION(vkGetFenceFdKHR);
+		VkFenceGetFdInfoKHR getFdInfo = {
+			.sType = VK_STRUCTURE_TYPE_FENCE_GET_FD_INFO_KHR,
+			.fence = s->fences[slot],
+			.handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT,
+		};
+		if (vkGetFenceFdKHR == NULL)
+			return -ENOTSUP;
+		VK_CHECK_RESULT(vkGetFenceFdKHR(s->device, &getFdInfo, &fd));
+		SPA_FLAG_SET(s->exported, 1u << slot);
+		s->fence_fds[slot] = fd;
+	}
+	s->busy_buffer_ids[slot] = SPA_ID_INVALID;
+	if (s->fence_fds[slot] < 0)
+		return -EALREADY;
+	if ((fd = fcntl(s->fence_fds[slot], F_DUPFD_CLOEXEC, 0)) < 0)
+		return -errno;
+	return fd;
+}
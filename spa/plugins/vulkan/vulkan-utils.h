@@ -1,8 +1,11 @@
+#include <stdbool.h>
+
 #include <vulkan/vulkan.h>
 
 #include <spa/buffer/buffer.h>
 
 #define MAX_BUFFERS 16
+#define MAX_IN_FLIGHT 3
 #define WORKGROUP_SIZE 32
 
 struct pixel {
@@ -20,13 +23,21 @@ struct vulkan_buffer {
 	struct spa_buffer *buf;
 	VkBuffer buffer;
 	VkDeviceMemory memory;
+	VkDescriptorSet descriptorSet;
+	void *ptr;			/* mapped host buffers only */
 };
 
+#define DEFAULT_SHADER	"spa/plugins/vulkan/shaders/main.spv"
+
 struct vulkan_state {
 	struct spa_log *log;
 
 	struct push_constants constants;
 
+	const char *shaderName;
+	/* the shader reads from a second storage buffer at binding 1 */
+	unsigned int has_input:1;
+
 	VkInstance instance;
 
 	VkPhysicalDevice physicalDevice;
@@ -37,33 +48,52 @@ struct vulkan_state {
 	VkShaderModule computeShaderModule;
 
 	VkCommandPool commandPool;
-	VkCommandBuffer commandBuffer;
 
 	VkQueue queue;
 	uint32_t queueFamilyIndex;
-	VkFence fence;
 	unsigned int prepared:1;
-	uint32_t busy_buffer_id;
+	/* the fences can be exported as sync_file fds */
+	unsigned int have_sync_fd:1;
+
+	/* one command buffer and fence for each frame in flight, the
+	 * frames complete in the order they were submitted */
+	VkCommandBuffer commandBuffers[MAX_IN_FLIGHT];
+	VkFence fences[MAX_IN_FLIGHT];
+	/* exporting a fence resets it, the exported fd signals instead.
+	 * A fence that was already signaled exports without an fd */
+	uint32_t exported;
+	int fence_fds[MAX_IN_FLIGHT];
+	uint32_t busy_buffer_ids[MAX_IN_FLIGHT];
+	uint32_t busy_head;
+	uint32_t n_busy;
 	uint32_t ready_buffer_id;
 
 	VkDescriptorPool descriptorPool;
-	VkDescriptorSet descriptorSet;
 	VkDescriptorSetLayout descriptorSetLayout;
-	uint32_t current_buffer_id;
 
 	uint32_t bufferSize;
 	struct vulkan_buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
 
+	/* imported dmabufs, read by the shader */
+	struct vulkan_buffer in_buffers[MAX_BUFFERS];
+	uint32_t n_in_buffers;
 };
 
 int spa_vulkan_prepare(struct vulkan_state *s);
 int spa_vulkan_use_buffers(struct vulkan_state *s, uint32_t flags,
 		uint32_t n_buffers, struct spa_buffer **buffers);
+int spa_vulkan_use_input_buffers(struct vulkan_state *s, uint32_t flags,
+		uint32_t n_buffers, struct spa_buffer **buffers);
+int spa_vulkan_alloc_host_buffers(struct vulkan_state *s, uint32_t n_buffers,
+		uint32_t size, uint32_t in_size);
 int spa_vulkan_unprepare(struct vulkan_state *s);
 
 int spa_vulkan_start(struct vulkan_state *s);
 int spa_vulkan_stop(struct vulkan_state *s);
 int spa_vulkan_ready(struct vulkan_state *s);
-int spa_vulkan_process(struct vulkan_state *s, uint32_t buffer_id);
+int spa_vulkan_wait(struct vulkan_state *s);
+bool spa_vulkan_can_process(struct vulkan_state *s);
+int spa_vulkan_process(struct vulkan_state *s, uint32_t buffer_id, uint32_t in_buffer_id);
+int spa_vulkan_export_fence(struct vulkan_state *s);
 int spa_vulkan_cleanup(struct vulkan_state *s);
@@ -32,24 +32,37 @@
 #include <spa/pod/pod.h>
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
+#include <spa/pod/filter.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/debug/pod.h>
 
+#include "benchmark.h"
+
 #define MAX_COUNT 10000000
 
+static struct bench_result results[6];
+static struct bench bench = BENCH_INIT("pod", results);
+
+static void add_result(const char *name, uint64_t count, uint64_t nsec)
+{
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = "c",
+		.count = count,
+		.nsec = nsec,
+	});
+}
+
 static void test_builder()
 {
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = { NULL, };
 	struct spa_pod_frame f[2];
-	struct timespec ts;
 	uint64_t t1, t2;
 	uint64_t count = 0;
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+	t1 = bench_now();
 
-	fprintf(stderr, "test_builder() : ");
 	for (count = 0; count < MAX_COUNT; count++) {
 		spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
@@ -81,27 +94,22 @@ static void test_builder()
 		spa_pod_builder_pop(&b, &f[1]);
 
 		spa_pod_builder_pop(&b, &f[0]);
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		t2 = bench_now();
 		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
 			break;
 	}
-	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
-			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+	add_result("pod_builder", count, t2 - t1);
 }
 
 static void test_builder2()
 {
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = { NULL, };
-	struct timespec ts;
 	uint64_t t1, t2;
 	uint64_t count = 0;
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+	t1 = bench_now();
 
-	fprintf(stderr, "test_builder2() : ");
 	for (count = 0; count < MAX_COUNT; count++) {
 		spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
@@ -122,20 +130,65 @@ static void test_builder2()
 								&SPA_FRACTION(0,1),
 								&SPA_FRACTION(INT32_MAX,1)));
 
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		t2 = bench_now();
 		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
 			break;
 	}
-	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
-			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+	add_result("pod_builder2", count, t2 - t1);
+}
+
+static void test_template()
+{
+	uint8_t tbuf[1024], buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod *tmpl, *pod;
+	uint32_t format_offset, size_offset, rate_offset;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+
+	spa_pod_builder_init(&b, tbuf, sizeof(tbuf));
+	tmpl = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, 0,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_CHOICE_ENUM_Id(3,
+							SPA_VIDEO_FORMAT_I420,
+							SPA_VIDEO_FORMAT_I420,
+							SPA_VIDEO_FORMAT_YUY2),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_CHOICE_RANGE_Rectangle(
+							&SPA_RECTANGLE(0, 0),
+							&SPA_RECTANGLE(1, 1),
+							&SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+							&SPA_FRACTION(0,1),
+							&SPA_FRACTION(0,1),
+							&SPA_FRACTION(INT32_MAX,1)));
+
+	format_offset = spa_pod_template_offset(tmpl, SPA_FORMAT_VIDEO_format);
+	size_offset = spa_pod_template_offset(tmpl, SPA_FORMAT_VIDEO_size);
+	rate_offset = spa_pod_template_offset(tmpl, SPA_FORMAT_VIDEO_framerate);
+
+	t1 = bench_now();
+
+	for (count = 0; count < MAX_COUNT; count++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+		pod = spa_pod_builder_template(&b, tmpl);
+		*SPA_POD_TEMPLATE_VALUE(pod, format_offset, uint32_t) = SPA_VIDEO_FORMAT_I420;
+		*SPA_POD_TEMPLATE_VALUE(pod, size_offset, struct spa_rectangle) = SPA_RECTANGLE(320, 240);
+		*SPA_POD_TEMPLATE_VALUE(pod, rate_offset, struct spa_fraction) = SPA_FRACTION(25, 1);
+
+		t2 = bench_now();
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	add_result("pod_template", count, t2 - t1);
 }
 
 static void test_parse()
 {
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = { NULL, };
-	struct timespec ts;
 	uint64_t t1, t2;
 	uint64_t count = 0;
 	struct spa_pod *fmt;
@@ -161,10 +214,8 @@ static void test_parse()
 
 	spa_pod_fixate(fmt);
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+	t1 = bench_now();
 
-	fprintf(stderr, "test_parse() : ");
 	for (count = 0; count < MAX_COUNT; count++) {
 		struct {
 			uint32_t media_type;
@@ -207,20 +258,17 @@ static void test_parse()
 		spa_assert(vals.size.width == 320 && vals.size.height == 240);
 		spa_assert(vals.framerate.num == 25 && vals.framerate.denom == 1);
 
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		t2 = bench_now();
 		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
 			break;
 	}
-	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
-			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+	add_result("pod_parse", count, t2 - t1);
 }
 
 static void test_parser()
 {
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = { NULL, };
-	struct timespec ts;
 	uint64_t t1, t2;
 	uint64_t count = 0;
 	struct spa_pod *fmt;
@@ -246,10 +294,8 @@ static void test_parser()
 
 	spa_pod_fixate(fmt);
 
-	clock_gettime(CLOCK_MONOTONIC, &ts);
-	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+	t1 = bench_now();
 
-	fprintf(stderr, "test_parser() : ");
 	for (count = 0; count < MAX_COUNT; count++) {
 		struct {
 			uint32_t media_type;
@@ -275,20 +321,76 @@ static void test_parser()
 		spa_assert(vals.size.width == 320 && vals.size.height == 240);
 		spa_assert(vals.framerate.num == 25 && vals.framerate.denom == 1);
 
-		clock_gettime(CLOCK_MONOTONIC, &ts);
-		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		t2 = bench_now();
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	add_result("pod_parser", count, t2 - t1);
+}
+
+#define N_FILTER_FORMATS	64
+
+static struct spa_pod *build_enum_format(struct spa_pod_builder *b, uint32_t first)
+{
+	struct spa_pod_frame f[2];
+	uint32_t i;
+
+	spa_pod_builder_push_object(b, &f[0], SPA_TYPE_OBJECT_Format, 0);
+	spa_pod_builder_add(b,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			0);
+	spa_pod_builder_prop(b, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(b, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(b, first);
+	for (i = 0; i < N_FILTER_FORMATS; i++)
+		spa_pod_builder_id(b, first + i);
+	spa_pod_builder_pop(b, &f[1]);
+	spa_pod_builder_add(b,
+			SPA_FORMAT_VIDEO_size,      SPA_POD_CHOICE_RANGE_Rectangle(
+							&SPA_RECTANGLE(320, 240),
+							&SPA_RECTANGLE(1, 1),
+							&SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
+			0);
+	return spa_pod_builder_pop(b, &f[0]);
+}
+
+static void test_filter()
+{
+	uint8_t b1[2048], b2[2048], buffer[2048];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_pod *p1, *p2, *res;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+
+	spa_pod_builder_init(&b, b1, sizeof(b1));
+	p1 = build_enum_format(&b, 1);
+	spa_pod_builder_init(&b, b2, sizeof(b2));
+	p2 = build_enum_format(&b, N_FILTER_FORMATS / 2);
+
+	t1 = bench_now();
+
+	for (count = 0; count < MAX_COUNT; count++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		spa_assert(spa_pod_filter(&b, &res, p1, p2) >= 0);
+
+		t2 = bench_now();
 		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
 			break;
 	}
-	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
-			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+	add_result("pod_filter", count, t2 - t1);
 }
 
 int main(int argc, char *argv[])
 {
 	test_builder();
 	test_builder2();
+	test_template();
 	test_parse();
 	test_parser();
+	test_filter();
+
+	bench_report(&bench);
+
 	return 0;
 }
@@ -0,0 +1,269 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Measures spa_ringbuffer throughput and round trip latency between a
+ * writer and a reader thread for different element sizes and for each
+ * relation between the two CPUs the threads run on:
+ *
+ *   same-cpu     both threads on one CPU, they yield to each other
+ *   smt          SMT siblings sharing a core
+ *   same-package different cores in the same package
+ *   cross-package different packages (sockets)
+ *
+ * The writer runs on CPU 0, the reader on the first CPU found for each
+ * relation. Relations without a CPU are skipped.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include <spa/utils/ringbuffer.h>
+
+#include "benchmark.h"
+
+#define RING_SIZE	(64 * 1024)
+#define MAX_ELEM_SIZE	4096
+#define TOTAL_BYTES	(256 * 1024 * 1024)
+#define LATENCY_COUNT	100000
+
+static const uint32_t elem_sizes[] = { 8, 64, 256, 1024, 4096 };
+
+enum relation {
+	RELATION_SAME_CPU,
+	RELATION_SMT,
+	RELATION_SAME_PACKAGE,
+	RELATION_CROSS_PACKAGE,
+	RELATION_LAST,
+};
+
+static const char *relation_names[] = {
+	[RELATION_SAME_CPU] = "same-cpu",
+	[RELATION_SMT] = "smt",
+	[RELATION_SAME_PACKAGE] = "same-package",
+	[RELATION_CROSS_PACKAGE] = "cross-package",
+};
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(elem_sizes) * RELATION_LAST * 2
+
+static struct bench_result results[MAX_RESULTS];
+static struct bench bench = BENCH_INIT("ringbuffer", results);
+
+struct ring {
+	struct spa_ringbuffer rb;
+	uint8_t data[RING_SIZE] SPA_ALIGNED(64);
+};
+
+struct test {
+	struct ring *ring[2];		/* to the reader and back */
+	uint32_t elem_size;
+	uint64_t count;			/* number of elements */
+	int cpu[2];			/* writer and reader cpu */
+	bool yield;
+	bool latency;
+	uint64_t errors;
+};
+
+static int read_sysfs_int(int cpu, const char *name)
+{
+	char path[256];
+	FILE *f;
+	int val = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static enum relation get_relation(int cpu0, int cpu1)
+{
+	if (cpu0 == cpu1)
+		return RELATION_SAME_CPU;
+	if (read_sysfs_int(cpu0, "physical_package_id") !=
+	    read_sysfs_int(cpu1, "physical_package_id"))
+		return RELATION_CROSS_PACKAGE;
+	if (read_sysfs_int(cpu0, "core_id") != read_sysfs_int(cpu1, "core_id"))
+		return RELATION_SAME_PACKAGE;
+	return RELATION_SMT;
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		fprintf(stderr, "can't pin to cpu %d\n", cpu);
+}
+
+static inline void relax(struct test *t)
+{
+	if (t->yield)
+		sched_yield();
+#if defined(__x86_64__) || defined(__i386__)
+	else
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	else
+		__asm__ __volatile__("yield");
+#endif
+}
+
+static void ring_write(struct test *t, struct ring *r, const void *elem)
+{
+	uint32_t index;
+
+	while (RING_SIZE - spa_ringbuffer_get_write_index(&r->rb, &index) < (int32_t)t->elem_size)
+		relax(t);
+	spa_ringbuffer_write_data(&r->rb, r->data, RING_SIZE,
+			index & (RING_SIZE - 1), elem, t->elem_size);
+	spa_ringbuffer_write_update(&r->rb, index + t->elem_size);
+}
+
+static void ring_read(struct test *t, struct ring *r, void *elem)
+{
+	uint32_t index;
+
+	while (spa_ringbuffer_get_read_index(&r->rb, &index) < (int32_t)t->elem_size)
+		relax(t);
+	spa_ringbuffer_read_data(&r->rb, r->data, RING_SIZE,
+			index & (RING_SIZE - 1), elem, t->elem_size);
+	spa_ringbuffer_read_update(&r->rb, index + t->elem_size);
+}
+
+static void *reader_start(void *arg)
+{
+	struct test *t = arg;
+	uint8_t elem[MAX_ELEM_SIZE] SPA_ALIGNED(64);
+	uint64_t i, seq;
+
+	pin(t->cpu[1]);
+
+	for (i = 0; i < t->count; i++) {
+		ring_read(t, t->ring[0], elem);
+		memcpy(&seq, elem, sizeof(seq));
+		if (seq != i)
+			t->errors++;
+		if (t->latency)
+			ring_write(t, t->ring[1], elem);
+	}
+	return NULL;
+}
+
+static void run_test1(const char *name, enum relation relation, int cpu,
+		uint32_t elem_size, bool latency)
+{
+	struct test t;
+	pthread_t reader;
+	uint8_t elem[MAX_ELEM_SIZE] SPA_ALIGNED(64);
+	uint64_t i, t1, t2;
+
+	spa_zero(t);
+	t.ring[0] = calloc(1, sizeof(struct ring));
+	t.ring[1] = calloc(1, sizeof(struct ring));
+	spa_assert(t.ring[0] != NULL && t.ring[1] != NULL);
+	t.elem_size = elem_size;
+	t.latency = latency;
+	t.count = latency ? LATENCY_COUNT : TOTAL_BYTES / elem_size;
+	t.cpu[0] = 0;
+	t.cpu[1] = cpu;
+	t.yield = relation == RELATION_SAME_CPU;
+
+	memset(elem, 0x55, sizeof(elem));
+	pin(t.cpu[0]);
+
+	pthread_create(&reader, NULL, reader_start, &t);
+
+	t1 = bench_now();
+	for (i = 0; i < t.count; i++) {
+		memcpy(elem, &i, sizeof(i));
+		ring_write(&t, t.ring[0], elem);
+		if (latency)
+			ring_read(&t, t.ring[1], elem);
+	}
+	pthread_join(reader, NULL);
+	t2 = bench_now();
+
+	if (t.errors > 0)
+		fprintf(stderr, "%s %s %u: %"PRIu64" elements out of sequence\n",
+				name, relation_names[relation], elem_size, t.errors);
+	spa_assert(t.errors == 0);
+
+	bench_add(&bench, &(struct bench_result) {
+		.name = name,
+		.impl = relation_names[relation],
+		.n_samples = elem_size,
+		.n_params = 2,
+		.params = {
+			{ "element_size", elem_size },
+			{ "reader_cpu", cpu },
+		},
+		.count = t.count,
+		.nsec = t2 - t1,
+	});
+
+	free(t.ring[0]);
+	free(t.ring[1]);
+}
+
+int main(int argc, char *argv[])
+{
+	int cpus[RELATION_LAST], n_cpus, cpu;
+	uint32_t i, j;
+
+	n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (i = 0; i < RELATION_LAST; i++)
+		cpus[i] = -1;
+	for (cpu = 0; cpu < n_cpus; cpu++) {
+		enum relation r = get_relation(0, cpu);
+		if (cpus[r] == -1)
+			cpus[r] = cpu;
+	}
+
+	for (i = 0; i < RELATION_LAST; i++) {
+		if (cpus[i] == -1) {
+			fprintf(stderr, "no cpu for %s, skipping\n", relation_names[i]);
+			continue;
+		}
+		for (j = 0; j < SPA_N_ELEMENTS(elem_sizes); j++) {
+			run_test1("ringbuffer_throughput", i, cpus[i], elem_sizes[j], false);
+			run_test1("ringbuffer_latency", i, cpus[i], elem_sizes[j], true);
+		}
+	}
+
+	bench_report(&bench);
+
+	return 0;
+}
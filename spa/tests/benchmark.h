@@ -0,0 +1,184 @@
+/* Spa
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_BENCHMARK_H
+#define SPA_BENCHMARK_H
+
+/* Helpers shared by the benchmark programs.
+ *
+ * Every benchmark collects its measurements with bench_add() and finishes
+ * with bench_report(). The report is a table for humans on stderr and a
+ * JSON document on stdout:
+ *
+ *   { "suite": "fmt-ops",
+ *     "results": [
+ *       { "name": "test_f32_s16", "impl": "sse2", "samples": 128, "channels": 2,
+ *         "params": { }, "iterations": 1000, "nsec": 123456,
+ *         "ns_per_iteration": 123.456, "ns_per_sample": 0.482 },
+ *       ... ] }
+ *
+ * Results are sorted so that the output of two runs can be compared line
+ * by line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <spa/utils/defs.h>
+
+#define BENCH_MAX_PARAMS	4
+
+struct bench_param {
+	const char *key;
+	int64_t value;
+};
+
+struct bench_result {
+	const char *name;
+	const char *impl;
+	uint32_t n_samples;		/* samples per channel per iteration */
+	uint32_t n_channels;
+	uint32_t n_params;
+	struct bench_param params[BENCH_MAX_PARAMS];
+	uint64_t count;			/* number of iterations */
+	uint64_t nsec;			/* total time of all iterations */
+};
+
+struct bench {
+	const char *suite;
+	struct bench_result *results;
+	uint32_t n_results;
+	uint32_t max_results;
+};
+
+#define BENCH_INIT(suite,results) { suite, results, 0, SPA_N_ELEMENTS(results) }
+
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static inline void bench_add(struct bench *b, const struct bench_result *r)
+{
+	spa_assert(b->n_results < b->max_results);
+	b->results[b->n_results++] = *r;
+}
+
+static inline uint64_t bench_result_perf(const struct bench_result *r)
+{
+	return r->nsec ? r->count * (uint64_t)SPA_NSEC_PER_SEC / r->nsec : 0;
+}
+
+static inline double bench_result_ns_per_sample(const struct bench_result *r)
+{
+	uint64_t n = r->count * r->n_samples * SPA_MAX(r->n_channels, 1u);
+	return n ? (double)r->nsec / n : 0.0;
+}
+
+static inline int bench_compare(const void *_a, const void *_b)
+{
+	const struct bench_result *a = _a, *b = _b;
+	uint64_t pa, pb;
+	uint32_t i;
+	int diff;
+
+	if ((diff = strcmp(a->name, b->name)) != 0)
+		return diff;
+	for (i = 0; i < a->n_params && i < b->n_params; i++) {
+		if (a->params[i].value != b->params[i].value)
+			return a->params[i].value < b->params[i].value ? -1 : 1;
+	}
+	if ((diff = (int)a->n_samples - (int)b->n_samples) != 0)
+		return diff;
+	if ((diff = (int)a->n_channels - (int)b->n_channels) != 0)
+		return diff;
+	pa = bench_result_perf(a);
+	pb = bench_result_perf(b);
+	if (pa != pb)
+		return pa > pb ? -1 : 1;
+	return strcmp(a->impl, b->impl);
+}
+
+static inline void bench_print_string(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fputc('\\', f);
+		fputc(*str, f);
+	}
+	fputc('"', f);
+}
+
+static inline void bench_report(struct bench *b)
+{
+	uint32_t i, j;
+
+	qsort(b->results, b->n_results, sizeof(struct bench_result), bench_compare);
+
+	for (i = 0; i < b->n_results; i++) {
+		struct bench_result *r = &b->results[i];
+
+		fprintf(stderr, "%-12"PRIu64" \t%8.3f ns/sample \t%-32.32s %-8s \t",
+				bench_result_perf(r), bench_result_ns_per_sample(r),
+				r->name, r->impl);
+		for (j = 0; j < r->n_params; j++)
+			fprintf(stderr, "%s %"PRIi64" ", r->params[j].key, r->params[j].value);
+		fprintf(stderr, "samples %d, channels %d\n", r->n_samples, r->n_channels);
+	}
+
+	fprintf(stdout, "{\n  \"suite\": ");
+	bench_print_string(stdout, b->suite);
+	fprintf(stdout, ",\n  \"results\": [");
+
+	for (i = 0; i < b->n_results; i++) {
+		struct bench_result *r = &b->results[i];
+
+		fprintf(stdout, "%s\n    { \"name\": ", i == 0 ? "" : ",");
+		bench_print_string(stdout, r->name);
+		fprintf(stdout, ", \"impl\": ");
+		bench_print_string(stdout, r->impl);
+		fprintf(stdout, ", \"samples\": %u, \"channels\": %u, \"params\": {",
+				r->n_samples, r->n_channels);
+		for (j = 0; j < r->n_params; j++) {
+			fprintf(stdout, "%s ", j == 0 ? "" : ",");
+			bench_print_string(stdout, r->params[j].key);
+			fprintf(stdout, ": %"PRIi64, r->params[j].value);
+		}
+		fprintf(stdout, " }, \"iterations\": %"PRIu64", \"nsec\": %"PRIu64
+				", \"ns_per_iteration\": %.3f, \"ns_per_sample\": %.4f }",
+				r->count, r->nsec,
+				r->count ? (double)r->nsec / r->count : 0.0,
+				bench_result_ns_per_sample(r));
+	}
+	fprintf(stdout, "\n  ]\n}\n");
+	fflush(stdout);
+}
+
+#endif /* SPA_BENCHMARK_H */
@@ -48,7 +48,8 @@ static void test_abi(void)
 	spa_assert(SPA_META_Bitmap == 4);
 	spa_assert(SPA_META_Cursor == 5);
 	spa_assert(SPA_META_Control == 6);
-	spa_assert(SPA_META_LAST == 7);
+	spa_assert(SPA_META_SyncFence == 7);
+	spa_assert(SPA_META_LAST == 8);
 
 	spa_assert(sizeof(struct spa_meta) == 16);
 	fprintf(stderr, "%zd", sizeof(struct spa_meta_header));
@@ -56,6 +57,7 @@ static void test_abi(void)
 	spa_assert(sizeof(struct spa_meta_region) == 16);
 	spa_assert(sizeof(struct spa_meta_bitmap) == 20);
 	spa_assert(sizeof(struct spa_meta_cursor) == 28);
+	spa_assert(sizeof(struct spa_meta_sync_fence) == 8);
 
 }
 
@@ -114,9 +116,96 @@ static void test_alloc(void)
 	free(buffers);
 }
 
+static void test_alloc_layout_array(void)
+{
+	static const uint32_t flags[] = {
+		0,
+		SPA_BUFFER_ALLOC_FLAG_INLINE_ALL,
+		SPA_BUFFER_ALLOC_FLAG_INLINE_META | SPA_BUFFER_ALLOC_FLAG_INLINE_CHUNK,
+		SPA_BUFFER_ALLOC_FLAG_NO_DATA,
+	};
+	struct spa_meta metas[2];
+	struct spa_data datas[2];
+	uint32_t aligns[2];
+	uint32_t i, j, k;
+
+	metas[0].type = SPA_META_Header;
+	metas[0].size = sizeof(struct spa_meta_header);
+	metas[1].type = 101;
+	metas[1].size = 11;
+
+	memset(datas, 0, sizeof(datas));
+	datas[0].maxsize = 4000;
+	datas[1].maxsize = 2011;
+
+	aligns[0] = 32;
+	aligns[1] = 16;
+
+	for (k = 0; k < SPA_N_ELEMENTS(flags); k++) {
+		struct spa_buffer_alloc_info info = { flags[k], };
+		struct spa_buffer *buffers[8], *b, *r;
+		void *mem[3], *skel, *ref, *data;
+
+		spa_buffer_alloc_fill_info(&info, SPA_N_ELEMENTS(metas), metas,
+				SPA_N_ELEMENTS(datas), datas, aligns);
+
+		mem[0] = calloc(1, info.max_align + 8 * info.skel_size);
+		mem[1] = calloc(1, info.max_align + 8 * info.skel_size);
+		mem[2] = calloc(1, info.max_align + 8 * info.mem_size);
+		spa_assert(mem[0] != NULL && mem[1] != NULL && mem[2] != NULL);
+
+		skel = SPA_PTR_ALIGN(mem[0], info.max_align, void);
+		ref = SPA_PTR_ALIGN(mem[1], info.max_align, void);
+		data = SPA_PTR_ALIGN(mem[2], info.max_align, void);
+
+		spa_buffer_alloc_layout_array(&info, 8, buffers, skel, data);
+
+		/* the copied skeletons must match a full layout */
+		for (i = 0; i < 8; i++) {
+			void *rs = SPA_MEMBER(ref, i * info.skel_size, void);
+			ptrdiff_t diff = SPA_PTRDIFF(skel, ref);
+
+			b = buffers[i];
+			spa_assert((void*)b == SPA_MEMBER(skel, i * info.skel_size, void));
+
+			r = spa_buffer_alloc_layout(&info, rs,
+					SPA_MEMBER(data, i * info.mem_size, void));
+
+			spa_assert(b->n_metas == r->n_metas);
+			spa_assert(b->n_datas == r->n_datas);
+			spa_assert((uint8_t*)r->metas + diff == (uint8_t*)b->metas);
+			spa_assert((uint8_t*)r->datas + diff == (uint8_t*)b->datas);
+
+			for (j = 0; j < b->n_metas; j++) {
+				uint8_t *p = r->metas[j].data;
+				if (info.flags & SPA_BUFFER_ALLOC_FLAG_INLINE_META)
+					p += diff;
+				spa_assert(b->metas[j].type == r->metas[j].type);
+				spa_assert(b->metas[j].size == r->metas[j].size);
+				spa_assert(b->metas[j].data == p);
+			}
+			for (j = 0; j < b->n_datas; j++) {
+				uint8_t *c = (uint8_t*)r->datas[j].chunk, *p = r->datas[j].data;
+				if (info.flags & SPA_BUFFER_ALLOC_FLAG_INLINE_CHUNK)
+					c += diff;
+				if (info.flags & SPA_BUFFER_ALLOC_FLAG_INLINE_DATA &&
+				    !(info.flags & SPA_BUFFER_ALLOC_FLAG_NO_DATA))
+					p += diff;
+				spa_assert(b->datas[j].maxsize == r->datas[j].maxsize);
+				spa_assert((uint8_t*)b->datas[j].chunk == c);
+				spa_assert(b->datas[j].data == p);
+			}
+		}
+		free(mem[0]);
+		free(mem[1]);
+		free(mem[2]);
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	test_abi();
 	test_alloc();
+	test_alloc_layout_array();
 	return 0;
 }
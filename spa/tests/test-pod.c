@@ -28,6 +28,7 @@
 #include <spa/pod/iter.h>
 #include <spa/pod/parser.h>
 #include <spa/pod/vararg.h>
+#include <spa/pod/filter.h>
 #include <spa/debug/pod.h>
 #include <spa/param/format.h>
 #include <spa/param/video/raw.h>
@@ -1521,6 +1522,197 @@ static void test_overflow(void)
 	spa_debug_pod(0, NULL, pod);
 }
 
+static void test_filter_flags(void)
+{
+	uint8_t b1[256], b2[256], b3[256];
+	struct spa_pod_builder pb;
+	struct spa_pod *p1, *p2, *res;
+	int32_t types;
+
+	spa_pod_builder_init(&pb, b1, sizeof(b1));
+	p1 = spa_pod_builder_add_object(&pb,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(
+				(1<<SPA_DATA_MemPtr) | (1<<SPA_DATA_DmaBuf)));
+	spa_pod_builder_init(&pb, b2, sizeof(b2));
+	p2 = spa_pod_builder_add_object(&pb,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(
+				(1<<SPA_DATA_MemFd) | (1<<SPA_DATA_DmaBuf)));
+
+	/* flags and flags keep the common flags */
+	spa_pod_builder_init(&pb, b3, sizeof(b3));
+	spa_assert(spa_pod_filter(&pb, &res, p1, p2) >= 0);
+	spa_pod_fixate(res);
+	spa_assert(spa_pod_parse_object(res,
+			SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_Int(&types)) == 1);
+	spa_assert(types == (1<<SPA_DATA_DmaBuf));
+
+	/* a plain value must be one of the flags */
+	spa_pod_builder_init(&pb, b2, sizeof(b2));
+	p2 = spa_pod_builder_add_object(&pb,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_Int(1<<SPA_DATA_MemPtr));
+	spa_pod_builder_init(&pb, b3, sizeof(b3));
+	spa_assert(spa_pod_filter(&pb, &res, p1, p2) >= 0);
+	spa_assert(spa_pod_parse_object(res,
+			SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_Int(&types)) == 1);
+	spa_assert(types == (1<<SPA_DATA_MemPtr));
+
+	spa_pod_builder_init(&pb, b2, sizeof(b2));
+	p2 = spa_pod_builder_add_object(&pb,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_Int(1<<SPA_DATA_MemFd));
+	spa_pod_builder_init(&pb, b3, sizeof(b3));
+	spa_assert(spa_pod_filter(&pb, &res, p1, p2) < 0);
+}
+
+static void test_template(void)
+{
+	uint8_t tbuf[256], buffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod *tmpl, *pod;
+	uint32_t i, size_offset, stride_offset;
+	const struct spa_pod_prop *prop;
+	int32_t blocks, stride;
+
+	spa_pod_builder_init(&b, tbuf, sizeof(tbuf));
+	tmpl = spa_pod_builder_add_object(&b,
+		SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+		SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(1, 1, 32),
+		SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+		SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(0, 0, INT32_MAX),
+		SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(0),
+		SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+	spa_assert(tmpl != NULL);
+
+	size_offset = spa_pod_template_offset(tmpl, SPA_PARAM_BUFFERS_size);
+	stride_offset = spa_pod_template_offset(tmpl, SPA_PARAM_BUFFERS_stride);
+	spa_assert(size_offset != 0);
+	spa_assert(stride_offset != 0);
+	spa_assert(spa_pod_template_offset(tmpl, SPA_PARAM_BUFFERS_dataType) == 0);
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	for (i = 1; i < 4; i++) {
+		pod = spa_pod_builder_template(&b, tmpl);
+		spa_assert(pod != NULL);
+		*SPA_POD_TEMPLATE_VALUE(pod, size_offset, int32_t) = 1024 * i;
+		*SPA_POD_TEMPLATE_VALUE(pod, stride_offset, int32_t) = 4 * i;
+
+		spa_assert(spa_pod_parse_object(pod,
+			SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(&blocks),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(&stride)) == 2);
+		spa_assert(blocks == 1);
+		prop = spa_pod_find_prop(pod, NULL, SPA_PARAM_BUFFERS_size);
+		spa_assert(prop != NULL);
+		spa_assert(*(int32_t*)SPA_POD_CHOICE_VALUES(&prop->value) == (int32_t)(1024 * i));
+		spa_assert(stride == (int32_t)(4 * i));
+	}
+
+	spa_pod_builder_init(&b, buffer, 8);
+	spa_assert(spa_pod_builder_template(&b, tmpl) == NULL);
+}
+
+static void test_filter_enum(void)
+{
+	uint8_t b1[1024], b2[1024], b3[1024];
+	struct spa_pod_builder pb;
+	struct spa_pod_frame f[2];
+	struct spa_pod *p1, *p2, *res;
+	const struct spa_pod_prop *prop;
+	uint32_t i, n_vals, choice, *vals;
+
+	/* 40 ids in descending order against the odd ids, large enough for the
+	 * sorted lookup */
+	spa_pod_builder_init(&pb, b1, sizeof(b1));
+	spa_pod_builder_push_object(&pb, &f[0], SPA_TYPE_OBJECT_Format, 0);
+	spa_pod_builder_prop(&pb, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(&pb, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(&pb, 40);
+	for (i = 40; i > 0; i--)
+		spa_pod_builder_id(&pb, i);
+	spa_pod_builder_pop(&pb, &f[1]);
+	p1 = spa_pod_builder_pop(&pb, &f[0]);
+
+	spa_pod_builder_init(&pb, b2, sizeof(b2));
+	spa_pod_builder_push_object(&pb, &f[0], SPA_TYPE_OBJECT_Format, 0);
+	spa_pod_builder_prop(&pb, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(&pb, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(&pb, 1);
+	for (i = 1; i < 60; i += 2)
+		spa_pod_builder_id(&pb, i);
+	spa_pod_builder_pop(&pb, &f[1]);
+	p2 = spa_pod_builder_pop(&pb, &f[0]);
+
+	spa_pod_builder_init(&pb, b3, sizeof(b3));
+	spa_assert(spa_pod_filter(&pb, &res, p1, p2) >= 0);
+
+	prop = spa_pod_find_prop(res, NULL, SPA_FORMAT_VIDEO_format);
+	spa_assert(prop != NULL);
+	vals = SPA_POD_BODY(spa_pod_get_values(&prop->value, &n_vals, &choice));
+	spa_assert(choice == SPA_CHOICE_Enum);
+	spa_assert(n_vals == 21);
+	spa_assert(vals[0] == 39);
+	for (i = 1; i < n_vals; i++)
+		spa_assert(vals[i] == 41 - 2 * i);
+
+	/* no common values */
+	spa_pod_builder_init(&pb, b2, sizeof(b2));
+	spa_pod_builder_push_object(&pb, &f[0], SPA_TYPE_OBJECT_Format, 0);
+	spa_pod_builder_prop(&pb, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(&pb, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(&pb, 100);
+	for (i = 100; i < 120; i++)
+		spa_pod_builder_id(&pb, i);
+	spa_pod_builder_pop(&pb, &f[1]);
+	p2 = spa_pod_builder_pop(&pb, &f[0]);
+
+	spa_pod_builder_init(&pb, b3, sizeof(b3));
+	spa_assert(spa_pod_filter(&pb, &res, p1, p2) < 0);
+}
+
+static void test_parser_views(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	struct spa_pod *pod;
+	const int32_t ints[] = { 1, 2, 3, 4 };
+	const char *str;
+	const void *vals;
+	uint32_t type, n_vals;
+	int32_t i;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	pod = spa_pod_builder_add_struct(&b,
+			SPA_POD_String("unknown"),
+			SPA_POD_Array(sizeof(int32_t), SPA_TYPE_Int, 4, ints),
+			SPA_POD_String("name"),
+			SPA_POD_Int(7));
+
+	spa_pod_parser_pod(&prs, pod);
+	spa_assert(spa_pod_parser_push_struct(&prs, &f) >= 0);
+	spa_assert(spa_pod_parser_skip(&prs) == 0);
+	spa_assert(spa_pod_parser_get_string(&prs, &str) == -EINVAL);
+	spa_assert(spa_pod_parser_get_array(&prs, &type, &n_vals, &vals) == 0);
+	spa_assert(type == SPA_TYPE_Int);
+	spa_assert(n_vals == 4);
+	spa_assert(vals != ints && memcmp(vals, ints, sizeof(ints)) == 0);
+	spa_assert(spa_pod_parser_get_array(&prs, &type, &n_vals, &vals) == -EINVAL);
+	spa_assert(spa_pod_parser_get_string(&prs, &str) == 0);
+	spa_assert(strcmp(str, "name") == 0);
+	spa_assert(SPA_PTRDIFF(str, buffer) > 0 &&
+			SPA_PTRDIFF(str, buffer) < (int)sizeof(buffer));
+	spa_assert(spa_pod_parser_get_int(&prs, &i) == 0);
+	spa_assert(i == 7);
+	spa_assert(spa_pod_parser_skip(&prs) == -EPIPE);
+	spa_pod_parser_pop(&prs, &f);
+}
+
 int main(int argc, char *argv[])
 {
 	test_abi();
@@ -1532,5 +1724,9 @@ int main(int argc, char *argv[])
 	test_parser2();
 	test_static();
 	test_overflow();
+	test_filter_flags();
+	test_filter_enum();
+	test_parser_views();
+	test_template();
 	return 0;
 }
@@ -338,6 +338,48 @@ static void test_hook(void)
     spa_assert(hook_free_count == 4);
 }
 
+static void test_ringbuffer_spsc(void)
+{
+    struct spa_ringbuffer_spsc rb;
+    uint32_t idx;
+    int32_t avail;
+
+    spa_ringbuffer_spsc_init(&rb);
+    spa_assert(spa_ringbuffer_spsc_get_read_index(&rb, &idx) == 0);
+    spa_assert(idx == 0);
+
+    /* commit a batch of 3 */
+    avail = spa_ringbuffer_spsc_get_write_index(&rb, &idx, 4);
+    spa_assert(idx == 0);
+    spa_assert(avail == 0);
+    spa_ringbuffer_spsc_write_update(&rb, idx + 3);
+    spa_assert(spa_ringbuffer_spsc_get_fill(&rb) == 3);
+
+    avail = spa_ringbuffer_spsc_get_read_index(&rb, &idx);
+    spa_assert(idx == 0);
+    spa_assert(avail == 3);
+    spa_ringbuffer_spsc_read_update(&rb, idx + 1);
+
+    /* the writer does not see the read until the ring looks full */
+    avail = spa_ringbuffer_spsc_get_write_index(&rb, &idx, 4);
+    spa_assert(idx == 3);
+    spa_assert(avail == 3);
+    spa_ringbuffer_spsc_write_update(&rb, idx + 1);
+    avail = spa_ringbuffer_spsc_get_write_index(&rb, &idx, 4);
+    spa_assert(idx == 4);
+    spa_assert(avail == 3);
+
+    /* the reader uses its copy of the write index until it runs out */
+    avail = spa_ringbuffer_spsc_get_read_index(&rb, &idx);
+    spa_assert(idx == 1);
+    spa_assert(avail == 2);
+    spa_ringbuffer_spsc_read_update(&rb, idx + 2);
+    avail = spa_ringbuffer_spsc_get_read_index(&rb, &idx);
+    spa_assert(idx == 3);
+    spa_assert(avail == 1);
+    spa_assert(spa_ringbuffer_spsc_get_fill(&rb) == 1);
+}
+
 static void test_ringbuffer(void)
 {
     struct spa_ringbuffer rb;
@@ -405,5 +447,6 @@ int main(int argc, char *argv[])
     test_list();
     test_hook();
     test_ringbuffer();
+    test_ringbuffer_spsc();
     return 0;
 }
@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <dlfcn.h>
+#include <time.h>
+#include <getopt.h>
 
 #include <spa/support/plugin.h>
 #include <spa/support/log-impl.h>
@@ -51,10 +53,28 @@ struct data {
 	struct spa_loop loop;
 	struct spa_node *node;
 	struct spa_hook listener;
+
+	bool bench;
+	uint64_t enum_ns;
+	uint32_t n_results;
 };
 
-static void print_param(void *data, int seq, int res, uint32_t type, const void *result)
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void print_param(void *_data, int seq, int res, uint32_t type, const void *result)
 {
+	struct data *data = _data;
+
+	if (data->bench) {
+		data->n_results++;
+		return;
+	}
+
 	switch (type) {
 	case SPA_RESULT_TYPE_NODE_PARAMS:
 	{
@@ -84,15 +104,20 @@ inspect_node_params(struct data *data, struct spa_node *node,
 	};
 
 	for (i = 0; i < n_params; i++) {
-		printf("enumerating: %s:\n", spa_debug_type_find_name(spa_type_param, params[i].id));
+		uint64_t start;
+
+		if (!data->bench)
+			printf("enumerating: %s:\n", spa_debug_type_find_name(spa_type_param, params[i].id));
 
 		if (!SPA_FLAG_IS_SET(params[i].flags, SPA_PARAM_INFO_READ))
 			continue;
 
+		start = get_time_ns();
 		spa_zero(listener);
 		spa_node_add_listener(node, &listener, &node_events, data);
 		res = spa_node_enum_params(node, 0, params[i].id, 0, UINT32_MAX, NULL);
 		spa_hook_remove(&listener);
+		data->enum_ns += get_time_ns() - start;
 
 		if (res != 0) {
 			printf("error enum_params %d: %s", params[i].id, spa_strerror(res));
@@ -115,7 +140,10 @@ inspect_port_params(struct data *data, struct spa_node *node,
 	};
 
 	for (i = 0; i < n_params; i++) {
-		printf("param: %s: flags %c%c\n",
+		uint64_t start;
+
+		if (!data->bench)
+			printf("param: %s: flags %c%c\n",
 				spa_debug_type_find_name(spa_type_param, params[i].id),
 				params[i].flags & SPA_PARAM_INFO_READ ? 'r' : '-',
 				params[i].flags & SPA_PARAM_INFO_WRITE ? 'w' : '-');
@@ -123,7 +151,10 @@ inspect_port_params(struct data *data, struct spa_node *node,
 		if (!SPA_FLAG_IS_SET(params[i].flags, SPA_PARAM_INFO_READ))
 			continue;
 
-		printf("values:\n");
+		if (!data->bench)
+			printf("values:\n");
+
+		start = get_time_ns();
 		spa_zero(listener);
 		spa_node_add_listener(node, &listener, &node_events, data);
 		res = spa_node_port_enum_params(node, 0,
@@ -131,6 +162,7 @@ inspect_port_params(struct data *data, struct spa_node *node,
 				params[i].id, 0, UINT32_MAX,
 				NULL);
 		spa_hook_remove(&listener);
+		data->enum_ns += get_time_ns() - start;
 
 		if (res != 0) {
 			printf("error port_enum_params %d: %s", params[i].id, spa_strerror(res));
@@ -143,6 +175,12 @@ static void node_info(void *_data, const struct spa_node_info *info)
 {
 	struct data *data = _data;
 
+	if (data->bench) {
+		if (info->change_mask & SPA_NODE_CHANGE_MASK_PARAMS)
+			inspect_node_params(data, data->node, info->n_params, info->params);
+		return;
+	}
+
 	printf("node info: %08"PRIx64"\n", info->change_mask);
 	printf("max input ports: %u\n", info->max_input_ports);
 	printf("max output ports: %u\n", info->max_output_ports);
@@ -161,6 +199,13 @@ static void node_port_info(void *_data, enum spa_direction direction, uint32_t i
 {
 	struct data *data = _data;
 
+	if (data->bench) {
+		if (info != NULL && (info->change_mask & SPA_PORT_CHANGE_MASK_PARAMS))
+			inspect_port_params(data, data->node, direction, id,
+					info->n_params, info->params);
+		return;
+	}
+
 	printf(" %s port: %08x",
 		direction == SPA_DIRECTION_INPUT ? "input" : "output",
 		id);
@@ -251,21 +296,98 @@ static void inspect_factory(struct data *data, const struct spa_handle_factory *
 	}
 }
 
+/* Instantiate the factory and time each step. The info step is the
+ * time spent emitting the node and port info, the param enumeration
+ * it triggers is reported separately. */
+static void bench_factory(struct data *data, const struct spa_handle_factory *factory)
+{
+	int res;
+	size_t size;
+	struct spa_handle *handle;
+	void *interface;
+	uint64_t t1, t2, t3, t4, t5, t6;
+
+	size = spa_handle_factory_get_size(factory, NULL);
+	handle = calloc(1, size);
+	if (handle == NULL) {
+		printf("%-40s can't allocate %zu bytes\n", factory->name, size);
+		return;
+	}
+
+	data->enum_ns = 0;
+	data->n_results = 0;
+
+	t1 = get_time_ns();
+	if ((res = spa_handle_factory_init(factory, handle, NULL, data->support, data->n_support)) < 0) {
+		printf("%-40s can't make factory instance: %s\n", factory->name, spa_strerror(res));
+		free(handle);
+		return;
+	}
+	t2 = get_time_ns();
+
+	t3 = t4 = t2;
+	if (spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Node, &interface) >= 0) {
+		t3 = get_time_ns();
+		inspect_node(data, interface);
+		t4 = get_time_ns();
+	}
+
+	t5 = get_time_ns();
+	spa_handle_clear(handle);
+	t6 = get_time_ns();
+	free(handle);
+
+	printf("%-40s %8zu %10.3f %10.3f %10.3f %6u %10.3f\n",
+			factory->name, size,
+			(t2 - t1) / 1000.0,
+			(t4 - t3 - data->enum_ns) / 1000.0,
+			data->enum_ns / 1000.0, data->n_results,
+			(t6 - t5) / 1000.0);
+}
+
 static const struct spa_loop_methods impl_loop = {
 	SPA_VERSION_LOOP_METHODS,
 };
 
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options] <plugin.so>\n"
+		"  -h, --help                            Show this help\n"
+		"  -b, --bench                           Time load, init, info and param\n"
+		"                                        enumeration of each factory\n",
+		name);
+}
+
 int main(int argc, char *argv[])
 {
 	struct data data = { 0 };
-	int res;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "bench",	no_argument,		NULL, 'b' },
+		{ NULL, 0, NULL, 0}
+	};
+	int c, res;
 	void *handle;
 	spa_handle_factory_enum_func_t enum_func;
 	uint32_t index;
 	const char *str;
-
-	if (argc < 2) {
-		printf("usage: %s <plugin.so>\n", argv[0]);
+	uint64_t start;
+
+	while ((c = getopt_long(argc, argv, "hb", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'b':
+			data.bench = true;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
+		show_help(argv[0]);
 		return -1;
 	}
 
@@ -283,14 +405,21 @@ int main(int argc, char *argv[])
 	data.support[2] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, &data.loop);
 	data.n_support = 3;
 
-	if ((handle = dlopen(argv[1], RTLD_NOW)) == NULL) {
-		printf("can't load %s\n", argv[1]);
+	start = get_time_ns();
+	if ((handle = dlopen(argv[optind], RTLD_NOW)) == NULL) {
+		printf("can't load %s\n", argv[optind]);
 		return -1;
 	}
 	if ((enum_func = dlsym(handle, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
 		printf("can't find function\n");
 		return -1;
 	}
+	if (data.bench) {
+		printf("plugin load: %.3f us\n", (get_time_ns() - start) / 1000.0);
+		printf("%-40s %8s %10s %10s %10s %6s %10s\n",
+				"factory", "size", "init(us)", "info(us)",
+				"enum(us)", "params", "clear(us)");
+	}
 
 	for (index = 0;;) {
 		const struct spa_handle_factory *factory;
@@ -300,7 +429,10 @@ int main(int argc, char *argv[])
 				printf("error enum_func: %s", spa_strerror(res));
 			break;
 		}
-		inspect_factory(&data, factory);
+		if (data.bench)
+			bench_factory(&data, factory);
+		else
+			inspect_factory(&data, factory);
 	}
 	return 0;
 }
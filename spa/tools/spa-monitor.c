@@ -29,11 +29,14 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
+#include <getopt.h>
 
 #include <spa/support/log-impl.h>
 #include <spa/support/loop.h>
 #include <spa/support/plugin.h>
 #include <spa/monitor/device.h>
+#include <spa/utils/result.h>
 
 #include <spa/debug/dict.h>
 #include <spa/debug/pod.h>
@@ -53,8 +56,17 @@ struct data {
 	bool rebuild_fds;
 	struct pollfd fds[16];
 	unsigned int n_fds;
+
+	bool bench;
+	uint32_t n_objects;
 };
 
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
 
 static void inspect_info(struct data *data, const struct spa_device_object_info *info)
 {
@@ -63,6 +75,11 @@ static void inspect_info(struct data *data, const struct spa_device_object_info
 
 static void on_device_info(void *_data, const struct spa_device_info *info)
 {
+	struct data *data = _data;
+
+	if (data->bench)
+		return;
+
 	spa_debug_dict(0, info->props);
 }
 
@@ -70,6 +87,12 @@ static void on_device_object_info(void *_data, uint32_t id, const struct spa_dev
 {
 	struct data *data = _data;
 
+	if (data->bench) {
+		if (info != NULL)
+			data->n_objects++;
+		return;
+	}
+
 	if (info == NULL) {
 		fprintf(stderr, "removed: %u\n", id);
 	}
@@ -142,13 +165,78 @@ static void handle_device(struct data *data, struct spa_device *device)
 	spa_hook_remove(&listener);
 }
 
+/* Adding the listener makes the device emit its info and the objects
+ * it has found so far, this is the enumeration cost we report. */
+static void bench_device(struct data *data, const struct spa_handle_factory *factory)
+{
+	struct spa_handle *handle;
+	struct spa_hook listener;
+	void *interface;
+	size_t size;
+	uint64_t t1, t2, t3, t4, t5, t6;
+	int res;
+
+	size = spa_handle_factory_get_size(factory, NULL);
+	handle = calloc(1, size);
+	if (handle == NULL) {
+		printf("%-40s can't allocate %zu bytes\n", factory->name, size);
+		return;
+	}
+
+	t1 = get_time_ns();
+	if ((res = spa_handle_factory_init(factory, handle, NULL, data->support,
+					   data->n_support)) < 0) {
+		printf("%-40s can't make factory instance: %s\n", factory->name, spa_strerror(res));
+		free(handle);
+		return;
+	}
+	t2 = get_time_ns();
+
+	data->n_objects = 0;
+	t3 = t4 = t2;
+	if (spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Device, &interface) >= 0) {
+		t3 = get_time_ns();
+		spa_zero(listener);
+		spa_device_add_listener((struct spa_device *)interface,
+				&listener, &impl_device_events, data);
+		t4 = get_time_ns();
+		spa_hook_remove(&listener);
+	}
+
+	t5 = get_time_ns();
+	spa_handle_clear(handle);
+	t6 = get_time_ns();
+	free(handle);
+
+	printf("%-40s %8zu %10.3f %10.3f %8u %10.3f\n",
+			factory->name, size,
+			(t2 - t1) / 1000.0,
+			(t4 - t3) / 1000.0, data->n_objects,
+			(t6 - t5) / 1000.0);
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options] <plugin.so>\n"
+		"  -h, --help                            Show this help\n"
+		"  -b, --bench                           Time load, init and object\n"
+		"                                        enumeration of each device\n",
+		name);
+}
+
 int main(int argc, char *argv[])
 {
 	struct data data = { 0 };
-	int res;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "bench",	no_argument,		NULL, 'b' },
+		{ NULL, 0, NULL, 0}
+	};
+	int c, res;
 	void *handle;
 	spa_handle_factory_enum_func_t enum_func;
 	uint32_t fidx;
+	uint64_t start;
 
 	data.log = &default_log.log;
 	data.main_loop.iface = SPA_INTERFACE_INIT(
@@ -160,19 +248,39 @@ int main(int argc, char *argv[])
 	data.support[2] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Loop, &data.main_loop);
 	data.n_support = 3;
 
-	if (argc < 2) {
-		printf("usage: %s <plugin.so>\n", argv[0]);
+	while ((c = getopt_long(argc, argv, "hb", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'b':
+			data.bench = true;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
+		show_help(argv[0]);
 		return -1;
 	}
 
-	if ((handle = dlopen(argv[1], RTLD_NOW)) == NULL) {
-		printf("can't load %s\n", argv[1]);
+	start = get_time_ns();
+	if ((handle = dlopen(argv[optind], RTLD_NOW)) == NULL) {
+		printf("can't load %s\n", argv[optind]);
 		return -1;
 	}
 	if ((enum_func = dlsym(handle, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
 		printf("can't find function\n");
 		return -1;
 	}
+	if (data.bench) {
+		printf("plugin load: %.3f us\n", (get_time_ns() - start) / 1000.0);
+		printf("%-40s %8s %10s %10s %8s %10s\n",
+				"factory", "size", "init(us)", "enum(us)",
+				"objects", "clear(us)");
+	}
 
 	for (fidx = 0;;) {
 		const struct spa_handle_factory *factory;
@@ -194,7 +302,10 @@ int main(int argc, char *argv[])
 				break;
 			}
 
-			if (info->type == SPA_TYPE_INTERFACE_Device) {
+			if (info->type == SPA_TYPE_INTERFACE_Device && data.bench) {
+				bench_device(&data, factory);
+			}
+			else if (info->type == SPA_TYPE_INTERFACE_Device) {
 				struct spa_handle *handle;
 				void *interface;
 
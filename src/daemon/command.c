@@ -31,6 +31,9 @@
 
 #include <pipewire/utils.h>
 #include <pipewire/module.h>
+#include <pipewire/link.h>
+#include <pipewire/keys.h>
+#include <pipewire/type.h>
 #include <pipewire/private.h>
 
 #include "command.h"
@@ -42,6 +45,7 @@ static struct pw_command *parse_command_set_prop(struct pw_properties *propertie
 static struct pw_command *parse_command_add_spa_lib(struct pw_properties *properties, const char *line, char **err);
 static struct pw_command *parse_command_module_load(struct pw_properties *properties, const char *line, char **err);
 static struct pw_command *parse_command_exec(struct pw_properties *properties, const char *line, char **err);
+static struct pw_command *parse_command_link_nodes(struct pw_properties *properties, const char *line, char **err);
 
 struct impl {
 	struct pw_command this;
@@ -61,6 +65,7 @@ static const struct command_parse parsers[] = {
 	{"add-spa-lib", "Add a library that provides a spa factory name regex", parse_command_add_spa_lib},
 	{"load-module", "Load a module", parse_command_module_load},
 	{"exec", "Execute a program", parse_command_exec},
+	{"link-nodes", "Link two nodes by name or id", parse_command_link_nodes},
 	{NULL, NULL, NULL }
 };
 
@@ -259,6 +264,142 @@ no_mem:
 	return NULL;
 }
 
+struct find_node {
+	const char *name;
+	uint32_t id;
+	struct pw_node *node;
+};
+
+static int find_node_global(void *data, struct pw_global *global)
+{
+	struct find_node *find = data;
+	struct pw_node *node;
+	const char *str;
+
+	if (pw_global_get_type(global) != PW_TYPE_INTERFACE_Node)
+		return 0;
+
+	node = pw_global_get_object(global);
+	if (find->id != SPA_ID_INVALID) {
+		if (node->info.id != find->id)
+			return 0;
+	} else {
+		str = pw_properties_get(pw_node_get_properties(node), PW_KEY_NODE_NAME);
+		if (str == NULL || strcmp(str, find->name) != 0)
+			return 0;
+	}
+	find->node = node;
+	return 1;
+}
+
+static struct pw_node *find_node(struct pw_core *core, const char *name)
+{
+	struct find_node find = { name, SPA_ID_INVALID, NULL };
+	char *end;
+	unsigned long id;
+
+	id = strtoul(name, &end, 10);
+	if (*name != '\0' && *end == '\0')
+		find.id = id;
+
+	pw_core_for_each_global(core, find_node_global, &find);
+	return find.node;
+}
+
+static struct pw_port *get_port(struct pw_node *node, enum pw_direction direction)
+{
+	struct pw_port *p;
+	uint32_t port_id;
+
+	p = pw_node_find_port(node, direction, SPA_ID_INVALID);
+	if (p != NULL && !pw_port_is_linked(p))
+		return p;
+
+	if ((port_id = pw_node_get_free_port_id(node, direction)) == SPA_ID_INVALID)
+		return NULL;
+	if ((p = pw_port_new(direction, port_id, NULL, 0)) == NULL)
+		return NULL;
+	if (pw_port_add(p, node) < 0)
+		return NULL;
+	return p;
+}
+
+static int
+execute_command_link_nodes(struct pw_command *command, struct pw_core *core, char **err)
+{
+	struct pw_node *output, *input;
+	struct pw_port *outport, *inport;
+	struct pw_properties *props;
+	struct pw_link *link;
+	int res;
+
+	if ((output = find_node(core, command->args[1])) == NULL) {
+		asprintf(err, "unknown output node \"%s\"", command->args[1]);
+		return -ENOENT;
+	}
+	if ((input = find_node(core, command->args[2])) == NULL) {
+		asprintf(err, "unknown input node \"%s\"", command->args[2]);
+		return -ENOENT;
+	}
+	if ((outport = get_port(output, PW_DIRECTION_OUTPUT)) == NULL ||
+	    (inport = get_port(input, PW_DIRECTION_INPUT)) == NULL) {
+		asprintf(err, "no free ports to link \"%s\" and \"%s\"",
+				command->args[1], command->args[2]);
+		return -ENOSPC;
+	}
+
+	props = command->n_args > 3 ?
+		pw_properties_new_string(command->args[3]) :
+		pw_properties_new(NULL, NULL);
+	if (props == NULL) {
+		asprintf(err, "alloc failed: %m");
+		return -errno;
+	}
+	pw_properties_set(props, PW_KEY_OBJECT_LINGER, "true");
+
+	if ((link = pw_link_new(core, outport, inport, NULL, props, 0)) == NULL) {
+		res = -errno;
+		asprintf(err, "can't link \"%s\" and \"%s\": %m",
+				command->args[1], command->args[2]);
+		return res;
+	}
+	if ((res = pw_link_register(link, NULL)) < 0) {
+		asprintf(err, "can't register link: %s", spa_strerror(res));
+		pw_link_destroy(link);
+		return res;
+	}
+	pw_log_info("linked %s -> %s", command->args[1], command->args[2]);
+	return 0;
+}
+
+static struct pw_command *parse_command_link_nodes(struct pw_properties *properties, const char *line, char **err)
+{
+	struct impl *impl;
+	struct pw_command *this;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		goto no_mem;
+
+	this = &impl->this;
+	this->func = execute_command_link_nodes;
+	this->args = pw_split_strv(line, whitespace, 4, &this->n_args);
+
+	if (this->n_args < 3)
+		goto no_nodes;
+
+	return this;
+
+no_nodes:
+	asprintf(err, "%s requires <output-node> <input-node> [<properties>]", this->args[0]);
+	pw_free_strv(this->args);
+	free(impl);
+	return NULL;
+no_mem:
+	asprintf(err, "alloc failed: %m");
+	return NULL;
+}
+
 /** Free command
  *
  * \param command a command to free
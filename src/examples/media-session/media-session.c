@@ -81,6 +81,8 @@ struct impl {
 	struct spa_list client_list;
 	struct spa_list node_list;
 	struct spa_list session_list;
+	struct spa_list dirty_list;	/* nodes to rescan */
+	struct spa_list waiting_list;	/* unlinked nodes, rescanned when a session changes */
 	int seq;
 
 	struct monitor bluez5_monitor;
@@ -134,6 +136,10 @@ struct node {
 	struct session *manager;
 	struct spa_list port_list;
 
+	struct spa_list rescan_link;	/* in dirty_list or waiting_list */
+	unsigned int dirty:1;
+	unsigned int waiting:1;
+
 	enum pw_direction direction;
 #define NODE_TYPE_UNKNOWN	0
 #define NODE_TYPE_STREAM	1
@@ -144,6 +150,8 @@ struct node {
 	uint32_t media_type;
 	uint32_t media_subtype;
 	struct spa_audio_info_raw format;
+	uint32_t min_rate;
+	uint32_t max_rate;
 };
 
 struct port {
@@ -185,6 +193,9 @@ struct session {
 
 	struct spa_source *idle_timeout;
 
+	uint32_t rate;
+	uint32_t configured_rate;
+
 	bool starting;
 	bool enabled;
 	bool busy;
@@ -224,6 +235,33 @@ static void schedule_rescan(struct impl *impl)
 		impl->seq = pw_core_proxy_sync(impl->core_proxy, 0, impl->seq);
 }
 
+static void node_unmark(struct node *node)
+{
+	if (node->dirty || node->waiting)
+		spa_list_remove(&node->rescan_link);
+	node->dirty = node->waiting = false;
+}
+
+/* only dirty nodes are evaluated in the next rescan */
+static void node_mark_dirty(struct impl *impl, struct node *node)
+{
+	if (node->dirty)
+		return;
+	node_unmark(node);
+	spa_list_append(&impl->dirty_list, &node->rescan_link);
+	node->dirty = true;
+}
+
+/* a session or target appeared or became available, try the nodes
+ * that could not be linked before again */
+static void wake_waiting(struct impl *impl)
+{
+	struct node *node;
+
+	spa_list_consume(node, &impl->waiting_list, rescan_link)
+		node_mark_dirty(impl, node);
+}
+
 static void remove_idle_timeout(struct session *sess)
 {
 	struct impl *impl = sess->impl;
@@ -275,6 +313,7 @@ static int on_node_idle(struct impl *impl, struct node *node)
 		sess->busy = false;
 		sess->exclusive = false;
 		add_idle_timeout(sess);
+		wake_waiting(impl);
 		break;
 	default:
 		break;
@@ -308,6 +347,15 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 	pw_log_debug(NAME" %p: info for node %d type %d", impl, n->obj.id, n->type);
 	n->info = pw_node_info_update(n->info, info);
 
+	if (info->change_mask & (PW_NODE_CHANGE_MASK_PROPS |
+				 PW_NODE_CHANGE_MASK_INPUT_PORTS |
+				 PW_NODE_CHANGE_MASK_OUTPUT_PORTS)) {
+		if (n->type == NODE_TYPE_DEVICE)
+			wake_waiting(impl);
+		else
+			node_mark_dirty(impl, n);
+	}
+
 	if (info->change_mask & PW_NODE_CHANGE_MASK_STATE) {
 		switch (info->state) {
 		case PW_NODE_STATE_IDLE:
@@ -324,6 +372,50 @@ static void node_event_info(void *object, const struct pw_node_info *info)
 	}
 }
 
+/* remember the rates a device can run at before the format is fixated */
+static void node_update_rates(struct node *n, const struct spa_pod *param)
+{
+	const struct spa_pod_prop *prop;
+	struct spa_pod *vals;
+	uint32_t i, n_vals, choice, min, max;
+	int32_t *v;
+
+	if ((prop = spa_pod_find_prop(param, NULL, SPA_FORMAT_AUDIO_rate)) == NULL)
+		return;
+
+	vals = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	if (vals->type != SPA_TYPE_Int || n_vals == 0)
+		return;
+
+	v = SPA_POD_BODY(vals);
+	switch (choice) {
+	case SPA_CHOICE_None:
+		min = max = v[0];
+		break;
+	case SPA_CHOICE_Range:
+	case SPA_CHOICE_Step:
+		if (n_vals < 3)
+			return;
+		min = v[1];
+		max = v[2];
+		break;
+	case SPA_CHOICE_Enum:
+		min = UINT32_MAX;
+		max = 0;
+		for (i = 1; i < n_vals; i++) {
+			min = SPA_MIN(min, (uint32_t)v[i]);
+			max = SPA_MAX(max, (uint32_t)v[i]);
+		}
+		break;
+	default:
+		return;
+	}
+	if (n->max_rate == 0 || min < n->min_rate)
+		n->min_rate = min;
+	if (max > n->max_rate)
+		n->max_rate = max;
+}
+
 static void node_event_param(void *object, int seq,
                        uint32_t id, uint32_t index, uint32_t next,
                        const struct spa_pod *param)
@@ -344,6 +436,8 @@ static void node_event_param(void *object, int seq,
 	    n->media_subtype != SPA_MEDIA_SUBTYPE_raw)
 		return;
 
+	node_update_rates(n, param);
+
 	spa_pod_object_fixate((struct spa_pod_object*)param);
 	if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
 		spa_debug_pod(2, NULL, param);
@@ -378,6 +472,7 @@ static void remove_session(struct impl *impl, struct session *sess)
 	spa_list_for_each_safe(n, t, &sess->node_list, session_link) {
 		n->session = NULL;
 		spa_list_remove(&n->session_link);
+		node_mark_dirty(impl, n);
 	}
 
 	spa_list_remove(&sess->l);
@@ -393,6 +488,7 @@ static void node_proxy_destroy(void *data)
 	pw_log_debug(NAME " %p: proxy destroy node %d", impl, n->obj.id);
 
 	spa_list_remove(&n->l);
+	node_unmark(n);
 
 	spa_list_for_each_safe(p, t, &n->port_list, l) {
 		spa_list_remove(&p->l);
@@ -451,6 +547,10 @@ handle_node(struct impl *impl, uint32_t id,
 	spa_list_append(&impl->node_list, &node->l);
 	node->type = NODE_TYPE_UNKNOWN;
 
+	/* the new node can be the target of a waiting node */
+	wake_waiting(impl);
+	node_mark_dirty(impl, node);
+
 	media_class = props ? spa_dict_lookup(props, PW_KEY_MEDIA_CLASS) : NULL;
 
 	pw_log_debug(NAME" %p: node "PW_KEY_MEDIA_CLASS" %s", impl, media_class);
@@ -486,6 +586,7 @@ handle_node(struct impl *impl, uint32_t id,
 			media_class += strlen("Audio/");
 		}
 		else if (strstr(media_class, "Video/") == media_class) {
+			node->media_type = SPA_MEDIA_TYPE_video;
 			media_class += strlen("Video/");
 		}
 		else
@@ -505,6 +606,7 @@ handle_node(struct impl *impl, uint32_t id,
 		sess->need_dsp = need_dsp;
 		sess->enabled = false;
 		sess->starting = need_dsp;
+		sess->rate = DEFAULT_SAMPLERATE;
 		sess->node = node;
 		if ((str = spa_dict_lookup(props, PW_KEY_NODE_PLUGGED)) != NULL)
 			sess->plugged = pw_properties_parse_uint64(str);
@@ -525,6 +627,11 @@ handle_node(struct impl *impl, uint32_t id,
 
 		pw_log_debug(NAME" %p: new session for device node %d %d", impl, id,
 				need_dsp);
+
+		/* enumerating the formats of a camera opens it and walks all
+		 * sizes and rates, leave that to the first stream that links */
+		if (node->media_type == SPA_MEDIA_TYPE_video)
+			return 1;
 	}
 	pw_node_proxy_enum_params((struct pw_node_proxy*)p,
 				0, SPA_PARAM_EnumFormat,
@@ -555,8 +662,10 @@ static void port_event_param(void *object, int seq,
 	if (id != SPA_PARAM_EnumFormat)
 		return;
 
-	if (node->manager)
+	if (node->manager && !node->manager->enabled) {
 		node->manager->enabled = true;
+		wake_waiting(p->obj.impl);
+	}
 
 	if (spa_format_parse(param, &node->media_type, &node->media_subtype) < 0)
 		return;
@@ -565,6 +674,8 @@ static void port_event_param(void *object, int seq,
 	    node->media_subtype != SPA_MEDIA_SUBTYPE_raw)
 		return;
 
+	node_update_rates(node, param);
+
 	spa_pod_fixate((struct spa_pod*)param);
 
 	if (spa_format_audio_raw_parse(param, &info) < 0)
@@ -644,7 +755,14 @@ handle_port(struct impl *impl, uint32_t id, uint32_t type,
 	pw_log_debug(NAME" %p: new port %d for node %d type %d %08x", impl, id, node_id,
 			node->type, port->flags);
 
-	if (node->type == NODE_TYPE_DEVICE) {
+	if (node->type == NODE_TYPE_DEVICE && node->media_type == SPA_MEDIA_TYPE_video) {
+		/* no formats needed, a video session is usable once it has a port */
+		if (node->manager && !node->manager->enabled) {
+			node->manager->enabled = true;
+			wake_waiting(impl);
+		}
+	}
+	else if (node->type == NODE_TYPE_DEVICE) {
 		pw_port_proxy_enum_params((struct pw_port_proxy*)p,
 				0, SPA_PARAM_EnumFormat,
 				0, -1, NULL);
@@ -781,8 +899,10 @@ registry_global_remove(void *data, uint32_t id)
 		node->manager = NULL;
 
 		spa_list_for_each(n, &impl->node_list, l) {
-			if (n->peer == node)
+			if (n->peer == node) {
 				n->peer = NULL;
+				node_mark_dirty(impl, n);
+			}
 		}
 		break;
 	}
@@ -914,6 +1034,20 @@ static int link_nodes(struct node *peer, enum pw_direction direction, struct nod
 	return 0;
 }
 
+/* an idle device runs at the rate of its first stream when it can so
+ * that the stream is not resampled */
+static uint32_t select_rate(struct node *device, struct node *node)
+{
+	uint32_t rate = node->format.rate;
+
+	if (device->media_type != SPA_MEDIA_TYPE_audio ||
+	    node->media_type != SPA_MEDIA_TYPE_audio ||
+	    rate == 0 || rate < device->min_rate || rate > device->max_rate)
+		return DEFAULT_SAMPLERATE;
+
+	return rate;
+}
+
 static void stream_set_volume(struct impl *impl, struct node *node, float volume, bool mute)
 {
 	char buf[1024];
@@ -1064,8 +1198,15 @@ static int rescan_node(struct impl *impl, struct node *node)
 	find.impl = impl;
 	find.exclusive = exclusive;
 
-	spa_list_for_each(session, &impl->session_list, l)
-		find_session(&find, session);
+	/* the session of a target is the manager of the target node */
+	if (find.path_id != SPA_ID_INVALID) {
+		if ((peer = find_object(impl, find.path_id)) != NULL &&
+		    peer->obj.type == PW_TYPE_INTERFACE_Node && peer->manager != NULL)
+			find_session(&find, peer->manager);
+	} else {
+		spa_list_for_each(session, &impl->session_list, l)
+			find_session(&find, session);
+	}
 
 	if (find.sess == NULL && find.path_id != SPA_ID_INVALID) {
 		pw_log_debug(NAME " %p: no session found for %d, try node", impl, node->obj.id);
@@ -1112,6 +1253,17 @@ static int rescan_node(struct impl *impl, struct node *node)
 		pw_log_warn(NAME" %p: session %d busy, can't get exclusive access", impl, session->id);
 		return -EBUSY;
 	}
+	if (!session->busy && !exclusive) {
+		uint32_t rate = select_rate(session->node, node);
+		if (rate != session->rate) {
+			pw_log_info(NAME" %p: session %d switching rate %d -> %d", impl,
+					session->id, session->rate, rate);
+			session->rate = rate;
+			session->starting = true;
+			schedule_rescan(impl);
+			return 0;
+		}
+	}
 	peer = session->node;
 	session->exclusive = exclusive;
 
@@ -1133,7 +1285,7 @@ do_link_profile:
 		pw_log_debug(NAME" %p: channels: %d -> %d", impl,
 				node->format.channels, audio_info.channels);
 
-		audio_info.rate = DEFAULT_SAMPLERATE;
+		audio_info.rate = session->rate;
 
 		spa_pod_builder_init(&b, buf, sizeof(buf));
 		param = spa_format_audio_raw_build(&b, SPA_PARAM_Format, &audio_info);
@@ -1171,6 +1323,13 @@ static void rescan_session(struct impl *impl, struct session *sess)
 	if (!sess->starting)
 		return;
 
+	if (sess->configured_rate == sess->rate) {
+		/* the new ports were announced before this rescan */
+		sess->starting = false;
+		wake_waiting(impl);
+		return;
+	}
+
 	if (node->info->props == NULL) {
 		pw_log_debug(NAME " %p: node %p has no properties", impl, node);
 		return;
@@ -1183,9 +1342,10 @@ static void rescan_session(struct impl *impl, struct session *sess)
 	}
 
 	info = node->format;
-	info.rate = DEFAULT_SAMPLERATE;
+	info.rate = sess->rate;
 
-	pw_log_debug(NAME" %p: setting profile for session %d %d", impl, sess->id, sess->direction);
+	pw_log_debug(NAME" %p: setting profile for session %d %d rate:%d", impl,
+			sess->id, sess->direction, sess->rate);
 
 	spa_pod_builder_init(&b, buf, sizeof(buf));
 	param = spa_format_audio_raw_build(&b, SPA_PARAM_Format, &info);
@@ -1198,9 +1358,9 @@ static void rescan_session(struct impl *impl, struct session *sess)
 
 	pw_node_proxy_set_param((struct pw_node_proxy*)sess->node->obj.proxy,
 			SPA_PARAM_PortConfig, 0, param);
-	schedule_rescan(impl);
 
-	sess->starting = false;
+	sess->configured_rate = sess->rate;
+	schedule_rescan(impl);
 }
 
 static void do_rescan(struct impl *impl)
@@ -1213,8 +1373,17 @@ static void do_rescan(struct impl *impl)
 
 	spa_list_for_each(sess, &impl->session_list, l)
 		rescan_session(impl, sess);
-	spa_list_for_each(node, &impl->node_list, l)
+
+	spa_list_consume(node, &impl->dirty_list, rescan_link) {
+		node_unmark(node);
 		rescan_node(impl, node);
+
+		if (node->type != NODE_TYPE_DEVICE &&
+		    node->session == NULL && node->peer == NULL) {
+			spa_list_append(&impl->waiting_list, &node->rescan_link);
+			node->waiting = true;
+		}
+	}
 }
 
 static void core_done(void *data, uint32_t id, int seq)
@@ -1317,6 +1486,8 @@ int main(int argc, char *argv[])
 
 	spa_list_init(&impl.client_list);
 	spa_list_init(&impl.node_list);
+	spa_list_init(&impl.dirty_list);
+	spa_list_init(&impl.waiting_list);
 	spa_list_init(&impl.session_list);
 
 	pw_core_add_spa_lib(impl.core, "api.bluez5.*", "bluez5/libspa-bluez5");
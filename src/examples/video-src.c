@@ -104,7 +104,7 @@ static void on_timeout(void *userdata, uint64_t expirations)
 	if ((p = buf->datas[0].data) == NULL)
 		return;
 
-	if ((h = spa_buffer_find_meta_data(buf, SPA_META_Header, sizeof(*h)))) {
+	if ((h = b->header)) {
 #if 0
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
@@ -116,7 +116,7 @@ static void on_timeout(void *userdata, uint64_t expirations)
 		h->seq = data->seq++;
 		h->dts_offset = 0;
 	}
-	if ((m = spa_buffer_find_meta(buf, SPA_META_VideoDamage))) {
+	if ((m = b->damage)) {
 		struct spa_meta_region *r = spa_meta_first(m);
 
 		if (spa_meta_check(r, m)) {
@@ -127,14 +127,14 @@ static void on_timeout(void *userdata, uint64_t expirations)
 		if (spa_meta_check(r, m))
 			r->region = SPA_REGION(0,0,0,0);
 	}
-	if ((mc = spa_buffer_find_meta_data(buf, SPA_META_VideoCrop, sizeof(*mc)))) {
+	if ((mc = b->crop)) {
 		data->crop = (sin(data->accumulator) + 1.0) * 32.0;
 		mc->region.position.x = data->crop;
 		mc->region.position.y = data->crop;
 		mc->region.size.width = WIDTH - data->crop*2;
 		mc->region.size.height = HEIGHT - data->crop*2;
 	}
-	if ((mcs = spa_buffer_find_meta_data(buf, SPA_META_Cursor, sizeof(*mcs)))) {
+	if ((mcs = b->cursor)) {
 		struct spa_meta_bitmap *mb;
 		uint32_t *bitmap, color;
 
@@ -35,6 +35,9 @@ extern "C" {
 struct pw_client_node_proxy { struct spa_interface iface; };
 
 #define PW_VERSION_CLIENT_NODE			3
+/** client nodes created with this version receive the buffers and io
+ * areas of many ports in one transaction event */
+#define PW_VERSION_CLIENT_NODE_TRANSACTION	4
 
 #define PW_EXTENSION_MODULE_CLIENT_NODE		PIPEWIRE_MODULE_PREFIX "module-client-node"
 
@@ -46,6 +49,23 @@ struct pw_client_node_buffer {
 	struct spa_buffer *buffer;	/**< buffer describing metadata and buffer memory */
 };
 
+/** a port configuration in a transaction */
+struct pw_client_node_port_op {
+#define PW_CLIENT_NODE_PORT_OP_USE_BUFFERS	0	/**< like the port_use_buffers event */
+#define PW_CLIENT_NODE_PORT_OP_SET_IO		1	/**< like the port_set_io event */
+	uint32_t type;			/**< one of PW_CLIENT_NODE_PORT_OP_* */
+	enum spa_direction direction;	/**< the direction of the port */
+	uint32_t port_id;		/**< the port id */
+	uint32_t mix_id;		/**< the mixer port id */
+	uint32_t flags;			/**< buffer flags, USE_BUFFERS only */
+	uint32_t n_buffers;		/**< number of buffers, USE_BUFFERS only */
+	struct pw_client_node_buffer *buffers;	/**< the buffers, USE_BUFFERS only */
+	uint32_t id;			/**< the io area id, SET_IO only */
+	uint32_t mem_id;		/**< the memory of the io area, SET_IO only */
+	uint32_t offset;		/**< offset of the io area, SET_IO only */
+	uint32_t size;			/**< size of the io area, SET_IO only */
+};
+
 #define PW_CLIENT_NODE_PROXY_EVENT_TRANSPORT		0
 #define PW_CLIENT_NODE_PROXY_EVENT_SET_PARAM		1
 #define PW_CLIENT_NODE_PROXY_EVENT_SET_IO		2
@@ -57,11 +77,12 @@ struct pw_client_node_buffer {
 #define PW_CLIENT_NODE_PROXY_EVENT_PORT_USE_BUFFERS	8
 #define PW_CLIENT_NODE_PROXY_EVENT_PORT_SET_IO		9
 #define PW_CLIENT_NODE_PROXY_EVENT_SET_ACTIVATION	10
-#define PW_CLIENT_NODE_PROXY_EVENT_NUM			11
+#define PW_CLIENT_NODE_PROXY_EVENT_TRANSACTION		11
+#define PW_CLIENT_NODE_PROXY_EVENT_NUM			12
 
 /** \ref pw_client_node events */
 struct pw_client_node_proxy_events {
-#define PW_VERSION_CLIENT_NODE_PROXY_EVENTS		0
+#define PW_VERSION_CLIENT_NODE_PROXY_EVENTS		1
 	uint32_t version;
 	/**
 	 * Notify of a new transport area
@@ -200,6 +221,20 @@ struct pw_client_node_proxy_events {
 				uint32_t mem_id,
 				uint32_t offset,
 				uint32_t size);
+	/**
+	 * Configure the buffers and io areas of many ports
+	 *
+	 * Only sent to client nodes created with
+	 * PW_VERSION_CLIENT_NODE_TRANSACTION. The ops should be applied
+	 * in order, as if they were sent as separate port_use_buffers
+	 * and port_set_io events.
+	 *
+	 * \param n_ops the number of ops
+	 * \param ops the port configurations
+	 */
+	int (*transaction) (void *object,
+			     uint32_t n_ops,
+			     const struct pw_client_node_port_op *ops);
 };
 
 #define PW_CLIENT_NODE_PROXY_METHOD_ADD_LISTENER	0
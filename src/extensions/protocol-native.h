@@ -45,6 +45,16 @@ struct pw_protocol_native_message {
 	int seq;
 };
 
+/** the peer understands the compact encoding of sync, done, ping and pong */
+#define PW_PROTOCOL_NATIVE_FEATURE_COMPACT	(1<<0)
+
+/** compact body of the core sync, done, ping and pong messages, used
+ * instead of a pod struct when both sides have the COMPACT feature. */
+struct pw_protocol_native_compact {
+	uint32_t id;
+	int32_t seq;
+};
+
 struct pw_protocol_native_demarshal {
 	int (*func) (void *object, const struct pw_protocol_native_message *msg);
 	uint32_t permissions;
@@ -53,7 +63,7 @@ struct pw_protocol_native_demarshal {
 
 /** \ref pw_protocol_native_ext methods */
 struct pw_protocol_native_ext {
-#define PW_VERSION_PROTOCOL_NATIVE_EXT	0
+#define PW_VERSION_PROTOCOL_NATIVE_EXT	1
 	uint32_t version;
 
 	struct spa_pod_builder * (*begin_proxy) (struct pw_proxy *proxy,
@@ -73,6 +83,13 @@ struct pw_protocol_native_ext {
 
 	int (*end_resource) (struct pw_resource *resource,
 			     struct spa_pod_builder *builder);
+
+	/* since 1 */
+	uint32_t (*get_proxy_features) (struct pw_proxy *proxy);
+	int (*set_proxy_features) (struct pw_proxy *proxy, uint32_t features);
+
+	uint32_t (*get_resource_features) (struct pw_resource *resource);
+	int (*set_resource_features) (struct pw_resource *resource, uint32_t features);
 };
 
 #define pw_protocol_native_begin_proxy(p,...)		pw_protocol_ext(pw_proxy_get_protocol(p),struct pw_protocol_native_ext,begin_proxy,p,__VA_ARGS__)
@@ -85,6 +102,11 @@ struct pw_protocol_native_ext {
 #define pw_protocol_native_get_resource_fd(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,get_resource_fd,r,__VA_ARGS__)
 #define pw_protocol_native_end_resource(r,...)		pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,end_resource,r,__VA_ARGS__)
 
+#define pw_protocol_native_get_proxy_features(p)	pw_protocol_ext(pw_proxy_get_protocol(p),struct pw_protocol_native_ext,get_proxy_features,p)
+#define pw_protocol_native_set_proxy_features(p,...)	pw_protocol_ext(pw_proxy_get_protocol(p),struct pw_protocol_native_ext,set_proxy_features,p,__VA_ARGS__)
+#define pw_protocol_native_get_resource_features(r)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,get_resource_features,r)
+#define pw_protocol_native_set_resource_features(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,set_resource_features,r,__VA_ARGS__)
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
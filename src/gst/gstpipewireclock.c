@@ -48,28 +48,76 @@ gst_pipewire_clock_new (struct pw_stream *stream, GstClockTime last_time)
   return GST_CLOCK_CAST (clock);
 }
 
+/* weight of a new rate measurement, smooths out the wakeup jitter */
+#define RATE_SMOOTH	0.05
+
+/* called from the process callback, once per graph cycle. Takes the
+ * position of the cycle and stores it, with the rate of the graph
+ * clock against the monotonic clock, in the snapshot. */
+void
+gst_pipewire_clock_update (GstPipeWireClock * clock)
+{
+  struct pw_time t;
+  GstClockTime time;
+  gdouble rate;
+
+  if (clock->stream == NULL ||
+      pw_stream_get_time (clock->stream, &t) < 0 ||
+      t.rate.denom == 0 || t.now <= 0)
+    return;
+
+  if ((GstClockTime) t.now == clock->snap.nsec)
+    return;
+
+  time = gst_util_uint64_scale_int (t.ticks, GST_SECOND * t.rate.num, t.rate.denom);
+
+  rate = clock->snap.nsec != 0 ? clock->snap.rate : 1.0;
+  if (clock->snap.nsec != 0 &&
+      (GstClockTime) t.now > clock->snap.nsec &&
+      time > clock->snap.time) {
+    gdouble r = (gdouble) (time - clock->snap.time) / (t.now - clock->snap.nsec);
+    rate += (r - rate) * RATE_SMOOTH;
+    rate = CLAMP (rate, 0.5, 2.0);
+  }
+
+  g_atomic_int_inc (&clock->seq);
+  clock->snap.time = time;
+  clock->snap.nsec = t.now;
+  clock->snap.rate = rate;
+  g_atomic_int_inc (&clock->seq);
+
+  GST_LOG_OBJECT (clock, "%"PRId64", %d/%d %"PRId64" rate %f",
+		  t.ticks, t.rate.num, t.rate.denom, t.now, rate);
+}
+
 static GstClockTime
 gst_pipewire_clock_get_internal_time (GstClock * clock)
 {
   GstPipeWireClock *pclock = (GstPipeWireClock *) clock;
-  GstClockTime result;
-  struct pw_time t;
+  GstClockTime result, time, nsec;
+  gdouble rate;
+  gint seq1, seq2;
   struct timespec ts;
 
-  if (pclock->stream == NULL ||
-      pw_stream_get_time (pclock->stream, &t) < 0 ||
-      t.rate.denom == 0)
+  do {
+    seq1 = g_atomic_int_get (&pclock->seq);
+    time = pclock->snap.time;
+    nsec = pclock->snap.nsec;
+    rate = pclock->snap.rate;
+    seq2 = g_atomic_int_get (&pclock->seq);
+  } while (seq1 != seq2 || (seq1 & 1));
+
+  if (nsec == 0)
     return pclock->last_time;
 
-  result = gst_util_uint64_scale_int (t.ticks, GST_SECOND * t.rate.num, t.rate.denom);
   clock_gettime(CLOCK_MONOTONIC, &ts);
-  result += SPA_TIMESPEC_TO_NSEC(&ts) - t.now;
+  result = time + (GstClockTimeDiff) ((gdouble) GST_CLOCK_DIFF (nsec,
+          SPA_TIMESPEC_TO_NSEC(&ts)) * rate);
 
   result += pclock->time_offset;
   pclock->last_time = result;
 
-  GST_DEBUG ("%"PRId64", %d/%d %"PRId64" %"PRId64,
-		  t.ticks, t.rate.num, t.rate.denom, t.now, result);
+  GST_DEBUG ("%"PRIu64" %"PRIu64" %f %"PRIu64, time, nsec, rate, result);
 
   return result;
 }
@@ -53,6 +53,14 @@ struct _GstPipeWireClock {
   struct pw_stream *stream;
   GstClockTime last_time;
   GstClockTimeDiff time_offset;
+
+  /* written once per cycle, read with the seq lock */
+  gint seq;
+  struct {
+    GstClockTime time;
+    GstClockTime nsec;
+    gdouble rate;
+  } snap;
 };
 
 struct _GstPipeWireClockClass {
@@ -63,6 +71,7 @@ GType gst_pipewire_clock_get_type (void);
 
 GstClock *      gst_pipewire_clock_new           (struct pw_stream *stream,
 					          GstClockTime last_time);
+void            gst_pipewire_clock_update        (GstPipeWireClock *clock);
 void            gst_pipewire_clock_reset         (GstPipeWireClock *clock,
 					          GstClockTime time);
 
@@ -27,6 +27,7 @@
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include <gst/audio/audio.h>
+#include <gst/allocators/gstdmabuf.h>
 
 #include <spa/utils/type.h>
 #include <spa/param/video/format-utils.h>
@@ -872,3 +873,17 @@ gst_caps_from_format (const struct spa_pod *format)
   }
   return res;
 }
+
+/* the preferred structure of @caps is for memory:DMABuf */
+gboolean
+gst_caps_is_dmabuf (GstCaps *caps)
+{
+  GstCapsFeatures *features;
+
+  if (caps == NULL || gst_caps_is_empty (caps) || gst_caps_is_any (caps))
+    return FALSE;
+
+  features = gst_caps_get_features (caps, 0);
+  return features != NULL &&
+      gst_caps_features_contains (features, GST_CAPS_FEATURE_MEMORY_DMABUF);
+}
@@ -37,6 +37,8 @@ GPtrArray *      gst_caps_to_format_all  (GstCaps *caps, uint32_t id);
 
 GstCaps *        gst_caps_from_format    (const struct spa_pod *format);
 
+gboolean         gst_caps_is_dmabuf      (GstCaps *caps);
+
 G_END_DECLS
 
 #endif
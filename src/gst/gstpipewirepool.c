@@ -32,6 +32,8 @@
 
 #include <gst/allocators/gstfdmemory.h>
 #include <gst/allocators/gstdmabuf.h>
+#include <gst/video/gstvideometa.h>
+#include <gst/video/gstvideopool.h>
 
 #include "gstpipewirepool.h"
 
@@ -51,6 +53,12 @@ enum
 static guint pool_signals[LAST_SIGNAL] = { 0 };
 
 static GQuark pool_data_quark;
+static GQuark damage_quark;
+
+/* the damage of a frame travels as region of interest metadata of this
+ * type in GStreamer */
+#define DAMAGE_ROI_TYPE "pipewire-damage"
+#define MAX_DAMAGE 16
 
 GstPipeWirePool *
 gst_pipewire_pool_new (void)
@@ -128,6 +136,56 @@ GstPipeWirePoolData *gst_pipewire_pool_get_data (GstBuffer *buffer)
   return gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer), pool_data_quark);
 }
 
+static gboolean
+remove_damage (GstBuffer *buffer, GstMeta **meta, gpointer user_data)
+{
+  if ((*meta)->info->api == GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE &&
+      ((GstVideoRegionOfInterestMeta *) *meta)->roi_type == damage_quark)
+    *meta = NULL;
+  return TRUE;
+}
+
+/* attach the damage of the pipewire buffer to the GstBuffer, no damage
+ * metadata means that the whole frame changed */
+void gst_pipewire_pool_damage_to_buffer (GstPipeWirePoolData *data)
+{
+  struct spa_region regions[MAX_DAMAGE];
+  int i, n;
+
+  gst_buffer_foreach_meta (data->buf, remove_damage, NULL);
+
+  n = pw_stream_buffer_get_damage (data->b, regions, MAX_DAMAGE);
+  for (i = 0; i < n; i++)
+    gst_buffer_add_video_region_of_interest_meta_id (data->buf, damage_quark,
+        regions[i].position.x, regions[i].position.y,
+        regions[i].size.width, regions[i].size.height);
+}
+
+/* fill the damage of the pipewire buffer from the metadata of @buffer */
+void gst_pipewire_pool_damage_from_buffer (GstPipeWirePoolData *data, GstBuffer *buffer)
+{
+  struct spa_region regions[MAX_DAMAGE];
+  GstVideoRegionOfInterestMeta *meta;
+  gpointer state = NULL;
+  guint n = 0;
+
+  if (data->b->damage == NULL)
+    return;
+
+  while ((meta = (GstVideoRegionOfInterestMeta *) gst_buffer_iterate_meta_filtered (buffer,
+              &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    if (meta->roi_type != damage_quark)
+      continue;
+    if (n == MAX_DAMAGE) {
+      /* too many regions, let the whole frame be damaged */
+      n = 0;
+      break;
+    }
+    regions[n++] = SPA_REGION(meta->x, meta->y, meta->w, meta->h);
+  }
+  pw_stream_buffer_set_damage (data->b, regions, n);
+}
+
 #if 0
 gboolean
 gst_pipewire_pool_add_buffer (GstPipeWirePool *pool, GstBuffer *buffer)
@@ -218,6 +276,13 @@ do_start (GstBufferPool * pool)
   return TRUE;
 }
 
+static const gchar **
+get_options (GstBufferPool * pool)
+{
+  static const gchar *options[] = { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
+  return options;
+}
+
 static void
 gst_pipewire_pool_finalize (GObject * object)
 {
@@ -238,6 +303,7 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
 
   gobject_class->finalize = gst_pipewire_pool_finalize;
 
+  bufferpool_class->get_options = get_options;
   bufferpool_class->start = do_start;
   bufferpool_class->flush_start = flush_start;
   bufferpool_class->acquire_buffer = acquire_buffer;
@@ -251,6 +317,7 @@ gst_pipewire_pool_class_init (GstPipeWirePoolClass * klass)
       "debug category for pipewirepool object");
 
   pool_data_quark = g_quark_from_static_string ("GstPipeWirePoolDataQuark");
+  damage_quark = g_quark_from_static_string (DAMAGE_ROI_TYPE);
 }
 
 static void
@@ -82,6 +82,9 @@ void gst_pipewire_pool_wrap_buffer (GstPipeWirePool *pool, struct pw_buffer *buf
 
 GstPipeWirePoolData *gst_pipewire_pool_get_data (GstBuffer *buffer);
 
+void gst_pipewire_pool_damage_to_buffer (GstPipeWirePoolData *data);
+void gst_pipewire_pool_damage_from_buffer (GstPipeWirePoolData *data, GstBuffer *buffer);
+
 //gboolean        gst_pipewire_pool_add_buffer    (GstPipeWirePool *pool, GstBuffer *buffer);
 //gboolean        gst_pipewire_pool_remove_buffer (GstPipeWirePool *pool, GstBuffer *buffer);
 
@@ -47,6 +47,8 @@
 #include <spa/pod/builder.h>
 #include <spa/utils/result.h>
 
+#include <gst/video/video.h>
+
 #include "gstpipewireformat.h"
 
 GST_DEBUG_CATEGORY_STATIC (pipewire_sink_debug);
@@ -54,6 +56,8 @@ GST_DEBUG_CATEGORY_STATIC (pipewire_sink_debug);
 
 #define DEFAULT_PROP_MODE GST_PIPEWIRE_SINK_MODE_DEFAULT
 
+#define MIN_BUFFERS	2
+
 enum
 {
   PROP_0,
@@ -133,12 +137,53 @@ gst_pipewire_sink_finalize (GObject * object)
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static guint
+caps_frame_size (GstCaps *caps)
+{
+  GstVideoInfo info;
+
+  if (caps && gst_video_info_from_caps (&info, caps))
+    return GST_VIDEO_INFO_SIZE (&info);
+  return 0;
+}
+
+/* the config of the pool becomes the Buffers param of the stream when the
+ * pool is activated */
+static void
+configure_pool (GstPipeWireSink *pwsink, GstCaps *caps, guint size)
+{
+  GstBufferPool *pool = GST_BUFFER_POOL_CAST (pwsink->pool);
+  GstStructure *config;
+
+  if (gst_buffer_pool_is_active (pool))
+    return;
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps, size, MIN_BUFFERS, 0);
+  gst_buffer_pool_config_set_allocator (config, NULL, &pwsink->alloc_params);
+  if (caps_frame_size (caps) > 0)
+    gst_buffer_pool_config_add_option (config, GST_BUFFER_POOL_OPTION_VIDEO_META);
+  gst_buffer_pool_set_config (pool, config);
+}
+
 static gboolean
 gst_pipewire_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
   GstPipeWireSink *pwsink = GST_PIPEWIRE_SINK (bsink);
+  GstCaps *caps;
+  gboolean need_pool;
+  guint size;
+
+  gst_query_parse_allocation (query, &caps, &need_pool);
+  size = caps_frame_size (caps);
+
+  if (need_pool)
+    configure_pool (pwsink, caps, size);
 
-  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool), 0, 0, 0);
+  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool),
+      size, MIN_BUFFERS, 0);
+  gst_query_add_allocation_param (query, NULL, &pwsink->alloc_params);
+  gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
   return TRUE;
 }
 
@@ -231,7 +276,8 @@ pool_activated (GstPipeWirePool *pool, GstPipeWireSink *sink)
   guint size;
   guint min_buffers;
   guint max_buffers;
-  const struct spa_pod *port_params[2];
+  const struct spa_pod *port_params[3];
+  guint n_params = 2;
   struct spa_pod_builder b = { NULL };
   uint8_t buffer[1024];
   struct spa_pod_frame f;
@@ -256,6 +302,11 @@ pool_activated (GstPipeWirePool *pool, GstPipeWireSink *sink)
 					       max_buffers ? max_buffers : INT32_MAX),
       SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16),
       0);
+  /* upstream renders into our buffers, make those dmabufs */
+  if (sink->use_dmabuf)
+    spa_pod_builder_add (&b,
+        SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(1 << SPA_DATA_DmaBuf),
+        0);
   port_params[0] = spa_pod_builder_pop (&b, &f);
 
   port_params[1] = spa_pod_builder_add_object (&b,
@@ -263,9 +314,18 @@ pool_activated (GstPipeWirePool *pool, GstPipeWireSink *sink)
       SPA_PARAM_META_type, SPA_POD_Int(SPA_META_Header),
       SPA_PARAM_META_size, SPA_POD_Int(sizeof (struct spa_meta_header)));
 
+  if (caps && gst_structure_has_name (gst_caps_get_structure (caps, 0), "video/x-raw")) {
+    port_params[n_params++] = spa_pod_builder_add_object (&b,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+                                 sizeof (struct spa_meta_region) * 16,
+                                 sizeof (struct spa_meta_region) * 1,
+                                 sizeof (struct spa_meta_region) * 16));
+  }
 
   pw_thread_loop_lock (sink->main_loop);
-  pw_stream_finish_format (sink->stream, 0, port_params, 2);
+  pw_stream_finish_format (sink->stream, 0, port_params, n_params);
   pw_thread_loop_unlock (sink->main_loop);
 }
 
@@ -275,6 +335,9 @@ gst_pipewire_sink_init (GstPipeWireSink * sink)
   sink->pool =  gst_pipewire_pool_new ();
   sink->client_name = g_strdup(pw_get_client_name());
   sink->mode = DEFAULT_PROP_MODE;
+  /* same as the align of the Buffers param */
+  gst_allocation_params_init (&sink->alloc_params);
+  sink->alloc_params.align = 15;
   sink->fd = -1;
 
   g_signal_connect (sink->pool, "activated", G_CALLBACK (pool_activated), sink);
@@ -430,6 +493,7 @@ do_send_buffer (GstPipeWireSink *pwsink)
   gboolean res;
   guint i;
   struct spa_buffer *b;
+  GstVideoMeta *meta;
 
   buffer = g_queue_pop_head (&pwsink->queue);
   if (buffer == NULL) {
@@ -446,11 +510,15 @@ do_send_buffer (GstPipeWireSink *pwsink)
     data->header->pts = GST_BUFFER_PTS (buffer);
     data->header->dts_offset = GST_BUFFER_DTS (buffer);
   }
+  meta = gst_buffer_get_video_meta (buffer);
   for (i = 0; i < b->n_datas; i++) {
     struct spa_data *d = &b->datas[i];
     GstMemory *mem = gst_buffer_peek_memory (buffer, i);
     d->chunk->offset = mem->offset - data->offset;
     d->chunk->size = mem->size;
+    /* upstream wrote into our buffer with its own layout */
+    if (meta && i < meta->n_planes)
+      d->chunk->stride = meta->stride[i];
   }
 
   if ((res = pw_stream_queue_buffer (pwsink->stream, data->b)) < 0) {
@@ -524,6 +592,9 @@ gst_pipewire_sink_setcaps (GstBaseSink * bsink, GstCaps * caps)
 
   pwsink = GST_PIPEWIRE_SINK (bsink);
 
+  pwsink->use_dmabuf = gst_caps_is_dmabuf (caps);
+  GST_DEBUG_OBJECT (pwsink, "use dmabuf %d", pwsink->use_dmabuf);
+
   possible = gst_caps_to_format_all (caps, SPA_PARAM_EnumFormat);
 
   pw_thread_loop_lock (pwsink->main_loop);
@@ -596,18 +667,29 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     GstBuffer *b = NULL;
     GstMapInfo info = { 0, };
 
-    if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pwsink->pool)))
+    if (!gst_buffer_pool_is_active (GST_BUFFER_POOL_CAST (pwsink->pool))) {
+      GstCaps *caps = gst_pad_get_current_caps (GST_BASE_SINK_PAD (bsink));
+      configure_pool (pwsink, caps, gst_buffer_get_size (buffer));
+      if (caps)
+        gst_caps_unref (caps);
       gst_buffer_pool_set_active (GST_BUFFER_POOL_CAST (pwsink->pool), TRUE);
+    }
 
     if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
       goto done;
 
+    /* dmabufs only pass without a copy when they come from our pool */
+    if (pwsink->use_dmabuf)
+      GST_LOG_OBJECT (pwsink, "copying buffer %p from another pool", buffer);
+
     gst_buffer_map (b, &info, GST_MAP_WRITE);
     gst_buffer_extract (buffer, 0, info.data, info.size);
     gst_buffer_unmap (b, &info);
     gst_buffer_resize (b, 0, gst_buffer_get_size (buffer));
+    gst_pipewire_pool_damage_from_buffer (gst_pipewire_pool_get_data (b), buffer);
     buffer = b;
   } else {
+    gst_pipewire_pool_damage_from_buffer (gst_pipewire_pool_get_data (buffer), buffer);
     gst_buffer_ref (buffer);
   }
 
@@ -82,6 +82,8 @@ struct _GstPipeWireSink {
 
   /* video state */
   gboolean negotiated;
+  gboolean use_dmabuf;
+  GstAllocationParams alloc_params;
 
   struct pw_loop *loop;
   struct pw_thread_loop *main_loop;
@@ -394,6 +394,47 @@ on_remove_buffer (void *_data, struct pw_buffer *b)
   gst_buffer_unref (buf);
 }
 
+/* downstream can't map dmabufs to find the layout of the planes, describe
+ * it with the video meta */
+static void
+update_video_meta (GstPipeWireSrc *pwsrc, struct pw_buffer *b, GstBuffer *buf)
+{
+  GstVideoInfo *info = &pwsrc->video_info;
+  guint i, n_planes = GST_VIDEO_INFO_N_PLANES (info);
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  GstVideoMeta *meta;
+
+  if (b->buffer->n_datas == n_planes) {
+    gsize pos = 0;
+
+    /* one memory for each plane */
+    for (i = 0; i < n_planes; i++) {
+      offset[i] = pos;
+      stride[i] = b->buffer->datas[i].chunk->stride;
+      pos += gst_buffer_peek_memory (buf, i)->size;
+    }
+  } else {
+    for (i = 0; i < n_planes; i++) {
+      offset[i] = GST_VIDEO_INFO_PLANE_OFFSET (info, i);
+      stride[i] = GST_VIDEO_INFO_PLANE_STRIDE (info, i);
+    }
+    if (b->buffer->n_datas > 0 && b->buffer->datas[0].chunk->stride != 0)
+      stride[0] = b->buffer->datas[0].chunk->stride;
+  }
+
+  if ((meta = gst_buffer_get_video_meta (buf)) == NULL) {
+    gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_INFO_FORMAT (info), GST_VIDEO_INFO_WIDTH (info),
+        GST_VIDEO_INFO_HEIGHT (info), n_planes, offset, stride);
+  } else {
+    for (i = 0; i < n_planes; i++) {
+      meta->offset[i] = offset[i];
+      meta->stride[i] = stride[i];
+    }
+  }
+}
+
 static void
 on_process (void *_data)
 {
@@ -404,6 +445,9 @@ on_process (void *_data)
   struct spa_meta_header *h;
   guint i;
 
+  if (pwsrc->clock)
+    gst_pipewire_clock_update (GST_PIPEWIRE_CLOCK (pwsrc->clock));
+
   b = pw_stream_dequeue_buffer (pwsrc->stream);
   if (b == NULL)
 	  return;
@@ -434,6 +478,9 @@ on_process (void *_data)
     mem->size = SPA_MIN(d->chunk->size, d->maxsize - mem->offset);
     mem->offset += data->offset;
   }
+  if (pwsrc->use_dmabuf && pwsrc->is_video)
+    update_video_meta (pwsrc, b, buf);
+  gst_pipewire_pool_damage_to_buffer (data);
 
   gst_buffer_ref (buf);
   g_queue_push_tail (&pwsrc->queue, buf);
@@ -595,6 +642,11 @@ gst_pipewire_src_negotiate (GstBaseSrc * basesrc)
 
   GST_DEBUG_OBJECT (basesrc, "have common caps: %" GST_PTR_FORMAT, caps);
 
+  /* hand out the dmabufs as they are when downstream prefers them,
+   * always-copy maps them anyway */
+  pwsrc->use_dmabuf = !pwsrc->always_copy && gst_caps_is_dmabuf (caps);
+  GST_DEBUG_OBJECT (basesrc, "use dmabuf %d", pwsrc->use_dmabuf);
+
   /* open a connection with these caps */
   possible = gst_caps_to_format_all (caps, SPA_PARAM_EnumFormat);
   gst_caps_unref (caps);
@@ -691,7 +743,7 @@ on_format_changed (void *data,
 {
   GstPipeWireSrc *pwsrc = data;
   GstCaps *caps;
-  gboolean res;
+  gboolean res, is_video;
 
   if (format == NULL) {
     GST_DEBUG_OBJECT (pwsrc, "clear format");
@@ -702,31 +754,55 @@ on_format_changed (void *data,
   gst_pipewire_clock_reset (GST_PIPEWIRE_CLOCK (pwsrc->clock), 0);
 
   caps = gst_caps_from_format (format);
+  is_video = gst_structure_has_name (gst_caps_get_structure (caps, 0), "video/x-raw");
+  pwsrc->is_video = is_video && gst_video_info_from_caps (&pwsrc->video_info, caps);
+  if (pwsrc->use_dmabuf)
+    gst_caps_set_features (caps, 0,
+        gst_caps_features_new (GST_CAPS_FEATURE_MEMORY_DMABUF, NULL));
+
   GST_DEBUG_OBJECT (pwsrc, "we got format %" GST_PTR_FORMAT, caps);
   res = gst_base_src_set_caps (GST_BASE_SRC (pwsrc), caps);
   gst_caps_unref (caps);
 
   if (res) {
-    const struct spa_pod *params[2];
+    const struct spa_pod *params[3];
+    struct spa_pod_frame f;
     struct spa_pod_builder b = { NULL };
     uint8_t buffer[512];
+    guint n_params = 2;
 
     spa_pod_builder_init (&b, buffer, sizeof (buffer));
-    params[0] = spa_pod_builder_add_object (&b,
-	SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+    spa_pod_builder_push_object (&b, &f, SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers);
+    spa_pod_builder_add (&b,
 	SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(16, 1, INT32_MAX),
 	SPA_PARAM_BUFFERS_blocks,  SPA_POD_CHOICE_RANGE_Int(0, 1, INT32_MAX),
 	SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(0, 0, INT32_MAX),
 	SPA_PARAM_BUFFERS_stride,  SPA_POD_CHOICE_RANGE_Int(0, 0, INT32_MAX),
-	SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+	SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16),
+	0);
+    if (pwsrc->use_dmabuf)
+      spa_pod_builder_add (&b,
+          SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(1 << SPA_DATA_DmaBuf),
+          0);
+    params[0] = spa_pod_builder_pop (&b, &f);
 
     params[1] = spa_pod_builder_add_object (&b,
 	SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
         SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
         SPA_PARAM_META_size, SPA_POD_Int(sizeof (struct spa_meta_header)));
 
+    if (is_video) {
+      params[n_params++] = spa_pod_builder_add_object (&b,
+          SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+          SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+          SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+                                   sizeof (struct spa_meta_region) * 16,
+                                   sizeof (struct spa_meta_region) * 1,
+                                   sizeof (struct spa_meta_region) * 16));
+    }
+
     GST_DEBUG_OBJECT (pwsrc, "doing finish format");
-    pw_stream_finish_format (pwsrc->stream, 0, params, 2);
+    pw_stream_finish_format (pwsrc->stream, 0, params, n_params);
   } else {
     GST_WARNING_OBJECT (pwsrc, "finish format with error");
     pw_stream_finish_format (pwsrc->stream, -EINVAL, NULL, 0);
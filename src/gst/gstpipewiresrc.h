@@ -27,6 +27,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
 
 #include <pipewire/pipewire.h>
 #include <gst/gstpipewirepool.h>
@@ -67,6 +68,10 @@ struct _GstPipeWireSrc {
   gboolean flushing;
   gboolean started;
 
+  gboolean use_dmabuf;
+  gboolean is_video;
+  GstVideoInfo video_info;
+
   gboolean is_live;
   GstClockTime min_latency;
   GstClockTime max_latency;
@@ -0,0 +1,745 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+#include "config.h"
+
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/ringbuffer.h>
+
+#include <pipewire/pipewire.h>
+#include "pipewire/private.h"
+
+#define NAME "bridge"
+
+#define MODULE_USAGE	"["PW_KEY_NODE_NAME"=<name>] "			\
+			"["PW_KEY_AUDIO_CHANNELS"=<channels>] "		\
+			"["PW_KEY_AUDIO_RATE"=<rate>] "			\
+			"[bridge.latency=<samples>]"
+
+static const struct spa_dict_item module_props[] = {
+	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ PW_KEY_MODULE_DESCRIPTION, "Bridge audio between two drivers with rate matching" },
+	{ PW_KEY_MODULE_USAGE, MODULE_USAGE },
+	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
+};
+
+#define DEFAULT_NAME		"bridge"
+#define DEFAULT_CHANNELS	2
+#define DEFAULT_RATE		48000
+#define DEFAULT_LATENCY		1024
+
+#define MAX_CHANNELS	64
+#define MAX_BUFFERS	32
+#define MAX_SAMPLES	8192u
+#define RING_SAMPLES	(1u << 15)	/* per channel, power of 2 */
+#define RING_MASK	(RING_SAMPLES - 1)
+
+/* the rate correction of the level controller, in addition to the
+ * ratio of the measured clock rates */
+#define CORR_KP		0.5
+#define CORR_KI		0.05
+#define CORR_MAX	0.005
+
+struct buffer {
+	struct spa_list link;
+	struct spa_buffer *buffer;
+	uint32_t id;
+};
+
+struct side {
+	struct impl *impl;
+	enum spa_direction direction;
+
+	struct pw_node *node;
+	struct spa_hook node_listener;
+
+	struct spa_node impl_node;
+	struct spa_hook_list hooks;
+
+	struct spa_node_info info;
+	struct spa_param_info node_params[1];
+	struct spa_port_info port_info;
+	struct spa_param_info params[5];
+
+	struct spa_io_position *position;
+	struct spa_io_buffers *io;
+
+	bool have_format;
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	struct spa_list empty;
+};
+
+struct impl {
+	struct pw_core *core;
+	struct pw_module *module;
+	struct spa_hook module_listener;
+	struct pw_properties *props;
+
+	uint32_t channels;
+	uint32_t rate;
+	uint32_t latency;
+
+	struct side sink;		/**< input, follows the driver of the capture side */
+	struct side source;		/**< output, follows the driver of the playback side */
+
+	/* written by the sink */
+	struct spa_ringbuffer ring;
+	float *data[MAX_CHANNELS];
+	uint64_t write_nsec;		/**< clock time of the sink driver at the last write */
+	double write_rate;		/**< measured rate of the sink driver */
+	uint32_t overruns;
+
+	/* owned by the source */
+	double phase;			/**< fractional read position */
+	double integral;
+	bool resync;
+	uint32_t underruns;
+};
+
+static void emit_port_info(struct side *s, bool full)
+{
+	if (full)
+		s->port_info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	if (s->port_info.change_mask) {
+		spa_node_emit_port_info(&s->hooks, s->direction, 0, &s->port_info);
+		s->port_info.change_mask = 0;
+	}
+}
+
+static int impl_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct side *s = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&s->hooks, &save, listener, events, data);
+
+	s->info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS | SPA_NODE_CHANGE_MASK_PARAMS;
+	spa_node_emit_info(&s->hooks, &s->info);
+	s->info.change_mask = 0;
+	emit_port_info(s, true);
+
+	spa_hook_list_join(&s->hooks, &save);
+	return 0;
+}
+
+static int impl_set_callbacks(void *object,
+			      const struct spa_node_callbacks *callbacks, void *data)
+{
+	return 0;
+}
+
+static int impl_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	struct side *s = object;
+
+	switch (id) {
+	case SPA_IO_Position:
+		s->position = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_send_command(void *object, const struct spa_command *command)
+{
+	struct side *s = object;
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (s->direction == SPA_DIRECTION_OUTPUT)
+			s->impl->resync = true;
+		break;
+	case SPA_NODE_COMMAND_Pause:
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static int impl_port_set_io(void *object, enum spa_direction direction, uint32_t port_id,
+			    uint32_t id, void *data, size_t size)
+{
+	struct side *s = object;
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		s->io = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_port_enum_params(void *object, int seq,
+				 enum spa_direction direction, uint32_t port_id,
+				 uint32_t id, uint32_t start, uint32_t num,
+				 const struct spa_pod *filter)
+{
+	struct side *s = object;
+	struct impl *impl = s->impl;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+	case SPA_PARAM_Format:
+		if (result.index != 0)
+			return 0;
+		if (id == SPA_PARAM_Format && !s->have_format)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, id,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
+			SPA_FORMAT_AUDIO_channels, SPA_POD_Int(impl->channels),
+			SPA_FORMAT_AUDIO_rate,     SPA_POD_Int(impl->rate));
+		break;
+
+	case SPA_PARAM_Buffers:
+		if (result.index != 0 || !s->have_format)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(impl->channels),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+							MAX_SAMPLES * sizeof(float),
+							16 * sizeof(float),
+							MAX_SAMPLES * sizeof(float)),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(sizeof(float)),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+
+	case SPA_PARAM_IO:
+		if (result.index != 0)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamIO, id,
+			SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+			SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+		break;
+
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&s->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int port_set_format(struct side *s, const struct spa_pod *format)
+{
+	struct impl *impl = s->impl;
+	struct spa_audio_info_raw info = { 0 };
+
+	if (format == NULL) {
+		s->have_format = false;
+		s->n_buffers = 0;
+	} else {
+		if (spa_format_audio_raw_parse(format, &info) < 0)
+			return -EINVAL;
+		if (info.format != SPA_AUDIO_FORMAT_F32P ||
+		    info.channels != impl->channels ||
+		    info.rate != impl->rate)
+			return -EINVAL;
+		s->have_format = true;
+	}
+
+	s->port_info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (s->have_format) {
+		s->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		s->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		s->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		s->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(s, false);
+
+	return 0;
+}
+
+static int impl_port_set_param(void *object,
+			       enum spa_direction direction, uint32_t port_id,
+			       uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	struct side *s = object;
+
+	if (id == SPA_PARAM_Format)
+		return port_set_format(s, param);
+	return -ENOENT;
+}
+
+static int impl_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t flags,
+		struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct side *s = object;
+	uint32_t i;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	spa_list_init(&s->empty);
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &s->buffers[i];
+
+		if (buffers[i]->n_datas < s->impl->channels)
+			return -EINVAL;
+
+		b->buffer = buffers[i];
+		b->id = i;
+		spa_list_append(&s->empty, &b->link);
+	}
+	s->n_buffers = n_buffers;
+	return 0;
+}
+
+static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct side *s = object;
+
+	if (buffer_id < s->n_buffers)
+		spa_list_append(&s->empty, &s->buffers[buffer_id].link);
+	return 0;
+}
+
+/* the sink writes the samples of its driver in the ringbuffer and
+ * remembers when it did so */
+static int sink_process(struct side *s)
+{
+	struct impl *impl = s->impl;
+	struct spa_io_buffers *io = s->io;
+	struct spa_buffer *buf;
+	uint32_t i, index, n_samples;
+	int32_t filled;
+
+	if (io == NULL || io->status != SPA_STATUS_HAVE_DATA || io->buffer_id >= s->n_buffers)
+		return SPA_STATUS_NEED_DATA;
+
+	buf = s->buffers[io->buffer_id].buffer;
+	n_samples = buf->datas[0].chunk->size / sizeof(float);
+
+	filled = spa_ringbuffer_get_write_index(&impl->ring, &index);
+	if (filled < 0 || (uint32_t)filled + n_samples > RING_SAMPLES) {
+		/* the source side is not reading, drop the samples and make
+		 * the source skip ahead when it comes back */
+		impl->overruns++;
+		pw_log_trace_fp(NAME" %p: overrun %d", impl, filled);
+		goto done;
+	}
+
+	for (i = 0; i < impl->channels; i++) {
+		struct spa_data *d = &buf->datas[i];
+
+		if (d->data == NULL)
+			continue;
+		spa_ringbuffer_write_data(&impl->ring,
+				impl->data[i], RING_SAMPLES * sizeof(float),
+				(index & RING_MASK) * sizeof(float),
+				SPA_MEMBER(d->data, d->chunk->offset, void),
+				SPA_MIN(d->chunk->size, n_samples * sizeof(float)));
+	}
+	spa_ringbuffer_write_update(&impl->ring, index + n_samples);
+
+	if (s->position) {
+		double rate_diff = s->position->clock.rate_diff;
+		double rate = impl->rate * (rate_diff > 0.0 ? rate_diff : 1.0);
+		__atomic_store(&impl->write_rate, &rate, __ATOMIC_RELAXED);
+		__atomic_store_n(&impl->write_nsec, s->position->clock.nsec, __ATOMIC_RELEASE);
+	}
+done:
+	io->status = SPA_STATUS_NEED_DATA;
+	return SPA_STATUS_NEED_DATA;
+}
+
+static inline float cubic(const float *d, uint32_t i, float t)
+{
+	float xm1 = d[(i - 1) & RING_MASK], x0 = d[i & RING_MASK];
+	float x1 = d[(i + 1) & RING_MASK], x2 = d[(i + 2) & RING_MASK];
+	float c = (x1 - xm1) * 0.5f;
+	float v = x0 - x1;
+	float w = c + v;
+	float a = w + v + (x2 - x0) * 0.5f;
+	float b = w + a;
+	return ((a * t - b) * t + c) * t + x0;
+}
+
+/* Calculate the resample ratio for the next cycle of the source. The
+ * ratio of the measured rates of both drivers is corrected with a PI
+ * controller on the fill level of the ringbuffer. The fill level includes
+ * the samples that the sink driver produced since its last cycle. */
+static double update_ratio(struct impl *impl, int32_t avail, uint32_t n_samples)
+{
+	struct spa_io_position *pos = impl->source.position;
+	double read_rate, write_rate, level, err, corr, dt;
+	uint64_t write_nsec;
+
+	write_nsec = __atomic_load_n(&impl->write_nsec, __ATOMIC_ACQUIRE);
+	__atomic_load(&impl->write_rate, &write_rate, __ATOMIC_RELAXED);
+	read_rate = impl->rate * (pos->clock.rate_diff > 0.0 ? pos->clock.rate_diff : 1.0);
+	if (write_rate <= 0.0)
+		write_rate = impl->rate;
+
+	level = avail - impl->phase;
+	if (pos->clock.nsec > write_nsec)
+		level += (pos->clock.nsec - write_nsec) * write_rate / SPA_NSEC_PER_SEC;
+
+	dt = (double)n_samples / impl->rate;
+	err = (level - impl->latency) / impl->rate;
+
+	impl->integral = SPA_CLAMP(impl->integral + err * dt * CORR_KI, -CORR_MAX, CORR_MAX);
+	corr = SPA_CLAMP(err * CORR_KP + impl->integral, -CORR_MAX, CORR_MAX);
+
+	pw_log_trace_fp(NAME" %p: level:%f err:%f corr:%f", impl, level, err, corr);
+
+	return (write_rate / read_rate) * (1.0 + corr);
+}
+
+/* the source resamples the samples of the sink to the clock of its own
+ * driver */
+static int source_process(struct side *s)
+{
+	struct impl *impl = s->impl;
+	struct spa_io_buffers *io = s->io;
+	struct buffer *b;
+	uint32_t i, j, index, n_samples, consumed, start;
+	int32_t avail;
+	double ratio, phase;
+
+	if (io == NULL || s->position == NULL)
+		return -EIO;
+
+	if (io->buffer_id < s->n_buffers) {
+		impl_port_reuse_buffer(s, 0, io->buffer_id);
+		io->buffer_id = SPA_ID_INVALID;
+	}
+	if (spa_list_is_empty(&s->empty)) {
+		pw_log_trace_fp(NAME" %p: out of buffers", impl);
+		return -EPIPE;
+	}
+	b = spa_list_first(&s->empty, struct buffer, link);
+	spa_list_remove(&b->link);
+
+	n_samples = SPA_MIN(s->position->clock.duration, MAX_SAMPLES);
+	n_samples = SPA_MIN(n_samples, b->buffer->datas[0].maxsize / sizeof(float));
+
+	avail = spa_ringbuffer_get_read_index(&impl->ring, &index);
+
+	if (impl->resync || avail > (int32_t)RING_SAMPLES) {
+		/* skip to the target latency */
+		if (avail > (int32_t)impl->latency) {
+			index += avail - impl->latency;
+			avail = impl->latency;
+		}
+		impl->phase = 0.0;
+		impl->integral = 0.0;
+		impl->resync = false;
+	}
+
+	ratio = update_ratio(impl, avail, n_samples);
+
+	/* we need 2 samples after the last interpolated one */
+	if (avail < (int32_t)(n_samples * ratio + impl->phase + 3)) {
+		impl->underruns++;
+		pw_log_trace_fp(NAME" %p: underrun %d < %u", impl, avail, n_samples);
+		for (i = 0; i < impl->channels; i++) {
+			struct spa_data *d = &b->buffer->datas[i];
+
+			if (d->data == NULL)
+				continue;
+			memset(d->data, 0, SPA_MIN(n_samples * sizeof(float), d->maxsize));
+		}
+		impl->resync = true;
+		consumed = 0;
+		goto done;
+	}
+
+	/* keep one sample of history for the interpolation */
+	start = index + 1;
+	for (i = 0; i < impl->channels; i++) {
+		float *dst = b->buffer->datas[i].data;
+
+		if (dst == NULL)
+			continue;
+
+		phase = impl->phase;
+		for (j = 0; j < n_samples; j++) {
+			uint32_t ip = (uint32_t)phase;
+			dst[j] = cubic(impl->data[i], start + ip, (float)(phase - ip));
+			phase += ratio;
+		}
+	}
+	phase = impl->phase + n_samples * ratio;
+	consumed = (uint32_t)phase;
+	impl->phase = phase - consumed;
+
+done:
+	spa_ringbuffer_read_update(&impl->ring, index + consumed);
+
+	for (i = 0; i < impl->channels; i++) {
+		struct spa_data *d = &b->buffer->datas[i];
+		d->chunk->offset = 0;
+		d->chunk->size = n_samples * sizeof(float);
+		d->chunk->stride = sizeof(float);
+	}
+	io->buffer_id = b->id;
+	io->status = SPA_STATUS_HAVE_DATA;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static int impl_node_process(void *object)
+{
+	struct side *s = object;
+
+	if (s->direction == SPA_DIRECTION_INPUT)
+		return sink_process(s);
+	else
+		return source_process(s);
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_add_listener,
+	.set_callbacks = impl_set_callbacks,
+	.set_io = impl_set_io,
+	.send_command = impl_send_command,
+	.port_set_io = impl_port_set_io,
+	.port_enum_params = impl_port_enum_params,
+	.port_set_param = impl_port_set_param,
+	.port_use_buffers = impl_port_use_buffers,
+	.port_reuse_buffer = impl_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static void node_destroy(void *data)
+{
+	struct side *s = data;
+	spa_hook_remove(&s->node_listener);
+	s->node = NULL;
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.destroy = node_destroy,
+};
+
+static int make_side(struct impl *impl, struct side *s, enum spa_direction direction)
+{
+	struct pw_properties *props;
+	const char *name;
+	int res;
+
+	s->impl = impl;
+	s->direction = direction;
+	spa_hook_list_init(&s->hooks);
+	spa_list_init(&s->empty);
+	s->impl_node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, s);
+
+	s->info = SPA_NODE_INFO_INIT();
+	s->info.max_input_ports = direction == SPA_DIRECTION_INPUT ? 1 : 0;
+	s->info.max_output_ports = direction == SPA_DIRECTION_OUTPUT ? 1 : 0;
+	s->info.flags = SPA_NODE_FLAG_RT;
+	s->info.params = s->node_params;
+	s->info.n_params = 0;
+
+	s->port_info = SPA_PORT_INFO_INIT();
+	s->port_info.flags = 0;
+	s->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	s->params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, 0);
+	s->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	s->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	s->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	s->port_info.params = s->params;
+	s->port_info.n_params = 5;
+
+	name = pw_properties_get(impl->props, PW_KEY_NODE_NAME);
+	if (name == NULL)
+		name = DEFAULT_NAME;
+
+	props = pw_properties_new(
+			PW_KEY_MEDIA_TYPE, "Audio",
+			PW_KEY_MEDIA_CLASS, direction == SPA_DIRECTION_INPUT ?
+				"Audio/Sink" : "Audio/Source",
+			NULL);
+	if (props == NULL)
+		return -errno;
+	pw_properties_setf(props, PW_KEY_NODE_NAME, "%s.%s", name,
+			direction == SPA_DIRECTION_INPUT ? "sink" : "source");
+
+	s->node = pw_node_new(impl->core, props, 0);
+	if (s->node == NULL)
+		return -errno;
+
+	pw_node_add_listener(s->node, &s->node_listener, &node_events, s);
+
+	if ((res = pw_node_set_implementation(s->node, &s->impl_node)) < 0)
+		return res;
+	if ((res = pw_node_register(s->node, NULL)) < 0)
+		return res;
+
+	return pw_node_set_active(s->node, true);
+}
+
+static void impl_free(struct impl *impl)
+{
+	uint32_t i;
+
+	if (impl->source.node)
+		pw_node_destroy(impl->source.node);
+	if (impl->sink.node)
+		pw_node_destroy(impl->sink.node);
+	for (i = 0; i < impl->channels; i++)
+		free(impl->data[i]);
+	if (impl->props)
+		pw_properties_free(impl->props);
+	free(impl);
+}
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+	spa_hook_remove(&impl->module_listener);
+	impl_free(impl);
+}
+
+static const struct pw_module_events module_events = {
+	PW_VERSION_MODULE_EVENTS,
+	.destroy = module_destroy,
+};
+
+SPA_EXPORT
+int pipewire__module_init(struct pw_module *module, const char *args)
+{
+	struct pw_core *core = pw_module_get_core(module);
+	struct impl *impl;
+	const char *str;
+	uint32_t i;
+	int res;
+
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL)
+		return -errno;
+
+	pw_log_debug(NAME" %p: new %s", impl, args);
+
+	impl->core = core;
+	impl->module = module;
+
+	impl->props = args ? pw_properties_new_string(args) : pw_properties_new(NULL, NULL);
+	if (impl->props == NULL) {
+		res = -errno;
+		goto error;
+	}
+
+	if ((str = pw_properties_get(impl->props, PW_KEY_AUDIO_CHANNELS)) != NULL)
+		impl->channels = pw_properties_parse_int(str);
+	else
+		impl->channels = DEFAULT_CHANNELS;
+	if ((str = pw_properties_get(impl->props, PW_KEY_AUDIO_RATE)) != NULL)
+		impl->rate = pw_properties_parse_int(str);
+	else
+		impl->rate = DEFAULT_RATE;
+	if ((str = pw_properties_get(impl->props, "bridge.latency")) != NULL)
+		impl->latency = pw_properties_parse_int(str);
+	else
+		impl->latency = DEFAULT_LATENCY;
+
+	if (impl->channels == 0 || impl->channels > MAX_CHANNELS ||
+	    impl->rate == 0 || impl->latency == 0 || impl->latency > RING_SAMPLES / 2) {
+		pw_log_error("usage: module-bridge " MODULE_USAGE);
+		res = -EINVAL;
+		goto error;
+	}
+
+	spa_ringbuffer_init(&impl->ring);
+	for (i = 0; i < impl->channels; i++) {
+		impl->data[i] = calloc(RING_SAMPLES, sizeof(float));
+		if (impl->data[i] == NULL) {
+			res = -errno;
+			goto error;
+		}
+	}
+	impl->resync = true;
+
+	if ((res = make_side(impl, &impl->sink, SPA_DIRECTION_INPUT)) < 0 ||
+	    (res = make_side(impl, &impl->source, SPA_DIRECTION_OUTPUT)) < 0) {
+		pw_log_error(NAME" %p: can't create nodes: %s", impl, spa_strerror(res));
+		goto error;
+	}
+
+	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
+
+	pw_module_update_properties(module, &SPA_DICT_INIT_ARRAY(module_props));
+
+	return 0;
+
+error:
+	impl_free(impl);
+	return res;
+}
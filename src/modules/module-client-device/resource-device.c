@@ -48,17 +48,46 @@ struct impl {
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
 
+	struct spa_source *register_event;
+
 	unsigned int registered:1;
 };
 
+static void destroy_register_event(struct impl *impl)
+{
+	if (impl->register_event == NULL)
+		return;
+	pw_loop_destroy_source(impl->core->main_loop, impl->register_event);
+	impl->register_event = NULL;
+}
+
+static void on_register(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+
+	destroy_register_event(impl);
+	pw_device_register(impl->device, NULL);
+}
+
 static void device_info(void *data, const struct spa_device_info *info)
 {
 	struct impl *impl = data;
 	if (!impl->registered) {
-		pw_device_register(impl->device, NULL);
 		pw_device_set_implementation(impl->device,
 				(struct spa_device*)impl->resource);
 		impl->registered = true;
+
+		/* the client sends the object_info of all its objects right
+		 * after the first info. Register the device once the messages
+		 * that were received together are handled, so that the device
+		 * and its objects are announced at once instead of one global
+		 * at a time. */
+		impl->register_event = pw_loop_add_event(impl->core->main_loop,
+				on_register, impl);
+		if (impl->register_event != NULL)
+			pw_loop_signal_event(impl->core->main_loop, impl->register_event);
+		else
+			pw_device_register(impl->device, NULL);
 	}
 }
 
@@ -74,6 +103,7 @@ static void device_resource_destroy(void *data)
 	pw_log_debug("client-device %p: destroy", impl);
 
 	impl->resource = NULL;
+	destroy_register_event(impl);
 	spa_hook_remove(&impl->device_listener);
 	spa_hook_remove(&impl->resource_listener);
 	spa_hook_remove(&impl->object_listener);
@@ -92,6 +122,7 @@ static void device_destroy(void *data)
 	pw_log_debug("client-device %p: destroy", impl);
 
 	impl->device = NULL;
+	destroy_register_event(impl);
 	spa_hook_remove(&impl->device_listener);
 	spa_hook_remove(&impl->resource_listener);
 	spa_hook_remove(&impl->object_listener);
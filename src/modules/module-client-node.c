@@ -33,7 +33,9 @@
 
 #include <pipewire/pipewire.h>
 
+#ifdef HAVE_COMPAT_V0
 #include "module-client-node/v0/client-node.h"
+#endif
 #include "module-client-node/client-node.h"
 
 #define NAME "client-node"
@@ -50,7 +52,9 @@ struct pw_proxy *pw_remote_spa_node_export(struct pw_remote *remote,
 		uint32_t type, struct pw_properties *props, void *object, size_t user_data_size);
 
 struct pw_protocol *pw_protocol_native_ext_client_node_init(struct pw_core *core);
+#ifdef HAVE_COMPAT_V0
 struct pw_protocol *pw_protocol_native_ext_client_node0_init(struct pw_core *core);
+#endif
 
 struct factory_data {
 	struct pw_factory *this;
@@ -80,11 +84,12 @@ static void *create_object(void *_data,
 		goto error_resource;
 	}
 
-	if (version == 0) {
+#ifdef HAVE_COMPAT_V0
+	if (version == 0)
 		result = pw_client_node0_new(node_resource, properties);
-	} else {
+	else
+#endif
 		result = pw_client_node_new(node_resource, properties, true);
-	}
 	if (result == NULL) {
 		res = -errno;
 		goto error_node;
@@ -158,7 +163,7 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 	factory = pw_factory_new(core,
 				 "client-node",
 				 PW_TYPE_INTERFACE_ClientNode,
-				 PW_VERSION_CLIENT_NODE,
+				 PW_VERSION_CLIENT_NODE_TRANSACTION,
 				 NULL,
 				 sizeof(*data));
 	if (factory == NULL)
@@ -175,7 +180,9 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 				      data);
 
 	pw_protocol_native_ext_client_node_init(core);
+#ifdef HAVE_COMPAT_V0
 	pw_protocol_native_ext_client_node0_init(core);
+#endif
 
 	data->export_node.type = PW_TYPE_INTERFACE_Node;
 	data->export_node.func = pw_remote_node_export;
@@ -28,6 +28,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <spa/support/system.h>
 #include <spa/node/node.h>
@@ -69,12 +72,31 @@
 
 #define CHECK_PORT_BUFFER(this,b,p)      (b < p->n_buffers)
 
+#define STATS_INTERVAL_SEC	1
+#define STATS_BUCKETS		32
+
+struct timing {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint32_t buckets[STATS_BUCKETS];	/**< log2 histogram of the usec */
+};
+
+struct stats {
+	struct timing wakeup;		/**< from signal_time to awake_time */
+	struct timing process;		/**< from awake_time to finish_time */
+	uint32_t late;			/**< triggered before it was finished */
+};
+
 struct buffer {
 	struct spa_buffer *outbuf;
 	struct spa_buffer buffer;
 	struct spa_meta metas[4];
 	struct spa_data datas[4];
 	struct pw_memblock *mem;
+	uint32_t mem_offset;
+	uint32_t mem_size;
 };
 
 struct mix {
@@ -147,6 +169,24 @@ struct impl {
 	struct pw_memblock *io_areas;
 	struct pw_node_activation *activation;
 
+	struct pw_memblock *control;	/**< ring of controls written by the client */
+	struct spa_source *control_event;
+	uint32_t control_pending;
+	uint8_t control_buffer[PW_NODE_CONTROL_SIZE] SPA_ALIGNED(8);
+
+	struct pw_array pending_ops;	/**< port ops for the next transaction */
+	struct spa_source *flush_event;
+
+	struct spa_list local_link;	/**< link in local_list */
+	bool in_local_list;
+	dev_t activation_dev;
+	ino_t activation_ino;
+	struct pw_node *local;		/**< the exported node when the client is in
+					  *  this process, run directly */
+
+	struct stats rt_stats;		/**< collected in the data loop */
+	struct spa_source *stats_timer;
+
 	struct spa_hook node_listener;
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
@@ -185,6 +225,8 @@ struct impl {
 	pw_client_node_resource(r,port_set_io,0,__VA_ARGS__)
 #define pw_client_node_resource_set_activation(r,...)	\
 	pw_client_node_resource(r,set_activation,0,__VA_ARGS__)
+#define pw_client_node_resource_transaction(r,...)	\
+	pw_client_node_resource(r,transaction,1,__VA_ARGS__)
 
 static int
 do_port_use_buffers(struct impl *impl,
@@ -197,6 +239,11 @@ do_port_use_buffers(struct impl *impl,
 
 /** \endcond */
 
+/* the client nodes of this process, used to find the nodes that are exported
+ * to a server in the same process */
+static pthread_mutex_t local_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spa_list local_list = SPA_LIST_INIT(&local_list);
+
 static struct mix *find_mix(struct port *p, uint32_t mix_id)
 {
 	struct mix *mix;
@@ -230,6 +277,113 @@ static struct mix *ensure_mix(struct impl *impl, struct port *p, uint32_t mix_id
 	return mix;
 }
 
+static uint32_t fill_buffers(struct mix *mix, struct pw_client_node_buffer *mb)
+{
+	uint32_t i;
+
+	for (i = 0; i < mix->n_buffers; i++) {
+		struct buffer *b = &mix->buffers[i];
+
+		mb[i].buffer = &b->buffer;
+		mb[i].mem_id = b->mem->id;
+		mb[i].offset = b->mem_offset;
+		mb[i].size = b->mem_size;
+	}
+	return mix->n_buffers;
+}
+
+/* Setting up a link configures the buffers and io areas of every mix of
+ * every port. Newer clients get these ops in one transaction that is sent
+ * from the main loop once the current work is done, or before any other
+ * event so that the order of events is kept. */
+static inline bool use_transaction(struct impl *impl)
+{
+	struct pw_resource *resource = impl->node.resource;
+
+	return resource != NULL && impl->flush_event != NULL &&
+		resource->version >= PW_VERSION_CLIENT_NODE_TRANSACTION;
+}
+
+static int queue_port_op(struct impl *impl, const struct pw_client_node_port_op *op)
+{
+	struct pw_client_node_port_op *o;
+
+	pw_array_for_each(o, &impl->pending_ops) {
+		if (o->type == op->type &&
+		    o->direction == op->direction &&
+		    o->port_id == op->port_id &&
+		    o->mix_id == op->mix_id &&
+		    o->id == op->id) {
+			*o = *op;
+			return 0;
+		}
+	}
+	if ((o = pw_array_add(&impl->pending_ops, sizeof(*o))) == NULL)
+		return -errno;
+	*o = *op;
+
+	if (pw_array_get_len(&impl->pending_ops, struct pw_client_node_port_op) == 1)
+		pw_loop_signal_event(impl->core->main_loop, impl->flush_event);
+	return 0;
+}
+
+static int flush_transaction(struct impl *impl)
+{
+	struct node *this = &impl->node;
+	struct pw_client_node_port_op *ops, *o;
+	struct pw_client_node_buffer *mb;
+	struct mix **mixes;
+	struct port *p;
+	struct mix *mix;
+	uint32_t i, n_ops, n_buffers;
+
+	n_ops = pw_array_get_len(&impl->pending_ops, struct pw_client_node_port_op);
+	if (n_ops == 0)
+		return 0;
+
+	ops = alloca(n_ops * sizeof(struct pw_client_node_port_op));
+	mixes = alloca(n_ops * sizeof(struct mix *));
+
+	/* drop the ops of ports that were removed in the meantime */
+	n_ops = n_buffers = 0;
+	pw_array_for_each(o, &impl->pending_ops) {
+		if (!CHECK_PORT(this, o->direction, o->port_id))
+			continue;
+		p = GET_PORT(this, o->direction, o->port_id);
+		if ((mix = find_mix(p, o->mix_id)) == NULL || !mix->valid)
+			continue;
+		if (o->type == PW_CLIENT_NODE_PORT_OP_USE_BUFFERS)
+			n_buffers += mix->n_buffers;
+		mixes[n_ops] = mix;
+		ops[n_ops++] = *o;
+	}
+	pw_array_reset(&impl->pending_ops);
+
+	if (n_ops == 0)
+		return 0;
+	if (this->resource == NULL)
+		return -EIO;
+
+	/* the buffers are taken from the mix, they are the latest ones */
+	mb = alloca(n_buffers * sizeof(struct pw_client_node_buffer));
+	for (i = 0; i < n_ops; i++) {
+		if (ops[i].type != PW_CLIENT_NODE_PORT_OP_USE_BUFFERS)
+			continue;
+		ops[i].buffers = mb;
+		ops[i].n_buffers = fill_buffers(mixes[i], mb);
+		mb += ops[i].n_buffers;
+	}
+
+	spa_log_debug(this->log, NAME " %p: flush %u port ops", this, n_ops);
+
+	return pw_client_node_resource_transaction(this->resource, n_ops, ops);
+}
+
+static void on_flush_event(void *data, uint64_t count)
+{
+	flush_transaction(data);
+}
+
 static int clear_buffers(struct node *this, struct mix *mix)
 {
 	uint32_t i, j;
@@ -323,6 +477,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(this->impl);
+
 	return pw_client_node_resource_set_param(this->resource, id, flags, param);
 }
 
@@ -358,6 +514,8 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(impl);
+
 	return pw_client_node_resource_set_io(this->resource,
 				       id,
 				       memid,
@@ -376,6 +534,8 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(this->impl);
+
 	return pw_client_node_resource_command(this->resource, command);
 }
 
@@ -438,6 +598,9 @@ impl_node_sync(void *object, int seq)
 	if (this->resource == NULL)
 		return -EIO;
 
+	/* the pong completes the pending port ops as well */
+	flush_transaction(this->impl);
+
 	return pw_resource_ping(this->resource, seq);
 }
 
@@ -536,6 +699,8 @@ impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(this->impl);
+
 	return pw_client_node_resource_add_port(this->resource, direction, port_id, props);
 }
 
@@ -550,6 +715,8 @@ impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(this->impl);
+
 	return pw_client_node_resource_remove_port(this->resource, direction, port_id);
 }
 
@@ -631,6 +798,7 @@ impl_node_port_set_param(void *object,
 	if (this->resource == NULL)
 		return -EIO;
 
+	flush_transaction(this->impl);
 
 	return pw_client_node_resource_port_set_param(this->resource,
 					       direction, port_id,
@@ -682,6 +850,21 @@ static int do_port_set_io(struct impl *impl,
 	if (this->resource == NULL)
 		return -EIO;
 
+	if (data && use_transaction(impl)) {
+		struct pw_client_node_port_op op = {
+			.type = PW_CLIENT_NODE_PORT_OP_SET_IO,
+			.direction = direction,
+			.port_id = port_id,
+			.mix_id = mix_id,
+			.id = id,
+			.mem_id = memid,
+			.offset = mem_offset,
+			.size = mem_size,
+		};
+		return queue_port_op(impl, &op);
+	}
+	flush_transaction(impl);
+
 	return pw_client_node_resource_port_set_io(this->resource,
 					    direction, port_id,
 					    mix_id,
@@ -779,18 +962,21 @@ do_port_use_buffers(struct impl *impl,
 				data_size += d->maxsize;
 		}
 
-		m = pw_mempool_import_block(this->client->pool, mem);
+		/* consumers share the producer memory, give them a read-only
+		 * fd so that they can't write into it */
+		if (direction == SPA_DIRECTION_INPUT)
+			m = pw_mempool_import_block_readonly(this->client->pool, mem);
+		else
+			m = pw_mempool_import_block(this->client->pool, mem);
 		if (m == NULL)
 			return -errno;
 
 		b->mem = m;
 
-		mb[i].buffer = &b->buffer;
-		mb[i].mem_id = m->id;
-		mb[i].offset = SPA_PTRDIFF(baseptr, SPA_MEMBER(mem->map->ptr, 0, void));
-		mb[i].size = data_size;
-		spa_log_debug(this->log, NAME" %p: buffer %d %d %d %d", this, i, mb[i].mem_id,
-				mb[i].offset, mb[i].size);
+		b->mem_offset = SPA_PTRDIFF(baseptr, SPA_MEMBER(mem->map->ptr, 0, void));
+		b->mem_size = data_size;
+		spa_log_debug(this->log, NAME" %p: buffer %d %d %d %d", this, i, m->id,
+				b->mem_offset, b->mem_size);
 
 		for (j = 0; j < buffers[i]->n_metas; j++)
 			memcpy(&b->buffer.metas[j], &buffers[i]->metas[j], sizeof(struct spa_meta));
@@ -807,14 +993,21 @@ do_port_use_buffers(struct impl *impl,
 			if (d->type == SPA_DATA_DmaBuf ||
 			    d->type == SPA_DATA_MemFd) {
 				uint32_t flags = PW_MEMBLOCK_FLAG_DONT_CLOSE;
+				struct pw_memblock *dm;
 
 				if (d->flags & SPA_DATA_FLAG_READABLE)
 					flags |= PW_MEMBLOCK_FLAG_READABLE;
 				if (d->flags & SPA_DATA_FLAG_WRITABLE)
 					flags |= PW_MEMBLOCK_FLAG_WRITABLE;
 
-				m = pw_mempool_import(this->client->pool,
-					flags, d->type, d->fd);
+				if (direction == SPA_DIRECTION_INPUT &&
+				    (dm = pw_mempool_find_fd(impl->core->pool, d->fd)) != NULL) {
+					m = pw_mempool_import_block_readonly(this->client->pool, dm);
+					b->buffer.datas[j].flags &= ~SPA_DATA_FLAG_WRITABLE;
+				} else {
+					m = pw_mempool_import(this->client->pool,
+						flags, d->type, d->fd);
+				}
 				if (m == NULL)
 					return -errno;
 
@@ -831,6 +1024,23 @@ do_port_use_buffers(struct impl *impl,
 		}
 	}
 
+	/* buffers allocated by the client are sent back with port_buffers,
+	 * the caller has to wait for those */
+	if (n_buffers > 0 && !(flags & SPA_NODE_BUFFERS_FLAG_ALLOC) &&
+	    use_transaction(impl)) {
+		struct pw_client_node_port_op op = {
+			.type = PW_CLIENT_NODE_PORT_OP_USE_BUFFERS,
+			.direction = direction,
+			.port_id = port_id,
+			.mix_id = mix_id,
+			.flags = flags,
+		};
+		return queue_port_op(impl, &op);
+	}
+	flush_transaction(impl);
+
+	fill_buffers(mix, mb);
+
 	return pw_client_node_resource_port_use_buffers(this->resource,
 						 direction, port_id, mix_id, flags,
 						 n_buffers, mb);
@@ -868,6 +1078,111 @@ impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
 	return -ENOTSUP;
 }
 
+static void timing_add(struct timing *t, uint64_t nsec)
+{
+	uint64_t usec = nsec / SPA_NSEC_PER_USEC;
+	uint32_t bucket;
+
+	if (t->count == 0 || nsec < t->min)
+		t->min = nsec;
+	if (nsec > t->max)
+		t->max = nsec;
+	t->sum += nsec;
+	t->count++;
+
+	bucket = usec == 0 ? 0 : 64 - __builtin_clzll(usec);
+	t->buckets[SPA_MIN(bucket, STATS_BUCKETS - 1u)]++;
+}
+
+/* the upper bound of the bucket with the 99th percentile */
+static uint64_t timing_p99(const struct timing *t)
+{
+	uint64_t total = 0, limit = t->count - t->count / 100;
+	uint32_t i;
+
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		total += t->buckets[i];
+		if (total >= limit)
+			break;
+	}
+	return i == 0 ? 0 : 1ULL << SPA_MIN(i, STATS_BUCKETS - 1u);
+}
+
+static void timing_format(const struct timing *t, char *buf, size_t size)
+{
+	uint64_t min = t->min / SPA_NSEC_PER_USEC;
+	uint64_t avg = t->sum / t->count / SPA_NSEC_PER_USEC;
+	uint64_t max = t->max / SPA_NSEC_PER_USEC;
+	uint64_t p99 = SPA_MIN(timing_p99(t), max);
+
+	snprintf(buf, size, "%"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64,
+			min, avg, max, p99);
+}
+
+/* the client wrote the times of the previous cycle in the activation */
+static inline void collect_stats(struct impl *impl, struct pw_node_activation *a)
+{
+	if (a->signal_time == 0)
+		return;
+
+	switch (a->status) {
+	case PW_NODE_ACTIVATION_FINISHED:
+		if (a->awake_time < a->signal_time || a->finish_time < a->awake_time)
+			break;
+		timing_add(&impl->rt_stats.wakeup, a->awake_time - a->signal_time);
+		timing_add(&impl->rt_stats.process, a->finish_time - a->awake_time);
+		break;
+	case PW_NODE_ACTIVATION_TRIGGERED:
+	case PW_NODE_ACTIVATION_AWAKE:
+		impl->rt_stats.late++;
+		break;
+	}
+}
+
+static int
+do_take_stats(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	struct stats *stats = *(struct stats **)data;
+
+	*stats = impl->rt_stats;
+	spa_zero(impl->rt_stats);
+	return 0;
+}
+
+static void on_stats_timeout(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	struct pw_node *node = impl->this.node;
+	struct stats stats, *s = &stats;
+	struct spa_dict_item items[3];
+	char wakeup[96], process[96], late[16];
+	uint32_t n_items = 0;
+
+	if (node == NULL)
+		return;
+
+	pw_loop_invoke(node->data_loop, do_take_stats, SPA_ID_INVALID,
+			&s, sizeof(s), true, impl);
+
+	/* updating the properties sends an info event, only do it when
+	 * the node was running */
+	if (stats.wakeup.count == 0 && stats.late == 0)
+		return;
+
+	if (stats.wakeup.count > 0) {
+		timing_format(&stats.wakeup, wakeup, sizeof(wakeup));
+		timing_format(&stats.process, process, sizeof(process));
+		items[n_items++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_STATS_WAKEUP, wakeup);
+		items[n_items++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_STATS_PROCESS, process);
+	}
+	snprintf(late, sizeof(late), "%u", stats.late);
+	items[n_items++] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_STATS_LATE, late);
+
+	pw_node_update_properties(node, &SPA_DICT_INIT(items, n_items));
+}
+
 static int impl_node_process(void *object)
 {
 	struct node *this = object;
@@ -875,12 +1190,30 @@ static int impl_node_process(void *object)
 	struct pw_node *n = impl->this.node;
 	struct timespec ts;
 
+	if (impl->control) {
+		struct pw_node_control *c = impl->control->map->ptr;
+		uint32_t index;
+
+		/* let the main loop apply the controls queued by the client */
+		if (spa_ringbuffer_get_read_index(&c->ring, &index) != 0 &&
+		    ATOMIC_CAS(impl->control_pending, 0, 1))
+			pw_loop_signal_event(impl->core->main_loop, impl->control_event);
+	}
+
 	spa_log_trace_fp(this->log, "%p: send process driver:%p", this, impl->this.node->driver_node);
 
+	collect_stats(impl, n->rt.activation);
+
 	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &ts);
 	n->rt.activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 	n->rt.activation->signal_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
+	/* the exported node lives in this process, run it without a wakeup */
+	if (impl->local != NULL) {
+		impl->local->rt.target.signal(impl->local->rt.target.data);
+		return SPA_STATUS_OK;
+	}
+
 	if (spa_system_eventfd_write(this->data_system, this->writefd, 1) < 0)
 		spa_log_warn(this->log, NAME" %p: error %m", this);
 
@@ -1208,6 +1541,112 @@ static void client_node_resource_pong(void *data, int seq)
 	spa_node_emit_result(&this->hooks, seq, 0, 0, NULL);
 }
 
+static void apply_controls(struct impl *impl, uint32_t node_id, struct spa_pod_sequence *seq)
+{
+	struct pw_client *client = impl->node.client;
+	struct pw_global *global;
+	struct pw_node *node;
+	struct spa_pod_control *c;
+	int res;
+
+	if ((global = pw_core_find_global(impl->core, node_id)) == NULL ||
+	    pw_global_get_type(global) != PW_TYPE_INTERFACE_Node ||
+	    !PW_PERM_IS_W(pw_global_get_permissions(global, client))) {
+		pw_log_debug(NAME " %p: no node %u to control", &impl->node, node_id);
+		return;
+	}
+	node = pw_global_get_object(global);
+
+	SPA_POD_SEQUENCE_FOREACH(seq, c) {
+		if (c->type != SPA_CONTROL_Properties ||
+		    !spa_pod_is_object_type(&c->value, SPA_TYPE_OBJECT_Props))
+			continue;
+
+		if ((res = spa_node_set_param(node->node, SPA_PARAM_Props, 0, &c->value)) < 0)
+			pw_log_warn(NAME " %p: node %u set props error: %s", &impl->node,
+					node_id, spa_strerror(res));
+	}
+}
+
+static void on_control_event(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct pw_node_control *c;
+	struct pw_node_control_msg msg;
+	uint32_t index, total;
+	int32_t avail;
+
+	ATOMIC_STORE(impl->control_pending, 0);
+
+	if (impl->control == NULL)
+		return;
+
+	c = impl->control->map->ptr;
+
+	/* the indexes are written by the client, don't trust them */
+	avail = spa_ringbuffer_get_read_index(&c->ring, &index);
+	if (avail < 0 || avail > (int32_t)PW_NODE_CONTROL_SIZE)
+		goto error_invalid;
+
+	while (avail >= (int32_t)sizeof(msg)) {
+		struct spa_pod *pod = (struct spa_pod *)impl->control_buffer;
+
+		spa_ringbuffer_read_data(&c->ring, c->data, PW_NODE_CONTROL_SIZE,
+				index & (PW_NODE_CONTROL_SIZE - 1), &msg, sizeof(msg));
+
+		if (msg.size < sizeof(struct spa_pod) || msg.size > PW_NODE_CONTROL_SIZE)
+			goto error_invalid;
+		total = SPA_ROUND_UP_N(sizeof(msg) + msg.size, 8);
+		if (total > (uint32_t)avail)
+			goto error_invalid;
+
+		spa_ringbuffer_read_data(&c->ring, c->data, PW_NODE_CONTROL_SIZE,
+				(index + sizeof(msg)) & (PW_NODE_CONTROL_SIZE - 1),
+				pod, msg.size);
+
+		if (SPA_POD_TYPE(pod) == SPA_TYPE_Sequence &&
+		    SPA_POD_SIZE(pod) <= msg.size &&
+		    SPA_POD_BODY_SIZE(pod) >= sizeof(struct spa_pod_sequence_body))
+			apply_controls(impl, msg.node_id, (struct spa_pod_sequence *)pod);
+
+		index += total;
+		avail -= total;
+	}
+	spa_ringbuffer_read_update(&c->ring, index);
+	return;
+
+error_invalid:
+	pw_log_warn(NAME " %p: invalid control ring, dropping %d bytes", &impl->node, avail);
+	spa_ringbuffer_read_update(&c->ring, index + avail);
+}
+
+static void setup_control(struct impl *impl)
+{
+	struct pw_node_control *c;
+
+	impl->control = pw_mempool_alloc(impl->core->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_MAP |
+			PW_MEMBLOCK_FLAG_SEAL,
+			SPA_DATA_MemFd, sizeof(struct pw_node_control) + PW_NODE_CONTROL_SIZE);
+	if (impl->control == NULL) {
+		pw_log_warn(NAME " %p: can't alloc control ring: %m", &impl->node);
+		return;
+	}
+	impl->control_event = pw_loop_add_event(impl->core->main_loop,
+			on_control_event, impl);
+	if (impl->control_event == NULL) {
+		pw_log_warn(NAME " %p: can't create control event: %m", &impl->node);
+		pw_memblock_unref(impl->control);
+		impl->control = NULL;
+		return;
+	}
+
+	c = impl->control->map->ptr;
+	spa_ringbuffer_init(&c->ring);
+	c->size = PW_NODE_CONTROL_SIZE;
+}
+
 void pw_client_node_registered(struct pw_client_node *this, struct pw_global *global)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -1236,6 +1675,10 @@ void pw_client_node_registered(struct pw_client_node *this, struct pw_global *gl
 					  0,
 					  sizeof(struct pw_node_activation));
 
+	if (impl->control)
+		impl_node_set_io(&impl->node, SPA_IO_Notify, impl->control->map->ptr,
+				impl->control->size);
+
 	if (impl->bind_node_id) {
 		pw_global_bind(global, client, PW_PERM_RWX,
 				impl->bind_node_version, impl->bind_node_id);
@@ -1273,6 +1716,8 @@ static void node_initialized(void *data)
 
 	pw_log_debug(NAME " %p: io areas %p", node, impl->io_areas->map->ptr);
 
+	setup_control(impl);
+
 	if ((global = pw_node_get_global(this->node)) != NULL)
 		pw_client_node_registered(this, global);
 }
@@ -1289,13 +1734,28 @@ static void node_free(void *data)
 	pw_log_debug(NAME " %p: free", node);
 	node_clear(node);
 
+	if (impl->in_local_list) {
+		pthread_mutex_lock(&local_lock);
+		spa_list_remove(&impl->local_link);
+		pthread_mutex_unlock(&local_lock);
+	}
+
 	spa_hook_remove(&impl->node_listener);
+	pw_array_clear(&impl->pending_ops);
 
 	if (this->resource)
 		pw_resource_destroy(this->resource);
 
 	if (impl->io_areas)
 		pw_memblock_unref(impl->io_areas);
+	if (impl->control_event)
+		pw_loop_destroy_source(impl->core->main_loop, impl->control_event);
+	if (impl->flush_event)
+		pw_loop_destroy_source(impl->core->main_loop, impl->flush_event);
+	if (impl->stats_timer)
+		pw_loop_destroy_source(impl->core->main_loop, impl->stats_timer);
+	if (impl->control)
+		pw_memblock_unref(impl->control);
 
 	pw_map_clear(&impl->io_map);
 
@@ -1536,6 +1996,8 @@ static void node_peer_added(void *data, struct pw_node *peer)
 	if (this->resource == NULL)
 		return;
 
+	flush_transaction(impl);
+
 	pw_client_node_resource_set_activation(this->resource,
 					  peer->info.id,
 					  peer->source.fd,
@@ -1563,6 +2025,7 @@ static void node_peer_removed(void *data, struct pw_node *peer)
 			peer->info.id);
 
 	if (this->resource != NULL) {
+		flush_transaction(impl);
 		pw_client_node_resource_set_activation(this->resource,
 					  peer->info.id,
 					  -1,
@@ -1633,6 +2096,7 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	struct pw_core *core = pw_client_get_core(client);
 	const struct spa_support *support;
 	uint32_t n_support;
+	struct stat st;
 	int res;
 
 	impl = calloc(1, sizeof(struct impl));
@@ -1664,6 +2128,8 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	this->flags = do_register ? 0 : 1;
 
 	pw_map_init(&impl->io_map, 64, 64);
+	pw_array_init(&impl->pending_ops, 32 * sizeof(struct pw_client_node_port_op));
+	impl->flush_event = pw_loop_add_event(core->main_loop, on_flush_event, impl);
 
 	this->resource = resource;
 	this->node = pw_spa_node_new(core,
@@ -1682,6 +2148,22 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	this->node->rt.target.signal = process_node;
 	this->node->rt.target.data = impl;
 
+	impl->stats_timer = pw_loop_add_timer(core->main_loop, on_stats_timeout, impl);
+	if (impl->stats_timer) {
+		struct timespec interval = { STATS_INTERVAL_SEC, 0 };
+		pw_loop_update_timer(core->main_loop, impl->stats_timer,
+				&interval, &interval, false);
+	}
+
+	if (fstat(this->node->activation->fd, &st) == 0) {
+		impl->activation_dev = st.st_dev;
+		impl->activation_ino = st.st_ino;
+		pthread_mutex_lock(&local_lock);
+		spa_list_append(&local_list, &impl->local_link);
+		impl->in_local_list = true;
+		pthread_mutex_unlock(&local_lock);
+	}
+
 	pw_resource_add_listener(this->resource,
 				&impl->resource_listener,
 				&resource_events,
@@ -1714,6 +2196,58 @@ error_exit_cleanup:
 	return NULL;
 }
 
+static int
+do_set_local(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	impl->local = *(struct pw_node **)data;
+	return 0;
+}
+
+/** Run an exported node directly from the server
+ * \param activation_fd the fd of the activation memory of the node
+ * \param node the exported node or NULL to signal it again
+ * \return 0 when the client node of \a activation_fd is in this process
+ *	and runs in the same data loop as \a node
+ *
+ * The client node is found with the activation memory that the client
+ * mapped, so only a client in this process can find it. The rt state of
+ * \a node is changed in its own data loop, so the node can only be run
+ * from the server when the server node uses the same loop.
+ */
+int pw_client_node_set_local(int activation_fd, struct pw_node *node)
+{
+	struct impl *impl;
+	struct stat st;
+	int res = -ENOENT;
+
+	if (fstat(activation_fd, &st) < 0)
+		return -errno;
+
+	pthread_mutex_lock(&local_lock);
+	spa_list_for_each(impl, &local_list, local_link) {
+		if (impl->activation_dev != st.st_dev ||
+		    impl->activation_ino != st.st_ino)
+			continue;
+
+		if (node != NULL && node->data_loop != impl->this.node->data_loop) {
+			pw_log_debug(NAME " %p: local node %p has another data loop",
+					&impl->node, node);
+			res = -EXDEV;
+			break;
+		}
+		pw_log_debug(NAME " %p: local node %p", &impl->node, node);
+		pw_loop_invoke(impl->this.node->data_loop,
+				do_set_local, SPA_ID_INVALID, &node, sizeof(node), true, impl);
+		res = 0;
+		break;
+	}
+	pthread_mutex_unlock(&local_lock);
+
+	return res;
+}
+
 /** Destroy a client node
  * \param node the client node to destroy
  * \memberof pw_client_node
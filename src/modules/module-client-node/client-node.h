@@ -53,6 +53,8 @@ pw_client_node_destroy(struct pw_client_node *node);
 
 void pw_client_node_registered(struct pw_client_node *node, struct pw_global *global);
 
+int pw_client_node_set_local(int activation_fd, struct pw_node *node);
+
 #ifdef __cplusplus
 }
 #endif
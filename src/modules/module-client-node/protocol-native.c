@@ -81,6 +81,40 @@ static inline int parse_dict(struct spa_pod_parser *prs, struct spa_dict *dict)
 	return 0;
 }
 
+static void push_buffers(struct spa_pod_builder *b,
+		uint32_t n_buffers, const struct pw_client_node_buffer *buffers)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct spa_buffer *buf = buffers[i].buffer;
+
+		spa_pod_builder_add(b,
+				    SPA_POD_Int(buffers[i].mem_id),
+				    SPA_POD_Int(buffers[i].offset),
+				    SPA_POD_Int(buffers[i].size),
+				    SPA_POD_Int(buf->n_metas), NULL);
+
+		for (j = 0; j < buf->n_metas; j++) {
+			struct spa_meta *m = &buf->metas[j];
+			spa_pod_builder_add(b,
+					    SPA_POD_Id(m->type),
+					    SPA_POD_Int(m->size), NULL);
+		}
+		spa_pod_builder_add(b,
+				SPA_POD_Int(buf->n_datas), NULL);
+		for (j = 0; j < buf->n_datas; j++) {
+			struct spa_data *d = &buf->datas[j];
+			spa_pod_builder_add(b,
+					    SPA_POD_Id(d->type),
+					    SPA_POD_Int(SPA_PTR_TO_UINT32(d->data)),
+					    SPA_POD_Int(d->flags),
+					    SPA_POD_Int(d->mapoffset),
+					    SPA_POD_Int(d->maxsize), NULL);
+		}
+	}
+}
+
 static int client_node_marshal_add_listener(void *object,
 			struct spa_hook *listener,
 			const struct pw_client_node_proxy_events *events,
@@ -591,6 +625,101 @@ static int client_node_demarshal_set_io(void *object, const struct pw_protocol_n
 	return 0;
 }
 
+static int client_node_demarshal_transaction(void *object, const struct pw_protocol_native_message *msg)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	struct pw_client_node_port_op *ops;
+	uint32_t n_ops, data_id;
+	uint32_t i, j, k;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0 ||
+	    spa_pod_parser_get(&prs,
+			SPA_POD_Int(&n_ops), NULL) < 0)
+		return -EINVAL;
+
+	if (n_ops > msg->size / sizeof(struct spa_pod_int))
+		return -EINVAL;
+
+	ops = alloca(sizeof(struct pw_client_node_port_op) * n_ops);
+	for (i = 0; i < n_ops; i++) {
+		struct pw_client_node_port_op *op = &ops[i];
+
+		spa_zero(*op);
+		if (spa_pod_parser_get(&prs,
+				SPA_POD_Int(&op->type),
+				SPA_POD_Int(&op->direction),
+				SPA_POD_Int(&op->port_id),
+				SPA_POD_Int(&op->mix_id), NULL) < 0)
+			return -EINVAL;
+
+		switch (op->type) {
+		case PW_CLIENT_NODE_PORT_OP_USE_BUFFERS:
+			if (spa_pod_parser_get(&prs,
+					SPA_POD_Int(&op->flags),
+					SPA_POD_Int(&op->n_buffers), NULL) < 0)
+				return -EINVAL;
+
+			op->buffers = alloca(sizeof(struct pw_client_node_buffer) * op->n_buffers);
+			for (j = 0; j < op->n_buffers; j++) {
+				struct pw_client_node_buffer *mb = &op->buffers[j];
+				struct spa_buffer *buf = mb->buffer = alloca(sizeof(struct spa_buffer));
+
+				if (spa_pod_parser_get(&prs,
+						SPA_POD_Int(&mb->mem_id),
+						SPA_POD_Int(&mb->offset),
+						SPA_POD_Int(&mb->size),
+						SPA_POD_Int(&buf->n_metas), NULL) < 0)
+					return -EINVAL;
+
+				buf->metas = alloca(sizeof(struct spa_meta) * buf->n_metas);
+				for (k = 0; k < buf->n_metas; k++) {
+					struct spa_meta *m = &buf->metas[k];
+
+					if (spa_pod_parser_get(&prs,
+							SPA_POD_Id(&m->type),
+							SPA_POD_Int(&m->size), NULL) < 0)
+						return -EINVAL;
+				}
+				if (spa_pod_parser_get(&prs,
+						SPA_POD_Int(&buf->n_datas), NULL) < 0)
+					return -EINVAL;
+
+				buf->datas = alloca(sizeof(struct spa_data) * buf->n_datas);
+				for (k = 0; k < buf->n_datas; k++) {
+					struct spa_data *d = &buf->datas[k];
+
+					if (spa_pod_parser_get(&prs,
+							SPA_POD_Id(&d->type),
+							SPA_POD_Int(&data_id),
+							SPA_POD_Int(&d->flags),
+							SPA_POD_Int(&d->mapoffset),
+							SPA_POD_Int(&d->maxsize), NULL) < 0)
+						return -EINVAL;
+
+					d->data = SPA_UINT32_TO_PTR(data_id);
+				}
+			}
+			break;
+		case PW_CLIENT_NODE_PORT_OP_SET_IO:
+			if (spa_pod_parser_get(&prs,
+					SPA_POD_Id(&op->id),
+					SPA_POD_Int(&op->mem_id),
+					SPA_POD_Int(&op->offset),
+					SPA_POD_Int(&op->size), NULL) < 0)
+				return -EINVAL;
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	pw_proxy_notify(proxy, struct pw_client_node_proxy_events, transaction, 1,
+			n_ops, ops);
+	return 0;
+}
+
 static int client_node_marshal_transport(void *object, uint32_t node_id, int readfd, int writefd,
 		uint32_t mem_id, uint32_t offset, uint32_t size)
 {
@@ -726,7 +855,6 @@ client_node_marshal_port_use_buffers(void *object,
 	struct pw_resource *resource = object;
 	struct spa_pod_builder *b;
 	struct spa_pod_frame f;
-	uint32_t i, j;
 
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_PORT_USE_BUFFERS, NULL);
 
@@ -738,33 +866,7 @@ client_node_marshal_port_use_buffers(void *object,
 			SPA_POD_Int(flags),
 			SPA_POD_Int(n_buffers), NULL);
 
-	for (i = 0; i < n_buffers; i++) {
-		struct spa_buffer *buf = buffers[i].buffer;
-
-		spa_pod_builder_add(b,
-				    SPA_POD_Int(buffers[i].mem_id),
-				    SPA_POD_Int(buffers[i].offset),
-				    SPA_POD_Int(buffers[i].size),
-				    SPA_POD_Int(buf->n_metas), NULL);
-
-		for (j = 0; j < buf->n_metas; j++) {
-			struct spa_meta *m = &buf->metas[j];
-			spa_pod_builder_add(b,
-					    SPA_POD_Id(m->type),
-					    SPA_POD_Int(m->size), NULL);
-		}
-		spa_pod_builder_add(b,
-				SPA_POD_Int(buf->n_datas), NULL);
-		for (j = 0; j < buf->n_datas; j++) {
-			struct spa_data *d = &buf->datas[j];
-			spa_pod_builder_add(b,
-					    SPA_POD_Id(d->type),
-					    SPA_POD_Int(SPA_PTR_TO_UINT32(d->data)),
-					    SPA_POD_Int(d->flags),
-					    SPA_POD_Int(d->mapoffset),
-					    SPA_POD_Int(d->maxsize), NULL);
-		}
-	}
+	push_buffers(b, n_buffers, buffers);
 	spa_pod_builder_pop(b, &f);
 
 	return pw_protocol_native_end_resource(resource, b);
@@ -840,6 +942,52 @@ client_node_marshal_set_io(void *object,
 	return pw_protocol_native_end_resource(resource, b);
 }
 
+static int
+client_node_marshal_transaction(void *object,
+				uint32_t n_ops,
+				const struct pw_client_node_port_op *ops)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	uint32_t i;
+
+	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_NODE_PROXY_EVENT_TRANSACTION, NULL);
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_add(b,
+			SPA_POD_Int(n_ops), NULL);
+
+	for (i = 0; i < n_ops; i++) {
+		const struct pw_client_node_port_op *op = &ops[i];
+
+		spa_pod_builder_add(b,
+				SPA_POD_Int(op->type),
+				SPA_POD_Int(op->direction),
+				SPA_POD_Int(op->port_id),
+				SPA_POD_Int(op->mix_id), NULL);
+
+		switch (op->type) {
+		case PW_CLIENT_NODE_PORT_OP_USE_BUFFERS:
+			spa_pod_builder_add(b,
+					SPA_POD_Int(op->flags),
+					SPA_POD_Int(op->n_buffers), NULL);
+			push_buffers(b, op->n_buffers, op->buffers);
+			break;
+		case PW_CLIENT_NODE_PORT_OP_SET_IO:
+			spa_pod_builder_add(b,
+					SPA_POD_Id(op->id),
+					SPA_POD_Int(op->mem_id),
+					SPA_POD_Int(op->offset),
+					SPA_POD_Int(op->size), NULL);
+			break;
+		}
+	}
+	spa_pod_builder_pop(b, &f);
+
+	return pw_protocol_native_end_resource(resource, b);
+}
+
 static int client_node_demarshal_get_node(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
@@ -1129,6 +1277,7 @@ static const struct pw_client_node_proxy_events pw_protocol_native_client_node_e
 	.port_use_buffers = &client_node_marshal_port_use_buffers,
 	.port_set_io = &client_node_marshal_port_set_io,
 	.set_activation = &client_node_marshal_set_activation,
+	.transaction = &client_node_marshal_transaction,
 };
 
 static const struct pw_protocol_native_demarshal
@@ -1144,7 +1293,8 @@ pw_protocol_native_client_node_event_demarshal[PW_CLIENT_NODE_PROXY_EVENT_NUM] =
 	[PW_CLIENT_NODE_PROXY_EVENT_PORT_SET_PARAM] = { &client_node_demarshal_port_set_param, 0 },
 	[PW_CLIENT_NODE_PROXY_EVENT_PORT_USE_BUFFERS] = { &client_node_demarshal_port_use_buffers, 0 },
 	[PW_CLIENT_NODE_PROXY_EVENT_PORT_SET_IO] = { &client_node_demarshal_port_set_io, 0 },
-	[PW_CLIENT_NODE_PROXY_EVENT_SET_ACTIVATION] = { &client_node_demarshal_set_activation, 0 }
+	[PW_CLIENT_NODE_PROXY_EVENT_SET_ACTIVATION] = { &client_node_demarshal_set_activation, 0 },
+	[PW_CLIENT_NODE_PROXY_EVENT_TRANSACTION] = { &client_node_demarshal_transaction, 0 }
 };
 
 static const struct pw_protocol_marshal pw_protocol_native_client_node_marshal = {
@@ -1159,6 +1309,18 @@ static const struct pw_protocol_marshal pw_protocol_native_client_node_marshal =
 	.client_demarshal = pw_protocol_native_client_node_event_demarshal,
 };
 
+static const struct pw_protocol_marshal pw_protocol_native_client_node_transaction_marshal = {
+	PW_TYPE_INTERFACE_ClientNode,
+	PW_VERSION_CLIENT_NODE_TRANSACTION,
+	0,
+	PW_CLIENT_NODE_PROXY_METHOD_NUM,
+	PW_CLIENT_NODE_PROXY_EVENT_NUM,
+	.client_marshal = &pw_protocol_native_client_node_method_marshal,
+	.server_demarshal = &pw_protocol_native_client_node_method_demarshal,
+	.server_marshal = &pw_protocol_native_client_node_event_marshal,
+	.client_demarshal = pw_protocol_native_client_node_event_demarshal,
+};
+
 struct pw_protocol *pw_protocol_native_ext_client_node_init(struct pw_core *core)
 {
 	struct pw_protocol *protocol;
@@ -1169,6 +1331,7 @@ struct pw_protocol *pw_protocol_native_ext_client_node_init(struct pw_core *core
 		return NULL;
 
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_client_node_marshal);
+	pw_protocol_add_marshal(protocol, &pw_protocol_native_client_node_transaction_marshal);
 
 	return protocol;
 }
@@ -40,6 +40,8 @@
 #include "extensions/protocol-native.h"
 #include "extensions/client-node.h"
 
+#include "client-node.h"
+
 #define MAX_MIX	4096
 #define MAX_IO	32
 
@@ -65,11 +67,15 @@ struct link {
 	struct pw_memmap *map;
 	struct pw_node_target target;
 	int signalfd;
+	struct pw_node *local;		/**< node exported by this process that we
+					  *  run directly instead of signaling */
 };
 
 struct node_data {
+	struct spa_list link;		/**< link in node_data_list */
 	struct pw_remote *remote;
 	struct pw_core *core;
+	bool local_dispatch;
 
 	uint32_t remote_id;
 	int rtwritefd;
@@ -98,6 +104,66 @@ struct node_data {
 
 /** \endcond */
 
+/* all exported nodes, used to find the peers that live in this process */
+static struct spa_list node_data_list = SPA_LIST_INIT(&node_data_list);
+
+static struct pw_node *find_local(struct node_data *data, uint32_t node_id)
+{
+	struct node_data *d;
+
+	if (!data->local_dispatch)
+		return NULL;
+
+	spa_list_for_each(d, &node_data_list, link) {
+		if (d->remote == data->remote && d->have_transport &&
+		    d->remote_id == node_id && d->local_dispatch)
+			return d->node;
+	}
+	return NULL;
+}
+
+/* make the links of the other nodes that point to our node run it
+ * directly from now on */
+static void set_local_links(struct node_data *data)
+{
+	struct node_data *d;
+	struct link *l;
+
+	if (!data->local_dispatch)
+		return;
+
+	spa_list_for_each(d, &node_data_list, link) {
+		if (d == data || d->remote != data->remote || !d->local_dispatch)
+			continue;
+		pw_array_for_each(l, &d->links) {
+			if (l->node_id == data->remote_id) {
+				pw_log_debug("node %p: link %p: dispatch local node %p",
+						d->node, l, data->node);
+				__atomic_store_n(&l->local, data->node, __ATOMIC_RELEASE);
+			}
+		}
+	}
+}
+
+static int
+do_unset_local_links(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *_data, size_t size, void *user_data)
+{
+	struct node_data *data = user_data;
+	struct node_data *d;
+	struct link *l;
+
+	spa_list_for_each(d, &node_data_list, link) {
+		if (d->remote != data->remote)
+			continue;
+		pw_array_for_each(l, &d->links) {
+			if (l->local == data->node)
+				l->local = NULL;
+		}
+	}
+	return 0;
+}
+
 static struct link *find_activation(struct pw_array *links, uint32_t node_id)
 {
 	struct link *l;
@@ -127,6 +193,12 @@ static void clean_transport(struct node_data *data)
 	if (!data->have_transport)
 		return;
 
+	if (data->local_dispatch) {
+		pw_client_node_set_local(data->activation->block->fd, NULL);
+		pw_loop_invoke(data->core->data_loop,
+			do_unset_local_links, SPA_ID_INVALID, NULL, 0, true, data);
+	}
+
 	pw_array_for_each(l, &data->links) {
 		if (l->node_id != SPA_ID_INVALID)
 			clear_link(data, l);
@@ -234,12 +306,27 @@ static struct mix *ensure_mix(struct node_data *data,
 }
 
 
+static int check_activation(struct pw_proxy *proxy, struct pw_memmap *mm, uint32_t size)
+{
+	struct pw_node_activation *a = mm->ptr;
+
+	if (size < sizeof(struct pw_node_activation) ||
+	    a->layout != PW_NODE_ACTIVATION_LAYOUT) {
+		pw_log_error("remote-node %p: activation layout %u (size %u) != %u (size %zd)",
+				proxy, size >= sizeof(*a) ? a->layout : 0, size,
+				PW_NODE_ACTIVATION_LAYOUT, sizeof(*a));
+		return -EPROTO;
+	}
+	return 0;
+}
+
 static int client_node_transport(void *object, uint32_t node_id,
 			int readfd, int writefd, uint32_t mem_id, uint32_t offset, uint32_t size)
 {
 	struct pw_proxy *proxy = object;
 	struct node_data *data = proxy->user_data;
 	struct pw_remote *remote = data->remote;
+	int res;
 
 	clean_transport(data);
 
@@ -249,6 +336,11 @@ static int client_node_transport(void *object, uint32_t node_id,
 		pw_log_debug("remote-node %p: can't map activation: %m", proxy);
 		return -errno;
 	}
+	if ((res = check_activation(proxy, data->activation, size)) < 0) {
+		pw_memmap_free(data->activation);
+		data->activation = NULL;
+		return res;
+	}
 
 	data->remote_id = node_id;
 	data->node->rt.activation = data->activation->ptr;
@@ -262,6 +354,13 @@ static int client_node_transport(void *object, uint32_t node_id,
 
 	data->have_transport = true;
 
+	set_local_links(data);
+
+	/* when the server is in this process, it runs the node directly */
+	if (data->local_dispatch &&
+	    pw_client_node_set_local(data->activation->block->fd, data->node) == 0)
+		pw_log_debug("remote-node %p: node %p runs in the server", proxy, data->node);
+
 	if (data->node->active)
 		pw_client_node_proxy_set_active(data->client_node, true);
 
@@ -773,9 +872,46 @@ error_exit:
 	return res;
 }
 
+static int
+client_node_transaction(void *object,
+			uint32_t n_ops,
+			const struct pw_client_node_port_op *ops)
+{
+	uint32_t i;
+	int res = 0;
+
+	pw_log_debug("node %p: transaction of %u port ops", object, n_ops);
+
+	/* errors are reported by the ops, go on with the other ports */
+	for (i = 0; i < n_ops; i++) {
+		const struct pw_client_node_port_op *op = &ops[i];
+		int r;
+
+		switch (op->type) {
+		case PW_CLIENT_NODE_PORT_OP_USE_BUFFERS:
+			r = client_node_port_use_buffers(object,
+					op->direction, op->port_id, op->mix_id,
+					op->flags, op->n_buffers, op->buffers);
+			break;
+		case PW_CLIENT_NODE_PORT_OP_SET_IO:
+			r = client_node_port_set_io(object,
+					op->direction, op->port_id, op->mix_id,
+					op->id, op->mem_id, op->offset, op->size);
+			break;
+		default:
+			r = -EINVAL;
+			break;
+		}
+		if (r < 0 && res == 0)
+			res = r;
+	}
+	return res;
+}
+
 static int link_signal_func(void *user_data)
 {
 	struct link *link = user_data;
+	struct pw_node *local;
 	uint64_t cmd = 1;
 	struct timespec ts;
 
@@ -785,6 +921,11 @@ static int link_signal_func(void *user_data)
 	link->target.activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 	link->target.activation->signal_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
+	/* the peer lives in this process, run it without a wakeup */
+	local = __atomic_load_n(&link->local, __ATOMIC_ACQUIRE);
+	if (local != NULL)
+		return local->rt.target.signal(local->rt.target.data);
+
 	if (write(link->signalfd, &cmd, sizeof(cmd)) != sizeof(cmd))
 		pw_log_warn("link %p: write failed %m", link);
 
@@ -825,6 +966,11 @@ client_node_set_activation(void *object,
 			res = -errno;
 			goto error_exit;
 		}
+		if ((res = check_activation(proxy, mm, size)) < 0) {
+			pw_memmap_free(mm);
+			close(signalfd);
+			goto error_exit;
+		}
 		ptr = mm->ptr;
 	}
 	pw_log_debug("node %p: set activation %d %p %u %u", node, node_id, ptr, offset, size);
@@ -843,10 +989,11 @@ client_node_set_activation(void *object,
 		link->target.signal = link_signal_func;
 		link->target.data = link;
 		link->target.node = NULL;
+		link->local = find_local(data, node_id);
 		spa_list_append(&node->rt.target_list, &link->target.link);
 
-		pw_log_debug("node %p: link %p: fd:%d id:%u state %p required %d, pending %d",
-				node, link, signalfd,
+		pw_log_debug("node %p: link %p: fd:%d local:%p id:%u state %p required %d, pending %d",
+				node, link, signalfd, link->local,
 				link->target.activation->position.clock.id,
 				&link->target.activation->state[0],
 				link->target.activation->state[0].required,
@@ -880,6 +1027,7 @@ static const struct pw_client_node_proxy_events client_node_events = {
 	.port_use_buffers = client_node_port_use_buffers,
 	.port_set_io = client_node_port_set_io,
 	.set_activation = client_node_set_activation,
+	.transaction = client_node_transaction,
 };
 
 static void do_node_init(struct pw_proxy *proxy)
@@ -1005,6 +1153,7 @@ static void client_node_proxy_destroy(void *_data)
 	pw_log_debug("%p: destroy", data);
 
 	clean_node(data);
+	spa_list_remove(&data->link);
 
 	spa_hook_remove(&data->node_listener);
 
@@ -1102,12 +1251,13 @@ static struct pw_proxy *node_export(struct pw_remote *remote, void *object, bool
 	struct pw_node *node = object;
 	struct pw_proxy *client_node;
 	struct node_data *data;
+	const char *str;
 	int i;
 
 	client_node = pw_core_proxy_create_object(remote->core_proxy,
 					    "client-node",
 					    PW_TYPE_INTERFACE_ClientNode,
-					    PW_VERSION_CLIENT_NODE,
+					    PW_VERSION_CLIENT_NODE_TRANSACTION,
 					    &node->properties->dict,
 					    sizeof(struct node_data));
         if (client_node == NULL)
@@ -1121,6 +1271,10 @@ static struct pw_proxy *node_export(struct pw_remote *remote, void *object, bool
 	data->client_node = (struct pw_client_node_proxy *)client_node;
 	data->remote_id = SPA_ID_INVALID;
 
+	str = pw_properties_get(remote->properties, PW_KEY_REMOTE_LOCAL_DISPATCH);
+	data->local_dispatch = str ? pw_properties_parse_bool(str) : true;
+	spa_list_append(&node_data_list, &data->link);
+
 	node->exported = true;
 
 	spa_list_init(&data->free_mix);
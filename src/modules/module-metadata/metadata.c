@@ -22,17 +22,30 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include <pipewire/pipewire.h>
 #include "pipewire/private.h"
 
 #include <extensions/metadata.h>
 
+struct item {
+	uint32_t subject;
+	char *key;
+	char *type;
+	char *value;
+};
+
 struct impl {
 	struct pw_global *global;
 
 	struct pw_metadata *metadata;
 	struct pw_resource *resource;
 	struct spa_hook resource_listener;
+	struct spa_hook metadata_listener;
+
+	/* last known state, sorted on (subject, key) */
+	struct pw_array items;
 };
 
 struct resource_data {
@@ -44,6 +57,103 @@ struct resource_data {
 	struct spa_hook metadata_listener;
 };
 
+static inline int item_compare(const struct item *item, uint32_t subject, const char *key)
+{
+	if (item->subject != subject)
+		return item->subject < subject ? -1 : 1;
+	if (key == NULL)
+		return 1;
+	return strcmp(item->key, key);
+}
+
+/* index of the first item not smaller than (subject, key), a NULL key
+ * sorts before all keys of the subject */
+static uint32_t find_item(struct impl *impl, uint32_t subject, const char *key)
+{
+	uint32_t lo = 0, hi = pw_array_get_len(&impl->items, struct item);
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		struct item *item = pw_array_get_unchecked(&impl->items, mid, struct item);
+		if (item_compare(item, subject, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static void clear_item(struct item *item)
+{
+	free(item->key);
+	free(item->type);
+	free(item->value);
+}
+
+static void remove_items(struct impl *impl, uint32_t idx, uint32_t n_items)
+{
+	struct item *item = pw_array_get_unchecked(&impl->items, idx, struct item);
+	uint32_t i;
+
+	if (n_items == 0)
+		return;
+	for (i = 0; i < n_items; i++)
+		clear_item(&item[i]);
+	memmove(item, item + n_items,
+			SPA_PTRDIFF(pw_array_end(&impl->items), item + n_items));
+	impl->items.size -= n_items * sizeof(struct item);
+}
+
+static int update_item(struct impl *impl, uint32_t subject,
+		const char *key, const char *type, const char *value)
+{
+	uint32_t idx, len, end;
+	struct item *item;
+
+	idx = find_item(impl, subject, key);
+	len = pw_array_get_len(&impl->items, struct item);
+
+	if (key == NULL) {
+		/* all keys of the subject */
+		for (end = idx; end < len; end++) {
+			item = pw_array_get_unchecked(&impl->items, end, struct item);
+			if (item->subject != subject)
+				break;
+		}
+		remove_items(impl, idx, end - idx);
+		return 0;
+	}
+
+	item = idx < len ? pw_array_get_unchecked(&impl->items, idx, struct item) : NULL;
+	if (item != NULL && item_compare(item, subject, key) != 0)
+		item = NULL;
+
+	if (value == NULL) {
+		if (item != NULL)
+			remove_items(impl, idx, 1);
+		return 0;
+	}
+	if (item == NULL) {
+		if (pw_array_add(&impl->items, sizeof(struct item)) == NULL)
+			return -errno;
+		item = pw_array_get_unchecked(&impl->items, idx, struct item);
+		memmove(item + 1, item, (len - idx) * sizeof(struct item));
+		item->subject = subject;
+		item->key = strdup(key);
+	} else {
+		free(item->type);
+		free(item->value);
+	}
+	item->type = type ? strdup(type) : NULL;
+	item->value = strdup(value);
+	return 0;
+}
+
+static void clear_items(struct impl *impl)
+{
+	remove_items(impl, 0, pw_array_get_len(&impl->items, struct item));
+}
+
 static int metadata_set_property(void *object,
 			uint32_t subject,
 			const char *key,
@@ -96,6 +206,23 @@ static const struct pw_metadata_events metadata_events = {
 	.property = metadata_property,
 };
 
+/* keeps the cache in sync with the implementation, this listener is
+ * added first so the cache is updated before the event is forwarded */
+static int impl_property(void *object,
+			uint32_t subject,
+			const char *key,
+			const char *type,
+			const char *value)
+{
+	struct impl *impl = object;
+	return update_item(impl, subject, key, type, value);
+}
+
+static const struct pw_metadata_events impl_metadata_events = {
+	PW_VERSION_METADATA_EVENTS,
+	.property = impl_property,
+};
+
 static void global_unbind(void *data)
 {
         struct resource_data *d = data;
@@ -115,6 +242,7 @@ global_bind(void *_data, struct pw_client *client, uint32_t permissions,
 	struct impl *impl = _data;
 	struct pw_resource *resource;
 	struct resource_data *data;
+	struct item *item;
 
 	resource = pw_resource_new(client, id, permissions, PW_TYPE_INTERFACE_Metadata, version, sizeof(*data));
         if (resource == NULL)
@@ -142,11 +270,34 @@ global_bind(void *_data, struct pw_client *client, uint32_t permissions,
 	pw_metadata_add_listener(impl->metadata,
 			&data->metadata_listener,
 			&metadata_events, data);
+
+	/* replay the current state, only the new resource sees this */
+	pw_array_for_each(item, &impl->items)
+		pw_metadata_resource_property(resource, item->subject,
+				item->key, item->type, item->value);
 	pw_log_debug(".");
 
 	return 0;
 }
 
+static void resource_destroy(void *data)
+{
+	struct impl *impl = data;
+
+	spa_hook_remove(&impl->resource_listener);
+	spa_hook_remove(&impl->metadata_listener);
+	if (impl->global)
+		pw_global_destroy(impl->global);
+	clear_items(impl);
+	pw_array_clear(&impl->items);
+	free(impl);
+}
+
+static const struct pw_resource_events impl_resource_events = {
+	PW_VERSION_RESOURCE_EVENTS,
+	.destroy = resource_destroy,
+};
+
 void *
 pw_metadata_new(struct pw_core *core, struct pw_resource *resource,
 		   struct pw_properties *properties)
@@ -179,6 +330,14 @@ pw_metadata_new(struct pw_core *core, struct pw_resource *resource,
 	}
 	impl->resource = resource;
 	impl->metadata = (struct pw_metadata*)resource;
+	pw_array_init(&impl->items, 64 * sizeof(struct item));
+
+	pw_resource_add_listener(resource,
+			&impl->resource_listener,
+			&impl_resource_events, impl);
+	pw_metadata_add_listener(impl->metadata,
+			&impl->metadata_listener,
+			&impl_metadata_events, impl);
 
 	pw_global_register(impl->global);
 
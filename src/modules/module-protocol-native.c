@@ -26,11 +26,13 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/file.h>
+#include <pthread.h>
 
 #include <spa/pod/iter.h>
 #include <spa/debug/pod.h>
@@ -68,8 +70,15 @@ static bool debug_messages = 0;
 #define LOCK_SUFFIX     ".lock"
 #define LOCK_SUFFIXLEN  5
 
+#define STATS_INTERVAL_SEC	1
+
+#define MAX_IO_THREADS		16
+#define MAX_QUEUED_MESSAGES	1024
+
 void pw_protocol_native_init(struct pw_protocol *protocol);
+#ifdef HAVE_COMPAT_V0
 void pw_protocol_native0_init(struct pw_protocol *protocol);
+#endif
 
 struct protocol_data {
 	struct pw_module *module;
@@ -89,6 +98,12 @@ struct client {
 	unsigned int flushing:1;
 };
 
+/** a thread that reads and frames client messages */
+struct io_thread {
+	struct pw_loop *loop;
+	struct pw_thread_loop *thread;
+};
+
 struct server {
 	struct pw_protocol_server this;
 
@@ -98,8 +113,25 @@ struct server {
 
 	struct pw_loop *loop;
 	struct spa_source *source;
+	struct spa_source *stats_timer;
 	struct spa_hook hook;
 	unsigned int activated:1;
+
+	struct io_thread io_threads[MAX_IO_THREADS];
+	uint32_t n_io_threads;
+	uint32_t next_io_thread;
+};
+
+#define QUEUED_MESSAGE	0
+#define QUEUED_START	1	/**< the connection started, res is the version */
+#define QUEUED_ERROR	2	/**< reading failed with res */
+
+/** a message read by an io thread, waiting to be dispatched */
+struct queued_message {
+	struct spa_list link;
+	uint32_t type;
+	int res;
+	struct pw_protocol_native_message msg;
 };
 
 struct client_data {
@@ -112,14 +144,196 @@ struct client_data {
 
 	unsigned int busy:1;
 	unsigned int need_flush:1;
+	unsigned int overflow:1;
+
+	uint64_t stats_messages_in;	/**< messages_in of the last stats update */
 
 	struct protocol_compat_v2 compat_v2;
+
+	/* with io threads, messages are read in the io thread and
+	 * dispatched from the queue on the main loop */
+	struct io_thread *io;
+	struct spa_source *io_source;	/**< on the io thread */
+	struct spa_source *queue_event;	/**< on the main loop */
+	pthread_mutex_t lock;		/**< protects queue, n_queued and stalled */
+	struct spa_list queue;
+	uint32_t n_queued;
+	bool stalled;			/**< io thread stopped reading, queue is full */
+	bool reading;			/**< io thread is reading from the connection */
+	struct queued_message *current;	/**< message being dispatched */
 };
 
+static int queue_message(struct client_data *data, uint32_t type, int res,
+		const struct pw_protocol_native_message *msg)
+{
+	struct queued_message *q;
+	size_t size = msg ? SPA_ROUND_UP_N(msg->size, 8) : 0;
+	size_t offset = SPA_ROUND_UP_N(sizeof(*q), 8);
+	uint32_t n_fds = msg ? msg->n_fds : 0;
+
+	if ((q = malloc(offset + size + n_fds * sizeof(int))) == NULL)
+		return -errno;
+
+	q->type = type;
+	q->res = res;
+	if (msg) {
+		q->msg = *msg;
+		q->msg.data = SPA_MEMBER(q, offset, void);
+		memcpy(q->msg.data, msg->data, msg->size);
+		q->msg.fds = SPA_MEMBER(q->msg.data, size, int);
+		memcpy(q->msg.fds, msg->fds, n_fds * sizeof(int));
+	} else {
+		spa_zero(q->msg);
+	}
+
+	pthread_mutex_lock(&data->lock);
+	spa_list_append(&data->queue, &q->link);
+	data->n_queued++;
+	pthread_mutex_unlock(&data->lock);
+
+	return 0;
+}
+
+/* called from the io thread */
+static void read_messages(struct client_data *data)
+{
+	const struct pw_protocol_native_message *msg;
+	struct io_thread *io = data->io;
+	bool queued = false, full;
+	int res;
+
+	data->reading = true;
+	while (true) {
+		pthread_mutex_lock(&data->lock);
+		if ((full = data->n_queued >= MAX_QUEUED_MESSAGES))
+			data->stalled = true;
+		pthread_mutex_unlock(&data->lock);
+
+		if (full) {
+			pw_log_debug(NAME" %p: queue full, stop reading", data->client);
+			pw_loop_update_io(io->loop, data->io_source,
+					data->io_source->mask & ~SPA_IO_IN);
+			break;
+		}
+
+		res = pw_protocol_native_connection_get_next(data->connection, &msg);
+		if (res == 0 || res == -EAGAIN)
+			break;
+		if (res > 0)
+			res = queue_message(data, QUEUED_MESSAGE, 0, msg);
+		if (res < 0) {
+			queue_message(data, QUEUED_ERROR, res, NULL);
+			pw_loop_destroy_source(io->loop, data->io_source);
+			data->io_source = NULL;
+			queued = true;
+			break;
+		}
+		queued = true;
+	}
+	data->reading = false;
+
+	if (queued)
+		pw_loop_signal_event(data->client->core->main_loop, data->queue_event);
+}
+
+static void
+io_data(void *data, int fd, uint32_t mask)
+{
+	struct client_data *this = data;
+
+	if (mask & (SPA_IO_HUP | SPA_IO_ERR)) {
+		/* the main loop sees this as well and destroys the client */
+		pw_loop_destroy_source(this->io->loop, this->io_source);
+		this->io_source = NULL;
+		return;
+	}
+	if (mask & SPA_IO_IN)
+		read_messages(this);
+}
+
+static int do_resume_reading(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct client_data *this = user_data;
+
+	if (this->io_source == NULL)
+		return 0;
+
+	pw_loop_update_io(this->io->loop, this->io_source,
+			this->io_source->mask | SPA_IO_IN);
+	/* the connection might have buffered messages */
+	read_messages(this);
+	return 0;
+}
+
+static int do_remove_io(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct client_data *this = user_data;
+
+	if (this->io_source)
+		pw_loop_destroy_source(this->io->loop, this->io_source);
+	this->io_source = NULL;
+	return 0;
+}
+
+static void resume_reading(struct client_data *data)
+{
+	pw_log_debug(NAME" %p: resume reading", data->client);
+	pw_loop_invoke(data->io->loop, do_resume_reading, 1, NULL, 0, false, data);
+}
+
+static void start_client(struct client_data *data, uint32_t version);
+
+static int next_message(struct client_data *data,
+		const struct pw_protocol_native_message **msg)
+{
+	struct queued_message *q;
+	bool resume;
+
+	if (data->io == NULL)
+		return pw_protocol_native_connection_get_next(data->connection, msg);
+
+	while (true) {
+		free(data->current);
+		data->current = NULL;
+
+		pthread_mutex_lock(&data->lock);
+		if (spa_list_is_empty(&data->queue)) {
+			q = NULL;
+		} else {
+			q = spa_list_first(&data->queue, struct queued_message, link);
+			spa_list_remove(&q->link);
+			data->n_queued--;
+		}
+		if ((resume = data->stalled && data->n_queued < MAX_QUEUED_MESSAGES / 2))
+			data->stalled = false;
+		pthread_mutex_unlock(&data->lock);
+
+		if (resume)
+			resume_reading(data);
+
+		if (q == NULL)
+			return 0;
+
+		data->current = q;
+
+		switch (q->type) {
+		case QUEUED_START:
+			start_client(data, q->res);
+			break;
+		case QUEUED_ERROR:
+			return q->res;
+		default:
+			*msg = &q->msg;
+			return 1;
+		}
+	}
+}
+
 static void
 process_messages(struct client_data *data)
 {
-	struct pw_protocol_native_connection *conn = data->connection;
 	struct pw_client *client = data->client;
 	struct pw_core *core = client->core;
 	const struct pw_protocol_native_message *msg;
@@ -135,7 +349,7 @@ process_messages(struct client_data *data)
 	        const struct pw_protocol_marshal *marshal;
 		uint32_t permissions, required;
 
-		res = pw_protocol_native_connection_get_next(conn, &msg);
+		res = next_message(data, &msg);
 		if (res < 0) {
 			if (res == -EAGAIN)
 				break;
@@ -227,10 +441,13 @@ client_busy_changed(void *data, bool busy)
 
 	c->busy = busy;
 
-	SPA_FLAG_UPDATE(mask, SPA_IO_IN, !busy);
-
 	pw_log_debug(NAME" %p: busy changed %d", client->protocol, busy);
-	pw_loop_update_io(client->core->main_loop, c->source, mask);
+
+	/* the io thread keeps reading until the queue is full */
+	if (c->io == NULL) {
+		SPA_FLAG_UPDATE(mask, SPA_IO_IN, !busy);
+		pw_loop_update_io(client->core->main_loop, c->source, mask);
+	}
 
 	if (!busy)
 		process_messages(c);
@@ -279,6 +496,22 @@ static void client_free(void *data)
 
 	spa_list_remove(&client->protocol_link);
 
+	if (this->io) {
+		struct queued_message *q;
+
+		/* also waits for pending resumes. The io thread needs the
+		 * lock to run do_remove_io, so don't hold it here */
+		pw_loop_invoke(this->io->loop, do_remove_io, 1, NULL, 0, true, this);
+
+		if (this->queue_event)
+			pw_loop_destroy_source(client->protocol->core->main_loop, this->queue_event);
+		spa_list_consume(q, &this->queue, link) {
+			spa_list_remove(&q->link);
+			free(q);
+		}
+		free(this->current);
+		pthread_mutex_destroy(&this->lock);
+	}
 	if (this->source)
 		pw_loop_destroy_source(client->protocol->core->main_loop, this->source);
 	if (this->connection)
@@ -293,20 +526,32 @@ static const struct pw_client_events client_events = {
 	.busy_changed = client_busy_changed,
 };
 
-static void on_start(void *data, uint32_t version)
+static void start_client(struct client_data *this, uint32_t version)
 {
-	struct client_data *this = data;
 	struct pw_client *client = this->client;
 	struct pw_core *core = client->core;
 
 	pw_log_debug("version %d", version);
 
+#ifndef HAVE_COMPAT_V0
+	/* without a core resource, the first message fails with -EPROTO
+	 * and the client is disconnected */
+	if (version == 0) {
+		pw_log_warn(NAME" %p: client uses the unsupported v0 protocol", client);
+		return;
+	}
+#endif
 	if (pw_global_bind(pw_core_get_global(core), client,
 			PW_PERM_RWX, version, 0) < 0)
 		return;
 
-	if (version == 0)
+#ifdef HAVE_COMPAT_V0
+	/* the type map is only needed to translate v0 messages */
+	if (version == 0) {
+		pw_map_init(&this->compat_v2.types, 0, 32);
 		client->compat_v2 = &this->compat_v2;
+	}
+#endif
 
 	if (pw_client_register(client, NULL) < 0)
 		return;
@@ -314,8 +559,65 @@ static void on_start(void *data, uint32_t version)
 	return;
 }
 
+static void on_start(void *data, uint32_t version)
+{
+	struct client_data *this = data;
+
+	/* the client is started from the main loop */
+	if (this->reading)
+		queue_message(this, QUEUED_START, version, NULL);
+	else
+		start_client(this, version);
+}
+
+static void on_queue_event(void *data, uint64_t count)
+{
+	struct client_data *this = data;
+	process_messages(this);
+}
+
+static int setup_io(struct server *s, struct client_data *this, int fd)
+{
+	struct pw_core *core = s->this.protocol->core;
+	struct io_thread *io;
+
+	io = &s->io_threads[s->next_io_thread++ % s->n_io_threads];
+
+	pthread_mutex_init(&this->lock, NULL);
+	spa_list_init(&this->queue);
+	this->io = io;
+
+	this->queue_event = pw_loop_add_event(pw_core_get_main_loop(core),
+			on_queue_event, this);
+	if (this->queue_event == NULL)
+		return -errno;
+
+	pw_thread_loop_lock(io->thread);
+	this->io_source = pw_loop_add_io(io->loop, fd,
+			SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP, false, io_data, this);
+	pw_thread_loop_unlock(io->thread);
+	if (this->io_source == NULL)
+		return -errno;
+
+	return 0;
+}
+
+static void on_server_error(void *data, int error)
+{
+	struct client_data *this = data;
+
+	/* the client is destroyed from the loop hook, we can be called
+	 * from anywhere a message is sent */
+	if (error == -ENOBUFS && !this->overflow) {
+		pw_log_warn(NAME" %p: client %p is not reading, disconnecting",
+				this->client->protocol, this->client);
+		this->overflow = true;
+	}
+}
+
 static const struct pw_protocol_native_connection_events server_conn_events = {
 	PW_VERSION_PROTOCOL_NATIVE_CONNECTION_EVENTS,
+	.error = on_server_error,
 	.start = on_start,
 };
 
@@ -330,6 +632,7 @@ static struct pw_client *client_new(struct server *s, int fd)
 	struct pw_properties *props;
 	char buffer[1024];
 	struct protocol_data *d = pw_protocol_get_user_data(protocol);
+	const char *str;
 
 	props = pw_properties_new(PW_KEY_PROTOCOL, "protocol-native", NULL);
 	if (props == NULL)
@@ -374,7 +677,9 @@ static struct pw_client *client_new(struct server *s, int fd)
 	if (this->connection == NULL)
 		goto cleanup_client;
 
-	pw_map_init(&this->compat_v2.types, 0, 32);
+	if ((str = pw_properties_get(pw_core_get_properties(core), PW_KEY_PROTOCOL_MAX_QUEUED)))
+		pw_protocol_native_connection_set_max_queued(this->connection,
+				pw_properties_parse_uint64(str));
 
 	pw_protocol_native_connection_add_listener(this->connection,
 						   &this->conn_listener,
@@ -383,6 +688,8 @@ static struct pw_client *client_new(struct server *s, int fd)
 
 	pw_client_add_listener(client, &this->client_listener, &client_events, this);
 
+	if (s->n_io_threads > 0 && setup_io(s, this, fd) < 0)
+		goto cleanup_client;
 
 	return client;
 
@@ -473,7 +780,7 @@ socket_data(void *data, int fd, uint32_t mask)
 	}
 	c = client->user_data;
 
-	if (!client->busy)
+	if (c->io == NULL && !client->busy)
 		pw_loop_update_io(client->protocol->core->main_loop,
 				c->source, c->source->mask | SPA_IO_IN);
 }
@@ -788,13 +1095,22 @@ static void destroy_server(struct pw_protocol_server *server)
 {
 	struct server *s = SPA_CONTAINER_OF(server, struct server, this);
 	struct pw_client *client, *tmp;
+	uint32_t i;
 
 	spa_list_remove(&server->link);
 	spa_hook_remove(&s->hook);
 
+	if (s->stats_timer)
+		pw_loop_destroy_source(pw_core_get_main_loop(server->protocol->core), s->stats_timer);
+
 	spa_list_for_each_safe(client, tmp, &server->client_list, protocol_link)
 		pw_client_destroy(client);
 
+	for (i = 0; i < s->n_io_threads; i++) {
+		pw_thread_loop_destroy(s->io_threads[i].thread);
+		pw_loop_destroy(s->io_threads[i].loop);
+	}
+
 	if (s->source) {
 		spa_hook_remove(&s->hook);
 		pw_loop_destroy_source(s->loop, s->source);
@@ -819,6 +1135,11 @@ static void on_before_hook(void *_data)
 	spa_list_for_each_safe(client, tmp, &this->client_list, protocol_link) {
 		data = client->user_data;
 
+		if (data->overflow) {
+			pw_client_destroy(client);
+			continue;
+		}
+
 		res = pw_protocol_native_connection_flush(data->connection);
 		if (res == -EAGAIN) {
 			int mask = data->source->mask;
@@ -834,6 +1155,48 @@ static void on_before_hook(void *_data)
 	}
 }
 
+static void update_client_stats(struct client_data *data)
+{
+	struct pw_protocol_native_connection_stats stats;
+	struct spa_dict_item items[6];
+	char vals[6][32];
+
+	pw_protocol_native_connection_get_stats(data->connection, &stats);
+
+	/* updating the properties sends an info event, only do it when the
+	 * client was active or it would see a change every interval */
+	if (stats.messages_in == data->stats_messages_in)
+		return;
+	data->stats_messages_in = stats.messages_in;
+
+	snprintf(vals[0], sizeof(vals[0]), "%"PRIu64, stats.bytes_in);
+	snprintf(vals[1], sizeof(vals[1]), "%"PRIu64, stats.bytes_out);
+	snprintf(vals[2], sizeof(vals[2]), "%"PRIu64, stats.messages_in);
+	snprintf(vals[3], sizeof(vals[3]), "%"PRIu64, stats.messages_out);
+	snprintf(vals[4], sizeof(vals[4]), "%"PRIu64, stats.queued);
+	snprintf(vals[5], sizeof(vals[5]), "%"PRIu64, (uint64_t)(stats.max_flush_latency / SPA_NSEC_PER_USEC));
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_BYTES_IN, vals[0]);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_BYTES_OUT, vals[1]);
+	items[2] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_MESSAGES_IN, vals[2]);
+	items[3] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_MESSAGES_OUT, vals[3]);
+	items[4] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_QUEUED, vals[4]);
+	items[5] = SPA_DICT_ITEM_INIT(PW_KEY_PROTOCOL_FLUSH_LATENCY, vals[5]);
+
+	pw_client_update_properties(data->client, &SPA_DICT_INIT(items, 6));
+}
+
+static void on_stats_timeout(void *_data, uint64_t expirations)
+{
+	struct server *server = _data;
+	struct pw_client *client, *tmp;
+
+	spa_list_for_each_safe(client, tmp, &server->this.client_list, protocol_link) {
+		struct client_data *data = client->user_data;
+		if (data->connection && client->global)
+			update_client_stats(data);
+	}
+}
+
 static const struct spa_loop_control_hooks impl_hooks = {
 	SPA_VERSION_LOOP_CONTROL_HOOKS,
 	.before = on_before_hook,
@@ -853,6 +1216,36 @@ get_name(const struct pw_properties *properties)
 	return name;
 }
 
+static int start_io_threads(struct server *s, int n_threads)
+{
+	struct io_thread *io;
+	int res;
+
+	while ((int)s->n_io_threads < SPA_MIN(n_threads, MAX_IO_THREADS)) {
+		io = &s->io_threads[s->n_io_threads];
+
+		if ((io->loop = pw_loop_new(NULL)) == NULL)
+			return -errno;
+
+		if ((io->thread = pw_thread_loop_new(io->loop, "protocol-io")) == NULL) {
+			res = -errno;
+			goto error_loop;
+		}
+		if ((res = pw_thread_loop_start(io->thread)) < 0)
+			goto error_thread;
+
+		s->n_io_threads++;
+	}
+	pw_log_info("server %p: %u io threads", s, s->n_io_threads);
+	return 0;
+
+error_thread:
+	pw_thread_loop_destroy(io->thread);
+error_loop:
+	pw_loop_destroy(io->loop);
+	return res;
+}
+
 static struct pw_protocol_server *
 impl_add_server(struct pw_protocol *protocol,
                 struct pw_core *core,
@@ -860,7 +1253,7 @@ impl_add_server(struct pw_protocol *protocol,
 {
 	struct pw_protocol_server *this;
 	struct server *s;
-	const char *name;
+	const char *name, *str;
 	int res;
 
 	if ((s = calloc(1, sizeof(struct server))) == NULL)
@@ -879,12 +1272,23 @@ impl_add_server(struct pw_protocol *protocol,
 
 	pw_loop_add_hook(pw_core_get_main_loop(core), &s->hook, &impl_hooks, s);
 
+	s->stats_timer = pw_loop_add_timer(pw_core_get_main_loop(core), on_stats_timeout, s);
+	if (s->stats_timer) {
+		struct timespec interval = { STATS_INTERVAL_SEC, 0 };
+		pw_loop_update_timer(pw_core_get_main_loop(core), s->stats_timer,
+				&interval, &interval, false);
+	}
+
 	if ((res = init_socket_name(s, name)) < 0)
 		goto error;
 
 	if ((res = lock_socket(s)) < 0)
 		goto error;
 
+	if ((str = pw_properties_get(pw_core_get_properties(core), PW_KEY_PROTOCOL_IO_THREADS)) &&
+	    (res = start_io_threads(s, pw_properties_parse_int(str))) < 0)
+		goto error;
+
 	if ((res = add_socket(protocol, s)) < 0)
 		goto error;
 
@@ -947,6 +1351,13 @@ static uint32_t impl_ext_add_resource_fd(struct pw_resource *resource, int fd)
 static int impl_ext_get_resource_fd(struct pw_resource *resource, uint32_t index)
 {
 	struct client_data *data = resource->client->user_data;
+	if (data->current) {
+		if (index == SPA_ID_INVALID)
+			return -1;
+		if (index >= data->current->msg.n_fds)
+			return -ENOENT;
+		return data->current->msg.fds[index];
+	}
 	return pw_protocol_native_connection_get_fd(data->connection, index);
 }
 
@@ -957,6 +1368,31 @@ static int impl_ext_end_resource(struct pw_resource *resource,
 	struct pw_client *client = resource->client;
 	return client->send_seq = pw_protocol_native_connection_end(data->connection, builder);
 }
+
+static uint32_t impl_ext_get_proxy_features(struct pw_proxy *proxy)
+{
+	struct client *impl = SPA_CONTAINER_OF(proxy->remote->conn, struct client, this);
+	return pw_protocol_native_connection_get_features(impl->connection);
+}
+
+static int impl_ext_set_proxy_features(struct pw_proxy *proxy, uint32_t features)
+{
+	struct client *impl = SPA_CONTAINER_OF(proxy->remote->conn, struct client, this);
+	return pw_protocol_native_connection_set_features(impl->connection, features);
+}
+
+static uint32_t impl_ext_get_resource_features(struct pw_resource *resource)
+{
+	struct client_data *data = resource->client->user_data;
+	return pw_protocol_native_connection_get_features(data->connection);
+}
+
+static int impl_ext_set_resource_features(struct pw_resource *resource, uint32_t features)
+{
+	struct client_data *data = resource->client->user_data;
+	return pw_protocol_native_connection_set_features(data->connection, features);
+}
+
 const static struct pw_protocol_native_ext protocol_ext_impl = {
 	PW_VERSION_PROTOCOL_NATIVE_EXT,
 	.begin_proxy = impl_ext_begin_proxy,
@@ -967,6 +1403,10 @@ const static struct pw_protocol_native_ext protocol_ext_impl = {
 	.add_resource_fd = impl_ext_add_resource_fd,
 	.get_resource_fd = impl_ext_get_resource_fd,
 	.end_resource = impl_ext_end_resource,
+	.get_proxy_features = impl_ext_get_proxy_features,
+	.set_proxy_features = impl_ext_set_proxy_features,
+	.get_resource_features = impl_ext_get_resource_features,
+	.set_resource_features = impl_ext_set_resource_features,
 };
 
 static void module_destroy(void *data)
@@ -1005,7 +1445,9 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 	this->extension = &protocol_ext_impl;
 
 	pw_protocol_native_init(this);
+#ifdef HAVE_COMPAT_V0
 	pw_protocol_native0_init(this);
+#endif
 
 	pw_log_debug(NAME" %p: new %d", this, debug_messages);
 
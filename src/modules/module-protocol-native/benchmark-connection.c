@@ -0,0 +1,140 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+
+#include <pipewire/pipewire.h>
+
+#include "connection.h"
+
+#define MAX_ROUNDS 10000
+
+static void send_ping(struct pw_protocol_native_connection *conn, bool compact,
+		uint32_t id, int seq)
+{
+	struct spa_pod_builder *b;
+	struct pw_protocol_native_compact c = { id, seq };
+
+	b = pw_protocol_native_connection_begin(conn, 0, 1, NULL);
+	if (compact)
+		spa_pod_builder_raw(b, &c, sizeof(c));
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(seq));
+	spa_assert(pw_protocol_native_connection_end(conn, b) >= 0);
+	spa_assert(pw_protocol_native_connection_flush(conn) == 0);
+}
+
+static void recv_ping(struct pw_protocol_native_connection *conn, bool compact,
+		uint32_t id, int seq)
+{
+	const struct pw_protocol_native_message *msg;
+	const struct pw_protocol_native_compact *c;
+	struct spa_pod_parser prs;
+	uint32_t rid;
+	int rseq;
+
+	spa_assert(pw_protocol_native_connection_get_next(conn, &msg) == 1);
+	if (compact) {
+		spa_assert(msg->size == sizeof(*c));
+		c = msg->data;
+		rid = c->id;
+		rseq = c->seq;
+	} else {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		spa_assert(spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&rid),
+					SPA_POD_Int(&rseq)) == 2);
+	}
+	spa_assert(rid == id);
+	spa_assert(rseq == seq);
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run(const char *name, struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out, bool compact)
+{
+	struct pw_protocol_native_connection_stats s0, s;
+	uint64_t t1, t2;
+	int i;
+
+	pw_protocol_native_connection_get_stats(out, &s0);
+	t1 = get_time();
+	for (i = 0; i < MAX_ROUNDS; i++) {
+		send_ping(out, compact, 0, i);
+		recv_ping(in, compact, 0, i);
+		send_ping(in, compact, 0, i);
+		recv_ping(out, compact, 0, i);
+	}
+	t2 = get_time();
+	pw_protocol_native_connection_get_stats(out, &s);
+
+	fprintf(stderr, "%s: elapsed %"PRIu64" rounds %d = %"PRIu64" nsec/round, %"PRIu64" bytes\n",
+			name, t2 - t1, MAX_ROUNDS, (t2 - t1) / MAX_ROUNDS,
+			s.bytes_out - s0.bytes_out);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_protocol_native_connection *in, *out;
+	int fds[2];
+
+	pw_init(&argc, &argv);
+
+	loop = pw_main_loop_new(NULL);
+	core = pw_core_new(pw_main_loop_get_loop(loop), NULL, 0);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		return -1;
+
+	in = pw_protocol_native_connection_new(core, fds[0]);
+	out = pw_protocol_native_connection_new(core, fds[1]);
+	if (in == NULL || out == NULL)
+		return -1;
+
+	run("pod", in, out, false);
+	run("compact", in, out, true);
+
+	pw_protocol_native_connection_destroy(in);
+	pw_protocol_native_connection_destroy(out);
+	pw_core_destroy(core);
+	pw_main_loop_destroy(loop);
+
+	return 0;
+}
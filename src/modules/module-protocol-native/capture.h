@@ -0,0 +1,68 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PIPEWIRE_PROTOCOL_NATIVE_CAPTURE_H
+#define PIPEWIRE_PROTOCOL_NATIVE_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/** \file
+ *
+ * File format of the protocol captures, written by the connection when
+ * PIPEWIRE_PROTOCOL_CAPTURE is set and read by pipewire-replay.
+ *
+ * A capture starts with a \ref pw_protocol_native_capture_header and is
+ * followed by one \ref pw_protocol_native_capture_record per message, each
+ * followed by the size bytes of the message payload. Fds are not
+ * captured, only their number. All values are in host byte order.
+ */
+
+#define PW_PROTOCOL_NATIVE_CAPTURE_MAGIC	0x50434150	/* "PCAP" */
+#define PW_PROTOCOL_NATIVE_CAPTURE_VERSION	0
+
+struct pw_protocol_native_capture_header {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct pw_protocol_native_capture_record {
+#define PW_PROTOCOL_NATIVE_CAPTURE_FLAG_IN	(1<<0)	/**< received, else sent */
+	uint32_t flags;
+	uint32_t id;			/**< destination id */
+	uint32_t opcode;
+	uint32_t seq;
+	uint32_t n_fds;			/**< fds sent with the message */
+	uint32_t size;			/**< size of the payload that follows */
+	uint64_t time;			/**< CLOCK_MONOTONIC in nsec */
+};
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* PIPEWIRE_PROTOCOL_NATIVE_CAPTURE_H */
@@ -25,21 +25,29 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <sys/socket.h>
 
 #include <spa/debug/pod.h>
 
+#include "config.h"
+
 #include <pipewire/pipewire.h>
 #include "pipewire/private.h"
 
 #include "connection.h"
+#include "capture.h"
 
 #define MAX_BUFFER_SIZE (1024 * 32)
 #define MAX_FDS 1024
 #define MAX_FDS_MSG 28
+#define MAX_IOV 16
 
 #define HDR_SIZE	16
 
@@ -53,7 +61,7 @@ struct buffer {
 	uint32_t n_fds;
 
 	uint32_t seq;
-	size_t offset;
+	size_t offset;			/**< consumed data: parsed for in, sent for out */
 	size_t fds_offset;
 	struct pw_protocol_native_message msg;
 
@@ -61,6 +69,15 @@ struct buffer {
 	bool first;
 };
 
+/* out data is queued in a chain of segments, a message is never split
+ * over segments so that the builder can write it in place */
+struct segment {
+	struct spa_list link;
+	size_t size;			/**< size of the complete messages */
+	size_t maxsize;
+	uint8_t data[];
+};
+
 struct impl {
 	struct pw_protocol_native_connection this;
 	struct pw_core *core;
@@ -68,10 +85,77 @@ struct impl {
 	struct buffer in, out;
 	struct spa_pod_builder builder;
 
+	struct spa_list segments;	/**< out data, out.offset is sent from the first */
+	struct segment *free_segment;	/**< a spare segment */
+
 	uint32_t version;
 	size_t hdr_size;
+
+	struct pw_protocol_native_connection_stats stats;
+	size_t max_queued;
+	uint64_t queued_time;		/**< when data was queued on an empty queue */
+
+	uint32_t features;
+
+	FILE *capture;			/**< messages are captured here when not NULL */
 };
 
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* one capture file per connection, named after the prefix in
+ * PIPEWIRE_PROTOCOL_CAPTURE, the pid and a counter */
+static FILE *open_capture(struct pw_protocol_native_connection *conn)
+{
+	static uint32_t counter = 0;
+	struct pw_protocol_native_capture_header hdr = {
+		PW_PROTOCOL_NATIVE_CAPTURE_MAGIC,
+		PW_PROTOCOL_NATIVE_CAPTURE_VERSION };
+	const char *prefix;
+	char path[PATH_MAX];
+	FILE *f;
+
+	if ((prefix = getenv("PIPEWIRE_PROTOCOL_CAPTURE")) == NULL)
+		return NULL;
+
+	snprintf(path, sizeof(path), "%s-%d-%u.cap", prefix, (int)getpid(),
+			__atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+	if ((f = fopen(path, "we")) == NULL) {
+		pw_log_warn("connection %p: can't open capture %s: %m", conn, path);
+		return NULL;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+		fclose(f);
+		return NULL;
+	}
+	pw_log_info("connection %p: capturing to %s", conn, path);
+	return f;
+}
+
+static void capture_message(struct impl *impl, uint32_t flags,
+		const struct pw_protocol_native_message *msg, const void *data, uint32_t size)
+{
+	struct pw_protocol_native_capture_record rec = {
+		.flags = flags,
+		.id = msg->id,
+		.opcode = msg->opcode,
+		.seq = msg->seq,
+		.n_fds = msg->n_fds,
+		.size = size,
+		.time = get_time_ns() };
+
+	if (fwrite(&rec, sizeof(rec), 1, impl->capture) != 1 ||
+	    fwrite(data, size, 1, impl->capture) != 1) {
+		pw_log_warn("connection %p: capture failed, stopping", &impl->this);
+		fclose(impl->capture);
+		impl->capture = NULL;
+	}
+}
+
 /** \endcond */
 
 /** Get an fd from a connection
@@ -136,7 +220,10 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 	int res;
 
 	if (buf->buffer_size + size > buf->buffer_maxsize) {
-		buf->buffer_maxsize = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		/* grow at least twice the size, many small messages would
+		 * otherwise realloc and copy the whole buffer each time */
+		buf->buffer_maxsize = SPA_ROUND_UP_N(SPA_MAX(buf->buffer_size + size,
+					buf->buffer_maxsize * 2), MAX_BUFFER_SIZE);
 		buf->buffer_data = realloc(buf->buffer_data, buf->buffer_maxsize);
 		if (buf->buffer_data == NULL) {
 			res = -errno;
@@ -147,14 +234,50 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 			errno = -res;
 			return NULL;
 		}
-		pw_log_warn("connection %p: resize buffer to %zd %zd %zd",
+		pw_log_debug("connection %p: resize buffer to %zd %zd %zd",
 			    conn, buf->buffer_size, size, buf->buffer_maxsize);
 	}
 	return (uint8_t *) buf->buffer_data + buf->buffer_size;
 }
 
+static struct segment *segment_new(struct impl *impl, size_t size)
+{
+	struct segment *s = impl->free_segment;
+	size_t maxsize = SPA_ROUND_UP_N(size, MAX_BUFFER_SIZE);
+
+	if (s != NULL && s->maxsize >= maxsize) {
+		impl->free_segment = NULL;
+	} else {
+		if ((s = malloc(sizeof(struct segment) + maxsize)) == NULL)
+			return NULL;
+		s->maxsize = maxsize;
+	}
+	s->size = 0;
+	spa_list_append(&impl->segments, &s->link);
+	return s;
+}
+
+static void segment_free(struct impl *impl, struct segment *s)
+{
+	spa_list_remove(&s->link);
+	if (impl->free_segment == NULL && s->maxsize == MAX_BUFFER_SIZE)
+		impl->free_segment = s;
+	else
+		free(s);
+}
+
+static void clear_segments(struct impl *impl)
+{
+	struct segment *s;
+
+	spa_list_consume(s, &impl->segments, link)
+		segment_free(impl, s);
+	impl->out.offset = 0;
+}
+
 static int refill_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
 {
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	ssize_t len;
 	struct cmsghdr *cmsg;
 	struct msghdr msg = { 0 };
@@ -188,6 +311,7 @@ static int refill_buffer(struct pw_protocol_native_connection *conn, struct buff
 	}
 
 	buf->buffer_size += len;
+	impl->stats.bytes_in += len;
 
 	/* handle control messages */
 	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
@@ -247,21 +371,20 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(struct p
 	impl->hdr_size = HDR_SIZE;
 	impl->version = 3;
 
-	impl->out.buffer_data = calloc(1, MAX_BUFFER_SIZE);
-	impl->out.buffer_maxsize = MAX_BUFFER_SIZE;
+	spa_list_init(&impl->segments);
 	impl->in.buffer_data = calloc(1, MAX_BUFFER_SIZE);
 	impl->in.buffer_maxsize = MAX_BUFFER_SIZE;
 	impl->in.update = true;
 	impl->in.first = true;
 
-	if (impl->out.buffer_data == NULL || impl->in.buffer_data == NULL)
+	if (impl->in.buffer_data == NULL)
 		goto no_mem;
 
+	impl->capture = open_capture(this);
+
 	return this;
 
 no_mem:
-	free(impl->out.buffer_data);
-	free(impl->in.buffer_data);
 	free(impl);
 	return NULL;
 }
@@ -280,11 +403,30 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 
 	spa_hook_list_call(&conn->listener_list, struct pw_protocol_native_connection_events, destroy, 0);
 
-	free(impl->out.buffer_data);
+	clear_segments(impl);
+	free(impl->free_segment);
 	free(impl->in.buffer_data);
+	if (impl->capture)
+		fclose(impl->capture);
 	free(impl);
 }
 
+/* move the unparsed data and fds to the start of the buffer */
+static void compact_buffer(struct pw_protocol_native_connection *conn, struct buffer *buf)
+{
+	size_t size = buf->buffer_size - buf->offset;
+	uint32_t n_fds = buf->n_fds - buf->fds_offset;
+
+	pw_log_trace("connection %p: compact %zd bytes and %u fds", conn, size, n_fds);
+
+	memmove(buf->buffer_data, buf->buffer_data + buf->offset, size);
+	buf->buffer_size = size;
+	buf->offset = 0;
+	memmove(buf->fds, &buf->fds[buf->fds_offset], n_fds * sizeof(int));
+	buf->n_fds = n_fds;
+	buf->fds_offset = 0;
+}
+
 static int prepare_packet(struct pw_protocol_native_connection *conn, struct buffer *buf)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
@@ -376,25 +518,62 @@ pw_protocol_native_connection_get_next(struct pw_protocol_native_connection *con
 		if (len == 0)
 			break;
 
+		/* the parsed messages are done, drop them instead of growing
+		 * the buffer. Only the partial message at the end is moved. */
+		if (buf->offset > 0 &&
+		    (buf->buffer_size + len > buf->buffer_maxsize ||
+		     buf->n_fds + MAX_FDS_MSG > MAX_FDS))
+			compact_buffer(conn, buf);
+
 		if (connection_ensure_size(conn, buf, len) == NULL)
 			return -errno;
 		if ((res = refill_buffer(conn, buf)) < 0)
 			return res;
 	}
+	impl->stats.messages_in++;
 	*msg = &buf->msg;
+	pw_trace_point(message_in, conn->fd, buf->msg.id, buf->msg.opcode, buf->msg.size);
+	if (impl->capture)
+		capture_message(impl, PW_PROTOCOL_NATIVE_CAPTURE_FLAG_IN,
+				&buf->msg, buf->msg.data, buf->msg.size);
 	return 1;
 }
 
+/* make room for the header and \a size bytes of payload of the current
+ * message. When the message doesn't fit in the last segment, only the
+ * message is moved to a new segment. */
 static inline void *begin_write(struct pw_protocol_native_connection *conn, uint32_t size)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t *p;
-	struct buffer *buf = &impl->out;
-	/* header and size for payload */
-	if ((p = connection_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
-		return NULL;
+	struct segment *s = NULL, *n;
+	size_t need = impl->hdr_size + size;
+	int res;
+
+	if (!spa_list_is_empty(&impl->segments))
+		s = spa_list_last(&impl->segments, struct segment, link);
 
-	return SPA_MEMBER(p, impl->hdr_size, void);
+	if (s == NULL || s->size + need > s->maxsize) {
+		if ((n = segment_new(impl, need)) == NULL) {
+			res = -errno;
+			spa_hook_list_call(&conn->listener_list,
+					struct pw_protocol_native_connection_events,
+					error, 0, -res);
+			errno = -res;
+			return NULL;
+		}
+		if (s != NULL) {
+			memcpy(n->data, s->data + s->size,
+				SPA_MIN(impl->hdr_size + impl->builder.state.offset,
+					s->maxsize - s->size));
+			/* it only had the unfinished message */
+			if (s->size == 0)
+				segment_free(impl, s);
+		}
+		pw_log_debug("connection %p: new segment %p of %zd for %zd",
+				conn, n, n->maxsize, need);
+		s = n;
+	}
+	return s->data + s->size + impl->hdr_size;
 }
 
 static int builder_overflow(void *data, uint32_t size)
@@ -446,10 +625,22 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	uint32_t *p, size = builder->state.offset;
 	struct buffer *buf = &impl->out;
+	struct segment *s;
 	int res;
 
-	if ((p = connection_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
+	if (impl->max_queued > 0 &&
+	    impl->stats.queued + impl->hdr_size + size > impl->max_queued) {
+		pw_log_debug("connection %p: %"PRIu64" bytes queued, dropping message id:%u op:%u",
+				conn, impl->stats.queued, buf->msg.id, buf->msg.opcode);
+		spa_hook_list_call(&conn->listener_list,
+				struct pw_protocol_native_connection_events,
+				error, 0, -ENOBUFS);
+		return -ENOBUFS;
+	}
+
+	if ((p = begin_write(conn, size)) == NULL)
 		return -errno;
+	p = SPA_MEMBER(p, -impl->hdr_size, uint32_t);
 
 	p[0] = buf->msg.id;
 	p[1] = (buf->msg.opcode << 24) | (size & 0xffffff);
@@ -458,7 +649,17 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 		p[3] = buf->msg.n_fds;
 	}
 
-	buf->buffer_size += impl->hdr_size + size;
+	s = spa_list_last(&impl->segments, struct segment, link);
+	s->size += impl->hdr_size + size;
+
+	if (impl->stats.queued == 0)
+		impl->queued_time = get_time_ns();
+	impl->stats.queued += impl->hdr_size + size;
+	impl->stats.messages_out++;
+	pw_trace_point(message_out, conn->fd, buf->msg.id, buf->msg.opcode, size);
+	if (impl->capture)
+		capture_message(impl, 0, &buf->msg,
+				SPA_MEMBER(p, impl->hdr_size, void), size);
 	if (impl->version >= 3)
 		buf->n_fds += buf->msg.n_fds;
 	else
@@ -493,36 +694,52 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	ssize_t sent, outsize;
 	struct msghdr msg = { 0 };
-	struct iovec iov[1];
+	struct iovec iov[MAX_IOV];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS_MSG * sizeof(int))];
 	int res = 0, *fds;
-	uint32_t fds_len, n_fds, outfds;
+	uint32_t fds_len, n_fds, outfds, n_iov;
 	struct buffer *buf;
-	void *data;
-	size_t size;
+	struct segment *s, *t;
+	size_t offset, limit, len;
 
 	buf = &impl->out;
-	data = buf->buffer_data;
-	size = buf->buffer_size;
 	fds = buf->fds;
 	n_fds = buf->n_fds;
 
-	while (size > 0) {
+	while (true) {
+		/* with more fds than fit in one message, send them with
+		 * a few bytes at a time */
 		if (n_fds > MAX_FDS_MSG) {
 			outfds = MAX_FDS_MSG;
-			outsize = SPA_MIN(sizeof(uint32_t), size);
+			limit = sizeof(uint32_t);
 		} else {
 			outfds = n_fds;
-			outsize = size;
+			limit = SIZE_MAX;
+		}
+
+		n_iov = 0;
+		outsize = 0;
+		offset = buf->offset;
+		spa_list_for_each(s, &impl->segments, link) {
+			if (n_iov == MAX_IOV || (size_t)outsize >= limit)
+				break;
+			len = SPA_MIN(s->size - offset, limit - outsize);
+			if (len > 0) {
+				iov[n_iov].iov_base = s->data + offset;
+				iov[n_iov].iov_len = len;
+				outsize += len;
+				n_iov++;
+			}
+			offset = 0;
 		}
+		if (outsize == 0)
+			break;
 
 		fds_len = outfds * sizeof(int);
 
-		iov[0].iov_base = data;
-		iov[0].iov_len = outsize;
 		msg.msg_iov = iov;
-		msg.msg_iovlen = 1;
+		msg.msg_iovlen = n_iov;
 
 		if (outfds > 0) {
 			msg.msg_control = cmsgbuf;
@@ -550,11 +767,31 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 			}
 			break;
 		}
-		pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, sent,
-			     outfds);
+		pw_log_trace("connection %p: %d written %zd bytes in %u segments and %u fds",
+				conn, conn->fd, sent, n_iov, outfds);
+
+		impl->stats.bytes_out += sent;
+		impl->stats.queued -= sent;
+		if (impl->stats.queued == 0) {
+			impl->stats.flush_latency = get_time_ns() - impl->queued_time;
+			impl->stats.max_flush_latency = SPA_MAX(impl->stats.max_flush_latency,
+					impl->stats.flush_latency);
+		}
 
-		size -= sent;
-		data = SPA_MEMBER(data, sent, void);
+		/* release the sent segments, keep the last one for new messages */
+		spa_list_for_each_safe(s, t, &impl->segments, link) {
+			len = s->size - buf->offset;
+			if ((size_t)sent < len) {
+				buf->offset += sent;
+				break;
+			}
+			sent -= len;
+			buf->offset = 0;
+			if (s->link.next == &impl->segments)
+				s->size = 0;
+			else
+				segment_free(impl, s);
+		}
 		n_fds -= outfds;
 		fds += outfds;
 	}
@@ -562,9 +799,6 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	res = 0;
 
 exit:
-	if (size > 0)
-		memmove(buf->buffer_data, data, size);
-	buf->buffer_size = size;
 	if (n_fds > 0)
 		memmove(buf->fds, fds, n_fds * sizeof(int));
 	buf->n_fds = n_fds;
@@ -585,8 +819,73 @@ int pw_protocol_native_connection_clear(struct pw_protocol_native_connection *co
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 
 	clear_buffer(&impl->out);
+	clear_segments(impl);
 	clear_buffer(&impl->in);
 	impl->in.update = true;
+	impl->stats.queued = 0;
+
+	return 0;
+}
 
+/** Get the statistics of a connection
+ *
+ * \param conn the connection object
+ * \param stats the statistics are stored here
+ * \return 0 on success
+ *
+ * \memberof pw_protocol_native_connection
+ */
+int pw_protocol_native_connection_get_stats(struct pw_protocol_native_connection *conn,
+		struct pw_protocol_native_connection_stats *stats)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	*stats = impl->stats;
+	return 0;
+}
+
+/** Limit the amount of queued data of a connection
+ *
+ * \param conn the connection object
+ * \param max_queued the max number of queued bytes, 0 for no limit
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void pw_protocol_native_connection_set_max_queued(struct pw_protocol_native_connection *conn,
+		size_t max_queued)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	impl->max_queued = max_queued;
+}
+
+/** Get the enabled features of a connection
+ *
+ * \param conn the connection object
+ * \return the enabled PW_PROTOCOL_NATIVE_FEATURE_* flags
+ *
+ * \memberof pw_protocol_native_connection
+ */
+uint32_t pw_protocol_native_connection_get_features(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	return impl->features;
+}
+
+/** Enable features on a connection
+ *
+ * \param conn the connection object
+ * \param features PW_PROTOCOL_NATIVE_FEATURE_* flags to enable
+ * \return 0 on success, -ENOTSUP when the peer uses the old protocol
+ *
+ * \memberof pw_protocol_native_connection
+ */
+int pw_protocol_native_connection_set_features(struct pw_protocol_native_connection *conn,
+		uint32_t features)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	if (impl->version < 3)
+		return -ENOTSUP;
+	if ((impl->features & features) != features)
+		pw_log_debug("connection %p: features %08x", conn, impl->features | features);
+	impl->features |= features;
 	return 0;
 }
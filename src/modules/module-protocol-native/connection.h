@@ -69,6 +69,19 @@ pw_protocol_native_connection_add_listener(struct pw_protocol_native_connection
 	spa_hook_list_append(&conn->listener_list, listener, events, data);
 }
 
+/** connection statistics */
+struct pw_protocol_native_connection_stats {
+	uint64_t bytes_in;		/**< bytes received */
+	uint64_t bytes_out;		/**< bytes sent */
+	uint64_t messages_in;		/**< messages received */
+	uint64_t messages_out;		/**< messages queued for sending */
+	uint64_t queued;		/**< bytes queued and not yet sent */
+	uint64_t flush_latency;		/**< nsec between queueing data on an empty
+					  *  queue and the queue being sent completely,
+					  *  the last value */
+	uint64_t max_flush_latency;	/**< max of flush_latency */
+};
+
 struct pw_protocol_native_connection *
 pw_protocol_native_connection_new(struct pw_core *core, int fd);
 
@@ -97,6 +110,26 @@ pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 int
 pw_protocol_native_connection_clear(struct pw_protocol_native_connection *conn);
 
+int
+pw_protocol_native_connection_get_stats(struct pw_protocol_native_connection *conn,
+				struct pw_protocol_native_connection_stats *stats);
+
+/** Set the max number of bytes that can be queued, 0 for no limit. When a
+ * message would go over the limit, it is dropped and the error event is
+ * emited with -ENOBUFS. */
+void
+pw_protocol_native_connection_set_max_queued(struct pw_protocol_native_connection *conn,
+				size_t max_queued);
+
+/** Get the PW_PROTOCOL_NATIVE_FEATURE_* that are enabled on the connection */
+uint32_t
+pw_protocol_native_connection_get_features(struct pw_protocol_native_connection *conn);
+
+/** Enable PW_PROTOCOL_NATIVE_FEATURE_* on the connection */
+int
+pw_protocol_native_connection_set_features(struct pw_protocol_native_connection *conn,
+				uint32_t features);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif
@@ -34,6 +34,27 @@
 
 #include "connection.h"
 
+/* sync, done, ping and pong are sent for each roundtrip and are encoded
+ * as two plain integers when the peer supports it, see hello */
+static inline void write_compact(struct spa_pod_builder *b, uint32_t id, int seq)
+{
+	struct pw_protocol_native_compact c = { id, seq };
+	spa_pod_builder_raw(b, &c, sizeof(c));
+}
+
+static inline bool read_compact(const struct pw_protocol_native_message *msg,
+		uint32_t *id, int *seq)
+{
+	const struct pw_protocol_native_compact *c = msg->data;
+
+	/* a pod struct with two ints is always larger */
+	if (msg->size != sizeof(*c))
+		return false;
+	*id = c->id;
+	*seq = c->seq;
+	return true;
+}
+
 static int core_method_marshal_add_listener(void *object,
 			struct spa_hook *listener,
 			const struct pw_core_proxy_events *events,
@@ -51,8 +72,10 @@ static int core_method_marshal_hello(void *object, uint32_t version)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_HELLO, NULL);
 
+	/* older servers ignore the features */
 	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(version));
+			SPA_POD_Int(version),
+			SPA_POD_Int(PW_PROTOCOL_NATIVE_FEATURE_COMPACT));
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -65,9 +88,12 @@ static int core_method_marshal_sync(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_SYNC, &msg);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
+	if (pw_protocol_native_get_proxy_features(proxy) & PW_PROTOCOL_NATIVE_FEATURE_COMPACT)
+		write_compact(b, id, SPA_RESULT_RETURN_ASYNC(msg->seq));
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -79,9 +105,12 @@ static int core_method_marshal_pong(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_PROXY_METHOD_PONG, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(seq));
+	if (pw_protocol_native_get_proxy_features(proxy) & PW_PROTOCOL_NATIVE_FEATURE_COMPACT)
+		write_compact(b, id, seq);
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(seq));
 
 	return pw_protocol_native_end_proxy(proxy, b);
 }
@@ -154,10 +183,8 @@ static void push_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
 static inline int parse_item(struct spa_pod_parser *prs, struct spa_dict_item *item)
 {
 	int res;
-	if ((res = spa_pod_parser_get(prs,
-		       SPA_POD_String(&item->key),
-		       SPA_POD_String(&item->value),
-		       NULL)) < 0)
+	if ((res = spa_pod_parser_get_string(prs, &item->key)) < 0 ||
+	    (res = spa_pod_parser_get_string(prs, &item->value)) < 0)
 		return res;
 	if (strstr(item->value, "pointer:") == item->value)
 		item->value = "";
@@ -279,13 +306,19 @@ static int core_event_demarshal_done(void *object, const struct pw_protocol_nati
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
-	uint32_t id, seq;
+	uint32_t id;
+	int seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
-		return -EINVAL;
+	if (read_compact(msg, &id, &seq)) {
+		/* the server understood our hello, reply in kind */
+		pw_protocol_native_set_proxy_features(proxy, PW_PROTOCOL_NATIVE_FEATURE_COMPACT);
+	} else {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		if (spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&id),
+					SPA_POD_Int(&seq)) < 0)
+			return -EINVAL;
+	}
 
 	return pw_proxy_notify(proxy, struct pw_core_proxy_events, done, 0, id, seq);
 }
@@ -294,13 +327,19 @@ static int core_event_demarshal_ping(void *object, const struct pw_protocol_nati
 {
 	struct pw_proxy *proxy = object;
 	struct spa_pod_parser prs;
-	uint32_t id, seq;
+	uint32_t id;
+	int seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
-		return -EINVAL;
+	if (read_compact(msg, &id, &seq)) {
+		/* the server understood our hello, reply in kind */
+		pw_protocol_native_set_proxy_features(proxy, PW_PROTOCOL_NATIVE_FEATURE_COMPACT);
+	} else {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		if (spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&id),
+					SPA_POD_Int(&seq)) < 0)
+			return -EINVAL;
+	}
 
 	return pw_proxy_notify(proxy, struct pw_core_proxy_events, ping, 0, id, seq);
 }
@@ -403,9 +442,12 @@ static void core_event_marshal_done(void *object, uint32_t id, int seq)
 
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_DONE, NULL);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(seq));
+	if (pw_protocol_native_get_resource_features(resource) & PW_PROTOCOL_NATIVE_FEATURE_COMPACT)
+		write_compact(b, id, seq);
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(seq));
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -419,9 +461,12 @@ static void core_event_marshal_ping(void *object, uint32_t id, int seq)
 	pw_client_set_busy(pw_resource_get_client(resource), false);
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_PING, &msg);
 
-	spa_pod_builder_add_struct(b,
-			SPA_POD_Int(id),
-			SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
+	if (pw_protocol_native_get_resource_features(resource) & PW_PROTOCOL_NATIVE_FEATURE_COMPACT)
+		write_compact(b, id, SPA_RESULT_RETURN_ASYNC(msg->seq));
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(SPA_RESULT_RETURN_ASYNC(msg->seq)));
 
 	pw_protocol_native_end_resource(resource, b);
 }
@@ -488,13 +533,18 @@ static int core_method_demarshal_hello(void *object, const struct pw_protocol_na
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_parser prs;
-	uint32_t version;
+	uint32_t version, features = 0;
 
 	spa_pod_parser_init(&prs, msg->data, msg->size);
 	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&version)) < 0)
+				SPA_POD_Int(&version),
+				SPA_POD_OPT_Int(&features)) < 0)
 		return -EINVAL;
 
+	if (features & PW_PROTOCOL_NATIVE_FEATURE_COMPACT)
+		pw_protocol_native_set_resource_features(resource,
+				PW_PROTOCOL_NATIVE_FEATURE_COMPACT);
+
 	return pw_resource_notify(resource, struct pw_core_proxy_methods, hello, 0, version);
 }
 
@@ -502,13 +552,16 @@ static int core_method_demarshal_sync(void *object, const struct pw_protocol_nat
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_parser prs;
-	uint32_t id, seq;
+	uint32_t id;
+	int seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
-		return -EINVAL;
+	if (!read_compact(msg, &id, &seq)) {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		if (spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&id),
+					SPA_POD_Int(&seq)) < 0)
+			return -EINVAL;
+	}
 
 	return pw_resource_notify(resource, struct pw_core_proxy_methods, sync, 0, id, seq);
 }
@@ -517,13 +570,16 @@ static int core_method_demarshal_pong(void *object, const struct pw_protocol_nat
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_parser prs;
-	uint32_t id, seq;
+	uint32_t id;
+	int seq;
 
-	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
-				SPA_POD_Int(&id),
-				SPA_POD_Int(&seq)) < 0)
-		return -EINVAL;
+	if (!read_compact(msg, &id, &seq)) {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		if (spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&id),
+					SPA_POD_Int(&seq)) < 0)
+			return -EINVAL;
+	}
 
 	return pw_resource_notify(resource, struct pw_core_proxy_methods, pong, 0, id, seq);
 }
@@ -669,6 +725,37 @@ static void registry_marshal_global_remove(void *object, uint32_t id)
 	pw_protocol_native_end_resource(resource, b);
 }
 
+static void registry_marshal_enum_done(void *object, int seq, uint32_t next_id)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_PROXY_EVENT_ENUM_DONE, NULL);
+
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(seq),
+			SPA_POD_Int(next_id));
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
+static void registry_marshal_resume_done(void *object, int seq, uint32_t cookie,
+		uint64_t serial, bool full)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_PROXY_EVENT_RESUME_DONE, NULL);
+
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(seq),
+			SPA_POD_Int(cookie),
+			SPA_POD_Long(serial),
+			SPA_POD_Bool(full));
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
 static int registry_demarshal_bind(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
@@ -700,6 +787,60 @@ static int registry_demarshal_destroy(void *object, const struct pw_protocol_nat
 	return pw_resource_notify(resource, struct pw_registry_proxy_methods, destroy, 0, id);
 }
 
+static int registry_demarshal_enum_globals(void *object, const struct pw_protocol_native_message *msg)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f[2];
+	uint32_t type, start_id, max_globals;
+	int seq;
+	struct spa_dict props;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_push_struct(&prs, &f[0]) < 0 ||
+	    spa_pod_parser_get(&prs,
+			SPA_POD_Int(&seq),
+			SPA_POD_Id(&type), NULL) < 0)
+		return -EINVAL;
+
+	if (spa_pod_parser_push_struct(&prs, &f[1]) < 0 ||
+	    spa_pod_parser_get(&prs,
+			SPA_POD_Int(&props.n_items), NULL) < 0)
+		return -EINVAL;
+
+	props.items = alloca(props.n_items * sizeof(struct spa_dict_item));
+	if (parse_dict(&prs, &props) < 0)
+		return -EINVAL;
+	spa_pod_parser_pop(&prs, &f[1]);
+
+	if (spa_pod_parser_get(&prs,
+			SPA_POD_Int(&start_id),
+			SPA_POD_Int(&max_globals), NULL) < 0)
+		return -EINVAL;
+
+	return pw_resource_notify(resource, struct pw_registry_proxy_methods, enum_globals, 1,
+			seq, type, props.n_items > 0 ? &props : NULL, start_id, max_globals);
+}
+
+static int registry_demarshal_resume(void *object, const struct pw_protocol_native_message *msg)
+{
+	struct pw_resource *resource = object;
+	struct spa_pod_parser prs;
+	uint32_t cookie;
+	uint64_t serial;
+	int seq;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&seq),
+				SPA_POD_Int(&cookie),
+				SPA_POD_Long(&serial)) < 0)
+		return -EINVAL;
+
+	return pw_resource_notify(resource, struct pw_registry_proxy_methods, resume, 2,
+			seq, cookie, serial);
+}
+
 static int module_method_marshal_add_listener(void *object,
 			struct spa_hook *listener,
 			const struct pw_module_proxy_events *events,
@@ -1042,6 +1183,10 @@ static void node_marshal_info(void *object, const struct pw_node_info *info)
 			    NULL);
 	push_dict(b, info->props);
 	push_params(b, info->n_params, info->params);
+	spa_pod_builder_add(b,
+			    SPA_POD_Int(info->n_xruns),
+			    SPA_POD_Long(info->xrun_delay),
+			    NULL);
 	spa_pod_builder_pop(b, &f);
 
 	pw_protocol_native_end_resource(resource, b);
@@ -1093,6 +1238,16 @@ static int node_demarshal_info(void *object, const struct pw_protocol_native_mes
 				       SPA_POD_Int(&info.params[i].flags), NULL) < 0)
 			return -EINVAL;
 	}
+	spa_pod_parser_pop(&prs, &f[1]);
+
+	/* older servers don't send the xrun counters */
+	if (spa_pod_parser_get(&prs,
+			SPA_POD_Int(&info.n_xruns),
+			SPA_POD_Long(&info.xrun_delay), NULL) < 0) {
+		info.n_xruns = 0;
+		info.xrun_delay = 0;
+		info.change_mask &= ~PW_NODE_CHANGE_MASK_XRUNS;
+	}
 
 	return pw_proxy_notify(proxy, struct pw_node_proxy_events, info, 0, &info);
 }
@@ -1827,6 +1982,43 @@ static int registry_demarshal_global_remove(void *object, const struct pw_protoc
 	return pw_proxy_notify(proxy, struct pw_registry_proxy_events, global_remove, 0, id);
 }
 
+static int registry_demarshal_enum_done(void *object, const struct pw_protocol_native_message *msg)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	uint32_t next_id;
+	int seq;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&seq),
+				SPA_POD_Int(&next_id)) < 0)
+		return -EINVAL;
+
+	return pw_proxy_notify(proxy, struct pw_registry_proxy_events, enum_done, 1, seq, next_id);
+}
+
+static int registry_demarshal_resume_done(void *object, const struct pw_protocol_native_message *msg)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_parser prs;
+	uint32_t cookie;
+	uint64_t serial;
+	bool full;
+	int seq;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&seq),
+				SPA_POD_Int(&cookie),
+				SPA_POD_Long(&serial),
+				SPA_POD_Bool(&full)) < 0)
+		return -EINVAL;
+
+	return pw_proxy_notify(proxy, struct pw_registry_proxy_events, resume_done, 2,
+			seq, cookie, serial, full);
+}
+
 static void * registry_marshal_bind(void *object, uint32_t id,
 				  uint32_t type, uint32_t version, size_t user_data_size)
 {
@@ -1865,6 +2057,45 @@ static int registry_marshal_destroy(void *object, uint32_t id)
 	return pw_protocol_native_end_proxy(proxy, b);
 }
 
+static int registry_marshal_enum_globals(void *object, int seq, uint32_t type,
+		const struct spa_dict *props, uint32_t start_id, uint32_t max_globals)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_REGISTRY_PROXY_METHOD_ENUM_GLOBALS, NULL);
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_add(b,
+			    SPA_POD_Int(seq),
+			    SPA_POD_Id(type),
+			    NULL);
+	push_dict(b, props);
+	spa_pod_builder_add(b,
+			    SPA_POD_Int(start_id),
+			    SPA_POD_Int(max_globals),
+			    NULL);
+	spa_pod_builder_pop(b, &f);
+
+	return pw_protocol_native_end_proxy(proxy, b);
+}
+
+static int registry_marshal_resume(void *object, int seq, uint32_t cookie, uint64_t serial)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_REGISTRY_PROXY_METHOD_RESUME, NULL);
+
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(seq),
+			SPA_POD_Int(cookie),
+			SPA_POD_Long(serial));
+
+	return pw_protocol_native_end_proxy(proxy, b);
+}
+
 static const struct pw_core_proxy_methods pw_protocol_native_core_method_marshal = {
 	PW_VERSION_CORE_PROXY_METHODS,
 	.add_listener = &core_method_marshal_add_listener,
@@ -1928,6 +2159,8 @@ static const struct pw_registry_proxy_methods pw_protocol_native_registry_method
 	.add_listener = &registry_method_marshal_add_listener,
 	.bind = &registry_marshal_bind,
 	.destroy = &registry_marshal_destroy,
+	.enum_globals = &registry_marshal_enum_globals,
+	.resume = &registry_marshal_resume,
 };
 
 static const struct pw_protocol_native_demarshal
@@ -1936,19 +2169,25 @@ pw_protocol_native_registry_method_demarshal[PW_REGISTRY_PROXY_METHOD_NUM] =
 	[PW_REGISTRY_PROXY_METHOD_ADD_LISTENER] = { NULL, 0, },
 	[PW_REGISTRY_PROXY_METHOD_BIND] = { &registry_demarshal_bind, 0, },
 	[PW_REGISTRY_PROXY_METHOD_DESTROY] = { &registry_demarshal_destroy, 0, },
+	[PW_REGISTRY_PROXY_METHOD_ENUM_GLOBALS] = { &registry_demarshal_enum_globals, 0, },
+	[PW_REGISTRY_PROXY_METHOD_RESUME] = { &registry_demarshal_resume, 0, },
 };
 
 static const struct pw_registry_proxy_events pw_protocol_native_registry_event_marshal = {
 	PW_VERSION_REGISTRY_PROXY_EVENTS,
 	.global = &registry_marshal_global,
 	.global_remove = &registry_marshal_global_remove,
+	.enum_done = &registry_marshal_enum_done,
+	.resume_done = &registry_marshal_resume_done,
 };
 
 static const struct pw_protocol_native_demarshal
 pw_protocol_native_registry_event_demarshal[PW_REGISTRY_PROXY_EVENT_NUM] =
 {
 	[PW_REGISTRY_PROXY_EVENT_GLOBAL] = { &registry_demarshal_global, 0, },
-	[PW_REGISTRY_PROXY_EVENT_GLOBAL_REMOVE] = { &registry_demarshal_global_remove, 0, }
+	[PW_REGISTRY_PROXY_EVENT_GLOBAL_REMOVE] = { &registry_demarshal_global_remove, 0, },
+	[PW_REGISTRY_PROXY_EVENT_ENUM_DONE] = { &registry_demarshal_enum_done, 0, },
+	[PW_REGISTRY_PROXY_EVENT_RESUME_DONE] = { &registry_demarshal_resume_done, 0, }
 };
 
 const struct pw_protocol_marshal pw_protocol_native_registry_marshal = {
@@ -1963,6 +2202,30 @@ const struct pw_protocol_marshal pw_protocol_native_registry_marshal = {
 	.client_demarshal = pw_protocol_native_registry_event_demarshal,
 };
 
+static const struct pw_protocol_marshal pw_protocol_native_registry_enum_marshal = {
+	PW_TYPE_INTERFACE_Registry,
+	PW_VERSION_REGISTRY_PROXY_ENUM,
+	0,
+	PW_REGISTRY_PROXY_METHOD_NUM,
+	PW_REGISTRY_PROXY_EVENT_NUM,
+	.client_marshal = &pw_protocol_native_registry_method_marshal,
+	.server_demarshal = pw_protocol_native_registry_method_demarshal,
+	.server_marshal = &pw_protocol_native_registry_event_marshal,
+	.client_demarshal = pw_protocol_native_registry_event_demarshal,
+};
+
+static const struct pw_protocol_marshal pw_protocol_native_registry_resume_marshal = {
+	PW_TYPE_INTERFACE_Registry,
+	PW_VERSION_REGISTRY_PROXY_RESUME,
+	0,
+	PW_REGISTRY_PROXY_METHOD_NUM,
+	PW_REGISTRY_PROXY_EVENT_NUM,
+	.client_marshal = &pw_protocol_native_registry_method_marshal,
+	.server_demarshal = pw_protocol_native_registry_method_demarshal,
+	.server_marshal = &pw_protocol_native_registry_event_marshal,
+	.client_demarshal = pw_protocol_native_registry_event_demarshal,
+};
+
 static const struct pw_module_proxy_events pw_protocol_native_module_event_marshal = {
 	PW_VERSION_MODULE_PROXY_EVENTS,
 	.info = &module_marshal_info,
@@ -2237,6 +2500,8 @@ void pw_protocol_native_init(struct pw_protocol *protocol)
 {
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_core_marshal);
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_registry_marshal);
+	pw_protocol_add_marshal(protocol, &pw_protocol_native_registry_enum_marshal);
+	pw_protocol_add_marshal(protocol, &pw_protocol_native_registry_resume_marshal);
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_module_marshal);
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_device_marshal);
 	pw_protocol_add_marshal(protocol, &pw_protocol_native_node_marshal);
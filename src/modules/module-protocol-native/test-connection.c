@@ -22,6 +22,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <unistd.h>
 #include <sys/socket.h>
 
 #include <spa/pod/builder.h>
@@ -120,6 +121,239 @@ static void test_read_write(struct pw_protocol_native_connection *in,
 	spa_assert(read_message(in) == -1);
 }
 
+static void test_flush_backlog(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_builder *b;
+	struct spa_pod_parser prs;
+	uint32_t i, n_read = 0;
+	int res, size = 4096;
+
+	setsockopt(out->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(in->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	/* more data than the socket takes, the flush is partial */
+	for (i = 0; i < 4096; i++) {
+		b = pw_protocol_native_connection_begin(out, 2, 7, NULL);
+		spa_assert(b != NULL);
+		spa_pod_builder_add_struct(b, SPA_POD_Int(i));
+		pw_protocol_native_connection_end(out, b);
+	}
+
+	while (n_read < 4096) {
+		res = pw_protocol_native_connection_flush(out);
+		spa_assert(res == 0 || res == -EAGAIN);
+
+		while (pw_protocol_native_connection_get_next(in, &msg) == 1) {
+			int32_t v;
+
+			spa_assert(msg->id == 2);
+			spa_assert(msg->opcode == 7);
+			spa_pod_parser_init(&prs, msg->data, msg->size);
+			if (spa_pod_parser_get_struct(&prs, SPA_POD_Int(&v)) < 0)
+				spa_assert_not_reached();
+			spa_assert(v == (int32_t)n_read);
+			n_read++;
+		}
+	}
+	spa_assert(pw_protocol_native_connection_flush(out) == 0);
+}
+
+static void test_large_message(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_builder *b;
+	struct spa_pod_parser prs;
+	static uint8_t data[100000];
+	uint32_t i, n_read = 0;
+	const void *v;
+	uint32_t len;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	/* a message larger than a segment in between small ones */
+	for (i = 0; i < 3; i++) {
+		b = pw_protocol_native_connection_begin(out, 3, i, NULL);
+		spa_assert(b != NULL);
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Bytes(data, i == 1 ? sizeof(data) : 16));
+		pw_protocol_native_connection_end(out, b);
+	}
+
+	while (n_read < 3) {
+		pw_protocol_native_connection_flush(out);
+
+		while (pw_protocol_native_connection_get_next(in, &msg) == 1) {
+			spa_assert(msg->id == 3);
+			spa_assert(msg->opcode == n_read);
+			spa_pod_parser_init(&prs, msg->data, msg->size);
+			if (spa_pod_parser_get_struct(&prs, SPA_POD_Bytes(&v, &len)) < 0)
+				spa_assert_not_reached();
+			spa_assert(len == (n_read == 1 ? sizeof(data) : 16));
+			spa_assert(memcmp(v, data, len) == 0);
+			n_read++;
+		}
+	}
+}
+
+static void test_read_partial(struct pw_protocol_native_connection *in, int fd)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_parser prs;
+	uint8_t data[64 * 1024];
+	uint32_t i, n_read = 0, size = 0, pos = 0;
+
+	/* messages written in chunks that end halfway a message */
+	for (i = 0; i < 1024; i++) {
+		uint32_t *p = (uint32_t *) &data[size];
+		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(&p[4], sizeof(data) - size - 16);
+
+		spa_pod_builder_add_struct(&b, SPA_POD_Int(i));
+		p[0] = 4;
+		p[1] = (1 << 24) | b.state.offset;
+		p[2] = i;
+		p[3] = 0;
+		size += 16 + b.state.offset;
+	}
+	spa_assert(size <= sizeof(data));
+
+	while (pos < size) {
+		uint32_t len = SPA_MIN(size - pos, 333u);
+
+		spa_assert(write(fd, &data[pos], len) == (ssize_t) len);
+		pos += len;
+
+		while (pw_protocol_native_connection_get_next(in, &msg) == 1) {
+			int32_t v;
+
+			spa_assert(msg->id == 4);
+			spa_assert(msg->opcode == 1);
+			spa_pod_parser_init(&prs, msg->data, msg->size);
+			if (spa_pod_parser_get_struct(&prs, SPA_POD_Int(&v)) < 0)
+				spa_assert_not_reached();
+			spa_assert(v == (int32_t)n_read);
+			n_read++;
+		}
+	}
+	spa_assert(n_read == 1024);
+}
+
+static void test_stats(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct pw_protocol_native_connection_stats si0, so0, si, so;
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_builder *b;
+	uint32_t i;
+	int res;
+
+	pw_protocol_native_connection_get_stats(in, &si0);
+	pw_protocol_native_connection_get_stats(out, &so0);
+
+	for (i = 0; i < 4; i++) {
+		b = pw_protocol_native_connection_begin(out, 5, 1, NULL);
+		spa_pod_builder_add_struct(b, SPA_POD_Int(i));
+		pw_protocol_native_connection_end(out, b);
+	}
+	pw_protocol_native_connection_get_stats(out, &so);
+	spa_assert(so.messages_out == so0.messages_out + 4);
+	spa_assert(so.queued > 0);
+
+	spa_assert(pw_protocol_native_connection_flush(out) == 0);
+	while (pw_protocol_native_connection_get_next(in, &msg) == 1);
+
+	pw_protocol_native_connection_get_stats(out, &so);
+	pw_protocol_native_connection_get_stats(in, &si);
+	spa_assert(so.queued == 0);
+	spa_assert(si.messages_in == si0.messages_in + 4);
+	spa_assert(si.bytes_in - si0.bytes_in == so.bytes_out - so0.bytes_out);
+
+	/* over the limit, messages are refused */
+	pw_protocol_native_connection_set_max_queued(out, 80);
+	for (i = 0; i < 4; i++) {
+		b = pw_protocol_native_connection_begin(out, 5, 1, NULL);
+		spa_pod_builder_add_struct(b, SPA_POD_Int(i));
+		res = pw_protocol_native_connection_end(out, b);
+		spa_assert(i < 2 ? res >= 0 : res == -ENOBUFS);
+	}
+	pw_protocol_native_connection_get_stats(out, &so);
+	spa_assert(so.queued <= 80);
+	pw_protocol_native_connection_set_max_queued(out, 0);
+	pw_protocol_native_connection_flush(out);
+	while (pw_protocol_native_connection_get_next(in, &msg) == 1);
+}
+
+static void send_ping(struct pw_protocol_native_connection *conn, bool compact,
+		uint32_t id, int seq)
+{
+	struct spa_pod_builder *b;
+	struct pw_protocol_native_compact c = { id, seq };
+
+	b = pw_protocol_native_connection_begin(conn, 0, 1, NULL);
+	if (compact)
+		spa_pod_builder_raw(b, &c, sizeof(c));
+	else
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(id),
+				SPA_POD_Int(seq));
+	spa_assert(pw_protocol_native_connection_end(conn, b) >= 0);
+	spa_assert(pw_protocol_native_connection_flush(conn) == 0);
+}
+
+static void recv_ping(struct pw_protocol_native_connection *conn, bool compact,
+		uint32_t id, int seq)
+{
+	const struct pw_protocol_native_message *msg;
+	const struct pw_protocol_native_compact *c;
+	struct spa_pod_parser prs;
+	uint32_t rid;
+	int rseq;
+
+	spa_assert(pw_protocol_native_connection_get_next(conn, &msg) == 1);
+	if (compact) {
+		spa_assert(msg->size == sizeof(*c));
+		c = msg->data;
+		rid = c->id;
+		rseq = c->seq;
+	} else {
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		spa_assert(spa_pod_parser_get_struct(&prs,
+					SPA_POD_Int(&rid),
+					SPA_POD_Int(&rseq)) == 2);
+	}
+	spa_assert(rid == id);
+	spa_assert(rseq == seq);
+}
+
+static void test_roundtrip(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	struct pw_protocol_native_connection_stats s0, s;
+	uint64_t pod_bytes, compact_bytes;
+	int i;
+
+	pw_protocol_native_connection_get_stats(out, &s0);
+	for (i = 0; i < 4; i++) {
+		send_ping(out, false, 0, i);
+		recv_ping(in, false, 0, i);
+	}
+	pw_protocol_native_connection_get_stats(out, &s);
+	pod_bytes = s.bytes_out - s0.bytes_out;
+
+	s0 = s;
+	for (i = 0; i < 4; i++) {
+		send_ping(out, true, 0, i);
+		recv_ping(in, true, 0, i);
+	}
+	pw_protocol_native_connection_get_stats(out, &s);
+	compact_bytes = s.bytes_out - s0.bytes_out;
+
+	spa_assert(compact_bytes < pod_bytes);
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_main_loop *loop;
@@ -145,6 +379,11 @@ int main(int argc, char *argv[])
 	test_create(in);
 	test_create(out);
 	test_read_write(in, out);
+	test_flush_backlog(in, out);
+	test_large_message(in, out);
+	test_read_partial(in, fds[1]);
+	test_stats(in, out);
+	test_roundtrip(in, out);
 
 	return 0;
 }
@@ -0,0 +1,345 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PULSE_SERVER_DEFS_H
+#define PULSE_SERVER_DEFS_H
+
+#define PROTOCOL_FLAG_MASK	0xffff0000u
+#define PROTOCOL_VERSION_MASK	0x0000ffffu
+#define PROTOCOL_VERSION	35
+#define PROTOCOL_FLAG_SHM	0x80000000u
+#define PROTOCOL_FLAG_MEMFD	0x40000000u
+
+#define NATIVE_COOKIE_LENGTH	256
+#define MAX_TAG_SIZE		(64*1024)
+#define MAX_FRAME_SIZE		(16*1024*1024)
+
+#define MAXLENGTH		(4*1024*1024)	/* like PulseAudio, 4MB */
+#define DEFAULT_TLENGTH_MSEC	2000
+#define DEFAULT_PROCESS_MSEC	20
+#define DEFAULT_FRAGSIZE_MSEC	DEFAULT_TLENGTH_MSEC
+
+#define DEFAULT_SINK		"@DEFAULT_SINK@"
+#define DEFAULT_SOURCE		"@DEFAULT_SOURCE@"
+#define DEFAULT_MONITOR		"@DEFAULT_MONITOR@"
+
+/* the frame header, all fields are in network byte order */
+enum {
+	DESC_LENGTH,
+	DESC_CHANNEL,
+	DESC_OFFSET_HI,
+	DESC_OFFSET_LO,
+	DESC_FLAGS,
+	DESC_MAX,
+};
+#define DESCRIPTOR_SIZE		(DESC_MAX * sizeof(uint32_t))
+
+#define FLAG_SHMDATA		0x80000000u
+#define FLAG_SHMDATA_MEMFD_BLOCK 0x20000000u
+#define FLAG_SHMRELEASE		0x40000000u
+#define FLAG_SHMREVOKE		0xC0000000u
+#define FLAG_SHMMASK		0xFF000000u
+#define FLAG_SEEKMASK		0x000000FFu
+#define FLAG_SHMWRITABLE	0x00800000u
+
+/* the payload of a frame with FLAG_SHMDATA */
+enum {
+	SHM_BLOCK_ID,
+	SHM_ID,
+	SHM_OFFSET,
+	SHM_LENGTH,
+	SHM_MAX,
+};
+
+enum {
+	SEEK_RELATIVE = 0,
+	SEEK_ABSOLUTE = 1,
+	SEEK_RELATIVE_ON_READ = 2,
+	SEEK_RELATIVE_END = 3,
+};
+
+enum {
+	TAG_INVALID = 0,
+	TAG_STRING = 't',
+	TAG_STRING_NULL = 'N',
+	TAG_U32 = 'L',
+	TAG_U8 = 'B',
+	TAG_U64 = 'R',
+	TAG_S64 = 'r',
+	TAG_SAMPLE_SPEC = 'a',
+	TAG_ARBITRARY = 'x',
+	TAG_BOOLEAN_TRUE = '1',
+	TAG_BOOLEAN_FALSE = '0',
+	TAG_BOOLEAN = TAG_BOOLEAN_TRUE,
+	TAG_TIMEVAL = 'T',
+	TAG_USEC = 'U',
+	TAG_CHANNEL_MAP = 'm',
+	TAG_CVOLUME = 'v',
+	TAG_PROPLIST = 'P',
+	TAG_VOLUME = 'V',
+	TAG_FORMAT_INFO = 'f',
+};
+
+enum {
+	ERR_OK = 0,
+	ERR_ACCESS,
+	ERR_COMMAND,
+	ERR_INVALID,
+	ERR_EXIST,
+	ERR_NOENTITY,
+	ERR_CONNECTIONREFUSED,
+	ERR_PROTOCOL,
+	ERR_TIMEOUT,
+	ERR_AUTHKEY,
+	ERR_INTERNAL,
+	ERR_CONNECTIONTERMINATED,
+	ERR_KILLED,
+	ERR_INVALIDSERVER,
+	ERR_MODINITFAILED,
+	ERR_BADSTATE,
+	ERR_NODATA,
+	ERR_VERSION,
+	ERR_TOOLARGE,
+	ERR_NOTSUPPORTED,
+	ERR_UNKNOWN,
+	ERR_NOEXTENSION,
+	ERR_OBSOLETE,
+	ERR_NOTIMPLEMENTED,
+	ERR_FORKED,
+	ERR_IO,
+	ERR_BUSY,
+	ERR_MAX,
+};
+
+static inline uint32_t res_to_err(int res)
+{
+	switch (res) {
+	case 0: return ERR_OK;
+	case -EACCES: case -EPERM: return ERR_ACCESS;
+	case -ENOTTY: return ERR_COMMAND;
+	case -EINVAL: return ERR_INVALID;
+	case -EEXIST: return ERR_EXIST;
+	case -ENOENT: case -ESRCH: case -ENXIO: case -ENODEV: return ERR_NOENTITY;
+	case -ECONNREFUSED: case -ENONET: case -EHOSTDOWN: case -ENETDOWN: return ERR_CONNECTIONREFUSED;
+	case -EPROTO: case -EBADMSG: return ERR_PROTOCOL;
+	case -ETIMEDOUT: case -ETIME: return ERR_TIMEOUT;
+	case -ENOKEY: return ERR_AUTHKEY;
+	case -ECONNRESET: case -EPIPE: return ERR_CONNECTIONTERMINATED;
+	case -EBADFD: return ERR_BADSTATE;
+	case -ENODATA: return ERR_NODATA;
+	case -EOVERFLOW: case -E2BIG: case -EFBIG: case -ERANGE: case -ENAMETOOLONG: return ERR_TOOLARGE;
+	case -ENOTSUP: case -EPROTONOSUPPORT: case -ESOCKTNOSUPPORT: return ERR_NOTSUPPORTED;
+	case -ENOSYS: return ERR_NOTIMPLEMENTED;
+	case -EIO: return ERR_IO;
+	case -EBUSY: return ERR_BUSY;
+	}
+	return ERR_UNKNOWN;
+}
+
+enum {
+	/* generic commands */
+	COMMAND_ERROR,
+	COMMAND_TIMEOUT, /* pseudo command */
+	COMMAND_REPLY,
+
+	/* CLIENT->SERVER */
+	COMMAND_CREATE_PLAYBACK_STREAM,        /* Payload changed in v9, v12 (0.9.0, 0.9.8) */
+	COMMAND_DELETE_PLAYBACK_STREAM,
+	COMMAND_CREATE_RECORD_STREAM,          /* Payload changed in v9, v12 (0.9.0, 0.9.8) */
+	COMMAND_DELETE_RECORD_STREAM,
+	COMMAND_EXIT,
+	COMMAND_AUTH,
+	COMMAND_SET_CLIENT_NAME,
+	COMMAND_LOOKUP_SINK,
+	COMMAND_LOOKUP_SOURCE,
+	COMMAND_DRAIN_PLAYBACK_STREAM,
+	COMMAND_STAT,
+	COMMAND_GET_PLAYBACK_LATENCY,
+	COMMAND_CREATE_UPLOAD_STREAM,
+	COMMAND_DELETE_UPLOAD_STREAM,
+	COMMAND_FINISH_UPLOAD_STREAM,
+	COMMAND_PLAY_SAMPLE,
+	COMMAND_REMOVE_SAMPLE,
+
+	COMMAND_GET_SERVER_INFO,
+	COMMAND_GET_SINK_INFO,
+	COMMAND_GET_SINK_INFO_LIST,
+	COMMAND_GET_SOURCE_INFO,
+	COMMAND_GET_SOURCE_INFO_LIST,
+	COMMAND_GET_MODULE_INFO,
+	COMMAND_GET_MODULE_INFO_LIST,
+	COMMAND_GET_CLIENT_INFO,
+	COMMAND_GET_CLIENT_INFO_LIST,
+	COMMAND_GET_SINK_INPUT_INFO,          /* Payload changed in v11 (0.9.7) */
+	COMMAND_GET_SINK_INPUT_INFO_LIST,     /* Payload changed in v11 (0.9.7) */
+	COMMAND_GET_SOURCE_OUTPUT_INFO,
+	COMMAND_GET_SOURCE_OUTPUT_INFO_LIST,
+	COMMAND_GET_SAMPLE_INFO,
+	COMMAND_GET_SAMPLE_INFO_LIST,
+	COMMAND_SUBSCRIBE,
+
+	COMMAND_SET_SINK_VOLUME,
+	COMMAND_SET_SINK_INPUT_VOLUME,
+	COMMAND_SET_SOURCE_VOLUME,
+
+	COMMAND_SET_SINK_MUTE,
+	COMMAND_SET_SOURCE_MUTE,
+
+	COMMAND_CORK_PLAYBACK_STREAM,
+	COMMAND_FLUSH_PLAYBACK_STREAM,
+	COMMAND_TRIGGER_PLAYBACK_STREAM,
+
+	COMMAND_SET_DEFAULT_SINK,
+	COMMAND_SET_DEFAULT_SOURCE,
+
+	COMMAND_SET_PLAYBACK_STREAM_NAME,
+	COMMAND_SET_RECORD_STREAM_NAME,
+
+	COMMAND_KILL_CLIENT,
+	COMMAND_KILL_SINK_INPUT,
+	COMMAND_KILL_SOURCE_OUTPUT,
+
+	COMMAND_LOAD_MODULE,
+	COMMAND_UNLOAD_MODULE,
+
+	/* Obsolete */
+	COMMAND_ADD_AUTOLOAD___OBSOLETE,
+	COMMAND_REMOVE_AUTOLOAD___OBSOLETE,
+	COMMAND_GET_AUTOLOAD_INFO___OBSOLETE,
+	COMMAND_GET_AUTOLOAD_INFO_LIST___OBSOLETE,
+
+	COMMAND_GET_RECORD_LATENCY,
+	COMMAND_CORK_RECORD_STREAM,
+	COMMAND_FLUSH_RECORD_STREAM,
+	COMMAND_PREBUF_PLAYBACK_STREAM,
+
+	/* SERVER->CLIENT */
+	COMMAND_REQUEST,
+	COMMAND_OVERFLOW,
+	COMMAND_UNDERFLOW,
+	COMMAND_PLAYBACK_STREAM_KILLED,
+	COMMAND_RECORD_STREAM_KILLED,
+	COMMAND_SUBSCRIBE_EVENT,
+
+	/* A few more client->server commands */
+
+	/* Supported since protocol v10 (0.9.5) */
+	COMMAND_MOVE_SINK_INPUT,
+	COMMAND_MOVE_SOURCE_OUTPUT,
+
+	/* Supported since protocol v11 (0.9.7) */
+	COMMAND_SET_SINK_INPUT_MUTE,
+
+	COMMAND_SUSPEND_SINK,
+	COMMAND_SUSPEND_SOURCE,
+
+	/* Supported since protocol v12 (0.9.8) */
+	COMMAND_SET_PLAYBACK_STREAM_BUFFER_ATTR,
+	COMMAND_SET_RECORD_STREAM_BUFFER_ATTR,
+
+	COMMAND_UPDATE_PLAYBACK_STREAM_SAMPLE_RATE,
+	COMMAND_UPDATE_RECORD_STREAM_SAMPLE_RATE,
+
+	/* SERVER->CLIENT */
+	COMMAND_PLAYBACK_STREAM_SUSPENDED,
+	COMMAND_RECORD_STREAM_SUSPENDED,
+	COMMAND_PLAYBACK_STREAM_MOVED,
+	COMMAND_RECORD_STREAM_MOVED,
+
+	/* Supported since protocol v13 (0.9.11) */
+	COMMAND_UPDATE_RECORD_STREAM_PROPLIST,
+	COMMAND_UPDATE_PLAYBACK_STREAM_PROPLIST,
+	COMMAND_UPDATE_CLIENT_PROPLIST,
+	COMMAND_REMOVE_RECORD_STREAM_PROPLIST,
+	COMMAND_REMOVE_PLAYBACK_STREAM_PROPLIST,
+	COMMAND_REMOVE_CLIENT_PROPLIST,
+
+	/* SERVER->CLIENT */
+	COMMAND_STARTED,
+
+	/* Supported since protocol v14 (0.9.12) */
+	COMMAND_EXTENSION,
+	/* Supported since protocol v15 (0.9.15) */
+	COMMAND_GET_CARD_INFO,
+	COMMAND_GET_CARD_INFO_LIST,
+	COMMAND_SET_CARD_PROFILE,
+
+	COMMAND_CLIENT_EVENT,
+	COMMAND_PLAYBACK_STREAM_EVENT,
+	COMMAND_RECORD_STREAM_EVENT,
+
+	/* SERVER->CLIENT */
+	COMMAND_PLAYBACK_BUFFER_ATTR_CHANGED,
+	COMMAND_RECORD_BUFFER_ATTR_CHANGED,
+
+	/* Supported since protocol v16 (0.9.16) */
+	COMMAND_SET_SINK_PORT,
+	COMMAND_SET_SOURCE_PORT,
+
+	/* Supported since protocol v22 (1.0) */
+	COMMAND_SET_SOURCE_OUTPUT_VOLUME,
+	COMMAND_SET_SOURCE_OUTPUT_MUTE,
+
+	/* Supported since protocol v27 (3.0) */
+	COMMAND_SET_PORT_LATENCY_OFFSET,
+
+	/* Supported since protocol v30 (6.0) */
+	/* BOTH DIRECTIONS */
+	COMMAND_ENABLE_SRBCHANNEL,
+	COMMAND_DISABLE_SRBCHANNEL,
+
+	/* Supported since protocol v31 (9.0)
+	 * BOTH DIRECTIONS */
+	COMMAND_REGISTER_MEMFD_SHMID,
+
+	/* Supported since protocol v35 (15.0) */
+	COMMAND_SEND_OBJECT_MESSAGE,
+
+	COMMAND_MAX
+};
+
+#define SINK_HW_VOLUME_CTRL	0x0001u
+#define SINK_LATENCY		0x0002u
+#define SINK_HARDWARE		0x0004u
+#define SINK_NETWORK		0x0008u
+#define SINK_HW_MUTE_CTRL	0x0010u
+#define SINK_DECIBEL_VOLUME	0x0020u
+#define SINK_FLAT_VOLUME	0x0040u
+#define SINK_DYNAMIC_LATENCY	0x0080u
+
+#define SOURCE_HW_VOLUME_CTRL	0x0001u
+#define SOURCE_LATENCY		0x0002u
+#define SOURCE_HARDWARE		0x0004u
+#define SOURCE_NETWORK		0x0008u
+#define SOURCE_HW_MUTE_CTRL	0x0010u
+#define SOURCE_DECIBEL_VOLUME	0x0020u
+#define SOURCE_DYNAMIC_LATENCY	0x0040u
+
+#define STATE_RUNNING		0
+#define STATE_IDLE		1
+#define STATE_SUSPENDED		2
+
+#define VOLUME_NORM		0x10000u
+
+#endif /* PULSE_SERVER_DEFS_H */
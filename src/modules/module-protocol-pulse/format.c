@@ -0,0 +1,347 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#define RATE_MAX	(48000u*8u)
+#define CHANNELS_MAX	(64u)
+
+enum sample_format {
+	SAMPLE_U8,
+	SAMPLE_ALAW,
+	SAMPLE_ULAW,
+	SAMPLE_S16LE,
+	SAMPLE_S16BE,
+	SAMPLE_FLOAT32LE,
+	SAMPLE_FLOAT32BE,
+	SAMPLE_S32LE,
+	SAMPLE_S32BE,
+	SAMPLE_S24LE,
+	SAMPLE_S24BE,
+	SAMPLE_S24_32LE,
+	SAMPLE_S24_32BE,
+	SAMPLE_MAX,
+	SAMPLE_INVALID = -1
+};
+
+static const struct format {
+	uint32_t format;
+	uint32_t id;
+	uint32_t size;
+	const char *name;
+} audio_formats[] = {
+	[SAMPLE_U8] = { SAMPLE_U8, SPA_AUDIO_FORMAT_U8, 1, "u8", },
+	[SAMPLE_ALAW] = { SAMPLE_ALAW, SPA_AUDIO_FORMAT_UNKNOWN, 1, "aLaw", },
+	[SAMPLE_ULAW] = { SAMPLE_ULAW, SPA_AUDIO_FORMAT_UNKNOWN, 1, "uLaw", },
+	[SAMPLE_S16LE] = { SAMPLE_S16LE, SPA_AUDIO_FORMAT_S16_LE, 2, "s16le", },
+	[SAMPLE_S16BE] = { SAMPLE_S16BE, SPA_AUDIO_FORMAT_S16_BE, 2, "s16be", },
+	[SAMPLE_FLOAT32LE] = { SAMPLE_FLOAT32LE, SPA_AUDIO_FORMAT_F32_LE, 4, "float32le", },
+	[SAMPLE_FLOAT32BE] = { SAMPLE_FLOAT32BE, SPA_AUDIO_FORMAT_F32_BE, 4, "float32be", },
+	[SAMPLE_S32LE] = { SAMPLE_S32LE, SPA_AUDIO_FORMAT_S32_LE, 4, "s32le", },
+	[SAMPLE_S32BE] = { SAMPLE_S32BE, SPA_AUDIO_FORMAT_S32_BE, 4, "s32be", },
+	[SAMPLE_S24LE] = { SAMPLE_S24LE, SPA_AUDIO_FORMAT_S24_LE, 3, "s24le", },
+	[SAMPLE_S24BE] = { SAMPLE_S24BE, SPA_AUDIO_FORMAT_S24_BE, 3, "s24be", },
+	[SAMPLE_S24_32LE] = { SAMPLE_S24_32LE, SPA_AUDIO_FORMAT_S24_32_LE, 4, "s24-32le", },
+	[SAMPLE_S24_32BE] = { SAMPLE_S24_32BE, SPA_AUDIO_FORMAT_S24_32_BE, 4, "s24-32be", },
+};
+
+static inline uint32_t format_pa2id(enum sample_format format)
+{
+	if (format < 0 || (size_t)format >= SPA_N_ELEMENTS(audio_formats))
+		return SPA_AUDIO_FORMAT_UNKNOWN;
+	return audio_formats[format].id;
+}
+
+static inline enum sample_format format_id2pa(uint32_t id)
+{
+	size_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(audio_formats); i++) {
+		if (id == audio_formats[i].id)
+			return audio_formats[i].format;
+	}
+	return SAMPLE_INVALID;
+}
+
+struct sample_spec {
+	enum sample_format format;
+	uint32_t rate;
+	uint8_t channels;
+};
+#define SAMPLE_SPEC_INIT (struct sample_spec) {		\
+			.format = SAMPLE_FLOAT32LE,	\
+			.rate = 48000,			\
+			.channels = 2,			\
+		}
+
+static inline uint32_t sample_spec_frame_size(const struct sample_spec *ss)
+{
+	if (ss->format < 0 || (size_t)ss->format >= SPA_N_ELEMENTS(audio_formats))
+		return 0;
+	return audio_formats[ss->format].size * ss->channels;
+}
+
+static inline bool sample_spec_valid(const struct sample_spec *ss)
+{
+	return (ss->format >= 0 && ss->format < SAMPLE_MAX &&
+	    format_pa2id(ss->format) != SPA_AUDIO_FORMAT_UNKNOWN &&
+	    ss->rate > 0 && ss->rate <= RATE_MAX &&
+	    ss->channels > 0 && ss->channels <= CHANNELS_MAX);
+}
+
+enum channel_position {
+	CHANNEL_POSITION_INVALID = -1,
+	CHANNEL_POSITION_MONO = 0,
+	CHANNEL_POSITION_FRONT_LEFT,
+	CHANNEL_POSITION_FRONT_RIGHT,
+	CHANNEL_POSITION_FRONT_CENTER,
+
+	CHANNEL_POSITION_REAR_CENTER,
+	CHANNEL_POSITION_REAR_LEFT,
+	CHANNEL_POSITION_REAR_RIGHT,
+
+	CHANNEL_POSITION_LFE,
+	CHANNEL_POSITION_FRONT_LEFT_OF_CENTER,
+	CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER,
+
+	CHANNEL_POSITION_SIDE_LEFT,
+	CHANNEL_POSITION_SIDE_RIGHT,
+	CHANNEL_POSITION_AUX0,
+	CHANNEL_POSITION_AUX31 = CHANNEL_POSITION_AUX0 + 31,
+
+	CHANNEL_POSITION_TOP_CENTER,
+
+	CHANNEL_POSITION_TOP_FRONT_LEFT,
+	CHANNEL_POSITION_TOP_FRONT_RIGHT,
+	CHANNEL_POSITION_TOP_FRONT_CENTER,
+
+	CHANNEL_POSITION_TOP_REAR_LEFT,
+	CHANNEL_POSITION_TOP_REAR_RIGHT,
+	CHANNEL_POSITION_TOP_REAR_CENTER,
+
+	CHANNEL_POSITION_MAX
+};
+
+static const uint32_t audio_channels[] = {
+	[CHANNEL_POSITION_MONO] = SPA_AUDIO_CHANNEL_MONO,
+	[CHANNEL_POSITION_FRONT_LEFT] = SPA_AUDIO_CHANNEL_FL,
+	[CHANNEL_POSITION_FRONT_RIGHT] = SPA_AUDIO_CHANNEL_FR,
+	[CHANNEL_POSITION_FRONT_CENTER] = SPA_AUDIO_CHANNEL_FC,
+	[CHANNEL_POSITION_REAR_CENTER] = SPA_AUDIO_CHANNEL_RC,
+	[CHANNEL_POSITION_REAR_LEFT] = SPA_AUDIO_CHANNEL_RL,
+	[CHANNEL_POSITION_REAR_RIGHT] = SPA_AUDIO_CHANNEL_RR,
+	[CHANNEL_POSITION_LFE] = SPA_AUDIO_CHANNEL_LFE,
+	[CHANNEL_POSITION_FRONT_LEFT_OF_CENTER] = SPA_AUDIO_CHANNEL_FLC,
+	[CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER] = SPA_AUDIO_CHANNEL_FRC,
+	[CHANNEL_POSITION_SIDE_LEFT] = SPA_AUDIO_CHANNEL_SL,
+	[CHANNEL_POSITION_SIDE_RIGHT] = SPA_AUDIO_CHANNEL_SR,
+	[CHANNEL_POSITION_AUX0 ... CHANNEL_POSITION_AUX31] = SPA_AUDIO_CHANNEL_UNKNOWN,
+	[CHANNEL_POSITION_TOP_CENTER] = SPA_AUDIO_CHANNEL_TC,
+	[CHANNEL_POSITION_TOP_FRONT_LEFT] = SPA_AUDIO_CHANNEL_TFL,
+	[CHANNEL_POSITION_TOP_FRONT_RIGHT] = SPA_AUDIO_CHANNEL_TFR,
+	[CHANNEL_POSITION_TOP_FRONT_CENTER] = SPA_AUDIO_CHANNEL_TFC,
+	[CHANNEL_POSITION_TOP_REAR_LEFT] = SPA_AUDIO_CHANNEL_TRL,
+	[CHANNEL_POSITION_TOP_REAR_RIGHT] = SPA_AUDIO_CHANNEL_TRR,
+	[CHANNEL_POSITION_TOP_REAR_CENTER] = SPA_AUDIO_CHANNEL_TRC,
+};
+
+struct channel_map {
+	uint8_t channels;
+	enum channel_position map[CHANNELS_MAX];
+};
+
+static inline uint32_t channel_pa2id(enum channel_position channel)
+{
+	if (channel < 0 || (size_t)channel >= SPA_N_ELEMENTS(audio_channels))
+		return SPA_AUDIO_CHANNEL_UNKNOWN;
+	return audio_channels[channel];
+}
+
+static inline enum channel_position channel_id2pa(uint32_t id)
+{
+	size_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(audio_channels); i++) {
+		if (id == audio_channels[i])
+			return i;
+	}
+	return CHANNEL_POSITION_INVALID;
+}
+
+/* the default channel layouts PulseAudio picks when a client does not
+ * send a channel map */
+static void channel_map_init_default(struct channel_map *map, uint8_t channels)
+{
+	static const enum channel_position layouts[][8] = {
+		{ CHANNEL_POSITION_MONO, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_LFE, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_REAR_LEFT, CHANNEL_POSITION_REAR_RIGHT, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_FRONT_CENTER,
+		  CHANNEL_POSITION_REAR_LEFT, CHANNEL_POSITION_REAR_RIGHT, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_FRONT_CENTER, CHANNEL_POSITION_LFE,
+		  CHANNEL_POSITION_REAR_LEFT, CHANNEL_POSITION_REAR_RIGHT, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_FRONT_CENTER, CHANNEL_POSITION_LFE,
+		  CHANNEL_POSITION_REAR_CENTER,
+		  CHANNEL_POSITION_SIDE_LEFT, CHANNEL_POSITION_SIDE_RIGHT, },
+		{ CHANNEL_POSITION_FRONT_LEFT, CHANNEL_POSITION_FRONT_RIGHT,
+		  CHANNEL_POSITION_FRONT_CENTER, CHANNEL_POSITION_LFE,
+		  CHANNEL_POSITION_REAR_LEFT, CHANNEL_POSITION_REAR_RIGHT,
+		  CHANNEL_POSITION_SIDE_LEFT, CHANNEL_POSITION_SIDE_RIGHT, },
+	};
+	uint32_t i;
+
+	map->channels = SPA_MIN(channels, CHANNELS_MAX);
+	for (i = 0; i < map->channels; i++) {
+		if (channels <= SPA_N_ELEMENTS(layouts))
+			map->map[i] = layouts[channels-1][i];
+		else
+			map->map[i] = CHANNEL_POSITION_AUX0 + (i % 32);
+	}
+}
+
+static inline bool channel_map_valid(const struct channel_map *map)
+{
+	uint8_t i;
+	if (map->channels == 0 || map->channels > CHANNELS_MAX)
+		return false;
+	for (i = 0; i < map->channels; i++)
+		if (map->map[i] < 0 || map->map[i] >= CHANNEL_POSITION_MAX)
+			return false;
+	return true;
+}
+
+struct cvolume {
+	uint8_t channels;
+	uint32_t values[CHANNELS_MAX];
+};
+
+static int format_parse_param(const struct spa_pod *param, struct sample_spec *ss,
+		struct channel_map *map)
+{
+	struct spa_audio_info info = { 0 };
+	uint32_t i;
+
+	spa_format_parse(param, &info.media_type, &info.media_subtype);
+
+	if (info.media_type != SPA_MEDIA_TYPE_audio ||
+	    info.media_subtype != SPA_MEDIA_SUBTYPE_raw ||
+	    spa_format_audio_raw_parse(param, &info.info.raw) < 0 ||
+	    !SPA_AUDIO_FORMAT_IS_INTERLEAVED(info.info.raw.format))
+		return -ENOTSUP;
+
+	ss->format = format_id2pa(info.info.raw.format);
+	if (ss->format == SAMPLE_INVALID)
+		return -ENOTSUP;
+	ss->rate = info.info.raw.rate;
+	ss->channels = info.info.raw.channels;
+
+	map->channels = info.info.raw.channels;
+	for (i = 0; i < map->channels; i++)
+		map->map[i] = channel_id2pa(info.info.raw.position[i]);
+
+	return 0;
+}
+
+static const struct spa_pod *format_build_param(struct spa_pod_builder *b,
+		uint32_t id, const struct sample_spec *spec, const struct channel_map *map)
+{
+	struct spa_audio_info_raw info;
+	uint32_t i;
+
+	info = SPA_AUDIO_INFO_RAW_INIT(
+			.format = format_pa2id(spec->format),
+			.channels = spec->channels,
+			.rate = spec->rate);
+	if (map && map->channels == spec->channels) {
+		for (i = 0; i < map->channels; i++)
+			info.position[i] = channel_pa2id(map->map[i]);
+	} else {
+		info.flags |= SPA_AUDIO_FLAG_UNPOSITIONED;
+	}
+	return spa_format_audio_raw_build(b, id, &info);
+}
+
+#define ENCODING_PCM	1
+
+/* a pa_format_info, the property values are JSON encoded */
+struct format_info {
+	uint32_t encoding;
+	struct pw_properties *props;
+};
+
+static void format_info_clear(struct format_info *info)
+{
+	if (info->props)
+		pw_properties_free(info->props);
+	spa_zero(*info);
+}
+
+static int format_info_from_spec(struct format_info *info, const struct sample_spec *ss)
+{
+	spa_zero(*info);
+	info->encoding = ENCODING_PCM;
+	if ((info->props = pw_properties_new(NULL, NULL)) == NULL)
+		return -errno;
+
+	pw_properties_setf(info->props, "format.sample_format", "\"%s\"",
+			audio_formats[ss->format].name);
+	pw_properties_setf(info->props, "format.rate", "%u", ss->rate);
+	pw_properties_setf(info->props, "format.channels", "%u", ss->channels);
+	return 0;
+}
+
+/* Only fixed values are understood, lists and ranges are not. */
+static int format_info_to_spec(const struct format_info *info, struct sample_spec *ss)
+{
+	const char *str;
+	size_t i, len;
+
+	if (info->encoding != ENCODING_PCM)
+		return -ENOTSUP;
+
+	if ((str = pw_properties_get(info->props, "format.sample_format")) == NULL)
+		return -ENOTSUP;
+	len = strlen(str);
+	if (len < 2 || str[0] != '"' || str[len-1] != '"')
+		return -ENOTSUP;
+	ss->format = SAMPLE_INVALID;
+	for (i = 0; i < SPA_N_ELEMENTS(audio_formats); i++) {
+		if (strlen(audio_formats[i].name) == len - 2 &&
+		    strncmp(audio_formats[i].name, str + 1, len - 2) == 0) {
+			ss->format = audio_formats[i].format;
+			break;
+		}
+	}
+	if ((str = pw_properties_get(info->props, "format.rate")) == NULL)
+		return -ENOTSUP;
+	ss->rate = atoi(str);
+	if ((str = pw_properties_get(info->props, "format.channels")) == NULL)
+		return -ENOTSUP;
+	ss->channels = atoi(str);
+
+	return sample_spec_valid(ss) ? 0 : -ENOTSUP;
+}
@@ -0,0 +1,2596 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "config.h"
+
+#include <spa/utils/result.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+#include "pipewire/private.h"
+
+#include "defs.h"
+
+#define NAME "pulse-server"
+
+#include "format.c"
+#include "message.c"
+
+#define DEFAULT_SERVER		"unix:native"
+#define MAX_SHM_POOLS		16
+#define MAX_FDS			8
+
+#define SINK_INDEX		0
+#define SINK_NAME		"pipewire-sink"
+#define SINK_DESCRIPTION	"PipeWire Sink"
+#define SOURCE_INDEX		1
+#define SOURCE_NAME		"pipewire-source"
+#define SOURCE_DESCRIPTION	"PipeWire Source"
+
+struct impl;
+struct client;
+
+/* a shared memory segment of a client that we read memblocks from */
+struct shm_pool {
+	uint32_t id;
+	unsigned int memfd:1;
+	void *ptr;
+	size_t size;
+};
+
+struct buffer_attr {
+	uint32_t maxlength;
+	uint32_t tlength;
+	uint32_t prebuf;
+	uint32_t minreq;
+	uint32_t fragsize;
+};
+
+struct stream {
+	uint32_t create_tag;
+	uint32_t channel;
+
+	struct impl *impl;
+	struct client *client;
+	enum pw_direction direction;
+
+	struct pw_stream *stream;
+	struct spa_hook stream_listener;
+
+	struct sample_spec ss;
+	struct channel_map map;
+	uint32_t frame_size;
+	struct buffer_attr attr;
+
+	int64_t read_index;
+	int64_t write_index;
+	uint64_t playing_for;
+	uint64_t underrun_for;
+	uint32_t requested;
+	uint32_t drain_tag;
+
+	unsigned int corked:1;
+	unsigned int started:1;
+	unsigned int active:1;
+	unsigned int underrun:1;
+	unsigned int draining:1;
+	unsigned int adjust_latency:1;
+	unsigned int early_requests:1;
+	unsigned int killed:1;
+};
+
+struct client {
+	struct spa_list link;
+	struct impl *impl;
+	struct server *server;
+
+	struct spa_source *source;
+
+	uint32_t index;
+	uint32_t version;
+	struct pw_properties *props;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	uint32_t in_index;
+	uint32_t desc[DESC_MAX];
+	struct message *message;
+
+	uint32_t out_index;
+	struct spa_list out_messages;
+
+	int fds[MAX_FDS];
+	uint32_t n_fds;
+
+	struct shm_pool pools[MAX_SHM_POOLS];
+	uint32_t n_pools;
+
+	struct pw_map streams;
+
+	unsigned int authenticated:1;
+	unsigned int shm:1;
+	unsigned int memfd:1;
+};
+
+struct server {
+	struct spa_list link;
+	struct impl *impl;
+
+	struct sockaddr_un addr;
+	struct spa_source *source;
+	struct spa_list clients;
+};
+
+struct impl {
+	struct pw_core *core;
+	struct pw_loop *loop;
+	struct pw_properties *props;
+
+	struct spa_list servers;
+	struct spa_list free_messages;
+
+	uint32_t client_index;
+
+	uint32_t cookie;
+	uint32_t default_tlength_msec;
+	uint32_t default_minreq_msec;
+	uint32_t default_prebuf_msec;
+	uint32_t default_fragsize_msec;
+	struct sample_spec default_spec;
+	struct channel_map default_map;
+};
+
+static struct message *message_alloc(struct client *client, uint32_t channel, uint32_t size)
+{
+	struct impl *impl = client->impl;
+	struct message *msg;
+
+	if (!spa_list_is_empty(&impl->free_messages)) {
+		msg = spa_list_first(&impl->free_messages, struct message, link);
+		spa_list_remove(&msg->link);
+	} else {
+		if ((msg = calloc(1, sizeof(struct message))) == NULL)
+			return NULL;
+	}
+	msg->channel = channel;
+	msg->offset_hi = msg->offset_lo = msg->flags = 0;
+	msg->creds = false;
+	msg->offset = 0;
+	msg->length = 0;
+	if (ensure_size(msg, size) < 0) {
+		free(msg->data);
+		free(msg);
+		return NULL;
+	}
+	return msg;
+}
+
+static void message_free(struct client *client, struct message *msg, bool dequeue, bool destroy)
+{
+	if (dequeue)
+		spa_list_remove(&msg->link);
+	if (destroy) {
+		free(msg->data);
+		free(msg);
+	} else {
+		spa_list_append(&client->impl->free_messages, &msg->link);
+	}
+}
+
+static int flush_messages(struct client *client)
+{
+	int res;
+
+	while (!spa_list_is_empty(&client->out_messages)) {
+		struct message *m;
+		uint32_t desc[DESC_MAX];
+		struct iovec iov[2];
+		struct msghdr msg;
+		struct cmsghdr *cmsg;
+		char cmsgbuf[CMSG_SPACE(sizeof(struct ucred))];
+		uint32_t idx, n_iov = 0;
+
+		m = spa_list_first(&client->out_messages, struct message, link);
+
+		desc[DESC_LENGTH] = htonl(m->length);
+		desc[DESC_CHANNEL] = htonl(m->channel);
+		desc[DESC_OFFSET_HI] = htonl(m->offset_hi);
+		desc[DESC_OFFSET_LO] = htonl(m->offset_lo);
+		desc[DESC_FLAGS] = htonl(m->flags);
+
+		idx = client->out_index;
+		if (idx < DESCRIPTOR_SIZE) {
+			iov[n_iov].iov_base = SPA_MEMBER(desc, idx, void);
+			iov[n_iov].iov_len = DESCRIPTOR_SIZE - idx;
+			n_iov++;
+			idx = 0;
+		} else {
+			idx -= DESCRIPTOR_SIZE;
+		}
+		if (idx < m->length) {
+			iov[n_iov].iov_base = m->data + idx;
+			iov[n_iov].iov_len = m->length - idx;
+			n_iov++;
+		}
+
+		spa_zero(msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n_iov;
+
+		/* the AUTH reply carries our credentials so that the client
+		 * can verify that we run as the same user before it enables
+		 * shared memory */
+		if (m->creds && client->out_index == 0) {
+			struct ucred ucred = {
+				.pid = getpid(),
+				.uid = getuid(),
+				.gid = getgid(),
+			};
+			msg.msg_control = cmsgbuf;
+			msg.msg_controllen = sizeof(cmsgbuf);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_CREDENTIALS;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(struct ucred));
+			memcpy(CMSG_DATA(cmsg), &ucred, sizeof(ucred));
+		}
+
+		while (true) {
+			res = sendmsg(client->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (res < 0) {
+				if (errno == EINTR)
+					continue;
+				res = -errno;
+				if (res != -EAGAIN && res != -EWOULDBLOCK)
+					pw_log_warn(NAME" %p: send channel:%u %zu, error %d: %m",
+							client, m->channel, iov[0].iov_len, res);
+				goto done;
+			}
+			break;
+		}
+		client->out_index += res;
+		if (client->out_index < DESCRIPTOR_SIZE + m->length)
+			continue;
+
+		client->out_index = 0;
+		message_free(client, m, true, false);
+	}
+	res = 0;
+done:
+	return res;
+}
+
+static int send_message(struct client *client, struct message *m)
+{
+	struct impl *impl = client->impl;
+	int res;
+
+	if (m == NULL)
+		return -EINVAL;
+
+	if (m->length > m->allocated || m->length > MAX_FRAME_SIZE) {
+		res = -ENOMEM;
+		goto error;
+	}
+
+	m->offset = 0;
+	spa_list_append(&client->out_messages, &m->link);
+
+	res = flush_messages(client);
+	if (res == -EAGAIN || res == -EWOULDBLOCK) {
+		pw_loop_update_io(impl->loop, client->source,
+				client->source->mask | SPA_IO_OUT);
+		res = 0;
+	}
+	return res;
+
+error:
+	message_free(client, m, false, false);
+	return res;
+}
+
+static struct message *reply_new(struct client *client, uint32_t tag)
+{
+	struct message *reply;
+
+	reply = message_alloc(client, -1, 0);
+	if (reply == NULL)
+		return NULL;
+
+	pw_log_debug(NAME" %p: REPLY tag:%u", client, tag);
+	message_put(reply,
+		TAG_U32, COMMAND_REPLY,
+		TAG_U32, tag,
+		TAG_INVALID);
+	return reply;
+}
+
+static int reply_error(struct client *client, uint32_t command, uint32_t tag, int res)
+{
+	struct message *reply;
+	uint32_t error = res_to_err(res);
+
+	pw_log_info(NAME" %p: ERROR command:%u tag:%u error:%u (%s)",
+			client, command, tag, error, spa_strerror(res));
+
+	reply = message_alloc(client, -1, 0);
+	if (reply == NULL)
+		return -errno;
+
+	message_put(reply,
+		TAG_U32, COMMAND_ERROR,
+		TAG_U32, tag,
+		TAG_U32, error,
+		TAG_INVALID);
+	return send_message(client, reply);
+}
+
+static int reply_simple_ack(struct client *client, uint32_t tag)
+{
+	return send_message(client, reply_new(client, tag));
+}
+
+static inline uint64_t bytes_to_usec(uint64_t length, const struct sample_spec *ss)
+{
+	uint32_t frame_size = sample_spec_frame_size(ss);
+	if (frame_size == 0 || ss->rate == 0)
+		return 0;
+	return (length / frame_size) * SPA_USEC_PER_SEC / ss->rate;
+}
+
+static inline uint32_t usec_to_bytes_round_up(uint64_t usec, const struct sample_spec *ss)
+{
+	uint64_t frames = (usec * ss->rate + SPA_USEC_PER_SEC - 1) / SPA_USEC_PER_SEC;
+	return frames * sample_spec_frame_size(ss);
+}
+
+/* Fill in the defaults of the buffer attributes the way PulseAudio
+ * does. Everything is rounded to whole frames. */
+static void fix_playback_buffer_attr(struct stream *s, struct buffer_attr *attr)
+{
+	struct impl *impl = s->impl;
+	uint32_t frame_size = s->frame_size, max_prebuf;
+
+	if (attr->maxlength == (uint32_t) -1 || attr->maxlength > MAXLENGTH)
+		attr->maxlength = MAXLENGTH;
+	attr->maxlength = SPA_MAX(SPA_ROUND_DOWN_N(attr->maxlength, frame_size), frame_size);
+
+	if (attr->tlength == (uint32_t) -1)
+		attr->tlength = usec_to_bytes_round_up(impl->default_tlength_msec * SPA_USEC_PER_MSEC, &s->ss);
+	attr->tlength = SPA_CLAMP(attr->tlength, frame_size, attr->maxlength);
+	attr->tlength = SPA_ROUND_UP_N(attr->tlength, frame_size);
+
+	if (attr->minreq == (uint32_t) -1) {
+		uint32_t process = usec_to_bytes_round_up(impl->default_minreq_msec * SPA_USEC_PER_MSEC, &s->ss);
+		attr->minreq = SPA_MIN(process, attr->tlength / 4);
+	}
+	attr->minreq = SPA_MAX(SPA_ROUND_DOWN_N(attr->minreq, frame_size), frame_size);
+
+	if (attr->tlength < attr->minreq + frame_size)
+		attr->tlength = SPA_MIN(attr->minreq + frame_size, attr->maxlength);
+
+	max_prebuf = attr->tlength + frame_size - attr->minreq;
+	if (attr->prebuf == (uint32_t) -1) {
+		if (impl->default_prebuf_msec > 0)
+			attr->prebuf = usec_to_bytes_round_up(impl->default_prebuf_msec * SPA_USEC_PER_MSEC, &s->ss);
+		else
+			attr->prebuf = max_prebuf;
+	}
+	attr->prebuf = SPA_MIN(attr->prebuf, max_prebuf);
+	attr->prebuf = SPA_ROUND_DOWN_N(attr->prebuf, frame_size);
+
+	attr->fragsize = 0;
+
+	pw_log_info(NAME" %p: maxlength:%u tlength:%u minreq:%u prebuf:%u", s,
+			attr->maxlength, attr->tlength, attr->minreq, attr->prebuf);
+}
+
+static void fix_record_buffer_attr(struct stream *s, struct buffer_attr *attr)
+{
+	struct impl *impl = s->impl;
+	uint32_t frame_size = s->frame_size;
+
+	if (attr->maxlength == (uint32_t) -1 || attr->maxlength > MAXLENGTH)
+		attr->maxlength = MAXLENGTH;
+	attr->maxlength = SPA_MAX(SPA_ROUND_DOWN_N(attr->maxlength, frame_size), frame_size);
+
+	if (attr->fragsize == (uint32_t) -1 || attr->fragsize == 0)
+		attr->fragsize = usec_to_bytes_round_up(impl->default_fragsize_msec * SPA_USEC_PER_MSEC, &s->ss);
+	attr->fragsize = SPA_CLAMP(attr->fragsize, frame_size, attr->maxlength);
+	attr->fragsize = SPA_ROUND_DOWN_N(attr->fragsize, frame_size);
+
+	attr->tlength = attr->minreq = attr->prebuf = 0;
+
+	pw_log_info(NAME" %p: maxlength:%u fragsize:%u", s,
+			attr->maxlength, attr->fragsize);
+}
+
+static uint64_t stream_latency_usec(struct stream *s, uint32_t latency)
+{
+	return bytes_to_usec(latency, &s->ss);
+}
+
+static uint32_t stream_queued(struct stream *s)
+{
+	struct pw_time t;
+	if (s->stream == NULL || pw_stream_get_time(s->stream, &t) < 0)
+		return 0;
+	return t.queued;
+}
+
+static int send_command_channel(struct stream *s, uint32_t command)
+{
+	struct client *client = s->client;
+	struct message *msg;
+
+	if ((msg = message_alloc(client, -1, 0)) == NULL)
+		return -errno;
+
+	message_put(msg,
+		TAG_U32, command,
+		TAG_U32, -1,
+		TAG_U32, s->channel,
+		TAG_INVALID);
+	return send_message(client, msg);
+}
+
+static int send_request(struct stream *s)
+{
+	struct client *client = s->client;
+	struct message *msg;
+	uint32_t queued, size;
+
+	if (s->killed || s->direction != PW_DIRECTION_OUTPUT)
+		return 0;
+
+	queued = stream_queued(s);
+	if (queued + s->requested >= s->attr.tlength)
+		return 0;
+
+	size = s->attr.tlength - queued - s->requested;
+	if (size < s->attr.minreq)
+		return 0;
+
+	s->requested += size;
+
+	pw_log_trace(NAME" %p: [%s] REQUEST channel:%u %u", s, client->props ?
+			pw_properties_get(client->props, PW_KEY_APP_NAME) : "",
+			s->channel, size);
+
+	if ((msg = message_alloc(client, -1, 0)) == NULL)
+		return -errno;
+
+	message_put(msg,
+		TAG_U32, COMMAND_REQUEST,
+		TAG_U32, -1,
+		TAG_U32, s->channel,
+		TAG_U32, size,
+		TAG_INVALID);
+	return send_message(client, msg);
+}
+
+static int send_underflow(struct stream *s)
+{
+	struct client *client = s->client;
+	struct message *msg;
+
+	pw_log_info(NAME" %p: UNDERFLOW channel:%u", s, s->channel);
+
+	if ((msg = message_alloc(client, -1, 0)) == NULL)
+		return -errno;
+
+	message_put(msg,
+		TAG_U32, COMMAND_UNDERFLOW,
+		TAG_U32, -1,
+		TAG_U32, s->channel,
+		TAG_INVALID);
+	if (client->version >= 23)
+		message_put(msg,
+			TAG_S64, s->read_index,
+			TAG_INVALID);
+	return send_message(client, msg);
+}
+
+/* Playback streams stay inactive until the client has prebuffered
+ * enough data or explicitly triggered or drained the stream. */
+static void stream_update_active(struct stream *s)
+{
+	bool active = !s->corked && (s->started || s->direction == PW_DIRECTION_INPUT);
+
+	if (s->stream == NULL || s->active == active)
+		return;
+
+	pw_log_debug(NAME" %p: channel:%u active:%d", s, s->channel, active);
+	s->active = active;
+	pw_stream_set_active(s->stream, active);
+}
+
+static void stream_start(struct stream *s)
+{
+	if (s->started)
+		return;
+	s->started = true;
+	s->underrun = false;
+	stream_update_active(s);
+	if (s->client->version >= 13)
+		send_command_channel(s, COMMAND_STARTED);
+}
+
+static void stream_check_prebuf(struct stream *s)
+{
+	uint32_t queued = stream_queued(s);
+
+	if (!s->started) {
+		if (queued > 0 && queued >= s->attr.prebuf)
+			stream_start(s);
+	} else if (s->underrun) {
+		if (queued > 0 && queued >= s->attr.prebuf) {
+			s->underrun = false;
+			if (s->client->version >= 13)
+				send_command_channel(s, COMMAND_STARTED);
+		}
+	}
+}
+
+static void stream_free(struct stream *s)
+{
+	struct client *client = s->client;
+
+	pw_log_debug(NAME" %p: free channel:%u", s, s->channel);
+
+	if (s->channel != SPA_ID_INVALID)
+		pw_map_remove(&client->streams, s->channel);
+	if (s->stream) {
+		spa_hook_remove(&s->stream_listener);
+		pw_stream_destroy(s->stream);
+	}
+	free(s);
+}
+
+static void stream_state_changed(void *data, enum pw_stream_state old,
+		enum pw_stream_state state, const char *error)
+{
+	struct stream *s = data;
+
+	switch (state) {
+	case PW_STREAM_STATE_ERROR:
+		pw_log_warn(NAME" %p: channel:%u error: %s", s, s->channel, error);
+		if (!s->killed) {
+			s->killed = true;
+			send_command_channel(s, s->direction == PW_DIRECTION_OUTPUT ?
+					COMMAND_PLAYBACK_STREAM_KILLED :
+					COMMAND_RECORD_STREAM_KILLED);
+		}
+		break;
+	case PW_STREAM_STATE_UNCONNECTED:
+		if (!s->killed && old != PW_STREAM_STATE_UNCONNECTED) {
+			s->killed = true;
+			send_command_channel(s, s->direction == PW_DIRECTION_OUTPUT ?
+					COMMAND_PLAYBACK_STREAM_KILLED :
+					COMMAND_RECORD_STREAM_KILLED);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void playback_process(struct stream *s)
+{
+	uint32_t queued = stream_queued(s);
+	int64_t read_index = s->write_index - queued;
+
+	if (s->active && read_index > s->read_index) {
+		s->playing_for += read_index - s->read_index;
+		s->underrun_for = 0;
+	}
+	s->read_index = read_index;
+
+	if (s->active && !s->underrun && !s->draining && queued == 0) {
+		s->underrun = true;
+		send_underflow(s);
+	}
+	send_request(s);
+}
+
+static void record_process(struct stream *s)
+{
+	struct client *client = s->client;
+
+	while (stream_queued(s) >= s->attr.fragsize) {
+		struct message *msg;
+		int32_t res;
+
+		if ((msg = message_alloc(client, s->channel, s->attr.fragsize)) == NULL)
+			break;
+
+		res = pw_stream_read(s->stream, msg->data, s->attr.fragsize);
+		if (res <= 0) {
+			message_free(client, msg, false, false);
+			break;
+		}
+		msg->length = res;
+		s->read_index += res;
+
+		pw_log_trace(NAME" %p: channel:%u send %d bytes", s, s->channel, res);
+		send_message(client, msg);
+	}
+}
+
+static void stream_process(void *data)
+{
+	struct stream *s = data;
+
+	if (s->killed)
+		return;
+
+	if (s->direction == PW_DIRECTION_OUTPUT)
+		playback_process(s);
+	else
+		record_process(s);
+}
+
+static void stream_drained(void *data)
+{
+	struct stream *s = data;
+
+	if (!s->draining)
+		return;
+
+	pw_log_info(NAME" %p: DRAIN channel:%u tag:%u", s, s->channel, s->drain_tag);
+	s->draining = false;
+	/* like PulseAudio, no UNDERFLOW for a drained stream */
+	s->underrun = true;
+	reply_simple_ack(s->client, s->drain_tag);
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = stream_state_changed,
+	.process = stream_process,
+	.drained = stream_drained,
+};
+
+static struct stream *stream_new(struct client *client, enum pw_direction direction,
+		uint32_t tag, const struct sample_spec *ss, const struct channel_map *map,
+		struct buffer_attr *attr, bool corked, struct pw_properties *props)
+{
+	struct stream *s;
+	const struct spa_pod *params[1];
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	uint32_t latency;
+	int res;
+
+	if ((s = calloc(1, sizeof(struct stream))) == NULL)
+		goto error_errno;
+
+	s->impl = client->impl;
+	s->client = client;
+	s->direction = direction;
+	s->create_tag = tag;
+	s->ss = *ss;
+	s->map = *map;
+	s->frame_size = sample_spec_frame_size(ss);
+	s->corked = corked;
+	s->underrun_for = -1;
+
+	s->channel = pw_map_insert_new(&client->streams, s);
+	if (s->channel == SPA_ID_INVALID)
+		goto error_errno;
+
+	if (direction == PW_DIRECTION_OUTPUT) {
+		fix_playback_buffer_attr(s, attr);
+		latency = attr->minreq;
+		pw_properties_set(props, PW_KEY_MEDIA_CATEGORY, "Playback");
+	} else {
+		fix_record_buffer_attr(s, attr);
+		latency = attr->fragsize;
+		pw_properties_set(props, PW_KEY_MEDIA_CATEGORY, "Capture");
+	}
+	s->attr = *attr;
+
+	pw_properties_set(props, PW_KEY_MEDIA_TYPE, "Audio");
+	pw_properties_setf(props, PW_KEY_STREAM_RING_SIZE, "%u", attr->maxlength);
+	pw_properties_setf(props, PW_KEY_NODE_LATENCY, "%u/%u",
+			latency / s->frame_size, ss->rate);
+
+	s->stream = pw_stream_new(client->remote,
+			pw_properties_get(props, PW_KEY_MEDIA_NAME), props);
+	props = NULL;
+	if (s->stream == NULL)
+		goto error_errno;
+
+	pw_stream_add_listener(s->stream, &s->stream_listener, &stream_events, s);
+
+	params[0] = format_build_param(&b, SPA_PARAM_EnumFormat, ss, map);
+
+	if ((res = pw_stream_connect(s->stream, direction, SPA_ID_INVALID,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_INACTIVE |
+			PW_STREAM_FLAG_RING,
+			params, 1)) < 0)
+		goto error;
+
+	/* without prebuf, playback starts right away */
+	if (direction == PW_DIRECTION_OUTPUT && attr->prebuf == 0)
+		s->started = true;
+	stream_update_active(s);
+
+	return s;
+
+error_errno:
+	res = -errno;
+error:
+	if (props)
+		pw_properties_free(props);
+	if (s)
+		stream_free(s);
+	errno = -res;
+	return NULL;
+}
+
+static struct stream *find_stream(struct client *client, uint32_t channel, enum pw_direction direction)
+{
+	struct stream *s = pw_map_lookup(&client->streams, channel);
+	if (s == NULL || s->direction != direction)
+		return NULL;
+	return s;
+}
+
+static int do_command_auth(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	uint32_t version;
+	const void *cookie;
+	size_t len;
+	bool shm = false, memfd = false;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &version,
+			TAG_ARBITRARY, &cookie, &len,
+			TAG_INVALID)) < 0)
+		return res;
+
+	/* since version 13 the upper bits carry the shm flags */
+	if ((version & PROTOCOL_VERSION_MASK) >= 13) {
+		shm = SPA_FLAG_IS_SET(version, PROTOCOL_FLAG_SHM);
+		memfd = SPA_FLAG_IS_SET(version, PROTOCOL_FLAG_MEMFD);
+		version &= PROTOCOL_VERSION_MASK;
+	}
+	if (version < 8)
+		return -EPROTO;
+
+	client->version = version;
+	client->authenticated = true;
+
+	/* shared memory is only possible with a client of the same user */
+	if (shm && version >= 13) {
+		struct ucred ucred;
+		socklen_t len = sizeof(ucred);
+
+		if (getsockopt(client->source->fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) < 0 ||
+		    ucred.uid != getuid())
+			shm = false;
+	}
+	client->shm = shm;
+	client->memfd = shm && memfd && version >= 31;
+
+	pw_log_info(NAME" %p: AUTH version:%d shm:%d memfd:%d", client, version,
+			client->shm, client->memfd);
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_U32, PROTOCOL_VERSION |
+			(client->shm ? PROTOCOL_FLAG_SHM : 0) |
+			(client->memfd ? PROTOCOL_FLAG_MEMFD : 0),
+		TAG_INVALID);
+	reply->creds = true;
+
+	return send_message(client, reply);
+}
+
+static int do_set_client_name(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	const char *name = NULL;
+	int res;
+
+	if (client->version < 13) {
+		if ((res = message_get(m,
+				TAG_STRING, &name,
+				TAG_INVALID)) < 0)
+			return res;
+		if (name == NULL)
+			return -EPROTO;
+		pw_properties_set(client->props, PW_KEY_APP_NAME, name);
+	} else {
+		if ((res = message_get(m,
+				TAG_PROPLIST, client->props,
+				TAG_INVALID)) < 0)
+			return res;
+	}
+	pw_remote_update_properties(client->remote, &client->props->dict);
+
+	pw_log_info(NAME" %p: SET_CLIENT_NAME %s", client,
+			pw_properties_get(client->props, PW_KEY_APP_NAME));
+
+	reply = reply_new(client, tag);
+	if (client->version >= 13)
+		message_put(reply,
+			TAG_U32, client->index,
+			TAG_INVALID);
+
+	return send_message(client, reply);
+}
+
+static int do_update_client_proplist(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct pw_properties *props;
+	uint32_t mode;
+	int res;
+
+	if ((props = pw_properties_new(NULL, NULL)) == NULL)
+		return -errno;
+	if ((res = message_get(m,
+			TAG_U32, &mode,
+			TAG_PROPLIST, props,
+			TAG_INVALID)) < 0)
+		goto exit;
+
+	pw_properties_update(client->props, &props->dict);
+	pw_remote_update_properties(client->remote, &client->props->dict);
+	res = reply_simple_ack(client, tag);
+exit:
+	pw_properties_free(props);
+	return res;
+}
+
+static int do_subscribe(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	uint32_t mask;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &mask,
+			TAG_INVALID)) < 0)
+		return res;
+
+	pw_log_info(NAME" %p: SUBSCRIBE mask:%08x", client, mask);
+
+	return reply_simple_ack(client, tag);
+}
+
+static int do_register_memfd_shmid(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct shm_pool *pool;
+	struct stat st;
+	uint32_t shm_id, i;
+	int res, fd;
+	void *ptr;
+
+	if ((res = message_get(m,
+			TAG_U32, &shm_id,
+			TAG_INVALID)) < 0)
+		return res;
+
+	if (client->n_fds == 0)
+		return -EPROTO;
+
+	fd = client->fds[0];
+	client->n_fds--;
+	memmove(&client->fds[0], &client->fds[1], client->n_fds * sizeof(int));
+
+	pw_log_info(NAME" %p: REGISTER_MEMFD_SHMID id:%u fd:%d", client, shm_id, fd);
+
+	if (!client->memfd || client->n_pools >= MAX_SHM_POOLS) {
+		res = -ENOTSUP;
+		goto exit;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto exit;
+	}
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED) {
+		res = -errno;
+		goto exit;
+	}
+
+	for (i = 0; i < client->n_pools; i++) {
+		pool = &client->pools[i];
+		if (pool->memfd && pool->id == shm_id) {
+			munmap(pool->ptr, pool->size);
+			break;
+		}
+	}
+	pool = &client->pools[i];
+	if (i == client->n_pools)
+		client->n_pools++;
+	pool->id = shm_id;
+	pool->memfd = true;
+	pool->ptr = ptr;
+	pool->size = st.st_size;
+	res = 0;
+exit:
+	/* no reply, this is a one-way message */
+	close(fd);
+	return res;
+}
+
+static struct shm_pool *find_pool(struct client *client, uint32_t shm_id, bool memfd)
+{
+	struct shm_pool *pool;
+	struct stat st;
+	char name[64];
+	uint32_t i;
+	int fd;
+	void *ptr;
+
+	for (i = 0; i < client->n_pools; i++) {
+		pool = &client->pools[i];
+		if (pool->id == shm_id && pool->memfd == memfd)
+			return pool;
+	}
+	if (memfd || client->n_pools >= MAX_SHM_POOLS)
+		return NULL;
+
+	/* a POSIX shm segment, map it the first time it is used */
+	snprintf(name, sizeof(name), "/dev/shm/pulse-shm-%u", shm_id);
+	if ((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	pool = &client->pools[client->n_pools++];
+	pool->id = shm_id;
+	pool->memfd = false;
+	pool->ptr = ptr;
+	pool->size = st.st_size;
+	return pool;
+}
+
+static int send_release(struct client *client, uint32_t block_id)
+{
+	struct message *msg;
+
+	if ((msg = message_alloc(client, -1, 0)) == NULL)
+		return -errno;
+
+	msg->offset_hi = block_id;
+	msg->flags = FLAG_SHMRELEASE;
+	return send_message(client, msg);
+}
+
+/* Newer clients can send a list of formats instead of, or next to, the
+ * sample spec. Use the first PCM format when the sample spec is not
+ * usable. */
+static int read_formats(struct message *m, uint8_t n_formats,
+		struct sample_spec *ss, struct channel_map *map)
+{
+	bool found = sample_spec_valid(ss);
+	uint8_t i;
+	int res;
+
+	for (i = 0; i < n_formats; i++) {
+		struct format_info info = { 0 };
+
+		if ((info.props = pw_properties_new(NULL, NULL)) == NULL)
+			return -errno;
+
+		res = message_get(m,
+				TAG_FORMAT_INFO, &info,
+				TAG_INVALID);
+		if (res >= 0 && !found &&
+		    format_info_to_spec(&info, ss) >= 0) {
+			channel_map_init_default(map, ss->channels);
+			found = true;
+		}
+		format_info_clear(&info);
+		if (res < 0)
+			return res;
+	}
+	return 0;
+}
+
+static int do_create_playback_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	const char *name = NULL, *sink_name;
+	struct sample_spec ss;
+	struct channel_map map;
+	struct cvolume volume;
+	struct buffer_attr attr = { 0 };
+	struct pw_properties *props = NULL;
+	struct stream *s;
+	struct message *reply;
+	uint32_t sink_index, syncid;
+	bool corked = false, no_remap = false, no_remix = false, fix_format = false,
+	     fix_rate = false, fix_channels = false, no_move = false, variable_rate = false,
+	     muted = false, adjust_latency = false, volume_set = true, early_requests = false,
+	     muted_set = false, dont_inhibit_auto_suspend = false, fail_on_suspend = false,
+	     relative_volume = false, passthrough = false;
+	uint8_t n_formats = 0;
+	int res;
+
+	props = pw_properties_copy(client->props);
+	if (props == NULL)
+		return -errno;
+
+	if (client->version < 13) {
+		if ((res = message_get(m,
+				TAG_STRING, &name,
+				TAG_INVALID)) < 0)
+			goto error;
+		if (name == NULL) {
+			res = -EPROTO;
+			goto error;
+		}
+	}
+	if ((res = message_get(m,
+			TAG_SAMPLE_SPEC, &ss,
+			TAG_CHANNEL_MAP, &map,
+			TAG_U32, &sink_index,
+			TAG_STRING, &sink_name,
+			TAG_U32, &attr.maxlength,
+			TAG_BOOLEAN, &corked,
+			TAG_U32, &attr.tlength,
+			TAG_U32, &attr.prebuf,
+			TAG_U32, &attr.minreq,
+			TAG_U32, &syncid,
+			TAG_CVOLUME, &volume,
+			TAG_INVALID)) < 0)
+		goto error;
+
+	if (client->version >= 12) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &no_remap,
+				TAG_BOOLEAN, &no_remix,
+				TAG_BOOLEAN, &fix_format,
+				TAG_BOOLEAN, &fix_rate,
+				TAG_BOOLEAN, &fix_channels,
+				TAG_BOOLEAN, &no_move,
+				TAG_BOOLEAN, &variable_rate,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 13) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &muted,
+				TAG_BOOLEAN, &adjust_latency,
+				TAG_PROPLIST, props,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 14) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &volume_set,
+				TAG_BOOLEAN, &early_requests,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 15) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &muted_set,
+				TAG_BOOLEAN, &dont_inhibit_auto_suspend,
+				TAG_BOOLEAN, &fail_on_suspend,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 17) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &relative_volume,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 18) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &passthrough,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 21) {
+		if ((res = message_get(m,
+				TAG_U8, &n_formats,
+				TAG_INVALID)) < 0)
+			goto error;
+		if ((res = read_formats(m, n_formats, &ss, &map)) < 0)
+			goto error;
+	}
+	if (map.channels == 0 && ss.channels > 0)
+		channel_map_init_default(&map, ss.channels);
+
+	if (!sample_spec_valid(&ss) || !channel_map_valid(&map) ||
+	    map.channels != ss.channels) {
+		res = -ENOTSUP;
+		goto error;
+	}
+	if (name != NULL)
+		pw_properties_set(props, PW_KEY_MEDIA_NAME, name);
+
+	pw_log_info(NAME" %p: CREATE_PLAYBACK_STREAM %s rate:%u channels:%u corked:%d",
+			client, pw_properties_get(props, PW_KEY_MEDIA_NAME),
+			ss.rate, ss.channels, corked);
+
+	s = stream_new(client, PW_DIRECTION_OUTPUT, tag, &ss, &map, &attr, corked, props);
+	props = NULL;
+	if (s == NULL) {
+		res = -errno;
+		goto error;
+	}
+	s->adjust_latency = adjust_latency;
+	s->early_requests = early_requests;
+	s->requested = s->attr.tlength;
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_U32, s->channel,		/* stream index/channel */
+		TAG_U32, s->channel,		/* sink_input index */
+		TAG_U32, s->requested,		/* missing/requested bytes */
+		TAG_INVALID);
+
+	if (client->version >= 9) {
+		message_put(reply,
+			TAG_U32, s->attr.maxlength,
+			TAG_U32, s->attr.tlength,
+			TAG_U32, s->attr.prebuf,
+			TAG_U32, s->attr.minreq,
+			TAG_INVALID);
+	}
+	if (client->version >= 12) {
+		message_put(reply,
+			TAG_SAMPLE_SPEC, &s->ss,
+			TAG_CHANNEL_MAP, &s->map,
+			TAG_U32, SINK_INDEX,		/* sink index */
+			TAG_STRING, SINK_NAME,		/* sink name */
+			TAG_BOOLEAN, false,		/* sink suspended state */
+			TAG_INVALID);
+	}
+	if (client->version >= 13) {
+		message_put(reply,
+			TAG_USEC, stream_latency_usec(s, s->attr.minreq),	/* sink configured latency */
+			TAG_INVALID);
+	}
+	if (client->version >= 21) {
+		struct format_info info;
+		format_info_from_spec(&info, &s->ss);
+		message_put(reply,
+			TAG_FORMAT_INFO, &info,
+			TAG_INVALID);
+		format_info_clear(&info);
+	}
+	return send_message(client, reply);
+
+error:
+	if (props)
+		pw_properties_free(props);
+	return res;
+}
+
+static int do_create_record_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	const char *name = NULL, *source_name;
+	struct sample_spec ss;
+	struct channel_map map;
+	struct cvolume volume;
+	struct buffer_attr attr = { 0 };
+	struct pw_properties *props = NULL;
+	struct stream *s;
+	struct message *reply;
+	uint32_t source_index, direct_on_input_idx;
+	bool corked = false, no_remap = false, no_remix = false, fix_format = false,
+	     fix_rate = false, fix_channels = false, no_move = false, variable_rate = false,
+	     peak_detect = false, adjust_latency = false, early_requests = false,
+	     dont_inhibit_auto_suspend = false, fail_on_suspend = false,
+	     muted = false, volume_set = false, muted_set = false,
+	     relative_volume = false, passthrough = false;
+	uint8_t n_formats = 0;
+	int res;
+
+	props = pw_properties_copy(client->props);
+	if (props == NULL)
+		return -errno;
+
+	if (client->version < 13) {
+		if ((res = message_get(m,
+				TAG_STRING, &name,
+				TAG_INVALID)) < 0)
+			goto error;
+		if (name == NULL) {
+			res = -EPROTO;
+			goto error;
+		}
+	}
+	if ((res = message_get(m,
+			TAG_SAMPLE_SPEC, &ss,
+			TAG_CHANNEL_MAP, &map,
+			TAG_U32, &source_index,
+			TAG_STRING, &source_name,
+			TAG_U32, &attr.maxlength,
+			TAG_BOOLEAN, &corked,
+			TAG_U32, &attr.fragsize,
+			TAG_INVALID)) < 0)
+		goto error;
+
+	if (client->version >= 12) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &no_remap,
+				TAG_BOOLEAN, &no_remix,
+				TAG_BOOLEAN, &fix_format,
+				TAG_BOOLEAN, &fix_rate,
+				TAG_BOOLEAN, &fix_channels,
+				TAG_BOOLEAN, &no_move,
+				TAG_BOOLEAN, &variable_rate,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 13) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &peak_detect,
+				TAG_BOOLEAN, &adjust_latency,
+				TAG_PROPLIST, props,
+				TAG_U32, &direct_on_input_idx,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 14) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &early_requests,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 15) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &dont_inhibit_auto_suspend,
+				TAG_BOOLEAN, &fail_on_suspend,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (client->version >= 22) {
+		if ((res = message_get(m,
+				TAG_U8, &n_formats,
+				TAG_INVALID)) < 0)
+			goto error;
+		if ((res = read_formats(m, n_formats, &ss, &map)) < 0)
+			goto error;
+		if ((res = message_get(m,
+				TAG_CVOLUME, &volume,
+				TAG_BOOLEAN, &muted,
+				TAG_BOOLEAN, &volume_set,
+				TAG_BOOLEAN, &muted_set,
+				TAG_BOOLEAN, &relative_volume,
+				TAG_BOOLEAN, &passthrough,
+				TAG_INVALID)) < 0)
+			goto error;
+	}
+	if (map.channels == 0 && ss.channels > 0)
+		channel_map_init_default(&map, ss.channels);
+
+	if (!sample_spec_valid(&ss) || !channel_map_valid(&map) ||
+	    map.channels != ss.channels) {
+		res = -ENOTSUP;
+		goto error;
+	}
+	if (name != NULL)
+		pw_properties_set(props, PW_KEY_MEDIA_NAME, name);
+
+	pw_log_info(NAME" %p: CREATE_RECORD_STREAM %s rate:%u channels:%u corked:%d",
+			client, pw_properties_get(props, PW_KEY_MEDIA_NAME),
+			ss.rate, ss.channels, corked);
+
+	s = stream_new(client, PW_DIRECTION_INPUT, tag, &ss, &map, &attr, corked, props);
+	props = NULL;
+	if (s == NULL) {
+		res = -errno;
+		goto error;
+	}
+	s->adjust_latency = adjust_latency;
+	s->early_requests = early_requests;
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_U32, s->channel,		/* stream index/channel */
+		TAG_U32, s->channel,		/* source_output index */
+		TAG_INVALID);
+	if (client->version >= 9) {
+		message_put(reply,
+			TAG_U32, s->attr.maxlength,
+			TAG_U32, s->attr.fragsize,
+			TAG_INVALID);
+	}
+	if (client->version >= 12) {
+		message_put(reply,
+			TAG_SAMPLE_SPEC, &s->ss,
+			TAG_CHANNEL_MAP, &s->map,
+			TAG_U32, SOURCE_INDEX,		/* source index */
+			TAG_STRING, SOURCE_NAME,	/* source name */
+			TAG_BOOLEAN, false,		/* source suspended state */
+			TAG_INVALID);
+	}
+	if (client->version >= 13) {
+		message_put(reply,
+			TAG_USEC, stream_latency_usec(s, s->attr.fragsize),	/* source configured latency */
+			TAG_INVALID);
+	}
+	if (client->version >= 22) {
+		struct format_info info;
+		format_info_from_spec(&info, &s->ss);
+		message_put(reply,
+			TAG_FORMAT_INFO, &info,
+			TAG_INVALID);
+		format_info_clear(&info);
+	}
+	return send_message(client, reply);
+
+error:
+	if (props)
+		pw_properties_free(props);
+	return res;
+}
+
+static int do_delete_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	uint32_t channel;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_INVALID)) < 0)
+		return res;
+
+	pw_log_info(NAME" %p: DELETE_STREAM channel:%u", client, channel);
+
+	s = find_stream(client, channel, command == COMMAND_DELETE_PLAYBACK_STREAM ?
+			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	stream_free(s);
+
+	return reply_simple_ack(client, tag);
+}
+
+static int do_cork_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	uint32_t channel;
+	bool cork;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_BOOLEAN, &cork,
+			TAG_INVALID)) < 0)
+		return res;
+
+	pw_log_info(NAME" %p: CORK channel:%u cork:%d", client, channel, cork);
+
+	s = find_stream(client, channel, command == COMMAND_CORK_PLAYBACK_STREAM ?
+			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	s->corked = cork;
+	stream_update_active(s);
+
+	return reply_simple_ack(client, tag);
+}
+
+static int do_flush_trigger_prebuf_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	uint32_t channel;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_INVALID)) < 0)
+		return res;
+
+	s = find_stream(client, channel, command == COMMAND_FLUSH_RECORD_STREAM ?
+			PW_DIRECTION_INPUT : PW_DIRECTION_OUTPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	switch (command) {
+	case COMMAND_FLUSH_PLAYBACK_STREAM:
+	{
+		uint32_t queued = stream_queued(s);
+		pw_stream_flush(s->stream, false);
+		/* like PulseAudio, the write index moves back to the read
+		 * index and the stream waits for prebuf again */
+		s->write_index -= queued;
+		s->started = false;
+		stream_update_active(s);
+		break;
+	}
+	case COMMAND_FLUSH_RECORD_STREAM:
+		pw_stream_flush(s->stream, false);
+		break;
+	case COMMAND_TRIGGER_PLAYBACK_STREAM:
+		stream_start(s);
+		break;
+	case COMMAND_PREBUF_PLAYBACK_STREAM:
+		s->started = false;
+		stream_update_active(s);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	res = reply_simple_ack(client, tag);
+	send_request(s);
+	return res;
+}
+
+static int do_drain_stream(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	uint32_t channel;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_INVALID)) < 0)
+		return res;
+
+	pw_log_info(NAME" %p: DRAIN channel:%u tag:%u", client, channel, tag);
+
+	s = find_stream(client, channel, PW_DIRECTION_OUTPUT);
+	if (s == NULL)
+		return -ENOENT;
+	if (s->draining)
+		return -EBUSY;
+
+	s->drain_tag = tag;
+	s->draining = true;
+	/* a stream that never reached its prebuf starts now */
+	stream_start(s);
+	pw_stream_flush(s->stream, true);
+
+	return 0;
+}
+
+static int do_set_stream_buffer_attr(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	struct buffer_attr attr = { 0 };
+	struct message *reply;
+	uint32_t channel, maxlength;
+	bool adjust_latency = false, early_requests = false;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_INVALID)) < 0)
+		return res;
+
+	s = find_stream(client, channel, command == COMMAND_SET_PLAYBACK_STREAM_BUFFER_ATTR ?
+			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	if (s->direction == PW_DIRECTION_OUTPUT) {
+		if ((res = message_get(m,
+				TAG_U32, &attr.maxlength,
+				TAG_U32, &attr.tlength,
+				TAG_U32, &attr.prebuf,
+				TAG_U32, &attr.minreq,
+				TAG_INVALID)) < 0)
+			return res;
+	} else {
+		if ((res = message_get(m,
+				TAG_U32, &attr.maxlength,
+				TAG_U32, &attr.fragsize,
+				TAG_INVALID)) < 0)
+			return res;
+	}
+	if (client->version >= 13) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &adjust_latency,
+				TAG_INVALID)) < 0)
+			return res;
+	}
+	if (client->version >= 14) {
+		if ((res = message_get(m,
+				TAG_BOOLEAN, &early_requests,
+				TAG_INVALID)) < 0)
+			return res;
+	}
+
+	/* the ring of the stream was sized for the original maxlength
+	 * and can't grow */
+	maxlength = s->attr.maxlength;
+	if (attr.maxlength == (uint32_t) -1 || attr.maxlength > maxlength)
+		attr.maxlength = maxlength;
+
+	s->adjust_latency = adjust_latency;
+	s->early_requests = early_requests;
+
+	reply = reply_new(client, tag);
+	if (s->direction == PW_DIRECTION_OUTPUT) {
+		fix_playback_buffer_attr(s, &attr);
+		s->attr = attr;
+		message_put(reply,
+			TAG_U32, s->attr.maxlength,
+			TAG_U32, s->attr.tlength,
+			TAG_U32, s->attr.prebuf,
+			TAG_U32, s->attr.minreq,
+			TAG_INVALID);
+		if (client->version >= 13)
+			message_put(reply,
+				TAG_USEC, stream_latency_usec(s, s->attr.minreq),
+				TAG_INVALID);
+	} else {
+		fix_record_buffer_attr(s, &attr);
+		s->attr = attr;
+		message_put(reply,
+			TAG_U32, s->attr.maxlength,
+			TAG_U32, s->attr.fragsize,
+			TAG_INVALID);
+		if (client->version >= 13)
+			message_put(reply,
+				TAG_USEC, stream_latency_usec(s, s->attr.fragsize),
+				TAG_INVALID);
+	}
+	res = send_message(client, reply);
+	send_request(s);
+	return res;
+}
+
+static int do_update_stream_proplist(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct pw_properties *props;
+	struct stream *s;
+	uint32_t channel, mode;
+	int res;
+
+	if ((props = pw_properties_new(NULL, NULL)) == NULL)
+		return -errno;
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_U32, &mode,
+			TAG_PROPLIST, props,
+			TAG_INVALID)) < 0)
+		goto exit;
+
+	s = find_stream(client, channel, command == COMMAND_UPDATE_PLAYBACK_STREAM_PROPLIST ?
+			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
+	if (s == NULL) {
+		res = -ENOENT;
+		goto exit;
+	}
+	pw_stream_update_properties(s->stream, &props->dict);
+	res = reply_simple_ack(client, tag);
+exit:
+	pw_properties_free(props);
+	return res;
+}
+
+static int do_set_stream_name(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct stream *s;
+	uint32_t channel;
+	const char *name = NULL;
+	struct spa_dict_item items[1];
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_STRING, &name,
+			TAG_INVALID)) < 0)
+		return res;
+	if (name == NULL)
+		return -EINVAL;
+
+	s = find_stream(client, channel, command == COMMAND_SET_PLAYBACK_STREAM_NAME ?
+			PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_NAME, name);
+	pw_stream_update_properties(s->stream, &SPA_DICT_INIT(items, 1));
+
+	return reply_simple_ack(client, tag);
+}
+
+static int do_get_playback_latency(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	struct stream *s;
+	struct timeval tv, now;
+	struct pw_time t = { 0 };
+	uint32_t channel;
+	uint64_t delay = 0;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_TIMEVAL, &tv,
+			TAG_INVALID)) < 0)
+		return res;
+
+	s = find_stream(client, channel, PW_DIRECTION_OUTPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	pw_stream_get_time(s->stream, &t);
+	if (t.rate.denom > 0)
+		delay = (t.delay < 0 ? -t.delay : t.delay) * SPA_USEC_PER_SEC * t.rate.num / t.rate.denom;
+	s->read_index = s->write_index - t.queued;
+
+	gettimeofday(&now, NULL);
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_USEC, delay,		/* sink latency */
+		TAG_USEC, 0ULL,			/* source latency */
+		TAG_BOOLEAN, s->active,		/* playing */
+		TAG_TIMEVAL, &tv,
+		TAG_TIMEVAL, &now,
+		TAG_S64, s->write_index,
+		TAG_S64, s->read_index,
+		TAG_INVALID);
+	if (client->version >= 13) {
+		message_put(reply,
+			TAG_U64, s->underrun_for,
+			TAG_U64, s->playing_for,
+			TAG_INVALID);
+	}
+	return send_message(client, reply);
+}
+
+static int do_get_record_latency(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	struct stream *s;
+	struct timeval tv, now;
+	struct pw_time t = { 0 };
+	uint32_t channel;
+	uint64_t delay = 0;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &channel,
+			TAG_TIMEVAL, &tv,
+			TAG_INVALID)) < 0)
+		return res;
+
+	s = find_stream(client, channel, PW_DIRECTION_INPUT);
+	if (s == NULL)
+		return -ENOENT;
+
+	pw_stream_get_time(s->stream, &t);
+	if (t.rate.denom > 0)
+		delay = (t.delay < 0 ? -t.delay : t.delay) * SPA_USEC_PER_SEC * t.rate.num / t.rate.denom;
+	/* the data in the ring is not sent yet */
+	delay += bytes_to_usec(t.queued, &s->ss);
+	s->write_index = s->read_index + t.queued;
+
+	gettimeofday(&now, NULL);
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_USEC, 0ULL,			/* monitor latency */
+		TAG_USEC, delay,		/* source latency */
+		TAG_BOOLEAN, s->active,		/* playing */
+		TAG_TIMEVAL, &tv,
+		TAG_TIMEVAL, &now,
+		TAG_S64, s->write_index,
+		TAG_S64, s->read_index,
+		TAG_INVALID);
+
+	return send_message(client, reply);
+}
+
+static int do_get_server_info(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct impl *impl = client->impl;
+	struct message *reply;
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_STRING, "PulseAudio (on PipeWire " PACKAGE_VERSION ")",
+		TAG_STRING, "15.0.0",
+		TAG_STRING, pw_get_user_name(),
+		TAG_STRING, pw_get_host_name(),
+		TAG_SAMPLE_SPEC, &impl->default_spec,
+		TAG_STRING, SINK_NAME,			/* default sink name */
+		TAG_STRING, SOURCE_NAME,		/* default source name */
+		TAG_U32, impl->cookie,			/* cookie */
+		TAG_INVALID);
+
+	if (client->version >= 15) {
+		message_put(reply,
+			TAG_CHANNEL_MAP, &impl->default_map,
+			TAG_INVALID);
+	}
+	return send_message(client, reply);
+}
+
+static int do_stat(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_U32, 0,	/* n_allocated */
+		TAG_U32, 0,	/* allocated size */
+		TAG_U32, 0,	/* n_accumulated */
+		TAG_U32, 0,	/* accumulated_size */
+		TAG_U32, 0,	/* sample cache size */
+		TAG_INVALID);
+
+	return send_message(client, reply);
+}
+
+static int do_lookup(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	const char *name = NULL;
+	uint32_t index;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_STRING, &name,
+			TAG_INVALID)) < 0)
+		return res;
+	if (name == NULL)
+		return -EINVAL;
+
+	if (command == COMMAND_LOOKUP_SINK &&
+	    (strcmp(name, SINK_NAME) == 0 || strcmp(name, DEFAULT_SINK) == 0))
+		index = SINK_INDEX;
+	else if (command == COMMAND_LOOKUP_SOURCE &&
+	    (strcmp(name, SOURCE_NAME) == 0 || strcmp(name, DEFAULT_SOURCE) == 0))
+		index = SOURCE_INDEX;
+	else
+		return -ENOENT;
+
+	reply = reply_new(client, tag);
+	message_put(reply,
+		TAG_U32, index,
+		TAG_INVALID);
+
+	return send_message(client, reply);
+}
+
+/* There is no device enumeration yet, clients see one sink and one source
+ * that are routed to the default devices of the session manager. */
+static void fill_device_info(struct client *client, struct message *m, bool sink)
+{
+	struct impl *impl = client->impl;
+	struct cvolume volume;
+	struct format_info info;
+	uint32_t i;
+
+	volume.channels = impl->default_spec.channels;
+	for (i = 0; i < volume.channels; i++)
+		volume.values[i] = VOLUME_NORM;
+
+	message_put(m,
+		TAG_U32, sink ? SINK_INDEX : SOURCE_INDEX,		/* index */
+		TAG_STRING, sink ? SINK_NAME : SOURCE_NAME,
+		TAG_STRING, sink ? SINK_DESCRIPTION : SOURCE_DESCRIPTION,
+		TAG_SAMPLE_SPEC, &impl->default_spec,
+		TAG_CHANNEL_MAP, &impl->default_map,
+		TAG_U32, -1,						/* module index */
+		TAG_CVOLUME, &volume,
+		TAG_BOOLEAN, false,					/* mute */
+		TAG_U32, -1,						/* monitor source/sink index */
+		TAG_STRING, NULL,					/* monitor source/sink name */
+		TAG_USEC, 0ULL,						/* latency */
+		TAG_STRING, "PipeWire",					/* driver */
+		TAG_U32, sink ? SINK_LATENCY : SOURCE_LATENCY,		/* flags */
+		TAG_INVALID);
+
+	if (client->version >= 13) {
+		message_put(m,
+			TAG_PROPLIST, NULL,
+			TAG_USEC, 0ULL,					/* requested latency */
+			TAG_INVALID);
+	}
+	if (client->version >= 15) {
+		message_put(m,
+			TAG_VOLUME, 1.0f,				/* base volume */
+			TAG_U32, STATE_RUNNING,				/* state */
+			TAG_U32, 0,					/* n_volume_steps */
+			TAG_U32, -1,					/* card index */
+			TAG_INVALID);
+	}
+	if (client->version >= 16) {
+		message_put(m,
+			TAG_U32, 0,					/* n_ports */
+			TAG_STRING, NULL,				/* active port name */
+			TAG_INVALID);
+	}
+	if ((sink && client->version >= 21) || (!sink && client->version >= 22)) {
+		format_info_from_spec(&info, &impl->default_spec);
+		message_put(m,
+			TAG_U8, 1,					/* n_formats */
+			TAG_FORMAT_INFO, &info,
+			TAG_INVALID);
+		format_info_clear(&info);
+	}
+}
+
+static int do_get_device_info(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+	const char *name = NULL;
+	uint32_t index;
+	bool sink = command == COMMAND_GET_SINK_INFO;
+	int res;
+
+	if ((res = message_get(m,
+			TAG_U32, &index,
+			TAG_STRING, &name,
+			TAG_INVALID)) < 0)
+		return res;
+
+	if (index != SPA_ID_INVALID) {
+		if (index != (sink ? SINK_INDEX : SOURCE_INDEX))
+			return -ENOENT;
+	} else if (name != NULL) {
+		if (strcmp(name, sink ? SINK_NAME : SOURCE_NAME) != 0 &&
+		    strcmp(name, sink ? DEFAULT_SINK : DEFAULT_SOURCE) != 0)
+			return -ENOENT;
+	} else {
+		return -EINVAL;
+	}
+
+	reply = reply_new(client, tag);
+	fill_device_info(client, reply, sink);
+	return send_message(client, reply);
+}
+
+static int do_get_info_list(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	struct message *reply;
+
+	reply = reply_new(client, tag);
+	switch (command) {
+	case COMMAND_GET_SINK_INFO_LIST:
+		fill_device_info(client, reply, true);
+		break;
+	case COMMAND_GET_SOURCE_INFO_LIST:
+		fill_device_info(client, reply, false);
+		break;
+	default:
+		/* empty lists for the other objects */
+		break;
+	}
+	return send_message(client, reply);
+}
+
+static int do_error_access(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	return -EACCES;
+}
+
+static const struct command {
+	const char *name;
+	int (*run) (struct client *client, uint32_t command, uint32_t tag, struct message *msg);
+} commands[COMMAND_MAX] = {
+	[COMMAND_AUTH] = { "AUTH", do_command_auth, },
+	[COMMAND_SET_CLIENT_NAME] = { "SET_CLIENT_NAME", do_set_client_name, },
+	[COMMAND_UPDATE_CLIENT_PROPLIST] = { "UPDATE_CLIENT_PROPLIST", do_update_client_proplist, },
+	[COMMAND_REGISTER_MEMFD_SHMID] = { "REGISTER_MEMFD_SHMID", do_register_memfd_shmid, },
+	[COMMAND_SUBSCRIBE] = { "SUBSCRIBE", do_subscribe, },
+	[COMMAND_EXIT] = { "EXIT", do_error_access, },
+
+	[COMMAND_CREATE_PLAYBACK_STREAM] = { "CREATE_PLAYBACK_STREAM", do_create_playback_stream, },
+	[COMMAND_DELETE_PLAYBACK_STREAM] = { "DELETE_PLAYBACK_STREAM", do_delete_stream, },
+	[COMMAND_CREATE_RECORD_STREAM] = { "CREATE_RECORD_STREAM", do_create_record_stream, },
+	[COMMAND_DELETE_RECORD_STREAM] = { "DELETE_RECORD_STREAM", do_delete_stream, },
+	[COMMAND_DRAIN_PLAYBACK_STREAM] = { "DRAIN_PLAYBACK_STREAM", do_drain_stream, },
+	[COMMAND_CORK_PLAYBACK_STREAM] = { "CORK_PLAYBACK_STREAM", do_cork_stream, },
+	[COMMAND_CORK_RECORD_STREAM] = { "CORK_RECORD_STREAM", do_cork_stream, },
+	[COMMAND_FLUSH_PLAYBACK_STREAM] = { "FLUSH_PLAYBACK_STREAM", do_flush_trigger_prebuf_stream, },
+	[COMMAND_FLUSH_RECORD_STREAM] = { "FLUSH_RECORD_STREAM", do_flush_trigger_prebuf_stream, },
+	[COMMAND_TRIGGER_PLAYBACK_STREAM] = { "TRIGGER_PLAYBACK_STREAM", do_flush_trigger_prebuf_stream, },
+	[COMMAND_PREBUF_PLAYBACK_STREAM] = { "PREBUF_PLAYBACK_STREAM", do_flush_trigger_prebuf_stream, },
+	[COMMAND_SET_PLAYBACK_STREAM_BUFFER_ATTR] = { "SET_PLAYBACK_STREAM_BUFFER_ATTR", do_set_stream_buffer_attr, },
+	[COMMAND_SET_RECORD_STREAM_BUFFER_ATTR] = { "SET_RECORD_STREAM_BUFFER_ATTR", do_set_stream_buffer_attr, },
+	[COMMAND_UPDATE_PLAYBACK_STREAM_PROPLIST] = { "UPDATE_PLAYBACK_STREAM_PROPLIST", do_update_stream_proplist, },
+	[COMMAND_UPDATE_RECORD_STREAM_PROPLIST] = { "UPDATE_RECORD_STREAM_PROPLIST", do_update_stream_proplist, },
+	[COMMAND_SET_PLAYBACK_STREAM_NAME] = { "SET_PLAYBACK_STREAM_NAME", do_set_stream_name, },
+	[COMMAND_SET_RECORD_STREAM_NAME] = { "SET_RECORD_STREAM_NAME", do_set_stream_name, },
+	[COMMAND_GET_PLAYBACK_LATENCY] = { "GET_PLAYBACK_LATENCY", do_get_playback_latency, },
+	[COMMAND_GET_RECORD_LATENCY] = { "GET_RECORD_LATENCY", do_get_record_latency, },
+
+	[COMMAND_STAT] = { "STAT", do_stat, },
+	[COMMAND_GET_SERVER_INFO] = { "GET_SERVER_INFO", do_get_server_info, },
+	[COMMAND_LOOKUP_SINK] = { "LOOKUP_SINK", do_lookup, },
+	[COMMAND_LOOKUP_SOURCE] = { "LOOKUP_SOURCE", do_lookup, },
+	[COMMAND_GET_SINK_INFO] = { "GET_SINK_INFO", do_get_device_info, },
+	[COMMAND_GET_SOURCE_INFO] = { "GET_SOURCE_INFO", do_get_device_info, },
+	[COMMAND_GET_SINK_INFO_LIST] = { "GET_SINK_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_SOURCE_INFO_LIST] = { "GET_SOURCE_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_MODULE_INFO_LIST] = { "GET_MODULE_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_CLIENT_INFO_LIST] = { "GET_CLIENT_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_SINK_INPUT_INFO_LIST] = { "GET_SINK_INPUT_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_SOURCE_OUTPUT_INFO_LIST] = { "GET_SOURCE_OUTPUT_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_SAMPLE_INFO_LIST] = { "GET_SAMPLE_INFO_LIST", do_get_info_list, },
+	[COMMAND_GET_CARD_INFO_LIST] = { "GET_CARD_INFO_LIST", do_get_info_list, },
+};
+
+static int handle_packet(struct client *client, struct message *msg)
+{
+	uint32_t command, tag;
+	int res = 0;
+
+	if (message_get(msg,
+			TAG_U32, &command,
+			TAG_U32, &tag,
+			TAG_INVALID) < 0) {
+		res = -EPROTO;
+		goto finish;
+	}
+
+	pw_log_debug(NAME" %p: Received packet command %u tag %u",
+			client, command, tag);
+
+	if (command >= COMMAND_MAX) {
+		res = -EINVAL;
+		goto finish;
+	}
+	if (!client->authenticated && command != COMMAND_AUTH) {
+		res = reply_error(client, command, tag, -EACCES);
+		goto finish;
+	}
+	if (commands[command].run == NULL) {
+		pw_log_info(NAME" %p: command %u (%s) not implemented", client, command,
+				commands[command].name ? commands[command].name : "unknown");
+		res = reply_error(client, command, tag, -ENOSYS);
+		goto finish;
+	}
+
+	pw_log_debug(NAME" %p: command %s", client, commands[command].name);
+
+	if ((res = commands[command].run(client, command, tag, msg)) < 0)
+		res = reply_error(client, command, tag, res);
+
+finish:
+	return res;
+}
+
+static int handle_memblock(struct client *client, struct message *msg)
+{
+	struct stream *s;
+	const void *data;
+	uint32_t size, block_id = 0;
+	int64_t offset;
+	int32_t filled;
+	bool shm = SPA_FLAG_IS_SET(msg->flags, FLAG_SHMDATA);
+
+	if (shm) {
+		struct shm_pool *pool;
+		uint32_t info[SHM_MAX], i;
+
+		if (!client->shm || msg->length != sizeof(info))
+			return -EPROTO;
+
+		memcpy(info, msg->data, sizeof(info));
+		for (i = 0; i < SHM_MAX; i++)
+			info[i] = ntohl(info[i]);
+
+		block_id = info[SHM_BLOCK_ID];
+		pool = find_pool(client, info[SHM_ID],
+				SPA_FLAG_IS_SET(msg->flags, FLAG_SHMDATA_MEMFD_BLOCK));
+		if (pool == NULL || info[SHM_OFFSET] > pool->size ||
+		    info[SHM_LENGTH] > pool->size - info[SHM_OFFSET]) {
+			pw_log_warn(NAME" %p: invalid shm block id:%u shm:%u offset:%u length:%u",
+					client, block_id, info[SHM_ID],
+					info[SHM_OFFSET], info[SHM_LENGTH]);
+			goto release;
+		}
+		data = SPA_MEMBER(pool->ptr, info[SHM_OFFSET], void);
+		size = info[SHM_LENGTH];
+	} else {
+		data = msg->data;
+		size = msg->length;
+	}
+
+	s = find_stream(client, msg->channel, PW_DIRECTION_OUTPUT);
+	if (s == NULL) {
+		pw_log_warn(NAME" %p: unknown channel %u", client, msg->channel);
+		goto release;
+	}
+
+	offset = (int64_t) (((uint64_t) msg->offset_hi) << 32 | msg->offset_lo);
+	if ((msg->flags & FLAG_SEEKMASK) != SEEK_RELATIVE || offset != 0)
+		pw_log_debug(NAME" %p: channel:%u seek mode:%u offset:%"PRIi64" ignored",
+				s, s->channel, msg->flags & FLAG_SEEKMASK, offset);
+
+	pw_log_trace(NAME" %p: channel:%u received memblock of %u bytes shm:%d",
+			s, s->channel, size, shm);
+
+	filled = pw_stream_write(s->stream, data, size);
+	if (filled >= 0 && (uint32_t)filled < size) {
+		pw_log_warn(NAME" %p: channel:%u overrun, dropped %u bytes",
+				s, s->channel, size - filled);
+		send_command_channel(s, COMMAND_OVERFLOW);
+	}
+	s->write_index += size;
+	s->requested -= SPA_MIN(size, s->requested);
+
+	stream_check_prebuf(s);
+
+release:
+	/* the data is copied, the client can reuse the block */
+	if (shm)
+		send_release(client, block_id);
+	return 0;
+}
+
+static int handle_message(struct client *client, struct message *msg)
+{
+	uint32_t shm = msg->flags & FLAG_SHMMASK;
+
+	if (shm == FLAG_SHMRELEASE || shm == FLAG_SHMREVOKE) {
+		/* we don't export blocks and copy the imported ones right
+		 * away, nothing to do */
+		return 0;
+	}
+	if (msg->channel == (uint32_t) -1)
+		return handle_packet(client, msg);
+
+	return handle_memblock(client, msg);
+}
+
+static void client_free(struct client *client)
+{
+	struct impl *impl = client->impl;
+	struct message *msg;
+	union pw_map_item *item;
+	uint32_t i;
+
+	pw_log_info(NAME" %p: client free", client);
+
+	spa_list_remove(&client->link);
+
+	pw_array_for_each(item, &client->streams.items) {
+		if (!pw_map_item_is_free(item))
+			stream_free(item->data);
+	}
+	pw_map_clear(&client->streams);
+
+	spa_list_consume(msg, &client->out_messages, link)
+		message_free(client, msg, true, false);
+	if (client->message)
+		message_free(client, client->message, false, false);
+
+	if (client->remote) {
+		spa_hook_remove(&client->remote_listener);
+		pw_remote_destroy(client->remote);
+	}
+	for (i = 0; i < client->n_fds; i++)
+		close(client->fds[i]);
+	for (i = 0; i < client->n_pools; i++)
+		munmap(client->pools[i].ptr, client->pools[i].size);
+	if (client->source)
+		pw_loop_destroy_source(impl->loop, client->source);
+	if (client->props)
+		pw_properties_free(client->props);
+	free(client);
+}
+
+static int do_read(struct client *client)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
+	void *data;
+	size_t size;
+	ssize_t r;
+	int res = 0;
+
+	if (client->in_index < DESCRIPTOR_SIZE) {
+		data = SPA_MEMBER(client->desc, client->in_index, void);
+		size = DESCRIPTOR_SIZE - client->in_index;
+	} else {
+		uint32_t idx = client->in_index - DESCRIPTOR_SIZE;
+
+		if (client->message == NULL) {
+			res = -EPROTO;
+			goto exit;
+		}
+		data = SPA_MEMBER(client->message->data, idx, void);
+		size = client->message->length - idx;
+	}
+
+	iov.iov_base = data;
+	iov.iov_len = size;
+	spa_zero(msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	while (true) {
+		if ((r = recvmsg(client->source->fd, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT)) < 0) {
+			if (errno == EINTR)
+				continue;
+			res = -errno;
+			if (res != -EAGAIN && res != -EWOULDBLOCK)
+				pw_log_warn(NAME" %p: recv client:%p res %zd: %m", client, client, r);
+			goto exit;
+		}
+		break;
+	}
+	if (r == 0) {
+		res = -EPIPE;
+		goto exit;
+	}
+
+	/* file descriptors are only sent along with REGISTER_MEMFD_SHMID,
+	 * keep them until the message is handled */
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		uint32_t i, n;
+		int *fds;
+
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		fds = (int*)CMSG_DATA(cmsg);
+		for (i = 0; i < n; i++) {
+			if (client->n_fds < MAX_FDS)
+				client->fds[client->n_fds++] = fds[i];
+			else
+				close(fds[i]);
+		}
+	}
+
+	client->in_index += r;
+
+	if (client->in_index == DESCRIPTOR_SIZE) {
+		uint32_t length, flags;
+
+		length = ntohl(client->desc[DESC_LENGTH]);
+		flags = ntohl(client->desc[DESC_FLAGS]);
+
+		if (length > MAX_FRAME_SIZE) {
+			pw_log_warn(NAME" %p: frame of %u bytes is too big", client, length);
+			res = -EPROTO;
+			goto exit;
+		}
+		if ((flags & FLAG_SHMMASK) != 0 && !client->shm) {
+			pw_log_warn(NAME" %p: shm frame without shm enabled", client);
+			res = -EPROTO;
+			goto exit;
+		}
+
+		if (client->message)
+			message_free(client, client->message, false, false);
+		client->message = message_alloc(client, ntohl(client->desc[DESC_CHANNEL]), length);
+		if (client->message == NULL) {
+			res = -errno;
+			goto exit;
+		}
+		client->message->length = length;
+		client->message->offset_hi = ntohl(client->desc[DESC_OFFSET_HI]);
+		client->message->offset_lo = ntohl(client->desc[DESC_OFFSET_LO]);
+		client->message->flags = flags;
+	}
+
+	if (client->in_index >= DESCRIPTOR_SIZE &&
+	    client->message != NULL &&
+	    client->in_index == client->message->length + DESCRIPTOR_SIZE) {
+		struct message *m = client->message;
+
+		client->message = NULL;
+		client->in_index = 0;
+
+		res = handle_message(client, m);
+
+		message_free(client, m, false, false);
+	}
+exit:
+	return res;
+}
+
+static void
+on_client_data(void *data, int fd, uint32_t mask)
+{
+	struct client *client = data;
+	struct impl *impl = client->impl;
+	int res;
+
+	if (mask & SPA_IO_HUP) {
+		res = -EPIPE;
+		goto error;
+	}
+	if (mask & SPA_IO_ERR) {
+		res = -EIO;
+		goto error;
+	}
+	if (mask & SPA_IO_OUT) {
+		pw_log_trace(NAME" %p: can write", client);
+		res = flush_messages(client);
+		if (res >= 0) {
+			pw_loop_update_io(impl->loop, client->source,
+					client->source->mask & ~SPA_IO_OUT);
+		} else if (res != -EAGAIN && res != -EWOULDBLOCK)
+			goto error;
+	}
+	if (mask & SPA_IO_IN) {
+		pw_log_trace(NAME" %p: can read", client);
+		while (true) {
+			res = do_read(client);
+			if (res < 0)
+				break;
+		}
+		if (res != -EAGAIN && res != -EWOULDBLOCK)
+			goto error;
+	}
+	return;
+
+error:
+	if (res == -EPIPE)
+		pw_log_info(NAME" %p: client %p disconnected", impl, client);
+	else
+		pw_log_error(NAME" %p: client %p error %d (%s)", impl,
+				client, res, spa_strerror(res));
+	client_free(client);
+}
+
+static void on_remote_state_changed(void *data, enum pw_remote_state old,
+		enum pw_remote_state state, const char *error)
+{
+	struct client *client = data;
+
+	if (state == PW_REMOTE_STATE_ERROR ||
+	    (state == PW_REMOTE_STATE_UNCONNECTED && old != PW_REMOTE_STATE_UNCONNECTED)) {
+		pw_log_warn(NAME" %p: remote %s: %s", client,
+				pw_remote_state_as_string(state), error ? error : "");
+		/* we can't free the client from the remote callback,
+		 * let the socket hang up and clean up from there */
+		shutdown(client->source->fd, SHUT_RDWR);
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_remote_state_changed,
+};
+
+static void
+on_connect(void *data, int fd, uint32_t mask)
+{
+	struct server *server = data;
+	struct impl *impl = server->impl;
+	struct sockaddr_un name;
+	socklen_t length;
+	int client_fd, res;
+	struct client *client;
+
+	length = sizeof(name);
+	client_fd = accept4(fd, (struct sockaddr *) &name, &length, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (client_fd < 0) {
+		pw_log_error(NAME" %p: failed to accept: %m", impl);
+		return;
+	}
+
+	client = calloc(1, sizeof(struct client));
+	if (client == NULL)
+		goto error;
+
+	client->impl = impl;
+	client->server = server;
+	client->index = impl->client_index++;
+	spa_list_init(&client->out_messages);
+	pw_map_init(&client->streams, 16, 16);
+	spa_list_append(&server->clients, &client->link);
+
+	client->props = pw_properties_new(
+			PW_KEY_CLIENT_API, "pipewire-pulse",
+			NULL);
+	if (client->props == NULL)
+		goto error;
+
+	client->source = pw_loop_add_io(impl->loop,
+					client_fd,
+					SPA_IO_ERR | SPA_IO_HUP | SPA_IO_IN,
+					true, on_client_data, client);
+	if (client->source == NULL)
+		goto error;
+	client_fd = -1;
+
+	/* each client gets its own connection to the daemon, its streams
+	 * are owned by it and go away with it */
+	client->remote = pw_remote_new(impl->core, pw_properties_copy(client->props), 0);
+	if (client->remote == NULL)
+		goto error;
+
+	pw_remote_add_listener(client->remote, &client->remote_listener,
+			&remote_events, client);
+
+	if ((res = pw_remote_connect(client->remote)) < 0) {
+		errno = -res;
+		goto error;
+	}
+	pw_log_info(NAME" %p: new client %p fd:%d", impl, client, client->source->fd);
+	return;
+
+error:
+	pw_log_error(NAME" %p: failed to create client: %m", impl);
+	if (client_fd >= 0)
+		close(client_fd);
+	if (client)
+		client_free(client);
+}
+
+static bool socket_in_use(const struct sockaddr_un *addr)
+{
+	socklen_t size;
+	bool in_use;
+	int fd;
+
+	if ((fd = socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return false;
+
+	size = offsetof(struct sockaddr_un, sun_path) + strlen(addr->sun_path);
+	in_use = connect(fd, (const struct sockaddr *) addr, size) == 0 ||
+		errno == EAGAIN || errno == EINPROGRESS;
+	close(fd);
+	return in_use;
+}
+
+static int make_local_socket(struct server *server, const char *name)
+{
+	const char *runtime_dir;
+	socklen_t size;
+	int name_size, fd, res;
+	struct stat socket_stat;
+
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL) {
+		pw_log_error(NAME" %p: XDG_RUNTIME_DIR not set in the environment", server);
+		return -EIO;
+	}
+
+	/* PulseAudio clients look for $XDG_RUNTIME_DIR/pulse/native */
+	server->addr.sun_family = AF_LOCAL;
+	name_size = snprintf(server->addr.sun_path, sizeof(server->addr.sun_path),
+			     "%s/pulse", runtime_dir) + 1;
+	if (name_size > (int) sizeof(server->addr.sun_path))
+		return -ENAMETOOLONG;
+	if (mkdir(server->addr.sun_path, 0700) < 0 && errno != EEXIST) {
+		res = -errno;
+		pw_log_error(NAME" %p: mkdir %s failed: %m", server, server->addr.sun_path);
+		return res;
+	}
+
+	name_size = snprintf(server->addr.sun_path, sizeof(server->addr.sun_path),
+			     "%s/pulse/%s", runtime_dir, name) + 1;
+	if (name_size > (int) sizeof(server->addr.sun_path)) {
+		pw_log_error(NAME" %p: socket path \"%s/pulse/%s\" plus null terminator exceeds 108 bytes",
+				server, runtime_dir, name);
+		*server->addr.sun_path = 0;
+		return -ENAMETOOLONG;
+	}
+
+	if ((fd = socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0) {
+		res = -errno;
+		goto error;
+	}
+	if (stat(server->addr.sun_path, &socket_stat) < 0) {
+		if (errno != ENOENT) {
+			res = -errno;
+			pw_log_error(NAME" %p: stat %s failed with error: %m",
+					server, server->addr.sun_path);
+			goto error_close;
+		}
+	} else {
+		/* don't steal the socket of a running PulseAudio */
+		if (socket_in_use(&server->addr)) {
+			res = -EADDRINUSE;
+			pw_log_error(NAME" %p: %s is in use, is another server running?",
+					server, server->addr.sun_path);
+			*server->addr.sun_path = 0;
+			goto error_close;
+		}
+		if (socket_stat.st_mode & S_IWUSR || socket_stat.st_mode & S_IWGRP)
+			unlink(server->addr.sun_path);
+	}
+
+	size = offsetof(struct sockaddr_un, sun_path) + strlen(server->addr.sun_path);
+	if (bind(fd, (struct sockaddr *) &server->addr, size) < 0) {
+		res = -errno;
+		pw_log_error(NAME" %p: bind() failed with error: %m", server);
+		goto error_close;
+	}
+	if (listen(fd, 128) < 0) {
+		res = -errno;
+		pw_log_error(NAME" %p: listen() failed with error: %m", server);
+		goto error_close;
+	}
+	return fd;
+
+error_close:
+	close(fd);
+error:
+	return res;
+}
+
+static void server_free(struct server *server)
+{
+	struct impl *impl = server->impl;
+	struct client *c;
+
+	spa_list_remove(&server->link);
+	spa_list_consume(c, &server->clients, link)
+		client_free(c);
+	if (server->source)
+		pw_loop_destroy_source(impl->loop, server->source);
+	if (server->addr.sun_path[0])
+		unlink(server->addr.sun_path);
+	free(server);
+}
+
+static struct server *create_server(struct impl *impl, const char *address)
+{
+	struct server *server;
+	int fd, res;
+
+	server = calloc(1, sizeof(struct server));
+	if (server == NULL)
+		return NULL;
+
+	server->impl = impl;
+	spa_list_init(&server->clients);
+	spa_list_append(&impl->servers, &server->link);
+
+	if (strstr(address, "unix:") == address) {
+		fd = make_local_socket(server, address+5);
+	} else {
+		pw_log_error(NAME" %p: unsupported address %s", impl, address);
+		fd = -EINVAL;
+	}
+	if (fd < 0) {
+		res = fd;
+		goto error;
+	}
+	server->source = pw_loop_add_io(impl->loop, fd, SPA_IO_IN, true, on_connect, server);
+	if (server->source == NULL) {
+		res = -errno;
+		pw_log_error(NAME" %p: can't create server source: %m", impl);
+		close(fd);
+		goto error;
+	}
+	pw_log_info(NAME" %p: listening on %s", impl, server->addr.sun_path);
+	return server;
+
+error:
+	*server->addr.sun_path = 0;
+	server_free(server);
+	errno = -res;
+	return NULL;
+}
+
+struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_core *core,
+		struct pw_properties *props, size_t user_data_size)
+{
+	struct impl *impl;
+	const char *str;
+	int res;
+
+	impl = calloc(1, sizeof(struct impl) + user_data_size);
+	if (impl == NULL) {
+		res = -errno;
+		goto error_free_props;
+	}
+
+	impl->core = core;
+	impl->loop = pw_core_get_main_loop(core);
+	impl->props = props;
+	impl->cookie = rand();
+	impl->default_spec = SAMPLE_SPEC_INIT;
+	channel_map_init_default(&impl->default_map, impl->default_spec.channels);
+	spa_list_init(&impl->servers);
+	spa_list_init(&impl->free_messages);
+
+	/* the buffer attributes for clients that leave them to the server */
+	impl->default_tlength_msec = DEFAULT_TLENGTH_MSEC;
+	impl->default_minreq_msec = DEFAULT_PROCESS_MSEC;
+	impl->default_fragsize_msec = DEFAULT_FRAGSIZE_MSEC;
+	if (props) {
+		if ((str = pw_properties_get(props, "pulse.default.tlength")) != NULL)
+			impl->default_tlength_msec = SPA_MAX(atoi(str), 1);
+		if ((str = pw_properties_get(props, "pulse.default.minreq")) != NULL)
+			impl->default_minreq_msec = SPA_MAX(atoi(str), 1);
+		if ((str = pw_properties_get(props, "pulse.default.prebuf")) != NULL)
+			impl->default_prebuf_msec = SPA_MAX(atoi(str), 0);
+		if ((str = pw_properties_get(props, "pulse.default.fragsize")) != NULL)
+			impl->default_fragsize_msec = SPA_MAX(atoi(str), 1);
+	}
+
+	str = props ? pw_properties_get(props, "server.address") : NULL;
+	if (str == NULL)
+		str = DEFAULT_SERVER;
+
+	if (create_server(impl, str) == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+	return (struct pw_protocol_pulse*)impl;
+
+error_free:
+	free(impl);
+error_free_props:
+	if (props)
+		pw_properties_free(props);
+	errno = -res;
+	return NULL;
+}
+
+void *pw_protocol_pulse_get_user_data(struct pw_protocol_pulse *pulse)
+{
+	return SPA_MEMBER(pulse, sizeof(struct impl), void);
+}
+
+void pw_protocol_pulse_destroy(struct pw_protocol_pulse *pulse)
+{
+	struct impl *impl = (struct impl*)pulse;
+	struct server *s;
+	struct message *msg;
+
+	spa_list_consume(s, &impl->servers, link)
+		server_free(s);
+
+	spa_list_consume(msg, &impl->free_messages, link) {
+		spa_list_remove(&msg->link);
+		free(msg->data);
+		free(msg);
+	}
+	if (impl->props)
+		pw_properties_free(impl->props);
+	free(impl);
+}
@@ -41,6 +41,7 @@
 #include <spa/utils/result.h>
 
 #include <pipewire/pipewire.h>
+#include "pipewire/private.h"
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -48,11 +49,16 @@ static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
+struct rt_source {
+	struct spa_loop *loop;
+	struct spa_source source;
+};
+
 struct impl {
 	struct pw_core *core;
 
-	struct spa_loop *loop;
-	struct spa_source source;
+	struct rt_source sources[PW_CORE_MAX_DATA_LOOPS];
+	uint32_t n_sources;
 
 	struct spa_hook module_listener;
 };
@@ -397,23 +403,31 @@ static int do_remove_source(struct spa_loop *loop,
 	return 0;
 }
 
-static void module_destroy(void *data)
+static void remove_sources(struct impl *impl)
 {
-	struct impl *impl = data;
+	uint32_t i;
 
-	spa_hook_remove(&impl->module_listener);
+	for (i = 0; i < impl->n_sources; i++) {
+		struct rt_source *s = &impl->sources[i];
 
-	if (impl->source.fd != -1) {
-		spa_loop_invoke(impl->loop,
+		spa_loop_invoke(s->loop,
 				do_remove_source,
 				SPA_ID_INVALID,
 				NULL,
 				0,
 				true,
-				&impl->source);
-		close(impl->source.fd);
-		impl->source.fd = -1;
+				&s->source);
+		close(s->source.fd);
 	}
+	impl->n_sources = 0;
+}
+
+static void module_destroy(void *data)
+{
+	struct impl *impl = data;
+
+	spa_hook_remove(&impl->module_listener);
+	remove_sources(impl);
 	free(impl);
 }
 
@@ -422,17 +436,15 @@ static const struct pw_module_events module_events = {
 	.destroy = module_destroy,
 };
 
-static void idle_func(struct spa_source *source)
+/* make a thread of this process realtime, with the scheduler when we are
+ * allowed to and else with RTKit, which takes the thread id */
+static void make_realtime(struct impl *impl, pthread_t thread, pid_t tid)
 {
-	struct impl *impl = source->data;
 	struct sched_param sp;
 	struct pw_rtkit_bus *system_bus;
 	struct rlimit rl;
 	int r, rtprio;
 	long long rttime;
-	uint64_t count;
-
-	read(impl->source.fd, &count, sizeof(uint64_t));
 
 	rtprio = 20;
 	rttime = 20000;
@@ -440,7 +452,7 @@ static void idle_func(struct spa_source *source)
 	spa_zero(sp);
 	sp.sched_priority = rtprio;
 
-	if (pthread_setschedparam(pthread_self(), SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
+	if (pthread_setschedparam(thread, SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
 		pw_log_debug("SCHED_OTHER|SCHED_RESET_ON_FORK worked.");
 		return;
 	}
@@ -464,29 +476,54 @@ static void idle_func(struct spa_source *source)
 		}
 	}
 
-	if ((r = pw_rtkit_make_realtime(system_bus, 0, rtprio)) < 0) {
-		pw_log_debug("could not make thread realtime: %s", spa_strerror(r));
+	if ((r = pw_rtkit_make_realtime(system_bus, tid, rtprio)) < 0) {
+		pw_log_debug("could not make thread %d realtime: %s", tid, spa_strerror(r));
 	} else {
-		pw_log_debug("thread made realtime");
+		pw_log_debug("thread %d made realtime", tid);
 	}
 	pw_rtkit_bus_free(system_bus);
 }
 
+/* runs in the thread of the data loop */
+static void idle_func(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	uint64_t count;
+
+	read(source->fd, &count, sizeof(uint64_t));
+
+	make_realtime(impl, pthread_self(), 0);
+}
+
+static int add_loop(struct impl *impl, struct spa_loop *loop)
+{
+	struct rt_source *s = &impl->sources[impl->n_sources];
+
+	s->loop = loop;
+	s->source.loop = loop;
+	s->source.func = idle_func;
+	s->source.data = impl;
+	s->source.fd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+	s->source.mask = SPA_IO_IN;
+	if (s->source.fd == -1)
+		return -errno;
+
+	spa_loop_add_source(loop, &s->source);
+	impl->n_sources++;
+	return 0;
+}
+
 SPA_EXPORT
 int pipewire__module_init(struct pw_module *module, const char *args)
 {
 	struct pw_core *core = pw_module_get_core(module);
+	struct pw_worker_pool *pool = core->worker_pool;
 	struct impl *impl;
-	struct spa_loop *loop;
-	const struct spa_support *support;
-	uint32_t n_support;
+	uint32_t i;
 	int res;
 
-	support = pw_core_get_support(core, &n_support);
-
-	loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
-        if (loop == NULL)
-                return -ENOTSUP;
+	if (core->n_data_loops == 0)
+		return -ENOTSUP;
 
 	impl = calloc(1, sizeof(struct impl));
 	if (impl == NULL)
@@ -495,19 +532,15 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 	pw_log_debug("module %p: new", impl);
 
 	impl->core = core;
-	impl->loop = loop;
-
-	impl->source.loop = loop;
-	impl->source.func = idle_func;
-	impl->source.data = impl;
-	impl->source.fd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
-	impl->source.mask = SPA_IO_IN;
-	if (impl->source.fd == -1) {
-		res = -errno;
-		goto error;
-	}
 
-	spa_loop_add_source(impl->loop, &impl->source);
+	/* the data loop threads make themselves realtime */
+	for (i = 0; i < core->n_data_loops; i++) {
+		if ((res = add_loop(impl, core->data_loops[i]->loop->loop)) < 0)
+			goto error;
+	}
+	/* the workers of the pool, worker 0 is the data loop thread */
+	for (i = 1; pool && i < pool->n_workers; i++)
+		make_realtime(impl, pool->workers[i]->thread, pool->workers[i]->tid);
 
 	pw_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
@@ -516,6 +549,7 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 	return 0;
 
 error:
+	remove_sources(impl);
 	free(impl);
 	return res;
 }
@@ -41,14 +41,168 @@
 #define MAX_ALIGN	32
 #define MAX_BUFFERS	64
 
+#define DEFAULT_POOL_SIZE	(16u * 1024u * 1024u)
+#define MAX_POOL_OWNER		2
+
+/** Shared buffer memory kept in the core after the buffers were cleared.
+ * Memory is only reused for the same owner and only when no client
+ * imports it anymore, so that old peers can't see the new data. */
+struct buffer_mem {
+	struct spa_list link;
+	const struct pw_buffers *owner;
+	struct pw_memblock *mem;
+	int32_t numa_node;
+};
+
 struct port {
 	struct spa_node *node;
 	enum spa_direction direction;
 	uint32_t port_id;
 };
 
+/* sizes are rounded up to a power of two so that small changes in the
+ * format can reuse the same memory */
+static uint32_t size_class(uint32_t size)
+{
+	uint32_t s = 4096;
+	while (s < size && s < 0x80000000u)
+		s <<= 1;
+	return SPA_MAX(s, size);
+}
+
+static size_t get_pool_size(struct pw_core *core)
+{
+	const char *str;
+	if ((str = pw_properties_get(core->properties, "link.buffer-pool-size")) != NULL)
+		return pw_properties_parse_uint64(str);
+	return DEFAULT_POOL_SIZE;
+}
+
+static void pool_free(struct pw_core *core, struct buffer_mem *bm)
+{
+	pw_log_debug(NAME" %p: free mem %p size:%u", bm->owner, bm->mem, bm->mem->size);
+	spa_list_remove(&bm->link);
+	core->buffer_mem_size -= bm->mem->size;
+	pw_memblock_unref(bm->mem);
+	free(bm);
+}
+
+static struct pw_memblock *pool_get(struct pw_core *core,
+		const struct pw_buffers *owner, uint32_t size, int32_t numa_node)
+{
+	struct buffer_mem *bm;
+	struct pw_memblock *mem;
+
+	spa_list_for_each(bm, &core->buffer_mem, link) {
+		if (bm->owner != owner || bm->mem->size != size ||
+		    bm->numa_node != numa_node ||
+		    pw_memblock_is_imported(bm->mem))
+			continue;
+
+		mem = bm->mem;
+		pw_log_debug(NAME" %p: reuse mem %p size:%u", owner, mem, size);
+		spa_list_remove(&bm->link);
+		core->buffer_mem_size -= size;
+		free(bm);
+		return mem;
+	}
+	return NULL;
+}
+
+static void pool_put(struct pw_core *core,
+		const struct pw_buffers *owner, struct pw_memblock *mem,
+		int32_t numa_node)
+{
+	struct buffer_mem *bm, *t;
+	size_t max_size = get_pool_size(core);
+	uint32_t n_owner = 0;
+
+	if (mem->size > max_size ||
+	    (bm = calloc(1, sizeof(struct buffer_mem))) == NULL) {
+		pw_memblock_unref(mem);
+		return;
+	}
+	pw_log_debug(NAME" %p: recycle mem %p size:%u", owner, mem, mem->size);
+
+	bm->owner = owner;
+	bm->mem = mem;
+	bm->numa_node = numa_node;
+	spa_list_prepend(&core->buffer_mem, &bm->link);
+	core->buffer_mem_size += mem->size;
+
+	/* keep the most recent sizes of the owner and stay within budget */
+	spa_list_for_each_safe(bm, t, &core->buffer_mem, link) {
+		if (bm->owner == owner && ++n_owner > MAX_POOL_OWNER)
+			pool_free(core, bm);
+	}
+	while (core->buffer_mem_size > max_size) {
+		bm = spa_list_last(&core->buffer_mem, struct buffer_mem, link);
+		pool_free(core, bm);
+	}
+}
+
+void pw_buffers_pool_clear(struct pw_core *core)
+{
+	struct buffer_mem *bm;
+
+	spa_list_consume(bm, &core->buffer_mem, link)
+		pool_free(core, bm);
+}
+
+static void free_dmabufs(struct pw_buffers *allocation)
+{
+	uint32_t i;
+
+	for (i = 0; i < allocation->n_data_mems; i++)
+		pw_memblock_unref(allocation->data_mems[i]);
+	free(allocation->data_mems);
+	allocation->data_mems = NULL;
+	allocation->n_data_mems = 0;
+}
+
+/* Allocate a dmabuf for each data of the buffers */
+static int alloc_dmabufs(struct pw_core *core, struct pw_buffers *allocation,
+		struct spa_buffer **buffers, uint32_t n_buffers, uint32_t *data_sizes)
+{
+	uint32_t i, j, n_datas;
+	struct pw_memblock *m;
+
+	if (n_buffers == 0)
+		return 0;
+
+	n_datas = buffers[0]->n_datas;
+	allocation->data_mems = calloc(n_buffers * n_datas, sizeof(struct pw_memblock *));
+	if (allocation->data_mems == NULL)
+		return -errno;
+
+	for (i = 0; i < n_buffers; i++) {
+		for (j = 0; j < n_datas; j++) {
+			struct spa_data *d = &buffers[i]->datas[j];
+
+			if (d->type != SPA_DATA_DmaBuf)
+				continue;
+
+			m = pw_mempool_alloc(core->pool, PW_MEMBLOCK_FLAG_READWRITE,
+					SPA_DATA_DmaBuf, data_sizes[j]);
+			if (m == NULL) {
+				int res = -errno;
+				free_dmabufs(allocation);
+				return res;
+			}
+			allocation->data_mems[allocation->n_data_mems++] = m;
+
+			d->fd = m->fd;
+			d->mapoffset = 0;
+			d->maxsize = data_sizes[j];
+			d->data = NULL;
+		}
+	}
+	pw_log_debug(NAME" %p: allocated %u dmabufs", allocation, allocation->n_data_mems);
+	return 0;
+}
+
 /* Allocate an array of buffers that can be shared */
-static int alloc_buffers(struct pw_mempool *pool,
+static int alloc_buffers(struct pw_core *core,
 			 uint32_t n_buffers,
 			 uint32_t n_params,
 			 struct spa_pod **params,
@@ -62,6 +216,7 @@ static int alloc_buffers(struct pw_mempool *pool,
 	struct spa_buffer **buffers;
 	void *skel, *data;
 	uint32_t i;
+	int res;
 	uint32_t n_metas;
 	struct spa_meta *metas;
 	struct spa_data *datas;
@@ -99,7 +254,12 @@ static int alloc_buffers(struct pw_mempool *pool,
 		struct spa_data *d = &datas[i];
 
 		spa_zero(*d);
-		if (data_sizes[i] > 0) {
+		if (data_sizes[i] > 0 && SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_DMABUF)) {
+			/* the data lives in separate dmabufs, nothing in the layout */
+			d->type = SPA_DATA_DmaBuf;
+			d->maxsize = 0;
+			SPA_FLAG_SET(d->flags, SPA_DATA_FLAG_READWRITE);
+		} else if (data_sizes[i] > 0) {
 			d->type = SPA_DATA_MemPtr;
 			d->maxsize = data_sizes[i];
 			SPA_FLAG_SET(d->flags, SPA_DATA_FLAG_READWRITE);
@@ -121,29 +281,55 @@ static int alloc_buffers(struct pw_mempool *pool,
 	skel = SPA_PTR_ALIGN(skel, info.max_align, void);
 
 	if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_SHARED)) {
+		uint32_t size = size_class(n_buffers * info.mem_size);
+		int32_t node = SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_NUMA) ?
+			allocation->numa_node : -1;
+
 		/* pointer to buffer structures */
-		m = pw_mempool_alloc(pool,
-				PW_MEMBLOCK_FLAG_READWRITE |
-				PW_MEMBLOCK_FLAG_SEAL |
-				PW_MEMBLOCK_FLAG_MAP,
-				SPA_DATA_MemFd,
-				n_buffers * info.mem_size);
-		if (m == NULL)
-			return -errno;
+		m = pool_get(core, allocation, size, node);
+		if (m == NULL) {
+			m = pw_mempool_alloc(core->pool,
+					PW_MEMBLOCK_FLAG_READWRITE |
+					PW_MEMBLOCK_FLAG_SEAL |
+					PW_MEMBLOCK_FLAG_MAP,
+					SPA_DATA_MemFd,
+					size);
+			if (m == NULL) {
+				free(buffers);
+				return -errno;
+			}
+			/* before the layout touches the pages */
+			if (node >= 0 && (res = pw_memblock_set_numa_node(m, node)) < 0) {
+				pw_log_warn(NAME" %p: can't place memory on numa node %d: %s",
+						allocation, node, spa_strerror(res));
+				node = -1;
+			}
+		}
+		allocation->numa_node = node;
 
 		data = m->map->ptr;
 	} else {
 		m = NULL;
 		data = NULL;
+		allocation->numa_node = -1;
 	}
 
 	pw_log_debug(NAME" %p: layout buffers skel:%p data:%p", allocation, skel, data);
 	spa_buffer_alloc_layout_array(&info, n_buffers, buffers, skel, data);
 
 	allocation->mem = m;
+	if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_DMABUF) &&
+	    (res = alloc_dmabufs(core, allocation, buffers, n_buffers, data_sizes)) < 0) {
+		if (m)
+			pw_memblock_unref(m);
+		allocation->mem = NULL;
+		free(buffers);
+		return res;
+	}
 	allocation->n_buffers = n_buffers;
 	allocation->buffers = buffers;
 	allocation->flags = flags;
+	allocation->core = core;
 
 	return 0;
 }
@@ -197,6 +383,28 @@ param_filter(struct pw_buffers *this,
 	return num;
 }
 
+/* the memory types the port can use, memory is assumed when it does
+ * not say */
+static uint32_t get_data_types(struct port *port)
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param;
+	uint32_t idx = 0;
+	int32_t types = (1 << SPA_DATA_MemPtr) | (1 << SPA_DATA_MemFd);
+
+	if (spa_node_port_enum_params_sync(port->node,
+				port->direction, port->port_id,
+				SPA_PARAM_Buffers, &idx, NULL, &param, &b) != 1)
+		return types;
+
+	spa_pod_fixate(param);
+	spa_pod_parse_object(param,
+			SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_OPT_Int(&types));
+	return types;
+}
+
 static struct spa_pod *find_param(struct spa_pod **params, uint32_t n_params, uint32_t type)
 {
 	uint32_t i;
@@ -208,6 +416,44 @@ static struct spa_pod *find_param(struct spa_pod **params, uint32_t n_params, ui
 	return NULL;
 }
 
+/* the lower bound of the number of buffers before fixation */
+static uint32_t get_min_buffers(const struct spa_pod *param)
+{
+	const struct spa_pod_prop *prop;
+	const struct spa_pod *vals;
+	uint32_t n_vals, choice;
+
+	prop = spa_pod_find_prop(param, NULL, SPA_PARAM_BUFFERS_buffers);
+	if (prop == NULL)
+		return 0;
+
+	vals = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	if (vals->type != SPA_TYPE_Int)
+		return 0;
+	if (choice == SPA_CHOICE_Range && n_vals >= 3)
+		return ((const int32_t *)SPA_POD_BODY_CONST(vals))[1];
+	return SPA_POD_VALUE(struct spa_pod_int, vals);
+}
+
+/* the upper bound of the number of buffers before fixation */
+static uint32_t get_max_buffers(const struct spa_pod *param)
+{
+	const struct spa_pod_prop *prop;
+	const struct spa_pod *vals;
+	uint32_t n_vals, choice;
+
+	prop = spa_pod_find_prop(param, NULL, SPA_PARAM_BUFFERS_buffers);
+	if (prop == NULL)
+		return 0;
+
+	vals = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	if (vals->type != SPA_TYPE_Int)
+		return 0;
+	if (choice == SPA_CHOICE_Range && n_vals >= 3)
+		return ((const int32_t *)SPA_POD_BODY_CONST(vals))[2];
+	return SPA_POD_VALUE(struct spa_pod_int, vals);
+}
+
 SPA_EXPORT
 int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 		struct spa_node *outnode, uint32_t out_port_id,
@@ -218,7 +464,7 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 	uint8_t buffer[4096];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 	uint32_t i, offset, n_params;
-	uint32_t max_buffers;
+	uint32_t max_buffers, range_min = 0, range_max = 0;
 	size_t minsize, stride, align;
 	uint32_t data_sizes[1];
 	int32_t data_strides[1];
@@ -234,6 +480,11 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 	params = alloca(n_params * sizeof(struct spa_pod *));
 	for (i = 0, offset = 0; i < n_params; i++) {
 		params[i] = SPA_MEMBER(buffer, offset, struct spa_pod);
+		if (range_max == 0 &&
+		    spa_pod_is_object_type(params[i], SPA_TYPE_OBJECT_ParamBuffers)) {
+			range_min = get_min_buffers(params[i]);
+			range_max = get_max_buffers(params[i]);
+		}
 		spa_pod_fixate(params[i]);
 		pw_log_debug(NAME" %p: fixated param %d:", result, i);
 		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
@@ -264,6 +515,14 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(&qstride),
 			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(&qalign));
 
+		/* the requested number, as far as both ports accept it */
+		if (result->target_buffers > 0 && qmax_buffers > 0)
+			qmax_buffers = SPA_CLAMP(result->target_buffers,
+					SPA_MAX(range_min, 1u), SPA_MAX(range_max, qmax_buffers));
+		/* extra buffers go up to what both ports accept */
+		if (result->extra_buffers > 0 && qmax_buffers > 0)
+			qmax_buffers = SPA_MIN(qmax_buffers + result->extra_buffers,
+					SPA_MAX(range_max, qmax_buffers));
 		max_buffers =
 		    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
 						      max_buffers);
@@ -280,6 +539,8 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 		max_buffers = 4;
 	}
 
+	result->max_frames = stride > 0 ? minsize / stride : 0;
+
 	if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_NO_MEM))
 		minsize = 0;
 
@@ -287,7 +548,25 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 	data_strides[0] = stride;
 	data_aligns[0] = align;
 
-	if ((res = alloc_buffers(core->pool,
+	/* hand out dmabufs when both ports can use them */
+	if (SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_SHARED) && minsize > 0 &&
+	    (get_data_types(&output) & get_data_types(&input) & (1 << SPA_DATA_DmaBuf))) {
+		if ((res = alloc_buffers(core,
+					 max_buffers,
+					 n_params,
+					 params,
+					 1,
+					 data_sizes, data_strides,
+					 data_aligns,
+					 flags | PW_BUFFERS_FLAG_DMABUF,
+					 result)) >= 0)
+			return res;
+
+		pw_log_info(NAME" %p: can't alloc dmabufs, using shared memory: %s",
+				result, spa_strerror(res));
+	}
+
+	if ((res = alloc_buffers(core,
 				 max_buffers,
 				 n_params,
 				 params,
@@ -305,8 +584,39 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 SPA_EXPORT
 void pw_buffers_clear(struct pw_buffers *buffers)
 {
-	if (buffers->mem)
-		pw_memblock_unref(buffers->mem);
+	struct pw_core *core = buffers->core;
+
+	if (buffers->mem) {
+		if (core)
+			pool_put(core, buffers, buffers->mem, buffers->numa_node);
+		else
+			pw_memblock_unref(buffers->mem);
+	}
+	free_dmabufs(buffers);
 	free(buffers->buffers);
 	spa_zero(*buffers);
+	/* keep the core so that the recycled memory can be released */
+	buffers->core = core;
+	buffers->numa_node = -1;
+}
+
+SPA_EXPORT
+void pw_buffers_release(struct pw_buffers *buffers)
+{
+	struct pw_core *core = buffers->core;
+	struct buffer_mem *bm, *t;
+
+	if (buffers->mem)
+		pw_memblock_unref(buffers->mem);
+	buffers->mem = NULL;
+	pw_buffers_clear(buffers);
+	buffers->core = NULL;
+
+	if (core == NULL)
+		return;
+
+	spa_list_for_each_safe(bm, t, &core->buffer_mem, link) {
+		if (bm->owner == buffers)
+			pool_free(core, bm);
+	}
 }
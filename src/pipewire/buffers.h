@@ -38,12 +38,28 @@ extern "C" {
 #define PW_BUFFERS_FLAG_NO_MEM		(1<<0)	/**< don't allocate buffer memory */
 #define PW_BUFFERS_FLAG_SHARED		(1<<1)	/**< buffers can be shared */
 #define PW_BUFFERS_FLAG_DYNAMIC		(1<<2)	/**< buffers have dynamic data */
+#define PW_BUFFERS_FLAG_NUMA		(1<<3)	/**< place the memory on numa_node */
+#define PW_BUFFERS_FLAG_DMABUF		(1<<4)	/**< allocate the data in dmabufs */
 
 struct pw_buffers {
 	struct pw_memblock *mem;	/**< allocated buffer memory */
+	struct pw_memblock **data_mems;	/**< dmabufs of the buffer data */
+	uint32_t n_data_mems;		/**< number of dmabufs */
 	struct spa_buffer **buffers;	/**< port buffers */
 	uint32_t n_buffers;		/**< number of port buffers */
 	uint32_t flags;			/**< flags */
+	struct pw_core *core;		/**< core to recycle the memory in */
+	int32_t numa_node;		/**< NUMA node of the memory or -1, the
+					  *  preferred node with PW_BUFFERS_FLAG_NUMA */
+	uint32_t extra_buffers;		/**< buffers to add to the negotiated number,
+					  *  within the range of the ports. Set before
+					  *  negotiating */
+	uint32_t target_buffers;	/**< number of buffers to use instead of the
+					  *  default of the ports, within their range
+					  *  or 0. Set before negotiating */
+	uint32_t max_frames;		/**< frames that fit in a buffer, from the
+					  *  negotiated size and stride, 0 when
+					  *  unknown */
 };
 
 int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
@@ -51,8 +67,13 @@ int pw_buffers_negotiate(struct pw_core *core, uint32_t flags,
 		struct spa_node *innode, uint32_t in_port_id,
 		struct pw_buffers *result);
 
+/** Clear the buffers. Shared buffer memory is kept in the core so that
+ * it can be reused when the same buffers are negotiated again */
 void pw_buffers_clear(struct pw_buffers *buffers);
 
+/** Clear the buffers and free all memory recycled for them */
+void pw_buffers_release(struct pw_buffers *buffers);
+
 #ifdef __cplusplus
 }
 #endif
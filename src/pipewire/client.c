@@ -24,6 +24,8 @@
 
 #include <errno.h>
 #include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
 
 #include "pipewire/interfaces.h"
 #include "pipewire/client.h"
@@ -40,6 +42,9 @@ struct impl {
 	struct spa_hook core_listener;
 	struct pw_array permissions;
 	struct spa_hook pool_listener;
+	struct spa_source *mem_stats_event;	/**< updates the memory stats once
+						  *  after a batch of pool changes */
+	unsigned int mem_stats_pending:1;
 };
 
 #define pw_client_resource(r,m,v,...)		pw_resource_call(r,struct pw_client_proxy_events,m,v,__VA_ARGS__)
@@ -227,6 +232,34 @@ error_resource:
 	return -errno;
 }
 
+static void update_mem_stats(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct pw_client *client = &impl->this;
+	struct pw_mempool_stats stats;
+	struct spa_dict_item items[2];
+	char blocks[16], size[32];
+
+	pw_mempool_get_stats(client->pool, &stats);
+	snprintf(blocks, sizeof(blocks), "%u", stats.n_blocks);
+	snprintf(size, sizeof(size), "%"PRIu64, stats.size);
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_MEM_BLOCKS, blocks);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_MEM_SIZE, size);
+
+	impl->mem_stats_pending = false;
+	pw_client_update_properties(client, &SPA_DICT_INIT(items, 2));
+}
+
+/* a link setup adds and removes many blocks, only emit the info of the
+ * client when the main loop is done with them */
+static void schedule_mem_stats(struct impl *impl)
+{
+	if (impl->mem_stats_pending || impl->mem_stats_event == NULL)
+		return;
+	impl->mem_stats_pending = true;
+	pw_loop_signal_event(impl->this.core->main_loop, impl->mem_stats_event);
+}
+
 static void pool_added(void *data, struct pw_memblock *block)
 {
 	struct impl *impl = data;
@@ -238,6 +271,7 @@ static void pool_added(void *data, struct pw_memblock *block)
 				block->id, block->type, block->fd,
 				block->flags & PW_MEMBLOCK_FLAG_READWRITE);
 	}
+	schedule_mem_stats(impl);
 }
 
 static void pool_removed(void *data, struct pw_memblock *block)
@@ -247,6 +281,7 @@ static void pool_removed(void *data, struct pw_memblock *block)
 	pw_log_debug(NAME" %p: removed block %d", client, block->id);
 	if (client->core_resource)
 		pw_core_resource_remove_mem(client->core_resource, block->id);
+	schedule_mem_stats(impl);
 }
 
 static const struct pw_mempool_events pool_events = {
@@ -319,13 +354,19 @@ struct pw_client *pw_client_new(struct pw_core *core,
 	p->id = SPA_ID_INVALID;
 	p->permissions = 0;
 
-	this->pool = pw_mempool_new(NULL);
+	this->pool = pw_core_create_client_mempool(core);
 	if (this->pool == NULL) {
 		res = -errno;
 		goto error_clear_array;
 	}
 	pw_mempool_add_listener(this->pool, &impl->pool_listener, &pool_events, impl);
 
+	impl->mem_stats_event = pw_loop_add_event(core->main_loop, update_mem_stats, impl);
+	if (impl->mem_stats_event == NULL) {
+		res = -errno;
+		goto error_clear_pool;
+	}
+
 	this->properties = properties;
 	this->permission_func = client_permission_func;
 	this->permission_data = impl;
@@ -336,6 +377,7 @@ struct pw_client *pw_client_new(struct pw_core *core,
 	spa_hook_list_init(&this->listener_list);
 
 	pw_map_init(&this->objects, 0, 32);
+	spa_list_init(&this->registry_list);
 
 	pw_core_add_listener(core, &impl->core_listener, &core_events, impl);
 
@@ -345,6 +387,9 @@ struct pw_client *pw_client_new(struct pw_core *core,
 
 	return this;
 
+error_clear_pool:
+	spa_hook_remove(&impl->pool_listener);
+	pw_mempool_destroy(this->pool);
 error_clear_array:
 	pw_array_clear(&impl->permissions);
 error_free:
@@ -498,7 +543,9 @@ void pw_client_destroy(struct pw_client *client)
 
 	pw_map_clear(&client->objects);
 	pw_array_clear(&impl->permissions);
+	spa_hook_remove(&impl->pool_listener);
 	pw_mempool_destroy(client->pool);
+	pw_loop_destroy_source(client->core->main_loop, impl->mem_stats_event);
 
 	pw_properties_free(client->properties);
 
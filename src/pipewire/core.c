@@ -150,16 +150,154 @@ error_exit:
 	return res;
 }
 
+/** check if a global passes the filter of a registry resource
+ * \memberof pw_core
+ */
+bool pw_registry_resource_match(struct pw_resource *resource, struct pw_global *global)
+{
+	struct registry_data *data = pw_resource_get_user_data(resource);
+	const struct spa_dict_item *item;
+
+	if (data->filter_type != SPA_ID_INVALID &&
+	    data->filter_type != global->type)
+		return false;
+
+	if (data->filter_props == NULL)
+		return true;
+
+	spa_dict_for_each(item, &data->filter_props->dict) {
+		const char *str = pw_properties_get(global->properties, item->key);
+		if (str == NULL || strcmp(str, item->value) != 0)
+			return false;
+	}
+	return true;
+}
+
+static int registry_enum_globals(void *object, int seq, uint32_t type,
+		const struct spa_dict *props, uint32_t start_id, uint32_t max_globals)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+	struct pw_core *core = resource->core;
+	struct registry_data *data = pw_resource_get_user_data(resource);
+	struct pw_properties *filter_props = NULL;
+	struct pw_global *global;
+	uint32_t id, n_ids, count = 0, next_id = SPA_ID_INVALID;
+
+	if (props != NULL && props->n_items > 0) {
+		if ((filter_props = pw_properties_new_dict(props)) == NULL)
+			return -errno;
+	}
+	if (data->filter_props)
+		pw_properties_free(data->filter_props);
+	data->filter_type = type;
+	data->filter_props = filter_props;
+
+	pw_log_debug("registry %p: enum globals seq:%d type:%u start:%u max:%u",
+			resource, seq, type, start_id, max_globals);
+
+	n_ids = pw_map_get_size(&core->globals);
+	for (id = start_id; id < n_ids; id++) {
+		uint32_t permissions;
+
+		if ((global = pw_map_lookup(&core->globals, id)) == NULL ||
+		    !pw_global_is_registered(global))
+			continue;
+
+		permissions = pw_global_get_permissions(global, client);
+		if (!PW_PERM_IS_R(permissions) ||
+		    !pw_registry_resource_match(resource, global))
+			continue;
+
+		if (max_globals > 0 && count == max_globals) {
+			next_id = id;
+			break;
+		}
+		pw_registry_resource_global(resource,
+					    global->id,
+					    permissions,
+					    global->type,
+					    global->version,
+					    &global->properties->dict);
+		count++;
+	}
+	pw_registry_resource_enum_done(resource, seq, next_id);
+	return 0;
+}
+
+static int registry_resume(void *object, int seq, uint32_t cookie, uint64_t serial)
+{
+	struct pw_resource *resource = object;
+	struct pw_client *client = resource->client;
+	struct pw_core *core = resource->core;
+	struct pw_global *global;
+	uint64_t i, first;
+	bool full;
+
+	/* older removals were forgotten, we can only resume when the client
+	 * saw all of them */
+	first = core->n_removed > PW_CORE_MAX_REMOVED ?
+		core->n_removed - PW_CORE_MAX_REMOVED : 0;
+
+	full = cookie != core->info.cookie ||
+		serial > core->registry_serial ||
+		(first > 0 && serial + 1 < core->removed[first % PW_CORE_MAX_REMOVED].serial);
+
+	pw_log_debug("registry %p: resume seq:%d cookie:%08x/%08x serial:%"PRIu64"/%"PRIu64" full:%d",
+			resource, seq, cookie, core->info.cookie, serial, core->registry_serial, full);
+
+	if (!full) {
+		for (i = first; i < core->n_removed; i++) {
+			uint32_t idx = i % PW_CORE_MAX_REMOVED;
+			if (core->removed[idx].serial > serial)
+				pw_registry_resource_global_remove(resource,
+						core->removed[idx].id);
+		}
+	}
+
+	spa_list_for_each(global, &core->global_list, link) {
+		uint32_t permissions;
+
+		if (!pw_registry_resource_match(resource, global))
+			continue;
+
+		permissions = pw_global_get_permissions(global, client);
+
+		if (!full && global->serial <= serial) {
+			/* known to the client, unless it can't see it now */
+			if (!PW_PERM_IS_R(permissions))
+				pw_registry_resource_global_remove(resource, global->id);
+			continue;
+		}
+		if (PW_PERM_IS_R(permissions))
+			pw_registry_resource_global(resource,
+						    global->id,
+						    permissions,
+						    global->type,
+						    global->version,
+						    &global->properties->dict);
+	}
+	pw_registry_resource_resume_done(resource, seq, core->info.cookie,
+			core->registry_serial, full);
+	return 0;
+}
+
 static const struct pw_registry_proxy_methods registry_methods = {
 	PW_VERSION_REGISTRY_PROXY_METHODS,
 	.bind = registry_bind,
-	.destroy = registry_destroy
+	.destroy = registry_destroy,
+	.enum_globals = registry_enum_globals,
+	.resume = registry_resume,
 };
 
 static void destroy_registry_resource(void *object)
 {
 	struct pw_resource *resource = object;
+	struct registry_data *data = pw_resource_get_user_data(resource);
 	spa_list_remove(&resource->link);
+	spa_list_remove(&data->client_link);
+	if (data->filter_props)
+		pw_properties_free(data->filter_props);
 }
 
 static const struct pw_resource_events resource_events = {
@@ -247,7 +385,7 @@ static struct pw_registry_proxy * core_get_registry(void *object, uint32_t versi
 	struct pw_core *this = resource->core;
 	struct pw_global *global;
 	struct pw_resource *registry_resource;
-	struct resource_data *data;
+	struct registry_data *data;
 	uint32_t new_id = user_data_size;
 	int res;
 
@@ -263,6 +401,9 @@ static struct pw_registry_proxy * core_get_registry(void *object, uint32_t versi
 	}
 
 	data = pw_resource_get_user_data(registry_resource);
+	data->resource = registry_resource;
+	data->filter_type = SPA_ID_INVALID;
+	data->filter_props = NULL;
 	pw_resource_add_listener(registry_resource,
 				&data->resource_listener,
 				&resource_events,
@@ -273,6 +414,11 @@ static struct pw_registry_proxy * core_get_registry(void *object, uint32_t versi
 				registry_resource);
 
 	spa_list_append(&this->registry_resource_list, &registry_resource->link);
+	spa_list_append(&client->registry_list, &data->client_link);
+
+	/* newer clients page through the globals with enum_globals */
+	if (version >= PW_VERSION_REGISTRY_PROXY_ENUM)
+		goto done;
 
 	spa_list_for_each(global, &this->global_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, client);
@@ -285,7 +431,7 @@ static struct pw_registry_proxy * core_get_registry(void *object, uint32_t versi
 						    &global->properties->dict);
 		}
 	}
-
+done:
 	return (struct pw_registry_proxy *)registry_resource;
 
 error_resource:
@@ -461,6 +607,40 @@ static const struct pw_global_events global_events = {
 	.destroy = global_destroy,
 };
 
+static struct pw_data_loop *create_data_loop(struct pw_core *core, uint32_t index)
+{
+	static const char * const loop_keys[] = { PW_KEY_LOOP_CPUS, PW_KEY_LOOP_RT_PRIO,
+		PW_KEY_LOOP_PREFAULT, PW_KEY_LOOP_CHECK_FAULTS };
+	struct pw_properties *pr;
+	const char *str;
+	char key[128];
+	uint32_t i;
+
+	pr = pw_properties_copy(core->properties);
+	if (pr == NULL)
+		return NULL;
+
+	if ((str = pw_properties_get(pr, "core.data-loop." PW_KEY_LIBRARY_NAME_SYSTEM)))
+		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, str);
+	if ((str = pw_properties_get(pr, "core.data-loop." SPA_KEY_LOOP_BUSY_POLL)))
+		pw_properties_set(pr, SPA_KEY_LOOP_BUSY_POLL, str);
+
+	for (i = 0; i < SPA_N_ELEMENTS(loop_keys); i++) {
+		snprintf(key, sizeof(key), "core.data-loop.%u.%s", index, loop_keys[i]);
+		if ((str = pw_properties_get(pr, key)))
+			pw_properties_set(pr, loop_keys[i], str);
+	}
+	pw_log_debug(NAME" %p: create data loop %u", core, index);
+
+	return pw_data_loop_new(pr);
+}
+
+static void destroy_data_loops(struct pw_core *core)
+{
+	while (core->n_data_loops > 0)
+		pw_data_loop_destroy(core->data_loops[--core->n_data_loops]);
+}
+
 /** Create a new core object
  *
  * \param main_loop the main loop to use
@@ -479,9 +659,9 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop,
 	const char *name, *lib, *str;
 	void *dbus_iface = NULL;
 	uint32_t n_support;
-	struct pw_properties *pr;
 	struct spa_cpu *cpu;
-	int res = 0;
+	uint32_t i, n_data_loops = 1;
+	int n_workers, res = 0;
 
 	impl = calloc(1, sizeof(struct impl) + user_data_size);
 	if (impl == NULL) {
@@ -505,17 +685,20 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop,
 
 	this->properties = properties;
 
-	pr = pw_properties_copy(properties);
-	if ((str = pw_properties_get(pr, "core.data-loop." PW_KEY_LIBRARY_NAME_SYSTEM)))
-		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, str);
+	if ((str = pw_properties_get(properties, "core.data-loops")) != NULL)
+		n_data_loops = SPA_CLAMP(pw_properties_parse_int(str), 1, (int)PW_CORE_MAX_DATA_LOOPS);
 
-	this->data_loop_impl = pw_data_loop_new(pr);
-	if (this->data_loop_impl == NULL)  {
-		res = -errno;
-		goto error_free;
+	for (i = 0; i < n_data_loops; i++) {
+		this->data_loops[i] = create_data_loop(this, i);
+		if (this->data_loops[i] == NULL)  {
+			res = -errno;
+			goto error_free_loop;
+		}
+		this->n_data_loops++;
 	}
+	this->data_loop_impl = this->data_loops[0];
 
-	this->pool = pw_mempool_new(NULL);
+	this->pool = pw_core_create_mempool(this);
 
 	this->data_loop = pw_data_loop_get_loop(this->data_loop_impl);
 	this->data_system = this->data_loop->system;
@@ -548,8 +731,38 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop,
 	}
 	this->n_support = n_support;
 
-	if ((res = pw_data_loop_start(this->data_loop_impl)) < 0)
-		goto error_free_loop;
+	for (i = 0; i < this->n_data_loops; i++) {
+		if ((res = pw_data_loop_start(this->data_loops[i])) < 0)
+			goto error_free_loop;
+	}
+
+	if ((str = pw_properties_get(properties, "core.data-loop.workers")) != NULL &&
+	    (n_workers = pw_properties_parse_int(str)) > 0) {
+		this->worker_pool = pw_worker_pool_new(this, n_workers);
+		if (this->worker_pool == NULL)
+			pw_log_warn(NAME" %p: can't create worker pool: %m", this);
+	}
+	if ((str = pw_properties_get(properties, "core.profiler")) != NULL &&
+	    pw_properties_parse_bool(str)) {
+		this->profiler = pw_profiler_new(this, PW_PROFILER_DEFAULT_SIZE);
+		if (this->profiler == NULL)
+			pw_log_warn(NAME" %p: can't create profiler: %m", this);
+	}
+	if ((str = pw_properties_get(properties, "core.cpu-time")) != NULL)
+		this->cpu_time = pw_properties_parse_bool(str);
+
+	this->quantum.policy = PW_QUANTUM_POLICY_STATIC;
+	this->quantum.min = MIN_QUANTUM;
+	this->quantum.max = MAX_QUANTUM;
+	if ((str = pw_properties_get(properties, "core.quantum.policy")) != NULL &&
+	    strcmp(str, "adaptive") == 0)
+		this->quantum.policy = PW_QUANTUM_POLICY_ADAPTIVE;
+	if ((str = pw_properties_get(properties, "core.quantum.min")) != NULL)
+		this->quantum.min = SPA_CLAMP((uint32_t)pw_properties_parse_int(str),
+				MIN_QUANTUM, MAX_QUANTUM);
+	if ((str = pw_properties_get(properties, "core.quantum.max")) != NULL)
+		this->quantum.max = SPA_CLAMP((uint32_t)pw_properties_parse_int(str),
+				this->quantum.min, MAX_QUANTUM);
 
 	pw_array_init(&this->factory_lib, 32);
 	pw_map_init(&this->globals, 128, 32);
@@ -564,6 +777,7 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop,
 	spa_list_init(&this->node_list);
 	spa_list_init(&this->factory_list);
 	spa_list_init(&this->link_list);
+	spa_list_init(&this->buffer_mem);
 	spa_list_init(&this->control_list[0]);
 	spa_list_init(&this->control_list[1]);
 	spa_list_init(&this->export_list);
@@ -612,7 +826,11 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop,
 	return this;
 
 error_free_loop:
-	pw_data_loop_destroy(this->data_loop_impl);
+	if (this->profiler)
+		pw_profiler_destroy(this->profiler);
+	if (this->worker_pool)
+		pw_worker_pool_destroy(this->worker_pool);
+	destroy_data_loops(this);
 error_free:
 	free(this);
 error_cleanup:
@@ -639,6 +857,7 @@ void pw_core_destroy(struct pw_core *core)
 	struct pw_resource *resource;
 	struct pw_node *node;
 	struct factory_entry *entry;
+	uint32_t i;
 
 	pw_log_debug(NAME" %p: destroy", core);
 	pw_core_emit_destroy(core);
@@ -666,9 +885,15 @@ void pw_core_destroy(struct pw_core *core)
 	pw_log_debug(NAME" %p: free", core);
 	pw_core_emit_free(core);
 
+	pw_buffers_pool_clear(core);
 	pw_mempool_destroy(core->pool);
 
-	pw_data_loop_destroy(core->data_loop_impl);
+	if (core->worker_pool)
+		pw_worker_pool_destroy(core->worker_pool);
+	destroy_data_loops(core);
+
+	if (core->profiler)
+		pw_profiler_destroy(core->profiler);
 
 	pw_properties_free(core->properties);
 
@@ -683,6 +908,9 @@ void pw_core_destroy(struct pw_core *core)
 
 	pw_map_clear(&core->globals);
 
+	for (i = 0; i < PW_CORE_FORMAT_CACHE; i++)
+		free(core->format_cache[i].format);
+
 	free(core);
 }
 
@@ -900,6 +1128,34 @@ struct pw_port *pw_core_find_port(struct pw_core *core,
 	return best;
 }
 
+/* Links between ports with the same formats negotiate the same format,
+ * remember the result of the last few negotiations. Ports bump their
+ * format serial when their EnumFormat param changes. */
+static struct spa_pod *format_cache_lookup(struct pw_core *core,
+		struct pw_port *output, struct pw_port *input)
+{
+	uint32_t i;
+	for (i = 0; i < PW_CORE_FORMAT_CACHE; i++) {
+		if (core->format_cache[i].format != NULL &&
+		    core->format_cache[i].output == output->format_serial &&
+		    core->format_cache[i].input == input->format_serial)
+			return core->format_cache[i].format;
+	}
+	return NULL;
+}
+
+static void format_cache_add(struct pw_core *core,
+		struct pw_port *output, struct pw_port *input,
+		const struct spa_pod *format)
+{
+	uint32_t i = core->format_cache_next++ % PW_CORE_FORMAT_CACHE;
+
+	free(core->format_cache[i].format);
+	core->format_cache[i].output = output->format_serial;
+	core->format_cache[i].input = input->format_serial;
+	core->format_cache[i].format = spa_pod_copy(format);
+}
+
 /** Find a common format between two ports
  *
  * \param core a core object
@@ -929,6 +1185,7 @@ int pw_core_find_format(struct pw_core *core,
 	uint32_t out_state, in_state;
 	int res;
 	uint32_t iidx = 0, oidx = 0;
+	bool use_cache = false;
 	struct spa_pod_builder fb = { 0 };
 	uint8_t fbuf[4096];
 	struct spa_pod *filter;
@@ -1001,6 +1258,24 @@ int pw_core_find_format(struct pw_core *core,
 			goto error;
 		}
 	} else if (in_state == PW_PORT_STATE_CONFIGURE && out_state == PW_PORT_STATE_CONFIGURE) {
+		struct spa_pod *cached;
+
+		use_cache = n_format_filters == 0 &&
+			output->format_serial != 0 && input->format_serial != 0;
+
+		if (use_cache && (cached = format_cache_lookup(core, output, input)) != NULL) {
+			uint32_t offset = builder->state.offset;
+
+			pw_log_debug(NAME" %p: cached format %"PRIu64" %"PRIu64, core,
+					output->format_serial, input->format_serial);
+			if ((res = spa_pod_builder_raw_padded(builder, cached,
+							SPA_POD_SIZE(cached))) < 0) {
+				asprintf(error, "error copy cached format: %s", spa_strerror(res));
+				goto error;
+			}
+			*format = spa_pod_builder_deref(builder, offset);
+			return 1;
+		}
 	      again:
 		/* both ports need a format */
 		pw_log_debug(NAME" %p: do enum input %d", core, iidx);
@@ -1038,6 +1313,9 @@ int pw_core_find_format(struct pw_core *core,
 		pw_log_debug(NAME" %p: Got filtered:", core);
 		if (pw_log_level_enabled(SPA_LOG_LEVEL_DEBUG))
 			spa_debug_format(2, NULL, *format);
+
+		if (use_cache)
+			format_cache_add(core, output, input, *format);
 	} else {
 		res = -EBADF;
 		asprintf(error, "error bad node state");
@@ -1137,6 +1415,69 @@ static int collect_nodes(struct pw_node *driver)
 	return 0;
 }
 
+/* the number of frames that fit in the smallest negotiated buffer of the
+ * graph of @driver or UINT32_MAX */
+static uint32_t graph_max_frames(struct pw_node *driver)
+{
+	struct pw_node *s;
+	struct pw_port *p;
+	uint32_t max = UINT32_MAX;
+
+#define CHECK_FRAMES(b)	if ((b).max_frames > 0) max = SPA_MIN(max, (b).max_frames)
+	spa_list_for_each(s, &driver->slave_list, slave_link) {
+		spa_list_for_each(p, &s->input_ports, link) {
+			CHECK_FRAMES(p->buffers);
+			CHECK_FRAMES(p->mix_buffers);
+		}
+		spa_list_for_each(p, &s->output_ports, link) {
+			CHECK_FRAMES(p->buffers);
+			CHECK_FRAMES(p->mix_buffers);
+		}
+	}
+#undef CHECK_FRAMES
+	return max;
+}
+
+static int do_set_duration(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node *driver = user_data;
+
+	if (driver->rt.position)
+		driver->rt.position->clock.duration = *(const uint32_t *)data;
+	return 0;
+}
+
+/* Apply the quantum of the adaptive policy to @driver. The followers read
+ * the duration from the position of the driver in each cycle and the
+ * quantum never grows past what their negotiated buffers can hold, so
+ * nothing needs to be negotiated again. The duration is changed in the
+ * data loop of the driver, between two cycles. */
+static void apply_adaptive_quantum(struct pw_core *core, struct pw_node *driver)
+{
+	uint32_t min, max, quantum;
+
+	max = SPA_MIN(core->quantum.max, graph_max_frames(driver));
+	min = SPA_CLAMP(driver->quantum_current, core->quantum.min, core->quantum.max);
+	max = SPA_MAX(max, min);
+
+	/* the requested latency changed, start again from there */
+	if (min != driver->rt.adapt.min)
+		driver->quantum_adapt = 0;
+
+	quantum = driver->quantum_adapt ? SPA_CLAMP(driver->quantum_adapt, min, max) : min;
+
+	pw_log_debug(NAME" %p: driver %p adaptive quantum:%u (%u-%u)", core, driver,
+			quantum, min, max);
+
+	ATOMIC_STORE(driver->rt.adapt.min, min);
+	ATOMIC_STORE(driver->rt.adapt.max, max);
+
+	if (driver->rt.position && driver->rt.position->clock.duration != quantum)
+		pw_loop_invoke(driver->data_loop, do_set_duration, SPA_ID_INVALID,
+				&quantum, sizeof(quantum), false, driver);
+}
+
 int pw_core_recalc_graph(struct pw_core *core)
 {
 	struct pw_node *n, *s, *target;
@@ -1205,7 +1546,9 @@ int pw_core_recalc_graph(struct pw_core *core)
 		if (!n->master)
 			continue;
 
-		if (n->rt.position && n->quantum_current != n->rt.position->clock.duration)
+		if (core->quantum.policy == PW_QUANTUM_POLICY_ADAPTIVE)
+			apply_adaptive_quantum(core, n);
+		else if (n->rt.position && n->quantum_current != n->rt.position->clock.duration)
 			n->rt.position->clock.duration = n->quantum_current;
 
 		pw_log_info(NAME" %p: master %p quantum:%u '%s'", core, n,
@@ -1262,7 +1605,9 @@ struct spa_handle *pw_core_load_spa_handle(struct pw_core *core,
 {
 	const char *lib;
 	const struct spa_support *support;
-	uint32_t n_support;
+	struct spa_support loop_support[SPA_N_ELEMENTS(core->support)];
+	struct pw_data_loop *data_loop;
+	uint32_t i, n_support;
 	struct spa_handle *handle;
 
 	pw_log_debug(NAME" %p: load factory %s", core, factory_name);
@@ -1279,8 +1624,72 @@ struct spa_handle *pw_core_load_spa_handle(struct pw_core *core,
 
 	support = pw_core_get_support(core, &n_support);
 
+	data_loop = pw_core_find_data_loop(core, info);
+	if (data_loop != core->data_loop_impl) {
+		/* run the plugin on the data loop the node was placed on */
+		memcpy(loop_support, support, n_support * sizeof(struct spa_support));
+		for (i = 0; i < n_support; i++) {
+			if (loop_support[i].type == SPA_TYPE_INTERFACE_DataLoop)
+				loop_support[i].data = data_loop->loop->loop;
+			else if (loop_support[i].type == SPA_TYPE_INTERFACE_DataSystem)
+				loop_support[i].data = data_loop->loop->system;
+		}
+		support = loop_support;
+	}
+
 	handle = pw_load_spa_handle(lib, factory_name,
 			info, n_support, support);
 
 	return handle;
 }
+
+static struct pw_mempool *create_mempool(struct pw_core *core,
+		const char * const keys[], uint32_t n_keys)
+{
+	struct pw_properties *props;
+	const char *str;
+	uint32_t i;
+
+	if ((props = pw_properties_new(NULL, NULL)) == NULL)
+		return NULL;
+
+	for (i = 0; i < n_keys; i++) {
+		if ((str = pw_properties_get(core->properties, keys[i])) != NULL)
+			pw_properties_set(props, keys[i], str);
+	}
+	return pw_mempool_new(props);
+}
+
+struct pw_mempool *pw_core_create_mempool(struct pw_core *core)
+{
+	static const char * const keys[] = {
+		PW_KEY_MEM_HUGEPAGES, PW_KEY_MEM_LOCK, PW_KEY_MEM_CACHE_SIZE,
+		PW_KEY_MEM_DMA_HEAP };
+	return create_mempool(core, keys, SPA_N_ELEMENTS(keys));
+}
+
+struct pw_mempool *pw_core_create_client_mempool(struct pw_core *core)
+{
+	static const char * const keys[] = {
+		PW_KEY_MEM_HUGEPAGES, PW_KEY_MEM_LOCK, PW_KEY_MEM_CACHE_SIZE,
+		PW_KEY_MEM_DMA_HEAP, PW_KEY_MEM_QUOTA_BLOCKS, PW_KEY_MEM_QUOTA_SIZE };
+	return create_mempool(core, keys, SPA_N_ELEMENTS(keys));
+}
+
+struct pw_data_loop *pw_core_find_data_loop(struct pw_core *core, const struct spa_dict *props)
+{
+	const char *str;
+	int index;
+
+	if (props == NULL ||
+	    (str = spa_dict_lookup(props, PW_KEY_NODE_LOOP)) == NULL)
+		return core->data_loop_impl;
+
+	index = pw_properties_parse_int(str);
+	if (index < 0 || index >= (int)core->n_data_loops) {
+		pw_log_warn(NAME" %p: invalid data loop %s, have %u", core,
+				str, core->n_data_loops);
+		return core->data_loop_impl;
+	}
+	return core->data_loops[index];
+}
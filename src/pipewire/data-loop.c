@@ -24,14 +24,35 @@
 
 #include <pthread.h>
 #include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <alloca.h>
+#include <unistd.h>
 #include <sys/resource.h>
 
 #include "pipewire/log.h"
+#include "pipewire/keys.h"
 #include "pipewire/data-loop.h"
 #include "pipewire/private.h"
 
 #define NAME "data-loop"
 
+#define MAX_PREFAULT	(4u * 1024 * 1024)
+
+struct impl {
+	struct pw_data_loop this;
+
+	cpu_set_t cpus;			/**< cpus to run the thread on */
+	unsigned int have_cpus:1;
+	int rt_prio;			/**< SCHED_FIFO priority or 0 */
+	int numa_node;			/**< NUMA node of the cpus or -1 */
+	size_t prefault;		/**< bytes of stack to touch on start */
+	unsigned int check_faults:1;	/**< warn about page faults in the thread */
+	long minflt;			/**< last sampled fault counts */
+	long majflt;
+};
+
 SPA_EXPORT
 int pw_data_loop_wait(struct pw_data_loop *this, int timeout)
 {
@@ -55,11 +76,66 @@ void pw_data_loop_exit(struct pw_data_loop *this)
 	this->running = false;
 }
 
+/* touch the stack pages so that the first cycles don't fault them in */
+static void prefault_stack(size_t size)
+{
+	volatile char *stack = alloca(size);
+	size_t i, page = sysconf(_SC_PAGESIZE);
+
+	for (i = 0; i < size; i += page)
+		stack[i] = 0;
+}
+
+static void check_faults(struct impl *impl, bool warn)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_THREAD, &ru) < 0)
+		return;
+
+	if (warn && (ru.ru_minflt > impl->minflt || ru.ru_majflt > impl->majflt))
+		pw_log_warn(NAME" %p: %ld minor and %ld major page faults in the loop",
+				&impl->this, ru.ru_minflt - impl->minflt,
+				ru.ru_majflt - impl->majflt);
+
+	impl->minflt = ru.ru_minflt;
+	impl->majflt = ru.ru_majflt;
+}
+
+static void setup_thread(struct impl *impl)
+{
+	struct pw_data_loop *this = &impl->this;
+	int res;
+
+	if (impl->have_cpus &&
+	    (res = pthread_setaffinity_np(pthread_self(), sizeof(impl->cpus), &impl->cpus)) != 0)
+		pw_log_warn(NAME" %p: can't set affinity: %s", this, strerror(res));
+
+	if (impl->rt_prio > 0) {
+		struct sched_param sp;
+
+		spa_zero(sp);
+		sp.sched_priority = impl->rt_prio;
+		if ((res = pthread_setschedparam(pthread_self(),
+				SCHED_FIFO | SCHED_RESET_ON_FORK, &sp)) != 0)
+			pw_log_warn(NAME" %p: can't set priority %d: %s", this,
+					impl->rt_prio, strerror(res));
+	}
+
+	if (impl->prefault > 0)
+		prefault_stack(impl->prefault);
+	if (impl->check_faults)
+		check_faults(impl, false);
+}
+
 static void *do_loop(void *user_data)
 {
 	struct pw_data_loop *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	int res;
 
+	setup_thread(impl);
+
 	pw_log_debug(NAME" %p: enter thread", this);
 	pw_loop_enter(this->loop);
 
@@ -70,6 +146,8 @@ static void *do_loop(void *user_data)
 			pw_log_error(NAME" %p: iterate error %d (%s)",
 					this, res, spa_strerror(res));
 		}
+		if (impl->check_faults)
+			check_faults(impl, true);
 	}
 
 	pw_log_debug(NAME" %p: leave thread", this);
@@ -86,7 +164,80 @@ static void do_stop(void *data, uint64_t count)
 	this->running = false;
 }
 
+/* parse a list of cpus like "0,2-3" */
+static int parse_cpus(struct impl *impl, const char *str)
+{
+	char *end;
+	long first, last, i;
+
+	CPU_ZERO(&impl->cpus);
+	while (*str) {
+		first = last = strtol(str, &end, 10);
+		if (end == str || first < 0)
+			return -EINVAL;
+		if (*end == '-') {
+			str = end + 1;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first)
+				return -EINVAL;
+		}
+		for (i = first; i <= last && i < CPU_SETSIZE; i++)
+			CPU_SET(i, &impl->cpus);
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return -EINVAL;
+		str = end;
+	}
+	impl->have_cpus = CPU_COUNT(&impl->cpus) > 0;
+	return 0;
+}
+
+static int get_cpu_numa_node(int cpu)
+{
+	char path[64];
+	struct dirent *entry;
+	DIR *dir;
+	int node = -1;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	if ((dir = opendir(path)) == NULL)
+		return -1;
+	while ((entry = readdir(dir)) != NULL) {
+		if (sscanf(entry->d_name, "node%d", &node) == 1)
+			break;
+		node = -1;
+	}
+	closedir(dir);
+	return node;
+}
+
+/* the NUMA node of the cpus when they are all on the same node */
+static int find_numa_node(struct impl *impl)
+{
+	int i, node, res = -1;
+
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, &impl->cpus))
+			continue;
+		if ((node = get_cpu_numa_node(i)) < 0 ||
+		    (res != -1 && res != node))
+			return -1;
+		res = node;
+	}
+	return res;
+}
+
+int pw_data_loop_get_numa_node(struct pw_data_loop *loop)
+{
+	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, this);
+	return impl->numa_node;
+}
+
 /** Create a new \ref pw_data_loop.
+ * \param properties extra properties, \ref PW_KEY_LOOP_CPUS,
+ *	\ref PW_KEY_LOOP_RT_PRIO, \ref PW_KEY_LOOP_PREFAULT and
+ *	\ref PW_KEY_LOOP_CHECK_FAULTS configure the thread of the loop
  * \return a newly allocated data loop
  *
  * \memberof pw_data_loop
@@ -94,17 +245,35 @@ static void do_stop(void *data, uint64_t count)
 SPA_EXPORT
 struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 {
+	struct impl *impl;
 	struct pw_data_loop *this;
+	const char *str;
 	int res;
 
-	this = calloc(1, sizeof(struct pw_data_loop));
-	if (this == NULL) {
+	impl = calloc(1, sizeof(struct impl));
+	if (impl == NULL) {
 		res = -errno;
 		goto error_cleanup;
 	}
+	this = &impl->this;
+	impl->numa_node = -1;
 
 	pw_log_debug(NAME" %p: new", this);
 
+	if (properties) {
+		if ((str = pw_properties_get(properties, PW_KEY_LOOP_CPUS)) != NULL &&
+		    parse_cpus(impl, str) < 0)
+			pw_log_warn(NAME" %p: invalid cpus '%s'", this, str);
+		if (impl->have_cpus)
+			impl->numa_node = find_numa_node(impl);
+		if ((str = pw_properties_get(properties, PW_KEY_LOOP_RT_PRIO)) != NULL)
+			impl->rt_prio = pw_properties_parse_int(str);
+		if ((str = pw_properties_get(properties, PW_KEY_LOOP_PREFAULT)) != NULL)
+			impl->prefault = SPA_MIN(strtoul(str, NULL, 0), MAX_PREFAULT);
+		if ((str = pw_properties_get(properties, PW_KEY_LOOP_CHECK_FAULTS)) != NULL)
+			impl->check_faults = pw_properties_parse_bool(str);
+	}
+
 	this->loop = pw_loop_new(properties);
 	properties = NULL;
 	if (this->loop == NULL) {
@@ -127,7 +296,7 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 error_loop_destroy:
 	pw_loop_destroy(this->loop);
 error_free:
-	free(this);
+	free(impl);
 error_cleanup:
 	if (properties)
 		pw_properties_free(properties);
@@ -150,7 +319,7 @@ void pw_data_loop_destroy(struct pw_data_loop *loop)
 
 	pw_loop_destroy_source(loop->loop, loop->event);
 	pw_loop_destroy(loop->loop);
-	free(loop);
+	free(SPA_CONTAINER_OF(loop, struct impl, this));
 }
 
 SPA_EXPORT
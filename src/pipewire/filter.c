@@ -44,14 +44,15 @@
 
 #define NAME "filter"
 
-#define MAX_SAMPLES	8192
-#define MAX_BUFFERS	64
+#define MAX_SAMPLES	8192u
+#define MAX_BUFFERS	64u
 #define MIN_QUEUED	1
 
 #define MASK_BUFFERS	(MAX_BUFFERS-1)
 #define MAX_PORTS	1024
 
 static float empty[MAX_SAMPLES];
+static float scratch[MAX_SAMPLES];
 
 struct buffer {
 	struct pw_buffer this;
@@ -63,7 +64,7 @@ struct buffer {
 
 struct queue {
 	uint32_t ids[MAX_BUFFERS];
-	struct spa_ringbuffer ring;
+	struct spa_ringbuffer_spsc ring;
 	uint64_t incount;
 	uint64_t outcount;
 };
@@ -107,6 +108,8 @@ struct port {
 	struct queue dequeued;
 	struct queue queued;
 
+	struct buffer *dsp_buffer;	/**< buffer dequeued for PW_FILTER_FLAG_DSP_BUFFERS */
+
 	/* from here is what the caller gets as user_data */
 	uint8_t user_data[0];
 };
@@ -128,11 +131,16 @@ struct filter {
 	struct spa_node_methods node_methods;
 	struct spa_hook_list hooks;
 	struct spa_callbacks callbacks;
+	struct pw_rt_hooks rt_hooks;		/**< listeners emitted from the data thread */
 	struct spa_io_position *position;
 
 	struct spa_list port_list;;
 	struct port *ports[2][MAX_PORTS];
 
+	float *dsp[2][MAX_PORTS];	/**< data of the ports in port order, valid
+					  *  in process with PW_FILTER_FLAG_DSP_BUFFERS */
+	uint32_t n_dsp[2];
+
 	struct spa_list param_list;
 	struct spa_param_info params[5];
 
@@ -239,8 +247,8 @@ static struct port *alloc_port(struct filter *filter,
 	p->id = i;
 
 	spa_list_init(&p->param_list);
-	spa_ringbuffer_init(&p->dequeued.ring);
-	spa_ringbuffer_init(&p->queued.ring);
+	spa_ringbuffer_spsc_init(&p->dequeued.ring);
+	spa_ringbuffer_spsc_init(&p->queued.ring);
 
 	filter->ports[direction][i] = p;
 	spa_list_append(&filter->port_list, &p->link);
@@ -263,9 +271,9 @@ static inline int push_queue(struct port *port, struct queue *queue, struct buff
 	SPA_FLAG_SET(buffer->flags, BUFFER_FLAG_QUEUED);
 	queue->incount += buffer->this.size;
 
-	spa_ringbuffer_get_write_index(&queue->ring, &index);
+	spa_ringbuffer_spsc_get_write_index(&queue->ring, &index, MAX_BUFFERS);
 	queue->ids[index & MASK_BUFFERS] = buffer->id;
-	spa_ringbuffer_write_update(&queue->ring, index + 1);
+	spa_ringbuffer_spsc_write_update(&queue->ring, index + 1);
 
 	return 0;
 }
@@ -276,13 +284,13 @@ static inline struct buffer *pop_queue(struct port *port, struct queue *queue)
 	uint32_t index, id;
 	struct buffer *buffer;
 
-	if ((avail = spa_ringbuffer_get_read_index(&queue->ring, &index)) < MIN_QUEUED) {
+	if ((avail = spa_ringbuffer_spsc_get_read_index(&queue->ring, &index)) < MIN_QUEUED) {
 		errno = EPIPE;
 		return NULL;
 	}
 
 	id = queue->ids[index & MASK_BUFFERS];
-	spa_ringbuffer_read_update(&queue->ring, index + 1);
+	spa_ringbuffer_spsc_read_update(&queue->ring, index + 1);
 
 	buffer = &port->buffers[id];
 	queue->outcount += buffer->this.size;
@@ -291,9 +299,52 @@ static inline struct buffer *pop_queue(struct port *port, struct queue *queue)
 	return buffer;
 }
 
+/* batch versions of push_queue and pop_queue that move all buffers with
+ * one update of the ring index */
+static inline int push_queue_n(struct port *port, struct queue *queue,
+		struct buffer **buffers, uint32_t n_buffers)
+{
+	uint32_t i, index;
+
+	for (i = 0; i < n_buffers; i++) {
+		if (SPA_FLAG_IS_SET(buffers[i]->flags, BUFFER_FLAG_QUEUED))
+			return -EINVAL;
+	}
+	spa_ringbuffer_spsc_get_write_index(&queue->ring, &index, MAX_BUFFERS);
+	for (i = 0; i < n_buffers; i++) {
+		SPA_FLAG_SET(buffers[i]->flags, BUFFER_FLAG_QUEUED);
+		queue->incount += buffers[i]->this.size;
+		queue->ids[(index + i) & MASK_BUFFERS] = buffers[i]->id;
+	}
+	spa_ringbuffer_spsc_write_update(&queue->ring, index + n_buffers);
+
+	return 0;
+}
+
+static inline uint32_t pop_queue_n(struct port *port, struct queue *queue,
+		struct buffer **buffers, uint32_t max)
+{
+	int32_t avail;
+	uint32_t i, index, n;
+
+	avail = spa_ringbuffer_spsc_get_read_index(&queue->ring, &index);
+	n = SPA_MIN((uint32_t)SPA_MAX(avail, 0), max);
+
+	for (i = 0; i < n; i++) {
+		struct buffer *buffer = &port->buffers[queue->ids[(index + i) & MASK_BUFFERS]];
+		queue->outcount += buffer->this.size;
+		SPA_FLAG_CLEAR(buffer->flags, BUFFER_FLAG_QUEUED);
+		buffers[i] = buffer;
+	}
+	if (n > 0)
+		spa_ringbuffer_spsc_read_update(&queue->ring, index + n);
+
+	return n;
+}
+
 static inline void clear_queue(struct port *port, struct queue *queue)
 {
-	spa_ringbuffer_init(&queue->ring);
+	spa_ringbuffer_spsc_init(&queue->ring);
 	queue->incount = queue->outcount;
 }
 
@@ -667,6 +718,13 @@ static int impl_port_use_buffers(void *object,
 		b->flags = 0;
 		b->id = i;
 		b->this.buffer = buffers[i];
+		b->this.header = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_Header, sizeof(*b->this.header));
+		b->this.crop = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_VideoCrop, sizeof(*b->this.crop));
+		b->this.damage = spa_buffer_find_meta(buffers[i], SPA_META_VideoDamage);
+		b->this.cursor = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_Cursor, sizeof(*b->this.cursor));
 
 		if (port->direction == SPA_DIRECTION_OUTPUT) {
 			pw_log_trace(NAME" %p: recycle buffer %d", filter, b->id);
@@ -709,14 +767,75 @@ static inline void copy_position(struct filter *impl)
 	}
 }
 
+static inline int call_trigger(struct filter *impl);
+
+/* dequeue a buffer on all ports and collect the data pointers in port
+ * order so that the process callback gets all of them at once */
+static void dsp_dequeue(struct filter *impl)
+{
+	struct port *p;
+	struct buffer *b;
+	struct spa_data *d;
+	uint32_t n_samples;
+	float *data;
+
+	n_samples = impl->position ?
+		SPA_MIN(impl->position->clock.duration, MAX_SAMPLES) : MAX_SAMPLES;
+
+	impl->n_dsp[0] = impl->n_dsp[1] = 0;
+	spa_list_for_each(p, &impl->port_list, link) {
+		if (impl->n_dsp[p->direction] >= MAX_PORTS)
+			continue;
+
+		if ((b = pop_queue(p, &p->dequeued)) != NULL) {
+			d = &b->this.buffer->datas[0];
+			if (p->direction == SPA_DIRECTION_OUTPUT) {
+				d->chunk->offset = 0;
+				d->chunk->size = n_samples * sizeof(float);
+				d->chunk->stride = sizeof(float);
+				d->chunk->flags = 0;
+			}
+			data = d->data;
+		} else {
+			data = p->direction == SPA_DIRECTION_INPUT ? empty : scratch;
+		}
+		p->dsp_buffer = b;
+		impl->dsp[p->direction][impl->n_dsp[p->direction]++] = data;
+	}
+}
+
+static void dsp_queue(struct filter *impl)
+{
+	struct port *p;
+	bool queued = false;
+
+	spa_list_for_each(p, &impl->port_list, link) {
+		if (p->dsp_buffer == NULL)
+			continue;
+		push_queue(p, &p->queued, p->dsp_buffer);
+		p->dsp_buffer = NULL;
+		queued = true;
+	}
+	impl->n_dsp[0] = impl->n_dsp[1] = 0;
+
+	if (queued)
+		call_trigger(impl);
+}
+
 static int
 do_call_process(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct filter *impl = user_data;
 	struct pw_filter *filter = &impl->this;
+	bool dsp = SPA_FLAG_IS_SET(impl->flags, PW_FILTER_FLAG_DSP_BUFFERS);
+
 	pw_log_trace(NAME" %p: do process", filter);
-	pw_filter_emit_process(filter, impl->position);
+	if (dsp)
+		dsp_dequeue(impl);
+	pw_rt_hooks_call(&impl->rt_hooks, struct pw_filter_events, process, 0, impl->position);
+	if (dsp)
+		dsp_queue(impl);
 	return 0;
 }
 
@@ -1032,6 +1151,7 @@ struct pw_filter * pw_filter_new(struct pw_remote *remote, const char *name,
 	spa_list_init(&impl->port_list);
 
 	spa_hook_list_init(&this->listener_list);
+	pw_rt_hooks_init(&impl->rt_hooks);
 	spa_list_init(&this->controls);
 
 	this->state = PW_FILTER_STATE_UNCONNECTED;
@@ -1115,6 +1235,7 @@ SPA_EXPORT
 void pw_filter_destroy(struct pw_filter *filter)
 {
 	struct filter *impl = SPA_CONTAINER_OF(filter, struct filter, this);
+	struct spa_hook *h;
 
 	pw_log_debug(NAME" %p: destroy", filter);
 
@@ -1137,16 +1258,39 @@ void pw_filter_destroy(struct pw_filter *filter)
 	if (impl->free_data)
 		pw_core_destroy(impl->data.core);
 
+	/* the hooks that are still in the list must not update us anymore */
+	spa_list_for_each(h, &filter->listener_list.list, link) {
+		h->removed = NULL;
+		h->priv = NULL;
+	}
+	pw_rt_hooks_clear(&impl->rt_hooks);
+
 	free(impl);
 }
 
+static void listener_removed(struct spa_hook *listener)
+{
+	struct filter *impl = listener->priv;
+
+	listener->removed = NULL;
+	listener->priv = NULL;
+	pw_rt_hooks_update(&impl->rt_hooks, &impl->this.listener_list, listener);
+}
+
 SPA_EXPORT
 void pw_filter_add_listener(struct pw_filter *filter,
 			    struct spa_hook *listener,
 			    const struct pw_filter_events *events,
 			    void *data)
 {
+	struct filter *impl = SPA_CONTAINER_OF(filter, struct filter, this);
+
 	spa_hook_list_append(&filter->listener_list, listener, events, data);
+	/* the process event is emitted from the data thread with
+	 * PW_FILTER_FLAG_RT_PROCESS, keep its copy of the list up to date */
+	listener->removed = listener_removed;
+	listener->priv = impl;
+	pw_rt_hooks_update(&impl->rt_hooks, &filter->listener_list, NULL);
 }
 
 SPA_EXPORT
@@ -1423,6 +1567,7 @@ int pw_filter_remove_port(void *port_data)
 
 	spa_list_remove(&port->link);
 	impl->ports[port->direction][port->id] = NULL;
+	port->dsp_buffer = NULL;
 
 	clear_buffers(port);
 	clear_params(impl, port, SPA_ID_INVALID);
@@ -1540,6 +1685,60 @@ int pw_filter_queue_buffer(void *port_data, struct pw_buffer *buffer)
 	return call_trigger(impl);
 }
 
+SPA_EXPORT
+int pw_filter_dequeue_buffers(void *port_data,
+		struct pw_buffer **buffers, uint32_t max_buffers)
+{
+	struct port *p = SPA_CONTAINER_OF(port_data, struct port, user_data);
+	struct filter *impl = p->filter;
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i, n;
+
+	n = pop_queue_n(p, &p->dequeued, b, SPA_MIN(max_buffers, MAX_BUFFERS));
+	pw_log_trace(NAME" %p: dequeue %u buffers", impl, n);
+
+	for (i = 0; i < n; i++)
+		buffers[i] = &b[i]->this;
+
+	return n;
+}
+
+SPA_EXPORT
+int pw_filter_queue_buffers(void *port_data,
+		struct pw_buffer **buffers, uint32_t n_buffers)
+{
+	struct port *p = SPA_CONTAINER_OF(port_data, struct port, user_data);
+	struct filter *impl = p->filter;
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i;
+	int res;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -EINVAL;
+
+	for (i = 0; i < n_buffers; i++)
+		b[i] = SPA_CONTAINER_OF(buffers[i], struct buffer, this);
+
+	pw_log_trace(NAME" %p: queue %u buffers", impl, n_buffers);
+	if ((res = push_queue_n(p, &p->queued, b, n_buffers)) < 0)
+		return res;
+
+	return call_trigger(impl);
+}
+
+SPA_EXPORT
+float *const *pw_filter_get_dsp_buffers(struct pw_filter *filter,
+		enum pw_direction direction, uint32_t *n_ports)
+{
+	struct filter *impl = SPA_CONTAINER_OF(filter, struct filter, this);
+	uint32_t dir = direction == PW_DIRECTION_INPUT ?
+		SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT;
+
+	if (n_ports)
+		*n_ports = impl->n_dsp[dir];
+	return impl->dsp[dir];
+}
+
 SPA_EXPORT
 void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples)
 {
@@ -111,6 +111,10 @@ enum pw_filter_flags {
 	PW_FILTER_FLAG_DRIVER		= (1 << 1),	/**< be a driver */
 	PW_FILTER_FLAG_RT_PROCESS	= (1 << 2),	/**< call process from the realtime
 							  *  thread */
+	PW_FILTER_FLAG_DSP_BUFFERS	= (1 << 3),	/**< dequeue and queue a buffer on all
+							  *  ports around the process event, use
+							  *  pw_filter_get_dsp_buffers() to get
+							  *  their data */
 };
 
 enum pw_filter_port_flags {
@@ -218,9 +222,28 @@ struct pw_buffer *pw_filter_dequeue_buffer(void *port_data);
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_filter_queue_buffer(void *port_data, struct pw_buffer *buffer);
 
+/** Get up to \a max_buffers buffers of a port at once.
+ * \return the number of buffers placed in \a buffers */
+int pw_filter_dequeue_buffers(void *port_data,
+		struct pw_buffer **buffers, uint32_t max_buffers);
+
+/** Submit or recycle \a n_buffers buffers of a port at once.
+ * \return 0 on success or a negative errno, in which case no buffer
+ *	was queued */
+int pw_filter_queue_buffers(void *port_data,
+		struct pw_buffer **buffers, uint32_t n_buffers);
+
 /** Get a data pointer to the buffer data */
 void *pw_filter_get_dsp_buffer(void *port_data, uint32_t n_samples);
 
+/** Get the data of all ports of \a direction in the order they were
+ * added. Only valid in the process event of a filter connected with
+ * \ref PW_FILTER_FLAG_DSP_BUFFERS, the buffers hold the number of
+ * samples of the clock duration of the position.
+ * \return an array of \a n_ports pointers to float samples */
+float *const *pw_filter_get_dsp_buffers(struct pw_filter *filter,
+		enum pw_direction direction, uint32_t *n_ports);
+
 /** Activate or deactivate the filter \memberof pw_filter */
 int pw_filter_set_active(struct pw_filter *filter, bool active);
 
@@ -140,9 +140,15 @@ int pw_global_register(struct pw_global *global)
 
 	spa_list_append(&core->global_list, &global->link);
 	impl->registered = true;
+	global->serial = ++core->registry_serial;
 
 	spa_list_for_each(registry, &core->registry_resource_list, link) {
-		uint32_t permissions = pw_global_get_permissions(global, registry->client);
+		uint32_t permissions;
+
+		if (!pw_registry_resource_match(registry, global))
+			continue;
+
+		permissions = pw_global_get_permissions(global, registry->client);
 		pw_log_debug("registry %p: global %d %08x", registry, global->id, permissions);
 		if (PW_PERM_IS_R(permissions))
 			pw_registry_resource_global(registry,
@@ -159,17 +165,29 @@ int pw_global_register(struct pw_global *global)
 	return 0;
 }
 
+bool pw_global_is_registered(struct pw_global *global)
+{
+	struct impl *impl = SPA_CONTAINER_OF(global, struct impl, this);
+	return impl->registered;
+}
+
 static int global_unregister(struct pw_global *global)
 {
 	struct impl *impl = SPA_CONTAINER_OF(global, struct impl, this);
 	struct pw_core *core = global->core;
 	struct pw_resource *resource;
+	uint32_t idx;
 
 	if (!impl->registered)
 		return 0;
 
 	spa_list_for_each(resource, &core->registry_resource_list, link) {
-		uint32_t permissions = pw_global_get_permissions(global, resource->client);
+		uint32_t permissions;
+
+		if (!pw_registry_resource_match(resource, global))
+			continue;
+
+		permissions = pw_global_get_permissions(global, resource->client);
 		pw_log_debug("registry %p: global %d %08x", resource, global->id, permissions);
 		if (PW_PERM_IS_R(permissions))
 			pw_registry_resource_global_remove(resource, global->id);
@@ -179,6 +197,11 @@ static int global_unregister(struct pw_global *global)
 	pw_map_remove(&core->globals, global->id);
 	impl->registered = false;
 
+	/* remember the removal for registries that resume */
+	idx = core->n_removed++ % PW_CORE_MAX_REMOVED;
+	core->removed[idx].serial = ++core->registry_serial;
+	core->removed[idx].id = global->id;
+
 	pw_log_debug(NAME" %p: unregistered %u", global, global->id);
 	pw_core_emit_global_removed(core, global);
 
@@ -284,8 +307,8 @@ SPA_EXPORT
 int pw_global_update_permissions(struct pw_global *global, struct pw_client *client,
 		uint32_t old_permissions, uint32_t new_permissions)
 {
-	struct pw_core *core = global->core;
 	struct pw_resource *resource, *t;
+	struct registry_data *data;
 	bool do_hide, do_show;
 
 	do_hide = PW_PERM_IS_R(old_permissions) && !PW_PERM_IS_R(new_permissions);
@@ -296,8 +319,15 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_client *cli
 
 	pw_global_emit_permissions_changed(global, client, old_permissions, new_permissions);
 
-	spa_list_for_each(resource, &core->registry_resource_list, link) {
-		if (resource->client != client)
+	/* only the registries of the client need an update and only when
+	 * the visibility changed. Changing the default permissions calls
+	 * this for every global, don't scan all registries of all clients. */
+	if (!do_hide && !do_show)
+		goto update_resources;
+
+	spa_list_for_each(data, &client->registry_list, client_link) {
+		resource = data->resource;
+		if (!pw_registry_resource_match(resource, global))
 			continue;
 
 		if (do_hide) {
@@ -317,6 +347,7 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_client *cli
 		}
 	}
 
+update_resources:
 	spa_list_for_each_safe(resource, t, &global->resource_list, link) {
 		if (resource->client != client)
 			continue;
@@ -44,6 +44,12 @@ extern "C" {
 #define PW_VERSION_CORE_PROXY		3
 struct pw_core_proxy { struct spa_interface iface; };
 #define PW_VERSION_REGISTRY_PROXY	3
+/** registries bound with this version don't get the existing globals
+ * replayed on bind, they use pw_registry_proxy_enum_globals() instead */
+#define PW_VERSION_REGISTRY_PROXY_ENUM	4
+/** registries bound with this version can resume from the state of a
+ * previous connection with pw_registry_proxy_resume() */
+#define PW_VERSION_REGISTRY_PROXY_RESUME	5
 struct pw_registry_proxy { struct spa_interface iface; };
 #define PW_VERSION_MODULE_PROXY		3
 struct pw_module_proxy { struct spa_interface iface; };
@@ -383,11 +389,13 @@ pw_core_proxy_create_object(struct pw_core_proxy *core,
 
 #define PW_REGISTRY_PROXY_EVENT_GLOBAL             0
 #define PW_REGISTRY_PROXY_EVENT_GLOBAL_REMOVE      1
-#define PW_REGISTRY_PROXY_EVENT_NUM                2
+#define PW_REGISTRY_PROXY_EVENT_ENUM_DONE          2
+#define PW_REGISTRY_PROXY_EVENT_RESUME_DONE        3
+#define PW_REGISTRY_PROXY_EVENT_NUM                4
 
 /** Registry events */
 struct pw_registry_proxy_events {
-#define PW_VERSION_REGISTRY_PROXY_EVENTS	0
+#define PW_VERSION_REGISTRY_PROXY_EVENTS	2
 	uint32_t version;
 	/**
 	 * Notify of a new global object
@@ -414,16 +422,44 @@ struct pw_registry_proxy_events {
 	 * \param id the id of the global that was removed
 	 */
 	void (*global_remove) (void *object, uint32_t id);
+	/**
+	 * Notify the end of an enumeration
+	 *
+	 * Emited after the globals of an enum_globals request were
+	 * emited.
+	 *
+	 * \param seq the seq number passed to enum_globals
+	 * \param next_id the start_id to use for the next page or
+	 *		SPA_ID_INVALID when all globals were enumerated
+	 */
+	void (*enum_done) (void *object, int seq, uint32_t next_id);
+	/**
+	 * Notify the end of a resume
+	 *
+	 * Emited after the global and global_remove events of a resume
+	 * request. \a cookie and \a serial identify the current state of
+	 * the registry and can be passed to resume on a later connection.
+	 *
+	 * \param seq the seq number passed to resume
+	 * \param cookie the cookie of the server
+	 * \param serial the serial of the registry
+	 * \param full all globals were emited, globals from the previous
+	 *		connection that were not emited are gone
+	 */
+	void (*resume_done) (void *object, int seq, uint32_t cookie,
+			uint64_t serial, bool full);
 };
 
 #define PW_REGISTRY_PROXY_METHOD_ADD_LISTENER	0
 #define PW_REGISTRY_PROXY_METHOD_BIND		1
 #define PW_REGISTRY_PROXY_METHOD_DESTROY	2
-#define PW_REGISTRY_PROXY_METHOD_NUM		3
+#define PW_REGISTRY_PROXY_METHOD_ENUM_GLOBALS	3
+#define PW_REGISTRY_PROXY_METHOD_RESUME		4
+#define PW_REGISTRY_PROXY_METHOD_NUM		5
 
 /** Registry methods */
 struct pw_registry_proxy_methods {
-#define PW_VERSION_REGISTRY_PROXY_METHODS	0
+#define PW_VERSION_REGISTRY_PROXY_METHODS	2
 	uint32_t version;
 
 	int (*add_listener) (void *object,
@@ -453,6 +489,43 @@ struct pw_registry_proxy_methods {
 	 * \param id the global id to destroy
 	 */
 	int (*destroy) (void *object, uint32_t id);
+
+	/**
+	 * Enumerate the global objects
+	 *
+	 * Emit a global event for the globals with an id of at least
+	 * \a start_id that match the filter, followed by an enum_done
+	 * event. The filter also applies to the global and
+	 * global_remove events emited afterwards.
+	 *
+	 * \param seq a sequence number passed to the enum_done event
+	 * \param type the interface type to match or SPA_ID_INVALID
+	 * \param props properties that must all match, or NULL
+	 * \param start_id the first global id to consider
+	 * \param max_globals the maximum number of globals to emit,
+	 *		0 for no limit
+	 */
+	int (*enum_globals) (void *object, int seq, uint32_t type,
+			const struct spa_dict *props,
+			uint32_t start_id, uint32_t max_globals);
+
+	/**
+	 * Resume from the registry state of a previous connection
+	 *
+	 * When \a cookie and \a serial are from a resume_done event of
+	 * the same server and the changes since then are still known,
+	 * only the globals added since then and global_remove events
+	 * for the removed globals are emited. Otherwise all globals are
+	 * emited. A resume_done event follows in both cases.
+	 *
+	 * The filter of enum_globals applies. Globals are assumed to
+	 * have the same permissions as on the previous connection.
+	 *
+	 * \param seq a sequence number passed to the resume_done event
+	 * \param cookie the cookie of the last resume_done or 0
+	 * \param serial the serial of the last resume_done
+	 */
+	int (*resume) (void *object, int seq, uint32_t cookie, uint64_t serial);
 };
 
 #define pw_registry_proxy_method(o,method,version,...)			\
@@ -481,6 +554,8 @@ pw_registry_proxy_bind(struct pw_registry_proxy *registry,
 }
 
 #define pw_registry_proxy_destroy(p,...)	pw_registry_proxy_method(p,destroy,0,__VA_ARGS__)
+#define pw_registry_proxy_enum_globals(p,...)	pw_registry_proxy_method(p,enum_globals,1,__VA_ARGS__)
+#define pw_registry_proxy_resume(p,...)		pw_registry_proxy_method(p,resume,2,__VA_ARGS__)
 
 
 #define PW_MODULE_PROXY_EVENT_INFO		0
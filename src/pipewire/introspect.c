@@ -82,15 +82,9 @@ const char *pw_link_state_as_string(enum pw_link_state state)
 	return "invalid-state";
 }
 
+/* the dict, the items and the strings are all in one allocation */
 static void pw_spa_dict_destroy(struct spa_dict *dict)
 {
-	const struct spa_dict_item *item;
-
-	spa_dict_for_each(item, dict) {
-		free((void *) item->key);
-		free((void *) item->value);
-	}
-	free((void*)dict->items);
 	free(dict);
 }
 
@@ -98,29 +92,68 @@ static struct spa_dict *pw_spa_dict_copy(struct spa_dict *dict)
 {
 	struct spa_dict *copy;
 	struct spa_dict_item *items;
+	size_t size, len;
 	uint32_t i;
+	char *str;
 
 	if (dict == NULL)
 		return NULL;
 
-	copy = calloc(1, sizeof(struct spa_dict));
+	size = sizeof(struct spa_dict) + dict->n_items * sizeof(struct spa_dict_item);
+	for (i = 0; i < dict->n_items; i++) {
+		size += strlen(dict->items[i].key) + 1;
+		if (dict->items[i].value)
+			size += strlen(dict->items[i].value) + 1;
+	}
+
+	copy = calloc(1, size);
 	if (copy == NULL)
-		goto no_mem;
-	copy->items = items = calloc(dict->n_items, sizeof(struct spa_dict_item));
-	if (copy->items == NULL)
-		goto no_items;
+		return NULL;
+
+	copy->items = items = SPA_MEMBER(copy, sizeof(struct spa_dict), struct spa_dict_item);
 	copy->n_items = dict->n_items;
+	str = SPA_MEMBER(items, dict->n_items * sizeof(struct spa_dict_item), char);
 
 	for (i = 0; i < dict->n_items; i++) {
-		items[i].key = strdup(dict->items[i].key);
-		items[i].value = dict->items[i].value ? strdup(dict->items[i].value) : NULL;
+		len = strlen(dict->items[i].key) + 1;
+		items[i].key = memcpy(str, dict->items[i].key, len);
+		str += len;
+		if (dict->items[i].value) {
+			len = strlen(dict->items[i].value) + 1;
+			items[i].value = memcpy(str, dict->items[i].value, len);
+			str += len;
+		}
 	}
 	return copy;
+}
 
-      no_items:
-	free(copy);
-      no_mem:
-	return NULL;
+static bool pw_spa_dict_equal(const struct spa_dict *d1, const struct spa_dict *d2)
+{
+	uint32_t i;
+
+	if (d1->n_items != d2->n_items)
+		return false;
+
+	for (i = 0; i < d1->n_items; i++) {
+		const struct spa_dict_item *i1 = &d1->items[i], *i2 = &d2->items[i];
+		if (strcmp(i1->key, i2->key) != 0)
+			return false;
+		if (i1->value == NULL || i2->value == NULL ?
+		    i1->value != i2->value : strcmp(i1->value, i2->value) != 0)
+			return false;
+	}
+	return true;
+}
+
+/* keep the current copy when the update has the same items in the same
+ * order, many updates of an info only change the state or params */
+static struct spa_dict *pw_spa_dict_update(struct spa_dict *dict, struct spa_dict *update)
+{
+	if (dict != NULL && update != NULL && pw_spa_dict_equal(dict, update))
+		return dict;
+	if (dict)
+		pw_spa_dict_destroy(dict);
+	return pw_spa_dict_copy(update);
 }
 
 SPA_EXPORT
@@ -145,9 +178,7 @@ struct pw_core_info *pw_core_info_update(struct pw_core_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_CORE_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	return info;
 }
@@ -195,9 +226,7 @@ struct pw_node_info *pw_node_info_update(struct pw_node_info *info,
 		info->error = update->error ? strdup(update->error) : NULL;
 	}
 	if (update->change_mask & PW_NODE_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	if (update->change_mask & PW_NODE_CHANGE_MASK_PARAMS) {
 		info->n_params = update->n_params;
@@ -210,6 +239,10 @@ struct pw_node_info *pw_node_info_update(struct pw_node_info *info,
 		else
 			info->params = NULL;
 	}
+	if (update->change_mask & PW_NODE_CHANGE_MASK_XRUNS) {
+		info->n_xruns = update->n_xruns;
+		info->xrun_delay = update->xrun_delay;
+	}
 	return info;
 }
 
@@ -243,9 +276,7 @@ struct pw_port_info *pw_port_info_update(struct pw_port_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_PORT_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	if (update->change_mask & PW_PORT_CHANGE_MASK_PARAMS) {
 		info->n_params = update->n_params;
@@ -291,9 +322,7 @@ struct pw_factory_info *pw_factory_info_update(struct pw_factory_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_FACTORY_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	return info;
 }
@@ -327,9 +356,7 @@ struct pw_module_info *pw_module_info_update(struct pw_module_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_MODULE_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	return info;
 }
@@ -362,9 +389,7 @@ struct pw_device_info *pw_device_info_update(struct pw_device_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_DEVICE_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	if (update->change_mask & PW_DEVICE_CHANGE_MASK_PARAMS) {
 		info->n_params = update->n_params;
@@ -406,9 +431,7 @@ struct pw_client_info *pw_client_info_update(struct pw_client_info *info,
 	info->change_mask = update->change_mask;
 
 	if (update->change_mask & PW_CLIENT_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	return info;
 }
@@ -452,9 +475,7 @@ struct pw_link_info *pw_link_info_update(struct pw_link_info *info,
 		info->format = update->format ? spa_pod_copy(update->format) : NULL;
 	}
 	if (update->change_mask & PW_LINK_CHANGE_MASK_PROPS) {
-		if (info->props)
-			pw_spa_dict_destroy(info->props);
-		info->props = pw_spa_dict_copy(update->props);
+		info->props = pw_spa_dict_update(info->props, update->props);
 	}
 	return info;
 }
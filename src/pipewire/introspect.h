@@ -167,7 +167,8 @@ struct pw_node_info {
 #define PW_NODE_CHANGE_MASK_STATE		(1 << 2)
 #define PW_NODE_CHANGE_MASK_PROPS		(1 << 3)
 #define PW_NODE_CHANGE_MASK_PARAMS		(1 << 4)
-#define PW_NODE_CHANGE_MASK_ALL			((1 << 5)-1)
+#define PW_NODE_CHANGE_MASK_XRUNS		(1 << 5)
+#define PW_NODE_CHANGE_MASK_ALL			((1 << 6)-1)
 	uint64_t change_mask;			/**< bitfield of changed fields since last call */
 	uint32_t n_input_ports;			/**< number of inputs */
 	uint32_t n_output_ports;		/**< number of outputs */
@@ -176,6 +177,8 @@ struct pw_node_info {
 	struct spa_dict *props;			/**< the properties of the node */
 	struct spa_param_info *params;		/**< parameters */
 	uint32_t n_params;			/**< number of items in \a params */
+	uint32_t n_xruns;			/**< number of late cycles the node was blamed for */
+	uint64_t xrun_delay;			/**< how late the graph was on the last one, in nsec */
 };
 
 struct pw_node_info *
@@ -54,6 +54,19 @@ extern "C" {
 #define PW_KEY_PROTOCOL			"pipewire.protocol"
 #define PW_KEY_ACCESS			"pipewire.access"	/**< how the client access is controlled */
 
+/** protocol statistics of a client, updated by the protocol */
+#define PW_KEY_PROTOCOL_BYTES_IN	"protocol.bytes-in"	/**< bytes received from the client */
+#define PW_KEY_PROTOCOL_BYTES_OUT	"protocol.bytes-out"	/**< bytes sent to the client */
+#define PW_KEY_PROTOCOL_MESSAGES_IN	"protocol.messages-in"	/**< messages received from the client */
+#define PW_KEY_PROTOCOL_MESSAGES_OUT	"protocol.messages-out"	/**< messages sent to the client */
+#define PW_KEY_PROTOCOL_QUEUED		"protocol.queued"	/**< bytes queued for the client */
+#define PW_KEY_PROTOCOL_FLUSH_LATENCY	"protocol.flush-latency" /**< max time in microseconds that
+								  *  queued data waited to be sent */
+#define PW_KEY_PROTOCOL_MAX_QUEUED	"protocol.max-queued"	/**< max bytes queued for a client before
+								  *  it is disconnected, 0 is unlimited */
+#define PW_KEY_PROTOCOL_IO_THREADS	"protocol.io-threads"	/**< number of threads that read client
+								  *  messages, 0 reads on the main loop */
+
 /** Various keys related to the identity of a client process and its security.
  * Must be obtained from trusted sources by the protocol and placed as
  * read-only properties. */
@@ -66,6 +79,30 @@ extern "C" {
 #define PW_KEY_LIBRARY_NAME_LOOP	"library.name.loop"	/**< name of the loop library to use */
 #define PW_KEY_LIBRARY_NAME_DBUS	"library.name.dbus"	/**< name of the dbus library to use */
 
+#define PW_KEY_MEM_HUGEPAGES		"mem.hugepages"		/**< hugepages for the memory of a pool,
+								  *  one of "none", "thp" or "hugetlb" */
+#define PW_KEY_MEM_LOCK			"mem.lock"		/**< populate and lock the mappings of
+								  *  a pool */
+#define PW_KEY_MEM_CACHE_SIZE		"mem.cache-size"	/**< max size in bytes of the unused
+								  *  mappings a pool keeps */
+#define PW_KEY_MEM_DMA_HEAP		"mem.dma-heap"		/**< dma-heap device for dmabuf memory,
+								  *  default /dev/dma_heap/system */
+#define PW_KEY_MEM_QUOTA_BLOCKS		"mem.quota-blocks"	/**< max number of memory blocks of a
+								  *  client, 0 is unlimited */
+#define PW_KEY_MEM_QUOTA_SIZE		"mem.quota-size"	/**< max size in bytes of the memory
+								  *  of a client, 0 is unlimited */
+#define PW_KEY_MEM_BLOCKS		"mem.blocks"		/**< number of memory blocks in use */
+#define PW_KEY_MEM_SIZE			"mem.size"		/**< size in bytes of the memory in use */
+
+#define PW_KEY_LOOP_CPUS		"loop.cpus"		/**< cpus the data loop thread runs on.
+								  *  Ex: "0,2-3" */
+#define PW_KEY_LOOP_RT_PRIO		"loop.rt-prio"		/**< SCHED_FIFO priority of the data
+								  *  loop thread */
+#define PW_KEY_LOOP_PREFAULT		"loop.prefault"		/**< bytes of stack to touch when the
+								  *  data loop thread starts */
+#define PW_KEY_LOOP_CHECK_FAULTS	"loop.check-faults"	/**< warn about page faults in the
+								  *  data loop thread, for debugging */
+
 #define PW_KEY_OBJECT_PATH		"object.path"		/**< unique path to construct the object */
 #define PW_KEY_OBJECT_ID		"object.id"		/**< a global object id */
 
@@ -86,6 +123,11 @@ extern "C" {
 								  *  default env(PIPEWIRE_REMOTE) or pipewire-0 */
 #define PW_KEY_REMOTE_INTENTION		"remote.intention"	/**< The intention of the remote connection,
 								  *  "generic", "screencast" */
+#define PW_KEY_REMOTE_LOCAL_DISPATCH	"remote.local-dispatch"	/**< exported nodes directly run the other
+								  *  exported nodes of the remote they link
+								  *  to instead of waking them up, and a
+								  *  server in the same process and data
+								  *  loop runs them directly, default true */
 
 /** application keys */
 #define PW_KEY_APP_NAME			"application.name"	/**< application name. Ex: "Totem Music Player" */
@@ -133,12 +175,35 @@ extern "C" {
 								  *  node/session */
 #define PW_KEY_NODE_LATENCY		"node.latency"		/**< the requested latency of the node as
 								  *  a fraction. Ex: 128/48000 */
+#define PW_KEY_NODE_PERIOD		"node.period"		/**< the node only needs to run once in this
+								  *  period, as a fraction in seconds. It is
+								  *  not run in the cycles in between. Only
+								  *  for nodes in the process of the graph,
+								  *  not for client nodes. Ex: 1/25 */
 #define PW_KEY_NODE_DONT_RECONNECT	"node.dont-reconnect"	/**< don't reconnect this node */
 #define PW_KEY_NODE_ALWAYS_PROCESS	"node.always-process"	/**< process even when unlinked */
 #define PW_KEY_NODE_PAUSE_ON_IDLE	"node.pause-on-idle"	/**< pause the node when idle */
 #define PW_KEY_NODE_DRIVER		"node.driver"		/**< node can drive the graph */
+#define PW_KEY_NODE_LOOP		"node.loop"		/**< index of the data loop the node
+								  *  runs on when it drives the graph */
+#define PW_KEY_NODE_TRANSPORT_SYNC	"node.transport.sync"	/**< node takes part in the transport sync and
+								  *  calls pw_node_sync_ready() when it is
+								  *  ready to start at a new position */
+#define PW_KEY_NODE_INFO_INTERVAL	"node.info-interval"	/**< minimum time in milliseconds between
+								  *  info and param notifications to clients,
+								  *  0 sends them once per main loop iteration */
 #define PW_KEY_NODE_STREAM		"node.stream"		/**< node is a stream, the server side should
 								  *  add a converter */
+#define PW_KEY_NODE_STATS_WAKEUP	"node.stats.wakeup"	/**< min, avg, max and 99th percentile in
+								  *  microseconds of the time a remote node
+								  *  took to wake up after it was triggered,
+								  *  over the last second */
+#define PW_KEY_NODE_STATS_PROCESS	"node.stats.process"	/**< min, avg, max and 99th percentile in
+								  *  microseconds of the processing time of a
+								  *  remote node, over the last second */
+#define PW_KEY_NODE_STATS_LATE		"node.stats.late"	/**< number of cycles in the last second
+								  *  where a remote node was triggered before
+								  *  it finished the previous cycle */
 /** Port keys */
 #define PW_KEY_PORT_ID			"port.id"		/**< port id */
 #define PW_KEY_PORT_NAME		"port.name"		/**< port name */
@@ -149,6 +214,11 @@ extern "C" {
 #define PW_KEY_PORT_TERMINAL		"port.terminal"		/**< if this port consumes the data */
 #define PW_KEY_PORT_CONTROL		"port.control"		/**< if this port is a control port */
 #define PW_KEY_PORT_MONITOR		"port.monitor"		/**< if this port is a monitor port */
+#define PW_KEY_PORT_NUMA_NODE		"port.numa-node"	/**< preferred NUMA node for the buffer
+								  *  memory of the port */
+#define PW_KEY_PORT_FAN_OUT		"port.fan-out"		/**< share the output buffers with all
+								  *  links and recycle them when the
+								  *  last consumer is done */
 
 /** link properties */
 #define PW_KEY_LINK_ID			"link.id"		/**< a link id */
@@ -159,6 +229,14 @@ extern "C" {
 #define PW_KEY_LINK_PASSIVE		"link.passive"		/**< indicate that a link is passive and
 								  *  does not cause the graph to be
 								  *  runnable. */
+#define PW_KEY_LINK_NUMA_NODE		"link.numa-node"	/**< NUMA node of the buffer memory
+								  *  of the link */
+#define PW_KEY_LINK_BUFFERING		"link.buffering"	/**< buffering of the link, "latency"
+								  *  for the fewest buffers or
+								  *  "throughput" for a deep queue */
+#define PW_KEY_LINK_BUFFERS		"link.buffers"		/**< number of negotiated buffers
+								  *  and the reason, like
+								  *  "2 latency" */
 /** device properties */
 #define PW_KEY_DEVICE_ID		"device.id"		/**< device id */
 #define PW_KEY_DEVICE_NAME		"device.name"		/**< device name */
@@ -221,6 +299,15 @@ extern "C" {
 #define PW_KEY_STREAM_MONITOR		"stream.monitor"	/**< Indicates that the stream is monitoring
 								  *  and might select a less accurate but faster
 								  *  conversion algorithm. */
+#define PW_KEY_STREAM_RING_SIZE		"stream.ring-size"	/**< size in bytes of the ring of a stream
+								  *  with PW_STREAM_FLAG_RING, rounded up to
+								  *  a power of two, default 65536 */
+#define PW_KEY_STREAM_WATERMARK		"stream.watermark"	/**< percentage of the buffers at which the
+								  *  process event is emitted when the stream
+								  *  does not process in the realtime thread.
+								  *  Playback streams are woken when the queued
+								  *  buffers drop to it, capture streams when
+								  *  the available buffers reach it. */
 
 /** object properties */
 #define PW_KEY_OBJECT_LINGER		"object.linger"		/**< the object lives on even after the client
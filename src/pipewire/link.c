@@ -407,6 +407,95 @@ static int select_io(struct pw_link *this)
 	return 0;
 }
 
+/* the NUMA node for the buffer memory, from the port properties or else
+ * the data loop of the consumer and then the producer */
+static int32_t find_numa_node(struct pw_link *this)
+{
+	struct pw_port *ports[2] = { this->input, this->output };
+	const char *str;
+	int i, node;
+
+	for (i = 0; i < 2; i++) {
+		if ((str = pw_properties_get(ports[i]->properties, PW_KEY_PORT_NUMA_NODE)) != NULL)
+			return pw_properties_parse_int(str);
+	}
+	for (i = 0; i < 2; i++) {
+		struct pw_data_loop *loop = ports[i]->node->data_loop_impl;
+		if (loop && (node = pw_data_loop_get_numa_node(loop)) >= 0)
+			return node;
+	}
+	return -1;
+}
+
+static void update_numa_node(struct pw_link *this, int32_t node)
+{
+	const char *str = pw_properties_get(this->properties, PW_KEY_LINK_NUMA_NODE);
+
+	if (node < 0) {
+		if (str == NULL)
+			return;
+		pw_properties_set(this->properties, PW_KEY_LINK_NUMA_NODE, NULL);
+	} else {
+		if (str != NULL && pw_properties_parse_int(str) == node)
+			return;
+		pw_properties_setf(this->properties, PW_KEY_LINK_NUMA_NODE, "%d", node);
+	}
+	pw_log_debug(NAME" %p: buffers on numa node %d", this, node);
+	this->info.change_mask |= PW_LINK_CHANGE_MASK_PROPS;
+	info_changed(this);
+}
+
+/* With fan-out the slowest consumer holds on to a buffer, give the
+ * producer one more buffer for it and one for each other consumer */
+static uint32_t get_fan_out_buffers(struct pw_port *port)
+{
+	const char *str;
+
+	if ((str = pw_properties_get(port->properties, PW_KEY_PORT_FAN_OUT)) == NULL ||
+	    !pw_properties_parse_bool(str))
+		return 0;
+	return SPA_MAX(port->n_mix, 2u) - 1;
+}
+
+#define LINK_BUFFERS_LATENCY	2
+#define LINK_BUFFERS_THROUGHPUT	16
+
+/* the number of buffers asked for with the buffering hint of the link,
+ * 0 leaves the choice to the ports */
+static uint32_t get_target_buffers(struct pw_link *this, const char **reason)
+{
+	const char *str;
+
+	*reason = "default";
+	if ((str = pw_properties_get(this->properties, PW_KEY_LINK_BUFFERING)) == NULL)
+		return 0;
+
+	if (strcmp(str, "latency") == 0) {
+		*reason = "latency";
+		return LINK_BUFFERS_LATENCY;
+	} else if (strcmp(str, "throughput") == 0) {
+		*reason = "throughput";
+		return LINK_BUFFERS_THROUGHPUT;
+	}
+	pw_log_warn(NAME" %p: unknown buffering '%s'", this, str);
+	return 0;
+}
+
+static void update_buffers(struct pw_link *this, uint32_t n_buffers, const char *reason)
+{
+	const char *str = pw_properties_get(this->properties, PW_KEY_LINK_BUFFERS);
+	char val[64];
+
+	snprintf(val, sizeof(val), "%u %s", n_buffers, reason);
+	if (str != NULL && strcmp(str, val) == 0)
+		return;
+
+	pw_log_debug(NAME" %p: using %s buffers", this, val);
+	pw_properties_set(this->properties, PW_KEY_LINK_BUFFERS, val);
+	this->info.change_mask |= PW_LINK_CHANGE_MASK_PROPS;
+	info_changed(this);
+}
+
 static int do_allocation(struct pw_link *this)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -443,10 +532,18 @@ static int do_allocation(struct pw_link *this)
 		this->rt.out_mix.have_buffers = true;
 	} else {
 		uint32_t flags, alloc_flags;
+		int32_t numa_node;
+		const char *reason;
 
 		flags = 0;
 		/* always shared buffers for the link */
 		alloc_flags = PW_BUFFERS_FLAG_SHARED;
+		output->buffers.extra_buffers = get_fan_out_buffers(output);
+		output->buffers.target_buffers = get_target_buffers(this, &reason);
+		if ((numa_node = find_numa_node(this)) >= 0) {
+			SPA_FLAG_SET(alloc_flags, PW_BUFFERS_FLAG_NUMA);
+			output->buffers.numa_node = numa_node;
+		}
 		/* if output port can alloc buffers, alloc skeleton buffers */
 		if (SPA_FLAG_IS_SET(out_flags, SPA_PORT_FLAG_CAN_ALLOC_BUFFERS)) {
 			SPA_FLAG_SET(alloc_flags, PW_BUFFERS_FLAG_NO_MEM);
@@ -463,6 +560,7 @@ static int do_allocation(struct pw_link *this)
 
 		pw_log_debug(NAME" %p: allocating %d buffers %p", this,
 			     output->buffers.n_buffers, output->buffers.buffers);
+		update_buffers(this, output->buffers.n_buffers, reason);
 
 		if ((res = pw_port_use_buffers(output, &this->rt.out_mix, flags,
 						output->buffers.buffers,
@@ -482,6 +580,8 @@ static int do_allocation(struct pw_link *this)
 		}
 	}
 
+	update_numa_node(this, output->buffers.mem ? output->buffers.numa_node : -1);
+
 	pw_log_debug(NAME" %p: using %d buffers %p on input port", this,
 		     output->buffers.n_buffers, output->buffers.buffers);
 
@@ -508,11 +608,8 @@ error:
 	return res;
 }
 
-static int
-do_activate_link(struct spa_loop *loop,
-		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+static void activate_link(struct pw_link *this)
 {
-	struct pw_link *this = user_data;
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 
 	pw_log_trace(NAME" %p: activate", this);
@@ -528,11 +625,45 @@ do_activate_link(struct spa_loop *loop,
 		required = ++this->rt.target.activation->state[0].required;
 		pw_log_trace(NAME" %p: node:%p required:%d", this,
 				impl->inode, required);
+
+		pw_node_update_schedule(impl->onode);
+		if (impl->inode->rt.driver_target.node != impl->onode->rt.driver_target.node)
+			pw_node_update_schedule(impl->inode);
 	}
+}
+
+static int
+do_activate_link(struct spa_loop *loop,
+		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_link *this = user_data;
+
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
+	activate_link(this);
 	return 0;
 }
 
-int pw_link_activate(struct pw_link *this)
+static int
+do_activate_links(struct spa_loop *loop,
+		 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_core *core = user_data;
+	struct pw_link * const *links = data;
+	uint32_t i, n_links = size / sizeof(struct pw_link *);
+
+	if (core->worker_pool)
+		pw_worker_pool_sync(core->worker_pool);
+
+	for (i = 0; i < n_links; i++)
+		activate_link(links[i]);
+	return 0;
+}
+
+/* set up the link for activation, returns 1 when the link can be added
+ * to the graph in the data loop */
+static int prepare_activate(struct pw_link *this)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	int res;
@@ -554,14 +685,70 @@ int pw_link_activate(struct pw_link *this)
 			return res;
 		impl->io_set = true;
 	}
+	return this->info.state == PW_LINK_STATE_PAUSED ? 1 : 0;
+}
 
-	if (this->info.state == PW_LINK_STATE_PAUSED) {
-		pw_loop_invoke(this->output->node->data_loop,
-		       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
-		impl->activated = true;
-	}
+int pw_link_activate(struct pw_link *this)
+{
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+	int res;
+
+	if ((res = prepare_activate(this)) <= 0)
+		return res;
+
+	pw_node_reserve_schedule(impl->onode->driver_node);
+	pw_node_reserve_schedule(impl->inode->driver_node);
+
+	pw_loop_invoke(this->output->node->data_loop,
+	       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
+	impl->activated = true;
 	return 0;
 }
+
+#define MAX_ACTIVATE	64u
+
+/* activate many links with one invoke per data loop so that the data
+ * thread is interrupted and synced with the workers only once */
+int pw_link_activate_links(struct pw_link **links, uint32_t n_links)
+{
+	struct pw_link *batch[MAX_ACTIVATE];
+	struct pw_loop *loop;
+	uint32_t i, j, n_ready = 0, n_batch;
+	int res, r = 0;
+
+	for (i = 0; i < n_links; i++) {
+		if ((res = prepare_activate(links[i])) < 0 && r == 0)
+			r = res;
+		if (res > 0)
+			links[n_ready++] = links[i];
+	}
+
+	for (i = 0; i < n_ready; i++) {
+		if (links[i] == NULL)
+			continue;
+
+		loop = links[i]->output->node->data_loop;
+		for (j = i, n_batch = 0; j < n_ready && n_batch < MAX_ACTIVATE; j++) {
+			struct pw_link *l = links[j];
+			struct impl *impl;
+
+			if (l == NULL || l->output->node->data_loop != loop)
+				continue;
+			impl = SPA_CONTAINER_OF(l, struct impl, this);
+			pw_node_reserve_schedule(impl->onode->driver_node);
+			pw_node_reserve_schedule(impl->inode->driver_node);
+			impl->activated = true;
+			batch[n_batch++] = l;
+			links[j] = NULL;
+		}
+		pw_log_debug(NAME" %p: activate %u links", batch[0], n_batch);
+		pw_loop_invoke(loop, do_activate_links, SPA_ID_INVALID,
+				batch, n_batch * sizeof(struct pw_link *), false,
+				batch[0]->core);
+	}
+	return r;
+}
+
 static void check_states(void *obj, void *user_data, int res, uint32_t id)
 {
 	struct pw_link *this = obj;
@@ -723,6 +910,9 @@ do_deactivate_link(struct spa_loop *loop,
 
 	pw_log_trace(NAME" %p: disable %p and %p", this, &this->rt.in_mix, &this->rt.out_mix);
 
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
 	spa_list_remove(&this->rt.out_mix.rt_link);
 	spa_list_remove(&this->rt.in_mix.rt_link);
 
@@ -733,6 +923,10 @@ do_deactivate_link(struct spa_loop *loop,
 		required = --this->rt.target.activation->state[0].required;
 		pw_log_trace(NAME" %p: node:%p required:%d", this,
 				impl->inode, required);
+
+		pw_node_update_schedule(impl->onode);
+		if (impl->inode->rt.driver_target.node != impl->onode->rt.driver_target.node)
+			pw_node_update_schedule(impl->inode);
 	}
 
 	return 0;
@@ -1134,6 +1328,7 @@ struct pw_link *pw_link_new(struct pw_core *core,
 		impl->inode = input_node;
 	}
 
+	this->rt.target.node = impl->inode;
 	this->rt.target.signal = impl->inode->rt.target.signal;
 	this->rt.target.data = impl->inode->rt.target.data;
 
@@ -28,18 +28,24 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 
 #include <spa/utils/list.h>
 #include <spa/buffer/buffer.h>
 
 #include <pipewire/log.h>
+#include <pipewire/keys.h>
 #include <pipewire/map.h>
 #include <pipewire/mem.h>
+#include <pipewire/properties.h>
 
 #define NAME "mempool"
 
@@ -70,6 +76,36 @@ static inline int memfd_create(const char *name, unsigned int flags)
 #define MFD_ALLOW_SEALING 0x0002U
 #endif
 
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB       0x0004U
+#endif
+
+/* mbind(2) policy and flags, see <numaif.h> */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED		1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE		(1 << 1)
+#endif
+#define MAX_NUMA_NODES		256
+
+/* dma-heap allocation ioctl, see <linux/dma-heap.h> */
+struct dma_heap_alloc {
+	uint64_t len;
+	uint32_t fd;
+	uint32_t fd_flags;
+	uint64_t heap_flags;
+};
+#define DMA_HEAP_ALLOC		_IOWR('H', 0x0, struct dma_heap_alloc)
+#define DEFAULT_DMA_HEAP	"/dev/dma_heap/system"
+
+#define DEFAULT_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+#define DEFAULT_CACHE_SIZE	(16 * 1024 * 1024)
+
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC		0x958458f6
+#endif
+
 /* fcntl() seals-related flags */
 
 #ifndef F_LINUX_SPECIFIC_BASE
@@ -103,6 +139,26 @@ struct mempool {
 	struct pw_map map;
 	struct spa_list blocks;
 	uint32_t pagesize;
+
+#define HUGEPAGES_NONE		0
+#define HUGEPAGES_THP		1	/**< advise transparent hugepages on mappings */
+#define HUGEPAGES_HUGETLB	2	/**< allocate blocks from hugetlbfs */
+	uint32_t hugepages;
+	size_t hugepagesize;
+	unsigned int lock:1;		/**< populate and lock mappings */
+	unsigned int lock_failed:1;
+
+	/* unused mappings are kept in the cache, least recently used first,
+	 * until their total size exceeds cache_max */
+	struct spa_list cache;
+	size_t cache_size;
+	size_t cache_max;
+
+	int dma_heap_fd;		/**< opened on first use, -2 when not available */
+
+	struct pw_mempool_stats stats;	/**< blocks and bytes in the pool */
+	uint32_t quota_blocks;		/**< max number of blocks or 0 */
+	uint64_t quota_size;		/**< max number of bytes or 0 */
 };
 
 struct memblock {
@@ -110,15 +166,25 @@ struct memblock {
 	struct spa_list link;
 	struct spa_list mappings;
 	struct spa_list maps;
+	uint32_t pagesize;		/**< page size of hugetlb blocks or 0 */
+	int ro_fd;			/**< read-only reopen of fd or -1 */
+	struct memblock *source;	/**< block this block was imported from */
+	struct spa_list imports;	/**< blocks imported from this block */
+	struct spa_list import_link;
+	unsigned int freeing:1;
 };
 
+/* a mapping holds a ref on its block unless it is in the cache */
 struct mapping {
 	struct memblock *block;
 	int ref;
 	uint32_t offset;
 	uint32_t size;
+	uint32_t flags;
 	unsigned int do_unmap:1;
+	unsigned int cached:1;
 	struct spa_list link;
+	struct spa_list cache_link;
 	void *ptr;
 };
 
@@ -128,6 +194,95 @@ struct memmap {
 	struct spa_list link;
 };
 
+static size_t get_hugepagesize(void)
+{
+	char line[128];
+	size_t size = DEFAULT_HUGEPAGE_SIZE;
+	unsigned long kb;
+	FILE *f;
+
+	if ((f = fopen("/proc/meminfo", "r")) == NULL)
+		return size;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+			size = kb * 1024;
+			break;
+		}
+	}
+	fclose(f);
+	return size;
+}
+
+/* mappings of hugetlbfs files must be aligned to the hugepage size */
+static uint32_t get_fd_hugepagesize(int fd)
+{
+	struct statfs st;
+
+	if (fstatfs(fd, &st) < 0 || (uint32_t)st.f_type != HUGETLBFS_MAGIC)
+		return 0;
+	return st.f_bsize;
+}
+
+static void parse_props(struct mempool *impl, struct pw_properties *props)
+{
+	const char *str;
+
+	if ((str = pw_properties_get(props, PW_KEY_MEM_HUGEPAGES)) != NULL) {
+		if (strcmp(str, "thp") == 0)
+			impl->hugepages = HUGEPAGES_THP;
+		else if (strcmp(str, "hugetlb") == 0)
+			impl->hugepages = HUGEPAGES_HUGETLB;
+		else if (strcmp(str, "none") != 0)
+			pw_log_warn(NAME" %p: unknown hugepages mode '%s'", impl, str);
+	}
+	if ((str = pw_properties_get(props, PW_KEY_MEM_LOCK)) != NULL)
+		impl->lock = pw_properties_parse_bool(str);
+	if ((str = pw_properties_get(props, PW_KEY_MEM_CACHE_SIZE)) != NULL)
+		impl->cache_max = pw_properties_parse_uint64(str);
+	if ((str = pw_properties_get(props, PW_KEY_MEM_QUOTA_BLOCKS)) != NULL)
+		impl->quota_blocks = pw_properties_parse_int(str);
+	if ((str = pw_properties_get(props, PW_KEY_MEM_QUOTA_SIZE)) != NULL)
+		impl->quota_size = pw_properties_parse_uint64(str);
+
+	if (impl->hugepages != HUGEPAGES_NONE)
+		impl->hugepagesize = get_hugepagesize();
+
+	pw_log_debug(NAME" %p: hugepages:%u size:%zd lock:%u cache:%zd quota:%u/%"PRIu64, impl,
+			impl->hugepages, impl->hugepagesize, impl->lock, impl->cache_max,
+			impl->quota_blocks, impl->quota_size);
+}
+
+static int check_quota(struct mempool *impl, size_t size)
+{
+	if (impl->quota_blocks > 0 &&
+	    impl->stats.n_blocks + 1 > impl->quota_blocks)
+		goto error;
+	if (impl->quota_size > 0 &&
+	    impl->stats.size + size > impl->quota_size)
+		goto error;
+	return 0;
+error:
+	pw_log_warn(NAME" %p: quota exceeded for %zd bytes, blocks:%u/%u size:%"PRIu64"/%"PRIu64,
+			impl, size, impl->stats.n_blocks, impl->quota_blocks,
+			impl->stats.size, impl->quota_size);
+	return -ENOSPC;
+}
+
+static void add_block(struct mempool *impl, struct memblock *b)
+{
+	b->this.id = pw_map_insert_new(&impl->map, b);
+	spa_list_append(&impl->blocks, &b->link);
+	impl->stats.n_blocks++;
+	impl->stats.size += b->this.size;
+}
+
+/** Create a new memory pool
+ * \param props properties of the pool, ownership is taken.
+ *	\ref PW_KEY_MEM_HUGEPAGES and \ref PW_KEY_MEM_LOCK configure
+ *	the memory of the pool, \ref PW_KEY_MEM_QUOTA_BLOCKS and
+ *	\ref PW_KEY_MEM_QUOTA_SIZE limit it.
+ * \return a new pool or NULL with errno set on error
+ */
 struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 {
 	struct mempool *impl;
@@ -141,9 +296,15 @@ struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 	this->props = props;
 
 	impl->pagesize = sysconf(_SC_PAGESIZE);
+	impl->cache_max = DEFAULT_CACHE_SIZE;
+	impl->dma_heap_fd = -1;
+	spa_list_init(&impl->cache);
 
 	pw_log_debug(NAME" %p: new", this);
 
+	if (props)
+		parse_props(impl, props);
+
 	spa_hook_list_init(&impl->listener_list);
 	pw_map_init(&impl->map, 64, 64);
 	spa_list_init(&impl->blocks);
@@ -168,6 +329,8 @@ void pw_mempool_destroy(struct pw_mempool *pool)
 		pw_memblock_free(&b->this);
 
 	pw_map_clear(&impl->map);
+	if (impl->dma_heap_fd >= 0)
+		close(impl->dma_heap_fd);
 	if (pool->props)
 		pw_properties_free(pool->props);
 	free(impl);
@@ -244,23 +407,71 @@ int pw_memblock_map_old(struct pw_memblock *mem)
 }
 #endif
 
+static inline bool mapping_contains(struct mapping *m,
+		uint32_t flags, uint32_t offset, uint32_t size)
+{
+	return (m->flags & flags) == flags &&
+	    ((m->flags ^ flags) & PW_MEMMAP_FLAG_PRIVATE) == 0 &&
+	    m->offset <= offset && (m->offset + m->size) >= (offset + size);
+}
+
+static void cache_remove(struct mempool *p, struct mapping *m)
+{
+	spa_list_remove(&m->cache_link);
+	p->cache_size -= m->size;
+	m->cached = false;
+}
+
 static struct mapping * memblock_find_mapping(struct memblock *b,
 		uint32_t flags, uint32_t offset, uint32_t size)
 {
 	struct mapping *m;
-	struct pw_mempool *pool = b->this.pool;
+	struct mempool *p = SPA_CONTAINER_OF(b->this.pool, struct mempool, this);
 
 	spa_list_for_each(m, &b->mappings, link) {
-		if (m->offset <= offset && (m->offset + m->size) >= (offset + size)) {
-			pw_log_debug(NAME" %p: found %p id:%d fd:%d offs:%d size:%d ref:%d",
-					pool, &b->this, b->this.id, b->this.fd,
-					offset, size, b->this.ref);
+		if (mapping_contains(m, flags, offset, size)) {
+			pw_log_debug(NAME" %p: found %p id:%d fd:%d offs:%d size:%d ref:%d cached:%d",
+					p, &b->this, b->this.id, b->this.fd,
+					offset, size, b->this.ref, m->cached);
+			if (m->cached) {
+				cache_remove(p, m);
+				b->this.ref++;
+			}
 			return m;
 		}
 	}
 	return NULL;
 }
 
+/* grow the range to include the cached mappings it overlaps or touches,
+ * so that they can be replaced by one mapping */
+static void merge_range(struct memblock *b, uint32_t flags,
+		uint32_t *offset, uint32_t *size)
+{
+	struct mapping *m;
+	uint32_t start = *offset, end = *offset + *size;
+	bool changed;
+
+	do {
+		changed = false;
+		spa_list_for_each(m, &b->mappings, link) {
+			if (!m->cached || m->flags != flags ||
+			    m->offset > end || m->offset + m->size < start)
+				continue;
+			if (m->offset < start || m->offset + m->size > end) {
+				start = SPA_MIN(start, m->offset);
+				end = SPA_MAX(end, m->offset + m->size);
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	*offset = start;
+	*size = end - start;
+}
+
+static void mapping_destroy(struct mapping *m);
+
 static struct mapping * memblock_map(struct memblock *b,
 		enum pw_memmap_flags flags, uint32_t offset, uint32_t size)
 {
@@ -286,6 +497,12 @@ static struct mapping * memblock_map(struct memblock *b,
 	}
 
 
+	if (p->lock)
+		fl |= MAP_POPULATE;
+
+	if (!(flags & PW_MEMMAP_FLAG_PRIVATE))
+		merge_range(b, flags, &offset, &size);
+
 	ptr = mmap(NULL, size, prot, fl, b->this.fd, offset);
 	if (ptr == MAP_FAILED) {
 		pw_log_error(NAME" %p: Failed to mmap memory fd:%d offset:%u size:%u: %m",
@@ -293,6 +510,18 @@ static struct mapping * memblock_map(struct memblock *b,
 		return NULL;
 	}
 
+	if (p->hugepages == HUGEPAGES_THP && size >= p->hugepagesize &&
+	    madvise(ptr, size, MADV_HUGEPAGE) < 0)
+		pw_log_debug(NAME" %p: can't advise hugepages: %m", p);
+
+	/* keep the pages resident so that the data loop never faults on
+	 * them, this usually fails when RLIMIT_MEMLOCK is too low */
+	if (p->lock && mlock(ptr, size) < 0 && !p->lock_failed) {
+		pw_log_warn(NAME" %p: can't lock memory fd:%d size:%u: %m",
+				p, b->this.fd, size);
+		p->lock_failed = true;
+	}
+
 	m = calloc(1, sizeof(struct mapping));
 	if (m == NULL) {
 		munmap(ptr, size);
@@ -303,7 +532,20 @@ static struct mapping * memblock_map(struct memblock *b,
 	m->block = b;
 	m->offset = offset;
 	m->size = size;
+	m->flags = flags;
 	b->this.ref++;
+
+	/* the cached mappings inside the new one are not needed anymore */
+	if (!(flags & PW_MEMMAP_FLAG_PRIVATE)) {
+		struct mapping *t, *tmp;
+
+		spa_list_for_each_safe(t, tmp, &b->mappings, link) {
+			if (t->cached && mapping_contains(m, t->flags, t->offset, t->size)) {
+				cache_remove(p, t);
+				mapping_destroy(t);
+			}
+		}
+	}
 	spa_list_append(&b->mappings, &m->link);
 
         pw_log_debug(NAME" %p: fd:%d map:%p ptr:%p (%d %d)", p,
@@ -312,7 +554,7 @@ static struct mapping * memblock_map(struct memblock *b,
 	return m;
 }
 
-static void mapping_unmap(struct mapping *m)
+static void mapping_destroy(struct mapping *m)
 {
 	struct memblock *b = m->block;
 	struct mempool *p = SPA_CONTAINER_OF(b->this.pool, struct mempool, this);
@@ -324,6 +566,57 @@ static void mapping_unmap(struct mapping *m)
 		munmap(m->ptr, m->size);
 	spa_list_remove(&m->link);
 	free(m);
+}
+
+static void mapping_unmap(struct mapping *m)
+{
+	struct memblock *b = m->block;
+
+	mapping_destroy(m);
+	pw_memblock_unref(&b->this);
+}
+
+static void cache_trim(struct mempool *p)
+{
+	struct mapping *m;
+
+	while (p->cache_size > p->cache_max) {
+		m = spa_list_first(&p->cache, struct mapping, cache_link);
+		cache_remove(p, m);
+		mapping_destroy(m);
+	}
+}
+
+static bool mapping_is_covered(struct mapping *m)
+{
+	struct mapping *t;
+
+	spa_list_for_each(t, &m->block->mappings, link) {
+		if (t != m && mapping_contains(t, m->flags, m->offset, m->size))
+			return true;
+	}
+	return false;
+}
+
+/* an unused mapping is kept in the cache so that it can be used again
+ * without a new mmap, unless another mapping can be used instead */
+static void mapping_release(struct mapping *m)
+{
+	struct memblock *b = m->block;
+	struct mempool *p = SPA_CONTAINER_OF(b->this.pool, struct mempool, this);
+
+	if (b->freeing || m->size > p->cache_max ||
+	    (m->flags & PW_MEMMAP_FLAG_PRIVATE) || mapping_is_covered(m)) {
+		mapping_unmap(m);
+		return;
+	}
+
+	pw_log_debug(NAME" %p: cache mapping:%p fd:%d size:%d", p, m, b->this.fd, m->size);
+
+	m->cached = true;
+	spa_list_append(&p->cache, &m->cache_link);
+	p->cache_size += m->size;
+	cache_trim(p);
 
 	pw_memblock_unref(&b->this);
 }
@@ -338,7 +631,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	struct memmap *mm;
 	struct pw_map_range range;
 
-	pw_map_range_init(&range, offset, size, p->pagesize);
+	pw_map_range_init(&range, offset, size, b->pagesize ? b->pagesize : p->pagesize);
 
 	m = memblock_find_mapping(b, flags, range.offset, range.size);
 	if (m == NULL)
@@ -359,7 +652,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	mm->this.flags = flags;
 	mm->this.offset = offset;
 	mm->this.size = size;
-	mm->this.ptr = SPA_MEMBER(m->ptr, range.start, void);
+	mm->this.ptr = SPA_MEMBER(m->ptr, range.offset - m->offset + range.start, void);
 	if (tag)
 		memcpy(mm->this.tag, tag, sizeof(mm->this.tag));
 
@@ -400,7 +693,7 @@ int pw_memmap_free(struct pw_memmap *map)
 	spa_list_remove(&mm->link);
 
 	if (--m->ref == 0)
-		mapping_unmap(m);
+		mapping_release(m);
 
 	free(mm);
 
@@ -419,10 +712,73 @@ static inline enum pw_memmap_flags block_flags_to_mem(enum pw_memblock_flags fla
 	return fl;
 }
 
+#ifdef USE_MEMFD
+/* hugetlbfs files can only be sized in whole hugepages. The pages are
+ * reserved for the file when it is first mapped, do that here so that
+ * we can use normal pages when there are not enough hugepages. */
+static int hugetlb_memfd_create(struct mempool *impl, size_t size)
+{
+	void *ptr;
+	int fd;
+
+	fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB);
+	if (fd == -1)
+		return -1;
+
+	if (ftruncate(fd, size) < 0)
+		goto error_close;
+
+	ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		goto error_close;
+	munmap(ptr, size);
+
+	return fd;
+
+error_close:
+	close(fd);
+	return -1;
+}
+#endif
+
+/* allocate a dmabuf from the dma-heap of the pool */
+static int dma_heap_alloc(struct mempool *impl, size_t size)
+{
+	struct dma_heap_alloc data;
+
+	if (impl->dma_heap_fd == -1) {
+		const char *path = DEFAULT_DMA_HEAP;
+
+		if (impl->this.props)
+			path = pw_properties_get(impl->this.props, PW_KEY_MEM_DMA_HEAP);
+		if (path == NULL)
+			path = DEFAULT_DMA_HEAP;
+
+		impl->dma_heap_fd = open(path, O_RDWR | O_CLOEXEC);
+		if (impl->dma_heap_fd == -1) {
+			pw_log_warn(NAME" %p: can't open dma-heap %s: %m", impl, path);
+			impl->dma_heap_fd = -2;
+		}
+	}
+	if (impl->dma_heap_fd < 0)
+		return -ENODEV;
+
+	spa_zero(data);
+	data.len = size;
+	data.fd_flags = O_RDWR | O_CLOEXEC;
+	if (ioctl(impl->dma_heap_fd, DMA_HEAP_ALLOC, &data) < 0) {
+		int res = -errno;
+		pw_log_warn(NAME" %p: can't alloc dmabuf of size %zd: %m", impl, size);
+		return res;
+	}
+	return data.fd;
+}
+
 /** Create a new memblock
  * \param pool the pool to use
  * \param flags memblock flags
- * \param type the requested memory type one of enum spa_data_type
+ * \param type the requested memory type one of enum spa_data_type,
+ *	SPA_DATA_DmaBuf memory comes from the \ref PW_KEY_MEM_DMA_HEAP
  * \param size size to allocate
  * \return a memblock structure or NULL with errno on error
  * \memberof pw_memblock
@@ -444,11 +800,35 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 	b->this.flags = flags;
 	b->this.type = type;
 	b->this.size = size;
+	b->ro_fd = -1;
 	spa_list_init(&b->mappings);
 	spa_list_init(&b->maps);
+	spa_list_init(&b->imports);
+
+	if ((res = check_quota(impl, size)) < 0)
+		goto error_free;
+
+	if (type == SPA_DATA_DmaBuf) {
+		if ((res = dma_heap_alloc(impl, size)) < 0)
+			goto error_free;
+		b->this.fd = res;
+		goto map;
+	}
 
 #ifdef USE_MEMFD
-	b->this.fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	b->this.fd = -1;
+	if (impl->hugepages == HUGEPAGES_HUGETLB && size >= impl->hugepagesize) {
+		size_t hsize = SPA_ROUND_UP_N(size, impl->hugepagesize);
+
+		if ((b->this.fd = hugetlb_memfd_create(impl, hsize)) == -1) {
+			pw_log_debug(NAME" %p: no hugepages for size %zd: %m", pool, size);
+		} else {
+			b->this.size = size = hsize;
+			b->pagesize = impl->hugepagesize;
+		}
+	}
+	if (b->this.fd == -1)
+		b->this.fd = memfd_create("pipewire-memfd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
 	if (b->this.fd == -1) {
 		res = -errno;
 		pw_log_error(NAME" %p: Failed to create memfd: %m", pool);
@@ -478,6 +858,8 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		}
 	}
 #endif
+
+map:
 	if (flags & PW_MEMBLOCK_FLAG_MAP && size > 0) {
 		b->this.map = pw_memblock_map(&b->this,
 				block_flags_to_mem(flags), 0, size, NULL);
@@ -489,8 +871,7 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		b->this.ref--;
 	}
 
-	b->this.id = pw_map_insert_new(&impl->map, b);
-	spa_list_append(&impl->blocks, &b->link);
+	add_block(impl, b);
 	pw_log_debug(NAME" %p: mem %p alloc id:%d type:%u", pool, &b->this, b->this.id, type);
 
 	pw_mempool_emit_added(impl, &b->this);
@@ -520,12 +901,12 @@ static struct memblock * mempool_find_fd(struct pw_mempool *pool, int fd)
 	return NULL;
 }
 
-SPA_EXPORT
-struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
-		enum pw_memblock_flags flags, uint32_t type, int fd)
+static struct pw_memblock * mempool_import(struct pw_mempool *pool,
+		enum pw_memblock_flags flags, uint32_t type, int fd, uint32_t size)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct memblock *b;
+	int res;
 
 	b = mempool_find_fd(pool, fd);
 	if (b != NULL) {
@@ -533,20 +914,28 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 		return &b->this;
 	}
 
+	if ((res = check_quota(impl, size)) < 0) {
+		errno = -res;
+		return NULL;
+	}
+
 	b = calloc(1, sizeof(struct memblock));
 	if (b == NULL)
 		return NULL;
 
 	spa_list_init(&b->maps);
 	spa_list_init(&b->mappings);
+	spa_list_init(&b->imports);
 
 	b->this.ref = 1;
 	b->this.pool = pool;
 	b->this.type = type;
 	b->this.fd = fd;
 	b->this.flags = flags;
-	b->this.id = pw_map_insert_new(&impl->map, b);
-	spa_list_append(&impl->blocks, &b->link);
+	b->this.size = size;
+	b->ro_fd = -1;
+	b->pagesize = get_fd_hugepagesize(fd);
+	add_block(impl, b);
 
 	pw_log_debug(NAME" %p: import %p id:%u flags:%08x type:%u fd:%d",
 			pool, b, b->this.id, flags, type, fd);
@@ -556,13 +945,83 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 	return &b->this;
 }
 
+/* remember where an imported block came from, a block is imported only
+ * once in a pool so it is linked to at most one source */
+static void link_import(struct pw_memblock *mem, struct pw_memblock *block)
+{
+	struct memblock *s = SPA_CONTAINER_OF(mem, struct memblock, this);
+	struct memblock *b = SPA_CONTAINER_OF(block, struct memblock, this);
+
+	if (b->source != NULL || b == s)
+		return;
+	b->source = s;
+	spa_list_append(&s->imports, &b->import_link);
+}
+
+SPA_EXPORT
+struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
+		enum pw_memblock_flags flags, uint32_t type, int fd)
+{
+	struct stat st;
+	uint32_t size = 0;
+
+	if (type == SPA_DATA_MemFd && fstat(fd, &st) == 0)
+		size = st.st_size;
+
+	return mempool_import(pool, flags, type, fd, size);
+}
+
 SPA_EXPORT
 struct pw_memblock * pw_mempool_import_block(struct pw_mempool *pool,
 		struct pw_memblock *mem)
 {
-	return pw_mempool_import(pool,
+	struct pw_memblock *block;
+
+	block = mempool_import(pool,
 			mem->flags | PW_MEMBLOCK_FLAG_DONT_CLOSE,
-			mem->type, mem->fd);
+			mem->type, mem->fd, mem->size);
+	if (block != NULL)
+		link_import(mem, block);
+	return block;
+}
+
+/** Import a block from another pool as read-only
+ * \param pool the pool to import into
+ * \param mem the block to import
+ * \return a new block or NULL on error
+ *
+ * memfd blocks are imported with a read-only reopen of the fd so that
+ * the kernel refuses writable mappings in the importer. Other blocks
+ * are imported as with pw_mempool_import_block().
+ */
+SPA_EXPORT
+struct pw_memblock * pw_mempool_import_block_readonly(struct pw_mempool *pool,
+		struct pw_memblock *mem)
+{
+	struct memblock *b = SPA_CONTAINER_OF(mem, struct memblock, this);
+	struct pw_memblock *block;
+	char path[64];
+
+	if (mem->type != SPA_DATA_MemFd || mem->fd < 0)
+		return pw_mempool_import_block(pool, mem);
+
+	if (b->ro_fd == -1) {
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", mem->fd);
+		b->ro_fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (b->ro_fd == -1) {
+			pw_log_debug(NAME" %p: can't reopen fd:%d read-only: %m",
+					mem->pool, mem->fd);
+			return pw_mempool_import_block(pool, mem);
+		}
+		pw_log_debug(NAME" %p: block %p fd:%d read-only fd:%d",
+				mem->pool, mem, mem->fd, b->ro_fd);
+	}
+	block = mempool_import(pool,
+			PW_MEMBLOCK_FLAG_READABLE | PW_MEMBLOCK_FLAG_DONT_CLOSE,
+			mem->type, b->ro_fd, mem->size);
+	if (block != NULL)
+		link_import(mem, block);
+	return block;
 }
 
 SPA_EXPORT
@@ -636,7 +1095,9 @@ void pw_memblock_free(struct pw_memblock *block)
 	struct memblock *b = SPA_CONTAINER_OF(block, struct memblock, this);
 	struct pw_mempool *pool = block->pool;
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	struct memblock *i;
 	struct memmap *mm;
+	struct mapping *m;
 
 	spa_return_if_fail(block != NULL);
 
@@ -646,22 +1107,87 @@ void pw_memblock_free(struct pw_memblock *block)
 	block->ref++;
 	if (block->map)
 		block->ref++;
+	b->freeing = true;
 
 	pw_map_remove(&impl->map, block->id);
 	spa_list_remove(&b->link);
+	impl->stats.n_blocks--;
+	impl->stats.size -= block->size;
 
 	pw_mempool_emit_removed(impl, block);
 
+	if (b->source != NULL)
+		spa_list_remove(&b->import_link);
+	spa_list_consume(i, &b->imports, import_link) {
+		spa_list_remove(&i->import_link);
+		i->source = NULL;
+	}
+
 	spa_list_consume(mm, &b->maps, link)
 		pw_memmap_free(&mm->this);
 
+	spa_list_consume(m, &b->mappings, link) {
+		if (m->cached)
+			cache_remove(impl, m);
+		mapping_destroy(m);
+	}
+
 	if (block->fd != -1 && !(block->flags & PW_MEMBLOCK_FLAG_DONT_CLOSE)) {
 		pw_log_debug(NAME" %p: close fd:%d", pool, block->fd);
 		close(block->fd);
 	}
+	if (b->ro_fd != -1)
+		close(b->ro_fd);
 	free(b);
 }
 
+/** Check if a memblock is imported in other pools
+ * \param block a memblock
+ * \return true when blocks imported from \a block with
+ *	pw_mempool_import_block() or pw_mempool_import_block_readonly()
+ *	are still alive
+ * \memberof pw_memblock
+ */
+SPA_EXPORT
+bool pw_memblock_is_imported(struct pw_memblock *block)
+{
+	struct memblock *b = SPA_CONTAINER_OF(block, struct memblock, this);
+	return !spa_list_is_empty(&b->imports);
+}
+
+/** Place the memory of a memblock on a NUMA node
+ * \param block a memblock with a map
+ * \param node the NUMA node
+ * \return 0 on success, < 0 on error
+ *
+ * Pages that are allocated later come from \a node when possible,
+ * pages that are already allocated are moved.
+ * \memberof pw_memblock
+ */
+SPA_EXPORT
+int pw_memblock_set_numa_node(struct pw_memblock *block, int node)
+{
+	unsigned long mask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+	struct pw_memmap *map = block->map;
+
+	if (map == NULL || node < 0 || node >= MAX_NUMA_NODES)
+		return -EINVAL;
+
+	spa_zero(mask);
+	mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+#ifdef SYS_mbind
+	if (syscall(SYS_mbind, map->ptr, map->size, MPOL_PREFERRED,
+				mask, MAX_NUMA_NODES + 1, MPOL_MF_MOVE) < 0)
+		return -errno;
+#else
+	return -ENOTSUP;
+#endif
+	pw_log_debug(NAME" %p: block %p id:%u on numa node %d",
+			block->pool, block, block->id, node);
+	return 0;
+}
+
 SPA_EXPORT
 struct pw_memblock * pw_mempool_find_ptr(struct pw_mempool *pool, const void *ptr)
 {
@@ -695,6 +1221,17 @@ struct pw_memblock * pw_mempool_find_id(struct pw_mempool *pool, uint32_t id)
 	return &b->this;
 }
 
+/** Get the number of blocks and bytes in a pool
+ * \param pool a pool
+ * \param stats filled with the totals
+ */
+SPA_EXPORT
+void pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats)
+{
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
+	*stats = impl->stats;
+}
+
 SPA_EXPORT
 struct pw_memblock * pw_mempool_find_fd(struct pw_mempool *pool, int fd)
 {
@@ -59,6 +59,12 @@ struct pw_mempool {
 	struct pw_properties *props;
 };
 
+/** accounting of the memory in a pool */
+struct pw_mempool_stats {
+	uint32_t n_blocks;	/**< number of blocks */
+	uint64_t size;		/**< total size of the blocks in bytes */
+};
+
 /** \class pw_memblock
  * Memory block structure */
 struct pw_memblock {
@@ -117,6 +123,10 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool,
 struct pw_memblock * pw_mempool_import_block(struct pw_mempool *pool,
 		struct pw_memblock *mem);
 
+/** Import a block from another pool, mappable read-only */
+struct pw_memblock * pw_mempool_import_block_readonly(struct pw_mempool *pool,
+		struct pw_memblock *mem);
+
 /** Import an fd into the pool */
 struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 		enum pw_memblock_flags flags, uint32_t type, int fd);
@@ -124,6 +134,12 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 /** Free a memblock regardless of the refcount and destroy all mappings */
 void pw_memblock_free(struct pw_memblock *mem);
 
+/** Check if blocks imported from \a mem are still alive */
+bool pw_memblock_is_imported(struct pw_memblock *mem);
+
+/** Place the memory of a mapped memblock on a NUMA node */
+int pw_memblock_set_numa_node(struct pw_memblock *block, int node);
+
 /** Unref a memblock */
 static inline void pw_memblock_unref(struct pw_memblock *mem)
 {
@@ -140,6 +156,9 @@ struct pw_memblock * pw_mempool_find_ptr(struct pw_mempool *pool, const void *pt
 /** Find memblock for given \a id */
 struct pw_memblock * pw_mempool_find_id(struct pw_mempool *pool, uint32_t id);
 
+/** Get the accounting of a pool */
+void pw_mempool_get_stats(struct pw_mempool *pool, struct pw_mempool_stats *stats);
+
 /** Find memblock for given \a fd */
 struct pw_memblock * pw_mempool_find_fd(struct pw_mempool *pool, int fd);
 
@@ -30,6 +30,8 @@
 #include <time.h>
 #include <sys/eventfd.h>
 
+#include "config.h"
+
 #include <spa/support/system.h>
 #include <spa/pod/parser.h>
 #include <spa/node/utils.h>
@@ -55,7 +57,16 @@ struct impl {
 
 	int last_error;
 
+	struct pw_data_loop *home_loop;		/**< data loop selected with node.loop */
+
+	struct spa_source *notify_timer;	/**< flushes coalesced notifications */
+	uint64_t notify_interval;		/**< min nsec between notifications */
+	uint64_t last_notify;
+	uint32_t pending_params[MAX_PARAMS];	/**< changed param ids to notify */
+	uint32_t n_pending_params;
+
 	unsigned int pause_on_idle:1;
+	unsigned int notify_pending:1;
 };
 
 #define pw_node_resource(r,m,v,...)	pw_resource_call(r,struct pw_node_proxy_events,m,v,__VA_ARGS__)
@@ -72,6 +83,8 @@ struct resource_data {
 	uint32_t subscribe_ids[MAX_PARAMS];
 	uint32_t n_subscribe_ids;
 
+	uint64_t pending_info;		/**< accumulated info change_mask */
+
 	/* for async replies */
 	int seq;
 	int end;
@@ -80,6 +93,9 @@ struct resource_data {
 
 /** \endcond */
 
+static int schedule_node(void *data);
+static int signal_driver(void *data);
+
 static void node_deactivate(struct pw_node *this)
 {
 	struct pw_port *port;
@@ -96,6 +112,206 @@ static void node_deactivate(struct pw_node *this)
 	}
 }
 
+/* index of the node of @t in the schedule being compiled or SPA_ID_INVALID */
+static inline uint32_t target_index(struct pw_node_schedule *s, uint32_t n_nodes,
+		struct pw_node_target *t)
+{
+	struct pw_node *n = t->node;
+
+	if (n == NULL || n->rt.sched_index >= n_nodes || s->nodes[n->rt.sched_index] != n)
+		return SPA_ID_INVALID;
+	return n->rt.sched_index;
+}
+
+/* Compile the target lists of the driver and its followers into the
+ * schedule of the driver. This runs in the data loop when the graph of
+ * the driver changes and only uses the storage that was reserved in the
+ * main thread.
+ *
+ * The nodes are sorted so that a node comes after the nodes that signal
+ * it, the required counts and the targets to signal are copied so that
+ * the cycle does not need to walk the lists. Nodes in a feedback loop
+ * are placed at the end. */
+static void compile_schedule(struct pw_node *driver)
+{
+	struct pw_node_schedule *s = &driver->rt.schedule;
+	struct pw_node_target *t;
+	struct pw_node *n;
+	uint32_t i, j, n_nodes = 0, n_targets = 0, head = 0, tail = 0;
+
+	spa_list_for_each(t, &driver->rt.target_list, link) {
+		if (t->node == NULL)
+			continue;
+		if (n_nodes == s->max_entries)
+			goto overflow;
+		t->node->rt.sched_index = n_nodes;
+		s->nodes[n_nodes] = t->node;
+		s->count[n_nodes++] = 0;
+	}
+
+	/* count the peers that signal each node, the driver signals all
+	 * nodes and is signaled by all nodes so its edges are left out */
+	for (i = 0; i < n_nodes; i++) {
+		spa_list_for_each(t, &s->nodes[i]->rt.target_list, link) {
+			n_targets++;
+			if (s->nodes[i] == driver)
+				continue;
+			j = target_index(s, n_nodes, t);
+			if (j != SPA_ID_INVALID && j != i && s->nodes[j] != driver)
+				s->count[j]++;
+		}
+	}
+	if (n_targets > s->max_targets)
+		goto overflow;
+
+	if ((i = driver->rt.sched_index) < n_nodes && s->nodes[i] == driver)
+		s->queue[tail++] = i;
+	for (i = 0; i < n_nodes; i++) {
+		if (s->count[i] == 0 && s->nodes[i] != driver)
+			s->queue[tail++] = i;
+	}
+	while (head < tail) {
+		i = s->queue[head++];
+		if (s->nodes[i] == driver)
+			continue;
+		spa_list_for_each(t, &s->nodes[i]->rt.target_list, link) {
+			j = target_index(s, n_nodes, t);
+			if (j != SPA_ID_INVALID && j != i && s->nodes[j] != driver &&
+			    --s->count[j] == 0)
+				s->queue[tail++] = j;
+		}
+	}
+	for (i = 0; i < n_nodes; i++) {
+		if (s->count[i] > 0)
+			s->queue[tail++] = i;
+	}
+
+	n_targets = 0;
+	for (i = 0; i < n_nodes; i++) {
+		struct pw_node_schedule_entry *e = &s->entries[i];
+
+		n = s->nodes[s->queue[i]];
+		e->node = n;
+		e->activation = n->rt.target.activation;
+		e->required = e->activation->state[0].required;
+		e->targets = &s->targets[n_targets];
+		e->n_targets = 0;
+
+		spa_list_for_each(t, &n->rt.target_list, link) {
+			struct pw_node_schedule_target *st = &e->targets[e->n_targets++];
+			st->activation = t->activation;
+			st->signal = t->signal;
+			st->data = t->data;
+			st->id = t->node ? t->node->info.id : SPA_ID_INVALID;
+		}
+		n_targets += e->n_targets;
+		n->rt.sched = e;
+	}
+	s->n_entries = n_nodes;
+	s->valid = true;
+
+	pw_log_trace(NAME" %p: compiled schedule with %u nodes %u targets",
+			driver, n_nodes, n_targets);
+	return;
+
+overflow:
+	pw_log_warn(NAME" %p: schedule does not fit %u/%u, using target lists",
+			driver, s->max_entries, s->max_targets);
+	spa_list_for_each(t, &driver->rt.target_list, link) {
+		if (t->node != NULL)
+			t->node->rt.sched = NULL;
+	}
+	s->n_entries = 0;
+	s->valid = false;
+}
+
+void pw_node_update_schedule(struct pw_node *node)
+{
+	struct pw_node *driver = node->rt.driver_target.node;
+
+	if (driver != NULL && !node->exported)
+		compile_schedule(driver);
+}
+
+static int
+do_swap_schedule(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node *driver = user_data;
+	struct pw_node_schedule *s = *(struct pw_node_schedule **)data, tmp;
+
+	if (driver->core->worker_pool)
+		pw_worker_pool_sync(driver->core->worker_pool);
+
+	tmp = driver->rt.schedule;
+	driver->rt.schedule = *s;
+	*s = tmp;
+	compile_schedule(driver);
+	return 0;
+}
+
+static void free_schedule(struct pw_node_schedule *s)
+{
+	free(s->entries);
+	spa_zero(*s);
+}
+
+int pw_node_reserve_schedule(struct pw_node *driver)
+{
+	struct pw_core *core = driver->core;
+	struct pw_node_schedule s, *sp = &s;
+	struct pw_node *n;
+	struct pw_link *l;
+	uint32_t n_nodes = 0, n_links = 0, n_targets;
+	size_t size;
+	void *p;
+
+	if (driver->exported)
+		return 0;
+
+	/* the graph of a driver is never larger than all the nodes and links,
+	 * each node has its target in the driver and signals the driver and
+	 * each link is a target of its output node */
+	spa_list_for_each(n, &core->node_list, link)
+		n_nodes++;
+	spa_list_for_each(l, &core->link_list, link)
+		n_links++;
+	/* the driver is not in the list before it is registered */
+	n_nodes = SPA_MAX(n_nodes, 1u);
+	n_targets = 2 * n_nodes + n_links;
+
+	if (n_nodes <= driver->rt.schedule.max_entries &&
+	    n_targets <= driver->rt.schedule.max_targets)
+		return 0;
+
+	spa_zero(s);
+	s.max_entries = SPA_MAX(2 * n_nodes, 16u);
+	s.max_targets = SPA_MAX(2 * n_targets, 32u);
+
+	size = s.max_entries * (sizeof(struct pw_node_schedule_entry) +
+			sizeof(struct pw_node *) + 2 * sizeof(uint32_t)) +
+		s.max_targets * sizeof(struct pw_node_schedule_target);
+	if ((p = calloc(1, size)) == NULL)
+		return -errno;
+
+	s.entries = p;
+	s.targets = SPA_MEMBER(s.entries, s.max_entries * sizeof(struct pw_node_schedule_entry),
+			struct pw_node_schedule_target);
+	s.nodes = SPA_MEMBER(s.targets, s.max_targets * sizeof(struct pw_node_schedule_target),
+			struct pw_node *);
+	s.count = SPA_MEMBER(s.nodes, s.max_entries * sizeof(struct pw_node *), uint32_t);
+	s.queue = SPA_MEMBER(s.count, s.max_entries * sizeof(uint32_t), uint32_t);
+
+	pw_log_debug(NAME" %p: reserve schedule for %u nodes %u targets", driver,
+			s.max_entries, s.max_targets);
+
+	pw_loop_invoke(driver->data_loop, do_swap_schedule, SPA_ID_INVALID,
+			&sp, sizeof(sp), true, driver);
+
+	free_schedule(&s);
+	return 0;
+}
+
 static void add_node(struct pw_node *this, struct pw_node *driver)
 {
 	uint32_t rdriver, rnode;
@@ -109,17 +325,24 @@ static void add_node(struct pw_node *this, struct pw_node *driver)
 	this->rt.driver_target.activation = driver->rt.activation;
 	this->rt.driver_target.node = driver;
 	this->rt.driver_target.data = driver;
+	if (this->core->worker_pool)
+		this->rt.driver_target.signal = schedule_node;
+	else if (this->core->n_data_loops > 1)
+		this->rt.driver_target.signal = signal_driver;
 	spa_list_append(&this->rt.target_list, &this->rt.driver_target.link);
 	rdriver = ++this->rt.driver_target.activation->state[0].required;
 
 	spa_list_append(&driver->rt.target_list, &this->rt.target.link);
 	rnode = ++this->rt.activation->state[0].required;
 
+	compile_schedule(driver);
+
 	pw_log_trace(NAME" %p: required driver:%d node:%d", this, rdriver, rnode);
 }
 
 static void remove_node(struct pw_node *this)
 {
+	struct pw_node *driver = this->rt.driver_target.node;
 	uint32_t rdriver, rnode;
 
 	if (this->exported)
@@ -135,6 +358,10 @@ static void remove_node(struct pw_node *this)
 	spa_list_remove(&this->rt.target.link);
 	rnode = --this->rt.activation->state[0].required;
 
+	this->rt.sched = NULL;
+	this->rt.driver_target.node = NULL;
+	compile_schedule(driver);
+
 	pw_log_trace(NAME" %p: required driver:%d node:%d", this, rdriver, rnode);
 }
 
@@ -143,6 +370,10 @@ do_node_remove(struct spa_loop *loop,
 	       bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct pw_node *this = user_data;
+
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
 	if (this->source.loop != NULL) {
 		spa_loop_remove_source(loop, &this->source);
 		remove_node(this);
@@ -180,6 +411,9 @@ do_node_add(struct spa_loop *loop,
 	struct pw_node *this = user_data;
 	struct pw_node *driver = this->driver_node;
 
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
 	if (this->source.loop == NULL) {
 		spa_loop_add_source(loop, &this->source);
 		add_node(this, driver);
@@ -212,20 +446,31 @@ static int start_node(struct pw_node *this)
 	return res;
 }
 
+static void schedule_notify(struct pw_node *node);
+
 static void emit_info_changed(struct pw_node *node)
 {
 	struct pw_resource *resource;
+	bool pending = false;
 
 	if (node->info.change_mask == 0)
 		return;
 
 	pw_node_emit_info_changed(node, &node->info);
 
-	if (node->global)
-		spa_list_for_each(resource, &node->global->resource_list, link)
-			pw_node_resource_info(resource, &node->info);
-
+	/* resources get the accumulated changes in one go from
+	 * flush_notify() */
+	if (node->global) {
+		spa_list_for_each(resource, &node->global->resource_list, link) {
+			struct resource_data *data = pw_resource_get_user_data(resource);
+			data->pending_info |= node->info.change_mask;
+			pending = true;
+		}
+	}
 	node->info.change_mask = 0;
+
+	if (pending)
+		schedule_notify(node);
 }
 
 static int resource_is_subscribed(struct pw_resource *resource, uint32_t id)
@@ -285,6 +530,99 @@ static void emit_params(struct pw_node *node, uint32_t *changed_ids, uint32_t n_
 	}
 }
 
+static void flush_notify(struct pw_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_resource *resource;
+	struct timespec now;
+	uint64_t change_mask;
+
+	impl->notify_pending = false;
+
+	spa_system_clock_gettime(node->core->main_loop->system, CLOCK_MONOTONIC, &now);
+	impl->last_notify = SPA_TIMESPEC_TO_NSEC(&now);
+
+	if (node->global == NULL) {
+		impl->n_pending_params = 0;
+		return;
+	}
+
+	change_mask = node->info.change_mask;
+	spa_list_for_each(resource, &node->global->resource_list, link) {
+		struct resource_data *data = pw_resource_get_user_data(resource);
+
+		if (data->pending_info == 0)
+			continue;
+
+		node->info.change_mask = data->pending_info;
+		pw_node_resource_info(resource, &node->info);
+		data->pending_info = 0;
+	}
+	node->info.change_mask = change_mask;
+
+	if (impl->n_pending_params > 0) {
+		uint32_t n_changed_ids = impl->n_pending_params;
+		impl->n_pending_params = 0;
+		emit_params(node, impl->pending_params, n_changed_ids);
+	}
+}
+
+static void on_notify_timeout(void *data, uint64_t expirations)
+{
+	flush_notify(data);
+}
+
+/* send the notifications after the current main loop iteration and no
+ * sooner than notify_interval after the previous ones so that bursts of
+ * changes are coalesced into one update with the final state */
+static void schedule_notify(struct pw_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct pw_loop *loop = node->core->main_loop;
+	struct timespec value;
+	uint64_t next;
+
+	if (impl->notify_pending)
+		return;
+
+	if (impl->notify_timer == NULL) {
+		impl->notify_timer = pw_loop_add_timer(loop, on_notify_timeout, node);
+		if (impl->notify_timer == NULL) {
+			pw_log_warn(NAME" %p: can't create notify timer: %m", node);
+			flush_notify(node);
+			return;
+		}
+	}
+
+	/* an absolute time in the past expires on the next iteration */
+	next = SPA_MAX(impl->last_notify + impl->notify_interval, 1u);
+	value.tv_sec = next / SPA_NSEC_PER_SEC;
+	value.tv_nsec = next % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(loop, impl->notify_timer, &value, NULL, true);
+
+	impl->notify_pending = true;
+}
+
+static void queue_params(struct pw_node *node, uint32_t *changed_ids, uint32_t n_changed_ids)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	uint32_t i, j;
+
+	if (node->global == NULL || n_changed_ids == 0)
+		return;
+
+	for (i = 0; i < n_changed_ids; i++) {
+		for (j = 0; j < impl->n_pending_params; j++) {
+			if (impl->pending_params[j] == changed_ids[i])
+				break;
+		}
+		if (j == impl->n_pending_params &&
+		    impl->n_pending_params < SPA_N_ELEMENTS(impl->pending_params))
+			impl->pending_params[impl->n_pending_params++] = changed_ids[i];
+	}
+	schedule_notify(node);
+}
+
 static void node_update_state(struct pw_node *node, enum pw_node_state state, char *error)
 {
 	enum pw_node_state old;
@@ -307,6 +645,7 @@ static void node_update_state(struct pw_node *node, enum pw_node_state state, ch
 
 	switch (state) {
 	case PW_NODE_STATE_RUNNING:
+		pw_node_reserve_schedule(node->driver_node);
 		pw_loop_invoke(node->data_loop, do_node_add, 1, NULL, 0, true, node);
 		break;
 	default:
@@ -652,6 +991,9 @@ do_move_nodes(struct spa_loop *loop,
 
 	pw_log_trace(NAME" %p: driver:%p->%p", this, this->driver_node, driver);
 
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
 	if (this->source.loop != NULL) {
 		remove_node(this);
 		add_node(this, driver);
@@ -659,6 +1001,61 @@ do_move_nodes(struct spa_loop *loop,
 	return 0;
 }
 
+static int
+do_node_detach(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node *this = user_data;
+
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
+	if (this->source.loop == NULL)
+		return 0;
+
+	spa_loop_remove_source(loop, &this->source);
+	remove_node(this);
+	return 1;
+}
+
+static int
+do_node_attach(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node *this = user_data;
+	struct pw_node *driver = *(struct pw_node **)data;
+
+	if (this->core->worker_pool)
+		pw_worker_pool_sync(this->core->worker_pool);
+
+	spa_loop_add_source(loop, &this->source);
+	add_node(this, driver);
+	return 0;
+}
+
+/* A graph runs on the data loop of its driver. Followers are moved to
+ * the loop of the driver by detaching them in the old loop and attaching
+ * them again in the new loop so that each loop only touches its own
+ * graph. */
+static void move_data_loop(struct pw_node *node, struct pw_data_loop *loop,
+		struct pw_node *driver)
+{
+	int res;
+
+	pw_log_debug(NAME" %p: move to data loop %p", node, loop);
+
+	res = pw_loop_invoke(node->data_loop,
+		       do_node_detach, SPA_ID_INVALID, NULL, 0, true, node);
+
+	node->data_loop_impl = loop;
+	node->data_loop = pw_data_loop_get_loop(loop);
+
+	if (res > 0)
+		pw_loop_invoke(node->data_loop,
+			       do_node_attach, SPA_ID_INVALID, &driver, sizeof(struct pw_node *),
+			       true, node);
+}
+
 static void remove_segment_master(struct pw_node *driver, uint32_t node_id)
 {
 	struct pw_node_activation *a = driver->rt.activation;
@@ -671,6 +1068,7 @@ int pw_node_set_driver(struct pw_node *node, struct pw_node *driver)
 {
 	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
 	struct pw_node *old = node->driver_node;
+	struct pw_data_loop *loop;
 	int res;
 
 	if (driver == NULL)
@@ -701,9 +1099,15 @@ int pw_node_set_driver(struct pw_node *node, struct pw_node *driver)
 		node->rt.position = &driver->rt.activation->position;
 	}
 
-	pw_loop_invoke(node->data_loop,
-		       do_move_nodes, SPA_ID_INVALID, &driver, sizeof(struct pw_node *),
-		       true, impl);
+	pw_node_reserve_schedule(driver);
+
+	loop = driver == node ? impl->home_loop : driver->data_loop_impl;
+	if (loop != node->data_loop_impl)
+		move_data_loop(node, loop, driver);
+	else
+		pw_loop_invoke(node->data_loop,
+			       do_move_nodes, SPA_ID_INVALID, &driver, sizeof(struct pw_node *),
+			       true, impl);
 	return 0;
 }
 
@@ -749,6 +1153,15 @@ static void check_properties(struct pw_node *node)
 	else
 		node->want_driver = false;
 
+	if ((str = pw_properties_get(node->properties, PW_KEY_NODE_INFO_INTERVAL)) == NULL)
+		str = pw_properties_get(node->core->properties, PW_KEY_NODE_INFO_INTERVAL);
+	impl->notify_interval = str ? pw_properties_parse_uint64(str) * SPA_NSEC_PER_MSEC : 0;
+
+	if ((str = pw_properties_get(node->properties, PW_KEY_NODE_TRANSPORT_SYNC)))
+		node->transport_sync = pw_properties_parse_bool(str);
+	else
+		node->transport_sync = false;
+
 	if (node->driver != driver) {
 		pw_log_info(NAME" %p: driver %d -> %d", node, node->driver, driver);
 		node->driver = driver;
@@ -775,6 +1188,14 @@ static void check_properties(struct pw_node *node)
 			}
 		}
 	}
+	node->rt.period = 0;
+	if ((str = pw_properties_get(node->properties, PW_KEY_NODE_PERIOD))) {
+		uint32_t num, denom;
+		if (sscanf(str, "%u/%u", &num, &denom) == 2 && denom != 0)
+			node->rt.period = (uint64_t)num * SPA_NSEC_PER_SEC / denom;
+		pw_log_info(NAME" %p: period '%s' %"PRIu64, node, str, node->rt.period);
+	}
+
 	pw_log_debug(NAME" %p: driver:%d recalc:%d", node, node->driver, do_recalc);
 
 	if (do_recalc)
@@ -783,28 +1204,229 @@ static void check_properties(struct pw_node *node)
 
 static void dump_states(struct pw_node *driver)
 {
-	struct pw_node_target *t;
+	struct pw_node_schedule *s = &driver->rt.schedule;
+	uint32_t i;
 
-	spa_list_for_each(t, &driver->rt.target_list, link) {
-		struct pw_node_activation *a = t->activation;
-		if (t->node == NULL)
-			continue;
+	for (i = 0; i < s->n_entries; i++) {
+		struct pw_node_schedule_entry *e = &s->entries[i];
+		struct pw_node_activation *a = e->activation;
 		pw_log_warn(NAME" %p (%s): pending:%d/%d s:%"PRIu64" a:%"PRIu64" f:%"PRIu64
 				" waiting:%"PRIu64" process:%"PRIu64" status:%d sync:%d",
-				t->node, t->node->name,
+				e->node, e->node->name,
 				a->state[0].pending, a->state[0].required,
 				a->signal_time,
 				a->awake_time,
 				a->finish_time,
 				a->awake_time - a->signal_time,
 				a->finish_time - a->awake_time,
-				t->activation->status, t->activation->pending_sync);
+				a->status, a->pending_sync);
 	}
 }
 
+#define MAX_PATH	8
+
+struct deadline_report {
+	uint32_t driver_id;
+	uint64_t delay;				/* nsec the graph was late */
+	bool unfinished;			/* the graph did not complete */
+	uint32_t n_path;
+	uint32_t path[MAX_PATH];		/* critical path, culprit first */
+};
+
+/* find the entry that triggered @target last in the previous cycle */
+static struct pw_node_schedule_entry *find_trigger(struct pw_node *driver,
+		struct pw_node_schedule_entry *target)
+{
+	struct pw_node_schedule *s = &driver->rt.schedule;
+	struct pw_node_schedule_entry *e, *best = NULL;
+	uint32_t i, j;
+
+	for (i = 0; i < s->n_entries; i++) {
+		struct pw_node_activation *a;
+
+		e = &s->entries[i];
+		a = e->activation;
+		if (e->node == driver || a->status != PW_NODE_ACTIVATION_FINISHED)
+			continue;
+		if (best && best->activation->finish_time >= a->finish_time)
+			continue;
+
+		for (j = 0; j < e->n_targets; j++) {
+			if (e->targets[j].activation == target->activation) {
+				best = e;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+static void deadline_path_append(struct deadline_report *r, struct pw_node *n)
+{
+	if (r->n_path < MAX_PATH)
+		r->path[r->n_path++] = n->info.id;
+}
+
+/* Walk the timestamps of the previous cycle back from the node that
+ * completed the graph or from the node that got stuck. Each step goes
+ * to the node that triggered the current one last. The node on that
+ * path that took the longest from being triggered to finishing is
+ * blamed for the late cycle and is put first in the path. */
+static void analyze_deadline(struct pw_node *driver, struct deadline_report *r)
+{
+	struct pw_node_schedule *s = &driver->rt.schedule;
+	struct pw_node_schedule_entry *e, *cur = NULL, *culprit = NULL;
+	uint64_t cost, max_cost = 0;
+	uint32_t i, n_steps = 0, n_entries = s->n_entries;
+
+	r->n_path = 0;
+
+	for (i = 0; i < n_entries; i++) {
+		struct pw_node_activation *a;
+
+		e = &s->entries[i];
+		a = e->activation;
+
+		if (e->node == driver)
+			continue;
+
+		if (r->unfinished) {
+			/* a node that was triggered but did not finish stopped
+			 * the graph, prefer the one that is still running */
+			if (a->status == PW_NODE_ACTIVATION_NOT_TRIGGERED ||
+			    a->status == PW_NODE_ACTIVATION_FINISHED)
+				continue;
+			if (cur == NULL ||
+			    (a->status == PW_NODE_ACTIVATION_AWAKE &&
+			     cur->activation->status != PW_NODE_ACTIVATION_AWAKE) ||
+			    (a->status == cur->activation->status &&
+			     a->signal_time < cur->activation->signal_time))
+				cur = e;
+		} else if (a->status == PW_NODE_ACTIVATION_FINISHED &&
+		    (cur == NULL || a->finish_time > cur->activation->finish_time)) {
+			cur = e;
+		}
+	}
+	if (cur == NULL) {
+		/* no follower finished, the driver itself was late */
+		deadline_path_append(r, driver);
+		return;
+	}
+
+	if (r->unfinished) {
+		/* nothing to compare against, the stuck node is the culprit */
+		culprit = cur;
+		deadline_path_append(r, cur->node);
+		cur = find_trigger(driver, cur);
+	}
+
+	for (; cur != NULL && n_steps < n_entries; n_steps++) {
+		struct pw_node_activation *a = cur->activation;
+
+		cost = a->finish_time - a->signal_time;
+		if (!r->unfinished && (culprit == NULL || cost > max_cost)) {
+			culprit = cur;
+			max_cost = cost;
+		}
+		deadline_path_append(r, cur->node);
+		cur = find_trigger(driver, cur);
+	}
+
+	/* move the culprit to the front */
+	for (i = 0; i < r->n_path; i++) {
+		if (r->path[i] == culprit->node->info.id) {
+			SPA_SWAP(r->path[0], r->path[i]);
+			break;
+		}
+	}
+}
+
+static int do_report_deadline(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_core *core = user_data;
+	const struct deadline_report *r = data;
+	struct pw_global *global;
+	struct pw_node *node, *driver = NULL;
+	char path[256];
+	uint32_t i;
+	int len = 0;
+
+	if ((global = pw_core_find_global(core, r->driver_id)) != NULL &&
+	    pw_global_get_type(global) == PW_TYPE_INTERFACE_Node)
+		driver = pw_global_get_object(global);
+
+	path[0] = '\0';
+	for (i = 0; i < r->n_path; i++) {
+		const char *name = "?";
+
+		if ((global = pw_core_find_global(core, r->path[i])) == NULL ||
+		    pw_global_get_type(global) != PW_TYPE_INTERFACE_Node)
+			continue;
+
+		node = pw_global_get_object(global);
+		name = node->name;
+
+		if (i == 0) {
+			node->info.n_xruns++;
+			node->info.xrun_delay = r->delay;
+			node->info.change_mask |= PW_NODE_CHANGE_MASK_XRUNS;
+			emit_info_changed(node);
+		}
+		if (len < (int)sizeof(path))
+			len += snprintf(path + len, sizeof(path) - len, "%s%d:%s",
+					i == 0 ? "" : " <- ", r->path[i], name);
+	}
+
+	pw_log_warn(NAME" %p: driver %d (%s) %s by %"PRIu64"us, critical path: %s",
+			driver, r->driver_id, driver ? driver->name : "?",
+			r->unfinished ? "did not complete" : "missed its deadline",
+			r->delay / 1000, r->n_path ? path : "unknown");
+	return 0;
+}
+
+/* Called at the start of a cycle, before the activations are reset.
+ * When the previous cycle did not complete or completed after the end
+ * of its period, find the node that caused it and hand it over to the
+ * main thread for reporting. */
+static void check_deadline(struct pw_node *driver, struct pw_node_activation *a, bool overrun)
+{
+	struct spa_io_position *pos = &a->position;
+	struct deadline_report r;
+	uint64_t period, busy;
+	int res;
+
+	if (driver->exported || pos->clock.rate.denom == 0 ||
+	    a->signal_time == 0 || a->finish_time < a->signal_time)
+		return;
+
+	period = pos->clock.duration * SPA_NSEC_PER_SEC *
+		pos->clock.rate.num / pos->clock.rate.denom;
+
+	if (overrun) {
+		r.unfinished = true;
+		r.delay = period;
+	} else {
+		busy = a->finish_time - a->signal_time;
+		if (busy <= period)
+			return;
+		r.unfinished = false;
+		r.delay = busy - period;
+	}
+	r.driver_id = driver->info.id;
+
+	analyze_deadline(driver, &r);
+
+	if ((res = pw_loop_invoke(driver->core->main_loop, do_report_deadline, 1,
+			&r, sizeof(r), false, driver->core)) < 0)
+		pw_log_trace_fp(NAME" %p: can't report deadline: %s", driver, spa_strerror(res));
+}
+
 static inline int resume_node(struct pw_node *this, int status)
 {
+	struct pw_node_schedule_entry *e;
 	struct pw_node_target *t;
+	uint32_t i;
 	struct timespec ts;
 	struct pw_node_activation *activation = this->rt.activation;
 	struct spa_system *data_system = this->core->data_system;
@@ -816,7 +1438,27 @@ static inline int resume_node(struct pw_node *this, int status)
 	activation->finish_time = nsec;
 
 	pw_log_trace_fp(NAME" %p: trigger peers %"PRIu64, this, nsec);
+	pw_trace_point(node_finish, this->info.id, nsec);
+
+	if ((e = this->rt.sched) != NULL) {
+		for (i = 0; i < e->n_targets; i++) {
+			struct pw_node_schedule_target *t = &e->targets[i];
+			struct pw_node_activation_state *state = &t->activation->state[0];
 
+			pw_log_trace_fp(NAME" %p: state %p pending %d/%d", this, state,
+					state->pending, state->required);
+
+			if (pw_node_activation_state_dec(state, 1)) {
+				pw_trace_point(node_signal, this->info.id, t->id);
+				t->activation->status = PW_NODE_ACTIVATION_TRIGGERED;
+				t->activation->signal_time = nsec;
+				t->signal(t->data);
+			}
+		}
+		return 0;
+	}
+
+	/* not in a compiled schedule, exported nodes */
 	spa_list_for_each(t, &this->rt.target_list, link) {
 		struct pw_node_activation_state *state;
 
@@ -826,6 +1468,8 @@ static inline int resume_node(struct pw_node *this, int status)
                                 state->pending, state->required);
 
 		if (pw_node_activation_state_dec(state, 1)) {
+			pw_trace_point(node_signal, this->info.id,
+					t->node ? t->node->info.id : SPA_ID_INVALID);
 			t->activation->status = PW_NODE_ACTIVATION_TRIGGERED;
 			t->activation->signal_time = nsec;
 			t->signal(t->data);
@@ -846,6 +1490,18 @@ static inline void calculate_stats(struct pw_node *this,  struct pw_node_activat
 	}
 }
 
+/* check if a node with a period has nothing to do in this cycle */
+static inline bool skip_cycle(struct pw_node *this, uint64_t nsec)
+{
+	if (nsec < this->rt.next_run)
+		return true;
+
+	this->rt.next_run += this->rt.period;
+	if (this->rt.next_run < nsec)
+		this->rt.next_run = nsec + this->rt.period;
+	return false;
+}
+
 static inline int process_node(void *data)
 {
 	struct pw_node *this = data;
@@ -853,6 +1509,7 @@ static inline int process_node(void *data)
         struct pw_port *p;
 	struct pw_node_activation *a = this->rt.activation;
 	struct spa_system *data_system = this->core->data_system;
+	uint64_t cpu_start = 0;
 	int status;
 
 	spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
@@ -860,14 +1517,40 @@ static inline int process_node(void *data)
 	a->awake_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
 	pw_log_trace_fp(NAME" %p: process %"PRIu64, this, a->awake_time);
+	pw_trace_point(node_awake, this->info.id, a->awake_time);
 
-	/* not implemented yet, just clear the flags */
-	a->pending_sync = false;
-	a->pending_new_pos = false;
+	/* acknowledge the new position. Nodes without transport sync are
+	 * ready to start right away, the others call pw_node_sync_ready() */
+	if (SPA_UNLIKELY(ATOMIC_LOAD(a->pending_new_pos))) {
+		ATOMIC_STORE(a->pending_new_pos, false);
+		if (!this->transport_sync)
+			ATOMIC_STORE(a->pending_sync, false);
+	}
 
 	spa_list_for_each(p, &this->rt.input_mix, rt.node_link)
 		spa_node_process(p->mix);
 
+	/* don't run the node in the cycles where it has nothing to do
+	 * but let the peers continue. The input was consumed by the mixers
+	 * above so that the node only sees the latest data when it runs.
+	 * Client nodes are triggered without going through here, so this
+	 * only works for nodes in this process. */
+	if (SPA_UNLIKELY(this->rt.period > 0) &&
+	    !this->exported && this != this->driver_node &&
+	    skip_cycle(this, a->awake_time)) {
+		pw_log_trace_fp(NAME" %p: skip cycle", this);
+		a->state[0].status = SPA_STATUS_OK;
+		resume_node(this, SPA_STATUS_OK);
+		return 0;
+	}
+
+	/* the wall clock times include the time the thread was preempted,
+	 * the thread cpu time only what the node used */
+	if (SPA_UNLIKELY(this->core->cpu_time)) {
+		spa_system_clock_gettime(data_system, CLOCK_THREAD_CPUTIME_ID, &ts);
+		cpu_start = SPA_TIMESPEC_TO_NSEC(&ts);
+	}
+
 	status = spa_node_process(this->node);
 	a->state[0].status = status;
 
@@ -876,6 +1559,11 @@ static inline int process_node(void *data)
 			spa_node_process(p->mix);
 	}
 
+	if (SPA_UNLIKELY(this->core->cpu_time)) {
+		spa_system_clock_gettime(data_system, CLOCK_THREAD_CPUTIME_ID, &ts);
+		a->cpu_time = SPA_TIMESPEC_TO_NSEC(&ts) - cpu_start;
+	}
+
 	if (this == this->driver_node && !this->exported) {
 		spa_system_clock_gettime(data_system, CLOCK_MONOTONIC, &ts);
 		a->status = PW_NODE_ACTIVATION_FINISHED;
@@ -885,6 +1573,9 @@ static inline int process_node(void *data)
 		/* calculate CPU time */
 		calculate_stats(this, a);
 
+		if (this->core->profiler)
+			pw_profiler_add_cycle(this->core->profiler, this);
+
 		pw_log_trace_fp(NAME" %p: graph completed wait:%"PRIu64" run:%"PRIu64
 				" busy:%"PRIu64" period:%"PRIu64" cpu:%f:%f:%f", this,
 				a->awake_time - a->signal_time,
@@ -892,6 +1583,8 @@ static inline int process_node(void *data)
 				a->finish_time - a->signal_time,
 				a->signal_time - a->prev_signal_time,
 				a->cpu_load[0], a->cpu_load[1], a->cpu_load[2]);
+		pw_trace_point(graph_complete, this->info.id, a->signal_time,
+				a->awake_time, a->finish_time);
 
 	} else if (status == SPA_STATUS_OK) {
 		pw_log_trace_fp(NAME" %p: async continue", this);
@@ -901,10 +1594,49 @@ static inline int process_node(void *data)
 	return 0;
 }
 
+static int signal_node(struct pw_node *this)
+{
+	struct spa_system *data_system = this->data_loop->system;
+	int res;
+
+	if ((res = spa_system_eventfd_write(data_system, this->source.fd, 1)) < 0)
+		pw_log_warn(NAME" %p: write failed %s", this, spa_strerror(res));
+	return res;
+}
+
+/* target signal function of the driver. The driver always runs in its
+ * own data loop, nodes that complete on another thread wake it up. */
+static int signal_driver(void *data)
+{
+	struct pw_node *this = data;
+
+	if (pw_data_loop_in_thread(this->data_loop_impl))
+		return process_node(this);
+	return signal_node(this);
+}
+
+/* target signal function when the core has a worker pool. The driver
+ * always runs in the data loop, the other nodes are pushed on the deque
+ * of the current thread, which runs them next unless an idle worker
+ * steals them first. */
+static int schedule_node(void *data)
+{
+	struct pw_node *this = data;
+	struct pw_core *core = this->core;
+
+	if (this == this->driver_node)
+		return signal_driver(this);
+	if (pw_worker_pool_push(core->worker_pool, &this->rt.work) < 0) {
+		pw_log_trace_fp(NAME" %p: can't queue, process now", this);
+		return process_node(this);
+	}
+	return 0;
+}
+
 static void node_on_fd_events(struct spa_source *source)
 {
 	struct pw_node *this = source->data;
-	struct spa_system *data_system = this->core->data_system;
+	struct spa_system *data_system = this->data_loop->system;
 
 	if (source->rmask & (SPA_IO_ERR | SPA_IO_HUP)) {
 		pw_log_warn(NAME" %p: got socket error %08x", this, source->rmask);
@@ -919,6 +1651,9 @@ static void node_on_fd_events(struct spa_source *source)
 
 		pw_log_trace_fp(NAME" %p: got process", this);
 		this->rt.target.signal(this->rt.target.data);
+
+		if (this->core->worker_pool)
+			pw_worker_pool_run(this->core->worker_pool);
 	}
 }
 
@@ -949,7 +1684,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	struct impl *impl;
 	struct pw_node *this;
 	size_t size;
-	struct spa_system *data_system = core->data_system;
+	struct spa_system *data_system;
 	int res;
 
 	impl = calloc(1, sizeof(struct impl) + user_data_size);
@@ -960,6 +1695,7 @@ struct pw_node *pw_node_new(struct pw_core *core,
 
 	this = &impl->this;
 	this->core = core;
+	this->source.fd = -1;
 
 	if (user_data_size > 0)
                 this->user_data = SPA_MEMBER(impl, sizeof(struct impl), void);
@@ -975,6 +1711,11 @@ struct pw_node *pw_node_new(struct pw_core *core,
 
 	this->properties = properties;
 
+	impl->home_loop = pw_core_find_data_loop(core, &properties->dict);
+	this->data_loop_impl = impl->home_loop;
+	this->data_loop = pw_data_loop_get_loop(this->data_loop_impl);
+	data_system = this->data_loop->system;
+
 	if ((res = spa_system_eventfd_create(data_system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
 		goto error_clean;
 
@@ -1002,8 +1743,6 @@ struct pw_node *pw_node_new(struct pw_core *core,
 		goto error_clean;
 	}
 
-	this->data_loop = core->data_loop;
-
 	spa_list_init(&this->slave_list);
 
 	spa_hook_list_init(&this->listener_list);
@@ -1024,10 +1763,13 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	this->rt.activation = this->activation->map->ptr;
 	this->rt.target.activation = this->rt.activation;
 	this->rt.target.node = this;
-	this->rt.target.signal = process_node;
+	this->rt.target.signal = core->worker_pool ? schedule_node : process_node;
 	this->rt.target.data = this;
 	this->rt.driver_target.signal = process_node;
+	this->rt.work.func = process_node;
+	this->rt.work.data = this;
 
+	this->rt.activation->layout = PW_NODE_ACTIVATION_LAYOUT;
 	reset_position(&this->rt.activation->position);
 	this->rt.activation->sync_timeout = 5 * SPA_NSEC_PER_SEC;
 	this->rt.activation->sync_left = 0;
@@ -1044,7 +1786,7 @@ error_clean:
 	if (this->activation)
 		pw_memblock_unref(this->activation);
 	if (this->source.fd != -1)
-		spa_system_close(this->core->data_system, this->source.fd);
+		spa_system_close(this->data_loop->system, this->source.fd);
 	free(impl);
 error_exit:
 	if (properties)
@@ -1149,7 +1891,7 @@ static void node_info(void *data, const struct spa_node_info *info)
 	emit_info_changed(node);
 
 	if (info->change_mask & SPA_NODE_CHANGE_MASK_PARAMS)
-		emit_params(node, changed_ids, n_changed_ids);
+		queue_params(node, changed_ids, n_changed_ids);
 }
 
 static void node_port_info(void *data, enum spa_direction direction, uint32_t port_id,
@@ -1308,11 +2050,124 @@ static void update_position(struct pw_node *node, int all_ready)
 		a->position.offset += a->position.clock.duration;
 }
 
+#define ADAPT_LOAD_HIGH		0.75f
+#define ADAPT_LOAD_LOW		0.25f
+#define ADAPT_GROW_NSEC		(100 * SPA_NSEC_PER_MSEC)
+#define ADAPT_SHRINK_NSEC	(2 * SPA_NSEC_PER_SEC)
+
+struct adapt_request {
+	uint32_t driver_id;
+	uint32_t quantum;
+};
+
+static int do_adapt_quantum(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_core *core = user_data;
+	const struct adapt_request *r = data;
+	struct pw_global *global;
+	struct pw_node *driver;
+
+	if ((global = pw_core_find_global(core, r->driver_id)) == NULL ||
+	    pw_global_get_type(global) != PW_TYPE_INTERFACE_Node)
+		return 0;
+
+	driver = pw_global_get_object(global);
+	driver->quantum_adapt = r->quantum;
+	return pw_core_recalc_graph(core);
+}
+
+/* Propose the quantum of the following cycles with the adaptive quantum
+ * policy. The duration of the running cycle is not touched, the request
+ * goes to the main loop and pw_core_recalc_graph() applies it between
+ * cycles, within the range that the buffers of the graph can hold.
+ *
+ * The quantum is doubled after an xrun or when the graph gets close to
+ * its deadline and is halved again when the load stays low for some time.
+ * It never drops below the quantum requested by the nodes of the driver. */
+static void adapt_quantum(struct pw_node *driver, struct pw_node_activation *a, bool overrun)
+{
+	struct adapt_request r;
+	uint32_t quantum, current = a->position.clock.duration, min, max;
+	uint64_t now = a->signal_time, elapsed = now - driver->rt.adapt.time;
+	bool xrun;
+	int res;
+
+	xrun = overrun || a->xrun_count != driver->rt.adapt.xrun_count;
+	driver->rt.adapt.xrun_count = a->xrun_count;
+
+	if ((xrun || a->cpu_load[0] > ADAPT_LOAD_HIGH) && elapsed > ADAPT_GROW_NSEC)
+		quantum = current * 2;
+	else if (a->cpu_load[2] < ADAPT_LOAD_LOW && elapsed > ADAPT_SHRINK_NSEC)
+		quantum = current / 2;
+	else
+		return;
+
+	min = ATOMIC_LOAD(driver->rt.adapt.min);
+	max = ATOMIC_LOAD(driver->rt.adapt.max);
+	if (max == 0)
+		return;
+
+	quantum = SPA_CLAMP(quantum, min, max);
+	if (quantum == current)
+		return;
+
+	pw_log_trace_fp(NAME" %p: request quantum %u -> %u xrun:%d load:%f:%f", driver,
+			current, quantum, xrun, a->cpu_load[0], a->cpu_load[2]);
+
+	driver->rt.adapt.time = now;
+
+	r.driver_id = driver->info.id;
+	r.quantum = quantum;
+	if ((res = pw_loop_invoke(driver->core->main_loop, do_adapt_quantum, 1,
+			&r, sizeof(r), false, driver->core)) < 0)
+		pw_log_trace_fp(NAME" %p: can't request quantum: %s", driver, spa_strerror(res));
+}
+
+struct cycle_state {
+	struct pw_node_activation *a;
+	uint32_t owner[2];
+	uint32_t reposition_owner;
+	struct pw_node *reposition_node;
+	int all_ready;
+	int update_sync;
+	int target_sync;
+};
+
+/* reset a node of the graph for the next cycle, @n is NULL for the
+ * remote targets of exported nodes */
+static inline void reset_target(struct cycle_state *c, struct pw_node_activation *ta,
+		uint32_t required, struct pw_node *n)
+{
+	ta->status = PW_NODE_ACTIVATION_NOT_TRIGGERED;
+	ta->state[0].pending = required;
+
+	if (n != NULL) {
+		uint32_t id = n->info.id;
+
+		/* this is the node with reposition info */
+		if (id == c->reposition_owner)
+			c->reposition_node = n;
+
+		/* update extra segment info if it is the owner */
+		if (id == c->owner[0])
+			c->a->position.segments[0].bar = ta->segment.bar;
+		if (id == c->owner[1])
+			c->a->position.segments[0].video = ta->segment.video;
+	}
+
+	if (c->update_sync) {
+		ATOMIC_STORE(ta->pending_sync, c->target_sync);
+		ATOMIC_STORE(ta->pending_new_pos, c->target_sync);
+	} else {
+		c->all_ready &= ATOMIC_LOAD(ta->pending_sync) == false;
+	}
+}
+
 static int node_ready(void *data, int status)
 {
-	struct pw_node *node = data, *reposition_node = NULL;
+	struct pw_node *node = data;
 	struct pw_node *driver = node->driver_node;
-	struct pw_node_target *t;
 	struct pw_port *p;
 
 	pw_log_trace_fp(NAME" %p: ready driver:%d exported:%d %p status:%d", node,
@@ -1320,55 +2175,48 @@ static int node_ready(void *data, int status)
 
 	if (node == driver) {
 		struct pw_node_activation *a = node->rt.activation;
-		int sync_type, all_ready, update_sync, target_sync;
-		uint32_t owner[2], reposition_owner;
+		struct pw_node_schedule *s = &driver->rt.schedule;
+		struct pw_node_target *t;
+		struct cycle_state c;
+		int sync_type;
+		uint32_t i;
+		bool overrun = a->state[0].pending != 0;
 
-		if (a->state[0].pending != 0) {
+		if (overrun) {
 			pw_log_warn(NAME" %p: graph not finished", node);
 			dump_states(node);
 			node->rt.target.signal(node->rt.target.data);
 		}
-
-		sync_type = check_updates(node, &reposition_owner);
-		owner[0] = ATOMIC_LOAD(a->segment_owner[0]);
-		owner[1] = ATOMIC_LOAD(a->segment_owner[1]);
-		all_ready = sync_type == SYNC_CHECK;
-		update_sync = !all_ready;
-		target_sync = sync_type == SYNC_START ? true : false;
-
-		spa_list_for_each(t, &driver->rt.target_list, link) {
-			struct pw_node_activation *ta = t->activation;
-
-			ta->status = PW_NODE_ACTIVATION_NOT_TRIGGERED;
-			pw_node_activation_state_reset(&ta->state[0]);
-
-			if (t->node) {
-				uint32_t id = t->node->info.id;
-
-				/* this is the node with reposition info */
-				if (id == reposition_owner)
-					reposition_node = t->node;
-
-				/* update extra segment info if it is the owner */
-				if (id == owner[0])
-					a->position.segments[0].bar = ta->segment.bar;
-				if (id == owner[1])
-					a->position.segments[0].video = ta->segment.video;
-			}
-
-			if (update_sync) {
-				ta->pending_sync = target_sync;
-				ta->pending_new_pos = target_sync;
-			} else {
-				all_ready &= ta->pending_sync == false;
+		check_deadline(node, a, overrun);
+
+		if (node->core->quantum.policy == PW_QUANTUM_POLICY_ADAPTIVE)
+			adapt_quantum(node, a, overrun);
+
+		c.a = a;
+		c.reposition_node = NULL;
+		sync_type = check_updates(node, &c.reposition_owner);
+		c.owner[0] = ATOMIC_LOAD(a->segment_owner[0]);
+		c.owner[1] = ATOMIC_LOAD(a->segment_owner[1]);
+		c.all_ready = sync_type == SYNC_CHECK;
+		c.update_sync = !c.all_ready;
+		c.target_sync = sync_type == SYNC_START ? true : false;
+
+		if (s->valid) {
+			for (i = 0; i < s->n_entries; i++) {
+				struct pw_node_schedule_entry *e = &s->entries[i];
+				reset_target(&c, e->activation, e->required, e->node);
 			}
+		} else {
+			spa_list_for_each(t, &driver->rt.target_list, link)
+				reset_target(&c, t->activation,
+						t->activation->state[0].required, t->node);
 		}
 		a->prev_signal_time = a->signal_time;
 
-		if (reposition_node)
-			do_reposition(node, reposition_node);
+		if (c.reposition_node)
+			do_reposition(node, c.reposition_node);
 
-		update_position(node, all_ready);
+		update_position(node, c.all_ready);
 	}
 	if (node->driver && !node->master)
 		return 0;
@@ -1378,7 +2226,12 @@ static int node_ready(void *data, int status)
 			spa_node_process(p->mix);
 	}
 
-	return resume_node(node, status);
+	resume_node(node, status);
+
+	if (node->core->worker_pool)
+		pw_worker_pool_run(node->core->worker_pool);
+
+	return 0;
 }
 
 static int node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
@@ -1406,6 +2259,7 @@ static int node_xrun(void *data, uint64_t trigger, uint64_t delay, struct spa_po
 	a->xrun_delay = delay;
 	a->max_delay = SPA_MAX(a->max_delay, delay);
 
+	pw_trace_point(node_xrun, this->info.id, trigger, delay);
 	pw_log_debug(NAME" %p: XRun! count:%u time:%"PRIu64" delay:%"PRIu64" max:%"PRIu64,
 			this, a->xrun_count, trigger, delay, a->max_delay);
 
@@ -1538,8 +2392,12 @@ void pw_node_destroy(struct pw_node *node)
 
 	pw_memblock_unref(node->activation);
 
+	if (impl->notify_timer)
+		pw_loop_destroy_source(node->core->main_loop, impl->notify_timer);
+
 	pw_work_queue_destroy(impl->work);
 
+	free_schedule(&node->rt.schedule);
 	pw_map_clear(&node->input_port_map);
 	pw_map_clear(&node->output_port_map);
 
@@ -1547,7 +2405,7 @@ void pw_node_destroy(struct pw_node *node)
 
 	clear_info(node);
 
-	spa_system_close(node->core->data_system, node->source.fd);
+	spa_system_close(node->data_loop->system, node->source.fd);
 	free(impl);
 }
 
@@ -1578,6 +2436,7 @@ struct result_node_params_data {
 			uint32_t id, uint32_t index, uint32_t next,
 			struct spa_pod *param);
 	int seq;
+	int res;
 };
 
 static void result_node_params(void *data, int seq, int res, uint32_t type, const void *result)
@@ -1587,8 +2446,8 @@ static void result_node_params(void *data, int seq, int res, uint32_t type, cons
 	case SPA_RESULT_TYPE_NODE_PARAMS:
 	{
 		const struct spa_result_node_params *r = result;
-		if (d->seq == seq)
-			d->callback(d->data, seq, r->id, r->index, r->next, r->param);
+		if (d->seq == seq && d->res == 0)
+			d->res = d->callback(d->data, seq, r->id, r->index, r->next, r->param);
 		break;
 	}
 	default:
@@ -1607,7 +2466,7 @@ int pw_node_for_each_param(struct pw_node *node,
 			   void *data)
 {
 	int res;
-	struct result_node_params_data user_data = { data, callback, seq };
+	struct result_node_params_data user_data = { data, callback, seq, 0 };
 	struct spa_hook listener;
 	static const struct spa_node_events node_events = {
 		SPA_VERSION_NODE_EVENTS,
@@ -1628,6 +2487,9 @@ int pw_node_for_each_param(struct pw_node *node,
 					filter);
 	spa_hook_remove(&listener);
 
+	if (user_data.res != 0)
+		res = user_data.res;
+
 	return res;
 }
 
@@ -1728,18 +2590,23 @@ static void on_state_complete(void *obj, void *data, int res, uint32_t seq)
 static void node_activate(struct pw_node *this)
 {
 	struct pw_port *port;
+	struct pw_link *link;
+	struct pw_array links;
 
 	pw_log_debug(NAME" %p: activate", this);
+
+	pw_array_init(&links, 64);
 	spa_list_for_each(port, &this->input_ports, link) {
-		struct pw_link *link;
 		spa_list_for_each(link, &port->links, input_link)
-			pw_link_activate(link);
+			pw_array_add_ptr(&links, link);
 	}
 	spa_list_for_each(port, &this->output_ports, link) {
-		struct pw_link *link;
 		spa_list_for_each(link, &port->links, output_link)
-			pw_link_activate(link);
+			pw_array_add_ptr(&links, link);
 	}
+	pw_link_activate_links(links.data,
+			pw_array_get_len(&links, struct pw_link *));
+	pw_array_clear(&links);
 }
 
 /** Set the node state
@@ -1826,6 +2693,19 @@ int pw_node_set_active(struct pw_node *node, bool active)
 	return 0;
 }
 
+SPA_EXPORT
+int pw_node_sync_ready(struct pw_node *node)
+{
+	struct pw_node_activation *a = node->rt.activation;
+
+	if (!node->transport_sync)
+		return -EINVAL;
+
+	pw_log_trace_fp(NAME" %p: sync ready", node);
+	ATOMIC_STORE(a->pending_sync, false);
+	return 0;
+}
+
 SPA_EXPORT
 bool pw_node_is_active(struct pw_node *node)
 {
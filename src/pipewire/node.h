@@ -152,6 +152,9 @@ int pw_node_for_each_port(struct pw_node *node,
 			  int (*callback) (void *data, struct pw_port *port),
 			  void *data);
 
+/** Iterate the params of the node. The callback should return 0 to fetch
+ * the next item, any other value cancels the iteration and is returned.
+ * Pass a filter and a max to let the node skip params early. */
 int pw_node_for_each_param(struct pw_node *node,
 			   int seq, uint32_t param_id,
 			   uint32_t index, uint32_t max,
@@ -176,6 +179,11 @@ int pw_node_set_active(struct pw_node *node, bool active);
 /** Check if a node is active */
 bool pw_node_is_active(struct pw_node *node);
 
+/** Signal that a node with PW_KEY_NODE_TRANSPORT_SYNC is ready to start at the
+ * new position. The driver goes to the RUNNING state when all nodes are ready
+ * or when the sync timeout expires. Can be called from the data thread. */
+int pw_node_sync_ready(struct pw_node *node);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,6 +51,7 @@ struct plugin {
 	spa_handle_factory_enum_func_t enum_func;
 	struct spa_list handles;
 	int ref;
+	const struct spa_handle_factory *last_factory;	/**< last factory that was found */
 };
 
 struct handle {
@@ -146,16 +147,14 @@ error_out:
 	return NULL;
 }
 
+/* Plugins stay loaded when their last handle is unloaded. Nodes and
+ * devices come and go with links and hotplug, and opening the library
+ * again with RTLD_NOW resolves all of its symbols again. */
 static void
 unref_plugin(struct plugin *plugin)
 {
-	if (--plugin->ref == 0) {
-		spa_list_remove(&plugin->link);
-		pw_log_debug("unloaded plugin:'%s'", plugin->filename);
-		dlclose(plugin->hnd);
-		free(plugin->filename);
-		free(plugin);
-	}
+	if (--plugin->ref == 0)
+		pw_log_debug("plugin:'%s' unused", plugin->filename);
 }
 
 static const struct spa_handle_factory *find_factory(struct plugin *plugin, const char *factory_name)
@@ -164,14 +163,20 @@ static const struct spa_handle_factory *find_factory(struct plugin *plugin, cons
 	uint32_t index;
         const struct spa_handle_factory *factory;
 
+	if ((factory = plugin->last_factory) != NULL &&
+	    strcmp(factory->name, factory_name) == 0)
+		return factory;
+
         for (index = 0;;) {
                 if ((res = plugin->enum_func(&factory, &index)) <= 0) {
                         if (res == 0)
 				break;
                         goto out;
                 }
-                if (strcmp(factory->name, factory_name) == 0)
+                if (strcmp(factory->name, factory_name) == 0) {
+			plugin->last_factory = factory;
                         return factory;
+		}
 	}
 	res = -ENOENT;
 out:
@@ -349,7 +354,7 @@ SPA_EXPORT
 void pw_init(int *argc, char **argv[])
 {
 	const char *str;
-	struct spa_dict_item items[3];
+	struct spa_dict_item items[4];
 	uint32_t n_items;
 	struct spa_dict info;
 	struct support *support = &global_support;
@@ -381,6 +386,8 @@ void pw_init(int *argc, char **argv[])
 	items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, level);
 	if ((str = getenv("PIPEWIRE_LOG")) != NULL)
 		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, str);
+	if ((str = getenv("PIPEWIRE_LOG_ASYNC")) != NULL)
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_ASYNC, str);
 	info = SPA_DICT_INIT(items, n_items);
 
 	log = add_interface(support, SPA_NAME_SUPPORT_LOG, SPA_TYPE_INTERFACE_Log, &info);
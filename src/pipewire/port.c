@@ -41,9 +41,16 @@
 #define NAME "port"
 
 /** \cond */
+#define MAX_FAN_OUT_BUFFERS	64
+
+static uint64_t format_serial;
+
 struct impl {
 	struct pw_port this;
 	struct spa_node mix_node;	/**< mix node implementation */
+
+	unsigned int fan_out:1;		/**< buffers are refcounted by the tee */
+	uint32_t buffer_refs[MAX_FAN_OUT_BUFFERS];	/**< consumers of each buffer */
 };
 
 #define pw_port_resource(r,m,v,...)	pw_resource_call(r,struct pw_port_proxy_events,m,v,__VA_ARGS__)
@@ -115,6 +122,58 @@ void pw_port_update_state(struct pw_port *port, enum pw_port_state state, char *
 	}
 }
 
+static void tee_release_buffer(struct impl *impl, uint32_t buffer_id)
+{
+	struct pw_port *this = &impl->this;
+
+	if (impl->buffer_refs[buffer_id] == 0 ||
+	    --impl->buffer_refs[buffer_id] > 0)
+		return;
+
+	pw_log_trace_fp(NAME" %p: tee release buffer %d", this, buffer_id);
+	spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
+}
+
+/* In fan-out mode all consumers read the same buffer. The tee keeps a
+ * count of the consumers that still hold the buffer; a consumer is done
+ * with it when it sets the status of its io back. The buffer is given
+ * back to the producer when the last consumer is done. */
+static int tee_process_fan_out(struct impl *impl)
+{
+	struct pw_port *this = &impl->this;
+	struct pw_port_mix *mix;
+	struct spa_io_buffers *io = &this->rt.io;
+	uint32_t n_mix = 0, buffer_id = io->buffer_id;
+	bool have_data = io->status == SPA_STATUS_HAVE_DATA &&
+		buffer_id < MAX_FAN_OUT_BUFFERS;
+
+	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
+		struct spa_io_buffers *mio = mix->io;
+
+		if (mio->buffer_id < MAX_FAN_OUT_BUFFERS &&
+		    (have_data || mio->status != SPA_STATUS_HAVE_DATA)) {
+			tee_release_buffer(impl, mio->buffer_id);
+			mio->buffer_id = SPA_ID_INVALID;
+		}
+		if (have_data) {
+			*mio = *io;
+			n_mix++;
+		}
+	}
+	if (have_data) {
+		pw_log_trace_fp(NAME" %p: tee buffer %d to %d consumers", this,
+				buffer_id, n_mix);
+		impl->buffer_refs[buffer_id] += n_mix;
+		/* the producer waits for reuse_buffer */
+		io->buffer_id = SPA_ID_INVALID;
+		if (n_mix == 0)
+			spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
+	}
+	io->status = SPA_STATUS_NEED_DATA;
+
+        return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
 static int tee_process(void *object)
 {
 	struct impl *impl = object;
@@ -123,6 +182,10 @@ static int tee_process(void *object)
 	struct spa_io_buffers *io = &this->rt.io;
 
 	pw_log_trace_fp(NAME" %p: tee input %d %d", this, io->status, io->buffer_id);
+
+	if (impl->fan_out)
+		return tee_process_fan_out(impl);
+
 	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
 		pw_log_trace_fp(NAME" %p: port %d %p->%p %d", this,
 				mix->port.port_id, io, mix->io, mix->io->buffer_id);
@@ -137,10 +200,22 @@ static int tee_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
 {
 	struct impl *impl = object;
 	struct pw_port *this = &impl->this;
+	struct pw_port_mix *mix;
 
 	pw_log_trace_fp(NAME" %p: tee reuse buffer %d %d", this, port_id, buffer_id);
-	spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
-
+	if (!impl->fan_out || buffer_id >= MAX_FAN_OUT_BUFFERS) {
+		spa_node_port_reuse_buffer(this->node->node, this->port_id, buffer_id);
+		return 0;
+	}
+	/* only drop the reference of the consumer that holds the buffer */
+	spa_list_for_each(mix, &this->rt.mix_list, rt_link) {
+		if (mix->port.port_id != port_id ||
+		    mix->io->buffer_id != buffer_id)
+			continue;
+		mix->io->buffer_id = SPA_ID_INVALID;
+		tee_release_buffer(impl, buffer_id);
+		break;
+	}
 	return 0;
 }
 
@@ -348,6 +423,9 @@ static void update_info(struct pw_port *port, const struct spa_port_info *info)
 			if (info->params[i].flags & SPA_PARAM_INFO_READ)
 				changed_ids[n_changed_ids++] = info->params[i].id;
 
+			if (info->params[i].id == SPA_PARAM_EnumFormat)
+				port->format_serial = ATOMIC_INC(format_serial);
+
 			port->info.params[i] = info->params[i];
 		}
 	}
@@ -617,6 +695,10 @@ static int do_add_port(struct spa_loop *loop,
 		       bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
         struct pw_port *this = user_data;
+	struct pw_core *core = this->node->core;
+
+	if (core->worker_pool)
+		pw_worker_pool_sync(core->worker_pool);
 
 	if (this->direction == PW_DIRECTION_INPUT)
 		spa_list_append(&this->node->rt.input_mix, &this->rt.node_link);
@@ -933,6 +1015,10 @@ static int do_remove_port(struct spa_loop *loop,
 			  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
         struct pw_port *this = user_data;
+	struct pw_core *core = this->node->core;
+
+	if (core->worker_pool)
+		pw_worker_pool_sync(core->worker_pool);
 
 	spa_list_remove(&this->rt.node_link);
 
@@ -996,8 +1082,8 @@ void pw_port_destroy(struct pw_port *port)
 	pw_log_debug(NAME" %p: free", port);
 	pw_port_emit_free(port);
 
-	pw_buffers_clear(&port->buffers);
-	pw_buffers_clear(&port->mix_buffers);
+	pw_buffers_release(&port->buffers);
+	pw_buffers_release(&port->mix_buffers);
 	free((void*)port->error);
 
 	pw_map_clear(&port->mix_port_map);
@@ -1013,6 +1099,7 @@ struct result_port_params_data {
 			uint32_t id, uint32_t index, uint32_t next,
 			struct spa_pod *param);
 	int seq;
+	int res;
 };
 
 static void result_port_params(void *data, int seq, int res, uint32_t type, const void *result)
@@ -1022,8 +1109,8 @@ static void result_port_params(void *data, int seq, int res, uint32_t type, cons
 	case SPA_RESULT_TYPE_NODE_PARAMS:
 	{
 		const struct spa_result_node_params *r = result;
-		if (d->seq == seq)
-			d->callback(d->data, seq, r->id, r->index, r->next, r->param);
+		if (d->seq == seq && d->res == 0)
+			d->res = d->callback(d->data, seq, r->id, r->index, r->next, r->param);
 		break;
 	}
 	default:
@@ -1043,7 +1130,7 @@ int pw_port_for_each_param(struct pw_port *port,
 {
 	int res;
 	struct pw_node *node = port->node;
-	struct result_port_params_data user_data = { data, callback, seq };
+	struct result_port_params_data user_data = { data, callback, seq, 0 };
 	struct spa_hook listener;
 	static const struct spa_node_events node_events = {
 		SPA_VERSION_NODE_EVENTS,
@@ -1065,6 +1152,9 @@ int pw_port_for_each_param(struct pw_port *port,
 					filter);
 	spa_hook_remove(&listener);
 
+	if (user_data.res != 0)
+		res = user_data.res;
+
 	pw_log_debug(NAME" %p: res %d: (%s)", port, res, spa_strerror(res));
 	return res;
 }
@@ -1244,6 +1334,7 @@ SPA_EXPORT
 int pw_port_use_buffers(struct pw_port *port, struct pw_port_mix *mix, uint32_t flags,
 		struct spa_buffer **buffers, uint32_t n_buffers)
 {
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
 	int res = 0, res2;
 
 	pw_log_debug(NAME" %p: %d:%d.%d: %d buffers flags:%d state:%d n_mix:%d", port,
@@ -1261,6 +1352,13 @@ int pw_port_use_buffers(struct pw_port *port, struct pw_port_mix *mix, uint32_t
 			pw_port_update_state(port, PW_PORT_STATE_READY, NULL);
 	}
 
+	if (port->direction == PW_DIRECTION_OUTPUT &&
+	    port->state == PW_PORT_STATE_READY) {
+		const char *str = pw_properties_get(port->properties, PW_KEY_PORT_FAN_OUT);
+		impl->fan_out = str ? pw_properties_parse_bool(str) : false;
+		spa_zero(impl->buffer_refs);
+	}
+
 	/* first negotiate with the node, this makes it possible to let the
 	 * node allocate buffer memory if needed */
 	if (port->state == PW_PORT_STATE_READY) {
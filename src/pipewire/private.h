@@ -31,6 +31,7 @@ extern "C" {
 
 #include <sys/socket.h>
 #include <sys/types.h> /* for pthread_t */
+#include <pthread.h>
 
 #include "pipewire/buffers.h"
 #include "pipewire/map.h"
@@ -41,16 +42,28 @@ extern "C" {
 #include "pipewire/stream.h"
 #include "pipewire/filter.h"
 #include "pipewire/log.h"
+#include "pipewire/profiler.h"
 
 #include <spa/support/plugin.h>
 #include <spa/pod/builder.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type-info.h>
+#include <spa/utils/ringbuffer.h>
 
 #ifndef spa_debug
 #define spa_debug pw_log_trace
 #endif
 
+/** Static trace point in the pipewire provider. With sys/sdt.h this is a
+ * nop that perf (sdt_pipewire:name) and LTTng can attach to, otherwise it
+ * compiles to nothing. Include config.h before this file. */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define pw_trace_point(name,...)	STAP_PROBEV(pipewire, name, ##__VA_ARGS__)
+#else
+#define pw_trace_point(name,...)	do { } while (0)
+#endif
+
 #define DEFAULT_QUANTUM		1024u
 #define MIN_QUANTUM		32u
 #define MAX_QUANTUM		8192u
@@ -115,6 +128,8 @@ struct pw_client {
 	struct pw_resource *client_resource;	/**< client resource object */
 
 	struct pw_map objects;		/**< list of resource objects */
+	struct spa_list registry_list;	/**< list of registry_data of the registries
+					  *  of this client */
 
 	struct spa_hook_list listener_list;
 
@@ -153,6 +168,7 @@ struct pw_global {
 
 	uint32_t type;			/**< type of interface */
 	uint32_t version;		/**< version of interface */
+	uint64_t serial;		/**< registry serial when registered */
 
 	pw_global_bind_func_t func;	/**< bind function */
 	void *object;			/**< object associated with the interface */
@@ -200,7 +216,12 @@ pw_core_resource_errorf(struct pw_resource *resource, uint32_t id, int seq,
 #define pw_registry_resource(r,m,v,...) pw_resource_call(r, struct pw_registry_proxy_events,m,v,##__VA_ARGS__)
 #define pw_registry_resource_global(r,...)        pw_registry_resource(r,global,0,__VA_ARGS__)
 #define pw_registry_resource_global_remove(r,...) pw_registry_resource(r,global_remove,0,__VA_ARGS__)
+#define pw_registry_resource_enum_done(r,...)     pw_registry_resource(r,enum_done,1,__VA_ARGS__)
+#define pw_registry_resource_resume_done(r,...)   pw_registry_resource(r,resume_done,2,__VA_ARGS__)
 
+#define PW_CORE_MAX_DATA_LOOPS	16u
+#define PW_CORE_MAX_REMOVED	256u
+#define PW_CORE_FORMAT_CACHE	16u
 
 struct pw_core {
 	struct pw_global *global;	/**< the global of the core */
@@ -211,8 +232,25 @@ struct pw_core {
 	struct pw_properties *properties;	/**< properties of the core */
 
 	struct pw_mempool *pool;		/**< global memory pool */
+	struct spa_list buffer_mem;		/**< recycled buffer memory */
+	size_t buffer_mem_size;			/**< total size of recycled buffer memory */
 
 	struct pw_map globals;			/**< map of globals */
+	uint64_t registry_serial;		/**< incremented for each added or
+						  *  removed global */
+	struct {
+		uint64_t serial;
+		uint32_t id;
+	} removed[PW_CORE_MAX_REMOVED];		/**< the last removed globals */
+	uint64_t n_removed;			/**< total number of removed globals */
+
+	struct {
+		uint64_t output;
+		uint64_t input;
+		struct spa_pod *format;
+	} format_cache[PW_CORE_FORMAT_CACHE];	/**< recently negotiated formats, keyed
+						  *  on the format serials of both ports */
+	uint32_t format_cache_next;		/**< next entry to replace */
 
 	struct spa_list protocol_list;		/**< list of protocols */
 	struct spa_list remote_list;		/**< list of remote connections */
@@ -234,6 +272,21 @@ struct pw_core {
 	struct pw_loop *data_loop;	/**< data loop for data passing */
         struct pw_data_loop *data_loop_impl;
 	struct spa_system *data_system;	/**< data system for data passing */
+	struct pw_data_loop *data_loops[PW_CORE_MAX_DATA_LOOPS];	/**< all data loops, the
+									  *  first one is data_loop_impl */
+	uint32_t n_data_loops;		/**< number of data loops */
+	struct pw_worker_pool *worker_pool;	/**< optional pool of threads to process
+						  *  nodes in parallel */
+	struct pw_profiler *profiler;		/**< optional profiler of the graph cycles */
+	unsigned int cpu_time:1;		/**< measure the thread cpu time of nodes */
+
+	struct {
+#define PW_QUANTUM_POLICY_STATIC	0	/**< quantum only follows node.latency */
+#define PW_QUANTUM_POLICY_ADAPTIVE	1	/**< drivers adapt the quantum to the load */
+		uint32_t policy;
+		uint32_t min;			/**< lower bound of the adaptive quantum */
+		uint32_t max;			/**< upper bound of the adaptive quantum */
+	} quantum;
 
 	struct spa_support support[16];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
@@ -260,6 +313,78 @@ struct pw_data_loop {
 	unsigned int running:1;
 };
 
+#define PW_WORKER_POOL_MAX_THREADS	64u
+#define PW_WORKER_DEQUE_SIZE		512	/* must be a power of 2 */
+
+struct pw_worker_item {
+	int (*func) (void *data);
+	void *data;
+};
+
+/** a worker thread of the pool with its own work-stealing deque. The
+ * owner pushes and pops at the bottom, other workers steal from the top. */
+struct pw_worker {
+	struct pw_worker_pool *pool;
+	uint32_t index;
+	pthread_t thread;
+	pid_t tid;				/**< thread id, set when the thread runs */
+
+	int64_t top SPA_ALIGNED(64);
+	int64_t bottom SPA_ALIGNED(64);
+	struct pw_worker_item *items[PW_WORKER_DEQUE_SIZE];
+};
+
+/** a pool of threads that run ready nodes of the graph in parallel. Nodes
+ * are pushed on the deque of the thread that completes their last
+ * dependency and run next by that thread or stolen by an idle worker. */
+struct pw_worker_pool {
+	struct pw_core *core;
+	struct spa_system *system;
+
+	int fd;					/**< semaphore eventfd to wake up idle workers */
+	uint32_t busy;				/**< queued or running items */
+	uint32_t n_idle;			/**< number of sleeping workers */
+	bool running;
+
+	uint32_t n_workers;			/**< worker 0 is the data loop thread */
+	struct pw_worker *workers[PW_WORKER_POOL_MAX_THREADS + 1];
+};
+
+struct pw_profiler {
+	char name[128];				/**< name of the shared memory */
+	int fd;
+	uint32_t size;				/**< size of the ringbuffer data */
+	size_t map_size;
+	struct pw_profiler_header *header;
+	void *data;
+	uint64_t cycle;
+	uint32_t lock;				/**< drivers of other data loops write
+						  *  to the same ringbuffer */
+};
+
+struct pw_profiler *pw_profiler_new(struct pw_core *core, uint32_t size);
+void pw_profiler_destroy(struct pw_profiler *profiler);
+
+/** append records for \a driver and its followers, called from the data
+ * loop of \a driver when its graph completed. Safe to call from several
+ * data loops. */
+void pw_profiler_add_cycle(struct pw_profiler *profiler, struct pw_node *driver);
+
+struct pw_worker_pool *pw_worker_pool_new(struct pw_core *core, uint32_t n_threads);
+void pw_worker_pool_destroy(struct pw_worker_pool *pool);
+
+/** queue \a item on the deque of the calling thread. Returns < 0 when the
+ * calling thread is not part of the pool or the deque is full, the caller
+ * should then run the item itself. */
+int pw_worker_pool_push(struct pw_worker_pool *pool, struct pw_worker_item *item);
+
+/** run the items queued by the calling thread */
+void pw_worker_pool_run(struct pw_worker_pool *pool);
+
+/** wait until all queued items are completed. Used by the data loop
+ * before it modifies the scheduling lists */
+void pw_worker_pool_sync(struct pw_worker_pool *pool);
+
 #define pw_main_loop_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_main_loop_events, m, v, ##__VA_ARGS__)
 #define pw_main_loop_emit_destroy(o) pw_main_loop_emit(o, destroy, 0)
 
@@ -339,35 +464,98 @@ struct pw_node_target {
 	void *data;
 };
 
+/** a target to signal, copied from the target list of a node */
+struct pw_node_schedule_target {
+	struct pw_node_activation *activation;
+	int (*signal) (void *data);
+	void *data;
+	uint32_t id;				/* id of the node or SPA_ID_INVALID */
+};
+
+/** an entry in the compiled schedule of a driver */
+struct pw_node_schedule_entry {
+	struct pw_node_activation *activation;
+	struct pw_node *node;
+	uint32_t required;			/* signals needed before the node runs */
+	uint32_t n_targets;
+	struct pw_node_schedule_target *targets;	/* targets to signal after the node */
+};
+
+/** The compiled schedule of a driver. The entries are in topological
+ * order, starting with the driver. The storage is reserved in the main
+ * thread with pw_node_reserve_schedule() and the schedule is compiled in
+ * the data loop without allocating. When the graph does not fit, valid
+ * is false and the target lists are used. */
+struct pw_node_schedule {
+	uint32_t n_entries;
+	uint32_t max_entries;
+	uint32_t max_targets;
+	unsigned int valid:1;
+	struct pw_node_schedule_entry *entries;
+	struct pw_node_schedule_target *targets;
+	struct pw_node **nodes;			/* scratch space for compiling */
+	uint32_t *count;
+	uint32_t *queue;
+};
+
+/* The activation is shared with the remote clients. It is split in cache
+ * lines that are written by different parties so that the atomic counters
+ * that the peers decrement in every cycle do not share a line with the
+ * position that all followers read or with the stats of the node. Bump
+ * PW_NODE_ACTIVATION_LAYOUT when the layout changes. */
 struct pw_node_activation {
+#define PW_NODE_ACTIVATION_LAYOUT		3
+	/* written by the peers that trigger this node, every cycle */
 #define PW_NODE_ACTIVATION_NOT_TRIGGERED	0
 #define PW_NODE_ACTIVATION_TRIGGERED		1
 #define PW_NODE_ACTIVATION_AWAKE		2
 #define PW_NODE_ACTIVATION_FINISHED		3
-	uint32_t status;
+	uint32_t status SPA_ALIGNED(64);
 
-	unsigned int version:1;
-	unsigned int pending_sync:1;			/* a sync is pending */
-	unsigned int pending_new_pos:1;			/* a new position is pending */
+	uint32_t version;
+	uint32_t pending_sync;				/* a sync is pending, set by the driver and
+							 * cleared by the node when it is ready */
+	uint32_t pending_new_pos;			/* a new position is pending, set by the driver
+							 * and cleared by the node when it saw it */
 
 	struct pw_node_activation_state state[2];	/* one current state and one next state,
 							 * as version flag */
-	uint64_t signal_time;
+
+	/* timing and stats, written by the node */
+	uint64_t signal_time SPA_ALIGNED(64);
 	uint64_t awake_time;
 	uint64_t finish_time;
 	uint64_t prev_signal_time;
 
-	/* updates */
-	struct spa_io_segment reposition;		/* reposition info, used when driver reposition_owner
+	float cpu_load[3];				/* averaged over short, medium, long time */
+	uint32_t xrun_count;				/* number of xruns */
+	uint64_t xrun_time;				/* time of last xrun in microseconds */
+	uint64_t xrun_delay;				/* delay of last xrun in microseconds */
+	uint64_t max_delay;				/* max of all xruns in microseconds */
+	uint64_t cpu_time;				/* thread cpu time of the last cycle in
+							 * nanoseconds, 0 when not measured */
+
+	/* updates, written by the node for the driver */
+	struct spa_io_segment reposition SPA_ALIGNED(64);
+							/* reposition info, used when driver reposition_owner
 							 * has this node id */
 	struct spa_io_segment segment;			/* update for the extra segment info fields.
 							 * used when driver segment_owner has this node id */
 
-	/* for drivers, shared with all nodes */
+	/* for drivers, updated by all nodes */
+#define PW_NODE_ACTIVATION_COMMAND_NONE		0
+#define PW_NODE_ACTIVATION_COMMAND_START	1
+#define PW_NODE_ACTIVATION_COMMAND_STOP		2
+	uint32_t command SPA_ALIGNED(64);		/* next command */
+	uint32_t reposition_owner;			/* owner id with new reposition info, last one
+							 * to update wins */
 	uint32_t segment_owner[32];			/* id of owners for each segment info struct.
 							 * nodes that want to update segment info need to
 							 * CAS their node id in this array. */
-	struct spa_io_position position;		/* contains current position and segment info.
+
+	/* for drivers, written by the driver and shared with all nodes */
+	struct spa_io_position position SPA_ALIGNED(64);
+							/* contains current position and segment info.
 							 * extra info is updated by nodes that have set
 							 * themselves as owner in the segment structs */
 
@@ -376,19 +564,26 @@ struct pw_node_activation {
 							 * longer for sync clients. */
 	uint64_t sync_left;				/* number of cycles before timeout */
 
+	uint32_t layout;				/* PW_NODE_ACTIVATION_LAYOUT */
+};
 
-	float cpu_load[3];				/* averaged over short, medium, long time */
-	uint32_t xrun_count;				/* number of xruns */
-	uint64_t xrun_time;				/* time of last xrun in microseconds */
-	uint64_t xrun_delay;				/* delay of last xrun in microseconds */
-	uint64_t max_delay;				/* max of all xruns in microseconds */
+/* Shared memory ring of control sequences that a client writes for other
+ * nodes and that the server applies without going through the socket. It
+ * is sent to the client node as the node SPA_IO_Notify area. Each message
+ * is a struct pw_node_control_msg followed by a struct spa_pod_sequence,
+ * padded to 8 bytes. */
+struct pw_node_control {
+	struct spa_ringbuffer ring;
+	uint32_t size;			/* size of data, a power of 2 */
+	uint32_t padding[13];
+	uint8_t data[0];
+};
 
-#define PW_NODE_ACTIVATION_COMMAND_NONE		0
-#define PW_NODE_ACTIVATION_COMMAND_START	1
-#define PW_NODE_ACTIVATION_COMMAND_STOP		2
-	uint32_t command;				/* next command */
-	uint32_t reposition_owner;			/* owner id with new reposition info, last one
-							 * to update wins */
+#define PW_NODE_CONTROL_SIZE		(16u * 1024u)
+
+struct pw_node_control_msg {
+	uint32_t node_id;		/* the node to apply the controls to */
+	uint32_t size;			/* size of the sequence pod */
 };
 
 #define ATOMIC_CAS(v,ov,nv)						\
@@ -410,6 +605,58 @@ struct pw_node_activation {
 #define SEQ_READ(s)			ATOMIC_LOAD(s)
 #define SEQ_READ_SUCCESS(s1,s2)		((s1) == (s2) && ((s2) & 1) == 0)
 
+/** a snapshot of the callbacks of a hook list */
+struct pw_rt_hook_set {
+	struct pw_rt_hook_set *next;		/**< next retired set */
+	uint32_t n_callbacks;
+	struct spa_callbacks callbacks[];
+};
+
+/** A copy of a hook list that the data thread can emit on without locks
+ * while the main thread adds and removes hooks. The main thread publishes
+ * a new set after each change and frees the old set when the readers that
+ * could have loaded it are done. */
+struct pw_rt_hooks {
+	struct pw_rt_hook_set *set;
+	struct pw_rt_hook_set *retired;		/**< sets that are still emitted */
+	uint32_t epoch;				/**< odd while a reader emits */
+	pthread_t reader;			/**< thread of the last reader */
+};
+
+void pw_rt_hooks_init(struct pw_rt_hooks *hooks);
+void pw_rt_hooks_clear(struct pw_rt_hooks *hooks);
+
+/** publish the hooks of \a list, call from the main thread after a hook was
+ * added or, with \a removed, after a hook was removed. When this returns, the
+ * removed hook is not called anymore. */
+int pw_rt_hooks_update(struct pw_rt_hooks *hooks, struct spa_hook_list *list,
+		struct spa_hook *removed);
+
+static inline struct pw_rt_hook_set *pw_rt_hooks_enter(struct pw_rt_hooks *hooks)
+{
+	hooks->reader = pthread_self();
+	ATOMIC_INC(hooks->epoch);
+	return ATOMIC_LOAD(hooks->set);
+}
+
+static inline void pw_rt_hooks_leave(struct pw_rt_hooks *hooks)
+{
+	ATOMIC_INC(hooks->epoch);
+}
+
+#define pw_rt_hooks_call(h,type,method,vers,...)				\
+({										\
+	struct pw_rt_hooks *_h = h;						\
+	struct pw_rt_hook_set *_s = pw_rt_hooks_enter(_h);			\
+	uint32_t _i;								\
+	for (_i = 0; _s != NULL && _i < _s->n_callbacks; _i++) {		\
+		const type *_f = (const type *) ATOMIC_LOAD(_s->callbacks[_i].funcs);	\
+		if (_f && _f->version >= (vers) && _f->method)			\
+			_f->method(_s->callbacks[_i].data, ## __VA_ARGS__);	\
+	}									\
+	pw_rt_hooks_leave(_h);							\
+})
+
 #define pw_node_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_node_events, m, v, ##__VA_ARGS__)
 #define pw_node_emit_destroy(n)			pw_node_emit(n, destroy, 0)
 #define pw_node_emit_free(n)			pw_node_emit(n, free, 0)
@@ -455,6 +702,7 @@ struct pw_node {
 					  *  is selected to drive the graph */
 	unsigned int visited:1;		/**< for sorting */
 	unsigned int want_driver:1;	/**< this node wants to be assigned to a driver */
+	unsigned int transport_sync:1;	/**< the node acknowledges a new position itself */
 
 	uint32_t port_user_data_size;	/**< extra size for port user data */
 
@@ -484,9 +732,12 @@ struct pw_node {
 	struct spa_hook_list listener_list;
 
 	struct pw_loop *data_loop;		/**< the data loop for this node */
+	struct pw_data_loop *data_loop_impl;	/**< the data loop of data_loop */
 
 	uint32_t quantum_size;			/**< desired quantum */
 	uint32_t quantum_current;		/**< current quantum for driver */
+	uint32_t quantum_adapt;			/**< quantum requested by the adaptive
+						  *  policy or 0 */
 	struct spa_source source;		/**< source to remotely trigger this node */
 	struct pw_memblock *activation;
 	struct {
@@ -497,12 +748,31 @@ struct pw_node {
 		struct spa_list target_list;		/* list of targets to signal after
 							 * this node */
 		struct pw_node_target driver_target;	/* driver target that we signal */
+		struct pw_node_schedule schedule;	/* compiled schedule of the nodes
+							 * in target_list of the driver */
+		struct pw_node_schedule_entry *sched;	/* our entry in the schedule of
+							 * the driver or NULL */
+		uint32_t sched_index;			/* used when compiling */
 		struct spa_list input_mix;		/* our input ports (and mixers) */
 		struct spa_list output_mix;		/* output ports (and mixers) */
 
 		struct pw_node_target target;		/* our target that is signaled by the
 							   driver */
 		struct spa_list driver_link;		/* our link in driver */
+
+		struct pw_worker_item work;		/* item to process this node in
+							 * the worker pool */
+
+		uint64_t period;			/* min time in nsec between two runs
+							 * of the node, 0 to run every cycle */
+		uint64_t next_run;			/* time of the next run with a period */
+
+		struct {
+			uint32_t min;			/* range of the quantum, stored with */
+			uint32_t max;			/* ATOMIC_STORE in pw_core_recalc_graph() */
+			uint32_t xrun_count;		/* last seen xrun count */
+			uint64_t time;			/* time of the last quantum request */
+		} adapt;				/* state of the adaptive quantum policy */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -578,6 +848,8 @@ struct pw_port {
 	struct pw_properties *properties;	/**< properties of the port */
 	struct pw_port_info info;
 	struct spa_param_info params[MAX_PARAMS];
+	uint64_t format_serial;		/**< changes with the EnumFormat param, 0
+					  *  when the port does not announce it */
 
 	struct pw_buffers buffers;	/**< buffers managed by this port, only on
 					  *  output ports, shared with all links */
@@ -891,6 +1163,43 @@ int pw_resource_install_marshal(struct pw_resource *resource, bool implementor);
 
 int pw_core_recalc_graph(struct pw_core *core);
 
+/** Make a new memory pool configured with the mem properties of the core */
+struct pw_mempool *pw_core_create_mempool(struct pw_core *core);
+
+/** Make a memory pool for a client, also limited by the mem quota of the core */
+struct pw_mempool *pw_core_create_client_mempool(struct pw_core *core);
+
+/** Find the data loop selected with \ref PW_KEY_NODE_LOOP in \a props */
+struct pw_data_loop *pw_core_find_data_loop(struct pw_core *core, const struct spa_dict *props);
+
+/** The NUMA node the cpus of \a loop are on or -1 */
+int pw_data_loop_get_numa_node(struct pw_data_loop *loop);
+
+/** Allocate zeroed memory for a small object, reusing recently freed blocks
+ * of the calling thread */
+void *pw_slab_alloc(size_t size);
+/** Free memory from pw_slab_alloc() */
+void pw_slab_free(void *data);
+
+/** Free all recycled buffer memory of the core */
+void pw_buffers_pool_clear(struct pw_core *core);
+
+/** user data of a registry resource */
+struct registry_data {
+	struct pw_resource *resource;
+	struct spa_list client_link;	/**< link in client registry_list */
+	struct spa_hook resource_listener;
+	struct spa_hook object_listener;
+	uint32_t filter_type;
+	struct pw_properties *filter_props;
+};
+
+/** Check if \a global passes the enum_globals filter of a registry resource */
+bool pw_registry_resource_match(struct pw_resource *resource, struct pw_global *global);
+
+/** Check if \a global was registered and is visible in the registry */
+bool pw_global_is_registered(struct pw_global *global);
+
 /** Create a new port \memberof pw_port
  * \return a newly allocated port */
 struct pw_port *
@@ -924,8 +1233,8 @@ void pw_port_unlink(struct pw_port *port);
 void pw_port_destroy(struct pw_port *port);
 
 /** Iterate the params of the given port. The callback should return
- * 1 to fetch the next item, 0 to stop iteration or <0 on error.
- * The function returns 0 on success or the error returned by the callback. */
+ * 0 to fetch the next item, any other value cancels the iteration and is
+ * returned. Results the port still produces after that are ignored. */
 int pw_port_for_each_param(struct pw_port *port,
 			   int seq, uint32_t param_id,
 			   uint32_t index, uint32_t max,
@@ -975,12 +1284,23 @@ int pw_node_initialized(struct pw_node *node);
 
 int pw_node_set_driver(struct pw_node *node, struct pw_node *driver);
 
+/** Make room in the schedule of \a driver for the graph, call from the
+ * main thread before the graph of the driver grows */
+int pw_node_reserve_schedule(struct pw_node *driver);
+
+/** Compile the schedule of the driver of \a node again, call from the
+ * data loop after the targets of the node changed */
+void pw_node_update_schedule(struct pw_node *node);
+
 /** Prepare a link \memberof pw_link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_link_prepare(struct pw_link *link);
 /** starts streaming on a link */
 int pw_link_activate(struct pw_link *link);
 
+/** Activate \a n_links links at once, the array is used as scratch space */
+int pw_link_activate_links(struct pw_link **links, uint32_t n_links);
+
 /** Deactivate a link \memberof pw_link */
 int pw_link_deactivate(struct pw_link *link);
 
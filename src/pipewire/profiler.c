@@ -0,0 +1,170 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pipewire/keys.h"
+#include "pipewire/log.h"
+#include "pipewire/private.h"
+#include "pipewire/profiler.h"
+
+#define NAME "profiler"
+
+struct pw_profiler *pw_profiler_new(struct pw_core *core, uint32_t size)
+{
+	struct pw_profiler *p;
+	const char *str;
+	int res;
+
+	p = calloc(1, sizeof(struct pw_profiler));
+	if (p == NULL)
+		return NULL;
+
+	if ((str = pw_properties_get(core->properties, PW_KEY_CORE_NAME)) == NULL)
+		str = "pipewire-0";
+	pw_profiler_shm_name(p->name, sizeof(p->name), str);
+
+	/* round up to a power of 2 so that indexes can wrap */
+	p->size = 1u << (32 - __builtin_clz(SPA_MAX(size, 4096u) - 1));
+	p->map_size = sizeof(struct pw_profiler_header) + p->size;
+
+	p->fd = shm_open(p->name, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0600);
+	if (p->fd < 0) {
+		res = -errno;
+		pw_log_error(NAME" %p: can't open shm %s: %m", p, p->name);
+		goto error_free;
+	}
+	if (ftruncate(p->fd, p->map_size) < 0) {
+		res = -errno;
+		pw_log_error(NAME" %p: can't truncate %s: %m", p, p->name);
+		goto error_unlink;
+	}
+	p->header = mmap(NULL, p->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+	if (p->header == MAP_FAILED) {
+		res = -errno;
+		pw_log_error(NAME" %p: can't mmap %s: %m", p, p->name);
+		goto error_unlink;
+	}
+	p->data = SPA_MEMBER(p->header, sizeof(struct pw_profiler_header), void);
+
+	p->header->version = PW_PROFILER_VERSION;
+	p->header->size = p->size;
+	p->header->record_size = sizeof(struct pw_profiler_record);
+	spa_ringbuffer_init(&p->header->ring);
+	__atomic_store_n(&p->header->magic, PW_PROFILER_MAGIC, __ATOMIC_RELEASE);
+
+	pw_log_info(NAME" %p: profiling to %s size:%u", p, p->name, p->size);
+
+	return p;
+
+error_unlink:
+	shm_unlink(p->name);
+	close(p->fd);
+error_free:
+	free(p);
+	errno = -res;
+	return NULL;
+}
+
+void pw_profiler_destroy(struct pw_profiler *p)
+{
+	pw_log_debug(NAME" %p: destroy", p);
+	munmap(p->header, p->map_size);
+	shm_unlink(p->name);
+	close(p->fd);
+	free(p);
+}
+
+static inline void fill_record(struct pw_profiler_record *r, struct pw_node *driver,
+		struct pw_node *node, uint64_t cycle)
+{
+	struct pw_node_activation *a = node->rt.activation;
+	struct spa_io_position *pos = &driver->rt.activation->position;
+
+	r->cycle = cycle;
+	r->driver_id = driver->info.id;
+	r->node_id = node->info.id;
+	r->status = a->status;
+	r->xrun_count = a->xrun_count;
+	r->signal_time = a->signal_time;
+	r->awake_time = a->awake_time;
+	r->finish_time = a->finish_time;
+	r->duration = pos->clock.duration;
+	r->rate = pos->clock.rate.denom;
+	if (node == driver)
+		memcpy(r->cpu_load, a->cpu_load, sizeof(r->cpu_load));
+	else
+		memset(r->cpu_load, 0, sizeof(r->cpu_load));
+	r->padding = 0;
+	r->cpu_time = a->cpu_time;
+}
+
+void pw_profiler_add_cycle(struct pw_profiler *p, struct pw_node *driver)
+{
+	struct pw_profiler_header *h = p->header;
+	struct pw_profiler_record r;
+	struct pw_node_schedule *s = &driver->rt.schedule;
+	uint32_t i, index, n_records;
+	int32_t filled;
+
+	/* the driver is also in its own schedule */
+	n_records = s->n_entries;
+	if (n_records == 0)
+		return;
+
+	/* the ringbuffer has one writer, serialise the drivers of the data
+	 * loops. The lock is only held while the records are copied. */
+	while (!ATOMIC_CAS(p->lock, 0, 1))
+		;
+
+	filled = spa_ringbuffer_get_write_index(&h->ring, &index);
+	if (filled < 0 || (uint32_t)filled + n_records * sizeof(r) > p->size) {
+		h->dropped += n_records;
+		goto done;
+	}
+
+	p->cycle++;
+	fill_record(&r, driver, driver, p->cycle);
+	spa_ringbuffer_write_data(&h->ring, p->data, p->size,
+			index & (p->size - 1), &r, sizeof(r));
+	index += sizeof(r);
+
+	for (i = 0; i < s->n_entries; i++) {
+		struct pw_node_schedule_entry *e = &s->entries[i];
+		if (e->node == driver)
+			continue;
+		fill_record(&r, driver, e->node, p->cycle);
+		spa_ringbuffer_write_data(&h->ring, p->data, p->size,
+				index & (p->size - 1), &r, sizeof(r));
+		index += sizeof(r);
+	}
+	spa_ringbuffer_write_update(&h->ring, index);
+done:
+	ATOMIC_STORE(p->lock, 0);
+}
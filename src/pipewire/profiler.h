@@ -0,0 +1,92 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PIPEWIRE_PROFILER_H
+#define PIPEWIRE_PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+/** \page page_profiler Profiler
+ *
+ * When the core is created with the core.profiler property set, the
+ * drivers append a record for themselves and for each of their followers
+ * into a ringbuffer in shared memory after every cycle. The shared
+ * memory is named with \ref pw_profiler_shm_name and can be mapped by
+ * tools to gather timing statistics without enabling trace logging.
+ */
+
+#define PW_PROFILER_MAGIC	0x50575046u	/* "PWPF" */
+#define PW_PROFILER_VERSION	2
+
+#define PW_PROFILER_DEFAULT_SIZE	(1u << 20)	/**< default size of the ringbuffer */
+
+/** the header at the start of the shared memory, followed by the
+ * ringbuffer data */
+struct pw_profiler_header {
+	uint32_t magic;			/**< PW_PROFILER_MAGIC */
+	uint32_t version;		/**< PW_PROFILER_VERSION */
+	uint32_t size;			/**< size of the ringbuffer data, a power of 2 */
+	uint32_t record_size;		/**< size of a pw_profiler_record */
+	uint64_t dropped;		/**< records dropped because the ringbuffer was full */
+	struct spa_ringbuffer ring;	/**< ringbuffer, the reader updates the read index */
+	uint32_t padding[8];
+};
+
+/** a record for one node in one cycle of a driver */
+struct pw_profiler_record {
+	uint64_t cycle;			/**< cycle counter of the driver */
+	uint32_t driver_id;		/**< id of the driver */
+	uint32_t node_id;		/**< id of the node, driver_id for the driver record */
+	int32_t status;			/**< activation status */
+	uint32_t xrun_count;		/**< number of xruns of the node */
+	uint64_t signal_time;		/**< time the node was triggered */
+	uint64_t awake_time;		/**< time the node started processing */
+	uint64_t finish_time;		/**< time the node completed */
+	uint32_t duration;		/**< quantum of the driver */
+	uint32_t rate;			/**< rate of the driver */
+	float cpu_load[3];		/**< DSP load of the driver over short, medium
+					  *  and long time, 0 for followers */
+	uint32_t padding;
+	uint64_t cpu_time;		/**< thread cpu time of the node in the cycle,
+					  *  0 when not measured */
+};
+
+/** make the name of the shared memory of the profiler of core \a core_name */
+static inline int pw_profiler_shm_name(char *name, size_t len, const char *core_name)
+{
+	return snprintf(name, len, "/%s-profiler", core_name);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_PROFILER_H */
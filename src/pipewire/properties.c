@@ -30,13 +30,78 @@
 #include "pipewire/properties.h"
 
 /** \cond */
+/* with this many items, keys are looked up in a hash index */
+#define INDEX_MIN_ITEMS	16
+
+struct index_slot {
+	uint32_t hash;
+	uint32_t pos;		/* item index + 1, 0 for an empty slot */
+};
+
 struct properties {
 	struct pw_properties this;
 
 	struct pw_array items;
+
+	struct index_slot *index;
+	uint32_t index_size;	/* power of 2, 0 when there is no index */
 };
 /** \endcond */
 
+static uint32_t key_hash(const char *key)
+{
+	uint32_t hash = 2166136261u;
+	while (*key)
+		hash = (hash ^ (uint8_t)*key++) * 16777619u;
+	return hash;
+}
+
+static void index_insert(struct properties *impl, uint32_t pos)
+{
+	const struct spa_dict_item *item = &impl->this.dict.items[pos];
+	uint32_t hash = key_hash(item->key), mask = impl->index_size - 1, i;
+
+	for (i = hash & mask; impl->index[i].pos != 0; i = (i + 1) & mask);
+	impl->index[i].hash = hash;
+	impl->index[i].pos = pos + 1;
+}
+
+/* keep the index at most half full so that probing stays short */
+static void index_rebuild(struct properties *impl)
+{
+	uint32_t i, n_items = impl->this.dict.n_items, size = 32;
+	struct index_slot *index;
+
+	while (size < n_items * 2)
+		size <<= 1;
+
+	if (size != impl->index_size) {
+		if ((index = realloc(impl->index, size * sizeof(struct index_slot))) == NULL) {
+			free(impl->index);
+			impl->index = NULL;
+			impl->index_size = 0;
+			return;
+		}
+		impl->index = index;
+		impl->index_size = size;
+	}
+	memset(impl->index, 0, size * sizeof(struct index_slot));
+	for (i = 0; i < n_items; i++)
+		index_insert(impl, i);
+}
+
+static void index_add(struct properties *impl)
+{
+	uint32_t n_items = impl->this.dict.n_items;
+
+	if (n_items < INDEX_MIN_ITEMS)
+		return;
+	if (n_items == INDEX_MIN_ITEMS || impl->index_size < n_items * 2)
+		index_rebuild(impl);
+	else
+		index_insert(impl, n_items - 1);
+}
+
 static int add_func(struct pw_properties *this, char *key, char *value)
 {
 	struct spa_dict_item *item;
@@ -51,6 +116,8 @@ static int add_func(struct pw_properties *this, char *key, char *value)
 
 	this->dict.items = impl->items.data;
 	this->dict.n_items++;
+
+	index_add(impl);
 	return 0;
 }
 
@@ -62,7 +129,25 @@ static void clear_item(struct spa_dict_item *item)
 
 static int find_index(const struct pw_properties *this, const char *key)
 {
+	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
 	const struct spa_dict_item *item;
+
+	if (key == NULL)
+		return -1;
+
+	if (impl->index_size > 0 &&
+	    this->dict.n_items >= INDEX_MIN_ITEMS) {
+		uint32_t hash = key_hash(key), mask = impl->index_size - 1, i;
+		const struct index_slot *slot;
+
+		for (i = hash & mask; (slot = &impl->index[i])->pos != 0; i = (i + 1) & mask) {
+			if (slot->hash == hash &&
+			    strcmp(this->dict.items[slot->pos - 1].key, key) == 0)
+				return slot->pos - 1;
+		}
+		return -1;
+	}
+
 	item = spa_dict_lookup_item(&this->dict, key);
 	if (item == NULL)
 		return -1;
@@ -279,6 +364,7 @@ void pw_properties_free(struct pw_properties *properties)
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
 	pw_properties_clear(properties);
 	pw_array_clear(&impl->items);
+	free(impl->index);
 	free(impl);
 }
 
@@ -315,6 +401,8 @@ static int do_replace(struct pw_properties *properties, const char *key, char *v
 			item->value = last->value;
 			impl->items.size -= sizeof(struct spa_dict_item);
 			properties->dict.n_items--;
+			if (properties->dict.n_items >= INDEX_MIN_ITEMS)
+				index_rebuild(impl);
 		} else {
 			free((char *) item->value);
 			item->value = copy ? strdup(value) : value;
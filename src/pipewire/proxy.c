@@ -64,7 +64,7 @@ struct pw_proxy *pw_proxy_new(struct pw_proxy *factory,
 	struct pw_remote *remote = factory->remote;
 	int res;
 
-	impl = calloc(1, sizeof(struct proxy) + user_data_size);
+	impl = pw_slab_alloc(sizeof(struct proxy) + user_data_size);
 	if (impl == NULL)
 		return NULL;
 
@@ -101,7 +101,7 @@ struct pw_proxy *pw_proxy_new(struct pw_proxy *factory,
 	return this;
 
 error_clean:
-	free(impl);
+	pw_slab_free(impl);
 	errno = -res;
 	return NULL;
 }
@@ -203,7 +203,7 @@ void pw_proxy_unref(struct pw_proxy *proxy)
 		return;
 
 	pw_log_debug(NAME" %p: free %u", proxy, proxy->id);
-	free(proxy);
+	pw_slab_free(proxy);
 }
 
 SPA_EXPORT
@@ -398,7 +398,7 @@ do_connect(struct spa_loop *loop,
 		res = -errno;
 		goto error_clean_core_proxy;
 	}
-	remote->pool = pw_mempool_new(NULL);
+	remote->pool = pw_core_create_mempool(remote->core);
 
 	pw_core_proxy_add_listener(remote->core_proxy, &impl->core_listener, &core_events, remote);
 	pw_proxy_add_listener(core_proxy, &impl->core_proxy_listener, &core_proxy_events, remote);
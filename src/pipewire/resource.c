@@ -52,7 +52,7 @@ struct pw_resource *pw_resource_new(struct pw_client *client,
 	struct pw_resource *this;
 	int res;
 
-	impl = calloc(1, sizeof(struct impl) + user_data_size);
+	impl = pw_slab_alloc(sizeof(struct impl) + user_data_size);
 	if (impl == NULL)
 		return NULL;
 
@@ -100,7 +100,7 @@ struct pw_resource *pw_resource_new(struct pw_client *client,
 	return this;
 
 error_clean:
-	free(impl);
+	pw_slab_free(impl);
 	errno = -res;
 	return NULL;
 }
@@ -234,5 +234,5 @@ void pw_resource_destroy(struct pw_resource *resource)
 
 	pw_log_debug(NAME" %p: free %u", resource, resource->id);
 
-	free(resource);
+	pw_slab_free(resource);
 }
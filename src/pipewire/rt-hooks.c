@@ -0,0 +1,121 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "pipewire/log.h"
+#include "pipewire/private.h"
+
+#define NAME "rt-hooks"
+
+static void free_sets(struct pw_rt_hook_set *s)
+{
+	struct pw_rt_hook_set *next;
+
+	for (; s != NULL; s = next) {
+		next = s->next;
+		free(s);
+	}
+}
+
+/* Wait until the readers that could have loaded the old set are done.
+ * A reader makes the epoch odd while it emits, so a change of the epoch
+ * means that the reader left. Returns false when the calling thread is
+ * the reader itself, it emits the old set and it can't be freed yet. */
+static bool wait_readers(struct pw_rt_hooks *hooks)
+{
+	uint32_t epoch = ATOMIC_LOAD(hooks->epoch);
+
+	if ((epoch & 1) == 0)
+		return true;
+	if (pthread_equal(hooks->reader, pthread_self()))
+		return false;
+
+	while (ATOMIC_LOAD(hooks->epoch) == epoch)
+		sched_yield();
+	return true;
+}
+
+void pw_rt_hooks_init(struct pw_rt_hooks *hooks)
+{
+	spa_zero(*hooks);
+}
+
+void pw_rt_hooks_clear(struct pw_rt_hooks *hooks)
+{
+	free_sets(hooks->set);
+	free_sets(hooks->retired);
+	spa_zero(*hooks);
+}
+
+int pw_rt_hooks_update(struct pw_rt_hooks *hooks, struct spa_hook_list *list,
+		struct spa_hook *removed)
+{
+	struct pw_rt_hook_set *s, *old = hooks->set;
+	struct spa_hook *h;
+	uint32_t i, n_callbacks = 0;
+
+	/* readers of the old set must not call the removed hook anymore,
+	 * even when we can't make a new set */
+	if (old != NULL && removed != NULL) {
+		for (i = 0; i < old->n_callbacks; i++) {
+			if (old->callbacks[i].funcs == removed->cb.funcs &&
+			    old->callbacks[i].data == removed->cb.data)
+				ATOMIC_STORE(old->callbacks[i].funcs, NULL);
+		}
+	}
+
+	spa_list_for_each(h, &list->list, link)
+		n_callbacks++;
+
+	s = malloc(sizeof(*s) + n_callbacks * sizeof(struct spa_callbacks));
+	if (s == NULL) {
+		int res = -errno;
+		pw_log_error(NAME" %p: can't update hooks: %m", hooks);
+		wait_readers(hooks);
+		return res;
+	}
+	s->next = NULL;
+	s->n_callbacks = 0;
+	spa_list_for_each(h, &list->list, link)
+		s->callbacks[s->n_callbacks++] = h->cb;
+
+	ATOMIC_STORE(hooks->set, s);
+
+	if (old == NULL)
+		return 0;
+
+	if (wait_readers(hooks)) {
+		free_sets(hooks->retired);
+		hooks->retired = NULL;
+		free(old);
+	} else {
+		old->next = hooks->retired;
+		hooks->retired = old;
+	}
+	return 0;
+}
@@ -0,0 +1,166 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipewire/log.h"
+#include "pipewire/private.h"
+
+#define NAME "slab"
+
+/* blocks are rounded up to a multiple of SLAB_GRANULE bytes, bigger blocks
+ * are not cached */
+#define SLAB_GRANULE	64
+#define SLAB_CLASSES	16
+#define SLAB_MAX_FREE	64
+#define SLAB_NO_CLASS	UINT32_MAX
+
+/** \cond */
+struct slab_header {
+	uint32_t klass;
+	uint32_t padding[3];
+};
+
+struct slab_free {
+	struct slab_free *next;
+};
+
+struct slab_cache {
+	struct {
+		struct slab_free *free;
+		uint32_t n_free;
+	} classes[SLAB_CLASSES];
+	uint64_t n_alloc;
+	uint64_t n_reused;
+	uint64_t n_released;
+};
+
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static __thread struct slab_cache *thread_cache;
+/** \endcond */
+
+static void cache_destroy(void *data)
+{
+	struct slab_cache *cache = data;
+	struct slab_free *f;
+	uint32_t i;
+
+	pw_log_debug(NAME" %p: alloc:%"PRIu64" reused:%"PRIu64" released:%"PRIu64,
+			cache, cache->n_alloc, cache->n_reused, cache->n_released);
+
+	for (i = 0; i < SLAB_CLASSES; i++) {
+		while ((f = cache->classes[i].free) != NULL) {
+			cache->classes[i].free = f->next;
+			free(SPA_MEMBER(f, -(int)sizeof(struct slab_header), void));
+		}
+	}
+	free(cache);
+}
+
+static void cache_key_init(void)
+{
+	pthread_key_create(&cache_key, cache_destroy);
+}
+
+static struct slab_cache *get_cache(void)
+{
+	struct slab_cache *cache = thread_cache;
+
+	if (SPA_LIKELY(cache != NULL))
+		return cache;
+
+	pthread_once(&cache_once, cache_key_init);
+	if ((cache = calloc(1, sizeof(struct slab_cache))) == NULL)
+		return NULL;
+	if (pthread_setspecific(cache_key, cache) != 0) {
+		free(cache);
+		return NULL;
+	}
+	thread_cache = cache;
+	return cache;
+}
+
+/** Allocate \a size bytes of zeroed memory. Small blocks come from a per
+ * thread cache of recently freed blocks of the same size class. Free with
+ * pw_slab_free(), from any thread. */
+void *pw_slab_alloc(size_t size)
+{
+	struct slab_cache *cache;
+	struct slab_header *h;
+	struct slab_free *f;
+	uint32_t klass;
+
+	size += sizeof(struct slab_header);
+	klass = (size + SLAB_GRANULE - 1) / SLAB_GRANULE - 1;
+
+	if (klass >= SLAB_CLASSES || (cache = get_cache()) == NULL) {
+		if ((h = calloc(1, size)) == NULL)
+			return NULL;
+		h->klass = SLAB_NO_CLASS;
+		return SPA_MEMBER(h, sizeof(struct slab_header), void);
+	}
+
+	cache->n_alloc++;
+	if ((f = cache->classes[klass].free) != NULL) {
+		cache->classes[klass].free = f->next;
+		cache->classes[klass].n_free--;
+		cache->n_reused++;
+		h = SPA_MEMBER(f, -(int)sizeof(struct slab_header), struct slab_header);
+		memset(f, 0, (klass + 1) * SLAB_GRANULE - sizeof(struct slab_header));
+	} else {
+		if ((h = calloc(1, (klass + 1) * SLAB_GRANULE)) == NULL)
+			return NULL;
+	}
+	h->klass = klass;
+	return SPA_MEMBER(h, sizeof(struct slab_header), void);
+}
+
+/** Free memory from pw_slab_alloc(). The block is kept in the cache of the
+ * calling thread when there is room. */
+void pw_slab_free(void *data)
+{
+	struct slab_header *h;
+	struct slab_cache *cache;
+	struct slab_free *f = data;
+
+	if (data == NULL)
+		return;
+
+	h = SPA_MEMBER(data, -(int)sizeof(struct slab_header), struct slab_header);
+	if (h->klass == SLAB_NO_CLASS || (cache = get_cache()) == NULL) {
+		free(h);
+		return;
+	}
+	if (cache->classes[h->klass].n_free >= SLAB_MAX_FREE) {
+		cache->n_released++;
+		free(h);
+		return;
+	}
+	f->next = cache->classes[h->klass].free;
+	cache->classes[h->klass].free = f;
+	cache->classes[h->klass].n_free++;
+}
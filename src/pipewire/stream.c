@@ -28,8 +28,11 @@
 #include <sys/mman.h>
 #include <time.h>
 
+#include "config.h"
+
 #include <spa/buffer/alloc.h>
 #include <spa/param/props.h>
+#include <spa/param/audio/format-utils.h>
 #include <spa/node/io.h>
 #include <spa/node/utils.h>
 #include <spa/utils/ringbuffer.h>
@@ -44,12 +47,14 @@
 
 #define NAME "stream"
 
-#define MAX_BUFFERS	64
+#define MAX_BUFFERS	64u
 #define MIN_QUEUED	1
 
 #define MASK_BUFFERS	(MAX_BUFFERS-1)
 #define MAX_PORTS	1
 
+#define DEFAULT_RING_SIZE	(64 * 1024)
+
 struct buffer {
 	struct pw_buffer this;
 	uint32_t id;
@@ -60,7 +65,7 @@ struct buffer {
 
 struct queue {
 	uint32_t ids[MAX_BUFFERS];
-	struct spa_ringbuffer ring;
+	struct spa_ringbuffer_spsc ring;
 	uint64_t incount;
 	uint64_t outcount;
 };
@@ -109,8 +114,11 @@ struct stream {
 	struct spa_node_methods node_methods;
 	struct spa_hook_list hooks;
 	struct spa_callbacks callbacks;
+	struct pw_rt_hooks rt_hooks;		/**< listeners emitted from the data thread */
 	struct spa_io_buffers *io;
 	struct spa_io_position *position;
+	struct spa_io_rate_match *rate_match;
+	struct pw_node_control *control;
 
 	struct spa_list param_list;
 	struct spa_param_info params[5];
@@ -123,8 +131,22 @@ struct stream {
 
 	uint32_t pending_seq;
 
+	struct spa_pod *last_format;	/**< format of the previous connection */
+
 	struct queue dequeued;
 	struct queue queued;
+	uint32_t mailbox;		/**< newest buffer of a capture stream with
+					  *  PW_STREAM_FLAG_KEEP_LATEST */
+
+	struct spa_ringbuffer ring;	/**< byte ring for PW_STREAM_FLAG_RING */
+	uint8_t *ring_data;
+	uint32_t ring_size;		/**< power of two */
+	uint32_t stride;		/**< frame size of the format or 0 */
+	uint32_t rate;			/**< sample rate of the format or 0 */
+
+	uint32_t watermark;		/**< percentage of buffers that wakes up
+					  *  the application, 0 to wake up every cycle */
+	int process_pending;		/**< a process wakeup is in flight */
 
 	struct data data;
 	uintptr_t seq;
@@ -210,9 +232,9 @@ static inline int push_queue(struct stream *stream, struct queue *queue, struct
 	SPA_FLAG_SET(buffer->flags, BUFFER_FLAG_QUEUED);
 	queue->incount += buffer->this.size;
 
-	spa_ringbuffer_get_write_index(&queue->ring, &index);
+	spa_ringbuffer_spsc_get_write_index(&queue->ring, &index, MAX_BUFFERS);
 	queue->ids[index & MASK_BUFFERS] = buffer->id;
-	spa_ringbuffer_write_update(&queue->ring, index + 1);
+	spa_ringbuffer_spsc_write_update(&queue->ring, index + 1);
 
 	return 0;
 }
@@ -223,13 +245,13 @@ static inline struct buffer *pop_queue(struct stream *stream, struct queue *queu
 	uint32_t index, id;
 	struct buffer *buffer;
 
-	if ((avail = spa_ringbuffer_get_read_index(&queue->ring, &index)) < MIN_QUEUED) {
+	if ((avail = spa_ringbuffer_spsc_get_read_index(&queue->ring, &index)) < MIN_QUEUED) {
 		errno = EPIPE;
 		return NULL;
 	}
 
 	id = queue->ids[index & MASK_BUFFERS];
-	spa_ringbuffer_read_update(&queue->ring, index + 1);
+	spa_ringbuffer_spsc_read_update(&queue->ring, index + 1);
 
 	buffer = &stream->buffers[id];
 	queue->outcount += buffer->this.size;
@@ -237,9 +259,80 @@ static inline struct buffer *pop_queue(struct stream *stream, struct queue *queu
 
 	return buffer;
 }
+
+/* batch versions of push_queue and pop_queue that move all buffers with
+ * one update of the ring index */
+static inline int push_queue_n(struct stream *stream, struct queue *queue,
+		struct buffer **buffers, uint32_t n_buffers)
+{
+	uint32_t i, index;
+
+	for (i = 0; i < n_buffers; i++) {
+		if (SPA_FLAG_IS_SET(buffers[i]->flags, BUFFER_FLAG_QUEUED))
+			return -EINVAL;
+	}
+	spa_ringbuffer_spsc_get_write_index(&queue->ring, &index, MAX_BUFFERS);
+	for (i = 0; i < n_buffers; i++) {
+		SPA_FLAG_SET(buffers[i]->flags, BUFFER_FLAG_QUEUED);
+		queue->incount += buffers[i]->this.size;
+		queue->ids[(index + i) & MASK_BUFFERS] = buffers[i]->id;
+	}
+	spa_ringbuffer_spsc_write_update(&queue->ring, index + n_buffers);
+
+	return 0;
+}
+
+static inline uint32_t pop_queue_n(struct stream *stream, struct queue *queue,
+		struct buffer **buffers, uint32_t max)
+{
+	int32_t avail;
+	uint32_t i, index, n;
+
+	avail = spa_ringbuffer_spsc_get_read_index(&queue->ring, &index);
+	n = SPA_MIN((uint32_t)SPA_MAX(avail, 0), max);
+
+	for (i = 0; i < n; i++) {
+		struct buffer *buffer = &stream->buffers[queue->ids[(index + i) & MASK_BUFFERS]];
+		queue->outcount += buffer->this.size;
+		SPA_FLAG_CLEAR(buffer->flags, BUFFER_FLAG_QUEUED);
+		buffers[i] = buffer;
+	}
+	if (n > 0)
+		spa_ringbuffer_spsc_read_update(&queue->ring, index + n);
+
+	return n;
+}
+
+/* with PW_STREAM_FLAG_KEEP_LATEST, skip to the newest buffer in the queue
+ * and move the older ones to the recycle queue. Only called by the
+ * consumer of queue and the producer of recycle so that both rings keep
+ * one reader and one writer. Capture streams use the mailbox instead. */
+static inline struct buffer *keep_latest(struct stream *stream, struct queue *queue,
+		struct queue *recycle, struct buffer *buffer)
+{
+	struct buffer *next;
+
+	while ((next = pop_queue(stream, queue)) != NULL) {
+		pw_log_trace(NAME" %p: drop buffer %d", stream, buffer->id);
+		push_queue(stream, recycle, buffer);
+		buffer = next;
+	}
+	return buffer;
+}
+
+/* a capture stream with PW_STREAM_FLAG_KEEP_LATEST doesn't queue the
+ * buffers it receives. The data thread swaps the newest buffer into the
+ * mailbox and recycles the one it replaces, the application swaps it out
+ * when it dequeues. */
+static inline bool use_mailbox(struct stream *impl)
+{
+	return impl->direction == SPA_DIRECTION_INPUT &&
+		SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_KEEP_LATEST);
+}
+
 static inline void clear_queue(struct stream *stream, struct queue *queue)
 {
-	spa_ringbuffer_init(&queue->ring);
+	spa_ringbuffer_spsc_init(&queue->ring);
 	queue->incount = queue->outcount;
 }
 
@@ -279,7 +372,8 @@ do_call_process(struct spa_loop *loop,
 	struct stream *impl = user_data;
 	struct pw_stream *stream = &impl->this;
 	pw_log_trace(NAME" %p: do process", stream);
-	pw_stream_emit_process(stream);
+	ATOMIC_STORE(impl->process_pending, 0);
+	pw_rt_hooks_call(&impl->rt_hooks, struct pw_stream_events, process, 0);
 	return 0;
 }
 
@@ -290,11 +384,39 @@ static void call_process(struct stream *impl)
 		do_call_process(NULL, false, 1, NULL, 0, impl);
 	}
 	else {
+		/* with a watermark the application handles all available
+		 * buffers in one callback, don't queue more wakeups */
+		if (impl->watermark > 0 &&
+		    ATOMIC_XCHG(impl->process_pending, 1))
+			return;
 		pw_loop_invoke(impl->core->main_loop,
 			do_call_process, 1, NULL, 0, false, impl);
 	}
 }
 
+/* check if the application needs to be woken up. Without a watermark
+ * this is every cycle, with a watermark only when the playback queue
+ * drains below it or the capture queue fills up to it. */
+static inline bool need_process(struct stream *impl)
+{
+	uint32_t level;
+	int32_t avail;
+
+	if (impl->watermark == 0 ||
+	    SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_RT_PROCESS))
+		return true;
+
+	level = SPA_MAX(impl->n_buffers * impl->watermark / 100, 1u);
+
+	if (impl->direction == SPA_DIRECTION_OUTPUT) {
+		avail = spa_ringbuffer_spsc_get_fill(&impl->queued.ring);
+		return avail <= (int32_t)level;
+	} else {
+		avail = spa_ringbuffer_spsc_get_fill(&impl->dequeued.ring);
+		return avail >= (int32_t)level;
+	}
+}
+
 static int
 do_call_drained(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -326,6 +448,12 @@ static int impl_set_io(void *object, uint32_t id, void *data, size_t size)
 		else
 			impl->position = NULL;
 		break;
+	case SPA_IO_Notify:
+		if (data && size >= sizeof(struct pw_node_control) + PW_NODE_CONTROL_SIZE)
+			impl->control = data;
+		else
+			impl->control = NULL;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -445,6 +573,17 @@ static int impl_port_set_io(void *object, enum spa_direction direction, uint32_t
 		else
 			impl->io = NULL;
 		break;
+	case SPA_IO_RateMatch:
+		/* the resampler in front of a playback stream drops unused
+		 * input when it has a rate match area, only the ring can
+		 * provide exactly the requested size */
+		if (impl->direction == SPA_DIRECTION_OUTPUT && impl->ring_data == NULL)
+			return -ENOTSUP;
+		if (data && size >= sizeof(struct spa_io_rate_match))
+			impl->rate_match = data;
+		else
+			impl->rate_match = NULL;
+		break;
 	default:
 		return -ENOENT;
 	}
@@ -496,6 +635,52 @@ static int impl_port_enum_params(void *object, int seq,
 	return 0;
 }
 
+static void parse_audio_format(struct stream *impl, const struct spa_pod *format)
+{
+	struct spa_audio_info info = { 0 };
+	uint32_t width;
+
+	impl->stride = impl->rate = 0;
+
+	if (format == NULL ||
+	    spa_format_parse(format, &info.media_type, &info.media_subtype) < 0 ||
+	    info.media_type != SPA_MEDIA_TYPE_audio ||
+	    info.media_subtype != SPA_MEDIA_SUBTYPE_raw ||
+	    spa_format_audio_raw_parse(format, &info.info.raw) < 0)
+		return;
+
+	impl->rate = info.info.raw.rate;
+	if (SPA_AUDIO_FORMAT_IS_PLANAR(info.info.raw.format))
+		return;
+
+	switch (info.info.raw.format) {
+	case SPA_AUDIO_FORMAT_S8:
+	case SPA_AUDIO_FORMAT_U8:
+		width = 1;
+		break;
+	case SPA_AUDIO_FORMAT_S16:
+	case SPA_AUDIO_FORMAT_S16_OE:
+	case SPA_AUDIO_FORMAT_U16:
+	case SPA_AUDIO_FORMAT_U16_OE:
+		width = 2;
+		break;
+	case SPA_AUDIO_FORMAT_S24:
+	case SPA_AUDIO_FORMAT_S24_OE:
+	case SPA_AUDIO_FORMAT_U24:
+	case SPA_AUDIO_FORMAT_U24_OE:
+		width = 3;
+		break;
+	case SPA_AUDIO_FORMAT_F64:
+	case SPA_AUDIO_FORMAT_F64_OE:
+		width = 8;
+		break;
+	default:
+		width = 4;
+		break;
+	}
+	impl->stride = width * info.info.raw.channels;
+}
+
 static int port_set_format(struct stream *impl,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags, const struct spa_pod *format)
@@ -517,9 +702,17 @@ static int port_set_format(struct stream *impl,
 		}
 
 		((struct spa_pod_object*)p->param)->body.id = SPA_PARAM_Format;
+
+		free(impl->last_format);
+		if ((impl->last_format = malloc(SPA_POD_SIZE(format))) != NULL)
+			memcpy(impl->last_format, format, SPA_POD_SIZE(format));
+
+		parse_audio_format(impl, format);
 	}
-	else
+	else {
 		p = NULL;
+		parse_audio_format(impl, NULL);
+	}
 
 	count = pw_stream_emit_format_changed(stream, p ? p->param : NULL);
 
@@ -610,6 +803,9 @@ static void clear_buffers(struct pw_stream *stream)
 		if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_MAPPED)) {
 			for (j = 0; j < b->this.buffer->n_datas; j++) {
 				struct spa_data *d = &b->this.buffer->datas[j];
+				if (d->type != SPA_DATA_MemFd &&
+				    d->type != SPA_DATA_DmaBuf)
+					continue;
 				pw_log_debug(NAME" %p: clear buffer %d mem",
 						stream, b->id);
 				unmap_data(impl, d);
@@ -617,10 +813,38 @@ static void clear_buffers(struct pw_stream *stream)
 		}
 	}
 	impl->n_buffers = 0;
+	impl->mailbox = SPA_ID_INVALID;
 	clear_queue(impl, &impl->dequeued);
 	clear_queue(impl, &impl->queued);
 }
 
+static int map_buffer(struct stream *impl, struct buffer *b)
+{
+	struct spa_buffer *buf = b->this.buffer;
+	uint32_t i;
+	int res, prot;
+
+	prot = PROT_READ | (impl->direction == SPA_DIRECTION_OUTPUT ? PROT_WRITE : 0);
+
+	for (i = 0; i < buf->n_datas; i++) {
+		struct spa_data *d = &buf->datas[i];
+		if (d->type != SPA_DATA_MemFd &&
+		    d->type != SPA_DATA_DmaBuf)
+			continue;
+		if ((res = map_data(impl, d, prot)) < 0) {
+			while (i-- > 0) {
+				d = &buf->datas[i];
+				if (d->type == SPA_DATA_MemFd ||
+				    d->type == SPA_DATA_DmaBuf)
+					unmap_data(impl, d);
+			}
+			return res;
+		}
+	}
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+	return 0;
+}
+
 static int impl_port_use_buffers(void *object,
 		enum spa_direction direction, uint32_t port_id,
 		uint32_t flags,
@@ -629,14 +853,12 @@ static int impl_port_use_buffers(void *object,
 	struct stream *impl = object;
 	struct pw_stream *stream = &impl->this;
 	uint32_t i, j, impl_flags = impl->flags;
-	int prot, res;
+	int res;
 	int size = 0;
 
 	if (impl->disconnecting)
 		return n_buffers == 0 ? 0 : -EIO;
 
-	prot = PROT_READ | (direction == SPA_DIRECTION_OUTPUT ? PROT_WRITE : 0);
-
 	clear_buffers(stream);
 
 	for (i = 0; i < n_buffers; i++) {
@@ -645,26 +867,37 @@ static int impl_port_use_buffers(void *object,
 
 		b->flags = 0;
 		b->id = i;
+		b->this.buffer = buffers[i];
+		b->this.header = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_Header, sizeof(*b->this.header));
+		b->this.crop = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_VideoCrop, sizeof(*b->this.crop));
+		b->this.damage = spa_buffer_find_meta(buffers[i], SPA_META_VideoDamage);
+		b->this.cursor = spa_buffer_find_meta_data(buffers[i],
+				SPA_META_Cursor, sizeof(*b->this.cursor));
 
 		if (SPA_FLAG_IS_SET(impl_flags, PW_STREAM_FLAG_MAP_BUFFERS)) {
 			for (j = 0; j < buffers[i]->n_datas; j++) {
 				struct spa_data *d = &buffers[i]->datas[j];
-				if (d->type == SPA_DATA_MemFd ||
-				    d->type == SPA_DATA_DmaBuf) {
-					if ((res = map_data(impl, d, prot)) < 0)
-						return res;
-				}
-				else if (d->data == NULL) {
+				if (d->type != SPA_DATA_MemFd &&
+				    d->type != SPA_DATA_DmaBuf &&
+				    d->data == NULL) {
 					pw_log_error(NAME" %p: invalid buffer mem", stream);
-					return -EINVAL;
+					res = -EINVAL;
+					goto error;
 				}
 				buf_size += d->maxsize;
 			}
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+			/* lazy buffers are mapped in dequeue */
+			if (!SPA_FLAG_IS_SET(impl_flags, PW_STREAM_FLAG_LAZY_MAP) &&
+			    (res = map_buffer(impl, b)) < 0)
+				goto error;
 
 			if (size > 0 && buf_size != size) {
 				pw_log_error(NAME" %p: invalid buffer size %d", stream, buf_size);
-				return -EINVAL;
+				res = -EINVAL;
+				i++;
+				goto error;
 			} else
 				size = buf_size;
 		}
@@ -675,10 +908,6 @@ static int impl_port_use_buffers(void *object,
 	for (i = 0; i < n_buffers; i++) {
 		struct buffer *b = &impl->buffers[i];
 
-		b->flags = 0;
-		b->id = i;
-		b->this.buffer = buffers[i];
-
 		if (impl->direction == SPA_DIRECTION_OUTPUT) {
 			pw_log_trace(NAME" %p: recycle buffer %d", stream, b->id);
 			push_queue(impl, &impl->dequeued, b);
@@ -696,6 +925,20 @@ static int impl_port_use_buffers(void *object,
 			NULL);
 
 	return 0;
+
+error:
+	while (i-- > 0) {
+		struct buffer *b = &impl->buffers[i];
+		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_MAPPED))
+			continue;
+		for (j = 0; j < b->this.buffer->n_datas; j++) {
+			struct spa_data *d = &b->this.buffer->datas[j];
+			if (d->type == SPA_DATA_MemFd ||
+			    d->type == SPA_DATA_DmaBuf)
+				unmap_data(impl, d);
+		}
+	}
+	return res;
 }
 
 static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
@@ -707,6 +950,27 @@ static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffe
 	return 0;
 }
 
+/* the delay of the resampler between the stream and the graph in
+ * clock ticks, capture resamples from the graph rate and playback from
+ * the stream rate */
+static inline int64_t rate_match_delay(struct stream *impl, struct spa_io_position *p)
+{
+	struct spa_io_rate_match *r = impl->rate_match;
+	int64_t delay;
+
+	if (r == NULL || r->delay == 0)
+		return 0;
+
+	if (impl->direction == SPA_DIRECTION_INPUT)
+		return r->delay;
+
+	if (impl->rate == 0 || p->clock.rate.num == 0)
+		return 0;
+
+	delay = (int64_t)r->delay * p->clock.rate.denom / (p->clock.rate.num * impl->rate);
+	return -delay;
+}
+
 static inline void copy_position(struct stream *impl, int64_t queued)
 {
 	struct spa_io_position *p = impl->position;
@@ -715,7 +979,7 @@ static inline void copy_position(struct stream *impl, int64_t queued)
 		impl->time.now = p->clock.nsec;
 		impl->time.rate = p->clock.rate;
 		impl->time.ticks = p->clock.position;
-		impl->time.delay = p->clock.delay;
+		impl->time.delay = p->clock.delay + rate_match_delay(impl, p);
 		impl->time.queued = queued;
 		SEQ_WRITE(impl->seq);
 	}
@@ -728,6 +992,7 @@ static int impl_node_process_input(void *object)
 	struct spa_io_buffers *io = impl->io;
 	struct buffer *b;
 	uint64_t size;
+	uint32_t old;
 
 	size = impl->time.ticks - impl->dequeued.incount;
 
@@ -742,8 +1007,24 @@ static int impl_node_process_input(void *object)
 
 	b->this.size = size;
 
+	if (use_mailbox(impl)) {
+		impl->dequeued.incount += size;
+		old = __atomic_exchange_n(&impl->mailbox, b->id, __ATOMIC_ACQ_REL);
+		if (old != SPA_ID_INVALID) {
+			/* the application did not take the previous buffer,
+			 * give it back without waking up the application */
+			pw_log_trace(NAME" %p: drop buffer %d", stream, old);
+			copy_position(impl, impl->dequeued.incount);
+			io->buffer_id = old;
+			io->status = SPA_STATUS_NEED_DATA;
+			return SPA_STATUS_HAVE_DATA;
+		}
+		call_process(impl);
+		goto done;
+	}
+
 	/* push new buffer */
-	if (push_queue(impl, &impl->dequeued, b) == 0)
+	if (push_queue(impl, &impl->dequeued, b) == 0 && need_process(impl))
 		call_process(impl);
 
 done:
@@ -783,6 +1064,8 @@ again:
 
 		/* pop new buffer */
 		if ((b = pop_queue(impl, &impl->queued)) != NULL) {
+			if (SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_KEEP_LATEST))
+				b = keep_latest(impl, &impl->queued, &impl->dequeued, b);
 			io->buffer_id = b->id;
 			io->status = SPA_STATUS_HAVE_DATA;
 			pw_log_trace(NAME" %p: pop %d %p", stream, b->id, io);
@@ -798,8 +1081,9 @@ again:
 	}
 
 	if (!impl->draining && !SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_DRIVER)) {
-		call_process(impl);
-		if (spa_ringbuffer_get_read_index(&impl->queued.ring, &index) >= MIN_QUEUED &&
+		if (need_process(impl))
+			call_process(impl);
+		if (spa_ringbuffer_spsc_get_read_index(&impl->queued.ring, &index) >= MIN_QUEUED &&
 		    io->status == SPA_STATUS_NEED_DATA)
 			goto again;
 	}
@@ -812,6 +1096,139 @@ exit:
 	return res;
 }
 
+/* bytes the graph consumes in one cycle, the input size requested by
+ * the resampler or the quantum, the whole buffer when the frame size or
+ * the quantum are unknown */
+static inline uint32_t ring_quantum(struct stream *impl, uint32_t maxsize)
+{
+	struct spa_io_position *p = impl->position;
+	struct spa_io_rate_match *r = impl->rate_match;
+	uint64_t size;
+
+	if (impl->stride == 0)
+		return maxsize;
+
+	if (r != NULL && r->size > 0)
+		size = (uint64_t)r->size * impl->stride;
+	else if (p != NULL && p->clock.duration > 0)
+		size = p->clock.duration * impl->stride;
+	else
+		return maxsize;
+
+	return SPA_MIN(size, maxsize);
+}
+
+static int impl_node_process_ring_input(void *object)
+{
+	struct stream *impl = object;
+	struct pw_stream *stream = &impl->this;
+	struct spa_io_buffers *io = impl->io;
+	struct buffer *b = NULL;
+	struct spa_data *d;
+	uint32_t index, offset, size, avail;
+	int32_t filled;
+
+	pw_log_trace(NAME" %p: process ring in status:%d id:%d", stream,
+			io->status, io->buffer_id);
+
+	if (io->status == SPA_STATUS_HAVE_DATA &&
+	    (b = get_buffer(stream, io->buffer_id)) != NULL) {
+		d = &b->this.buffer->datas[0];
+		offset = SPA_MIN(d->chunk->offset, d->maxsize);
+		size = SPA_MIN(d->chunk->size, d->maxsize - offset);
+
+		filled = spa_ringbuffer_get_write_index(&impl->ring, &index);
+		avail = impl->ring_size - SPA_CLAMP(filled, 0, (int32_t)impl->ring_size);
+		if (size > avail) {
+			pw_log_trace(NAME" %p: ring overrun, dropping %u bytes",
+					stream, size - avail);
+			size = avail;
+		}
+		if (size > 0) {
+			spa_ringbuffer_write_data(&impl->ring,
+					impl->ring_data, impl->ring_size,
+					index & (impl->ring_size - 1),
+					SPA_MEMBER(d->data, offset, void), size);
+			spa_ringbuffer_write_update(&impl->ring, index + size);
+			call_process(impl);
+		}
+	}
+	copy_position(impl, 0);
+
+	/* the data was copied, the buffer can be recycled right away */
+	io->buffer_id = b ? b->id : SPA_ID_INVALID;
+	io->status = SPA_STATUS_NEED_DATA;
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static int impl_node_process_ring_output(void *object)
+{
+	struct stream *impl = object;
+	struct pw_stream *stream = &impl->this;
+	struct spa_io_buffers *io = impl->io;
+	struct buffer *b;
+	struct spa_data *d;
+	uint32_t index, size, avail;
+	int32_t filled;
+
+	pw_log_trace(NAME" %p: process ring out status:%d id:%d", stream,
+			io->status, io->buffer_id);
+
+	if (io->status != SPA_STATUS_HAVE_DATA) {
+		/* recycle old buffer */
+		if ((b = get_buffer(stream, io->buffer_id)) != NULL)
+			push_queue(impl, &impl->dequeued, b);
+
+		filled = spa_ringbuffer_get_read_index(&impl->ring, &index);
+		avail = SPA_CLAMP(filled, 0, (int32_t)impl->ring_size);
+
+		if (avail == 0 && impl->draining) {
+			io->buffer_id = SPA_ID_INVALID;
+			io->status = SPA_STATUS_NEED_DATA;
+			call_drained(impl);
+			goto exit;
+		}
+		if ((b = pop_queue(impl, &impl->dequeued)) != NULL) {
+			d = &b->this.buffer->datas[0];
+			size = ring_quantum(impl, d->maxsize);
+			avail = SPA_MIN(avail, size);
+			/* only copy whole frames so that the ring stays aligned */
+			if (impl->stride > 0)
+				avail -= avail % impl->stride;
+
+			spa_ringbuffer_read_data(&impl->ring,
+					impl->ring_data, impl->ring_size,
+					index & (impl->ring_size - 1), d->data, avail);
+			spa_ringbuffer_read_update(&impl->ring, index + avail);
+
+			if (avail < size) {
+				pw_log_trace(NAME" %p: ring underrun, %u bytes silence",
+						stream, size - avail);
+				memset(SPA_MEMBER(d->data, avail, void), 0, size - avail);
+			}
+			d->chunk->offset = 0;
+			d->chunk->size = size;
+			d->chunk->stride = impl->stride;
+
+			io->buffer_id = b->id;
+			io->status = SPA_STATUS_HAVE_DATA;
+		} else {
+			io->buffer_id = SPA_ID_INVALID;
+			io->status = SPA_STATUS_NEED_DATA;
+			pw_log_trace(NAME" %p: no more buffers %p", stream, io);
+		}
+	}
+
+	/* let the application refill the ring */
+	if (!impl->draining && !SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_DRIVER))
+		call_process(impl);
+exit:
+	copy_position(impl, 0);
+
+	return io->status;
+}
+
 static const struct spa_node_methods impl_node = {
 	SPA_VERSION_NODE_METHODS,
 	.add_listener = impl_add_listener,
@@ -1042,8 +1459,12 @@ static int handle_connect(struct pw_stream *stream)
 	if (!SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_INACTIVE))
 		pw_node_set_active(slave, true);
 
+	/* raw audio is converted to the DSP format of the graph by an
+	 * adapter in this process, so that the conversion runs in the data
+	 * thread of the client and not in the server */
 	if (impl->media_type == SPA_MEDIA_TYPE_audio &&
-	    impl->media_subtype == SPA_MEDIA_SUBTYPE_raw) {
+	    impl->media_subtype == SPA_MEDIA_SUBTYPE_raw &&
+	    !SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_NO_CONVERT)) {
 		factory = pw_core_find_factory(impl->core, "adapter");
 		if (factory == NULL) {
 			pw_log_error(NAME" %p: no adapter factory found", stream);
@@ -1174,11 +1595,13 @@ struct pw_stream * pw_stream_new(struct pw_remote *remote, const char *name,
 	this->name = name ? strdup(name) : NULL;
 	this->node_id = SPA_ID_INVALID;
 
-	spa_ringbuffer_init(&impl->dequeued.ring);
-	spa_ringbuffer_init(&impl->queued.ring);
+	spa_ringbuffer_spsc_init(&impl->dequeued.ring);
+	spa_ringbuffer_spsc_init(&impl->queued.ring);
+	impl->mailbox = SPA_ID_INVALID;
 	spa_list_init(&impl->param_list);
 
 	spa_hook_list_init(&this->listener_list);
+	pw_rt_hooks_init(&impl->rt_hooks);
 	spa_list_init(&this->controls);
 
 	this->state = PW_STREAM_STATE_UNCONNECTED;
@@ -1266,6 +1689,7 @@ SPA_EXPORT
 void pw_stream_destroy(struct pw_stream *stream)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct spa_hook *h;
 	struct control *c;
 
 	pw_log_debug(NAME" %p: destroy", stream);
@@ -1281,6 +1705,8 @@ void pw_stream_destroy(struct pw_stream *stream)
 
 	pw_log_debug(NAME" %p: free", stream);
 	free(stream->error);
+	free(impl->last_format);
+	free(impl->ring_data);
 
 	pw_properties_free(stream->properties);
 
@@ -1294,16 +1720,39 @@ void pw_stream_destroy(struct pw_stream *stream)
 	if (impl->free_data)
 		pw_core_destroy(impl->data.core);
 
+	/* the hooks that are still in the list must not update us anymore */
+	spa_list_for_each(h, &stream->listener_list.list, link) {
+		h->removed = NULL;
+		h->priv = NULL;
+	}
+	pw_rt_hooks_clear(&impl->rt_hooks);
+
 	free(impl);
 }
 
+static void listener_removed(struct spa_hook *listener)
+{
+	struct stream *impl = listener->priv;
+
+	listener->removed = NULL;
+	listener->priv = NULL;
+	pw_rt_hooks_update(&impl->rt_hooks, &impl->this.listener_list, listener);
+}
+
 SPA_EXPORT
 void pw_stream_add_listener(struct pw_stream *stream,
 			    struct spa_hook *listener,
 			    const struct pw_stream_events *events,
 			    void *data)
 {
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+
 	spa_hook_list_append(&stream->listener_list, listener, events, data);
+	/* the process event is emitted from the data thread with
+	 * PW_STREAM_FLAG_RT_PROCESS, keep its copy of the list up to date */
+	listener->removed = listener_removed;
+	listener->priv = impl;
+	pw_rt_hooks_update(&impl->rt_hooks, &stream->listener_list, NULL);
 }
 
 SPA_EXPORT
@@ -1408,6 +1857,58 @@ static const char *get_media_class(struct stream *impl)
 	}
 }
 
+/* when reconnecting, offer the format of the previous connection first
+ * so that negotiation ends up with the same format when possible */
+static void add_last_format(struct stream *impl,
+		const struct spa_pod **params, uint32_t n_params)
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b;
+	struct spa_pod *format;
+	uint32_t i;
+
+	if (impl->last_format == NULL)
+		return;
+
+	for (i = 0; i < n_params; i++) {
+		if (!spa_pod_is_object_id(params[i], SPA_PARAM_EnumFormat))
+			continue;
+
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		if (spa_pod_filter(&b, &format, params[i], impl->last_format) != 0)
+			continue;
+
+		pw_log_debug(NAME" %p: offer previous format", impl);
+		add_param(&impl->this, PARAM_TYPE_INIT, format);
+		return;
+	}
+	/* not possible with the new params */
+	free(impl->last_format);
+	impl->last_format = NULL;
+}
+
+static int alloc_ring(struct stream *impl)
+{
+	const char *str;
+	uint32_t size, req = DEFAULT_RING_SIZE;
+
+	if ((str = pw_properties_get(impl->this.properties, PW_KEY_STREAM_RING_SIZE)) != NULL)
+		req = SPA_CLAMP(pw_properties_parse_int(str), 1, 1 << 30);
+
+	for (size = 1; size < req; size <<= 1);
+
+	free(impl->ring_data);
+	if ((impl->ring_data = calloc(1, size)) == NULL) {
+		impl->ring_size = 0;
+		return -errno;
+	}
+	impl->ring_size = size;
+	spa_ringbuffer_init(&impl->ring);
+
+	pw_log_debug(NAME" %p: ring of %u bytes", impl, size);
+	return 0;
+}
+
 SPA_EXPORT
 int
 pw_stream_connect(struct pw_stream *stream,
@@ -1419,6 +1920,7 @@ pw_stream_connect(struct pw_stream *stream,
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
 	enum pw_remote_state state;
+	const char *str;
 	int res;
 	uint32_t i;
 
@@ -1428,10 +1930,20 @@ pw_stream_connect(struct pw_stream *stream,
 	impl->flags = flags;
 	impl->node_methods = impl_node;
 
+	if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RING)) {
+		if ((res = alloc_ring(impl)) < 0)
+			return res;
+		/* the ring is copied in the process thread, buffers must be mapped */
+		SPA_FLAG_SET(impl->flags, PW_STREAM_FLAG_MAP_BUFFERS);
+		SPA_FLAG_CLEAR(impl->flags, PW_STREAM_FLAG_LAZY_MAP);
+	}
+
 	if (impl->direction == SPA_DIRECTION_INPUT)
-		impl->node_methods.process = impl_node_process_input;
+		impl->node_methods.process = impl->ring_data ?
+			impl_node_process_ring_input : impl_node_process_input;
 	else
-		impl->node_methods.process = impl_node_process_output;
+		impl->node_methods.process = impl->ring_data ?
+			impl_node_process_ring_output : impl_node_process_output;
 
 	impl->impl_node.iface = SPA_INTERFACE_INIT(
 			SPA_TYPE_INTERFACE_Node,
@@ -1445,6 +1957,7 @@ pw_stream_connect(struct pw_stream *stream,
 	impl->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
 
 	clear_params(stream, PARAM_TYPE_INIT | PARAM_TYPE_OTHER | PARAM_TYPE_FORMAT);
+	add_last_format(impl, params, n_params);
 	for (i = 0; i < n_params; i++)
 		add_param(stream, PARAM_TYPE_INIT, params[i]);
 
@@ -1469,6 +1982,12 @@ pw_stream_connect(struct pw_stream *stream,
 
 	impl->alloc_buffers = SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_ALLOC_BUFFERS);
 
+	if ((str = pw_properties_get(stream->properties, PW_KEY_STREAM_WATERMARK)) != NULL)
+		impl->watermark = SPA_CLAMP(pw_properties_parse_int(str), 0, 100);
+	else
+		impl->watermark = 0;
+	impl->process_pending = 0;
+
 	pw_properties_setf(stream->properties, PW_KEY_MEDIA_CLASS, "Stream/%s/%s",
 			direction == PW_DIRECTION_INPUT ? "Input" : "Output",
 			get_media_class(impl));
@@ -1587,6 +2106,39 @@ int pw_stream_set_control(struct pw_stream *stream, uint32_t id, uint32_t n_valu
 	return 0;
 }
 
+SPA_EXPORT
+int pw_stream_send_controls(struct pw_stream *stream, uint32_t node_id,
+		const struct spa_pod_sequence *controls)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct pw_node_control *c = impl->control;
+	struct pw_node_control_msg msg;
+	uint32_t index, size, total;
+	int32_t filled;
+
+	if (c == NULL)
+		return -ENOTSUP;
+
+	size = SPA_POD_SIZE(controls);
+	total = SPA_ROUND_UP_N(sizeof(msg) + size, 8);
+
+	filled = spa_ringbuffer_get_write_index(&c->ring, &index);
+	if (filled < 0 || (uint32_t)filled + total > PW_NODE_CONTROL_SIZE) {
+		pw_log_debug(NAME" %p: control ring full", stream);
+		return -ENOSPC;
+	}
+
+	msg.node_id = node_id;
+	msg.size = size;
+	spa_ringbuffer_write_data(&c->ring, c->data, PW_NODE_CONTROL_SIZE,
+			index & (PW_NODE_CONTROL_SIZE - 1), &msg, sizeof(msg));
+	spa_ringbuffer_write_data(&c->ring, c->data, PW_NODE_CONTROL_SIZE,
+			(index + sizeof(msg)) & (PW_NODE_CONTROL_SIZE - 1), controls, size);
+	spa_ringbuffer_write_update(&c->ring, index + total);
+
+	return 0;
+}
+
 SPA_EXPORT
 const struct pw_stream_control *pw_stream_get_control(struct pw_stream *stream, uint32_t id)
 {
@@ -1623,7 +2175,11 @@ int pw_stream_get_time(struct pw_stream *stream, struct pw_time *time)
 		seq2 = SEQ_READ(impl->seq);
 	} while (!SEQ_READ_SUCCESS(seq1, seq2));
 
-	if (impl->direction == SPA_DIRECTION_INPUT)
+	if (impl->ring_data) {
+		uint32_t index;
+		time->queued = SPA_MAX(spa_ringbuffer_get_read_index(&impl->ring, &index), 0);
+	}
+	else if (impl->direction == SPA_DIRECTION_INPUT)
 		time->queued = (int64_t)(time->queued - impl->dequeued.outcount);
 	else
 		time->queued = (int64_t)(impl->queued.incount - time->queued);
@@ -1643,7 +2199,7 @@ do_process(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
 {
 	struct stream *impl = user_data;
-	int res = impl_node_process_output(impl);
+	int res = impl->node_methods.process(impl);
 	return spa_node_call_ready(&impl->callbacks, res);
 }
 
@@ -1664,15 +2220,42 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream)
 	struct buffer *b;
 	int res;
 
-	if ((b = pop_queue(impl, &impl->dequeued)) == NULL) {
+	if (impl->ring_data) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if (use_mailbox(impl)) {
+		uint32_t id = __atomic_exchange_n(&impl->mailbox, SPA_ID_INVALID, __ATOMIC_ACQ_REL);
+		if (id == SPA_ID_INVALID) {
+			pw_log_trace(NAME" %p: no more buffers", stream);
+			call_trigger(impl);
+			errno = EPIPE;
+			return NULL;
+		}
+		b = &impl->buffers[id];
+		impl->dequeued.outcount += b->this.size;
+	}
+	else if ((b = pop_queue(impl, &impl->dequeued)) == NULL) {
 		res = -errno;
 		pw_log_trace(NAME" %p: no more buffers: %m", stream);
 		call_trigger(impl);
 		errno = -res;
 		return NULL;
 	}
-	pw_log_trace(NAME" %p: dequeue buffer %d", stream, b->id);
 
+	pw_log_trace(NAME" %p: dequeue buffer %d", stream, b->id);
+	pw_trace_point(stream_dequeue, stream, b->id);
+
+	if (SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_MAP_BUFFERS) &&
+	    !SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_MAPPED) &&
+	    (res = map_buffer(impl, b)) < 0) {
+		pw_log_error(NAME" %p: can't map buffer %d: %s", stream,
+				b->id, spa_strerror(res));
+		/* only the data thread writes the dequeued queue of a mailbox */
+		push_queue(impl, use_mailbox(impl) ? &impl->queued : &impl->dequeued, b);
+		errno = -res;
+		return NULL;
+	}
 	return &b->this;
 }
 
@@ -1683,13 +2266,149 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	struct buffer *b = SPA_CONTAINER_OF(buffer, struct buffer, this);
 	int res;
 
+	if (impl->ring_data)
+		return -ENOTSUP;
+
 	pw_log_trace(NAME" %p: queue buffer %d", stream, b->id);
+	pw_trace_point(stream_queue, stream, b->id);
 	if ((res = push_queue(impl, &impl->queued, b)) < 0)
 		return res;
 
 	return call_trigger(impl);
 }
 
+SPA_EXPORT
+int pw_stream_dequeue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t max_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i, n;
+	int res;
+
+	if (impl->ring_data)
+		return -ENOTSUP;
+
+	if (use_mailbox(impl)) {
+		if (max_buffers == 0)
+			return 0;
+		if ((buffers[0] = pw_stream_dequeue_buffer(stream)) == NULL)
+			return errno == EPIPE ? 0 : -errno;
+		return 1;
+	}
+
+	n = pop_queue_n(impl, &impl->dequeued, b, SPA_MIN(max_buffers, MAX_BUFFERS));
+	if (n == 0) {
+		pw_log_trace(NAME" %p: no more buffers", stream);
+		call_trigger(impl);
+		return 0;
+	}
+	pw_log_trace(NAME" %p: dequeue %u buffers", stream, n);
+
+	for (i = 0; i < n; i++) {
+		if (SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_MAP_BUFFERS) &&
+		    !SPA_FLAG_IS_SET(b[i]->flags, BUFFER_FLAG_MAPPED) &&
+		    (res = map_buffer(impl, b[i])) < 0) {
+			pw_log_error(NAME" %p: can't map buffer %d: %s", stream,
+					b[i]->id, spa_strerror(res));
+			push_queue_n(impl, &impl->dequeued, &b[i], n - i);
+			return i > 0 ? (int)i : res;
+		}
+		buffers[i] = &b[i]->this;
+	}
+	return n;
+}
+
+SPA_EXPORT
+int pw_stream_queue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i;
+	int res;
+
+	if (impl->ring_data)
+		return -ENOTSUP;
+	if (n_buffers > MAX_BUFFERS)
+		return -EINVAL;
+
+	for (i = 0; i < n_buffers; i++)
+		b[i] = SPA_CONTAINER_OF(buffers[i], struct buffer, this);
+
+	pw_log_trace(NAME" %p: queue %u buffers", stream, n_buffers);
+	if ((res = push_queue_n(impl, &impl->queued, b, n_buffers)) < 0)
+		return res;
+
+	return call_trigger(impl);
+}
+
+static void region_union(struct spa_region *r, const struct spa_region *o)
+{
+	int32_t x1 = SPA_MIN(r->position.x, o->position.x);
+	int32_t y1 = SPA_MIN(r->position.y, o->position.y);
+	int32_t x2 = SPA_MAX(r->position.x + (int32_t)r->size.width,
+			o->position.x + (int32_t)o->size.width);
+	int32_t y2 = SPA_MAX(r->position.y + (int32_t)r->size.height,
+			o->position.y + (int32_t)o->size.height);
+
+	*r = SPA_REGION(x1, y1, x2 - x1, y2 - y1);
+}
+
+SPA_EXPORT
+int pw_stream_buffer_set_damage(struct pw_buffer *buffer,
+		const struct spa_region *regions, uint32_t n_regions)
+{
+	struct spa_meta *m = buffer->damage;
+	struct spa_meta_region *r, *last = NULL;
+	uint32_t i, n = 0;
+
+	if (m == NULL)
+		return -ENOTSUP;
+
+	r = spa_meta_first(m);
+	for (i = 0; i < n_regions; i++) {
+		struct spa_meta_region *next = r + 1;
+
+		if (regions[i].size.width == 0 || regions[i].size.height == 0)
+			continue;
+		/* keep one slot for the terminating empty region when we can */
+		if (spa_meta_check(r, m) && (last == NULL || spa_meta_check(next, m))) {
+			r->region = regions[i];
+			last = r++;
+			n++;
+		} else if (last != NULL) {
+			region_union(&last->region, &regions[i]);
+		}
+	}
+	if (spa_meta_check(r, m))
+		r->region = SPA_REGION(0, 0, 0, 0);
+
+	return n;
+}
+
+SPA_EXPORT
+int pw_stream_buffer_get_damage(struct pw_buffer *buffer,
+		struct spa_region *regions, uint32_t max_regions)
+{
+	struct spa_meta *m = buffer->damage;
+	struct spa_meta_region *r;
+	uint32_t n = 0;
+
+	if (m == NULL || max_regions == 0)
+		return 0;
+
+	spa_meta_for_each(r, m) {
+		if (!spa_meta_region_is_valid(r))
+			break;
+		if (n < max_regions)
+			regions[n++] = r->region;
+		else
+			region_union(&regions[n - 1], &r->region);
+	}
+	return n;
+}
+
 static int
 do_flush(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -1698,16 +2417,19 @@ do_flush(struct spa_loop *loop,
 	struct buffer *b;
 
 	pw_log_trace(NAME" %p: flush", impl);
-	do {
-		b = pop_queue(impl, &impl->queued);
-		if (b != NULL)
-			push_queue(impl, &impl->dequeued, b);
-	}
-	while (b);
+	/* a mailbox never reads the dequeued queue, the queued buffers are
+	 * recycled in the next cycles */
+	while (!use_mailbox(impl) && (b = pop_queue(impl, &impl->queued)) != NULL)
+		push_queue(impl, &impl->dequeued, b);
 
 	impl->time.queued = impl->queued.outcount = impl->dequeued.incount =
 		impl->dequeued.outcount = impl->queued.incount;
 
+	if (impl->ring_data) {
+		uint32_t index;
+		spa_ringbuffer_get_write_index(&impl->ring, &index);
+		spa_ringbuffer_read_update(&impl->ring, index);
+	}
 	return 0;
 }
 static int
@@ -1727,3 +2449,61 @@ int pw_stream_flush(struct pw_stream *stream, bool drain)
 			drain ? do_drain : do_flush, 1, NULL, 0, true, impl);
 	return 0;
 }
+
+SPA_EXPORT
+int32_t pw_stream_write(struct pw_stream *stream, const void *data, uint32_t size)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	uint32_t index, avail;
+	int32_t filled;
+
+	if (impl->ring_data == NULL || impl->direction != SPA_DIRECTION_OUTPUT)
+		return -ENOTSUP;
+
+	filled = spa_ringbuffer_get_write_index(&impl->ring, &index);
+	avail = impl->ring_size - SPA_CLAMP(filled, 0, (int32_t)impl->ring_size);
+
+	size = SPA_MIN(size, avail);
+	if (impl->stride > 0)
+		size -= size % impl->stride;
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_write_data(&impl->ring,
+			impl->ring_data, impl->ring_size,
+			index & (impl->ring_size - 1), data, size);
+	spa_ringbuffer_write_update(&impl->ring, index + size);
+
+	pw_log_trace(NAME" %p: write %u bytes, filled %d", stream, size, filled + size);
+	call_trigger(impl);
+
+	return size;
+}
+
+SPA_EXPORT
+int32_t pw_stream_read(struct pw_stream *stream, void *data, uint32_t size)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	uint32_t index;
+	int32_t filled;
+
+	if (impl->ring_data == NULL || impl->direction != SPA_DIRECTION_INPUT)
+		return -ENOTSUP;
+
+	filled = spa_ringbuffer_get_read_index(&impl->ring, &index);
+
+	size = SPA_MIN(size, (uint32_t)SPA_CLAMP(filled, 0, (int32_t)impl->ring_size));
+	if (impl->stride > 0)
+		size -= size % impl->stride;
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_read_data(&impl->ring,
+			impl->ring_data, impl->ring_size,
+			index & (impl->ring_size - 1), data, size);
+	spa_ringbuffer_read_update(&impl->ring, index + size);
+
+	pw_log_trace(NAME" %p: read %u bytes, filled %d", stream, size, filled - size);
+
+	return size;
+}
@@ -136,6 +136,43 @@ extern "C" {
  * The process event is emited when PipeWire has emptied a buffer that
  * can now be refilled.
  *
+ * \subsection ssec_watermark Wakeups
+ *
+ * Without \ref PW_STREAM_FLAG_RT_PROCESS, the process event is emitted
+ * from the main loop of the stream. Running that loop in a
+ * \ref pw_thread_loop gives the application a worker thread that
+ * prepares buffers while the realtime thread serves the queued ones.
+ * The stream.watermark property limits the wakeups of that thread to
+ * the moments when the queue crosses the watermark. The application
+ * should then handle all available buffers in one process callback.
+ *
+ * \subsection ssec_ring Ring mode
+ *
+ * Streams connected with \ref PW_STREAM_FLAG_RING don't expose buffers.
+ * Use \ref pw_stream_write() to add data of any size to a playback stream
+ * and \ref pw_stream_read() to take data from a capture stream. The
+ * processing thread moves one graph quantum between the ring and the
+ * buffers in each cycle, so the application write size does not need to
+ * match the quantum.
+ *
+ * \subsection ssec_keep_latest Keep latest
+ *
+ * Consumers that care about freshness more than completeness, like a
+ * video preview, can connect with \ref PW_STREAM_FLAG_KEEP_LATEST. A
+ * capture stream then only returns the newest buffer from
+ * \ref pw_stream_dequeue_buffer() and recycles the older ones, a playback
+ * stream only sends the most recently queued buffer. A slow consumer
+ * skips frames instead of adding latency and the producer does not run
+ * out of buffers.
+ *
+ * A capture stream keeps the newest buffer in a single slot that the
+ * data thread and \ref pw_stream_dequeue_buffer() swap atomically. A
+ * buffer that replaces one the application did not take yet recycles the
+ * old one to the producer in the same cycle, and the process event is
+ * only emitted for a buffer that lands in an empty slot. An application
+ * that handles frames at its own pace, like an encoder, is not woken up
+ * for the frames it skips.
+ *
  * \section sec_stream_disconnect Disconnect
  *
  * Use \ref pw_stream_disconnect() to disconnect a stream after use.
@@ -176,6 +213,13 @@ struct pw_buffer {
 					  *  For output streams, this field is set by the user.
 					  *  This field is added for all queued buffers and
 					  *  returned in the time info. */
+
+	/* metadata of the buffer, resolved when the buffer is added */
+	struct spa_meta_header *header;	/**< SPA_META_Header or NULL */
+	struct spa_meta_region *crop;	/**< SPA_META_VideoCrop or NULL */
+	struct spa_meta *damage;	/**< SPA_META_VideoDamage, an array of
+					  *  struct spa_meta_region, or NULL */
+	struct spa_meta_cursor *cursor;	/**< SPA_META_Cursor or NULL */
 };
 
 struct pw_stream_control {
@@ -239,7 +283,9 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_DRIVER		= (1 << 3),	/**< be a driver */
 	PW_STREAM_FLAG_RT_PROCESS	= (1 << 4),	/**< call process from the realtime
 							  *  thread */
-	PW_STREAM_FLAG_NO_CONVERT	= (1 << 5),	/**< don't convert format */
+	PW_STREAM_FLAG_NO_CONVERT	= (1 << 5),	/**< don't convert format. Raw audio
+							  *  streams are otherwise converted to
+							  *  the DSP format in the client */
 	PW_STREAM_FLAG_EXCLUSIVE	= (1 << 6),	/**< require exclusive access to the
 							  *  device */
 	PW_STREAM_FLAG_DONT_RECONNECT	= (1 << 7),	/**< don't try to reconnect this stream
@@ -247,6 +293,15 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_ALLOC_BUFFERS	= (1 << 8),	/**< the application will allocate buffer
 							  *  memory. In the add_buffer event, the
 							  *  data of the buffer should be set */
+	PW_STREAM_FLAG_LAZY_MAP		= (1 << 9),	/**< with PW_STREAM_FLAG_MAP_BUFFERS, mmap
+							  *  the data of a buffer when it is
+							  *  dequeued for the first time */
+	PW_STREAM_FLAG_RING		= (1 << 10),	/**< exchange data with \ref pw_stream_write()
+							  *  and \ref pw_stream_read() through a
+							  *  byte ring instead of buffers */
+	PW_STREAM_FLAG_KEEP_LATEST	= (1 << 11),	/**< only keep the most recent buffer.
+							  *  Older buffers that were not dequeued
+							  *  by the consumer yet are recycled */
 };
 
 /** Create a new unconneced \ref pw_stream \memberof pw_stream
@@ -324,6 +379,15 @@ pw_stream_finish_format(struct pw_stream *stream,	/**< a \ref pw_stream */
 /** Set control values */
 int pw_stream_set_control(struct pw_stream *stream, uint32_t id, uint32_t n_values, float *values, ...);
 
+/** Queue a sequence of controls for the node with \a node_id in the shared
+ * memory control ring of the stream. The server applies the
+ * SPA_CONTROL_Properties controls with the Props of the node without going
+ * through the socket. This should be called from one thread only.
+ * \return 0 on success, -ENOTSUP when the stream has no control ring and
+ *	-ENOSPC when the ring is full. */
+int pw_stream_send_controls(struct pw_stream *stream, uint32_t node_id,
+		const struct spa_pod_sequence *controls);
+
 /** A time structure \memberof pw_stream */
 struct pw_time {
 	int64_t now;			/**< the monotonic time */
@@ -332,10 +396,13 @@ struct pw_time {
 					  *  the remote end is reading/writing. */
 	int64_t delay;			/**< delay to device, add to ticks to get the time of the
 					  *  device. Positive for INPUT streams and
-					  *  negative for OUTPUT streams. */
+					  *  negative for OUTPUT streams. This includes
+					  *  the samples in the device buffer and the
+					  *  delay of the resampler of the stream. */
 	uint64_t queued;		/**< data queued in the stream, this is the sum
 					  *  of the size fields in the pw_buffer that are
-					  *  currently queued */
+					  *  currently queued or the bytes in the ring
+					  *  with PW_STREAM_FLAG_RING */
 };
 /** Query the time on the stream \memberof pw_stream */
 int pw_stream_get_time(struct pw_stream *stream, struct pw_time *time);
@@ -347,6 +414,38 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream);
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer);
 
+/** Get up to \a max_buffers buffers at once, like calling
+ * \ref pw_stream_dequeue_buffer() in a loop.
+ * \return the number of buffers placed in \a buffers or a negative errno */
+int pw_stream_dequeue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t max_buffers);
+
+/** Submit or recycle \a n_buffers buffers at once.
+ * \return 0 on success or a negative errno, in which case no buffer
+ *	was queued */
+int pw_stream_queue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers);
+
+/** Set the regions of \a buffer that changed since the previous buffer.
+ *
+ * The regions are written in the SPA_META_VideoDamage metadata of the
+ * buffer. When there are more regions than fit, the remaining ones are
+ * merged into the last region. An empty list means that the whole frame
+ * changed.
+ *
+ * \return the number of regions written or -ENOTSUP when the buffer has
+ *	no damage metadata */
+int pw_stream_buffer_set_damage(struct pw_buffer *buffer,
+		const struct spa_region *regions, uint32_t n_regions);
+
+/** Get up to \a max_regions changed regions of \a buffer. When there are
+ * more regions, the remaining ones are merged into the last one.
+ *
+ * \return the number of regions placed in \a regions, 0 when the whole
+ *	frame should be considered changed */
+int pw_stream_buffer_get_damage(struct pw_buffer *buffer,
+		struct spa_region *regions, uint32_t max_regions);
+
 /** Activate or deactivate the stream \memberof pw_stream */
 int pw_stream_set_active(struct pw_stream *stream, bool active);
 
@@ -354,6 +453,24 @@ int pw_stream_set_active(struct pw_stream *stream, bool active);
  * be called when all data is played or recorded */
 int pw_stream_flush(struct pw_stream *stream, bool drain);
 
+/** Write data to a playback stream connected with \ref PW_STREAM_FLAG_RING.
+ *
+ * Any amount of data can be written, the processing thread takes exactly
+ * one graph quantum from the ring in each cycle and plays silence when
+ * there is not enough. For raw audio, only whole frames are written.
+ *
+ * \return the number of bytes written, which is less than \a size when
+ *	the ring is full, or a negative errno when the stream has no ring
+ * \memberof pw_stream */
+int32_t pw_stream_write(struct pw_stream *stream, const void *data, uint32_t size);
+
+/** Read data from a capture stream connected with \ref PW_STREAM_FLAG_RING.
+ *
+ * \return the number of bytes read, 0 when the ring is empty, or a
+ *	negative errno when the stream has no ring
+ * \memberof pw_stream */
+int32_t pw_stream_read(struct pw_stream *stream, void *data, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
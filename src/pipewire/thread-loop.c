@@ -379,3 +379,33 @@ bool pw_thread_loop_in_thread(struct pw_thread_loop *loop)
 {
 	return pthread_self() == loop->thread;
 }
+
+/** Call a function in the thread of the loop
+ *
+ * \param loop a \ref pw_thread_loop
+ * \param func the function to call
+ * \param seq a sequence number passed to \a func
+ * \param data data passed to \a func, copied unless \a block is true
+ * \param size the size of \a data
+ * \param block wait until \a func was called
+ * \param user_data passed to \a func
+ * \return the result of \a func when blocking or called from the
+ *	thread, 0 when queued or < 0 on error
+ *
+ * The function is queued without taking the lock of \a loop and is
+ * called from the loop thread with the lock held, so it can use the
+ * objects of the loop. When called from the loop thread, \a func is
+ * called immediately.
+ *
+ * The lock must not be held when \a block is true, the loop thread
+ * needs it to run \a func.
+ *
+ * \memberof pw_thread_loop
+ */
+SPA_EXPORT
+int pw_thread_loop_invoke(struct pw_thread_loop *loop,
+		spa_invoke_func_t func, uint32_t seq, const void *data,
+		size_t size, bool block, void *user_data)
+{
+	return pw_loop_invoke(loop->loop, func, seq, data, size, block, user_data);
+}
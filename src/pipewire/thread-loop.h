@@ -79,6 +79,14 @@ extern "C" {
  *
  * All events and callbacks are called with the thread lock held.
  *
+ * \section sec_thread_loop_invoke Invoking
+ *
+ * Short operations, like queueing a buffer or changing a control on a
+ * stream, can be posted to the loop thread with pw_thread_loop_invoke()
+ * without taking the lock. The function is queued in the lock-free
+ * invoke queue of the loop and is called in the loop thread with the
+ * lock held.
+ *
  */
 /** \class pw_thread_loop
  *
@@ -147,6 +155,11 @@ void pw_thread_loop_accept(struct pw_thread_loop *loop);
 /** Check if inside the thread */
 bool pw_thread_loop_in_thread(struct pw_thread_loop *loop);
 
+/** Call \a func in the thread of the loop without taking the lock */
+int pw_thread_loop_invoke(struct pw_thread_loop *loop,
+		spa_invoke_func_t func, uint32_t seq, const void *data,
+		size_t size, bool block, void *user_data);
+
 #ifdef __cplusplus
 }
 #endif
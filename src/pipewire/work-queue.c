@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include <spa/utils/type.h>
 #include <spa/utils/result.h>
@@ -34,6 +35,12 @@
 
 #define NAME "work-queue"
 
+/* async items that are not completed after this time are completed
+ * with -ETIMEDOUT so that they don't block the queue forever */
+#define WORK_TIMEOUT_NSEC	(30 * SPA_NSEC_PER_SEC)
+
+#define HASH_SIZE	64
+
 /** \cond */
 struct work_item {
 	void *obj;
@@ -42,6 +49,8 @@ struct work_item {
 	pw_work_func_t func;
 	void *data;
 	struct spa_list link;
+	struct spa_list hash_link;	/**< in the hash while waiting for seq */
+	uint64_t timeout;
 	int res;
 };
 
@@ -49,20 +58,87 @@ struct pw_work_queue {
 	struct pw_loop *loop;
 
 	struct spa_source *wakeup;
+	struct spa_source *timer;
+	uint64_t next_timeout;
 
 	struct spa_list work_list;
 	struct spa_list free_list;
+	struct spa_list hash[HASH_SIZE];
 	uint32_t counter;
 	uint32_t n_queued;
+	uint32_t n_ready;
 };
 /** \endcond */
 
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static inline struct spa_list *hash_bucket(struct pw_work_queue *this, void *obj, uint32_t seq)
+{
+	uintptr_t h = ((uintptr_t)obj >> 4) ^ seq;
+	return &this->hash[h & (HASH_SIZE - 1)];
+}
+
+static void item_ready(struct pw_work_queue *this, struct work_item *item, int res)
+{
+	spa_list_remove(&item->hash_link);
+	item->seq = SPA_ID_INVALID;
+	item->res = res;
+	this->n_ready++;
+}
+
+static void arm_timer(struct pw_work_queue *this, uint64_t timeout)
+{
+	struct timespec value;
+
+	this->next_timeout = timeout;
+	value.tv_sec = timeout / SPA_NSEC_PER_SEC;
+	value.tv_nsec = timeout % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(this->loop, this->timer, &value, NULL, true);
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct pw_work_queue *this = data;
+	struct work_item *item;
+	uint64_t now = get_time_ns(), next = 0;
+	bool have_work = false;
+
+	spa_list_for_each(item, &this->work_list, link) {
+		if (item->seq == SPA_ID_INVALID)
+			continue;
+		if (item->timeout > now) {
+			if (next == 0 || item->timeout < next)
+				next = item->timeout;
+			continue;
+		}
+		pw_log_warn(NAME" %p: timeout waiting for item %p %d", this,
+				item->obj, item->seq);
+		item_ready(this, item, -ETIMEDOUT);
+		have_work = true;
+	}
+	if (next != 0)
+		arm_timer(this, next);
+	else
+		this->next_timeout = 0;
+
+	if (have_work)
+		pw_loop_signal_event(this->loop, this->wakeup);
+}
+
 static void process_work_queue(void *data, uint64_t count)
 {
 	struct pw_work_queue *this = data;
 	struct work_item *item, *tmp;
 
 	spa_list_for_each_safe(item, tmp, &this->work_list, link) {
+		if (this->n_ready == 0)
+			break;
+
 		if (item->seq != SPA_ID_INVALID) {
 			pw_log_debug(NAME" %p: %d waiting for item %p %d", this,
 				     this->n_queued, item->obj, item->seq);
@@ -78,6 +154,7 @@ static void process_work_queue(void *data, uint64_t count)
 
 		spa_list_remove(&item->link);
 		this->n_queued--;
+		this->n_ready--;
 
 		if (item->func) {
 			pw_log_debug(NAME" %p: %d process work item %p %d %d", this,
@@ -98,7 +175,7 @@ static void process_work_queue(void *data, uint64_t count)
 struct pw_work_queue *pw_work_queue_new(struct pw_loop *loop)
 {
 	struct pw_work_queue *this;
-	int res;
+	int res, i;
 
 	this = calloc(1, sizeof(struct pw_work_queue));
 	if (this == NULL)
@@ -113,12 +190,21 @@ struct pw_work_queue *pw_work_queue_new(struct pw_loop *loop)
 		res = -errno;
 		goto error_free;
 	}
+	this->timer = pw_loop_add_timer(this->loop, on_timeout, this);
+	if (this->timer == NULL) {
+		res = -errno;
+		goto error_destroy_wakeup;
+	}
 
 	spa_list_init(&this->work_list);
 	spa_list_init(&this->free_list);
+	for (i = 0; i < HASH_SIZE; i++)
+		spa_list_init(&this->hash[i]);
 
 	return this;
 
+error_destroy_wakeup:
+	pw_loop_destroy_source(this->loop, this->wakeup);
 error_free:
 	free(this);
 	errno = -res;
@@ -136,6 +222,7 @@ void pw_work_queue_destroy(struct pw_work_queue *queue)
 
 	pw_log_debug(NAME" %p: destroy", queue);
 
+	pw_loop_destroy_source(queue->loop, queue->timer);
 	pw_loop_destroy_source(queue->loop, queue->wakeup);
 
 	spa_list_for_each_safe(item, tmp, &queue->work_list, link) {
@@ -181,6 +268,12 @@ pw_work_queue_add(struct pw_work_queue *queue, void *obj, int res, pw_work_func_
 	if (SPA_RESULT_IS_ASYNC(res)) {
 		item->seq = SPA_RESULT_ASYNC_SEQ(res);
 		item->res = res;
+		item->timeout = get_time_ns() + WORK_TIMEOUT_NSEC;
+		spa_list_append(hash_bucket(queue, obj, item->seq), &item->hash_link);
+		/* items are added in timeout order, an armed timer
+		 * is always earlier */
+		if (queue->next_timeout == 0)
+			arm_timer(queue, item->timeout);
 		pw_log_debug(NAME" %p: defer async %d for object %p", queue, item->seq, obj);
 	} else if (res == -EBUSY) {
 		pw_log_debug(NAME" %p: wait sync object %p", queue, obj);
@@ -196,9 +289,10 @@ pw_work_queue_add(struct pw_work_queue *queue, void *obj, int res, pw_work_func_
 	spa_list_append(&queue->work_list, &item->link);
 	queue->n_queued++;
 
-	if (have_work)
+	if (have_work) {
+		queue->n_ready++;
 		pw_loop_signal_event(queue->loop, queue->wakeup);
-
+	}
 	return item->id;
 }
 
@@ -218,7 +312,8 @@ int pw_work_queue_cancel(struct pw_work_queue *queue, void *obj, uint32_t id)
 		if ((id == SPA_ID_INVALID || item->id == id) && (obj == NULL || item->obj == obj)) {
 			pw_log_debug(NAME" %p: cancel defer %d for object %p", queue,
 				     item->seq, item->obj);
-			item->seq = SPA_ID_INVALID;
+			if (item->seq != SPA_ID_INVALID)
+				item_ready(queue, item, item->res);
 			item->func = NULL;
 			have_work = true;
 		}
@@ -242,15 +337,14 @@ int pw_work_queue_cancel(struct pw_work_queue *queue, void *obj, uint32_t id)
  */
 int pw_work_queue_complete(struct pw_work_queue *queue, void *obj, uint32_t seq, int res)
 {
-	struct work_item *item;
+	struct work_item *item, *tmp;
 	bool have_work = false;
 
-	spa_list_for_each(item, &queue->work_list, link) {
+	spa_list_for_each_safe(item, tmp, hash_bucket(queue, obj, seq), hash_link) {
 		if (item->obj == obj && item->seq == seq) {
 			pw_log_debug(NAME" %p: found defered %d for object %p res:%d",
 					queue, seq, obj, res);
-			item->seq = SPA_ID_INVALID;
-			item->res = res;
+			item_ready(queue, item, res);
 			have_work = true;
 		}
 	}
@@ -0,0 +1,305 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <spa/support/system.h>
+
+#include "pipewire/log.h"
+#include "pipewire/loop.h"
+#include "pipewire/private.h"
+
+#define NAME "worker-pool"
+
+#define DEQUE_MASK	(PW_WORKER_DEQUE_SIZE - 1)
+
+/** \cond */
+static __thread struct pw_worker *current_worker;
+/** \endcond */
+
+/* Chase-Lev work-stealing deque. Only the owner thread calls deque_push
+ * and deque_pop, any thread can call deque_steal. */
+static int deque_push(struct pw_worker *w, struct pw_worker_item *item)
+{
+	int64_t b, t;
+
+	b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+	t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+	if (b - t >= PW_WORKER_DEQUE_SIZE)
+		return -ENOSPC;
+
+	__atomic_store_n(&w->items[b & DEQUE_MASK], item, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static struct pw_worker_item *deque_pop(struct pw_worker *w)
+{
+	struct pw_worker_item *item = NULL;
+	int64_t b, t;
+
+	b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+
+	if (t <= b) {
+		item = __atomic_load_n(&w->items[b & DEQUE_MASK], __ATOMIC_RELAXED);
+		if (t == b) {
+			/* last item, race against thieves */
+			if (!__atomic_compare_exchange_n(&w->top, &t, t + 1,
+					false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				item = NULL;
+			__atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+		}
+	} else {
+		__atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return item;
+}
+
+static struct pw_worker_item *deque_steal(struct pw_worker *w)
+{
+	struct pw_worker_item *item;
+	int64_t b, t;
+
+	t = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b)
+		return NULL;
+
+	item = __atomic_load_n(&w->items[t & DEQUE_MASK], __ATOMIC_RELAXED);
+	if (!__atomic_compare_exchange_n(&w->top, &t, t + 1,
+			false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	return item;
+}
+
+static struct pw_worker_item *steal_item(struct pw_worker_pool *pool, struct pw_worker *self)
+{
+	struct pw_worker_item *item;
+	uint32_t i, idx;
+
+	/* start with the next worker so that not all thieves hit the same deque */
+	for (i = 1; i <= pool->n_workers; i++) {
+		idx = (self->index + i) % pool->n_workers;
+		if ((item = deque_steal(pool->workers[idx])) != NULL)
+			return item;
+	}
+	return NULL;
+}
+
+static inline void run_item(struct pw_worker_pool *pool, struct pw_worker_item *item)
+{
+	item->func(item->data);
+	__atomic_sub_fetch(&pool->busy, 1, __ATOMIC_RELEASE);
+}
+
+static void *do_worker(void *user_data)
+{
+	struct pw_worker *self = user_data;
+	struct pw_worker_pool *pool = self->pool;
+	struct pw_worker_item *item;
+	uint64_t count;
+
+	pw_log_debug(NAME" %p: enter worker %u", pool, self->index);
+	current_worker = self;
+	__atomic_store_n(&self->tid, (pid_t) syscall(SYS_gettid), __ATOMIC_RELEASE);
+
+	while (__atomic_load_n(&pool->running, __ATOMIC_ACQUIRE)) {
+		if ((item = deque_pop(self)) != NULL ||
+		    (item = steal_item(pool, self)) != NULL) {
+			run_item(pool, item);
+			continue;
+		}
+
+		/* go idle, check again after announcing it so that a concurrent
+		 * push either sees us idle or we see its item */
+		__atomic_add_fetch(&pool->n_idle, 1, __ATOMIC_SEQ_CST);
+		if ((item = steal_item(pool, self)) != NULL) {
+			__atomic_sub_fetch(&pool->n_idle, 1, __ATOMIC_SEQ_CST);
+			run_item(pool, item);
+			continue;
+		}
+		if (spa_system_eventfd_read(pool->system, pool->fd, &count) < 0 &&
+		    errno != EINTR)
+			pw_log_error(NAME" %p: read error: %m", pool);
+		__atomic_sub_fetch(&pool->n_idle, 1, __ATOMIC_SEQ_CST);
+	}
+	current_worker = NULL;
+	pw_log_debug(NAME" %p: leave worker %u", pool, self->index);
+
+	return NULL;
+}
+
+static int do_set_worker(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	current_worker = user_data;
+	return 0;
+}
+
+static struct pw_worker *worker_new(struct pw_worker_pool *pool)
+{
+	struct pw_worker *w;
+
+	if ((w = aligned_alloc(64, SPA_ROUND_UP_N(sizeof(*w), 64))) == NULL)
+		return NULL;
+
+	memset(w, 0, sizeof(*w));
+	w->pool = pool;
+	w->index = pool->n_workers;
+	pool->workers[pool->n_workers++] = w;
+	return w;
+}
+
+struct pw_worker_pool *pw_worker_pool_new(struct pw_core *core, uint32_t n_threads)
+{
+	struct pw_worker_pool *pool;
+	struct pw_worker *w;
+	uint32_t i;
+	int res;
+
+	pool = calloc(1, sizeof(struct pw_worker_pool));
+	if (pool == NULL)
+		return NULL;
+
+	pool->core = core;
+	pool->system = core->data_system;
+
+	if ((res = spa_system_eventfd_create(pool->system,
+			SPA_FD_CLOEXEC | SPA_FD_EVENT_SEMAPHORE)) < 0)
+		goto error_free;
+	pool->fd = res;
+
+	n_threads = SPA_MIN(n_threads, PW_WORKER_POOL_MAX_THREADS);
+	for (i = 0; i <= n_threads; i++) {
+		if (worker_new(pool) == NULL) {
+			res = -errno;
+			goto error_stop;
+		}
+	}
+
+	/* the data loop thread owns the first deque */
+	pw_loop_invoke(core->data_loop, do_set_worker, 1, NULL, 0, true, pool->workers[0]);
+
+	pool->running = true;
+	for (i = 1; i < pool->n_workers; i++) {
+		w = pool->workers[i];
+		if ((res = pthread_create(&w->thread, NULL, do_worker, w)) != 0) {
+			pw_log_error(NAME" %p: can't create thread: %s", pool, strerror(res));
+			res = -res;
+			goto error_stop;
+		}
+	}
+	/* wait for the thread ids so that the threads can be made
+	 * realtime by id, like RTKit does */
+	for (i = 1; i < pool->n_workers; i++) {
+		while (__atomic_load_n(&pool->workers[i]->tid, __ATOMIC_ACQUIRE) == 0)
+			sched_yield();
+	}
+	pw_log_debug(NAME" %p: new with %u threads", pool, n_threads);
+
+	return pool;
+
+error_stop:
+	pw_worker_pool_destroy(pool);
+	errno = -res;
+	return NULL;
+error_free:
+	free(pool);
+	errno = -res;
+	return NULL;
+}
+
+void pw_worker_pool_destroy(struct pw_worker_pool *pool)
+{
+	uint32_t i;
+
+	pw_log_debug(NAME" %p: destroy", pool);
+
+	if (pool->n_workers > 0)
+		pw_loop_invoke(pool->core->data_loop, do_set_worker, 1, NULL, 0, true, NULL);
+
+	if (__atomic_exchange_n(&pool->running, false, __ATOMIC_SEQ_CST)) {
+		spa_system_eventfd_write(pool->system, pool->fd, pool->n_workers);
+		for (i = 1; i < pool->n_workers; i++) {
+			if (pool->workers[i]->thread != 0)
+				pthread_join(pool->workers[i]->thread, NULL);
+		}
+	}
+	for (i = 0; i < pool->n_workers; i++)
+		free(pool->workers[i]);
+
+	spa_system_close(pool->system, pool->fd);
+	free(pool);
+}
+
+int pw_worker_pool_push(struct pw_worker_pool *pool, struct pw_worker_item *item)
+{
+	struct pw_worker *w = current_worker;
+	int res;
+
+	if (w == NULL || w->pool != pool)
+		return -EPERM;
+
+	__atomic_add_fetch(&pool->busy, 1, __ATOMIC_ACQUIRE);
+	if ((res = deque_push(w, item)) < 0) {
+		__atomic_sub_fetch(&pool->busy, 1, __ATOMIC_RELEASE);
+		return res;
+	}
+	/* only pay for a wakeup when someone can steal the work */
+	if (__atomic_load_n(&pool->n_idle, __ATOMIC_SEQ_CST) > 0 &&
+	    (res = spa_system_eventfd_write(pool->system, pool->fd, 1)) < 0)
+		pw_log_warn(NAME" %p: write failed: %s", pool, spa_strerror(res));
+	return 0;
+}
+
+void pw_worker_pool_run(struct pw_worker_pool *pool)
+{
+	struct pw_worker *w = current_worker;
+	struct pw_worker_item *item;
+
+	if (w == NULL || w->pool != pool)
+		return;
+
+	while ((item = deque_pop(w)) != NULL)
+		run_item(pool, item);
+}
+
+void pw_worker_pool_sync(struct pw_worker_pool *pool)
+{
+	pw_worker_pool_run(pool);
+
+	while (__atomic_load_n(&pool->busy, __ATOMIC_ACQUIRE) != 0)
+		sched_yield();
+}
@@ -0,0 +1,140 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <pipewire/private.h>
+
+#define MAX_COUNT 10000000
+#define N_PEERS 2
+
+/* the activation layout before the fields were split over cache lines */
+struct packed_activation {
+	uint32_t status;
+
+	unsigned int version:1;
+	unsigned int pending_sync:1;
+	unsigned int pending_new_pos:1;
+
+	struct pw_node_activation_state state[2];
+	uint64_t signal_time;
+	uint64_t awake_time;
+	uint64_t finish_time;
+	uint64_t prev_signal_time;
+
+	struct spa_io_segment reposition;
+	struct spa_io_segment segment;
+
+	uint32_t segment_owner[32];
+	struct spa_io_position position;
+
+	uint64_t sync_timeout;
+	uint64_t sync_left;
+
+	float cpu_load[3];
+	uint32_t xrun_count;
+	uint64_t xrun_time;
+	uint64_t xrun_delay;
+	uint64_t max_delay;
+
+	uint32_t command;
+	uint32_t reposition_owner;
+};
+
+struct data {
+	struct pw_node_activation_state *state;
+	bool running;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* a peer that triggers the node and decrements its pending counter */
+static void *peer_thread(void *arg)
+{
+	struct data *d = arg;
+
+	while (__atomic_load_n(&d->running, __ATOMIC_RELAXED)) {
+		(void)pw_node_activation_state_dec(d->state, 1);
+		__atomic_add_fetch(&d->state->pending, 1, __ATOMIC_SEQ_CST);
+	}
+	return NULL;
+}
+
+/* the node updates its timings and stats while the peers signal the
+ * pending counter it shares the activation with */
+static void run(const char *name, struct pw_node_activation_state *state,
+		uint64_t *finish_time, float *cpu_load, struct spa_io_position *position)
+{
+	struct data d = { state, true };
+	pthread_t peers[N_PEERS];
+	uint64_t t1, t2, count, sum = 0;
+	int i;
+
+	for (i = 0; i < N_PEERS; i++)
+		pthread_create(&peers[i], NULL, peer_thread, &d);
+
+	t1 = get_time();
+	for (count = 0; count < MAX_COUNT; count++) {
+		__atomic_store_n(finish_time, count, __ATOMIC_RELAXED);
+		*cpu_load = (*cpu_load + 0.5f) / 2.0f;
+		sum += __atomic_load_n(&position->clock.position, __ATOMIC_RELAXED);
+	}
+	t2 = get_time();
+
+	__atomic_store_n(&d.running, false, __ATOMIC_RELAXED);
+	for (i = 0; i < N_PEERS; i++)
+		pthread_join(peers[i], NULL);
+
+	fprintf(stderr, "%s: elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec (%"PRIu64")\n",
+			name, t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1), sum);
+}
+
+int main(int argc, char *argv[])
+{
+	struct packed_activation *p;
+	struct pw_node_activation *a;
+
+	if (posix_memalign((void**)&p, 64, sizeof(*p)) != 0 ||
+	    posix_memalign((void**)&a, 64, sizeof(*a)) != 0)
+		return -1;
+
+	memset(p, 0, sizeof(*p));
+	run("packed", &p->state[0], &p->finish_time, &p->cpu_load[0], &p->position);
+
+	memset(a, 0, sizeof(*a));
+	run("split", &a->state[0], &a->finish_time, &a->cpu_load[0], &a->position);
+
+	free(p);
+	free(a);
+
+	return 0;
+}
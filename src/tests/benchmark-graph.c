@@ -0,0 +1,1331 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Runs a graph of trivial nodes for a number of cycles and reports the
+ * cycle time distribution, the wakeup and processing time per node and
+ * the number of context switches.
+ *
+ * The graph consists of groups of a source, filters and sinks. The
+ * source of the first group drives the graph. Filters are either in
+ * this process or, with --remote, each in its own client process that
+ * connects to the core of the benchmark with the native protocol.
+ *
+ *   chain:   source -> filter 1 -> ... -> filter M -> sink
+ *   fanout:  source -> filter j -> sink j            (j = 1..M)
+ *   fanin:   source j -> filter j -> sink            (j = 1..M)
+ *
+ * A table is written to stderr and the results as JSON to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/filter.h>
+#include <pipewire/private.h>
+
+#define NAME "benchmark-graph"
+
+#define MAX_BUFFERS	16
+#define MAX_NODES	1024
+
+#define DEFAULT_GROUPS		1
+#define DEFAULT_FILTERS		2
+#define DEFAULT_CYCLES		10000
+#define BENCH_QUANTUM		256
+#define BENCH_RATE		48000
+
+#define SETUP_TIMEOUT		(10 * SPA_NSEC_PER_SEC)
+#define POLL_INTERVAL		(10 * SPA_NSEC_PER_MSEC)
+
+enum topology {
+	TOPOLOGY_CHAIN,
+	TOPOLOGY_FANOUT,
+	TOPOLOGY_FANIN,
+};
+
+static const char *topology_names[] = {
+	[TOPOLOGY_CHAIN] = "chain",
+	[TOPOLOGY_FANOUT] = "fanout",
+	[TOPOLOGY_FANIN] = "fanin",
+};
+
+enum role {
+	ROLE_SOURCE,
+	ROLE_FILTER,
+	ROLE_SINK,
+	ROLE_LAST,
+};
+
+static const char *role_names[] = {
+	[ROLE_SOURCE] = "source",
+	[ROLE_FILTER] = "filter",
+	[ROLE_SINK] = "sink",
+};
+
+enum state {
+	STATE_WAIT_NODES,	/* waiting for the remote nodes and their ports */
+	STATE_WAIT_RUNNING,	/* waiting for all nodes to join the graph */
+	STATE_RUNNING,		/* running the cycles */
+	STATE_DONE,
+};
+
+struct data;
+
+struct port {
+	struct spa_io_buffers *io;
+	struct spa_buffer *buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	uint32_t next;
+};
+
+struct node {
+	struct data *data;
+	enum role role;
+	char name[64];
+	bool remote;
+	bool driver;
+	pid_t pid;
+
+	struct pw_node *node;
+	uint32_t id;
+
+	struct spa_node impl;
+	struct spa_hook_list hooks;
+	struct spa_callbacks callbacks;
+	struct spa_io_position *position;
+	bool has_port[2];
+	struct port ports[2];		/* indexed by enum spa_direction */
+
+	/* from the profiler */
+	uint64_t count;
+	uint64_t wait_sum;
+	uint64_t wait_max;
+	uint64_t busy_sum;
+	uint64_t busy_max;
+};
+
+struct link {
+	struct node *out;
+	struct node *in;
+	struct pw_link *link;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct spa_source *poll;
+	enum state state;
+	uint64_t setup_start;
+	int res;
+
+	/* options */
+	enum topology topology;
+	uint32_t n_groups;
+	uint32_t n_filters;
+	uint32_t n_cycles;
+	uint32_t quantum;
+	uint32_t rate;
+	bool remote;
+	bool timer;
+	const char *exe;
+
+	struct node *nodes[MAX_NODES];
+	uint32_t n_nodes;
+	struct link links[MAX_NODES * 2];
+	uint32_t n_links;
+
+	/* data thread state of the driver */
+	struct node *driver;
+	struct pw_loop *data_loop;
+	struct spa_source *timer_source;
+	struct spa_source *event_source;
+	uint32_t warmup;
+	uint32_t cycle;
+	uint64_t cycle_start;
+	uint64_t *cycle_times;
+	uint64_t measure_start;
+	uint64_t measure_end;
+
+	uint64_t ctx_start;
+	uint64_t ctx_end;
+	uint64_t dropped;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* context switches of all threads of a process */
+static uint64_t get_ctx_switches(pid_t pid)
+{
+	char path[128], line[256];
+	struct dirent *e;
+	uint64_t total = 0, v;
+	DIR *dir;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/task", pid);
+	if ((dir = opendir(path)) == NULL)
+		return 0;
+
+	while ((e = readdir(dir)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%d/task/%s/status", pid, e->d_name);
+		if ((f = fopen(path, "r")) == NULL)
+			continue;
+		while (fgets(line, sizeof(line), f) != NULL) {
+			if (sscanf(line, "voluntary_ctxt_switches: %"SCNu64, &v) == 1 ||
+			    sscanf(line, "nonvoluntary_ctxt_switches: %"SCNu64, &v) == 1)
+				total += v;
+		}
+		fclose(f);
+	}
+	closedir(dir);
+	return total;
+}
+
+static uint64_t get_all_ctx_switches(struct data *d)
+{
+	uint64_t total = get_ctx_switches(getpid());
+	uint32_t i;
+
+	for (i = 0; i < d->n_nodes; i++) {
+		if (d->nodes[i]->pid > 0)
+			total += get_ctx_switches(d->nodes[i]->pid);
+	}
+	return total;
+}
+
+/* the nodes in this process */
+
+static uint32_t get_n_samples(struct node *n, struct spa_buffer *b)
+{
+	uint32_t n_samples = n->position ? n->position->clock.duration : n->data->quantum;
+	return SPA_MIN(n_samples, b->datas[0].maxsize / sizeof(float));
+}
+
+static struct spa_buffer *dequeue_output(struct node *n)
+{
+	struct port *p = &n->ports[SPA_DIRECTION_OUTPUT];
+	struct spa_buffer *b;
+
+	if (p->io == NULL || p->n_buffers == 0 || p->io->status == SPA_STATUS_HAVE_DATA)
+		return NULL;
+
+	b = p->buffers[p->next];
+	p->io->buffer_id = p->next;
+	p->io->status = SPA_STATUS_HAVE_DATA;
+	p->next = (p->next + 1) % p->n_buffers;
+	return b;
+}
+
+static void set_chunk(struct spa_buffer *b, uint32_t n_samples)
+{
+	b->datas[0].chunk->offset = 0;
+	b->datas[0].chunk->size = n_samples * sizeof(float);
+	b->datas[0].chunk->stride = sizeof(float);
+}
+
+static int produce(struct node *n)
+{
+	struct spa_buffer *b;
+
+	if ((b = dequeue_output(n)) == NULL)
+		return SPA_STATUS_OK;
+
+	set_chunk(b, get_n_samples(n, b));
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static int filter(struct node *n)
+{
+	struct port *in = &n->ports[SPA_DIRECTION_INPUT];
+	struct spa_buffer *ib, *ob;
+	uint32_t n_samples;
+
+	if (in->io == NULL || in->io->status != SPA_STATUS_HAVE_DATA ||
+	    in->io->buffer_id >= in->n_buffers)
+		return SPA_STATUS_NEED_DATA;
+
+	ib = in->buffers[in->io->buffer_id];
+	in->io->status = SPA_STATUS_NEED_DATA;
+
+	if ((ob = dequeue_output(n)) == NULL)
+		return SPA_STATUS_NEED_DATA;
+
+	n_samples = SPA_MIN(get_n_samples(n, ob), ib->datas[0].chunk->size / sizeof(float));
+	if (ib->datas[0].data != NULL && ob->datas[0].data != NULL)
+		memcpy(ob->datas[0].data, ib->datas[0].data, n_samples * sizeof(float));
+	set_chunk(ob, n_samples);
+
+	return SPA_STATUS_HAVE_DATA;
+}
+
+static int consume(struct node *n)
+{
+	struct port *in = &n->ports[SPA_DIRECTION_INPUT];
+
+	if (in->io != NULL)
+		in->io->status = SPA_STATUS_NEED_DATA;
+	return SPA_STATUS_NEED_DATA;
+}
+
+static int do_quit(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	d->state = STATE_DONE;
+	pw_main_loop_quit(d->loop);
+	return 0;
+}
+
+/* start a cycle, called from the data loop of the driver */
+static void start_cycle(struct data *d)
+{
+	struct node *n = d->driver;
+
+	d->cycle_start = get_time();
+	produce(n);
+	spa_node_call_ready(&n->callbacks, SPA_STATUS_HAVE_DATA);
+}
+
+/* the graph completed, called from the data loop of the driver */
+static void end_cycle(struct data *d)
+{
+	uint64_t now = get_time();
+	uint32_t index;
+
+	if (d->cycle_start == 0)
+		return;
+
+	index = d->cycle - d->warmup;
+	if (d->cycle >= d->warmup && index < d->n_cycles)
+		d->cycle_times[index] = now - d->cycle_start;
+
+	d->cycle_start = 0;
+	d->cycle++;
+
+	if (d->cycle == d->warmup)
+		__atomic_store_n(&d->measure_start, now, __ATOMIC_RELEASE);
+
+	if (d->cycle == d->warmup + d->n_cycles) {
+		__atomic_store_n(&d->measure_end, now, __ATOMIC_RELEASE);
+		if (d->timer)
+			pw_loop_update_timer(d->data_loop, d->timer_source, NULL, NULL, false);
+		pw_loop_invoke(pw_main_loop_get_loop(d->loop), do_quit, 1, NULL, 0, false, d);
+	} else if (!d->timer) {
+		pw_loop_signal_event(d->data_loop, d->event_source);
+	}
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	start_cycle(data);
+}
+
+static void on_event(void *data, uint64_t count)
+{
+	start_cycle(data);
+}
+
+static int do_start(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+	struct timespec value, interval;
+	uint64_t period;
+
+	if (d->timer) {
+		period = (uint64_t)d->quantum * SPA_NSEC_PER_SEC / d->rate;
+		value.tv_sec = interval.tv_sec = period / SPA_NSEC_PER_SEC;
+		value.tv_nsec = interval.tv_nsec = period % SPA_NSEC_PER_SEC;
+		pw_loop_update_timer(d->data_loop, d->timer_source, &value, &interval, false);
+	} else {
+		start_cycle(d);
+	}
+	return 0;
+}
+
+static int do_add_sources(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+
+	d->timer_source = pw_loop_add_timer(d->data_loop, on_timeout, d);
+	d->event_source = pw_loop_add_event(d->data_loop, on_event, d);
+	return 0;
+}
+
+static int do_remove_sources(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct data *d = user_data;
+
+	if (d->timer_source)
+		pw_loop_destroy_source(d->data_loop, d->timer_source);
+	if (d->event_source)
+		pw_loop_destroy_source(d->data_loop, d->event_source);
+	d->timer_source = d->event_source = NULL;
+	return 0;
+}
+
+static void emit_port_info(struct node *n, enum spa_direction direction)
+{
+	struct spa_port_info info;
+
+	info = SPA_PORT_INFO_INIT();
+	info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS;
+	info.flags = SPA_PORT_FLAG_NO_REF;
+	spa_node_emit_port_info(&n->hooks, direction, 0, &info);
+}
+
+static int impl_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct node *n = object;
+	struct spa_node_info info;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+
+	info = SPA_NODE_INFO_INIT();
+	info.max_input_ports = n->has_port[SPA_DIRECTION_INPUT] ? 1 : 0;
+	info.max_output_ports = n->has_port[SPA_DIRECTION_OUTPUT] ? 1 : 0;
+	info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS;
+	info.flags = SPA_NODE_FLAG_RT;
+	spa_node_emit_info(&n->hooks, &info);
+
+	if (n->has_port[SPA_DIRECTION_INPUT])
+		emit_port_info(n, SPA_DIRECTION_INPUT);
+	if (n->has_port[SPA_DIRECTION_OUTPUT])
+		emit_port_info(n, SPA_DIRECTION_OUTPUT);
+
+	spa_hook_list_join(&n->hooks, &save);
+
+	return 0;
+}
+
+static int impl_set_callbacks(void *object,
+		const struct spa_node_callbacks *callbacks, void *data)
+{
+	struct node *n = object;
+	n->callbacks = SPA_CALLBACKS_INIT(callbacks, data);
+	return 0;
+}
+
+static int impl_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	struct node *n = object;
+
+	switch (id) {
+	case SPA_IO_Position:
+		n->position = data;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static int impl_send_command(void *object, const struct spa_command *command)
+{
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+	case SPA_NODE_COMMAND_Pause:
+		/* the cycles are started when the complete graph is running */
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static int impl_port_enum_params(void *object, int seq,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct node *n = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+	case SPA_PARAM_Format:
+		if (result.index > 0)
+			return 0;
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, id,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_AUDIO_format,   SPA_POD_Id(SPA_AUDIO_FORMAT_F32P),
+			SPA_FORMAT_AUDIO_rate,     SPA_POD_Int(n->data->rate),
+			SPA_FORMAT_AUDIO_channels, SPA_POD_Int(1));
+		break;
+	case SPA_PARAM_Buffers:
+		if (result.index > 0)
+			return 0;
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(MAX_QUANTUM * sizeof(float)),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(sizeof(float)),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(16));
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int impl_port_set_param(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	return id == SPA_PARAM_Format ? 0 : -ENOENT;
+}
+
+static int impl_port_use_buffers(void *object,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t flags, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct node *n = object;
+	struct port *p = &n->ports[direction];
+	uint32_t i;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	for (i = 0; i < n_buffers; i++)
+		p->buffers[i] = buffers[i];
+	p->n_buffers = n_buffers;
+	p->next = 0;
+	return 0;
+}
+
+static int impl_port_set_io(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t id, void *data, size_t size)
+{
+	struct node *n = object;
+
+	if (id != SPA_IO_Buffers)
+		return -ENOENT;
+	n->ports[direction].io = data;
+	return 0;
+}
+
+static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	return 0;
+}
+
+static int impl_process(void *object)
+{
+	struct node *n = object;
+
+	if (n->driver) {
+		end_cycle(n->data);
+		return SPA_STATUS_OK;
+	}
+	switch (n->role) {
+	case ROLE_SOURCE:
+		return produce(n);
+	case ROLE_FILTER:
+		return filter(n);
+	default:
+		return consume(n);
+	}
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_add_listener,
+	.set_callbacks = impl_set_callbacks,
+	.set_io = impl_set_io,
+	.send_command = impl_send_command,
+	.port_enum_params = impl_port_enum_params,
+	.port_set_param = impl_port_set_param,
+	.port_use_buffers = impl_port_use_buffers,
+	.port_set_io = impl_port_set_io,
+	.port_reuse_buffer = impl_port_reuse_buffer,
+	.process = impl_process,
+};
+
+/* the nodes in a client process */
+
+struct client {
+	struct pw_main_loop *loop;
+	struct pw_filter *filter;
+	void *in_port;
+	void *out_port;
+};
+
+static void client_process(void *data, struct spa_io_position *position)
+{
+	struct client *c = data;
+	uint32_t n_samples = position->clock.duration;
+	float *in, *out;
+
+	in = pw_filter_get_dsp_buffer(c->in_port, n_samples);
+	out = pw_filter_get_dsp_buffer(c->out_port, n_samples);
+	if (in != NULL && out != NULL)
+		memcpy(out, in, n_samples * sizeof(float));
+}
+
+static const struct pw_filter_events client_events = {
+	PW_VERSION_FILTER_EVENTS,
+	.process = client_process,
+};
+
+static void client_quit(void *data, int signal_number)
+{
+	struct client *c = data;
+	pw_main_loop_quit(c->loop);
+}
+
+static int run_client(const char *name, uint32_t quantum, uint32_t rate)
+{
+	struct client c = { 0 };
+	struct pw_loop *l;
+	char latency[64];
+
+	c.loop = pw_main_loop_new(NULL);
+	if (c.loop == NULL)
+		return -errno;
+
+	l = pw_main_loop_get_loop(c.loop);
+	pw_loop_add_signal(l, SIGINT, client_quit, &c);
+	pw_loop_add_signal(l, SIGTERM, client_quit, &c);
+
+	snprintf(latency, sizeof(latency), "%u/%u", quantum, rate);
+	c.filter = pw_filter_new_simple(l, name,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_NODE_LATENCY, latency,
+				PW_KEY_NODE_ALWAYS_PROCESS, "true",
+				PW_KEY_MEDIA_TYPE, "Audio",
+				PW_KEY_MEDIA_CATEGORY, "Filter",
+				NULL),
+			&client_events, &c);
+	if (c.filter == NULL)
+		return -errno;
+
+	c.in_port = pw_filter_add_port(c.filter,
+			PW_DIRECTION_INPUT,
+			PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+			pw_properties_new(
+				PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+				PW_KEY_PORT_NAME, "input",
+				NULL),
+			NULL, 0);
+	c.out_port = pw_filter_add_port(c.filter,
+			PW_DIRECTION_OUTPUT,
+			PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+			pw_properties_new(
+				PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+				PW_KEY_PORT_NAME, "output",
+				NULL),
+			NULL, 0);
+
+	pw_filter_connect(c.filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0);
+
+	pw_main_loop_run(c.loop);
+
+	pw_filter_destroy(c.filter);
+	pw_main_loop_destroy(c.loop);
+
+	return 0;
+}
+
+/* building the graph */
+
+static struct node *add_node(struct data *d, enum role role, bool remote,
+		uint32_t group, uint32_t index)
+{
+	struct node *n;
+
+	if (d->n_nodes >= MAX_NODES || (n = calloc(1, sizeof(*n))) == NULL)
+		return NULL;
+
+	n->data = d;
+	n->role = role;
+	n->remote = remote;
+	n->id = SPA_ID_INVALID;
+	n->has_port[SPA_DIRECTION_INPUT] = role != ROLE_SOURCE;
+	n->has_port[SPA_DIRECTION_OUTPUT] = role != ROLE_SINK;
+	snprintf(n->name, sizeof(n->name), "bench-%d-%s-%u-%u",
+			(int)getpid(), role_names[role], group, index);
+
+	d->nodes[d->n_nodes++] = n;
+	return n;
+}
+
+static int add_link(struct data *d, struct node *out, struct node *in)
+{
+	if (out == NULL || in == NULL)
+		return -ENOMEM;
+	if (d->n_links >= SPA_N_ELEMENTS(d->links))
+		return -ENOSPC;
+	d->links[d->n_links++] = (struct link) { out, in, NULL };
+	return 0;
+}
+
+static int make_topology(struct data *d)
+{
+	struct node *src, *sink, *prev, *f;
+	uint32_t g, j;
+	int res;
+
+	for (g = 0; g < d->n_groups; g++) {
+		switch (d->topology) {
+		case TOPOLOGY_CHAIN:
+			prev = add_node(d, ROLE_SOURCE, false, g, 0);
+			for (j = 0; j < d->n_filters; j++) {
+				f = add_node(d, ROLE_FILTER, d->remote, g, j);
+				if ((res = add_link(d, prev, f)) < 0)
+					return res;
+				prev = f;
+			}
+			sink = add_node(d, ROLE_SINK, false, g, 0);
+			if ((res = add_link(d, prev, sink)) < 0)
+				return res;
+			break;
+		case TOPOLOGY_FANOUT:
+			src = add_node(d, ROLE_SOURCE, false, g, 0);
+			for (j = 0; j < SPA_MAX(d->n_filters, 1u); j++) {
+				prev = src;
+				if (d->n_filters > 0) {
+					f = add_node(d, ROLE_FILTER, d->remote, g, j);
+					if ((res = add_link(d, prev, f)) < 0)
+						return res;
+					prev = f;
+				}
+				sink = add_node(d, ROLE_SINK, false, g, j);
+				if ((res = add_link(d, prev, sink)) < 0)
+					return res;
+			}
+			break;
+		case TOPOLOGY_FANIN:
+			sink = add_node(d, ROLE_SINK, false, g, 0);
+			for (j = 0; j < SPA_MAX(d->n_filters, 1u); j++) {
+				prev = add_node(d, ROLE_SOURCE, false, g, j);
+				if (d->n_filters > 0) {
+					f = add_node(d, ROLE_FILTER, d->remote, g, j);
+					if ((res = add_link(d, prev, f)) < 0)
+						return res;
+					prev = f;
+				}
+				if ((res = add_link(d, prev, sink)) < 0)
+					return res;
+			}
+			break;
+		}
+	}
+	if (d->n_nodes == 0 || d->nodes[0]->role != ROLE_SOURCE) {
+		/* fanin adds the sink first, the first source drives */
+		for (j = 0; j < d->n_nodes; j++)
+			if (d->nodes[j]->role == ROLE_SOURCE)
+				break;
+		if (j == d->n_nodes)
+			return -EINVAL;
+		d->driver = d->nodes[j];
+	} else {
+		d->driver = d->nodes[0];
+	}
+	d->driver->driver = true;
+	return 0;
+}
+
+static int create_local_node(struct data *d, struct node *n)
+{
+	struct pw_properties *props;
+	char latency[64];
+
+	snprintf(latency, sizeof(latency), "%u/%u", d->quantum, d->rate);
+	props = pw_properties_new(
+			PW_KEY_NODE_NAME, n->name,
+			PW_KEY_NODE_LATENCY, latency,
+			NULL);
+	if (props == NULL)
+		return -errno;
+	/* only the first group is linked to the driver, the nodes of the
+	 * other groups join its graph because they always process */
+	if (n->driver)
+		pw_properties_set(props, PW_KEY_NODE_DRIVER, "true");
+	else
+		pw_properties_set(props, PW_KEY_NODE_ALWAYS_PROCESS, "true");
+
+	spa_hook_list_init(&n->hooks);
+	n->impl.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, n);
+
+	if ((n->node = pw_node_new(d->core, props, 0)) == NULL)
+		return -errno;
+	pw_node_set_implementation(n->node, &n->impl);
+	pw_node_register(n->node, NULL);
+	n->id = pw_global_get_id(pw_node_get_global(n->node));
+	return 0;
+}
+
+static int spawn_client(struct data *d, struct node *n)
+{
+	char quantum[16], rate[16];
+	pid_t pid;
+
+	snprintf(quantum, sizeof(quantum), "%u", d->quantum);
+	snprintf(rate, sizeof(rate), "%u", d->rate);
+
+	if ((pid = fork()) < 0)
+		return -errno;
+	if (pid == 0) {
+		execl(d->exe, d->exe, "--client", n->name,
+				"--quantum", quantum, "--rate", rate, NULL);
+		fprintf(stderr, "can't exec %s: %m\n", d->exe);
+		_exit(1);
+	}
+	n->pid = pid;
+	return 0;
+}
+
+static int find_remote_node(void *data, struct pw_global *global)
+{
+	struct node *n = data;
+	struct pw_node *node;
+	const char *str;
+
+	if (pw_global_get_type(global) != PW_TYPE_INTERFACE_Node)
+		return 0;
+	node = pw_global_get_object(global);
+	str = pw_properties_get(pw_node_get_properties(node), PW_KEY_NODE_NAME);
+	if (str == NULL || strcmp(str, n->name) != 0)
+		return 0;
+	if (pw_node_find_port(node, PW_DIRECTION_INPUT, 0) == NULL ||
+	    pw_node_find_port(node, PW_DIRECTION_OUTPUT, 0) == NULL)
+		return 0;
+
+	n->node = node;
+	n->id = pw_global_get_id(global);
+	return 1;
+}
+
+static int make_links(struct data *d)
+{
+	struct pw_port *out, *in;
+	struct link *l;
+	uint32_t i;
+
+	for (i = 0; i < d->n_links; i++) {
+		l = &d->links[i];
+		out = pw_node_find_port(l->out->node, PW_DIRECTION_OUTPUT, 0);
+		in = pw_node_find_port(l->in->node, PW_DIRECTION_INPUT, 0);
+		if (out == NULL || in == NULL)
+			return -ENOENT;
+
+		l->link = pw_link_new(d->core, out, in, NULL, NULL, 0);
+		if (l->link == NULL) {
+			fprintf(stderr, "can't link %s to %s: %m\n", l->out->name, l->in->name);
+			return -errno;
+		}
+		pw_link_register(l->link, NULL);
+	}
+	for (i = 0; i < d->n_nodes; i++) {
+		if (!d->nodes[i]->remote)
+			pw_node_set_active(d->nodes[i]->node, true);
+	}
+	return 0;
+}
+
+/* profiler */
+
+static struct node *find_node(struct data *d, uint32_t id)
+{
+	uint32_t i;
+	for (i = 0; i < d->n_nodes; i++)
+		if (d->nodes[i]->id == id)
+			return d->nodes[i];
+	return NULL;
+}
+
+static void read_profiler(struct data *d)
+{
+	struct pw_profiler *p = d->core->profiler;
+	struct pw_profiler_header *h;
+	struct pw_profiler_record r;
+	uint64_t start, end, wait, busy;
+	uint32_t index;
+	int32_t avail;
+	struct node *n;
+
+	if (p == NULL)
+		return;
+
+	h = p->header;
+	start = __atomic_load_n(&d->measure_start, __ATOMIC_ACQUIRE);
+	end = __atomic_load_n(&d->measure_end, __ATOMIC_ACQUIRE);
+
+	avail = spa_ringbuffer_get_read_index(&h->ring, &index);
+	if (avail > (int32_t)h->size) {
+		index += avail;
+		spa_ringbuffer_read_update(&h->ring, index);
+		return;
+	}
+	while (avail >= (int32_t)sizeof(r)) {
+		spa_ringbuffer_read_data(&h->ring, p->data, h->size,
+				index & (h->size - 1), &r, sizeof(r));
+		index += sizeof(r);
+		avail -= sizeof(r);
+
+		if (start == 0 || r.signal_time < start ||
+		    (end != 0 && r.signal_time > end))
+			continue;
+		if (r.finish_time < r.awake_time || r.awake_time < r.signal_time)
+			continue;
+		if ((n = find_node(d, r.node_id)) == NULL)
+			continue;
+
+		wait = r.awake_time - r.signal_time;
+		busy = r.finish_time - r.awake_time;
+		n->count++;
+		n->wait_sum += wait;
+		n->wait_max = SPA_MAX(n->wait_max, wait);
+		n->busy_sum += busy;
+		n->busy_max = SPA_MAX(n->busy_max, busy);
+	}
+	spa_ringbuffer_read_update(&h->ring, index);
+	d->dropped = h->dropped;
+}
+
+/* main loop state machine */
+
+static bool all_running(struct data *d)
+{
+	uint32_t i;
+	for (i = 0; i < d->n_nodes; i++) {
+		const struct pw_node_info *info = pw_node_get_info(d->nodes[i]->node);
+		if (info->state != PW_NODE_STATE_RUNNING)
+			return false;
+	}
+	return true;
+}
+
+static void on_poll(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	uint32_t i;
+	int res;
+
+	switch (d->state) {
+	case STATE_WAIT_NODES:
+		for (i = 0; i < d->n_nodes; i++) {
+			struct node *n = d->nodes[i];
+			if (n->node == NULL &&
+			    pw_core_for_each_global(d->core, find_remote_node, n) == 0)
+				break;
+		}
+		if (i < d->n_nodes)
+			break;
+		if ((res = make_links(d)) < 0) {
+			d->res = res;
+			pw_main_loop_quit(d->loop);
+			return;
+		}
+		d->state = STATE_WAIT_RUNNING;
+		break;
+
+	case STATE_WAIT_RUNNING:
+		if (!all_running(d))
+			break;
+		d->data_loop = d->driver->node->data_loop;
+		d->ctx_start = get_all_ctx_switches(d);
+		/* skip what was recorded while setting up */
+		if (d->core->profiler)
+			d->core->profiler->header->ring.readindex =
+				d->core->profiler->header->ring.writeindex;
+		pw_loop_invoke(d->data_loop, do_add_sources, 0, NULL, 0, true, d);
+		pw_loop_invoke(d->data_loop, do_start, 0, NULL, 0, true, d);
+		d->state = STATE_RUNNING;
+		return;
+
+	case STATE_RUNNING:
+		read_profiler(d);
+		return;
+
+	default:
+		return;
+	}
+
+	if (get_time() - d->setup_start > SETUP_TIMEOUT) {
+		fprintf(stderr, "timeout while setting up the graph\n");
+		d->res = -ETIMEDOUT;
+		pw_main_loop_quit(d->loop);
+	}
+}
+
+/* report */
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t*)a, ub = *(const uint64_t*)b;
+	return ua < ub ? -1 : ua > ub ? 1 : 0;
+}
+
+static uint64_t percentile(uint64_t *sorted, uint32_t n, double p)
+{
+	uint32_t i = SPA_MIN((uint32_t)(p * n), n - 1);
+	return n ? sorted[i] : 0;
+}
+
+static void report(struct data *d)
+{
+	uint64_t sum = 0, *t = d->cycle_times, ctx, elapsed;
+	uint32_t i, n = SPA_MIN(d->cycle - SPA_MIN(d->cycle, d->warmup), d->n_cycles);
+	struct {
+		uint32_t n_nodes;
+		uint64_t count, wait_sum, wait_max, busy_sum, busy_max;
+	} roles[ROLE_LAST];
+	static const double pct[] = { 0.5, 0.9, 0.99, 0.999 };
+	static const char *pct_names[] = { "p50", "p90", "p99", "p99.9" };
+
+	qsort(t, n, sizeof(uint64_t), compare_u64);
+	for (i = 0; i < n; i++)
+		sum += t[i];
+
+	spa_zero(roles);
+	for (i = 0; i < d->n_nodes; i++) {
+		struct node *nd = d->nodes[i];
+		roles[nd->role].n_nodes++;
+		roles[nd->role].count += nd->count;
+		roles[nd->role].wait_sum += nd->wait_sum;
+		roles[nd->role].wait_max = SPA_MAX(roles[nd->role].wait_max, nd->wait_max);
+		roles[nd->role].busy_sum += nd->busy_sum;
+		roles[nd->role].busy_max = SPA_MAX(roles[nd->role].busy_max, nd->busy_max);
+	}
+	ctx = d->ctx_end - d->ctx_start;
+	elapsed = d->measure_end > d->measure_start ? d->measure_end - d->measure_start : 0;
+
+	fprintf(stderr, "%s: %s, %u groups, %u filters (%s), %u nodes, quantum %u/%u, %s\n",
+			NAME, topology_names[d->topology], d->n_groups, d->n_filters,
+			d->remote ? "remote" : "in-process", d->n_nodes,
+			d->quantum, d->rate, d->timer ? "timer" : "freewheel");
+	fprintf(stderr, "cycles %u, elapsed %"PRIu64" ns, %.1f cycles/sec\n",
+			n, elapsed, elapsed ? n * (double)SPA_NSEC_PER_SEC / elapsed : 0.0);
+	fprintf(stderr, "cycle time (usec): min %.2f avg %.2f", n ? t[0] / 1000.0 : 0.0,
+			n ? sum / (n * 1000.0) : 0.0);
+	for (i = 0; i < SPA_N_ELEMENTS(pct); i++)
+		fprintf(stderr, " %s %.2f", pct_names[i], percentile(t, n, pct[i]) / 1000.0);
+	fprintf(stderr, " max %.2f\n", n ? t[n-1] / 1000.0 : 0.0);
+	fprintf(stderr, "overhead per node: %.2f usec\n",
+			n && d->n_nodes ? sum / (n * 1000.0 * d->n_nodes) : 0.0);
+	fprintf(stderr, "context switches: %"PRIu64" (%.2f per cycle, including %u warmup cycles)\n",
+			ctx, d->cycle ? ctx / (double)d->cycle : 0.0, d->warmup);
+	fprintf(stderr, "%-8s %6s %10s %10s %10s %10s\n", "role", "nodes",
+			"wait-avg", "wait-max", "busy-avg", "busy-max");
+	for (i = 0; i < ROLE_LAST; i++) {
+		if (roles[i].n_nodes == 0)
+			continue;
+		fprintf(stderr, "%-8s %6u %10.2f %10.2f %10.2f %10.2f\n",
+				role_names[i], roles[i].n_nodes,
+				roles[i].count ? roles[i].wait_sum / (roles[i].count * 1000.0) : 0.0,
+				roles[i].wait_max / 1000.0,
+				roles[i].count ? roles[i].busy_sum / (roles[i].count * 1000.0) : 0.0,
+				roles[i].busy_max / 1000.0);
+	}
+	if (d->dropped)
+		fprintf(stderr, "profiler dropped %"PRIu64" records\n", d->dropped);
+
+	printf("{\n  \"suite\": \"graph\",\n");
+	printf("  \"config\": { \"topology\": \"%s\", \"groups\": %u, \"filters\": %u, "
+			"\"remote\": %s, \"nodes\": %u, \"quantum\": %u, \"rate\": %u, "
+			"\"timer\": %s },\n",
+			topology_names[d->topology], d->n_groups, d->n_filters,
+			d->remote ? "true" : "false", d->n_nodes, d->quantum, d->rate,
+			d->timer ? "true" : "false");
+	printf("  \"cycles\": %u,\n  \"elapsed_ns\": %"PRIu64",\n", n, elapsed);
+	printf("  \"cycle_ns\": { \"min\": %"PRIu64", \"avg\": %.1f",
+			n ? t[0] : 0, n ? sum / (double)n : 0.0);
+	for (i = 0; i < SPA_N_ELEMENTS(pct); i++)
+		printf(", \"%s\": %"PRIu64, pct_names[i], percentile(t, n, pct[i]));
+	printf(", \"max\": %"PRIu64" },\n", n ? t[n-1] : 0);
+	printf("  \"overhead_per_node_ns\": %.1f,\n",
+			n && d->n_nodes ? sum / ((double)n * d->n_nodes) : 0.0);
+	printf("  \"context_switches\": %"PRIu64",\n", ctx);
+	printf("  \"context_switches_per_cycle\": %.3f,\n", d->cycle ? ctx / (double)d->cycle : 0.0);
+	printf("  \"profiler_dropped\": %"PRIu64",\n", d->dropped);
+	printf("  \"roles\": [");
+	for (i = 0; i < ROLE_LAST; i++) {
+		printf("%s\n    { \"role\": \"%s\", \"nodes\": %u, \"wait_avg_ns\": %.1f, "
+				"\"wait_max_ns\": %"PRIu64", \"busy_avg_ns\": %.1f, "
+				"\"busy_max_ns\": %"PRIu64" }",
+				i == 0 ? "" : ",", role_names[i], roles[i].n_nodes,
+				roles[i].count ? roles[i].wait_sum / (double)roles[i].count : 0.0,
+				roles[i].wait_max,
+				roles[i].count ? roles[i].busy_sum / (double)roles[i].count : 0.0,
+				roles[i].busy_max);
+	}
+	printf("\n  ]\n}\n");
+	fflush(stdout);
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -t, --topology                        chain, fanout or fanin (default chain)\n"
+		"  -g, --groups                          Number of groups (default %d)\n"
+		"  -m, --filters                         Filters per group (default %d)\n"
+		"  -c, --cycles                          Measured cycles (default %d)\n"
+		"  -q, --quantum                         Quantum in samples (default %d)\n"
+		"  -r, --rate                            Sample rate (default %d)\n"
+		"  -R, --remote                          Run each filter in a client process\n"
+		"  -T, --timer                           Start cycles every quantum instead\n"
+		"                                        of right after the previous one\n"
+		"  -p, --property                        Add a core property key=value\n",
+		name, DEFAULT_GROUPS, DEFAULT_FILTERS, DEFAULT_CYCLES,
+		BENCH_QUANTUM, BENCH_RATE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 }, *d = &data;
+	struct pw_properties *props;
+	struct timespec value, interval;
+	const char *client = NULL;
+	char name[64];
+	uint32_t i;
+	int c, res;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "topology",	required_argument,	NULL, 't' },
+		{ "groups",	required_argument,	NULL, 'g' },
+		{ "filters",	required_argument,	NULL, 'm' },
+		{ "cycles",	required_argument,	NULL, 'c' },
+		{ "quantum",	required_argument,	NULL, 'q' },
+		{ "rate",	required_argument,	NULL, 'r' },
+		{ "remote",	no_argument,		NULL, 'R' },
+		{ "timer",	no_argument,		NULL, 'T' },
+		{ "property",	required_argument,	NULL, 'p' },
+		{ "client",	required_argument,	NULL, 'C' },
+		{ NULL, 0, NULL, 0}
+	};
+
+	pw_init(&argc, &argv);
+
+	d->topology = TOPOLOGY_CHAIN;
+	d->n_groups = DEFAULT_GROUPS;
+	d->n_filters = DEFAULT_FILTERS;
+	d->n_cycles = DEFAULT_CYCLES;
+	d->quantum = BENCH_QUANTUM;
+	d->rate = BENCH_RATE;
+	d->exe = "/proc/self/exe";
+
+	if ((props = pw_properties_new("core.profiler", "true", NULL)) == NULL)
+		return -1;
+
+	while ((c = getopt_long(argc, argv, "ht:g:m:c:q:r:RTp:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 't':
+			for (i = 0; i < SPA_N_ELEMENTS(topology_names); i++)
+				if (strcmp(optarg, topology_names[i]) == 0)
+					break;
+			if (i == SPA_N_ELEMENTS(topology_names)) {
+				fprintf(stderr, "unknown topology %s\n", optarg);
+				return -1;
+			}
+			d->topology = i;
+			break;
+		case 'g':
+			d->n_groups = SPA_MAX(atoi(optarg), 1);
+			break;
+		case 'm':
+			d->n_filters = SPA_MAX(atoi(optarg), 0);
+			break;
+		case 'c':
+			d->n_cycles = SPA_MAX(atoi(optarg), 1);
+			break;
+		case 'q':
+			d->quantum = SPA_CLAMP((uint32_t)atoi(optarg), MIN_QUANTUM, MAX_QUANTUM);
+			break;
+		case 'r':
+			d->rate = SPA_MAX(atoi(optarg), 1);
+			break;
+		case 'R':
+			d->remote = true;
+			break;
+		case 'T':
+			d->timer = true;
+			break;
+		case 'p':
+		{
+			char *eq = strchr(optarg, '=');
+			if (eq == NULL) {
+				fprintf(stderr, "invalid property %s\n", optarg);
+				return -1;
+			}
+			*eq = '\0';
+			pw_properties_set(props, optarg, eq + 1);
+			break;
+		}
+		case 'C':
+			client = optarg;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+
+	if (client != NULL) {
+		pw_properties_free(props);
+		return run_client(client, d->quantum, d->rate);
+	}
+
+	d->warmup = SPA_MAX(d->n_cycles / 10, 16u);
+	if ((d->cycle_times = calloc(d->n_cycles, sizeof(uint64_t))) == NULL)
+		return -1;
+
+	/* the clients connect to the socket of this core */
+	snprintf(name, sizeof(name), "%s-%d", NAME, (int)getpid());
+	pw_properties_set(props, PW_KEY_CORE_NAME, name);
+	if (d->remote) {
+		pw_properties_set(props, PW_KEY_CORE_DAEMON, "true");
+		setenv("PIPEWIRE_CORE", name, 1);
+		setenv("PIPEWIRE_REMOTE", name, 1);
+	}
+
+	d->loop = pw_main_loop_new(NULL);
+	if (d->loop == NULL)
+		return -1;
+	d->core = pw_core_new(pw_main_loop_get_loop(d->loop), props, 0);
+	if (d->core == NULL)
+		return -1;
+
+	if (d->remote) {
+		if (pw_module_load(d->core, "libpipewire-module-protocol-native", NULL, NULL) == NULL ||
+		    pw_module_load(d->core, "libpipewire-module-client-node", NULL, NULL) == NULL) {
+			fprintf(stderr, "can't load modules: %m\n");
+			return -1;
+		}
+	}
+
+	if ((res = make_topology(d)) < 0) {
+		fprintf(stderr, "can't make graph: %s\n", spa_strerror(res));
+		return -1;
+	}
+	for (i = 0; i < d->n_nodes; i++) {
+		struct node *n = d->nodes[i];
+		res = n->remote ? spawn_client(d, n) : create_local_node(d, n);
+		if (res < 0) {
+			fprintf(stderr, "can't create %s: %s\n", n->name, spa_strerror(res));
+			d->res = res;
+			goto done;
+		}
+	}
+
+	d->state = STATE_WAIT_NODES;
+	d->setup_start = get_time();
+	d->poll = pw_loop_add_timer(pw_main_loop_get_loop(d->loop), on_poll, d);
+	value.tv_sec = interval.tv_sec = 0;
+	value.tv_nsec = interval.tv_nsec = POLL_INTERVAL;
+	pw_loop_update_timer(pw_main_loop_get_loop(d->loop), d->poll, &value, &interval, false);
+
+	pw_main_loop_run(d->loop);
+
+	if (d->state == STATE_DONE) {
+		d->ctx_end = get_all_ctx_switches(d);
+		read_profiler(d);
+		report(d);
+	}
+
+done:
+	if (d->data_loop)
+		pw_loop_invoke(d->data_loop, do_remove_sources, 0, NULL, 0, true, d);
+
+	for (i = 0; i < d->n_links; i++) {
+		if (d->links[i].link)
+			pw_link_destroy(d->links[i].link);
+	}
+	for (i = 0; i < d->n_nodes; i++) {
+		struct node *n = d->nodes[i];
+		if (n->pid > 0) {
+			kill(n->pid, SIGTERM);
+			waitpid(n->pid, NULL, 0);
+		} else if (n->node) {
+			pw_node_destroy(n->node);
+		}
+		free(n);
+	}
+	free(d->cycle_times);
+
+	pw_core_destroy(d->core);
+	pw_main_loop_destroy(d->loop);
+
+	return d->res < 0 ? -1 : 0;
+}
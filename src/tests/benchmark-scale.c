@@ -0,0 +1,597 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+/* Measures how the core scales with the number of objects.
+ *
+ * For each step, 100, 1000, ... up to --nodes, the benchmark creates
+ * that many nodes with --ports input and output ports and reports:
+ *
+ *   - the time to create and register the nodes and their ports
+ *   - the memory used per node, from the resident set size
+ *   - the cost of looking up globals, ports and properties
+ *   - with --remote, the time for a client to connect and enumerate
+ *     the registry over the native protocol
+ *   - the time to destroy the nodes
+ *
+ * The steady-state cycle cost of a running graph is measured by
+ * benchmark-graph.
+ *
+ * A table is written to stderr and the results as JSON to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/private.h>
+
+#define NAME "benchmark-scale"
+
+#define MIN_NODES		100
+#define DEFAULT_NODES		10000
+#define DEFAULT_PORTS		1
+#define MAX_PORTS		64
+#define N_PROPS			8
+#define N_LOOKUPS		100000
+
+struct node {
+	struct spa_node impl;
+	struct spa_hook_list hooks;
+	uint32_t n_ports;
+	struct pw_node *node;
+	uint32_t id;
+};
+
+struct result {
+	uint32_t n_nodes;
+	uint64_t create_ns;
+	uint64_t destroy_ns;
+	int64_t mem_per_node;
+	double find_global_ns;
+	double find_port_ns;
+	double get_prop_ns;
+	uint64_t registry_ns;
+	uint32_t n_globals;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	int res;
+
+	/* options */
+	uint32_t max_nodes;
+	uint32_t n_ports;
+	bool remote;
+	const char *exe;
+
+	pid_t pid;
+	struct result results[16];
+	uint32_t n_results;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int64_t get_rss(void)
+{
+	long size, resident;
+	FILE *f;
+	int n;
+
+	if ((f = fopen("/proc/self/statm", "r")) == NULL)
+		return 0;
+	n = fscanf(f, "%ld %ld", &size, &resident);
+	fclose(f);
+	return n == 2 ? (int64_t)resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+/* the nodes, they only announce their ports */
+
+static void emit_port_info(struct node *n, enum spa_direction direction, uint32_t port_id)
+{
+	struct spa_port_info info;
+
+	info = SPA_PORT_INFO_INIT();
+	info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS;
+	info.flags = SPA_PORT_FLAG_NO_REF;
+	spa_node_emit_port_info(&n->hooks, direction, port_id, &info);
+}
+
+static int impl_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct node *n = object;
+	struct spa_node_info info;
+	struct spa_hook_list save;
+	uint32_t i;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+
+	info = SPA_NODE_INFO_INIT();
+	info.max_input_ports = n->n_ports;
+	info.max_output_ports = n->n_ports;
+	info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS;
+	info.flags = SPA_NODE_FLAG_RT;
+	spa_node_emit_info(&n->hooks, &info);
+
+	for (i = 0; i < n->n_ports; i++) {
+		emit_port_info(n, SPA_DIRECTION_INPUT, i);
+		emit_port_info(n, SPA_DIRECTION_OUTPUT, i);
+	}
+
+	spa_hook_list_join(&n->hooks, &save);
+
+	return 0;
+}
+
+static int impl_set_callbacks(void *object,
+		const struct spa_node_callbacks *callbacks, void *data)
+{
+	return 0;
+}
+
+static int impl_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int impl_port_enum_params(void *object, int seq,
+		enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	return 0;
+}
+
+static int impl_process(void *object)
+{
+	return SPA_STATUS_OK;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_add_listener,
+	.set_callbacks = impl_set_callbacks,
+	.send_command = impl_send_command,
+	.port_enum_params = impl_port_enum_params,
+	.process = impl_process,
+};
+
+static int create_node(struct data *d, struct node *n, uint32_t index)
+{
+	struct pw_properties *props;
+	char key[32];
+	uint32_t i;
+
+	props = pw_properties_new(NULL, NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props, PW_KEY_NODE_NAME, "bench-node-%u", index);
+	pw_properties_setf(props, PW_KEY_NODE_DESCRIPTION, "Benchmark node %u", index);
+	pw_properties_set(props, PW_KEY_MEDIA_CLASS, "Audio/Duplex");
+	for (i = 3; i < N_PROPS; i++) {
+		snprintf(key, sizeof(key), "bench.prop.%u", i);
+		pw_properties_setf(props, key, "%u", index);
+	}
+
+	spa_hook_list_init(&n->hooks);
+	n->n_ports = d->n_ports;
+	n->impl.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, n);
+
+	if ((n->node = pw_node_new(d->core, props, 0)) == NULL)
+		return -errno;
+	pw_node_set_implementation(n->node, &n->impl);
+	pw_node_register(n->node, NULL);
+	n->id = pw_global_get_id(pw_node_get_global(n->node));
+	return 0;
+}
+
+/* the client that enumerates the registry */
+
+struct client {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_remote *remote;
+	struct pw_core_proxy *core_proxy;
+	struct pw_registry_proxy *registry;
+	struct spa_hook remote_listener;
+	struct spa_hook core_listener;
+	struct spa_hook registry_listener;
+	uint64_t start;
+	uint64_t elapsed;
+	uint32_t n_globals;
+	int res;
+};
+
+static void client_global(void *data, uint32_t id,
+		uint32_t permissions, uint32_t type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct client *c = data;
+	c->n_globals++;
+}
+
+static const struct pw_registry_proxy_events client_registry_events = {
+	PW_VERSION_REGISTRY_PROXY_EVENTS,
+	.global = client_global,
+};
+
+static void client_done(void *data, uint32_t id, int seq)
+{
+	struct client *c = data;
+
+	if (id != 0)
+		return;
+	c->elapsed = get_time() - c->start;
+	pw_main_loop_quit(c->loop);
+}
+
+static const struct pw_core_proxy_events client_core_events = {
+	PW_VERSION_CORE_PROXY_EVENTS,
+	.done = client_done,
+};
+
+static void client_state_changed(void *data, enum pw_remote_state old,
+		enum pw_remote_state state, const char *error)
+{
+	struct client *c = data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		fprintf(stderr, "remote error: %s\n", error);
+		c->res = -EIO;
+		pw_main_loop_quit(c->loop);
+		break;
+	case PW_REMOTE_STATE_CONNECTED:
+		c->core_proxy = pw_remote_get_core_proxy(c->remote);
+		pw_core_proxy_add_listener(c->core_proxy,
+				&c->core_listener, &client_core_events, c);
+		c->registry = pw_core_proxy_get_registry(c->core_proxy,
+				PW_VERSION_REGISTRY_PROXY, 0);
+		pw_registry_proxy_add_listener(c->registry,
+				&c->registry_listener, &client_registry_events, c);
+		pw_core_proxy_sync(c->core_proxy, 0, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events client_remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = client_state_changed,
+};
+
+static int run_client(int fd)
+{
+	struct client c = { 0 };
+	uint64_t result[2];
+
+	c.loop = pw_main_loop_new(NULL);
+	if (c.loop == NULL)
+		return -errno;
+	c.core = pw_core_new(pw_main_loop_get_loop(c.loop), NULL, 0);
+	if (c.core == NULL)
+		return -errno;
+	c.remote = pw_remote_new(c.core, NULL, 0);
+	if (c.remote == NULL)
+		return -errno;
+
+	pw_remote_add_listener(c.remote, &c.remote_listener, &client_remote_events, &c);
+
+	c.start = get_time();
+	if ((c.res = pw_remote_connect(c.remote)) >= 0)
+		pw_main_loop_run(c.loop);
+
+	result[0] = c.elapsed;
+	result[1] = c.n_globals;
+	if (c.res >= 0 && write(fd, result, sizeof(result)) != sizeof(result))
+		c.res = -errno;
+	close(fd);
+
+	pw_core_destroy(c.core);
+	pw_main_loop_destroy(c.loop);
+
+	return c.res;
+}
+
+static void on_child(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+static int measure_registry(struct data *d, struct result *r)
+{
+	uint64_t result[2];
+	char fd[16];
+	int fds[2], status;
+	pid_t pid;
+
+	if (pipe(fds) < 0)
+		return -errno;
+
+	if ((pid = fork()) < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return -errno;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		snprintf(fd, sizeof(fd), "%d", fds[1]);
+		execl(d->exe, d->exe, "--client", fd, NULL);
+		fprintf(stderr, "can't exec %s: %m\n", d->exe);
+		_exit(1);
+	}
+	close(fds[1]);
+
+	/* serve the client until it exits */
+	pw_main_loop_run(d->loop);
+	waitpid(pid, &status, 0);
+
+	if (read(fds[0], result, sizeof(result)) != sizeof(result)) {
+		close(fds[0]);
+		return -EIO;
+	}
+	close(fds[0]);
+
+	r->registry_ns = result[0];
+	r->n_globals = result[1];
+	return 0;
+}
+
+/* the measurements */
+
+static void measure_lookups(struct data *d, struct node *nodes, uint32_t n_nodes,
+		struct result *r)
+{
+	uint64_t start;
+	uint32_t i, j, found = 0;
+
+	start = get_time();
+	for (i = 0; i < N_LOOKUPS; i++) {
+		j = (i * 7919) % n_nodes;
+		if (pw_core_find_global(d->core, nodes[j].id) != NULL)
+			found++;
+	}
+	r->find_global_ns = (get_time() - start) / (double)N_LOOKUPS;
+
+	start = get_time();
+	for (i = 0; i < N_LOOKUPS; i++) {
+		j = (i * 7919) % n_nodes;
+		if (pw_node_find_port(nodes[j].node, PW_DIRECTION_OUTPUT,
+					i % d->n_ports) != NULL)
+			found++;
+	}
+	r->find_port_ns = (get_time() - start) / (double)N_LOOKUPS;
+
+	start = get_time();
+	for (i = 0; i < N_LOOKUPS; i++) {
+		j = (i * 7919) % n_nodes;
+		if (pw_properties_get(pw_node_get_properties(nodes[j].node),
+					PW_KEY_MEDIA_CLASS) != NULL)
+			found++;
+	}
+	r->get_prop_ns = (get_time() - start) / (double)N_LOOKUPS;
+
+	if (found != 3 * N_LOOKUPS)
+		fprintf(stderr, "only %u of %u lookups succeeded\n", found, 3 * N_LOOKUPS);
+}
+
+static int run_step(struct data *d, uint32_t n_nodes, struct result *r)
+{
+	struct node *nodes;
+	uint64_t start;
+	int64_t rss;
+	uint32_t i;
+	int res = 0;
+
+	if ((nodes = calloc(n_nodes, sizeof(struct node))) == NULL)
+		return -errno;
+
+	r->n_nodes = n_nodes;
+
+	rss = get_rss();
+	start = get_time();
+	for (i = 0; i < n_nodes; i++) {
+		if ((res = create_node(d, &nodes[i], i)) < 0)
+			break;
+	}
+	r->create_ns = get_time() - start;
+	r->mem_per_node = (get_rss() - rss) / (int64_t)n_nodes;
+
+	if (res >= 0) {
+		measure_lookups(d, nodes, n_nodes, r);
+		if (d->remote)
+			res = measure_registry(d, r);
+	}
+
+	start = get_time();
+	for (i = 0; i < n_nodes; i++) {
+		if (nodes[i].node)
+			pw_node_destroy(nodes[i].node);
+	}
+	r->destroy_ns = get_time() - start;
+
+	free(nodes);
+	return res;
+}
+
+static void report(struct data *d)
+{
+	uint32_t i;
+
+	fprintf(stderr, "%u ports per direction, %s\n", d->n_ports,
+			d->remote ? "with registry" : "in-process");
+	fprintf(stderr, "%8s %12s %12s %10s %10s %10s %10s %12s %12s\n",
+			"nodes", "create(us)", "per-node(ns)", "mem(B)",
+			"global(ns)", "port(ns)", "prop(ns)", "registry(us)",
+			"destroy(us)");
+	for (i = 0; i < d->n_results; i++) {
+		struct result *r = &d->results[i];
+		fprintf(stderr, "%8u %12.1f %12.1f %10"PRIi64" %10.1f %10.1f %10.1f %12.1f %12.1f\n",
+				r->n_nodes, r->create_ns / 1000.0,
+				r->create_ns / (double)r->n_nodes,
+				r->mem_per_node, r->find_global_ns,
+				r->find_port_ns, r->get_prop_ns,
+				r->registry_ns / 1000.0, r->destroy_ns / 1000.0);
+	}
+
+	printf("{\n  \"benchmark\": \"%s\", \"ports\": %u, \"remote\": %s,\n  \"steps\": [",
+			NAME, d->n_ports, d->remote ? "true" : "false");
+	for (i = 0; i < d->n_results; i++) {
+		struct result *r = &d->results[i];
+		printf("%s\n    { \"nodes\": %u, \"create_ns\": %"PRIu64", "
+				"\"mem_per_node\": %"PRIi64", \"find_global_ns\": %.1f, "
+				"\"find_port_ns\": %.1f, \"get_prop_ns\": %.1f, "
+				"\"registry_ns\": %"PRIu64", \"globals\": %u, "
+				"\"destroy_ns\": %"PRIu64" }",
+				i == 0 ? "" : ",", r->n_nodes, r->create_ns,
+				r->mem_per_node, r->find_global_ns, r->find_port_ns,
+				r->get_prop_ns, r->registry_ns, r->n_globals,
+				r->destroy_ns);
+	}
+	printf("\n  ]\n}\n");
+	fflush(stdout);
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"  -n, --nodes                           Maximum number of nodes (default %d)\n"
+		"  -p, --ports                           Ports per direction (default %d)\n"
+		"  -R, --remote                          Enumerate the registry from a client\n",
+		name, DEFAULT_NODES, DEFAULT_PORTS);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 }, *d = &data;
+	struct pw_properties *props;
+	char name[64];
+	uint32_t n_nodes;
+	int c, res;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "nodes",	required_argument,	NULL, 'n' },
+		{ "ports",	required_argument,	NULL, 'p' },
+		{ "remote",	no_argument,		NULL, 'R' },
+		{ "client",	required_argument,	NULL, 'C' },
+		{ NULL, 0, NULL, 0}
+	};
+
+	pw_init(&argc, &argv);
+
+	d->max_nodes = DEFAULT_NODES;
+	d->n_ports = DEFAULT_PORTS;
+	d->exe = "/proc/self/exe";
+
+	while ((c = getopt_long(argc, argv, "hn:p:R", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'n':
+			d->max_nodes = SPA_MAX(atoi(optarg), MIN_NODES);
+			break;
+		case 'p':
+			d->n_ports = SPA_CLAMP(atoi(optarg), 1, MAX_PORTS);
+			break;
+		case 'R':
+			d->remote = true;
+			break;
+		case 'C':
+			return run_client(atoi(optarg)) < 0 ? -1 : 0;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+
+	/* the client connects to the socket of this core */
+	snprintf(name, sizeof(name), "%s-%d", NAME, (int)getpid());
+	if ((props = pw_properties_new(PW_KEY_CORE_NAME, name, NULL)) == NULL)
+		return -1;
+	if (d->remote) {
+		pw_properties_set(props, PW_KEY_CORE_DAEMON, "true");
+		setenv("PIPEWIRE_REMOTE", name, 1);
+	}
+
+	d->loop = pw_main_loop_new(NULL);
+	if (d->loop == NULL)
+		return -1;
+	d->core = pw_core_new(pw_main_loop_get_loop(d->loop), props, 0);
+	if (d->core == NULL)
+		return -1;
+
+	if (d->remote) {
+		if (pw_module_load(d->core, "libpipewire-module-protocol-native", NULL, NULL) == NULL) {
+			fprintf(stderr, "can't load modules: %m\n");
+			return -1;
+		}
+		pw_loop_add_signal(pw_main_loop_get_loop(d->loop), SIGCHLD, on_child, d);
+	}
+
+	for (n_nodes = MIN_NODES;
+	     n_nodes <= d->max_nodes && d->n_results < SPA_N_ELEMENTS(d->results);
+	     n_nodes *= 10) {
+		if ((res = run_step(d, n_nodes, &d->results[d->n_results])) < 0) {
+			fprintf(stderr, "can't run %u nodes: %s\n", n_nodes, spa_strerror(res));
+			d->res = res;
+			break;
+		}
+		d->n_results++;
+	}
+
+	if (d->n_results > 0)
+		report(d);
+
+	pw_core_destroy(d->core);
+	pw_main_loop_destroy(d->loop);
+
+	return d->res < 0 ? -1 : 0;
+}
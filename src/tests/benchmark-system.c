@@ -0,0 +1,226 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <spa/support/system.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+
+#define N_CYCLES	1000
+#define RATE		48000
+
+struct stats {
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint32_t count;
+};
+
+struct data {
+	struct spa_system *system;
+	int timer;
+	int fwd;
+	int back;
+	bool running;
+};
+
+static void stats_add(struct stats *s, uint64_t val)
+{
+	if (s->count == 0 || val < s->min)
+		s->min = val;
+	if (val > s->max)
+		s->max = val;
+	s->sum += val;
+	s->count++;
+}
+
+static uint64_t get_time(struct spa_system *system)
+{
+	struct timespec ts;
+	spa_system_clock_gettime(system, CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int wait_fd(struct spa_system *system, int pfd, int timeout)
+{
+	struct spa_poll_event ev[1];
+	int res;
+
+	while ((res = spa_system_pollfd_wait(system, pfd, ev, 1, timeout)) == -EINTR);
+	return res;
+}
+
+/* the follower wakes up from the eventfd of the driver and signals
+ * back, like a node that is triggered and completes */
+static void *follower_thread(void *arg)
+{
+	struct data *d = arg;
+	uint64_t count;
+	int pfd;
+
+	pfd = spa_system_pollfd_create(d->system, SPA_FD_CLOEXEC);
+	spa_system_pollfd_add(d->system, pfd, d->fwd, SPA_IO_IN, NULL);
+
+	while (__atomic_load_n(&d->running, __ATOMIC_RELAXED)) {
+		if (wait_fd(d->system, pfd, 100) <= 0)
+			continue;
+		if (spa_system_eventfd_read(d->system, d->fwd, &count) < 0)
+			continue;
+		spa_system_eventfd_write(d->system, d->back, 1);
+	}
+	spa_system_close(d->system, pfd);
+	return NULL;
+}
+
+/* the driver wakes up from a timer every quantum, measures how late it
+ * woke up and the round trip to the follower */
+static void run(struct data *d, const char *name, uint32_t quantum)
+{
+	struct stats wakeup, cycle;
+	struct itimerspec its;
+	uint64_t period, next, now, t, count;
+	pthread_t thread;
+	uint32_t i;
+	int pfd;
+
+	spa_zero(wakeup);
+	spa_zero(cycle);
+	period = quantum * SPA_NSEC_PER_SEC / RATE;
+
+	pfd = spa_system_pollfd_create(d->system, SPA_FD_CLOEXEC);
+	spa_system_pollfd_add(d->system, pfd, d->timer, SPA_IO_IN, NULL);
+	spa_system_pollfd_add(d->system, pfd, d->back, SPA_IO_IN, NULL);
+
+	d->running = true;
+	pthread_create(&thread, NULL, follower_thread, d);
+
+	spa_zero(its);
+	next = get_time(d->system) + 10 * period;
+
+	for (i = 0; i < N_CYCLES; i++) {
+		its.it_value.tv_sec = next / SPA_NSEC_PER_SEC;
+		its.it_value.tv_nsec = next % SPA_NSEC_PER_SEC;
+		spa_system_timerfd_settime(d->system, d->timer, SPA_FD_TIMER_ABSTIME, &its, NULL);
+
+		if (wait_fd(d->system, pfd, 1000) <= 0 ||
+		    spa_system_timerfd_read(d->system, d->timer, &count) < 0)
+			break;
+		now = get_time(d->system);
+		stats_add(&wakeup, now - next);
+
+		spa_system_eventfd_write(d->system, d->fwd, 1);
+		if (wait_fd(d->system, pfd, 1000) <= 0 ||
+		    spa_system_eventfd_read(d->system, d->back, &count) < 0)
+			break;
+		t = get_time(d->system);
+		stats_add(&cycle, t - now);
+
+		next += period;
+		if (next < t)
+			next = t + period;
+	}
+
+	__atomic_store_n(&d->running, false, __ATOMIC_RELAXED);
+	pthread_join(thread, NULL);
+	spa_system_close(d->system, pfd);
+
+	if (wakeup.count == 0 || cycle.count == 0) {
+		fprintf(stderr, "%s: quantum %u: no cycles\n", name, quantum);
+		return;
+	}
+	fprintf(stderr, "%s: quantum %u (%"PRIu64"us) cycles %u: "
+			"wakeup min/avg/max %"PRIu64"/%"PRIu64"/%"PRIu64"us "
+			"round trip min/avg/max %"PRIu64"/%"PRIu64"/%"PRIu64"us\n",
+			name, quantum, period / 1000, cycle.count,
+			wakeup.min / 1000, wakeup.sum / wakeup.count / 1000, wakeup.max / 1000,
+			cycle.min / 1000, cycle.sum / cycle.count / 1000, cycle.max / 1000);
+}
+
+static int benchmark(const char *lib)
+{
+	static const uint32_t quanta[] = { 32, 64, 128 };
+	struct spa_handle *handle;
+	struct data d;
+	void *iface;
+	uint32_t i;
+	int res;
+
+	handle = pw_load_spa_handle(lib, SPA_NAME_SUPPORT_SYSTEM, NULL, 0, NULL);
+	if (handle == NULL) {
+		fprintf(stderr, "%s: can't load: %m\n", lib);
+		return -errno;
+	}
+	if ((res = spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_System, &iface)) < 0) {
+		fprintf(stderr, "%s: can't get System interface: %s\n", lib, spa_strerror(res));
+		goto exit;
+	}
+	spa_zero(d);
+	d.system = iface;
+	d.timer = spa_system_timerfd_create(d.system, CLOCK_MONOTONIC,
+			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	d.fwd = spa_system_eventfd_create(d.system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	d.back = spa_system_eventfd_create(d.system, SPA_FD_CLOEXEC | SPA_FD_NONBLOCK);
+	if (d.timer < 0 || d.fwd < 0 || d.back < 0) {
+		fprintf(stderr, "%s: can't create fds\n", lib);
+		res = -EIO;
+		goto close;
+	}
+
+	for (i = 0; i < SPA_N_ELEMENTS(quanta); i++)
+		run(&d, lib, quanta[i]);
+	res = 0;
+
+close:
+	if (d.timer >= 0)
+		spa_system_close(d.system, d.timer);
+	if (d.fwd >= 0)
+		spa_system_close(d.system, d.fwd);
+	if (d.back >= 0)
+		spa_system_close(d.system, d.back);
+exit:
+	pw_unload_spa_handle(handle);
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char * const libs[] = { "support/libspa-support", "support/libspa-evl" };
+	int i;
+
+	pw_init(&argc, &argv);
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++)
+			benchmark(argv[i]);
+	} else {
+		for (i = 0; i < (int)SPA_N_ELEMENTS(libs); i++)
+			benchmark(libs[i]);
+	}
+	return 0;
+}
@@ -103,6 +103,10 @@ static void test_registry_abi(void)
 		void * (*bind) (void *object, uint32_t id, uint32_t type, uint32_t version,
 				size_t user_data_size);
 		int (*destroy) (void *object, uint32_t id);
+		int (*enum_globals) (void *object, int seq, uint32_t type,
+				const struct spa_dict *props,
+				uint32_t start_id, uint32_t max_globals);
+		int (*resume) (void *object, int seq, uint32_t cookie, uint64_t serial);
 	} methods = { PW_VERSION_REGISTRY_PROXY_METHODS, };
 	struct {
 		uint32_t version;
@@ -110,19 +114,26 @@ static void test_registry_abi(void)
 			uint32_t permissions, uint32_t type, uint32_t version,
 			const struct spa_dict *props);
 		void (*global_remove) (void *object, uint32_t id);
+		void (*enum_done) (void *object, int seq, uint32_t next_id);
+		void (*resume_done) (void *object, int seq, uint32_t cookie,
+				uint64_t serial, bool full);
 	} events = { PW_VERSION_REGISTRY_PROXY_EVENTS, };
 
 	TEST_FUNC(m, methods, version);
 	TEST_FUNC(m, methods, add_listener);
 	TEST_FUNC(m, methods, bind);
 	TEST_FUNC(m, methods, destroy);
-	spa_assert(PW_VERSION_REGISTRY_PROXY_METHODS == 0);
+	TEST_FUNC(m, methods, enum_globals);
+	TEST_FUNC(m, methods, resume);
+	spa_assert(PW_VERSION_REGISTRY_PROXY_METHODS == 2);
 	spa_assert(sizeof(m) == sizeof(methods));
 
 	TEST_FUNC(e, events, version);
 	TEST_FUNC(e, events, global);
 	TEST_FUNC(e, events, global_remove);
-	spa_assert(PW_VERSION_REGISTRY_PROXY_EVENTS == 0);
+	TEST_FUNC(e, events, enum_done);
+	TEST_FUNC(e, events, resume_done);
+	spa_assert(PW_VERSION_REGISTRY_PROXY_EVENTS == 2);
 	spa_assert(sizeof(e) == sizeof(events));
 }
 
@@ -306,6 +306,64 @@ static void test_parse(void)
 	spa_assert(pw_properties_parse_double("1.234") == 1.234);
 }
 
+static void test_many(void)
+{
+	struct pw_properties *props;
+	char key[32], value[32];
+	const char *str;
+	int i;
+
+	props = pw_properties_new(NULL, NULL);
+	spa_assert(props != NULL);
+
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		spa_assert(pw_properties_setf(props, key, "%d", i) == 1);
+	}
+	spa_assert(props->dict.n_items == 100);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		snprintf(value, sizeof(value), "%d", i);
+		spa_assert((str = pw_properties_get(props, key)) != NULL);
+		spa_assert(!strcmp(str, value));
+	}
+	spa_assert(pw_properties_get(props, NULL) == NULL);
+	spa_assert(pw_properties_get(props, "") == NULL);
+	spa_assert(pw_properties_get(props, "key.100") == NULL);
+
+	/* removing moves the last item, all others must still be found */
+	for (i = 0; i < 100; i += 2) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		spa_assert(pw_properties_set(props, key, NULL) == 1);
+	}
+	spa_assert(props->dict.n_items == 50);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		str = pw_properties_get(props, key);
+		if (i & 1) {
+			snprintf(value, sizeof(value), "%d", i);
+			spa_assert(str != NULL && !strcmp(str, value));
+		} else {
+			spa_assert(str == NULL);
+		}
+	}
+	spa_assert(pw_properties_set(props, "key.1", "changed") == 1);
+	spa_assert(!strcmp(pw_properties_get(props, "key.1"), "changed"));
+
+	pw_properties_clear(props);
+	spa_assert(props->dict.n_items == 0);
+	spa_assert(pw_properties_get(props, "key.1") == NULL);
+
+	for (i = 0; i < 20; i++) {
+		snprintf(key, sizeof(key), "other.%d", i);
+		spa_assert(pw_properties_set(props, key, "x") == 1);
+	}
+	spa_assert(pw_properties_get(props, "key.1") == NULL);
+	spa_assert(!strcmp(pw_properties_get(props, "other.19"), "x"));
+
+	pw_properties_free(props);
+}
+
 int main(int argc, char *argv[])
 {
 	test_abi();
@@ -317,6 +375,7 @@ int main(int argc, char *argv[])
 	test_new_string();
 	test_update();
 	test_parse();
+	test_many();
 
 	return 0;
 }
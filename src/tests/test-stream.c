@@ -137,6 +137,7 @@ static void test_create(void)
 	struct spa_hook listener = { 0, };
 	const char *error = NULL;
 	struct pw_time tm;
+	struct pw_buffer *bufs[4];
 
 	loop = pw_main_loop_new(NULL);
 	core = pw_core_new(pw_main_loop_get_loop(loop), NULL, 12);
@@ -165,6 +166,8 @@ static void test_create(void)
 	spa_assert(tm.queued == 0);
 
 	spa_assert(pw_stream_dequeue_buffer(stream) == NULL);
+	spa_assert(pw_stream_dequeue_buffers(stream, bufs, 4) == 0);
+	spa_assert(pw_stream_queue_buffers(stream, bufs, 0) == 0);
 
 	/* check destroy */
 	destroy_count = 0;
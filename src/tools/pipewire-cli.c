@@ -48,6 +48,14 @@ struct data {
 	struct spa_list remotes;
 	struct remote_data *current;
 
+	/* batch mode, commands are read from script and only the
+	 * end of the script is synced with the server */
+	bool batch;
+	FILE *script;
+	const char *script_name;
+	int line;
+	int errors;
+
 	struct pw_map vars;
 };
 
@@ -275,12 +283,22 @@ static void show_prompt(struct remote_data *rd)
 	fflush(stdout);
 }
 
+static void run_script(struct data *data);
+
 static void on_core_done(void *_data, uint32_t id, int seq)
 {
 	struct remote_data *rd = _data;
+	struct data *data = rd->data;
+
+	if (seq != rd->prompt_pending)
+		return;
 
-	if (seq == rd->prompt_pending)
+	if (!data->batch)
 		show_prompt(rd);
+	else if (data->script)
+		run_script(data);
+	else
+		pw_main_loop_quit(data->loop);
 }
 
 static int print_global(void *obj, void *data)
@@ -583,6 +601,8 @@ static void info_node(struct proxy_data *pd)
 		fprintf(stdout, " \"%s\"\n", info->error);
 	else
 		fprintf(stdout, "\n");
+	fprintf(stdout, "%c\txruns: %u (last %"PRIu64"us)\n", MARK_CHANGE(PW_NODE_CHANGE_MASK_XRUNS),
+			info->n_xruns, info->xrun_delay / 1000);
 	print_properties(info->props, MARK_CHANGE(PW_NODE_CHANGE_MASK_PROPS), true);
 	print_params(info->params, info->n_params, MARK_CHANGE(PW_NODE_CHANGE_MASK_PARAMS), true);
 	info->change_mask = 0;
@@ -1365,6 +1385,46 @@ static bool parse(struct data *data, char *buf, size_t size, char **error)
 	return false;
 }
 
+/* Run the script until the end or until a command needs a round trip
+ * before the next one can be sent. Requests are not synced one by one,
+ * they are queued on the connection and one sync at the end waits for
+ * all of them. */
+static void run_script(struct data *data)
+{
+	struct remote_data *rd;
+	char *buf = NULL, *error;
+	size_t size = 0;
+	ssize_t r;
+
+	while ((r = getline(&buf, &size, data->script)) != -1) {
+		data->line++;
+		if (!parse(data, buf, r, &error)) {
+			fprintf(stderr, "%s:%d: Error: \"%s\"\n",
+					data->script_name, data->line, error);
+			free(error);
+			data->errors++;
+		}
+		rd = data->current;
+		if (rd == NULL)
+			break;
+		/* a new remote, continue when it is connected */
+		if (rd->core_proxy == NULL) {
+			free(buf);
+			return;
+		}
+	}
+	free(buf);
+
+	if (data->script != stdin)
+		fclose(data->script);
+	data->script = NULL;
+
+	if ((rd = data->current) == NULL)
+		pw_main_loop_quit(data->loop);
+	else
+		rd->prompt_pending = pw_core_proxy_sync(rd->core_proxy, 0, 0);
+}
+
 static void do_input(void *data, int fd, uint32_t mask)
 {
 	struct data *d = data;
@@ -1419,6 +1479,21 @@ int main(int argc, char *argv[])
 
 	pw_init(&argc, &argv);
 
+	if (argc > 2 || (argc == 2 && !strcmp(argv[1], "-h"))) {
+		fprintf(stderr, "usage: %s [<script>|-]\n", argv[0]);
+		return -1;
+	}
+	if (argc == 2) {
+		data.batch = true;
+		data.script_name = argv[1];
+		if (!strcmp(argv[1], "-"))
+			data.script = stdin;
+		else if ((data.script = fopen(argv[1], "r")) == NULL) {
+			fprintf(stderr, "can't open script %s: %m\n", argv[1]);
+			return -1;
+		}
+	}
+
 	data.loop = pw_main_loop_new(NULL);
 	l = pw_main_loop_get_loop(data.loop);
 	pw_loop_add_signal(l, SIGINT, do_quit, &data);
@@ -1432,17 +1507,21 @@ int main(int argc, char *argv[])
 
 	pw_module_load(data.core, "libpipewire-module-link-factory", NULL, NULL);
 
-	pw_loop_add_io(l, STDIN_FILENO, SPA_IO_IN|SPA_IO_HUP, false, do_input, &data);
-
-	fprintf(stdout, "Welcome to PipeWire \"%s\" version %s. Type 'help' for usage.\n", info->name, info->version);
+	if (!data.batch) {
+		pw_loop_add_io(l, STDIN_FILENO, SPA_IO_IN|SPA_IO_HUP, false, do_input, &data);
+		fprintf(stdout, "Welcome to PipeWire \"%s\" version %s. Type 'help' for usage.\n",
+				info->name, info->version);
+	}
 
 	snprintf(args, sizeof(args), "%s", info->name);
 	do_connect(&data, "connect", args, &error);
 
 	pw_main_loop_run(data.loop);
 
+	if (data.script && data.script != stdin)
+		fclose(data.script);
 	pw_core_destroy(data.core);
 	pw_main_loop_destroy(data.loop);
 
-	return 0;
+	return data.errors > 0 ? -1 : 0;
 }
@@ -274,6 +274,8 @@ static void print_node(struct proxy_data *data)
 			printf(" \"%s\"\n", info->error);
 		else
 			printf("\n");
+		printf("%c\txruns: %u (last %"PRIu64"us)\n", MARK_CHANGE(PW_NODE_CHANGE_MASK_XRUNS),
+				info->n_xruns, info->xrun_delay / 1000);
 		print_properties(info->props, MARK_CHANGE(PW_NODE_CHANGE_MASK_PROPS));
 	}
 }
@@ -0,0 +1,450 @@
+/* PipeWire
+ *
+ * Copyright © 2019 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <spa/utils/result.h>
+
+#include <pipewire/interfaces.h>
+#include <pipewire/type.h>
+#include <pipewire/remote.h>
+#include <pipewire/main-loop.h>
+#include <pipewire/pipewire.h>
+#include <pipewire/profiler.h>
+
+#define N_BUCKETS	16	/* busy time histogram, bucket n is [2^n, 2^(n+1)) usec */
+
+/* Columns: QUANT and RATE of the driver, average WAIT and BUSY time in
+ * usec, CPU the average thread cpu time in usec when the daemon runs with
+ * core.cpu-time, B/Q the max busy time as a fraction of the period, LOAD the DSP
+ * load of the driver over short, medium and long time, ERR the xruns
+ * reported by the node and BLAME the xruns of the driver where this node
+ * was busy the longest. */
+
+struct node {
+	struct spa_list link;
+	uint32_t id;
+	char name[64];
+
+	uint64_t count;
+	uint64_t wait_sum;
+	uint64_t wait_max;
+	uint64_t busy_sum;
+	uint64_t busy_max;
+	uint64_t cpu_sum;
+	uint32_t hist[N_BUCKETS];
+	uint32_t xruns;			/* xruns attributed to this node */
+
+	/* from the last record of the node */
+	uint32_t driver_id;
+	uint32_t quantum;
+	uint32_t rate;
+	float cpu_load[3];
+	uint32_t xrun_count;
+	uint32_t xrun_last;		/* xrun_count at the last print */
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+
+	struct pw_remote *remote;
+	struct spa_hook remote_listener;
+
+	struct pw_core_proxy *core_proxy;
+	struct pw_registry_proxy *registry_proxy;
+	struct spa_hook registry_listener;
+
+	const char *remote_name;
+	char shm_name[128];
+	int fd;
+	size_t map_size;
+	struct pw_profiler_header *header;
+	void *ring;
+
+	struct spa_source *timer;
+	uint64_t last_dropped;
+	bool tty;
+
+	/* records of the cycle being collected */
+	struct pw_profiler_record cycle[1024];
+	uint32_t n_cycle;
+
+	struct spa_list nodes;
+};
+
+static struct node *find_node(struct data *d, uint32_t id, bool create)
+{
+	struct node *n;
+
+	spa_list_for_each(n, &d->nodes, link)
+		if (n->id == id)
+			return n;
+	if (!create)
+		return NULL;
+
+	if ((n = calloc(1, sizeof(*n))) == NULL)
+		return NULL;
+	n->id = id;
+	snprintf(n->name, sizeof(n->name), "%u", id);
+	spa_list_append(&d->nodes, &n->link);
+	return n;
+}
+
+static void process_cycle(struct data *d)
+{
+	struct pw_profiler_record *dr = &d->cycle[0], *r, *worst = NULL;
+	uint64_t period, busy, worst_busy = 0;
+	struct node *n;
+	uint32_t i;
+	bool xrun;
+
+	if (d->n_cycle == 0)
+		return;
+
+	for (i = 0; i < d->n_cycle; i++) {
+		r = &d->cycle[i];
+		if ((n = find_node(d, r->node_id, true)) == NULL)
+			continue;
+
+		if (r->finish_time < r->awake_time || r->awake_time < r->signal_time)
+			continue;
+
+		n->driver_id = r->driver_id;
+		n->quantum = r->duration;
+		n->rate = r->rate;
+		memcpy(n->cpu_load, r->cpu_load, sizeof(n->cpu_load));
+		n->xrun_count = r->xrun_count;
+
+		busy = r->finish_time - r->awake_time;
+		n->count++;
+		n->wait_sum += r->awake_time - r->signal_time;
+		n->wait_max = SPA_MAX(n->wait_max, r->awake_time - r->signal_time);
+		n->busy_sum += busy;
+		n->busy_max = SPA_MAX(n->busy_max, busy);
+		n->cpu_sum += r->cpu_time;
+		n->hist[SPA_MIN(busy < 1000 ? 0 : 63 - __builtin_clzll(busy / 1000),
+				N_BUCKETS - 1)]++;
+
+		if (i > 0 && busy >= worst_busy) {
+			worst = r;
+			worst_busy = busy;
+		}
+	}
+
+	/* the cycle of the driver took longer than the period, blame the
+	 * follower that was busy for the longest time */
+	period = dr->rate ? (uint64_t)dr->duration * SPA_NSEC_PER_SEC / dr->rate : 0;
+	xrun = period > 0 && dr->finish_time - dr->signal_time > period;
+	if (xrun && (n = find_node(d, worst ? worst->node_id : dr->node_id, false)) != NULL)
+		n->xruns++;
+
+	d->n_cycle = 0;
+}
+
+static void read_records(struct data *d)
+{
+	struct pw_profiler_header *h = d->header;
+	struct pw_profiler_record r;
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&h->ring, &index);
+	if (avail > (int32_t)h->size) {
+		fprintf(stderr, "profiler overrun, skipping %d bytes\n", avail);
+		index += avail;
+		spa_ringbuffer_read_update(&h->ring, index);
+		d->n_cycle = 0;
+		return;
+	}
+	while (avail >= (int32_t)sizeof(r)) {
+		spa_ringbuffer_read_data(&h->ring, d->ring, h->size,
+				index & (h->size - 1), &r, sizeof(r));
+		index += sizeof(r);
+		avail -= sizeof(r);
+
+		if (d->n_cycle > 0 &&
+		    (d->cycle[0].cycle != r.cycle || d->cycle[0].driver_id != r.driver_id))
+			process_cycle(d);
+		if (d->n_cycle < SPA_N_ELEMENTS(d->cycle))
+			d->cycle[d->n_cycle++] = r;
+	}
+	spa_ringbuffer_read_update(&h->ring, index);
+}
+
+static void print_node(struct data *d, struct node *n, bool follower)
+{
+	uint64_t period;
+	uint32_t i;
+
+	period = n->rate ? (uint64_t)n->quantum * SPA_NSEC_PER_SEC / n->rate : 0;
+
+	printf("%-6u %6u %6u %8.1f %8.1f %8.1f %5.2f ",
+			n->id, n->quantum, n->rate,
+			n->wait_sum / (n->count * 1000.0),
+			n->busy_sum / (n->count * 1000.0),
+			n->cpu_sum / (n->count * 1000.0),
+			period ? (double)n->busy_max / period : 0.0);
+	if (follower)
+		printf("%-18s", "");
+	else
+		printf("%5.2f %5.2f %5.2f ", n->cpu_load[0], n->cpu_load[1], n->cpu_load[2]);
+	printf("%5u %5u ", n->xrun_count - n->xrun_last, n->xruns);
+	if (follower)
+		printf(" + %-21.21s", n->name);
+	else
+		printf("%-24.24s", n->name);
+	if (!d->tty) {
+		printf(" %8"PRIu64" %8.1f %8.1f ", n->count,
+				n->wait_max / 1000.0, n->busy_max / 1000.0);
+		for (i = 0; i < N_BUCKETS; i++)
+			printf(" %u", n->hist[i]);
+	}
+	printf("\n");
+}
+
+static void reset_node(struct node *n)
+{
+	n->count = n->wait_sum = n->wait_max = n->busy_sum = n->busy_max = 0;
+	n->cpu_sum = 0;
+	n->xruns = 0;
+	n->xrun_last = n->xrun_count;
+	memset(n->hist, 0, sizeof(n->hist));
+}
+
+/* one line per driver with its followers below it. On a terminal the
+ * screen is redrawn, otherwise the max times and the busy time histogram
+ * (usec, log2) are appended and the blocks are printed one after the other */
+static void print_stats(struct data *d)
+{
+	struct node *n, *f;
+
+	if (d->tty)
+		printf("\033[H\033[2J");
+	else
+		printf("\n");
+
+	printf("%-6s %6s %6s %8s %8s %8s %5s %5s %5s %5s %5s %5s %s",
+			"ID", "QUANT", "RATE", "WAIT", "BUSY", "CPU", "B/Q",
+			"LOAD", "LOAD", "LOAD", "ERR", "BLAME", "NAME");
+	if (!d->tty)
+		printf("%-20s %8s %8s %8s  histogram", "", "CYCLES", "WAITMAX", "BUSYMAX");
+	printf("\n");
+
+	spa_list_for_each(n, &d->nodes, link) {
+		if (n->count == 0 || n->driver_id != n->id)
+			continue;
+		print_node(d, n, false);
+		spa_list_for_each(f, &d->nodes, link) {
+			if (f->count == 0 || f == n || f->driver_id != n->id)
+				continue;
+			print_node(d, f, true);
+		}
+	}
+	spa_list_for_each(n, &d->nodes, link)
+		reset_node(n);
+
+	if (d->header->dropped != d->last_dropped) {
+		printf("dropped %"PRIu64" records\n", d->header->dropped - d->last_dropped);
+		d->last_dropped = d->header->dropped;
+	}
+	fflush(stdout);
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+
+	read_records(d);
+	print_stats(d);
+}
+
+static int map_header(struct data *d)
+{
+	struct pw_profiler_header h;
+
+	pw_profiler_shm_name(d->shm_name, sizeof(d->shm_name), d->remote_name);
+
+	if ((d->fd = shm_open(d->shm_name, O_RDWR | O_CLOEXEC, 0)) < 0) {
+		fprintf(stderr, "can't open %s: %m\n", d->shm_name);
+		fprintf(stderr, "is the daemon running with core.profiler = true?\n");
+		return -errno;
+	}
+	if (read(d->fd, &h, sizeof(h)) != sizeof(h) ||
+	    h.magic != PW_PROFILER_MAGIC || h.version != PW_PROFILER_VERSION ||
+	    h.record_size != sizeof(struct pw_profiler_record)) {
+		fprintf(stderr, "invalid profiler header in %s\n", d->shm_name);
+		return -EINVAL;
+	}
+	d->map_size = sizeof(h) + h.size;
+	d->header = mmap(NULL, d->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, d->fd, 0);
+	if (d->header == MAP_FAILED) {
+		fprintf(stderr, "can't mmap %s: %m\n", d->shm_name);
+		return -errno;
+	}
+	d->ring = SPA_MEMBER(d->header, sizeof(h), void);
+	d->last_dropped = d->header->dropped;
+
+	/* skip what was recorded before we started */
+	d->header->ring.readindex = d->header->ring.writeindex;
+
+	return 0;
+}
+
+static void registry_event_global(void *data, uint32_t id,
+				  uint32_t permissions, uint32_t type, uint32_t version,
+				  const struct spa_dict *props)
+{
+	struct data *d = data;
+	struct node *n;
+	const char *str;
+
+	if (type != PW_TYPE_INTERFACE_Node || props == NULL)
+		return;
+	if ((str = spa_dict_lookup(props, PW_KEY_NODE_NAME)) == NULL)
+		return;
+	if ((n = find_node(d, id, true)) != NULL)
+		snprintf(n->name, sizeof(n->name), "%s", str);
+}
+
+static void registry_event_global_remove(void *data, uint32_t id)
+{
+	struct data *d = data;
+	struct node *n;
+
+	if ((n = find_node(d, id, false)) != NULL) {
+		spa_list_remove(&n->link);
+		free(n);
+	}
+}
+
+static const struct pw_registry_proxy_events registry_events = {
+	PW_VERSION_REGISTRY_PROXY_EVENTS,
+	.global = registry_event_global,
+	.global_remove = registry_event_global_remove,
+};
+
+static void on_state_changed(void *_data, enum pw_remote_state old,
+			     enum pw_remote_state state, const char *error)
+{
+	struct data *data = _data;
+
+	switch (state) {
+	case PW_REMOTE_STATE_ERROR:
+		/* we can still profile, but without node names */
+		fprintf(stderr, "remote error: %s\n", error);
+		break;
+
+	case PW_REMOTE_STATE_CONNECTED:
+		data->core_proxy = pw_remote_get_core_proxy(data->remote);
+		data->registry_proxy = pw_core_proxy_get_registry(data->core_proxy,
+								  PW_VERSION_REGISTRY_PROXY, 0);
+		pw_registry_proxy_add_listener(data->registry_proxy,
+					       &data->registry_listener,
+					       &registry_events, data);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static const struct pw_remote_events remote_events = {
+	PW_VERSION_REMOTE_EVENTS,
+	.state_changed = on_state_changed,
+};
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	struct pw_loop *l;
+	struct pw_properties *props = NULL;
+	struct timespec value, interval;
+	struct node *n;
+	int res;
+
+	pw_init(&argc, &argv);
+
+	spa_list_init(&data.nodes);
+
+	data.tty = isatty(STDOUT_FILENO);
+	data.remote_name = argc > 1 ? argv[1] : getenv("PIPEWIRE_REMOTE");
+	if (data.remote_name == NULL)
+		data.remote_name = "pipewire-0";
+
+	if ((res = map_header(&data)) < 0)
+		return -1;
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL)
+		return -1;
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+
+	data.core = pw_core_new(l, NULL, 0);
+	if (data.core == NULL)
+		return -1;
+
+	props = pw_properties_new(PW_KEY_REMOTE_NAME, data.remote_name, NULL);
+	data.remote = pw_remote_new(data.core, props, 0);
+	if (data.remote == NULL)
+		return -1;
+
+	pw_remote_add_listener(data.remote, &data.remote_listener, &remote_events, &data);
+	if ((res = pw_remote_connect(data.remote)) < 0)
+		fprintf(stderr, "can't connect: %s\n", spa_strerror(res));
+
+	data.timer = pw_loop_add_timer(l, on_timeout, &data);
+	value.tv_sec = interval.tv_sec = 1;
+	value.tv_nsec = interval.tv_nsec = 0;
+	pw_loop_update_timer(l, data.timer, &value, &interval, false);
+
+	pw_main_loop_run(data.loop);
+
+	spa_list_consume(n, &data.nodes, link) {
+		spa_list_remove(&n->link);
+		free(n);
+	}
+	munmap(data.header, data.map_size);
+	close(data.fd);
+
+	pw_remote_destroy(data.remote);
+	pw_core_destroy(data.core);
+	pw_main_loop_destroy(data.loop);
+
+	return 0;
+}
@@ -0,0 +1,359 @@
+/* PipeWire
+ *
+ * Copyright © 2020 Wim Taymans
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <spa/pod/parser.h>
+#include <spa/pod/builder.h>
+
+#include <pipewire/interfaces.h>
+
+#include "module-protocol-native/capture.h"
+
+/* Sends the client side of a protocol capture to a daemon as fast as the
+ * socket takes it and reports how long the daemon needed to handle all of
+ * it. A client always talks first so the direction of the first record
+ * is the direction of the client messages. Messages with fds can't be
+ * replayed and are skipped, replies are read and dropped. */
+
+#define HDR_SIZE	16
+#define SYNC_SEQ	0x7fff0001
+
+struct data {
+	const char *remote;
+
+	uint8_t *out;
+	size_t out_size;
+	size_t out_maxsize;
+	uint32_t n_messages;
+	uint32_t n_skipped;
+
+	uint8_t in[64 * 1024];
+	size_t in_size;
+	uint32_t n_replies;
+	bool done;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int add_message(struct data *d, uint32_t id, uint32_t opcode, uint32_t seq,
+		const void *payload, uint32_t size)
+{
+	uint32_t *p;
+
+	if (d->out_size + HDR_SIZE + size > d->out_maxsize) {
+		size_t maxsize = SPA_MAX(d->out_maxsize * 2, d->out_size + HDR_SIZE + size);
+		uint8_t *out = realloc(d->out, maxsize);
+		if (out == NULL)
+			return -errno;
+		d->out = out;
+		d->out_maxsize = maxsize;
+	}
+	p = SPA_MEMBER(d->out, d->out_size, uint32_t);
+	p[0] = id;
+	p[1] = (opcode << 24) | (size & 0xffffff);
+	p[2] = seq;
+	p[3] = 0;
+	memcpy(&p[4], payload, size);
+	d->out_size += HDR_SIZE + size;
+	return 0;
+}
+
+static int load_capture(struct data *d, const char *path)
+{
+	struct pw_protocol_native_capture_header hdr;
+	struct pw_protocol_native_capture_record rec;
+	uint32_t direction = 0;
+	bool first = true;
+	void *payload = NULL;
+	FILE *f;
+	int res = 0;
+
+	if ((f = fopen(path, "re")) == NULL)
+		return -errno;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    hdr.magic != PW_PROTOCOL_NATIVE_CAPTURE_MAGIC ||
+	    hdr.version != PW_PROTOCOL_NATIVE_CAPTURE_VERSION) {
+		res = -EINVAL;
+		goto exit;
+	}
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		void *p;
+
+		if ((p = realloc(payload, SPA_MAX(rec.size, 1u))) == NULL) {
+			res = -errno;
+			goto exit;
+		}
+		payload = p;
+		if (rec.size > 0 && fread(payload, rec.size, 1, f) != 1) {
+			res = -EINVAL;
+			goto exit;
+		}
+		if (first) {
+			direction = rec.flags & PW_PROTOCOL_NATIVE_CAPTURE_FLAG_IN;
+			first = false;
+		}
+		if ((rec.flags & PW_PROTOCOL_NATIVE_CAPTURE_FLAG_IN) != direction)
+			continue;
+		if (rec.n_fds > 0) {
+			d->n_skipped++;
+			continue;
+		}
+		if ((res = add_message(d, rec.id, rec.opcode, rec.seq, payload, rec.size)) < 0)
+			goto exit;
+		d->n_messages++;
+	}
+exit:
+	free(payload);
+	fclose(f);
+	return res;
+}
+
+static int add_sync(struct data *d)
+{
+	uint8_t buffer[64];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+
+	spa_pod_builder_add_struct(&b,
+			SPA_POD_Int(0),
+			SPA_POD_Int(SYNC_SEQ));
+	return add_message(d, 0, PW_CORE_PROXY_METHOD_SYNC, 0, buffer, b.state.offset);
+}
+
+static int connect_remote(struct data *d)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	const char *runtime_dir;
+	int fd;
+
+	if ((runtime_dir = getenv("XDG_RUNTIME_DIR")) == NULL) {
+		fprintf(stderr, "XDG_RUNTIME_DIR not set in the environment\n");
+		return -EIO;
+	}
+	if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s",
+				runtime_dir, d->remote) >= (int)sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+
+	if ((fd = socket(PF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+		return -errno;
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		int res = -errno;
+		close(fd);
+		return res;
+	}
+	return fd;
+}
+
+static void check_done(struct data *d, uint32_t id, uint32_t opcode,
+		const void *payload, uint32_t size)
+{
+	struct spa_pod_parser prs;
+	int32_t sync_id, seq;
+
+	if (id != 0 || opcode != PW_CORE_PROXY_EVENT_DONE)
+		return;
+
+	if (size == 2 * sizeof(uint32_t)) {
+		/* compact encoding */
+		const int32_t *c = payload;
+		seq = c[1];
+	} else {
+		spa_pod_parser_init(&prs, payload, size);
+		if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&sync_id),
+				SPA_POD_Int(&seq)) < 0)
+			return;
+	}
+	if (seq == SYNC_SEQ)
+		d->done = true;
+}
+
+/* read and drop the replies, close any fds the daemon sends */
+static int read_replies(struct data *d, int fd)
+{
+	uint8_t cmsgbuf[CMSG_SPACE(sizeof(int) * 28)];
+	struct iovec iov;
+	struct msghdr msg = { 0 };
+	struct cmsghdr *cmsg;
+	ssize_t len;
+	size_t offset = 0;
+
+	iov.iov_base = d->in + d->in_size;
+	iov.iov_len = sizeof(d->in) - d->in_size;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	if ((len = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) < 0)
+		return errno == EAGAIN || errno == EINTR ? 0 : -errno;
+	if (len == 0)
+		return -EPIPE;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		int *fds = (int*)CMSG_DATA(cmsg);
+		size_t i, n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+		for (i = 0; i < n_fds; i++)
+			close(fds[i]);
+	}
+	d->in_size += len;
+
+	while (d->in_size - offset >= HDR_SIZE) {
+		uint32_t *p = SPA_MEMBER(d->in, offset, uint32_t);
+		uint32_t size = p[1] & 0xffffff;
+
+		if (HDR_SIZE + size > sizeof(d->in))
+			return -EPROTO;
+		if (d->in_size - offset < HDR_SIZE + size)
+			break;
+		check_done(d, p[0], p[1] >> 24, &p[4], size);
+		d->n_replies++;
+		offset += HDR_SIZE + size;
+	}
+	memmove(d->in, d->in + offset, d->in_size - offset);
+	d->in_size -= offset;
+	return 0;
+}
+
+static int replay(struct data *d, int fd)
+{
+	size_t sent = 0;
+	int res;
+
+	while (!d->done) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		if (sent < d->out_size)
+			pfd.events |= POLLOUT;
+
+		if (poll(&pfd, 1, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (pfd.revents & POLLOUT) {
+			ssize_t len = send(fd, d->out + sent, d->out_size - sent, MSG_NOSIGNAL);
+			if (len < 0 && errno != EAGAIN && errno != EINTR)
+				return -errno;
+			if (len > 0)
+				sent += len;
+		}
+		if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+			if ((res = read_replies(d, fd)) < 0)
+				return res;
+		}
+	}
+	return 0;
+}
+
+static void show_help(const char *name)
+{
+	fprintf(stdout, "%s [options] <capture>\n"
+		"  -h, --help                            Show this help\n"
+		"  -r, --remote                          Remote daemon name\n\n"
+		"Captures are made by running a client or the daemon with\n"
+		"PIPEWIRE_PROTOCOL_CAPTURE=<prefix> in the environment.\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 };
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "remote",	required_argument,	NULL, 'r' },
+		{ NULL, 0, NULL, 0}
+	};
+	uint64_t start, elapsed;
+	int c, fd, res;
+
+	if ((data.remote = getenv("PIPEWIRE_REMOTE")) == NULL)
+		data.remote = "pipewire-0";
+
+	while ((c = getopt_long(argc, argv, "hr:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0]);
+			return 0;
+		case 'r':
+			data.remote = optarg;
+			break;
+		default:
+			show_help(argv[0]);
+			return -1;
+		}
+	}
+	if (optind >= argc) {
+		show_help(argv[0]);
+		return -1;
+	}
+
+	if ((res = load_capture(&data, argv[optind])) < 0) {
+		fprintf(stderr, "can't load capture %s: %s\n", argv[optind], strerror(-res));
+		return -1;
+	}
+	if ((res = add_sync(&data)) < 0) {
+		fprintf(stderr, "can't add sync: %s\n", strerror(-res));
+		return -1;
+	}
+	if ((fd = connect_remote(&data)) < 0) {
+		fprintf(stderr, "can't connect to %s: %s\n", data.remote, strerror(-fd));
+		return -1;
+	}
+
+	start = get_time_ns();
+	res = replay(&data, fd);
+	elapsed = get_time_ns() - start;
+	close(fd);
+
+	if (res < 0)
+		fprintf(stderr, "replay failed: %s\n", strerror(-res));
+
+	fprintf(stdout, "%u messages (%zu bytes), %u skipped, %u replies in %.3f ms",
+			data.n_messages, data.out_size, data.n_skipped, data.n_replies,
+			elapsed / 1000000.0);
+	if (elapsed > 0)
+		fprintf(stdout, ", %.0f messages/s", data.n_messages * 1e9 / elapsed);
+	fprintf(stdout, "\n");
+
+	free(data.out);
+	return res < 0 ? -1 : 0;
+}